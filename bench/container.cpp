@@ -0,0 +1,481 @@
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "audio/encoder.hpp"
+#include "audio/opus.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "muxer/audio_producer.hpp"
+#include "muxer/faststart_mp4_muxer.hpp"
+#include "muxer/mp4_muxer.hpp"
+#include "muxer/simple_mp4_muxer.hpp"
+#include "muxer/video_producer.hpp"
+#include "video/buffer_vpx_encoder.hpp"
+#include "video/vpx.hpp"
+#include "webm/input/audio_context.hpp"
+#include "webm/input/context.hpp"
+#include "webm/input/video_context.hpp"
+#include "webm/output/context.hpp"
+
+#include "measure.hpp"
+
+// WebM の読み書きと MP4 の書き出しの速度を, エンコードせずに作ったパケット列で測る.
+// 引数を与えた場合は, 名前にその文字列を含むベンチマークだけを実行する
+
+namespace {
+
+using hisui::bench::measure;
+using hisui::bench::Measurement;
+using hisui::bench::to_seconds;
+
+const std::uint32_t WIDTH = 1280;
+const std::uint32_t HEIGHT = 720;
+const std::uint64_t DURATION = 300;  // 秒
+const std::uint64_t FRAME_RATE = 25;
+const std::uint64_t KEY_FRAME_INTERVAL = 2 * FRAME_RATE;
+// キーフレームは他のフレームのこの倍の大きさにする
+const std::uint64_t KEY_FRAME_SIZE_RATIO = 8;
+const std::uint64_t AUDIO_FRAME_SAMPLES = 960;  // 20 ms
+const std::size_t OPUS_PACKET_SIZE = 160;
+const std::array<std::uint32_t, 2> VIDEO_BIT_RATES = {500, 2500};  // kbps
+const ::opus_int32 OPUS_SKIP = 312;
+// producer の parameters は参照を持つので, 空の配列も残しておく
+const std::vector<hisui::ArchiveItem> NO_ARCHIVES = {};
+
+struct Stream {
+  // timestamp は ns
+  std::vector<hisui::Frame> frames;
+  std::size_t size = 0;
+};
+
+// frames の各要素は 1 つの領域を分け合う
+Stream make_stream(const std::vector<std::size_t>& sizes,
+                   const std::vector<bool>& is_keys,
+                   const std::uint64_t interval,
+                   const std::vector<std::uint8_t>& key_frame_header,
+                   const std::uint32_t seed) {
+  Stream stream;
+  for (const auto size : sizes) {
+    stream.size += size;
+  }
+  const std::shared_ptr<std::uint8_t[]> storage(
+      new std::uint8_t[stream.size]);
+  std::mt19937 engine(seed);
+  std::generate_n(storage.get(), stream.size, [&engine] {
+    return static_cast<std::uint8_t>(engine());
+  });
+
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < std::size(sizes); ++i) {
+    std::shared_ptr<std::uint8_t[]> data(storage, storage.get() + offset);
+    if (is_keys[i]) {
+      std::copy_n(std::data(key_frame_header),
+                  std::min(std::size(key_frame_header), sizes[i]), data.get());
+    }
+    stream.frames.push_back(hisui::Frame{.timestamp = i * interval,
+                                         .data = data,
+                                         .data_size = sizes[i],
+                                         .is_key = is_keys[i]});
+    offset += sizes[i];
+  }
+  return stream;
+}
+
+// 先頭を解析された場合に備えて, キーフレームは本物の VP9 のキーフレームで始める
+std::vector<std::uint8_t> encode_key_frame(const std::uint32_t bit_rate) {
+  hisui::Config config;
+  config.out_video_codec = hisui::config::OutVideoCodec::VP9;
+  config.out_video_bit_rate = bit_rate;
+  hisui::FrameQueue queue;
+  hisui::video::BufferVPXEncoder encoder(
+      &queue, hisui::video::VPXEncoderConfig(WIDTH, HEIGHT, config));
+  std::vector<unsigned char> image(WIDTH * HEIGHT * 3 >> 1, 0x80);
+  encoder.outputImage(image);
+  encoder.flush();
+  const auto frame = queue.front();
+  if (!frame || !frame->is_key) {
+    throw std::runtime_error("encoding key frame failed");
+  }
+  return {frame->data.get(), frame->data.get() + frame->data_size};
+}
+
+// 平均が bit_rate になるよう, キーフレーム以外の大きさを ±30% の範囲でばらつかせる
+Stream make_video_stream(const std::uint32_t bit_rate) {
+  const auto number_of_frames = DURATION * FRAME_RATE;
+  const auto base_size =
+      static_cast<double>(bit_rate) * 1000 / 8 / FRAME_RATE *
+      KEY_FRAME_INTERVAL / (KEY_FRAME_INTERVAL - 1 + KEY_FRAME_SIZE_RATIO);
+  std::mt19937 engine(bit_rate);
+  std::uniform_real_distribution<double> distribution(0.7, 1.3);
+  std::vector<std::size_t> sizes;
+  std::vector<bool> is_keys;
+  for (std::uint64_t i = 0; i < number_of_frames; ++i) {
+    const bool is_key = i % KEY_FRAME_INTERVAL == 0;
+    const auto size = base_size * distribution(engine) *
+                      (is_key ? KEY_FRAME_SIZE_RATIO : 1);
+    sizes.push_back(static_cast<std::size_t>(size));
+    is_keys.push_back(is_key);
+  }
+  return make_stream(sizes, is_keys, hisui::Constants::NANO_SECOND / FRAME_RATE,
+                     encode_key_frame(bit_rate), 0);
+}
+
+Stream make_audio_stream() {
+  const auto number_of_frames =
+      DURATION * hisui::Constants::PCM_SAMPLE_RATE / AUDIO_FRAME_SAMPLES;
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<std::size_t> distribution(
+      OPUS_PACKET_SIZE * 3 / 4, OPUS_PACKET_SIZE * 5 / 4);
+  std::vector<std::size_t> sizes;
+  for (std::uint64_t i = 0; i < number_of_frames; ++i) {
+    sizes.push_back(distribution(engine));
+  }
+  return make_stream(sizes, std::vector<bool>(number_of_frames, true),
+                     AUDIO_FRAME_SAMPLES * hisui::Constants::NANO_SECOND /
+                         hisui::Constants::PCM_SAMPLE_RATE,
+                     {}, 1);
+}
+
+// AsyncWebMMuxer と同じく, timestamp の順に映像と音声を交互に書く
+void write_webm(const std::filesystem::path& path,
+                const Stream& video,
+                const Stream& audio) {
+  hisui::webm::output::Context context(path.string());
+  context.init();
+  context.setVideoTrack(WIDTH, HEIGHT, hisui::Constants::VP9_FOURCC, nullptr,
+                        0);
+  const auto private_data =
+      hisui::audio::create_opus_private_data({.skip = OPUS_SKIP});
+  context.setAudioTrack(static_cast<std::uint64_t>(OPUS_SKIP) *
+                            hisui::Constants::NANO_SECOND /
+                            hisui::Constants::PCM_SAMPLE_RATE,
+                        private_data.data(), std::size(private_data));
+  auto v = std::begin(video.frames);
+  auto a = std::begin(audio.frames);
+  while (v != std::end(video.frames) || a != std::end(audio.frames)) {
+    if (a == std::end(audio.frames) ||
+        (v != std::end(video.frames) && v->timestamp <= a->timestamp)) {
+      context.addVideoFrame(v->data.get(), v->data_size, v->timestamp,
+                            v->is_key);
+      ++v;
+    } else {
+      context.addAudioFrame(a->data.get(), a->data_size, a->timestamp);
+      ++a;
+    }
+  }
+}
+
+// ページキャッシュから落として, 次に読む際にディスクから読ませる
+void drop_page_cache(const std::filesystem::path& path, const bool sync) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("opening {} failed: {}",
+                                         path.string(), std::strerror(errno)));
+  }
+  // 書き込み中のページは落とせないので, 書き終えた直後は先に書き出す
+  if (sync) {
+    ::fsync(fd);
+  }
+  const int ret = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+  if (ret != 0) {
+    throw std::runtime_error(fmt::format("posix_fadvise() failed: {}",
+                                         std::strerror(ret)));
+  }
+}
+
+// 書いたフレームが全て読めることも確かめる
+template <class T>
+void read_frames(const std::filesystem::path& path,
+                 const std::size_t expected_frames) {
+  T context(path.string());
+  if (!context.init()) {
+    throw std::runtime_error(fmt::format("opening {} failed", path.string()));
+  }
+  std::size_t frames = 0;
+  while (context.readFrame()) {
+    ++frames;
+  }
+  if (frames != expected_frames) {
+    throw std::runtime_error(fmt::format("{} frames were read from {}: {}",
+                                         frames, path.string(),
+                                         expected_frames));
+  }
+}
+
+void report_throughput(const std::string& name,
+                       const Measurement& m,
+                       const std::size_t frames_per_iteration,
+                       const std::size_t bytes_per_iteration) {
+  const auto seconds = to_seconds(m.elapsed);
+  fmt::print("{:<48} {:>12.1f} packets/s {:>10.1f} MiB/s\n", name,
+             static_cast<double>(m.iterations * frames_per_iteration) /
+                 seconds,
+             static_cast<double>(m.iterations * bytes_per_iteration) /
+                 seconds / (1 << 20));
+}
+
+void bench_webm(const std::function<bool(const std::string&)>& is_selected,
+                const Stream& video,
+                const Stream& audio,
+                const std::string& suffix,
+                const std::filesystem::path& path) {
+  const std::size_t frames = std::size(video.frames) + std::size(audio.frames);
+  const std::size_t size = video.size + audio.size;
+  const auto writer_name = "webm/writer/" + suffix;
+  if (is_selected(writer_name)) {
+    report_throughput(writer_name,
+                      measure([&path, &video, &audio](std::uint64_t) {
+                        write_webm(path, video, audio);
+                      }),
+                      frames, size);
+  }
+
+  write_webm(path, video, audio);
+  drop_page_cache(path, true);
+  for (const bool is_cold : {false, true}) {
+    const std::string cache = is_cold ? "cold" : "warm";
+    const auto video_name = fmt::format("webm/reader/video/{}/{}", suffix,
+                                        cache);
+    if (is_selected(video_name)) {
+      report_throughput(
+          video_name, measure([&path, &video, is_cold](std::uint64_t) {
+            if (is_cold) {
+              drop_page_cache(path, false);
+            }
+            read_frames<hisui::webm::input::VideoContext>(
+                path, std::size(video.frames));
+          }),
+          std::size(video.frames), video.size);
+    }
+    const auto audio_name = fmt::format("webm/reader/audio/{}/{}", suffix,
+                                        cache);
+    if (is_selected(audio_name)) {
+      report_throughput(
+          audio_name, measure([&path, &audio, is_cold](std::uint64_t) {
+            if (is_cold) {
+              drop_page_cache(path, false);
+            }
+            read_frames<hisui::webm::input::AudioContext>(
+                path, std::size(audio.frames));
+          }),
+          std::size(audio.frames), audio.size);
+    }
+  }
+}
+
+// Opus のエンコーダーの代わりに, 合成した sample の数に応じて作っておいたパケットを出力する
+class SyntheticAudioEncoder : public hisui::audio::Encoder {
+ public:
+  SyntheticAudioEncoder(hisui::FrameQueue* t_buffer, const Stream& t_stream)
+      : m_buffer(t_buffer), m_stream(t_stream) {}
+
+  void addSamples(const std::int16_t*,
+                  const std::size_t number_of_samples) override {
+    m_samples += number_of_samples;
+    while (m_samples >= AUDIO_FRAME_SAMPLES &&
+           m_index < std::size(m_stream.frames)) {
+      const auto& frame = m_stream.frames[m_index];
+      m_buffer->push(hisui::Frame{.timestamp = m_index * AUDIO_FRAME_SAMPLES,
+                                  .data = frame.data,
+                                  .data_size = frame.data_size,
+                                  .is_key = true});
+      m_samples -= AUDIO_FRAME_SAMPLES;
+      ++m_index;
+    }
+  }
+
+  void flush() override {}
+
+ private:
+  hisui::FrameQueue* m_buffer;
+  const Stream& m_stream;
+  std::size_t m_samples = 0;
+  std::size_t m_index = 0;
+};
+
+class SyntheticAudioProducer : public hisui::muxer::AudioProducer {
+ public:
+  explicit SyntheticAudioProducer(const Stream& stream)
+      : AudioProducer({.archives = NO_ARCHIVES,
+                       .mixer = hisui::config::AudioMixer::Simple,
+                       .duration = static_cast<double>(DURATION),
+                       .show_progress_bar = false}) {
+    m_encoder = std::make_shared<SyntheticAudioEncoder>(&m_buffer, stream);
+  }
+};
+
+// 合成とエンコードをせず, 作っておいたフレームを MP4 の timescale で出力する
+class SyntheticVideoProducer : public hisui::muxer::VideoProducer {
+ public:
+  explicit SyntheticVideoProducer(const Stream& t_stream)
+      : VideoProducer({.show_progress_bar = false}), m_stream(t_stream) {}
+
+  void produce() override {
+    for (const auto& frame : m_stream.frames) {
+      m_buffer.push(hisui::Frame{.timestamp = frame.timestamp * TIMESCALE /
+                                              hisui::Constants::NANO_SECOND,
+                                 .data = frame.data,
+                                 .data_size = frame.data_size,
+                                 .is_key = frame.is_key});
+    }
+    m_buffer.close();
+  }
+
+  std::uint32_t getWidth() const override { return WIDTH; }
+  std::uint32_t getHeight() const override { return HEIGHT; }
+  std::uint32_t getFourcc() const override {
+    return hisui::Constants::VP9_FOURCC;
+  }
+
+ private:
+  static const std::uint64_t TIMESCALE = 16000;
+  const Stream& m_stream;
+};
+
+// setUp() で作られる Opus の producer を, エンコードしないものに差し替える
+template <class T>
+class SyntheticMP4Muxer : public T {
+ public:
+  SyntheticMP4Muxer(const hisui::Config& config,
+                    const Stream& video,
+                    const Stream& t_audio)
+      : T(config,
+          hisui::muxer::MP4MuxerParametersForLayout{
+              .audio_archive_items = NO_ARCHIVES,
+              .video_producer =
+                  std::make_shared<SyntheticVideoProducer>(video),
+              .duration = static_cast<double>(DURATION)}),
+        m_audio(t_audio) {}
+
+  void setUp() override {
+    T::setUp();
+    this->m_audio_producer = std::make_shared<SyntheticAudioProducer>(m_audio);
+  }
+
+ private:
+  const Stream& m_audio;
+};
+
+template <class T>
+void write_mp4(const hisui::Config& config,
+               const Stream& video,
+               const Stream& audio) {
+  SyntheticMP4Muxer<T> muxer(config, video, audio);
+  muxer.setUp();
+  muxer.run();
+  muxer.cleanUp();
+}
+
+void bench_mp4(const std::function<bool(const std::string&)>& is_selected,
+               const Stream& video,
+               const Stream& audio,
+               const std::uint32_t bit_rate,
+               const std::string& suffix,
+               const std::filesystem::path& path) {
+  hisui::Config config;
+  config.out_container = hisui::config::OutContainer::MP4;
+  config.out_video_codec = hisui::config::OutVideoCodec::VP9;
+  config.out_video_bit_rate = bit_rate;
+  config.out_filename = path.string();
+  config.show_progress_bar = false;
+  config.directory_for_faststart_intermediate_file =
+      path.parent_path().string();
+
+  const std::size_t frames = std::size(video.frames) + std::size(audio.frames);
+  const std::size_t size = video.size + audio.size;
+  const auto simple_name = "mp4/simple/" + suffix;
+  if (is_selected(simple_name)) {
+    config.mp4_muxer = hisui::config::MP4Muxer::Simple;
+    report_throughput(simple_name,
+                      measure([&config, &video, &audio](std::uint64_t) {
+                        write_mp4<hisui::muxer::SimpleMP4Muxer>(config, video,
+                                                                audio);
+                      }),
+                      frames, size);
+  }
+  // 中間ファイルからのコピーも含める
+  const auto faststart_name = "mp4/faststart/" + suffix;
+  if (is_selected(faststart_name)) {
+    config.mp4_muxer = hisui::config::MP4Muxer::Faststart;
+    report_throughput(faststart_name,
+                      measure([&config, &video, &audio](std::uint64_t) {
+                        write_mp4<hisui::muxer::FaststartMP4Muxer>(
+                            config, video, audio);
+                      }),
+                      frames, size);
+  }
+}
+
+void bench_container(
+    const std::function<bool(const std::string&)>& is_selected) {
+  const auto audio = make_audio_stream();
+  for (const auto bit_rate : VIDEO_BIT_RATES) {
+    const auto suffix = fmt::format("vp9/{}kbps", bit_rate);
+    if (!is_selected("webm/writer/" + suffix) &&
+        !is_selected("webm/reader/video/" + suffix) &&
+        !is_selected("webm/reader/audio/" + suffix) &&
+        !is_selected("mp4/simple/" + suffix) &&
+        !is_selected("mp4/faststart/" + suffix)) {
+      continue;
+    }
+    const auto video = make_video_stream(bit_rate);
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto webm_path =
+        directory / fmt::format("hisui_container_bench_{}.webm", bit_rate);
+    const auto mp4_path =
+        directory / fmt::format("hisui_container_bench_{}.mp4", bit_rate);
+    try {
+      bench_webm(is_selected, video, audio, suffix, webm_path);
+      bench_mp4(is_selected, video, audio, bit_rate, suffix, mp4_path);
+    } catch (...) {
+      std::filesystem::remove(webm_path);
+      std::filesystem::remove(mp4_path);
+      throw;
+    }
+    std::filesystem::remove(webm_path);
+    std::filesystem::remove(mp4_path);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+
+  const std::string filter = argc > 1 ? argv[1] : "";
+  const auto is_selected = [&filter](const std::string& name) {
+    return filter.empty() || name.find(filter) != std::string::npos;
+  };
+
+  try {
+    bench_container(is_selected);
+  } catch (const std::exception& e) {
+    spdlog::error("benchmark failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,603 @@
+#include <fmt/core.h>
+#include <libyuv/scale.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/buffer_opus_encoder.hpp"
+#include "audio/mixer.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "layout/cell_util.hpp"
+#include "layout/composer.hpp"
+#include "layout/region.hpp"
+#include "layout/reuse.hpp"
+#include "layout/source.hpp"
+#include "layout/video_source.hpp"
+#include "video/av1_decoder.hpp"
+#include "video/buffer_av1_encoder.hpp"
+#include "video/buffer_vpx_encoder.hpp"
+#include "video/composer.hpp"
+#include "video/decoder.hpp"
+#include "video/encoder.hpp"
+#include "video/grid_composer.hpp"
+#include "video/parallel_grid_composer.hpp"
+#include "video/preserve_aspect_ratio_scaler.hpp"
+#include "video/scaler.hpp"
+#include "video/simple_scaler.hpp"
+#include "video/source.hpp"
+#include "video/vpx.hpp"
+#include "video/vpx_decoder.hpp"
+#include "video/yuv.hpp"
+#include "webm/input/video_context.hpp"
+#include "webm/output/context.hpp"
+
+#include "measure.hpp"
+
+// 合成, 拡縮, ミキシング, エンコード, デコードの処理速度を合成した入力で測る.
+// 引数を与えた場合は, 名前にその文字列を含むベンチマークだけを実行する
+
+namespace {
+
+using hisui::bench::measure;
+using hisui::bench::Measurement;
+using hisui::bench::to_seconds;
+
+const std::uint64_t FRAME_INTERVAL = hisui::Constants::NANO_SECOND / 25;
+const std::size_t SAMPLES_PER_ITERATION = hisui::Constants::PCM_SAMPLE_RATE;
+const std::array<std::size_t, 4> NUMBERS_OF_SOURCES = {1, 4, 9, 16};
+
+struct Resolution {
+  const std::uint32_t width;
+  const std::uint32_t height;
+};
+
+void report_frames(const std::string& name, const Measurement& m) {
+  fmt::print("{:<56} {:>12.1f} frames/s\n", name,
+             static_cast<double>(m.iterations) / to_seconds(m.elapsed));
+}
+
+// 1 回に frames_per_iteration フレームを処理した場合
+void report_codec(const std::string& name,
+                  const Measurement& m,
+                  const std::size_t frames_per_iteration) {
+  const auto frames =
+      static_cast<double>(m.iterations * frames_per_iteration);
+  fmt::print("{:<56} {:>12.1f} frames/s {:>10.3f} cpu_ms/frame\n", name,
+             frames / to_seconds(m.elapsed),
+             to_seconds(m.cpu_time) * 1000 / frames);
+}
+
+void report_samples(const std::string& name,
+                    const Measurement& m,
+                    const std::size_t samples_per_iteration) {
+  fmt::print("{:<56} {:>12.3f} ns/sample\n", name,
+             static_cast<double>(m.elapsed.count()) /
+                 static_cast<double>(m.iterations * samples_per_iteration));
+}
+
+std::string to_string(const Resolution& r) {
+  return fmt::format("{}x{}", r.width, r.height);
+}
+
+// 位置によって値の変わる模様で埋める. 値そのものに意味はない
+std::shared_ptr<hisui::video::YUVImage> create_synthetic_yuv_image(
+    const Resolution& r,
+    const std::uint32_t seed) {
+  auto image = std::make_shared<hisui::video::YUVImage>(r.width, r.height);
+  for (int p = 0; p < 3; ++p) {
+    const auto width = image->getWidth(p);
+    const auto height = image->getHeight(p);
+    const auto stride = image->getStride(p);
+    for (std::uint32_t y = 0; y < height; ++y) {
+      for (std::uint32_t x = 0; x < width; ++x) {
+        image->yuv[static_cast<std::size_t>(p)][y * stride + x] =
+            static_cast<std::uint8_t>((x + 2 * y + seed * 17) & 0xff);
+      }
+    }
+  }
+  return image;
+}
+
+std::vector<std::int16_t> create_synthetic_samples(const std::size_t size,
+                                                   const std::uint32_t seed) {
+  std::mt19937 engine(seed);
+  std::uniform_int_distribution<std::int16_t> distribution;
+  std::vector<std::int16_t> samples(size);
+  for (auto& s : samples) {
+    s = distribution(engine);
+  }
+  return samples;
+}
+
+// デコーダーの代わりに同じ画像を返す. is_static でなければ毎回内容が変わったことにする
+class SyntheticSource : public hisui::video::Source {
+ public:
+  SyntheticSource(const Resolution& r,
+                  const std::uint32_t seed,
+                  const bool t_is_static)
+      : m_image(create_synthetic_yuv_image(r, seed)),
+        m_is_static(t_is_static) {}
+
+  const std::shared_ptr<hisui::video::YUVImage>& getYUV(
+      const std::uint64_t t) override {
+    if (!m_is_static) {
+      m_image->setTimestamp(t);
+    }
+    return m_image;
+  }
+
+  std::uint32_t getWidth() const override { return m_image->getWidth(0); }
+  std::uint32_t getHeight() const override { return m_image->getHeight(0); }
+
+ private:
+  std::shared_ptr<hisui::video::YUVImage> m_image;
+  const bool m_is_static;
+};
+
+const std::vector<std::pair<Resolution, Resolution>> SCALING_RESOLUTIONS = {
+    {{.width = 640, .height = 480}, {.width = 320, .height = 240}},
+    {{.width = 640, .height = 480}, {.width = 640, .height = 360}},
+    {{.width = 1280, .height = 720}, {.width = 640, .height = 360}},
+    {{.width = 1920, .height = 1080}, {.width = 640, .height = 360}},
+    {{.width = 1920, .height = 1080}, {.width = 1280, .height = 720}},
+    {{.width = 320, .height = 240}, {.width = 1280, .height = 720}},
+};
+
+void bench_scaler(const std::function<bool(const std::string&)>& is_selected) {
+  for (const auto& [src_resolution, dst_resolution] : SCALING_RESOLUTIONS) {
+    const auto suffix = fmt::format("{}->{}", to_string(src_resolution),
+                                    to_string(dst_resolution));
+    const auto src = create_synthetic_yuv_image(src_resolution, 0);
+
+    std::vector<std::pair<std::string, std::unique_ptr<hisui::video::Scaler>>>
+        scalers;
+    scalers.emplace_back(
+        "scaler/simple/" + suffix,
+        std::make_unique<hisui::video::SimpleScaler>(
+            dst_resolution.width, dst_resolution.height, libyuv::kFilterBox));
+    scalers.emplace_back(
+        "scaler/preserve_aspect_ratio/" + suffix,
+        std::make_unique<hisui::video::PreserveAspectRatioScaler>(
+            dst_resolution.width, dst_resolution.height, libyuv::kFilterBox));
+
+    for (auto& [name, scaler] : scalers) {
+      if (!is_selected(name)) {
+        continue;
+      }
+      // 同じ画像は拡縮し直さないので, 毎回タイムスタンプを変える
+      report_frames(name, measure([&scaler = scaler, &src](std::uint64_t i) {
+                      src->setTimestamp(i);
+                      scaler->scale(src);
+                    }));
+    }
+  }
+}
+
+void bench_grid_composer(
+    const std::function<bool(const std::string&)>& is_selected) {
+  const Resolution single{.width = 320, .height = 240};
+  const Resolution src_resolution{.width = 640, .height = 480};
+
+  for (const auto size : NUMBERS_OF_SOURCES) {
+    std::vector<std::shared_ptr<hisui::video::YUVImage>> images;
+    for (std::size_t i = 0; i < size; ++i) {
+      images.push_back(create_synthetic_yuv_image(
+          src_resolution, static_cast<std::uint32_t>(i)));
+    }
+    const std::size_t columns = size == 1 ? 1 : (size <= 4 ? 2 : 4);
+    const auto suffix = fmt::format("{}x{}", size, to_string(single));
+
+    std::vector<std::pair<std::string, std::unique_ptr<hisui::video::Composer>>>
+        composers;
+    composers.emplace_back(
+        "grid_composer/" + suffix,
+        std::make_unique<hisui::video::GridComposer>(
+            single.width, single.height, size, columns,
+            hisui::config::VideoScaler::PreserveAspectRatio,
+            libyuv::kFilterBox));
+    composers.emplace_back(
+        "parallel_grid_composer/" + suffix,
+        std::make_unique<hisui::video::ParallelGridComposer>(
+            single.width, single.height, size, columns,
+            hisui::config::VideoScaler::PreserveAspectRatio,
+            libyuv::kFilterBox));
+
+    for (auto& [name, composer] : composers) {
+      if (!is_selected(name)) {
+        continue;
+      }
+      std::vector<unsigned char> composed(composer->getWidth() *
+                                          composer->getHeight() * 3 / 2);
+      report_frames(name,
+                    measure([&composer = composer, &composed,
+                             &images](std::uint64_t i) {
+                      for (auto& image : images) {
+                        image->setTimestamp(i);
+                      }
+                      composer->compose(&composed, images);
+                    }));
+    }
+  }
+}
+
+void bench_layout_composer(
+    const std::function<bool(const std::string&)>& is_selected) {
+  const Resolution resolution{.width = 1280, .height = 720};
+  const Resolution src_resolution{.width = 640, .height = 480};
+  const std::string connection_id = "synthetic";
+  const std::filesystem::path file_path = "";
+
+  for (const auto size : NUMBERS_OF_SOURCES) {
+    for (const bool is_static : {false, true}) {
+      const auto name =
+          fmt::format("layout_composer/{}x{}{}", size,
+                      to_string(src_resolution), is_static ? "/static" : "");
+      if (!is_selected(name)) {
+        continue;
+      }
+
+      std::vector<std::shared_ptr<hisui::layout::VideoSource>> video_sources;
+      for (std::size_t i = 0; i < size; ++i) {
+        video_sources.push_back(std::make_shared<hisui::layout::VideoSource>(
+            hisui::layout::SourceParameters{.file_path = file_path,
+                                            .index = i,
+                                            .connection_id = connection_id,
+                                            .start_time = 0,
+                                            .end_time = 3600},
+            std::make_shared<SyntheticSource>(
+                src_resolution, static_cast<std::uint32_t>(i), is_static)));
+      }
+      auto region = std::make_shared<hisui::layout::Region>(
+          hisui::layout::RegionParameters{
+              .name = "synthetic",
+              .pos = {.x = 0, .y = 0},
+              .z_pos = 0,
+              .resolution = {.width = resolution.width,
+                             .height = resolution.height},
+              .max_columns = 0,
+              .max_rows = 0,
+              .reuse = hisui::layout::Reuse::ShowOldest,
+              .video_sources = video_sources,
+          });
+      const hisui::layout::Resolution layout_resolution{
+          .width = resolution.width, .height = resolution.height};
+      hisui::layout::VideoSourceCache video_source_cache;
+      region->prepare({.resolution = layout_resolution,
+                       .video_source_cache = video_source_cache});
+      region->setEncodingInterval();
+
+      const std::vector<std::shared_ptr<hisui::layout::Region>> regions = {
+          region};
+      hisui::layout::Composer composer(
+          {.regions = regions, .resolution = layout_resolution});
+      std::vector<unsigned char> composed(resolution.width *
+                                          resolution.height * 3 / 2);
+      report_frames(name, measure([&composer, &composed](std::uint64_t i) {
+                      composer.compose(&composed, i * FRAME_INTERVAL);
+                    }));
+    }
+  }
+}
+
+void bench_mixer(const std::function<bool(const std::string&)>& is_selected) {
+  const auto samples1 = create_synthetic_samples(SAMPLES_PER_ITERATION, 0);
+  const auto samples2 = create_synthetic_samples(SAMPLES_PER_ITERATION, 1);
+  std::vector<std::int16_t> mixed(SAMPLES_PER_ITERATION);
+
+  const std::vector<
+      std::pair<std::string, std::function<std::int16_t(std::int16_t,
+                                                         std::int16_t)>>>
+      mixers = {
+          {"mixer/simple", hisui::audio::mix_sample_simple},
+          {"mixer/vttoth", hisui::audio::mix_sample_vttoth},
+      };
+  for (const auto& [name, mix] : mixers) {
+    if (!is_selected(name)) {
+      continue;
+    }
+    report_samples(
+        name,
+        measure([&mix = mix, &samples1, &samples2, &mixed](std::uint64_t) {
+          for (std::size_t i = 0; i < SAMPLES_PER_ITERATION; ++i) {
+            mixed[i] = mix(samples1[i], samples2[i]);
+          }
+        }),
+        SAMPLES_PER_ITERATION);
+  }
+
+  const std::vector<std::pair<
+      std::string,
+      std::function<void(std::int16_t*, const std::int16_t*, std::size_t)>>>
+      block_mixers = {
+          {"mixer/block/simple", hisui::audio::mix_samples_simple},
+          {"mixer/block/vttoth", hisui::audio::mix_samples_vttoth},
+      };
+  for (const auto& [name, mix] : block_mixers) {
+    if (!is_selected(name)) {
+      continue;
+    }
+    report_samples(
+        name,
+        measure([&mix = mix, &samples1, &samples2, &mixed](std::uint64_t) {
+          std::copy(std::begin(samples1), std::end(samples1),
+                    std::begin(mixed));
+          mix(mixed.data(), samples2.data(), SAMPLES_PER_ITERATION);
+        }),
+        SAMPLES_PER_ITERATION);
+  }
+
+  const std::string name = "mixer/block/limiter";
+  if (is_selected(name)) {
+    std::vector<std::int32_t> bus(SAMPLES_PER_ITERATION);
+    report_samples(
+        name,
+        measure([&samples1, &samples2, &mixed, &bus](std::uint64_t) {
+          std::fill(std::begin(bus), std::end(bus), 0);
+          hisui::audio::accumulate_samples(bus.data(), samples1.data(),
+                                           SAMPLES_PER_ITERATION);
+          hisui::audio::accumulate_samples(bus.data(), samples2.data(),
+                                           SAMPLES_PER_ITERATION);
+          hisui::audio::limit_samples(mixed.data(), bus.data(),
+                                      SAMPLES_PER_ITERATION);
+        }),
+        SAMPLES_PER_ITERATION);
+  }
+}
+
+void bench_opus_encoder(
+    const std::function<bool(const std::string&)>& is_selected) {
+  const std::string name = "buffer_opus_encoder";
+  if (!is_selected(name)) {
+    return;
+  }
+  // L, R の順に並べた SAMPLES_PER_ITERATION 個分の sample
+  const auto samples = create_synthetic_samples(SAMPLES_PER_ITERATION * 2, 0);
+
+  hisui::FrameQueue queue;
+  hisui::audio::BufferOpusEncoder encoder(
+      &queue, {.bit_rate = hisui::Constants::OPUS_DEFAULT_BIT_RATE});
+  report_samples(name,
+                 measure([&encoder, &queue, &samples](std::uint64_t) {
+                   encoder.addSamples(samples.data(), SAMPLES_PER_ITERATION);
+                   while (queue.front()) {
+                     queue.pop();
+                   }
+                 }),
+                 SAMPLES_PER_ITERATION);
+}
+
+struct CodecResolution {
+  const Resolution resolution;
+  const std::uint32_t bitrate;
+};
+
+// hisui の出力でよく使う解像度と, それぞれの 1 ストリームのビットレート (kbps)
+const std::vector<CodecResolution> CODEC_RESOLUTIONS = {
+    {.resolution = {.width = 640, .height = 480}, .bitrate = 500},
+    {.resolution = {.width = 1280, .height = 720}, .bitrate = 1500},
+    {.resolution = {.width = 1920, .height = 1080}, .bitrate = 3000},
+};
+// --job-threads に与える値. エンコーダーとデコーダーのスレッド数の上限になる
+const std::array<std::uint32_t, 4> CODEC_THREADS = {1, 2, 4, 8};
+// 1 回のエンコードとデコードのフレーム数
+const std::size_t CODEC_FRAMES = 30;
+
+const std::vector<std::pair<std::string, hisui::config::OutVideoCodec>>
+    CODECS = {
+        {"vp8", hisui::config::OutVideoCodec::VP8},
+        {"vp9", hisui::config::OutVideoCodec::VP9},
+        {"av1", hisui::config::OutVideoCodec::AV1},
+};
+
+// 動きのある映像の代わりに, フレームごとに模様をずらした I420 の画像を作る
+std::vector<std::vector<unsigned char>> create_synthetic_raw_images(
+    const Resolution& r) {
+  const std::size_t y_size = static_cast<std::size_t>(r.width) * r.height;
+  const std::size_t chroma_width = (r.width + 1) >> 1;
+  const std::size_t chroma_height = (r.height + 1) >> 1;
+  std::mt19937 engine(0);
+  std::uniform_int_distribution<int> noise(0, 15);
+
+  std::vector<std::vector<unsigned char>> images;
+  for (std::size_t f = 0; f < CODEC_FRAMES; ++f) {
+    std::vector<unsigned char> image(y_size +
+                                     2 * chroma_width * chroma_height);
+    for (std::size_t y = 0; y < r.height; ++y) {
+      for (std::size_t x = 0; x < r.width; ++x) {
+        image[y * r.width + x] = static_cast<unsigned char>(
+            ((x + 4 * f) ^ (y + 2 * f)) + static_cast<std::size_t>(
+                                              noise(engine)));
+      }
+    }
+    for (std::size_t i = y_size; i < std::size(image); ++i) {
+      image[i] = static_cast<unsigned char>(128 + (i + f) % 32);
+    }
+    images.push_back(std::move(image));
+  }
+  return images;
+}
+
+hisui::Config make_codec_config(const hisui::config::OutVideoCodec codec,
+                                const std::uint32_t bitrate,
+                                const std::uint32_t threads) {
+  hisui::Config config;
+  config.out_video_codec = codec;
+  config.out_video_bit_rate = bitrate;
+  config.job_threads = threads;
+  return config;
+}
+
+// hisui が出力に使うのと同じ設定でエンコーダーを作る
+std::unique_ptr<hisui::video::Encoder> create_encoder(
+    hisui::FrameQueue* queue,
+    const Resolution& r,
+    const hisui::Config& config) {
+  if (config.out_video_codec == hisui::config::OutVideoCodec::AV1) {
+    return std::make_unique<hisui::video::BufferAV1Encoder>(
+        queue, hisui::video::AV1EncoderConfig(r.width, r.height, config));
+  }
+  return std::make_unique<hisui::video::BufferVPXEncoder>(
+      queue, hisui::video::VPXEncoderConfig(r.width, r.height, config));
+}
+
+std::vector<hisui::Frame> encode_frames(
+    const std::vector<std::vector<unsigned char>>& images,
+    const Resolution& r,
+    const hisui::Config& config) {
+  hisui::FrameQueue queue;
+  auto encoder = create_encoder(&queue, r, config);
+  std::vector<hisui::Frame> frames;
+  auto drain = [&queue, &frames] {
+    while (const auto frame = queue.front()) {
+      frames.push_back(*frame);
+      queue.pop();
+    }
+  };
+  for (const auto& image : images) {
+    encoder->outputImage(image);
+    drain();
+  }
+  encoder->flush();
+  drain();
+  return frames;
+}
+
+void write_webm(const std::filesystem::path& path,
+                const std::vector<hisui::Frame>& frames,
+                const Resolution& r,
+                const hisui::config::OutVideoCodec codec) {
+  hisui::webm::output::Context context(path.string());
+  context.init();
+  // AsyncWebMMuxer と同じ CodecPrivate
+  const std::array<std::uint8_t, 4> av1_private_data{0x81, 0x00, 0x06, 0x00};
+  const bool is_av1 = codec == hisui::config::OutVideoCodec::AV1;
+  context.setVideoTrack(r.width, r.height, codec,
+                        is_av1 ? av1_private_data.data() : nullptr,
+                        is_av1 ? std::size(av1_private_data) : 0);
+  for (const auto& frame : frames) {
+    context.addVideoFrame(frame.data.get(), frame.data_size, frame.timestamp,
+                          frame.is_key);
+  }
+}
+
+std::shared_ptr<hisui::video::Decoder> create_decoder(
+    const std::shared_ptr<hisui::webm::input::VideoContext>& webm,
+    const hisui::config::OutVideoCodec codec,
+    const std::uint32_t threads) {
+  if (codec == hisui::config::OutVideoCodec::AV1) {
+    return std::make_shared<hisui::video::AV1Decoder>(webm, threads);
+  }
+  // DecoderFactory と同じく VP9 は row_mt を使う
+  return std::make_shared<hisui::video::VPXDecoder>(
+      webm, threads, codec == hisui::config::OutVideoCodec::VP9);
+}
+
+void decode_frames(const std::filesystem::path& path,
+                   const std::vector<hisui::Frame>& frames,
+                   const hisui::config::OutVideoCodec codec,
+                   const std::uint32_t threads) {
+  auto webm = std::make_shared<hisui::webm::input::VideoContext>(path.string());
+  if (!webm->init()) {
+    throw std::runtime_error(
+        fmt::format("opening {} failed", path.string()));
+  }
+  auto decoder = create_decoder(webm, codec, threads);
+  for (const auto& frame : frames) {
+    decoder->getImage(frame.timestamp);
+  }
+}
+
+// エンコードした結果をファイルに書き, 同じスレッド数でデコードする
+void bench_codec(const std::function<bool(const std::string&)>& is_selected) {
+  for (const auto& [resolution, bitrate] : CODEC_RESOLUTIONS) {
+    const auto images = create_synthetic_raw_images(resolution);
+    for (const auto& [codec_name, codec] : CODECS) {
+      for (const auto threads : CODEC_THREADS) {
+        const auto suffix = fmt::format("{}/{}/{}kbps/threads={}", codec_name,
+                                        to_string(resolution), bitrate,
+                                        threads);
+        const auto encoder_name = "encoder/" + suffix;
+        const auto decoder_name = "decoder/" + suffix;
+        if (!is_selected(encoder_name) && !is_selected(decoder_name)) {
+          continue;
+        }
+
+        const auto config = make_codec_config(codec, bitrate, threads);
+        const auto frames = encode_frames(images, resolution, config);
+        if (is_selected(encoder_name)) {
+          report_codec(encoder_name,
+                       measure([&images, &resolution = resolution,
+                                &config](std::uint64_t) {
+                         encode_frames(images, resolution, config);
+                       }),
+                       CODEC_FRAMES);
+        }
+        if (!is_selected(decoder_name)) {
+          continue;
+        }
+
+        const auto path = std::filesystem::temp_directory_path() /
+                          fmt::format("hisui_bench_{}_{}x{}.webm", codec_name,
+                                      resolution.width, resolution.height);
+        write_webm(path, frames, resolution, codec);
+        try {
+          report_codec(decoder_name,
+                       measure([&path, &frames, codec = codec,
+                                threads = threads](std::uint64_t) {
+                         decode_frames(path, frames, codec, threads);
+                       }),
+                       std::size(frames));
+        } catch (...) {
+          std::filesystem::remove(path);
+          throw;
+        }
+        std::filesystem::remove(path);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+
+  const std::string filter = argc > 1 ? argv[1] : "";
+  const auto is_selected = [&filter](const std::string& name) {
+    return filter.empty() || name.find(filter) != std::string::npos;
+  };
+
+  try {
+    bench_scaler(is_selected);
+    bench_grid_composer(is_selected);
+    bench_layout_composer(is_selected);
+    bench_mixer(is_selected);
+    bench_opus_encoder(is_selected);
+    bench_codec(is_selected);
+  } catch (const std::exception& e) {
+    spdlog::error("benchmark failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
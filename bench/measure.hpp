@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+
+#include "constants.hpp"
+
+namespace hisui::bench {
+
+const std::chrono::nanoseconds MIN_DURATION = std::chrono::seconds(1);
+const std::uint64_t MIN_ITERATIONS = 3;
+
+struct Measurement {
+  const std::uint64_t iterations;
+  const std::chrono::nanoseconds elapsed;
+  // コーデックの内部のスレッドも含めた, プロセス全体の CPU 時間
+  const std::chrono::nanoseconds cpu_time;
+};
+
+// 1 回目は計測から外し, MIN_DURATION 以上かつ MIN_ITERATIONS 回以上繰り返す
+inline Measurement measure(const std::function<void(const std::uint64_t)>& f) {
+  f(0);
+  std::uint64_t iterations = 0;
+  const auto start = std::chrono::steady_clock::now();
+  const auto start_clock = std::clock();
+  std::chrono::nanoseconds elapsed{0};
+  while (elapsed < MIN_DURATION || iterations < MIN_ITERATIONS) {
+    f(++iterations);
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  const auto cpu_time = std::chrono::nanoseconds(static_cast<std::int64_t>(
+      static_cast<double>(std::clock() - start_clock) / CLOCKS_PER_SEC *
+      hisui::Constants::NANO_SECOND));
+  return {.iterations = iterations, .elapsed = elapsed, .cpu_time = cpu_time};
+}
+
+inline double to_seconds(const std::chrono::nanoseconds& d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+}  // namespace hisui::bench
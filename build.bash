@@ -10,7 +10,7 @@ _PACKAGES=(
 )
 
 function show_help() {
-  echo "$PROGRAM [--clean] [--use-ccache] [--use-fdk-aac] [--with-test] [--build-type-native] [--build-type-debug] [--package] <package>"
+  echo "$PROGRAM [--clean] [--use-ccache] [--use-fdk-aac] [--use-dav1d] [--use-nvdec] [--use-vaapi] [--use-trace] [--with-test] [--with-benchmark] [--build-type-native] [--build-type-debug] [--package] <package>"
   echo "<package>:"
   for package in "${_PACKAGES[@]}"; do
     echo "  - $package"
@@ -22,8 +22,13 @@ PACKAGE=""
 FLAG_CLEAN=0
 FLAG_PACKAGE=0
 FLAG_WITH_TEST=0
+FLAG_WITH_BENCHMARK=0
 FLAG_USE_CCACHE=0
 FLAG_USE_FDK_AAC=0
+FLAG_USE_DAV1D=0
+FLAG_USE_NVDEC=0
+FLAG_USE_VAAPI=0
+FLAG_USE_TRACE=0
 
 CMAKE_FLAGS=()
 BUILD_TYPE='Release'
@@ -41,12 +46,27 @@ while [ $# -ne 0 ]; do
     "--with-test" )
         FLAG_WITH_TEST=1
         ;;
+    "--with-benchmark" )
+        FLAG_WITH_BENCHMARK=1
+        ;;
     "--use-ccache" )
         FLAG_USE_CCACHE=1
         ;;
     "--use-fdk-aac" )
         FLAG_USE_FDK_AAC=1
         ;;
+    "--use-dav1d" )
+        FLAG_USE_DAV1D=1
+        ;;
+    "--use-nvdec" )
+        FLAG_USE_NVDEC=1
+        ;;
+    "--use-vaapi" )
+        FLAG_USE_VAAPI=1
+        ;;
+    "--use-trace" )
+        FLAG_USE_TRACE=1
+        ;;
     "--build-type-native" )
         BUILD_TYPE="Native"
         ;;
@@ -87,6 +107,12 @@ else
     CMAKE_FLAGS+=('-DWITH_TEST=NO')
 fi
 
+if [ $FLAG_WITH_BENCHMARK -eq 1 ]; then
+    CMAKE_FLAGS+=('-DWITH_BENCHMARK=YES')
+else
+    CMAKE_FLAGS+=('-DWITH_BENCHMARK=NO')
+fi
+
 if [ $FLAG_USE_CCACHE -eq 1 ]; then
     CMAKE_FLAGS+=('-DUSE_CCACHE=YES')
     CXX='ccache clang++'
@@ -101,6 +127,30 @@ else
     CMAKE_FLAGS+=('-DUSE_FDK_AAC=NO')
 fi
 
+if [ $FLAG_USE_DAV1D -eq 1 ]; then
+    CMAKE_FLAGS+=('-DUSE_DAV1D=YES')
+else
+    CMAKE_FLAGS+=('-DUSE_DAV1D=NO')
+fi
+
+if [ $FLAG_USE_NVDEC -eq 1 ]; then
+    CMAKE_FLAGS+=('-DUSE_NVDEC=YES')
+else
+    CMAKE_FLAGS+=('-DUSE_NVDEC=NO')
+fi
+
+if [ $FLAG_USE_VAAPI -eq 1 ]; then
+    CMAKE_FLAGS+=('-DUSE_VAAPI=YES')
+else
+    CMAKE_FLAGS+=('-DUSE_VAAPI=NO')
+fi
+
+if [ $FLAG_USE_TRACE -eq 1 ]; then
+    CMAKE_FLAGS+=('-DUSE_TRACE=YES')
+else
+    CMAKE_FLAGS+=('-DUSE_TRACE=NO')
+fi
+
 echo "--clean: ${FLAG_CLEAN}"
 echo "--package: ${FLAG_PACKAGE}"
 echo "CMAKE_FLAGS:" "${CMAKE_FLAGS[@]}"
@@ -1,12 +1,12 @@
 #!/usr/bin/env bash
 
-# src/ test/ 以下のファイルに clang-format を適用する
+# src/ test/ bench/ 以下のファイルに clang-format を適用する
 
 set -e
 
 shopt -s globstar
 
-for file in src/**/*.[ch]pp test/**/*.[ch]pp; do
+for file in src/**/*.[ch]pp test/**/*.[ch]pp bench/**/*.[ch]pp; do
   echo applying "$file"
   clang-format -i -style=file "$file"
 done
@@ -4,45 +4,211 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "audio/webm_source.hpp"
 #include "constants.hpp"
 #include "metadata.hpp"
+#include "util/file.hpp"
 #include "util/interval.hpp"
+#include "util/interval_index.hpp"
+#include "util/thread_pool.hpp"
 
 namespace hisui::audio {
 
-BasicSequencer::BasicSequencer(
-    const std::vector<hisui::ArchiveItem>& archives) {
-  for (const auto& archive : archives) {
-    const auto& path = archive.getPath();
-    if (!(path.extension() == ".webm")) {
-      spdlog::info("unsupported audio source: {}", path.string());
+BasicSequencer::BasicSequencer(const std::vector<hisui::ArchiveItem>& archives,
+                               const std::size_t decode_threads,
+                               const std::uint32_t sample_rate,
+                               const std::int32_t silence_level)
+    : m_window_size(sample_rate) {
+  // WebM の解析とデコーダーの生成には時間がかかるので, ソースは並列に作る
+  std::vector<std::unique_ptr<Source>> sources(std::size(archives));
+  hisui::util::parallel_for(
+      std::size(archives),
+      [&archives, &sources, sample_rate, silence_level](const std::size_t i) {
+        const auto& path = archives[i].getPath();
+        if (hisui::util::get_extension(path) != ".webm") {
+          spdlog::info("unsupported audio source: {}", path.string());
+          return;
+        }
+        sources[i] = std::make_unique<hisui::audio::WebMSource>(
+            path.string(), sample_rate, silence_level);
+      });
+
+  for (std::size_t i = 0; i < std::size(archives); ++i) {
+    if (!sources[i]) {
       continue;
     }
+    const auto& archive = archives[i];
     m_sequence.push_back(
-        {std::make_unique<hisui::audio::WebMSource>(path.string()),
-         hisui::util::Interval(static_cast<std::uint64_t>(std::floor(
-                                   archive.getStartTimeOffset() *
-                                   hisui::Constants::PCM_SAMPLE_RATE)),
-                               static_cast<std::uint64_t>(std::ceil(
-                                   archive.getStopTimeOffset() *
-                                   hisui::Constants::PCM_SAMPLE_RATE)))});
+        {std::move(sources[i]),
+         hisui::util::Interval(
+             static_cast<std::uint64_t>(
+                 std::floor(archive.getStartTimeOffset() * sample_rate)),
+             static_cast<std::uint64_t>(
+                 std::ceil(archive.getStopTimeOffset() * sample_rate)))});
   }
-}
 
-void BasicSequencer::getSamples(
-    std::vector<std::pair<std::int16_t, std::int16_t>>* samples,
-    const std::uint64_t position) {
-  samples->clear();
+  std::vector<hisui::util::Interval> intervals;
   for (const auto& s : m_sequence) {
-    if (s.second.isIn(position)) {
-      samples->push_back(
-          s.first->getSample(s.second.getSubstructLower(position)));
+    intervals.push_back(s.second);
+  }
+  m_interval_index = std::make_unique<hisui::util::IntervalIndex>(intervals);
+  m_blocks.resize(std::size(m_sequence));
+
+  // 呼び出し元のスレッドもデコードを行うので, ワーカーは 1 つ少なくてよい
+  if (decode_threads > 1 && std::size(m_sequence) > 1) {
+    m_thread_pool = std::make_unique<hisui::util::ThreadPool>(
+        std::min(decode_threads, std::size(m_sequence)) - 1);
+  }
+}
+
+BasicSequencer::~BasicSequencer() {
+  if (m_next_decoding.valid()) {
+    m_next_decoding.wait();
+  }
+}
+
+void BasicSequencer::getSamples(std::vector<const std::int16_t*>* blocks,
+                                const std::uint64_t position,
+                                const std::size_t number_of_samples) {
+  if (m_thread_pool) {
+    getSamplesFromWindow(blocks, position, number_of_samples);
+    return;
+  }
+  blocks->clear();
+  m_interval_index->find(&m_active, position, position + number_of_samples);
+  for (const auto i : m_active) {
+    auto& block = m_blocks[i];
+    block.resize(number_of_samples * 2);
+    if (!readSamples(i, block.data(), position, number_of_samples)) {
+      blocks->push_back(block.data());
+    }
+  }
+}
+
+bool BasicSequencer::getPacket(const std::uint8_t** packet,
+                               std::size_t* size,
+                               const std::uint64_t position,
+                               const std::size_t number_of_samples) {
+  if (m_thread_pool) {
+    return false;
+  }
+  const std::uint64_t end = position + number_of_samples;
+  m_interval_index->find(&m_active, position, end);
+  if (std::size(m_active) != 1) {
+    return false;
+  }
+  const auto& [source, interval] = m_sequence[m_active[0]];
+  if (position < interval.getLower() || interval.getUpper() < end) {
+    return false;
+  }
+  return source->getPacket(packet, size, interval.getSubstructLower(position),
+                           number_of_samples);
+}
+
+// position より後から始まる source は先頭から読めばよい
+void BasicSequencer::seek(const std::uint64_t position) {
+  for (auto& [source, interval] : m_sequence) {
+    if (interval.getLower() < position && position < interval.getUpper()) {
+      source->seek(interval.getSubstructLower(position));
+    }
+  }
+}
+
+// m_sequence[i] の [position, position + number_of_samples) を block に書き込み,
+// 全て無音ならば true を返す. source の区間外は 0 で埋める
+bool BasicSequencer::readSamples(const std::size_t i,
+                                 std::int16_t* block,
+                                 const std::uint64_t position,
+                                 const std::size_t number_of_samples) {
+  const auto& [source, interval] = m_sequence[i];
+  const std::uint64_t end = position + number_of_samples;
+  const auto lower = std::max(position, interval.getLower());
+  const auto upper = std::min(end, interval.getUpper());
+
+  const auto head = static_cast<std::size_t>(lower - position) * 2;
+  const auto tail = static_cast<std::size_t>(upper - position) * 2;
+  std::fill_n(block, head, 0);
+  const bool is_silent =
+      source->getSamples(block + head, interval.getSubstructLower(lower),
+                         static_cast<std::size_t>(upper - lower));
+  std::fill_n(block + tail, number_of_samples * 2 - tail, 0);
+  return is_silent;
+}
+
+// 合成から無音の source を外せるよう, 呼び出し元が読む長さの step ごとに読む
+void BasicSequencer::decodeWindow(DecodedWindow* window,
+                                  const std::uint64_t begin,
+                                  const std::size_t step) {
+  window->begin = begin;
+  window->end = begin + m_window_size;
+  window->step = std::max<std::size_t>(step, 1);
+  m_interval_index->find(&window->sources, window->begin, window->end);
+  window->blocks.resize(std::size(window->sources));
+  window->silent_steps.resize(std::size(window->sources));
+  // source ごとのデコードは順に行う必要があるので, source 単位で分担する
+  m_thread_pool->parallelFor(
+      std::size(window->sources), [this, window](const std::size_t k) {
+        auto& block = window->blocks[k];
+        block.resize(m_window_size * 2);
+        auto& silent_steps = window->silent_steps[k];
+        silent_steps.clear();
+        for (std::uint64_t p = 0; p < m_window_size; p += window->step) {
+          const auto n = static_cast<std::size_t>(
+              std::min<std::uint64_t>(window->step, m_window_size - p));
+          silent_steps.push_back(
+              readSamples(window->sources[k],
+                          block.data() + static_cast<std::size_t>(p) * 2,
+                          window->begin + p, n));
+        }
+      });
+}
+
+void BasicSequencer::getSamplesFromWindow(
+    std::vector<const std::int16_t*>* blocks,
+    const std::uint64_t position,
+    const std::size_t number_of_samples) {
+  const std::uint64_t end = position + number_of_samples;
+  if (position < m_current.begin || m_current.end < end ||
+      m_current.begin == m_current.end) {
+    if (m_next_decoding.valid()) {
+      m_next_decoding.get();
+    }
+    if (m_next.begin == position && m_next.begin != m_next.end) {
+      std::swap(m_current, m_next);
+    } else {
+      decodeWindow(&m_current, position, number_of_samples);
+    }
+    m_next_decoding = std::async(
+        std::launch::async,
+        [this, begin = m_current.end, step = m_current.step] {
+          decodeWindow(&m_next, begin, step);
+        });
+  }
+
+  blocks->clear();
+  const auto offset = static_cast<std::size_t>(position - m_current.begin);
+  // step の区切りと揃っていなければ, 無音かどうかは分からない
+  const bool is_aligned =
+      number_of_samples == m_current.step && offset % m_current.step == 0;
+  for (std::size_t k = 0; k < std::size(m_current.sources); ++k) {
+    const auto& interval = m_sequence[m_current.sources[k]].second;
+    if (interval.getLower() >= end || position >= interval.getUpper()) {
+      continue;
+    }
+    if (is_aligned && m_current.silent_steps[k][offset / m_current.step]) {
+      continue;
     }
+    blocks->push_back(m_current.blocks[k].data() + offset * 2);
   }
 }
 
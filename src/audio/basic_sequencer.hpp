@@ -1,13 +1,17 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "audio/sequencer.hpp"
 #include "audio/source.hpp"
+#include "constants.hpp"
 #include "util/interval.hpp"
+#include "util/interval_index.hpp"
 
 namespace hisui {
 
@@ -15,19 +19,72 @@ class ArchiveItem;
 
 }
 
+namespace hisui::util {
+
+class ThreadPool;
+
+}
+
 namespace hisui::audio {
 
+// decode_threads > 1 の場合は, 一定の区間ごとに source を並列にデコードし,
+// 呼び出し元が合成している間に次の区間をデコードしておく.
+// 振幅が silence_level 以下の source は, その区間の合成から外す. 負ならば外さない
 class BasicSequencer : public Sequencer {
  public:
-  explicit BasicSequencer(const std::vector<hisui::ArchiveItem>&);
+  explicit BasicSequencer(
+      const std::vector<hisui::ArchiveItem>&,
+      const std::size_t decode_threads = 1,
+      const std::uint32_t sample_rate = hisui::Constants::PCM_SAMPLE_RATE,
+      const std::int32_t silence_level = -1);
+  ~BasicSequencer();
 
-  void getSamples(std::vector<std::pair<std::int16_t, std::int16_t>>*,
-                  const std::uint64_t) override;
+  void getSamples(std::vector<const std::int16_t*>*,
+                  const std::uint64_t,
+                  const std::size_t) override;
+  // 並列にデコードする場合は先読みと競合するので使わない
+  bool getPacket(const std::uint8_t**,
+                 std::size_t*,
+                 const std::uint64_t,
+                 const std::size_t) override;
+  void seek(const std::uint64_t) override;
 
  private:
+  struct DecodedWindow {
+    std::uint64_t begin = 0;
+    std::uint64_t end = 0;
+    // [begin, end) に掛かる m_sequence の index と, その source の sample
+    std::vector<std::size_t> sources = {};
+    std::vector<std::vector<std::int16_t>> blocks = {};
+    // source ごとに, step 個ずつに区切った sample が無音か
+    std::size_t step = 0;
+    std::vector<std::vector<bool>> silent_steps = {};
+  };
+
   std::vector<
       std::pair<std::unique_ptr<hisui::audio::Source>, hisui::util::Interval>>
       m_sequence;
+  std::unique_ptr<hisui::util::IntervalIndex> m_interval_index;
+  std::vector<std::size_t> m_active;
+  // m_sequence の各 source 用の sample の置き場所
+  std::vector<std::vector<std::int16_t>> m_blocks;
+
+  std::unique_ptr<hisui::util::ThreadPool> m_thread_pool;
+  // 並列にデコードする区間の長さ. 1 秒分
+  std::uint64_t m_window_size;
+  DecodedWindow m_current;
+  DecodedWindow m_next;
+  // m_next をデコードしている処理. m_current と m_next より先に破棄する
+  std::future<void> m_next_decoding;
+
+  bool readSamples(const std::size_t,
+                   std::int16_t*,
+                   const std::uint64_t,
+                   const std::size_t);
+  void decodeWindow(DecodedWindow*, const std::uint64_t, const std::size_t);
+  void getSamplesFromWindow(std::vector<const std::int16_t*>*,
+                            const std::uint64_t,
+                            const std::size_t);
 };
 
 }  // namespace hisui::audio
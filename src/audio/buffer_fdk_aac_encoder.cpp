@@ -9,11 +9,13 @@
 #include "audio/fdk_aac.hpp"
 #include "constants.hpp"
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
 
 namespace hisui::audio {
 
 BufferFDKAACEncoder::BufferFDKAACEncoder(
-    std::queue<hisui::Frame>* t_buffer,
+    hisui::FrameQueue* t_buffer,
     const BufferFDKAACEncoderParameters& params)
     : m_buffer(t_buffer) {
   ::AACENC_InfoStruct info;
@@ -26,6 +28,7 @@ BufferFDKAACEncoder::BufferFDKAACEncoder(
       2 *
       info.frameLength;  // 2 = (bits_per_sample) / 8 where bits_per_sample = 16
   m_aac_buffer = new std::uint8_t[Constants::FDK_AAC_ENCODE_BUFFER_SIZE];
+  m_pcm_buffer.reserve(m_max_sample_size);
 }
 
 BufferFDKAACEncoder::~BufferFDKAACEncoder() {
@@ -35,24 +38,40 @@ BufferFDKAACEncoder::~BufferFDKAACEncoder() {
   ::aacEncClose(&m_handle);
 }
 
-void BufferFDKAACEncoder::addSample(const std::int16_t left,
-                                    const std::int16_t right) {
-  m_pcm_buffer.push_back(left);
-  m_pcm_buffer.push_back(right);
-
-  if (std::size(m_pcm_buffer) >= m_max_sample_size) {
-    encodeAndWrite();
-    m_timestamp += m_max_sample_size / 2;
+void BufferFDKAACEncoder::addSamples(const std::int16_t* samples,
+                                     const std::size_t number_of_samples) {
+  const std::int16_t* end = samples + number_of_samples * 2;
+  while (samples != end) {
+    // 溜めている sample がなければ, 1 フレーム分ずつ samples から直接エンコードする
+    if (std::empty(m_pcm_buffer) &&
+        static_cast<std::size_t>(end - samples) >= m_max_sample_size) {
+      encodeAndWrite(samples, m_max_sample_size);
+      m_timestamp += m_max_sample_size / 2;
+      samples += m_max_sample_size;
+      continue;
+    }
+    const auto n = std::min(static_cast<std::size_t>(end - samples),
+                            m_max_sample_size - std::size(m_pcm_buffer));
+    m_pcm_buffer.insert(std::end(m_pcm_buffer), samples, samples + n);
+    samples += n;
+
+    if (std::size(m_pcm_buffer) >= m_max_sample_size) {
+      encodeAndWrite(m_pcm_buffer.data(), std::size(m_pcm_buffer));
+      m_pcm_buffer.clear();
+      m_timestamp += m_max_sample_size / 2;
+    }
   }
 }
 
 void BufferFDKAACEncoder::flush() {
   if (std::size(m_pcm_buffer) > 0) {
-    encodeAndWrite();
+    encodeAndWrite(m_pcm_buffer.data(), std::size(m_pcm_buffer));
+    m_pcm_buffer.clear();
   }
 }
 
-void BufferFDKAACEncoder::encodeAndWrite() {
+void BufferFDKAACEncoder::encodeAndWrite(const std::int16_t* pcm,
+                                         const std::size_t size) {
   ::AACENC_BufDesc in_buf, out_buf;
   ::AACENC_InArgs in_args;
   ::AACENC_OutArgs out_args;
@@ -63,9 +82,10 @@ void BufferFDKAACEncoder::encodeAndWrite() {
   void *in_ptr, *out_ptr;
   ::AACENC_ERROR err;
 
-  const int num_in_samples = static_cast<int>(std::size(m_pcm_buffer));
+  const int num_in_samples = static_cast<int>(size);
 
-  in_ptr = m_pcm_buffer.data();
+  // aacEncEncode() は入力を書き換えない
+  in_ptr = const_cast<std::int16_t*>(pcm);
   in_size = num_in_samples * 2;
   in_elem_size = 2;
 
@@ -99,14 +119,12 @@ void BufferFDKAACEncoder::encodeAndWrite() {
 
   const std::size_t data_size = static_cast<std::size_t>(out_args.numOutBytes);
 
-  std::uint8_t* data = new std::uint8_t[data_size];
-  std::copy_n(m_aac_buffer, data_size, data);
+  auto data = FrameBufferPool::getInstance().acquire(data_size);
+  std::copy_n(m_aac_buffer, data_size, data.get());
   m_buffer->push(hisui::Frame{.timestamp = m_timestamp,
                               .data = data,
                               .data_size = data_size,
                               .is_key = true});
-
-  m_pcm_buffer.clear();
 }
 
 }  // namespace hisui::audio
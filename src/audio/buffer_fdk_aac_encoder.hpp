@@ -2,14 +2,15 @@
 
 #include <fdk-aac/aacenc_lib.h>
 
+#include <cstddef>
 #include <cstdint>
-#include <queue>
 #include <vector>
 
 #include "audio/encoder.hpp"
 
 namespace hisui {
 
+class FrameQueue;
 struct Frame;
 
 }
@@ -22,21 +23,22 @@ struct BufferFDKAACEncoderParameters {
 
 class BufferFDKAACEncoder : public Encoder {
  public:
-  BufferFDKAACEncoder(std::queue<hisui::Frame>*,
+  BufferFDKAACEncoder(hisui::FrameQueue*,
                       const BufferFDKAACEncoderParameters&);
   ~BufferFDKAACEncoder();
-  void addSample(const std::int16_t, const std::int16_t) override;
+  void addSamples(const std::int16_t*, const std::size_t) override;
   void flush() override;
 
  private:
-  std::queue<hisui::Frame>* m_buffer;
+  hisui::FrameQueue* m_buffer;
   ::HANDLE_AACENCODER m_handle;
   std::vector<std::int16_t> m_pcm_buffer;
   std::uint64_t m_max_sample_size;
   std::uint8_t* m_aac_buffer = nullptr;
   std::uint64_t m_timestamp = 0;
 
-  void encodeAndWrite();
+  // pcm は L, R の順に並んだ size 個の値
+  void encodeAndWrite(const std::int16_t* pcm, const std::size_t size);
 };
 
 }  // namespace hisui::audio
@@ -10,45 +10,86 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <stdexcept>
 
 #include "audio/opus.hpp"
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
 
 namespace hisui::audio {
 
-BufferOpusEncoder::BufferOpusEncoder(std::queue<hisui::Frame>* t_buffer,
+namespace {
+
+// 無音をこの数だけエンコードした後は, エンコーダーの状態が落ち着いたものとみなす
+const std::size_t NUMBER_OF_SILENT_FRAMES_TO_SETTLE = 4;
+
+}  // namespace
+
+BufferOpusEncoder::BufferOpusEncoder(hisui::FrameQueue* t_buffer,
                                      const BufferOpusEncoderParameters& params)
     : m_buffer(t_buffer),
+      m_frame_size(static_cast<std::size_t>(params.frame_duration) *
+                   params.sample_rate / 1000),
+      m_opus_buffer(hisui::Constants::OPUS_MAX_PACKET_SIZE *
+                    std::max(1U, params.frame_duration / 20)),
       m_timescale(params.timescale),
-      m_timestamp_step(
-          static_cast<std::uint64_t>(hisui::Constants::OPUS_ENCODE_FRAME_SIZE) *
-          m_timescale / hisui::Constants::PCM_SAMPLE_RATE) {
-  m_encoder = create_opus_encoder({.bit_rate = params.bit_rate});
-
-  const int ret = ::opus_encoder_ctl(m_encoder, OPUS_GET_LOOKAHEAD(&m_skip));
+      m_timestamp_step(static_cast<std::uint64_t>(m_frame_size) * m_timescale /
+                       params.sample_rate) {
+  m_timestamp = params.first_frame * m_timestamp_step;
+  m_encoder = create_opus_encoder({.sample_rate = params.sample_rate,
+                                   .bit_rate = params.bit_rate,
+                                   .application = params.application,
+                                   .vbr = params.vbr,
+                                   .constrained_vbr = params.constrained_vbr,
+                                   .complexity = params.complexity});
+
+  ::opus_int32 lookahead;
+  const int ret = ::opus_encoder_ctl(m_encoder, OPUS_GET_LOOKAHEAD(&lookahead));
   if (ret < 0) {
     throw std::runtime_error(
         fmt::format("opus_encoder_ctl(GET_LOOKAHEAD) failed: error='{}'",
                     ::opus_strerror(ret)));
   }
+  // lookahead はエンコーダーのサンプリングレートでの値だが,
+  // pre-skip は常に 48 kHz での sample 数で表す
+  m_skip = static_cast<::opus_int32>(
+      static_cast<std::int64_t>(lookahead) * hisui::Constants::PCM_SAMPLE_RATE /
+      params.sample_rate);
 
   spdlog::debug("BufferOpusEncoder: skip={}", m_skip);
+  m_pcm_buffer.reserve(m_frame_size * 2);
 }
 
 BufferOpusEncoder::~BufferOpusEncoder() {
   ::opus_encoder_destroy(m_encoder);
 }
 
-void BufferOpusEncoder::addSample(const std::int16_t left,
-                                  const std::int16_t right) {
-  m_pcm_buffer.push_back(left);
-  m_pcm_buffer.push_back(right);
-
-  if (std::size(m_pcm_buffer) >= hisui::Constants::OPUS_ENCODE_FRAME_SIZE * 2) {
-    encodeAndWrite();
-    m_timestamp += m_timestamp_step;
+void BufferOpusEncoder::addSamples(const std::int16_t* samples,
+                                   const std::size_t number_of_samples) {
+  const std::size_t frame_size = m_frame_size * 2;
+  const std::int16_t* end = samples + number_of_samples * 2;
+  while (samples != end) {
+    // 溜めている sample がなければ, 1 フレーム分ずつ samples から直接エンコードする
+    if (std::empty(m_pcm_buffer) &&
+        static_cast<std::size_t>(end - samples) >= frame_size) {
+      encodeAndWrite(samples, frame_size);
+      m_timestamp += m_timestamp_step;
+      samples += frame_size;
+      continue;
+    }
+    const auto n = std::min(static_cast<std::size_t>(end - samples),
+                            frame_size - std::size(m_pcm_buffer));
+    m_pcm_buffer.insert(std::end(m_pcm_buffer), samples, samples + n);
+    samples += n;
+
+    if (std::size(m_pcm_buffer) >= frame_size) {
+      encodeAndWrite(m_pcm_buffer.data(), std::size(m_pcm_buffer));
+      m_pcm_buffer.clear();
+      m_timestamp += m_timestamp_step;
+    }
   }
 }
 
@@ -56,36 +97,79 @@ void BufferOpusEncoder::flush() {
   // 1 sample しかない場合に実施すると ::OPUS_BUFFER_TOO_SMALL が返るので, その場合は切り捨てる
   const auto size = std::size(m_pcm_buffer);
   if (size > 2) {
-    encodeAndWrite();
+    encodeAndWrite(m_pcm_buffer.data(), size);
   } else if (size > 0) {
     spdlog::debug("pcm buffer has only 1 sample. cannot encode");
   }
+  m_pcm_buffer.clear();
+}
+
+void BufferOpusEncoder::addPacket(const std::uint8_t* packet,
+                                  const std::size_t size) {
+  if (!std::empty(m_pcm_buffer)) {
+    throw std::logic_error(
+        "BufferOpusEncoder::addPacket() is called between frames");
+  }
+  write(packet, size);
+  m_timestamp += m_timestamp_step;
+  m_has_stale_state = true;
 }
 
 ::opus_int32 BufferOpusEncoder::getSkip() const {
   return m_skip;
 }
 
-void BufferOpusEncoder::encodeAndWrite() {
+void BufferOpusEncoder::encodeAndWrite(const opus_int16* pcm,
+                                       const std::size_t size) {
+  if (m_has_stale_state) {
+    // 古い sample が混ざるより, 無音から始まる方が目立たない
+    const int ret = ::opus_encoder_ctl(m_encoder, OPUS_RESET_STATE);
+    if (ret < 0) {
+      throw std::runtime_error(
+          fmt::format("opus_encoder_ctl(RESET_STATE) failed: error='{}'",
+                      ::opus_strerror(ret)));
+    }
+    m_number_of_silent_frames = 0;
+    m_has_stale_state = false;
+  }
+  const bool is_silent =
+      size == m_frame_size * 2 &&
+      std::all_of(pcm, pcm + size, [](const opus_int16 s) { return s == 0; });
+  if (is_silent &&
+      m_number_of_silent_frames >= NUMBER_OF_SILENT_FRAMES_TO_SETTLE) {
+    write(m_silent_packet.data(), std::size(m_silent_packet));
+    return;
+  }
+
   const int number_of_bytes =
-      ::opus_encode(m_encoder, m_pcm_buffer.data(),
-                    static_cast<int>(std::size(m_pcm_buffer) / 2),
-                    m_opus_buffer, hisui::Constants::OPUS_MAX_PACKET_SIZE);
+      ::opus_encode(m_encoder, pcm, static_cast<int>(size / 2),
+                    m_opus_buffer.data(),
+                    static_cast<::opus_int32>(std::size(m_opus_buffer)));
   if (number_of_bytes < 0) {
     throw std::runtime_error(fmt::format("opus_encode() failed: error='{}'",
                                          opus_strerror(number_of_bytes)));
   }
 
-  std::uint8_t* data =
-      new std::uint8_t[static_cast<std::size_t>(number_of_bytes)];
-  std::copy_n(m_opus_buffer, number_of_bytes, data);
-  m_buffer->push(
-      hisui::Frame{.timestamp = m_timestamp,
-                   .data = data,
-                   .data_size = static_cast<std::size_t>(number_of_bytes),
-                   .is_key = true});
+  const auto packet_size = static_cast<std::size_t>(number_of_bytes);
+  if (!is_silent) {
+    m_number_of_silent_frames = 0;
+  } else if (++m_number_of_silent_frames ==
+             NUMBER_OF_SILENT_FRAMES_TO_SETTLE) {
+    m_silent_packet.assign(std::begin(m_opus_buffer),
+                           std::begin(m_opus_buffer) +
+                               static_cast<std::ptrdiff_t>(packet_size));
+  }
+  write(m_opus_buffer.data(), packet_size);
+}
 
-  m_pcm_buffer.clear();
+void BufferOpusEncoder::write(const std::uint8_t* packet,
+                              const std::size_t size) {
+  auto data = FrameBufferPool::getInstance().acquire(size);
+  std::copy_n(packet, size, data.get());
+  m_buffer->push(hisui::Frame{.timestamp = m_timestamp,
+                              .data = data,
+                              .data_size = size,
+                              .is_key = true});
 }
 
 }  // namespace hisui::audio
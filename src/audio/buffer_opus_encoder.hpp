@@ -3,8 +3,8 @@
 #include <opus.h>
 #include <opus_types.h>
 
+#include <cstddef>
 #include <cstdint>
-#include <queue>
 #include <vector>
 
 #include "audio/encoder.hpp"
@@ -12,6 +12,7 @@
 
 namespace hisui {
 
+class FrameQueue;
 struct Frame;
 
 }
@@ -21,29 +22,52 @@ namespace hisui::audio {
 struct BufferOpusEncoderParameters {
   const std::uint32_t bit_rate;
   const std::uint64_t timescale = hisui::Constants::NANO_SECOND;
+  const std::uint32_t sample_rate = hisui::Constants::PCM_SAMPLE_RATE;
+  // 1 フレームの長さ (ms). addPacket() で渡すパケットもこの長さでなければならない
+  const std::uint32_t frame_duration = 20;
+  const int application = OPUS_APPLICATION_AUDIO;
+  const bool vbr = true;
+  const bool constrained_vbr = true;
+  const int complexity = -1;
+  // 最初に出力するフレームの番号. 区間を分けてエンコードしたものを繋げる場合に,
+  // タイムスタンプを通しで振るために使う
+  const std::uint64_t first_frame = 0;
 };
 
 class BufferOpusEncoder : public Encoder {
  public:
-  explicit BufferOpusEncoder(std::queue<hisui::Frame>*,
+  explicit BufferOpusEncoder(hisui::FrameQueue*,
                              const BufferOpusEncoderParameters&);
   ~BufferOpusEncoder();
-  void addSample(const std::int16_t, const std::int16_t) override;
+  void addSamples(const std::int16_t*, const std::size_t) override;
   void flush() override;
+  // 溜めている sample が無い時, つまりフレームの境界でだけ呼べる
+  void addPacket(const std::uint8_t*, const std::size_t) override;
 
+  // pre-skip. sample_rate によらず 48 kHz での sample 数を返す
   ::opus_int32 getSkip() const;
 
  private:
-  std::queue<hisui::Frame>* m_buffer;
+  hisui::FrameQueue* m_buffer;
   ::OpusEncoder* m_encoder;
+  // 1 フレームの sample 数
+  const std::size_t m_frame_size;
   std::vector<opus_int16> m_pcm_buffer;
-  std::uint8_t m_opus_buffer[hisui::Constants::OPUS_MAX_PACKET_SIZE];
+  // 20 ms を超えるフレームは複数の Opus フレームを 1 つのパケットに入れる
+  std::vector<std::uint8_t> m_opus_buffer;
   std::uint64_t m_timestamp = 0;
   const std::uint64_t m_timescale;
   const std::uint64_t m_timestamp_step;
   ::opus_int32 m_skip;
+  // 無音のフレームが続いた場合は, エンコードせずに m_silent_packet を使い回す
+  std::size_t m_number_of_silent_frames = 0;
+  std::vector<std::uint8_t> m_silent_packet;
+  // addPacket() の後は, エンコーダーに残っている lookahead の sample が古い
+  bool m_has_stale_state = false;
 
-  void encodeAndWrite();
+  // pcm は L, R の順に並んだ size 個の値
+  void encodeAndWrite(const opus_int16* pcm, const std::size_t size);
+  void write(const std::uint8_t*, const std::size_t);
 };
 
 }  // namespace hisui::audio
@@ -2,16 +2,20 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <utility>
 
 namespace hisui::audio {
 
 class Decoder {
  public:
   virtual ~Decoder() = default;
-  virtual std::pair<const std::int16_t*, const std::size_t> decode(
-      const unsigned char*,
-      const std::size_t) = 0;
+  // dst に最大 dst_size 個の sample を書き込み, 書き込んだ数を返す.
+  // 複数 channel の場合は channel 順に並べる
+  virtual std::size_t decode(const unsigned char*,
+                             const std::size_t,
+                             std::int16_t* dst,
+                             const std::size_t dst_size) = 0;
+  // 1 回の decode() で書き込まれうる sample の最大数
+  virtual std::size_t getMaxDecodedSize() const = 0;
 };
 
 }  // namespace hisui::audio
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <stdexcept>
 
 namespace hisui::audio {
 
@@ -8,8 +10,14 @@ class Encoder {
  public:
   virtual ~Encoder() = default;
 
-  virtual void addSample(const std::int16_t, const std::int16_t) = 0;
+  // L, R の順に並んだ number_of_samples 個分の sample を受け取る
+  virtual void addSamples(const std::int16_t* samples,
+                          const std::size_t number_of_samples) = 0;
   virtual void flush() = 0;
+  // エンコード済みの 1 フレームを, 次にエンコードするフレームの代わりにそのまま出力する
+  virtual void addPacket(const std::uint8_t*, const std::size_t) {
+    throw std::logic_error("this encoder does not support addPacket()");
+  }
 };
 
 }  // namespace hisui::audio
@@ -1,9 +1,63 @@
 #include "audio/mixer.hpp"
 
+// AVX2 の版も作るので, SSE2 のみの emmintrin.h ではなく immintrin.h を使う
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <limits>
 
+#include "util/cpu_dispatch.hpp"
+
 namespace hisui::audio {
 
+namespace {
+
+// s1 * s2 は int32_t に収まらないことがあるので, uint32_t で計算して折り返す.
+// 分岐を含まないので mix_samples_vttoth() のループはベクトル化される
+inline std::int32_t vttoth(const std::int32_t sample1,
+                           const std::int32_t sample2) {
+  const std::int32_t s1 = sample1 + 32768;
+  const std::int32_t s2 = sample2 + 32768;
+  const std::int32_t q = static_cast<std::int32_t>(
+                             static_cast<std::uint32_t>(s1) *
+                             static_cast<std::uint32_t>(s2)) /
+                         32768;
+  const std::int32_t m =
+      (s1 < 32768 || s2 < 32768) ? q : 2 * (s1 + s2) - q - 65536;
+  return std::min(m, 65535) - 32768;
+}
+
+// limit_samples() はこの値までの振幅をそのまま通す
+constexpr float LIMITER_THRESHOLD = 24576.0f;
+constexpr float LIMITER_KNEE = 32767.0f - LIMITER_THRESHOLD;
+
+#if defined(HISUI_CPU_DISPATCH_X86)
+// 16 sample ずつ処理し, 処理した数を返す
+__attribute__((target("avx2"))) std::size_t mix_samples_simple_avx2(
+    std::int16_t* mixed,
+    const std::int16_t* samples,
+    const std::size_t size) {
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mixed + i));
+    const __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mixed + i),
+                        _mm256_adds_epi16(a, b));
+  }
+  return i;
+}
+#endif
+
+}  // namespace
+
 // https://stackoverflow.com/a/12090491
 std::int16_t mix_sample_simple(const std::int16_t sample1,
                                const std::int16_t sample2) {
@@ -22,18 +76,71 @@ std::int16_t mix_sample_simple(const std::int16_t sample1,
 // https://stackoverflow.com/a/25102339
 std::int16_t mix_sample_vttoth(const std::int16_t sample1,
                                const std::int16_t sample2) {
-  std::int32_t s1 = sample1 + 32768;
-  std::int32_t s2 = sample2 + 32768;
-  std::int32_t m;
-  if ((s1 < 32768) || (s2 < 32768)) {
-    m = s1 * s2 / 32768;
-  } else {
-    m = 2 * (s1 + s2) - (s1 * s2) / 32768 - 65536;
+  return static_cast<std::int16_t>(vttoth(sample1, sample2));
+}
+
+void mix_samples_simple(std::int16_t* mixed,
+                        const std::int16_t* samples,
+                        const std::size_t size) {
+  std::size_t i = 0;
+#if defined(HISUI_CPU_DISPATCH_X86)
+  if (hisui::util::has_avx2()) {
+    i = mix_samples_simple_avx2(mixed, samples, size);
+  }
+#endif
+  // x86_64 の SSE2, aarch64 の NEON は常に使える飽和加算を持つ
+#if defined(__SSE2__)
+  for (; i + 8 <= size; i += 8) {
+    const __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mixed + i));
+    const __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mixed + i),
+                     _mm_adds_epi16(a, b));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= size; i += 8) {
+    vst1q_s16(mixed + i, vqaddq_s16(vld1q_s16(mixed + i),
+                                    vld1q_s16(samples + i)));
+  }
+#endif
+  for (; i < size; ++i) {
+    mixed[i] = mix_sample_simple(mixed[i], samples[i]);
+  }
+}
+
+HISUI_TARGET_CLONES
+void mix_samples_vttoth(std::int16_t* mixed,
+                        const std::int16_t* samples,
+                        const std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    mixed[i] = static_cast<std::int16_t>(vttoth(mixed[i], samples[i]));
+  }
+}
+
+HISUI_TARGET_CLONES
+void accumulate_samples(std::int32_t* bus,
+                        const std::int16_t* samples,
+                        const std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    bus[i] += samples[i];
   }
-  if (m >= 65536) {
-    m = 65535;
+}
+
+// 閾値を超えた分 e を K * e / (e + K) に縮めるので, 振幅は 32767 に漸近する.
+// 分岐を含まないのでループはベクトル化される
+HISUI_TARGET_CLONES
+void limit_samples(std::int16_t* mixed,
+                   const std::int32_t* bus,
+                   const std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    const auto x = static_cast<float>(bus[i]);
+    const auto a = std::abs(x);
+    const auto e = std::max(a - LIMITER_THRESHOLD, 0.0f);
+    const auto y = std::min(a, LIMITER_THRESHOLD) +
+                   LIMITER_KNEE * e / (e + LIMITER_KNEE);
+    mixed[i] = static_cast<std::int16_t>(std::copysign(y, x));
   }
-  return static_cast<std::int16_t>(m - 32768);
 }
 
 }  // namespace hisui::audio
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace hisui::audio {
@@ -8,4 +9,25 @@ std::int16_t mix_sample_simple(std::int16_t, std::int16_t);
 
 std::int16_t mix_sample_vttoth(std::int16_t, std::int16_t);
 
+// i < size について mixed[i] = mix_sample_xxx(mixed[i], samples[i]) とする
+void mix_samples_simple(std::int16_t* mixed,
+                        const std::int16_t* samples,
+                        const std::size_t size);
+
+void mix_samples_vttoth(std::int16_t* mixed,
+                        const std::int16_t* samples,
+                        const std::size_t size);
+
+// 全ての source を int32_t の bus に足し合わせてから, 最後に 1 度だけ limit_samples() で
+// int16_t に収める. 足す順序によらず結果が決まる
+// i < size について bus[i] += samples[i] とする
+void accumulate_samples(std::int32_t* bus,
+                        const std::int16_t* samples,
+                        const std::size_t size);
+
+// 閾値を超える部分だけを滑らかに圧縮し, int16_t の範囲に収めて mixed に書き込む
+void limit_samples(std::int16_t* mixed,
+                   const std::int32_t* bus,
+                   const std::size_t size);
+
 }  // namespace hisui::audio
@@ -40,18 +40,29 @@ std::array<std::uint8_t, 19> create_opus_private_data(
   int err;
   ::OpusEncoder* encoder =
       ::opus_encoder_create(static_cast<opus_int32>(params.sample_rate),
-                            params.channels, OPUS_APPLICATION_AUDIO, &err);
+                            params.channels, params.application, &err);
   if (err < 0) {
     throw std::runtime_error(fmt::format(
         "opus_encoder_create() failed: error='{}'", ::opus_strerror(err)));
   }
 
-  const int encoder_ctl_ret =
-      ::opus_encoder_ctl(encoder, OPUS_SET_BITRATE(params.bit_rate));
-  if (encoder_ctl_ret < 0) {
-    throw std::runtime_error(
-        fmt::format("opus_encoder_ctl(BITRATE) failed: error='{}'",
-                    ::opus_strerror(encoder_ctl_ret)));
+  auto check = [encoder](const int ret, const char* name) {
+    if (ret < 0) {
+      ::opus_encoder_destroy(encoder);
+      throw std::runtime_error(
+          fmt::format("opus_encoder_ctl({}) failed: error='{}'", name,
+                      ::opus_strerror(ret)));
+    }
+  };
+  check(::opus_encoder_ctl(encoder, OPUS_SET_BITRATE(params.bit_rate)),
+        "BITRATE");
+  check(::opus_encoder_ctl(encoder, OPUS_SET_VBR(params.vbr ? 1 : 0)), "VBR");
+  check(::opus_encoder_ctl(encoder, OPUS_SET_VBR_CONSTRAINT(
+                                        params.constrained_vbr ? 1 : 0)),
+        "VBR_CONSTRAINT");
+  if (params.complexity >= 0) {
+    check(::opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(params.complexity)),
+          "COMPLEXITY");
   }
 
   return encoder;
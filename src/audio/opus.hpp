@@ -22,6 +22,13 @@ struct CreateOpusEncoderParameters {
   const std::uint32_t sample_rate = hisui::Constants::PCM_SAMPLE_RATE;
   const int channels = 2;
   const std::uint32_t bit_rate = hisui::Constants::OPUS_DEFAULT_BIT_RATE;
+  // OPUS_APPLICATION_*
+  const int application = OPUS_APPLICATION_AUDIO;
+  const bool vbr = true;
+  // vbr の場合に, ビットレートの変動を抑える
+  const bool constrained_vbr = true;
+  // 0-10. 負ならば libopus の既定値を使う
+  const int complexity = -1;
 };
 
 ::OpusEncoder* create_opus_encoder(const CreateOpusEncoderParameters&);
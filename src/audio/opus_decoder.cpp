@@ -5,6 +5,9 @@
 #include <opus_defines.h>
 #include <opus_types.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 
 #include "audio/opus.hpp"
@@ -12,40 +15,48 @@
 
 namespace hisui::audio {
 
-OpusDecoder::OpusDecoder(const int t_channles) : m_channels(t_channles) {
+OpusDecoder::OpusDecoder(const int t_channles,
+                         const std::uint32_t t_sample_rate)
+    : m_channels(t_channles),
+      m_max_frame_size(static_cast<std::size_t>(
+          Constants::OPUS_DECODE_MAX_FRAME_SIZE * t_sample_rate /
+          Constants::PCM_SAMPLE_RATE)) {
   if (m_channels != 1 && m_channels != 2) {
     throw std::invalid_argument(
         fmt::format("invalid number of channels: {}", m_channels));
   }
 
-  m_decoder = create_opus_decoder({.channels = m_channels});
-
-  m_opus_buffer = new std::int16_t[static_cast<std::size_t>(
-      hisui::Constants::OPUS_DECODE_MAX_FRAME_SIZE *
-      static_cast<std::uint32_t>(m_channels))];
+  // libopus は 48 kHz 以外でも直接デコードできるので, 別途リサンプルしなくてよい
+  m_decoder = create_opus_decoder(
+      {.sample_rate = t_sample_rate, .channels = m_channels});
 }
 
 OpusDecoder::~OpusDecoder() {
-  if (m_opus_buffer) {
-    delete[] m_opus_buffer;
-  }
   if (m_decoder) {
     ::opus_decoder_destroy(m_decoder);
   }
 }
 
-std::pair<const std::int16_t*, const std::size_t> OpusDecoder::decode(
-    const unsigned char* src_buffer,
-    const std::size_t src_buffer_length) {
+std::size_t OpusDecoder::decode(const unsigned char* src_buffer,
+                                const std::size_t src_buffer_length,
+                                std::int16_t* dst,
+                                const std::size_t dst_size) {
+  const auto channels = static_cast<std::size_t>(m_channels);
+  const int frame_size =
+      static_cast<int>(std::min(dst_size / channels, m_max_frame_size));
   const int number_of_samples = ::opus_decode(
-      m_decoder, src_buffer, static_cast<opus_int32>(src_buffer_length),
-      m_opus_buffer, hisui::Constants::OPUS_DECODE_MAX_FRAME_SIZE, 0);
+      m_decoder, src_buffer, static_cast<opus_int32>(src_buffer_length), dst,
+      frame_size, 0);
 
   if (number_of_samples < 0) {
     throw std::runtime_error(fmt::format("opus_decode() failed: error='{}'",
                                          ::opus_strerror(number_of_samples)));
   }
-  return {m_opus_buffer, number_of_samples * m_channels};
+  return static_cast<std::size_t>(number_of_samples) * channels;
+}
+
+std::size_t OpusDecoder::getMaxDecodedSize() const {
+  return m_max_frame_size * static_cast<std::size_t>(m_channels);
 }
 
 }  // namespace hisui::audio
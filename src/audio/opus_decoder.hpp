@@ -4,25 +4,30 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <utility>
 
 #include "audio/decoder.hpp"
+#include "constants.hpp"
 
 namespace hisui::audio {
 
 class OpusDecoder : public Decoder {
  public:
-  explicit OpusDecoder(const int t_channles);
+  explicit OpusDecoder(
+      const int t_channles,
+      const std::uint32_t t_sample_rate = hisui::Constants::PCM_SAMPLE_RATE);
   ~OpusDecoder();
 
-  std::pair<const std::int16_t*, const std::size_t> decode(
-      const unsigned char*,
-      const std::size_t) override;
+  std::size_t decode(const unsigned char*,
+                     const std::size_t,
+                     std::int16_t*,
+                     const std::size_t) override;
+  std::size_t getMaxDecodedSize() const override;
 
  private:
   ::OpusDecoder* m_decoder = nullptr;
   int m_channels;
-  std::int16_t* m_opus_buffer = nullptr;
+  // 1 フレームの最大 sample 数. 120 ms 分
+  std::size_t m_max_frame_size;
 };
 
 }  // namespace hisui::audio
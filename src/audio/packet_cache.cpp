@@ -0,0 +1,202 @@
+#include "audio/packet_cache.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "util/file.hpp"
+
+namespace hisui::audio {
+
+namespace {
+
+constexpr char MAGIC[8] = {'H', 'I', 'S', 'U', 'I', 'A', 'P', 'C'};
+// 書式を変えたら上げる
+constexpr std::uint32_t VERSION = 1;
+// 壊れたファイルで巨大な領域を確保しないための上限
+constexpr std::uint64_t MAX_PACKET_SIZE = 1 << 20;
+constexpr std::uint64_t MAX_KEY_SIZE = 1 << 24;
+
+// キャッシュは作ったマシンでしか読まないので, バイト順はそのままでよい
+template <typename T>
+void write_value(std::ostream& os, const T& value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_value(std::istream& is) {
+  T value{};
+  is.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+}  // namespace
+
+PacketCache::PacketCache(const std::string& cache_directory,
+                         const std::string& key)
+    : m_key(key),
+      m_path(std::filesystem::path(cache_directory) /
+             fmt::format("audio.{:016x}.cache",
+                         std::hash<std::string>{}(key))) {}
+
+PacketCache::~PacketCache() {
+  if (m_os.is_open()) {
+    m_os.close();
+    std::error_code ec;
+    std::filesystem::remove(m_tmp_path, ec);
+  }
+}
+
+std::optional<std::vector<hisui::Frame>> PacketCache::load() const {
+  std::ifstream is(m_path, std::ios::binary);
+  if (!is) {
+    return {};
+  }
+
+  char magic[sizeof(MAGIC)];
+  is.read(magic, sizeof(magic));
+  if (!is || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      read_value<std::uint32_t>(is) != VERSION) {
+    spdlog::debug("audio cache is outdated: {}", m_path.string());
+    return {};
+  }
+  // ハッシュが衝突していても別の合成のパケットを使わないよう, key 全体を比べる
+  const auto key_size = read_value<std::uint64_t>(is);
+  if (!is || key_size != std::size(m_key) || key_size > MAX_KEY_SIZE) {
+    spdlog::debug("audio cache key mismatch: {}", m_path.string());
+    return {};
+  }
+  std::string key(key_size, '\0');
+  is.read(std::data(key), static_cast<std::streamsize>(key_size));
+  if (!is || key != m_key) {
+    spdlog::debug("audio cache key mismatch: {}", m_path.string());
+    return {};
+  }
+
+  std::vector<hisui::Frame> frames;
+  // 最後まで書き終えたファイルは, 末尾に 0 の tag がある
+  while (is && read_value<std::uint8_t>(is) == 1) {
+    const auto timestamp = read_value<std::uint64_t>(is);
+    const auto is_key = read_value<std::uint8_t>(is) != 0;
+    const auto size = read_value<std::uint64_t>(is);
+    if (!is || size > MAX_PACKET_SIZE) {
+      is.setstate(std::ios::failbit);
+      break;
+    }
+    auto data =
+        hisui::FrameBufferPool::getInstance().acquire(std::max<std::size_t>(
+            static_cast<std::size_t>(size), 1));
+    is.read(reinterpret_cast<char*>(data.get()),
+            static_cast<std::streamsize>(size));
+    frames.push_back(hisui::Frame{.timestamp = timestamp,
+                                  .data = std::move(data),
+                                  .data_size = static_cast<std::size_t>(size),
+                                  .is_key = is_key});
+  }
+  if (!is) {
+    spdlog::warn("audio cache is broken: {}", m_path.string());
+    return {};
+  }
+  spdlog::debug("audio cache loaded: {}", m_path.string());
+  return frames;
+}
+
+void PacketCache::startRecording() {
+  // 同時に合成している他のプロセスが書きかけのファイルを読まないよう,
+  // 別の名前で書いてから置き換える
+  m_tmp_path = m_path;
+  m_tmp_path += fmt::format(".{}.tmp", ::getpid());
+  try {
+    std::filesystem::create_directories(m_path.parent_path());
+    m_os.open(m_tmp_path, std::ios::binary | std::ios::trunc);
+    if (!m_os) {
+      throw std::runtime_error("open failed: " + m_tmp_path.string());
+    }
+    m_os.write(MAGIC, sizeof(MAGIC));
+    write_value(m_os, VERSION);
+    write_value<std::uint64_t>(m_os, std::size(m_key));
+    m_os.write(std::data(m_key),
+               static_cast<std::streamsize>(std::size(m_key)));
+  } catch (const std::exception& e) {
+    spdlog::warn("recording audio cache failed: {}", e.what());
+    m_os.close();
+  }
+}
+
+void PacketCache::record(const hisui::Frame& frame) {
+  if (!m_os.is_open()) {
+    return;
+  }
+  write_value<std::uint8_t>(m_os, 1);
+  write_value<std::uint64_t>(m_os, frame.timestamp);
+  write_value<std::uint8_t>(m_os, frame.is_key ? 1 : 0);
+  write_value<std::uint64_t>(m_os, frame.data_size);
+  m_os.write(reinterpret_cast<const char*>(frame.data.get()),
+             static_cast<std::streamsize>(frame.data_size));
+}
+
+void PacketCache::commit() {
+  if (!m_os.is_open()) {
+    return;
+  }
+  try {
+    write_value<std::uint8_t>(m_os, 0);
+    m_os.close();
+    if (!m_os) {
+      throw std::runtime_error("write failed: " + m_tmp_path.string());
+    }
+    std::filesystem::rename(m_tmp_path, m_path);
+    spdlog::debug("audio cache saved: {}", m_path.string());
+  } catch (const std::exception& e) {
+    spdlog::warn("saving audio cache failed: {}", e.what());
+    std::error_code ec;
+    std::filesystem::remove(m_tmp_path, ec);
+  }
+}
+
+std::string make_archives_key(
+    const std::vector<hisui::ArchiveItem>& archives) {
+  std::string key;
+  for (const auto& archive : archives) {
+    const auto path = archive.getPath();
+    if (hisui::util::is_url(path.string())) {
+      return "";
+    }
+    const auto absolute_path = std::filesystem::absolute(path);
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(absolute_path, ec);
+    if (ec) {
+      return "";
+    }
+    const auto mtime = std::filesystem::last_write_time(absolute_path, ec);
+    if (ec) {
+      return "";
+    }
+    key += fmt::format("{} size={} mtime={} start={} stop={}\n",
+                       absolute_path.string(), size,
+                       mtime.time_since_epoch().count(),
+                       archive.getStartTimeOffset(),
+                       archive.getStopTimeOffset());
+  }
+  return key;
+}
+
+}  // namespace hisui::audio
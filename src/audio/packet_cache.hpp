@@ -0,0 +1,44 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "frame.hpp"
+
+namespace hisui::audio {
+
+// エンコード済みの音声のパケットを, 入力と設定から作った key ごとにファイルに保存する.
+// レイアウトや映像のコーデックだけを変えて合成し直す場合に, 音声のデコード, ミックス, エンコードを省ける
+class PacketCache {
+ public:
+  PacketCache(const std::string& cache_directory, const std::string& key);
+  ~PacketCache();
+
+  PacketCache(const PacketCache&) = delete;
+  PacketCache& operator=(const PacketCache&) = delete;
+
+  // 保存されている全てのパケット. 無い場合や key が異なる場合, 壊れている場合は空
+  std::optional<std::vector<hisui::Frame>> load() const;
+
+  // 保存に失敗しても合成は続けられるので, 警告を出して以降の record() を無視する
+  void startRecording();
+  void record(const hisui::Frame&);
+  // 全てのパケットを record() し終えたら呼ぶ. 呼ばずに破棄すると書きかけのファイルを消す
+  void commit();
+
+ private:
+  std::string m_key;
+  std::filesystem::path m_path;
+  std::filesystem::path m_tmp_path;
+  std::ofstream m_os;
+};
+
+// 入力ファイルの絶対パス, 大きさ, 更新日時と区間から作る key の一部.
+// URL を含む場合は内容が変わったかを確かめられないので空を返す
+std::string make_archives_key(const std::vector<hisui::ArchiveItem>&);
+
+}  // namespace hisui::audio
@@ -0,0 +1,202 @@
+#include "audio/pcm_writer.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <numbers>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace hisui::audio {
+
+namespace {
+
+// 間引く間隔あたりの filter の片側の長さ
+constexpr std::size_t HALF_TAPS_PER_FACTOR = 8;
+// 折り返しを抑えるため, 遮断周波数は出力のナイキスト周波数より少し低くする
+constexpr double CUTOFF_RATIO = 0.9;
+constexpr std::size_t WAV_HEADER_SIZE = 44;
+
+// Blackman 窓をかけた sinc 関数の low-pass filter. 係数の和は 1 にする
+std::vector<float> make_low_pass_filter(const std::size_t factor) {
+  const std::size_t half = HALF_TAPS_PER_FACTOR * factor;
+  const double cutoff = CUTOFF_RATIO * 0.5 / static_cast<double>(factor);
+  std::vector<double> taps(2 * half + 1);
+  for (std::size_t i = 0; i < std::size(taps); ++i) {
+    const double x = static_cast<double>(i) - static_cast<double>(half);
+    const double sinc =
+        x == 0.0 ? 2.0 * cutoff
+                 : std::sin(2.0 * std::numbers::pi * cutoff * x) /
+                       (std::numbers::pi * x);
+    const double phase = 2.0 * std::numbers::pi * static_cast<double>(i) /
+                         static_cast<double>(std::size(taps) - 1);
+    const double window =
+        0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+    taps[i] = sinc * window;
+  }
+  const double sum = std::accumulate(std::begin(taps), std::end(taps), 0.0);
+  std::vector<float> normalized;
+  for (const auto t : taps) {
+    normalized.push_back(static_cast<float>(t / sum));
+  }
+  return normalized;
+}
+
+std::int16_t to_sample(const float value) {
+  return static_cast<std::int16_t>(
+      std::clamp(std::lround(value), -32768L, 32767L));
+}
+
+template <typename T>
+void put_le(std::array<char, WAV_HEADER_SIZE>* header,
+            const std::size_t offset,
+            const T value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    (*header)[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+}  // namespace
+
+PCMWriter::PCMWriter(const std::string& t_filename,
+                     const PCMWriterParameters& params)
+    : m_filename(t_filename),
+      m_ofs(t_filename, std::ios_base::binary | std::ios_base::trunc),
+      m_out_sample_rate(params.out_sample_rate != 0 ? params.out_sample_rate
+                                                    : params.sample_rate),
+      m_channels(params.channels),
+      m_wav(params.wav) {
+  if (!m_ofs) {
+    throw std::runtime_error(fmt::format("opening {} failed", m_filename));
+  }
+  if (m_channels != 1 && m_channels != 2) {
+    throw std::invalid_argument(
+        fmt::format("channels must be 1 or 2: {}", m_channels));
+  }
+  if (m_out_sample_rate == 0 || m_out_sample_rate > params.sample_rate ||
+      params.sample_rate % m_out_sample_rate != 0) {
+    throw std::invalid_argument(
+        fmt::format("out_sample_rate must divide sample_rate: {} {}",
+                    m_out_sample_rate, params.sample_rate));
+  }
+  m_factor = params.sample_rate / m_out_sample_rate;
+  if (m_factor > 1) {
+    m_taps = make_low_pass_filter(m_factor);
+    // 出力の sample が filter の中央に来るよう, 片側の長さだけ無音を入れておく
+    m_input.resize(std::size(m_taps) / 2 * m_channels);
+  }
+  if (m_wav) {
+    writeHeader();
+  }
+}
+
+void PCMWriter::addSamples(const std::int16_t* samples,
+                           const std::size_t number_of_samples) {
+  if (m_factor == 1) {
+    if (m_channels == 2) {
+      m_output.assign(samples, samples + number_of_samples * 2);
+    } else {
+      m_output.clear();
+      for (std::size_t i = 0; i < number_of_samples; ++i) {
+        m_output.push_back(to_sample(
+            (static_cast<float>(samples[2 * i]) + samples[2 * i + 1]) / 2));
+      }
+    }
+    write();
+    return;
+  }
+
+  for (std::size_t i = 0; i < number_of_samples; ++i) {
+    if (m_channels == 2) {
+      m_input.push_back(samples[2 * i]);
+      m_input.push_back(samples[2 * i + 1]);
+    } else {
+      m_input.push_back(
+          (static_cast<float>(samples[2 * i]) + samples[2 * i + 1]) / 2);
+    }
+  }
+  decimate();
+  write();
+}
+
+void PCMWriter::flush() {
+  if (m_factor > 1) {
+    // 最後の sample まで filter の中央に来るよう, 片側の長さだけ無音を足す
+    m_input.resize(std::size(m_input) + std::size(m_taps) / 2 * m_channels);
+    decimate();
+    write();
+  }
+  if (m_wav) {
+    m_ofs.seekp(0);
+    writeHeader();
+    m_ofs.seekp(0, std::ios_base::end);
+  }
+  m_ofs.flush();
+  if (!m_ofs) {
+    throw std::runtime_error(fmt::format("writing {} failed", m_filename));
+  }
+}
+
+void PCMWriter::decimate() {
+  const std::size_t number_of_taps = std::size(m_taps);
+  const std::size_t frames = std::size(m_input) / m_channels;
+  m_output.clear();
+  std::size_t position = 0;
+  for (; position + number_of_taps <= frames; position += m_factor) {
+    for (std::size_t c = 0; c < m_channels; ++c) {
+      float value = 0;
+      for (std::size_t k = 0; k < number_of_taps; ++k) {
+        value += m_taps[k] * m_input[(position + k) * m_channels + c];
+      }
+      m_output.push_back(to_sample(value));
+    }
+  }
+  m_input.erase(std::begin(m_input),
+                std::begin(m_input) +
+                    static_cast<std::ptrdiff_t>(position * m_channels));
+}
+
+void PCMWriter::write() {
+  const auto size = std::size(m_output) * sizeof(std::int16_t);
+  m_ofs.write(reinterpret_cast<const char*>(std::data(m_output)),
+              static_cast<std::streamsize>(size));
+  if (!m_ofs) {
+    throw std::runtime_error(fmt::format("writing {} failed", m_filename));
+  }
+  m_data_size += size;
+}
+
+void PCMWriter::writeHeader() {
+  std::array<char, WAV_HEADER_SIZE> header{};
+  const std::uint16_t block_align =
+      static_cast<std::uint16_t>(m_channels * sizeof(std::int16_t));
+  // 4 GiB を超える場合は大きさを表せないので, 上限の値を入れる
+  const auto data_size = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+      m_data_size, 0xffffffffU - (WAV_HEADER_SIZE - 8)));
+  std::copy_n("RIFF", 4, std::data(header));
+  put_le<std::uint32_t>(
+      &header, 4, data_size + static_cast<std::uint32_t>(WAV_HEADER_SIZE - 8));
+  std::copy_n("WAVEfmt ", 8, std::data(header) + 8);
+  put_le<std::uint32_t>(&header, 16, 16);
+  // PCM
+  put_le<std::uint16_t>(&header, 20, 1);
+  put_le<std::uint16_t>(&header, 22, m_channels);
+  put_le<std::uint32_t>(&header, 24, m_out_sample_rate);
+  put_le<std::uint32_t>(&header, 28, m_out_sample_rate * block_align);
+  put_le<std::uint16_t>(&header, 32, block_align);
+  put_le<std::uint16_t>(&header, 34, 16);
+  std::copy_n("data", 4, std::data(header) + 36);
+  put_le<std::uint32_t>(&header, 40, data_size);
+  m_ofs.write(std::data(header),
+              static_cast<std::streamsize>(std::size(header)));
+}
+
+}  // namespace hisui::audio
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "audio/encoder.hpp"
+#include "constants.hpp"
+
+namespace hisui::audio {
+
+struct PCMWriterParameters {
+  // 受け取る sample の sampling rate
+  const std::uint32_t sample_rate = hisui::Constants::PCM_SAMPLE_RATE;
+  // 書き出す sampling rate. sample_rate を割り切る値でなければならない. 0 ならば sample_rate
+  const std::uint32_t out_sample_rate = 0;
+  // 1 ならば L, R の平均を書き出す
+  const std::uint16_t channels = 2;
+  // false ならばヘッダーを書かずに little endian の sample のみを書き出す
+  const bool wav = true;
+};
+
+// 合成した sample をエンコードせずに 16 bit の PCM で書き出す. Encoder として
+// AudioProducer に渡す. 間引く場合は low-pass filter を通してから間引く
+class PCMWriter : public Encoder {
+ public:
+  PCMWriter(const std::string&, const PCMWriterParameters&);
+
+  void addSamples(const std::int16_t*, const std::size_t) override;
+  void flush() override;
+
+ private:
+  std::string m_filename;
+  std::ofstream m_ofs;
+  std::uint32_t m_out_sample_rate;
+  std::uint16_t m_channels;
+  bool m_wav;
+  // 間引く間隔. 1 ならば filter を通さない
+  std::size_t m_factor;
+  std::vector<float> m_taps;
+  // filter に通す前の, channels 個ずつ並んだ sample
+  std::vector<float> m_input;
+  std::vector<std::int16_t> m_output;
+  std::uint64_t m_data_size = 0;
+
+  void decimate();
+  void write();
+  void writeHeader();
+};
+
+}  // namespace hisui::audio
@@ -1,7 +1,7 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <utility>
 #include <vector>
 
 namespace hisui::audio {
@@ -10,8 +10,25 @@ class Sequencer {
  public:
   virtual ~Sequencer() = default;
 
-  virtual void getSamples(std::vector<std::pair<std::int16_t, std::int16_t>>*,
-                          const std::uint64_t) = 0;
+  // [position, position + number_of_samples) に掛かる source ごとに,
+  // L, R の順に並んだ number_of_samples 個分の sample の先頭を blocks に入れる.
+  // source の区間外は 0 で埋める. 全て無音の source は入れなくてよい.
+  // 指す先は次の呼び出しまで有効
+  virtual void getSamples(std::vector<const std::int16_t*>* blocks,
+                          const std::uint64_t position,
+                          const std::size_t number_of_samples) = 0;
+  // [position, position + number_of_samples) に掛かる source が 1 つだけで,
+  // その Opus のフレームをそのまま出力できる場合に packet と size に入れて true を返す.
+  // packet は次の呼び出しまで有効
+  virtual bool getPacket(const std::uint8_t**,
+                         std::size_t*,
+                         const std::uint64_t,
+                         const std::size_t) {
+    return false;
+  }
+  // 次に getSamples() か getPacket() で読む位置を position にする.
+  // 最初に読む前に 1 度だけ呼ぶ
+  virtual void seek(const std::uint64_t) {}
 };
 
 }  // namespace hisui::audio
@@ -1,15 +1,29 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <utility>
 
 namespace hisui::audio {
 
 class Source {
  public:
   virtual ~Source() = default;
-  virtual std::pair<std::int16_t, std::int16_t> getSample(
-      const std::uint64_t) = 0;
+  // position から number_of_samples 個分の sample を L, R の順に samples へ書き込む.
+  // 書き込んだ sample が全て無音とみなせる場合は true を返す
+  virtual bool getSamples(std::int16_t* samples,
+                          const std::uint64_t position,
+                          const std::size_t number_of_samples) = 0;
+  // position から number_of_samples 個分に当たる Opus のフレームがあれば,
+  // デコードせずに読んで packet と size に入れて true を返す.
+  // packet は次に読むまで有効
+  virtual bool getPacket(const std::uint8_t**,
+                         std::size_t*,
+                         const std::uint64_t,
+                         const std::size_t) {
+    return false;
+  }
+  // 次に読む位置を position にする. 最初に読む前に 1 度だけ呼ぶ
+  virtual void seek(const std::uint64_t) {}
 };
 
 }  // namespace hisui::audio
@@ -1,11 +1,17 @@
 #include "audio/webm_source.hpp"
 
 #include <bits/exception.h>
+#include <opus.h>
+#include <opus_types.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <iterator>
+#include <vector>
 
 #include "audio/decoder.hpp"
 #include "audio/opus_decoder.hpp"
@@ -15,7 +21,19 @@
 
 namespace hisui::audio {
 
-WebMSource::WebMSource(const std::string& t_file_path) {
+namespace {
+
+// シーク先より前からデコードしておき, デコーダーの状態を追従させる長さ (ms)
+constexpr std::uint64_t SEEK_PRE_ROLL_MS = 80;
+// これ以下の大きさの Opus のパケットは DTX で, 音声を含まない
+constexpr std::size_t DTX_PACKET_SIZE = 2;
+
+}  // namespace
+
+WebMSource::WebMSource(const std::string& t_file_path,
+                       const std::uint32_t t_sampling_rate,
+                       const std::int32_t t_silence_level)
+    : m_sampling_rate(t_sampling_rate), m_silence_level(t_silence_level) {
   m_webm = std::make_shared<hisui::webm::input::AudioContext>(t_file_path);
   if (!m_webm->init()) {
     spdlog::info(
@@ -32,9 +50,9 @@ WebMSource::WebMSource(const std::string& t_file_path) {
 
   switch (m_webm->getCodec()) {
     case hisui::webm::input::AudioCodec::Opus:
-      m_channels = m_webm->getChannels(),
-      m_sampling_rate = static_cast<std::uint64_t>(m_webm->getSamplingRate());
-      m_decoder = std::make_shared<OpusDecoder>(m_channels);
+      m_channels = m_webm->getChannels();
+      m_decoder = std::make_shared<OpusDecoder>(
+          m_channels, static_cast<std::uint32_t>(m_sampling_rate));
       if (hisui::report::Reporter::hasInstance()) {
         hisui::report::Reporter::getInstance().registerAudioDecoder(
             m_webm->getFilePath(), {.codec = "opus",
@@ -55,49 +73,193 @@ WebMSource::WebMSource(const std::string& t_file_path) {
   }
 }
 
-std::pair<std::int16_t, std::int16_t> WebMSource::getSample(
-    const std::uint64_t position) {
-  if (!m_decoder) {
-    return {0, 0};
+bool WebMSource::getSamples(std::int16_t* samples,
+                            const std::uint64_t position,
+                            const std::size_t number_of_samples) {
+  const auto channels = static_cast<std::size_t>(m_channels);
+  bool is_silent = true;
+  std::size_t i = 0;
+  while (i < number_of_samples) {
+    if (!m_decoder) {
+      std::fill_n(samples + 2 * i, 2 * (number_of_samples - i), 0);
+      return is_silent;
+    }
+
+    // 読んだフレームのタイムスタンプより前は無音にする
+    const std::uint64_t p = position + i;
+    if (p < m_current_position) {
+      const auto n = static_cast<std::size_t>(std::min(
+          static_cast<std::uint64_t>(number_of_samples - i),
+          m_current_position - p));
+      std::fill_n(samples + 2 * i, 2 * n, 0);
+      i += n;
+      continue;
+    }
+
+    if (m_data_begin == m_data_end) {
+      // データが空だったら次のフレームを読んで, その後の m_decoder と m_current_position の値に応じた処理を行なう
+      readFrame();
+      continue;
+    }
+
+    const auto n =
+        std::min(number_of_samples - i, (m_data_end - m_data_begin) / channels);
+    const std::int16_t* src = m_data.data() + m_data_begin;
+    is_silent = is_silent && m_is_data_silent;
+    if (m_channels == 1) {
+      for (std::size_t j = 0; j < n; ++j) {
+        samples[2 * (i + j)] = src[j];
+        samples[2 * (i + j) + 1] = src[j];
+      }
+    } else {
+      std::copy_n(src, 2 * n, samples + 2 * i);
+    }
+    m_data_begin += n * channels;
+    i += n;
+  }
+  return is_silent;
+}
+
+bool WebMSource::getPacket(const std::uint8_t** packet,
+                           std::size_t* size,
+                           const std::uint64_t position,
+                           const std::size_t number_of_samples) {
+  // Opus のフレームの長さは 48 kHz での sample 数で決まる
+  if (!m_decoder || m_sampling_rate != hisui::Constants::PCM_SAMPLE_RATE) {
+    return false;
+  }
+  const auto channels = static_cast<std::size_t>(m_channels);
+  const auto pending = (m_data_end - m_data_begin) / channels;
+  const auto half = static_cast<std::uint64_t>(number_of_samples / 2);
+  // 残っている sample が多い場合は, 前のフレームがこの区間の大部分を占めている
+  if (pending > half) {
+    return false;
+  }
+  const auto timestamp = m_webm->peekNextTimestamp();
+  if (!timestamp) {
+    return false;
   }
-  if (position < m_current_position) {
-    return {0, 0};
+  const auto next_position = static_cast<std::uint64_t>(*timestamp) *
+                             m_sampling_rate / hisui::Constants::NANO_SECOND;
+  if (next_position + half < position || position + half < next_position) {
+    return false;
+  }
+  if (!m_webm->readFrame()) {
+    m_decoder = nullptr;
+    return false;
   }
 
-  if (std::empty(m_data)) {
-    // データが空だったら次のフレームを読んで, その後の m_decoder と m_current_position の値に応じた処理を行なう
-    readFrame();
-    return getSample(position);
+  const auto samples = ::opus_packet_get_nb_samples(
+      m_webm->getBuffer(), static_cast<::opus_int32>(m_webm->getBufferSize()),
+      static_cast<::opus_int32>(m_sampling_rate));
+  if (samples != static_cast<int>(number_of_samples)) {
+    // 読んでしまったのでデコードしておく. 残っている sample があれば,
+    // 通常と同じくその直後に続くものとする
+    if (pending == 0) {
+      m_current_position = next_position;
+    }
+    decodeFrame();
+    return false;
   }
 
-  if (m_channels == 1) {
-    const std::int16_t d = m_data.front();
-    m_data.pop();
-    return {d, d};
+  // 残っていた sample はこのフレームの先頭と重なるので捨てる.
+  // デコーダーはこのフレームを知らないまま次のフレームをデコードすることになるが,
+  // パケットロスと同じく数 ms で追従する
+  m_data_begin = m_data_end;
+  m_current_position = next_position;
+  *packet = m_webm->getBuffer();
+  *size = m_webm->getBufferSize();
+  return true;
+}
+
+void WebMSource::seek(const std::uint64_t position) {
+  if (!m_decoder) {
+    return;
+  }
+  const auto pre_roll = m_sampling_rate * SEEK_PRE_ROLL_MS / 1000;
+  const auto begin = position > pre_roll ? position - pre_roll : 0;
+  // begin より前のフレームが無ければ, 先頭から読むのと同じになる
+  std::uint64_t p = 0;
+  if (m_webm->seekToKeyFrame(static_cast<std::int64_t>(
+          begin * hisui::Constants::NANO_SECOND / m_sampling_rate))) {
+    m_data_begin = 0;
+    m_data_end = 0;
+    readFrame();
+    p = m_current_position;
   }
 
-  const std::int16_t f = m_data.front();
-  m_data.pop();
-  const std::int16_t s = m_data.front();
-  m_data.pop();
-  return {f, s};
+  std::vector<std::int16_t> discarded(
+      hisui::Constants::OPUS_ENCODE_FRAME_SIZE * 2);
+  while (m_decoder && p < position) {
+    const auto n = static_cast<std::size_t>(
+        std::min(static_cast<std::uint64_t>(std::size(discarded) / 2),
+                 position - p));
+    getSamples(discarded.data(), p, n);
+    p += n;
+  }
 }
 
 void WebMSource::readFrame() {
   if (m_webm->readFrame()) {
     m_current_position = static_cast<std::uint64_t>(m_webm->getTimestamp()) *
-                         hisui::Constants::PCM_SAMPLE_RATE /
-                         hisui::Constants::NANO_SECOND;
-    const auto decoded =
-        m_decoder->decode(m_webm->getBuffer(), m_webm->getBufferSize());
-    if (decoded.second > 0) {
-      for (std::size_t i = 0; i < decoded.second; ++i) {
-        m_data.push(decoded.first[i]);
-      }
-    }
+                         m_sampling_rate / hisui::Constants::NANO_SECOND;
+    decodeFrame();
   } else {
     m_decoder = nullptr;
   }
 }
 
+void WebMSource::decodeFrame() {
+  reserveDecodingSpace();
+  const bool is_data_silent = m_data_begin == m_data_end || m_is_data_silent;
+  const auto begin = m_data_end;
+  // 無音の後の DTX のパケットは, デコードしても無音かコンフォートノイズにしかならない
+  if (m_silence_level >= 0 && m_is_last_frame_silent &&
+      m_webm->getBufferSize() <= DTX_PACKET_SIZE) {
+    const auto samples = ::opus_packet_get_nb_samples(
+        m_webm->getBuffer(),
+        static_cast<::opus_int32>(m_webm->getBufferSize()),
+        static_cast<::opus_int32>(m_sampling_rate));
+    if (samples > 0) {
+      const auto n = std::min(static_cast<std::size_t>(samples) *
+                                  static_cast<std::size_t>(m_channels),
+                              m_decoder->getMaxDecodedSize());
+      std::fill_n(m_data.data() + m_data_end, n, 0);
+      m_data_end += n;
+      m_is_data_silent = is_data_silent;
+      return;
+    }
+  }
+
+  m_data_end += m_decoder->decode(m_webm->getBuffer(), m_webm->getBufferSize(),
+                                  m_data.data() + m_data_end,
+                                  std::size(m_data) - m_data_end);
+  if (m_silence_level < 0) {
+    m_is_data_silent = false;
+    return;
+  }
+  const auto level = m_silence_level;
+  m_is_last_frame_silent = std::all_of(
+      std::begin(m_data) + static_cast<std::ptrdiff_t>(begin),
+      std::begin(m_data) + static_cast<std::ptrdiff_t>(m_data_end),
+      [level](const std::int16_t s) { return std::abs(s) <= level; });
+  m_is_data_silent = is_data_silent && m_is_last_frame_silent;
+}
+
+void WebMSource::reserveDecodingSpace() {
+  const auto size = m_decoder->getMaxDecodedSize();
+  if (std::size(m_data) - m_data_end >= size) {
+    return;
+  }
+  // 読み残しを先頭に寄せる
+  std::copy(std::begin(m_data) + static_cast<std::ptrdiff_t>(m_data_begin),
+            std::begin(m_data) + static_cast<std::ptrdiff_t>(m_data_end),
+            std::begin(m_data));
+  m_data_end -= m_data_begin;
+  m_data_begin = 0;
+  if (std::size(m_data) - m_data_end < size) {
+    m_data.resize(m_data_end + size);
+  }
+}
+
 }  // namespace hisui::audio
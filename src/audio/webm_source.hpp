@@ -1,12 +1,13 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
-#include <queue>
 #include <string>
-#include <utility>
+#include <vector>
 
 #include "audio/source.hpp"
+#include "constants.hpp"
 
 namespace hisui::webm::input {
 
@@ -20,18 +21,45 @@ class Decoder;
 
 class WebMSource : public Source {
  public:
-  explicit WebMSource(const std::string&);
-  std::pair<std::int16_t, std::int16_t> getSample(const std::uint64_t) override;
+  // 振幅が t_silence_level 以下のフレームは無音とみなす. 負ならば無音を判定しない
+  WebMSource(const std::string&,
+             const std::uint32_t t_sampling_rate =
+                 hisui::Constants::PCM_SAMPLE_RATE,
+             const std::int32_t t_silence_level = -1);
+  bool getSamples(std::int16_t*,
+                  const std::uint64_t,
+                  const std::size_t) override;
+  // フレームの位置が position から number_of_samples の半分以上ずれている場合や,
+  // フレームの長さが number_of_samples でない場合は false を返す
+  bool getPacket(const std::uint8_t**,
+                 std::size_t*,
+                 const std::uint64_t,
+                 const std::size_t) override;
+  // position の少し手前のフレームからデコードし, position の直前までを捨てる
+  void seek(const std::uint64_t) override;
 
  private:
   std::shared_ptr<hisui::webm::input::AudioContext> m_webm = nullptr;
   std::shared_ptr<hisui::audio::Decoder> m_decoder = nullptr;
-  int m_channels;
+  int m_channels = 0;
+  // デコードした sample のサンプリングレート. Opus は WebM に書かれた値によらず,
+  // このレートで直接デコードする
   std::uint64_t m_sampling_rate;
-  std::queue<std::int16_t> m_data;
+  std::int32_t m_silence_level;
+  // デコード済みの sample を [m_data_begin, m_data_end) に置く.
+  // デコーダーは m_data_end 以降に直接書き込む
+  std::vector<std::int16_t> m_data;
+  std::size_t m_data_begin = 0;
+  std::size_t m_data_end = 0;
   std::uint64_t m_current_position = 0;
+  // [m_data_begin, m_data_end) が全て無音か
+  bool m_is_data_silent = false;
+  // 最後にデコードしたフレームが無音だったか. 無音の後の DTX はデコードしなくてよい
+  bool m_is_last_frame_silent = false;
 
   void readFrame();
+  void decodeFrame();
+  void reserveDecodingSpace();
 };
 
 }  // namespace hisui::audio
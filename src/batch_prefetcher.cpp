@@ -0,0 +1,155 @@
+#include "batch_prefetcher.hpp"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metadata.hpp"
+#include "util/file.hpp"
+#include "util/io_budget.hpp"
+
+namespace hisui {
+
+namespace {
+
+constexpr std::size_t READ_SIZE = 1024 * 1024;
+
+}  // namespace
+
+BatchPrefetcher::BatchPrefetcher(
+    const std::vector<std::string>& metadata_filenames,
+    const std::size_t number_of_jobs,
+    const std::uint64_t max_size)
+    : m_metadata_filenames(metadata_filenames),
+      m_number_of_jobs(number_of_jobs),
+      m_max_size(max_size),
+      m_sizes(std::size(metadata_filenames), 0) {
+  m_thread = std::thread([this] { run(); });
+}
+
+BatchPrefetcher::~BatchPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_stopped = true;
+  }
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+void BatchPrefetcher::start(const std::size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_number_of_started = std::max(m_number_of_started, index + 1);
+  }
+  m_cv.notify_all();
+}
+
+// 読み終えて, まだ合成を始めていないメタデータの入力の大きさ
+std::uint64_t BatchPrefetcher::getPendingSize() const {
+  std::uint64_t size = 0;
+  for (std::size_t i = m_number_of_started; i < m_next; ++i) {
+    size += m_sizes[i];
+  }
+  return size;
+}
+
+void BatchPrefetcher::run() {
+  while (true) {
+    std::size_t index;
+    std::uint64_t pending_size;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] {
+        if (m_is_stopped) {
+          return true;
+        }
+        // 合成を始めたものは飛ばす
+        m_next = std::max(m_next, m_number_of_started);
+        return m_next < std::size(m_metadata_filenames) &&
+               m_next < m_number_of_started + m_number_of_jobs &&
+               getPendingSize() < m_max_size;
+      });
+      if (m_is_stopped) {
+        return;
+      }
+      index = m_next++;
+      pending_size = getPendingSize();
+    }
+
+    const auto size = prefetch(index, m_max_size - pending_size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sizes[index] = size;
+  }
+}
+
+// index 番目のメタデータの入力を, 合計が limit を超えない範囲で読み, 読んだ大きさを返す
+std::uint64_t BatchPrefetcher::prefetch(const std::size_t index,
+                                        const std::uint64_t limit) {
+  const auto& metadata_filename = m_metadata_filenames[index];
+  std::uint64_t size = 0;
+  try {
+    for (const auto& archive :
+         hisui::parse_metadata(metadata_filename).getArchiveItems()) {
+      const auto path = archive.getPath().string();
+      if (hisui::util::is_url(path)) {
+        continue;
+      }
+      const auto file_size = std::filesystem::file_size(path);
+      if (size + file_size > limit) {
+        spdlog::debug("prefetch size exceeded: {}", path);
+        continue;
+      }
+      if (!readFile(path)) {
+        break;
+      }
+      size += file_size;
+    }
+  } catch (const std::exception& e) {
+    // 合成する時に同じエラーになるので, ここでは合成を止めない
+    spdlog::debug("prefetching {} failed: {}", metadata_filename, e.what());
+  }
+  spdlog::debug("prefetched {}: {} bytes", metadata_filename, size);
+  return size;
+}
+
+// 読み終えずに止めた場合は false を返す
+bool BatchPrefetcher::readFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    spdlog::debug("opening {} failed: {}", path, std::strerror(errno));
+    return true;
+  }
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  std::vector<char> buffer(READ_SIZE);
+  bool is_completed = true;
+  while (true) {
+    if (m_is_stopped) {
+      is_completed = false;
+      break;
+    }
+    hisui::util::ReadBandwidth::acquire(std::size(buffer));
+    const auto n = ::read(fd, std::data(buffer), std::size(buffer));
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+  }
+  ::close(fd);
+  return is_completed;
+}
+
+}  // namespace hisui
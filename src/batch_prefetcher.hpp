@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hisui {
+
+// --batch の合成している間に, 後に続くメタデータの入力を専用のスレッドで先頭から読み,
+// page cache に載せておく. ネットワーク越しのファイルシステムでも, 各合成を I/O を待たずに始められる
+class BatchPrefetcher {
+ public:
+  // 合成を始めていないメタデータの入力の合計が max_size バイトを超えない範囲で,
+  // 最後に始めたものに続く number_of_jobs 個を読む
+  BatchPrefetcher(const std::vector<std::string>& metadata_filenames,
+                  const std::size_t number_of_jobs,
+                  const std::uint64_t max_size);
+  ~BatchPrefetcher();
+
+  BatchPrefetcher(const BatchPrefetcher&) = delete;
+  BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+  // index 番目のメタデータを合成し始める時に呼ぶ
+  void start(const std::size_t index);
+
+ private:
+  const std::vector<std::string> m_metadata_filenames;
+  const std::size_t m_number_of_jobs;
+  const std::uint64_t m_max_size;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  // 合成を始めたメタデータの数
+  std::size_t m_number_of_started = 0;
+  // 次に読むメタデータ
+  std::size_t m_next = 0;
+  // メタデータごとに読んだ大きさ
+  std::vector<std::uint64_t> m_sizes;
+  std::atomic<bool> m_is_stopped = false;
+  std::thread m_thread;
+
+  void run();
+  std::uint64_t getPendingSize() const;
+  std::uint64_t prefetch(const std::size_t index, const std::uint64_t limit);
+  bool readFile(const std::string& path);
+};
+
+}  // namespace hisui
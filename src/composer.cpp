@@ -0,0 +1,173 @@
+#include "composer.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "metadata.hpp"
+#include "muxer/async_webm_muxer.hpp"
+#include "muxer/faststart_mp4_muxer.hpp"
+#include "muxer/fragmented_mp4_muxer.hpp"
+#include "muxer/hls_muxer.hpp"
+#include "muxer/mezzanine.hpp"
+#include "muxer/muxer.hpp"
+#include "muxer/pcm_muxer.hpp"
+#include "muxer/simple_mp4_muxer.hpp"
+#include "preflight.hpp"
+#include "report/reporter.hpp"
+#include "result_cache.hpp"
+#include "util/cpu_affinity.hpp"
+#include "video/codec_probe.hpp"
+#include "video/decoder_factory.hpp"
+#include "video/openh264_handler.hpp"
+
+#ifdef USE_ONEVPL
+#include "video/vpl_session.hpp"
+#endif
+
+namespace hisui {
+
+namespace {
+
+std::unique_ptr<hisui::muxer::Muxer> make_muxer(
+    const hisui::Config& config,
+    const hisui::MetadataSet& metadata_set) {
+  const double duration =
+      config.getClipDuration(metadata_set.getMaxStopTimeOffset());
+  if (config.out_pcm_only) {
+    return std::make_unique<hisui::muxer::PCMMuxer>(
+        config, hisui::muxer::PCMMuxerParameters{
+                    .audio_archive_items = metadata_set.getArchiveItems(),
+                    .duration = duration,
+                });
+  }
+  auto normal_archives = metadata_set.getNormal().getArchiveItems();
+  if (config.mezzanine_directory != "") {
+    normal_archives =
+        hisui::muxer::get_mezzanine_archives(config, normal_archives);
+  }
+  const auto preferred_archives =
+      metadata_set.hasPreferred()
+          ? metadata_set.getPreferred().getArchiveItems()
+          : std::vector<hisui::ArchiveItem>{};
+
+  if (config.out_container == hisui::config::OutContainer::WebM) {
+    return std::make_unique<hisui::muxer::AsyncWebMMuxer>(
+        config, hisui::muxer::AsyncWebMMuxerParameters{
+                    .audio_archive_items = metadata_set.getArchiveItems(),
+                    .normal_archives = normal_archives,
+                    .preferred_archives = preferred_archives,
+                    .duration = duration,
+                });
+  }
+  if (config.out_container != hisui::config::OutContainer::MP4) {
+    throw std::runtime_error("config.out_container is invalid");
+  }
+  const hisui::muxer::MP4MuxerParameters params{
+      .audio_archive_items = metadata_set.getArchiveItems(),
+      .normal_archives = normal_archives,
+      .preferred_archives = preferred_archives,
+      .duration = duration,
+  };
+  switch (config.mp4_muxer) {
+    case hisui::config::MP4Muxer::Simple:
+      return std::make_unique<hisui::muxer::SimpleMP4Muxer>(config, params);
+    case hisui::config::MP4Muxer::Faststart:
+      return std::make_unique<hisui::muxer::FaststartMP4Muxer>(config, params);
+    case hisui::config::MP4Muxer::Fragmented:
+      return std::make_unique<hisui::muxer::FragmentedMP4Muxer>(config,
+                                                                params);
+    case hisui::config::MP4Muxer::HLS:
+      return std::make_unique<hisui::muxer::HLSMuxer>(config, params);
+    default:
+      throw std::runtime_error("config.mp4_muxer is invalid");
+  }
+}
+
+}  // namespace
+
+CompositionResult compose(const hisui::Config& config,
+                          const hisui::MetadataSet& metadata_set) {
+  // producer, codec, muxer のスレッドはこの後に作られるので, 全て job_cpus で動く.
+  // 各スレッドが初めて書き込んだメモリはその CPU の NUMA node に確保される
+  hisui::util::ThreadAffinityScope affinity(config.job_cpus);
+  std::unique_ptr<hisui::muxer::Muxer> muxer;
+  std::unique_ptr<hisui::ResultCache> result_cache;
+  try {
+    result_cache = std::make_unique<hisui::ResultCache>(config, metadata_set);
+    if (result_cache->restore()) {
+      return {.succeeded = true};
+    }
+    muxer = make_muxer(config, hisui::run_preflight(config, metadata_set));
+  } catch (const std::exception& e) {
+    spdlog::error("setting up muxer failed: {}", e.what());
+    return {.error = e.what()};
+  }
+
+  try {
+    muxer->setUp();
+    muxer->run();
+  } catch (const std::exception& e) {
+    spdlog::error("muxing failed: {}", e.what());
+    try {
+      muxer->cleanUp();
+    } catch (const std::exception& cleanup_error) {
+      spdlog::error("cleaning up muxer failed: {}", cleanup_error.what());
+    }
+    CompositionResult result{.error = e.what()};
+    if (hisui::report::Reporter::hasInstance()) {
+      result.report =
+          hisui::report::Reporter::getInstance().makeFailureReport(e.what());
+    }
+    return result;
+  }
+  muxer.reset();
+  result_cache->save();
+
+  CompositionResult result{.succeeded = true};
+  if (hisui::report::Reporter::hasInstance()) {
+    result.report = hisui::report::Reporter::getInstance().makeSuccessReport();
+  }
+  return result;
+}
+
+void close_codec_handlers() {
+  // hasInstance() は初めて呼ばれた時に開くので, 確かめずに閉じる
+  hisui::video::OpenH264Handler::close();
+
+#ifdef USE_ONEVPL
+  hisui::video::VPLSession::close();
+#endif
+}
+
+Composer::Composer(const hisui::Config& config) {
+  // codec のライブラリとハードウェアは, 合成に必要になった時に初めて開く
+  hisui::video::OpenH264Handler::setLibraryPath(config.openh264);
+  hisui::video::set_codec_probe_cache_file(config.codec_probe_cache_file);
+  hisui::video::DecoderFactory::setup(config);
+}
+
+Composer::~Composer() {
+  close_codec_handlers();
+}
+
+CompositionResult Composer::compose(
+    const hisui::Config& config,
+    const hisui::MetadataSet& metadata_set) const {
+  const bool opens_reporter = !hisui::report::Reporter::hasInstance();
+  if (opens_reporter) {
+    hisui::report::Reporter::open();
+  }
+  auto result = hisui::compose(config, metadata_set);
+  if (opens_reporter) {
+    hisui::report::Reporter::close();
+  }
+  return result;
+}
+
+}  // namespace hisui
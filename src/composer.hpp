@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include "config.hpp"
+#include "metadata.hpp"
+
+namespace hisui {
+
+struct CompositionResult {
+  bool succeeded = false;
+  std::string error;
+  // Reporter を開いていれば, 成功した場合は success, 失敗した場合は failure のレポートの JSON
+  std::string report;
+};
+
+// metadata_set の録画を config の出力に合成する. 失敗しても例外は投げずに error に入れる.
+// codec のライブラリは開いたままにするので, 使い終わったら close_codec_handlers() を呼ぶ
+CompositionResult compose(const hisui::Config&, const hisui::MetadataSet&);
+
+// OpenH264 のライブラリと VPL のセッションを閉じる.
+// 開いていなければ何もしない
+void close_codec_handlers();
+
+// hisui のプロセスを起動せずに, 同じプロセスで合成を繰り返すためのもの.
+// OpenH264 のライブラリや VPL のセッション, codec の検出結果は Composer を破棄するまで使い回す.
+// 入力の録画は hisui::webm::input::MemoryReader::add() で登録したメモリー上のものも使える.
+// Reporter は 1 つしかないので, compose() を同時に呼んではいけない
+class Composer {
+ public:
+  // config のうち codec のライブラリの設定のみを使う
+  explicit Composer(const hisui::Config&);
+  ~Composer();
+
+  Composer(const Composer&) = delete;
+  Composer& operator=(const Composer&) = delete;
+
+  // レポートを常に作って返す
+  CompositionResult compose(const hisui::Config&,
+                            const hisui::MetadataSet&) const;
+};
+
+}  // namespace hisui
@@ -1,11 +1,17 @@
 #include "config.hpp"
 
 #include <codec/api/wels/codec_app_def.h>
+#include <fmt/core.h>
 #include <libyuv/scale.h>
+#include <sched.h>
 #include <spdlog/common.h>
 
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <set>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
@@ -18,6 +24,8 @@
 #include <CLI/Validators.hpp>
 #include <boost/rational.hpp>
 
+#include "util/cgroup.hpp"
+
 #define EXPERIMENTAL_OPTIONS "Experimental Options"
 
 #ifdef NDEBUG
@@ -32,6 +40,11 @@
 
 namespace {
 
+// --preview の grid の 1 区画の大きさとフレームレート
+constexpr std::uint32_t PREVIEW_SCALING_WIDTH = 160;
+constexpr std::uint32_t PREVIEW_SCALING_HEIGHT = 120;
+constexpr std::uint64_t PREVIEW_FRAME_RATE = 5;
+
 class MyFormatter : public CLI::Formatter {
  public:
   std::string make_option_opts(const CLI::Option*) const override { return ""; }
@@ -63,6 +76,14 @@ void set_cli_options(CLI::App* app, Config* config) {
   app->add_option("-f,--in-metadata-file", config->in_metadata_filename,
                   "Metadata filename (REQUIRED)")
       ->check(CLI::ExistingFile);
+  app->add_option("--append-metadata-file", config->append_metadata_filenames,
+                  "Metadata filename of a recording that continues the "
+                  "previous one. Can be repeated; the recordings are "
+                  "composed into one output in the given order")
+      ->check(CLI::ExistingFile);
+  app->add_flag("--trim", config->trim,
+                "Remove the periods in which no archive is recorded, as "
+                "\"trim\" of --layout does");
 
   app->add_flag("--version", config->version, "Print version and exit");
   auto option_screen_capture_report =
@@ -95,6 +116,13 @@ void set_cli_options(CLI::App* app, Config* config) {
       ->check(CLI::PositiveNumber)
       ->group(EXPERIMENTAL_OPTIONS);
 
+  app->add_option("--screen-capture-tune-content",
+                  config->screen_capture_tune_content,
+                  "Encode screen-capture with VP8 screen content mode or "
+                  "VP9 screen content tuning (0, 1). default: 1")
+      ->check(CLI::Range(0, 1))
+      ->group(EXPERIMENTAL_OPTIONS);
+
   app->add_option("--mix-screen-capture-audio",
                   config->mix_screen_capture_audio,
                   "Mix screen-capture audio. default: false")
@@ -139,11 +167,132 @@ void set_cli_options(CLI::App* app, Config* config) {
 
   app->add_option("--out-webm-file", config->out_filename, "Output filename")
       ->group(OPTIONS_FOR_BACKWARD_COMPATIBILITY);
-  app->add_option("--out-file", config->out_filename, "Output filename");
+  app->add_option("--out-file", config->out_filename,
+                  "Output filename (\"-\" for stdout, WebM only)");
+  app->add_option("--out-audio-only-file", config->out_audio_only_filename,
+                  "Also write the same audio to this audio-only file "
+                  "(WebM only)");
+  app->add_option("--out-packet-ring-file", config->out_packet_ring_filename,
+                  "Also publish the encoded packets to a shared-memory ring "
+                  "in this file (e.g. under /dev/shm) for another process on "
+                  "the same host (WebM only)");
+  app->add_option("--out-packet-ring-size", config->out_packet_ring_size,
+                  "Size of the ring of --out-packet-ring-file in MiB. "
+                  "default: 64")
+      ->check(CLI::PositiveNumber);
+  app->add_option("--out-pcm-file", config->out_pcm_filename,
+                  "Also write the mixed audio without encoding as 16-bit PCM "
+                  "to this file (WAV if it ends with .wav, otherwise raw "
+                  "little-endian samples)");
+  app->add_option("--out-pcm-sample-rate", config->out_pcm_sample_rate,
+                  "Sampling rate of --out-pcm-file, which must divide the "
+                  "rate of mixed audio (8000/12000/16000/24000/48000). "
+                  "default: the rate of mixed audio")
+      ->check(CLI::IsMember({8000, 12000, 16000, 24000, 48000}));
+  app->add_flag("--out-pcm-mono", config->out_pcm_mono,
+                "Write --out-pcm-file in mono");
+  app->add_flag("--out-pcm-only", config->out_pcm_only,
+                "Write only --out-pcm-file, without composing video or "
+                "encoding audio");
+  app->add_option("--batch", config->batch_filename,
+                  "File listing metadata files to compose in one process, "
+                  "one per line. Each output is named after its metadata "
+                  "file");
+  app->add_option("--batch-jobs", config->batch_jobs,
+                  "Number of metadata files composed concurrently with "
+                  "--batch (POSITIVE INTEGER). default: 1")
+      ->check(CLI::PositiveNumber);
+  app->add_option("--batch-prefetch-jobs", config->batch_prefetch_jobs,
+                  "With --batch, read the input archives of this many queued "
+                  "metadata files into the page cache while composing "
+                  "(NON NEGATIVE INTEGER, disabled: 0). default: 0")
+      ->check(CLI::NonNegativeNumber);
+  app->add_option("--batch-prefetch-size", config->batch_prefetch_size,
+                  "Total size of prefetched inputs of queued metadata files "
+                  "for --batch-prefetch-jobs (MiB, NON NEGATIVE INTEGER). "
+                  "default: 1024")
+      ->check(CLI::NonNegativeNumber);
+  app->add_option("--video-ladder", config->video_ladder_heights,
+                  "Comma separated heights of additional video-only "
+                  "renditions downscaled from the composed video, written "
+                  "next to the output as <name>_<height>p.webm (VP8/VP9 in "
+                  "WebM only)")
+      ->delimiter(',')
+      ->check(CLI::PositiveNumber);
+  app->add_flag("--participant-outputs", config->participant_outputs,
+                "Also write each connection's video scaled to one grid cell, "
+                "black while it is absent, next to the output as "
+                "<name>_<connection_id>.webm (VP8/VP9 in WebM only)");
+  app->add_flag("--participant-audio-outputs",
+                config->participant_audio_outputs,
+                "Also write each connection's audio aligned to the output "
+                "timeline, silent while it is absent, next to the output as "
+                "<name>_<connection_id>.weba (WebM only). Opus packets are "
+                "copied without re-encoding when the output is 48 kHz with "
+                "20 ms frames");
+  app->add_option("--video-part-count", config->video_part_count,
+                  "Split the output timeline into this number of parts and "
+                  "write only the video of --video-part-index part (POSITIVE "
+                  "INTEGER, VP8/VP9/AV1 in WebM only). default: 1")
+      ->check(CLI::PositiveNumber);
+  app->add_option("--video-part-index", config->video_part_index,
+                  "Zero-based index of the part written with "
+                  "--video-part-count (NON NEGATIVE INTEGER). default: 0")
+      ->check(CLI::NonNegativeNumber);
+  app->add_option("--concat", config->concat_filenames,
+                  "Comma separated parts written with --video-part-count, in "
+                  "order, and an audio-only file written with --audio-only. "
+                  "They are joined into --out-file without composing")
+      ->delimiter(',')
+      ->check(CLI::ExistingFile);
+
+  app->add_option("--checkpoint-dir", config->checkpoint_directory,
+                  "Directory where parts of --checkpoint-interval seconds are "
+                  "kept until joined into the output. Parts already written "
+                  "are reused when run again after a failure (VP8/VP9/AV1 "
+                  "in WebM only)");
+  app->add_option("--checkpoint-interval", config->checkpoint_interval,
+                  "Length of each part written with --checkpoint-dir in "
+                  "seconds (POSITIVE NUMBER). default: 600")
+      ->check(CLI::PositiveNumber);
+  app->add_option("--mezzanine-dir", config->mezzanine_directory,
+                  "Directory where each video source is first scaled to the "
+                  "size of one grid cell and written as a lightly compressed "
+                  "VP8 file, which is then composed instead of the source. "
+                  "Files already written are reused");
+  app->add_option("--mezzanine-sources", config->mezzanine_sources,
+                  "Comma separated 0-based indices of video sources in the "
+                  "metadata. Only their files are written to --mezzanine-dir "
+                  "without composing, so that processes or machines can "
+                  "share the work")
+      ->delimiter(',');
+  app->add_option("--mezzanine-jobs", config->mezzanine_jobs,
+                  "Number of files written concurrently to --mezzanine-dir "
+                  "(POSITIVE INTEGER). default: 4")
+      ->check(CLI::PositiveNumber);
+  app->add_option("--start", config->clip_start,
+                  "Start of the written part of the timeline in seconds "
+                  "(NON NEGATIVE NUMBER). default: 0");
+  app->add_option("--end", config->clip_end,
+                  "End of the written part of the timeline in seconds "
+                  "(NON NEGATIVE NUMBER, 0 for the end of the recording). "
+                  "default: 0");
+  app->add_option("--out-hash", config->out_hashes,
+                  "Comma separated hash algorithms (sha224/sha256) of the "
+                  "output files, computed while they are written and shown "
+                  "in the log and the success report")
+      ->delimiter(',')
+      ->check(CLI::IsMember({"sha224", "sha256"}));
 
   app->add_option("--max-columns", config->max_columns,
                   "Max columns (POSITIVE INTEGER). default: 3")
       ->check(CLI::PositiveNumber);
+  app->add_flag("--adaptive-grid", config->adaptive_grid,
+                "Compose only the recordings shown at each time into a grid "
+                "and scale the bitrate by their number, so that the output "
+                "resolution becomes smaller when fewer participants are "
+                "present (VP8/VP9 in WebM)")
+      ->group(EXPERIMENTAL_OPTIONS);
 
   app->add_option(
          "--libvpx-cq-level", config->libvpx_cq_level,
@@ -166,14 +315,50 @@ void set_cli_options(CLI::App* app, Config* config) {
                   "AAC bit rate (kbps, POSITIVE INTEGER). default: 64000")
       ->check(CLI::PositiveNumber);
 
+  app->add_option("--out-audio-sample-rate", config->out_audio_sample_rate,
+                  "Sampling rate of mixed audio, Opus only "
+                  "(8000/12000/16000/24000/48000). default: 48000")
+      ->check(CLI::IsMember({8000, 12000, 16000, 24000, 48000}));
+
   std::vector<std::pair<std::string, config::MP4Muxer>> mp4_muxer_assoc{
       {"simple", config::MP4Muxer::Simple},
       {"faststart", config::MP4Muxer::Faststart},
+      {"fragmented", config::MP4Muxer::Fragmented},
+      {"hls", config::MP4Muxer::HLS},
   };
   app->add_option("--mp4-muxer", config->mp4_muxer,
-                  "MP4 muxer (Faststart/Simple). default: Faststart")
+                  "MP4 muxer (Faststart/Simple/Fragmented/HLS). Fragmented "
+                  "writes sample tables every chunk instead of keeping them "
+                  "in memory. HLS writes a playlist and fragmented MP4 "
+                  "segments instead of a single file. default: Faststart")
       ->transform(CLI::CheckedTransformer(mp4_muxer_assoc, CLI::ignore_case));
 
+  app->add_option("--mp4-chunk-duration", config->mp4_chunk_duration,
+                  "Duration of MP4 chunks (fragments for Fragmented) in ms. "
+                  "Shorter chunks keep audio and video closer in the file but "
+                  "make the sample tables larger. 0 is 960 for AAC and 1000 "
+                  "for Opus. default: 0");
+
+  std::vector<std::pair<std::string, config::MP4Interleave>>
+      mp4_interleave_assoc{
+          {"chunk", config::MP4Interleave::Chunk},
+          {"fine", config::MP4Interleave::Fine},
+      };
+  app->add_option("--mp4-interleave", config->mp4_interleave,
+                  "How Simple/Faststart interleave MP4 chunks. chunk writes "
+                  "video as it arrives and the audio of the chunk after it. "
+                  "fine writes the audio of each chunk before its video, and "
+                  "also cuts a chunk when its video exceeds "
+                  "--mp4-chunk-max-size, for progressive playback. "
+                  "default: chunk")
+      ->transform(
+          CLI::CheckedTransformer(mp4_interleave_assoc, CLI::ignore_case));
+
+  app->add_option("--mp4-chunk-max-size", config->mp4_chunk_max_size,
+                  "Upper limit of video buffered for a chunk in KiB with "
+                  "--mp4-interleave fine. default: 1024")
+      ->check(CLI::PositiveNumber);
+
   app->add_option("--dir-for-faststart",
                   config->directory_for_faststart_intermediate_file,
                   "Directory for intermediate files of faststart "
@@ -198,21 +383,149 @@ void set_cli_options(CLI::App* app, Config* config) {
 
   app->add_flag("--video-codec-engines", config->video_codec_engines,
                 "Show video codec engines and exit.");
+  app->add_flag("--estimate", config->estimate,
+                "Print a composition cost estimate as JSON and exit.");
+  std::vector<std::pair<std::string, config::Preflight>> preflight_assoc{
+      {"None", config::Preflight::None},
+      {"Check", config::Preflight::Check},
+      {"Exclude", config::Preflight::Exclude},
+  };
+  app->add_option("--preflight", config->preflight,
+                  "Scan the input archives in parallel before composing "
+                  "(None/Check/Exclude). Check fails listing broken files, "
+                  "Exclude composes without them. default: None")
+      ->transform(CLI::CheckedTransformer(preflight_assoc, CLI::ignore_case));
+  app->add_flag("--preview", config->preview,
+                "Compose a quick low-fidelity preview: 160x120 grid cells, "
+                "5 fps, no scaling filter, --encode-speed fast, keyframe-only "
+                "decoding and --opus-passthrough where possible");
+  app->add_option("--thumbnails", config->thumbnail_times,
+                  "Comma separated times in seconds. Only the frames at "
+                  "these times are composed and written as images named "
+                  "<name>_<milliseconds>.jpg next to --out-file, then exit")
+      ->delimiter(',')
+      ->check(CLI::NonNegativeNumber);
+  std::vector<std::pair<std::string, config::ThumbnailFormat>>
+      thumbnail_format_assoc{
+          {"JPEG", config::ThumbnailFormat::JPEG},
+          {"PNG", config::ThumbnailFormat::PNG},
+      };
+  app->add_option("--thumbnail-format", config->thumbnail_format,
+                  "Image format of --thumbnails (JPEG/PNG). default: JPEG")
+      ->transform(
+          CLI::CheckedTransformer(thumbnail_format_assoc, CLI::ignore_case));
+  app->add_option("--thumbnail-quality", config->thumbnail_quality,
+                  "JPEG quality of --thumbnails (1-100). default: 90")
+      ->check(CLI::Range(1, 100));
+
+  app->add_flag("--live", config->live,
+                "Compose recordings that are still being written. Reading "
+                "an input waits for new clusters at the end of the file, so "
+                "the output follows the recording with a bounded delay")
+      ->group(EXPERIMENTAL_OPTIONS);
+  app->add_option("--live-idle-timeout", config->live_idle_timeout,
+                  "With --live, treat an input as finished when nothing is "
+                  "appended to it for this number of seconds "
+                  "(POSITIVE INTEGER). default: 30")
+      ->check(CLI::PositiveNumber)
+      ->group(EXPERIMENTAL_OPTIONS);
+  app->add_option("--hls-segment-duration", config->hls_segment_duration,
+                  "Target duration of HLS segments in seconds. Segments are "
+                  "cut at video keyframes (POSITIVE NUMBER). default: 4")
+      ->check(CLI::PositiveNumber)
+      ->group(EXPERIMENTAL_OPTIONS);
+  app->add_option("--hls-part-duration", config->hls_part_duration,
+                  "Duration of LL-HLS partial segments in seconds. 0 "
+                  "disables partial segments (NON NEGATIVE NUMBER). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(EXPERIMENTAL_OPTIONS);
+  app->add_option("--hls-playlist-size", config->hls_playlist_size,
+                  "Number of segments kept in the HLS playlist. Older "
+                  "segments are deleted. 0 keeps all segments "
+                  "(NON NEGATIVE INTEGER). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(EXPERIMENTAL_OPTIONS);
 
   std::vector<std::pair<std::string, config::H264Encoder>> h264_encoder_assoc{
 #ifdef USE_ONEVPL
       {"OneVPL", config::H264Encoder::OneVPL},
+#endif
+#ifdef USE_VAAPI
+      {"VAAPI", config::H264Encoder::VAAPI},
 #endif
       {"OpenH264", config::H264Encoder::OpenH264},
   };
 
   app->add_option("--h264-encoder", config->h264_encoder,
-                  "H264 encoder (OneVPL/OpenH264). default: OneVPL")
+                  "H264 encoder (OneVPL/VAAPI/OpenH264). default: OneVPL")
       ->transform(
           CLI::CheckedTransformer(h264_encoder_assoc, CLI::ignore_case));
 
+  std::vector<std::pair<std::string, config::DecoderEngine>>
+      decoder_engine_assoc{
+          {"Auto", config::DecoderEngine::Auto},
+          {"Software", config::DecoderEngine::Software},
+          {"Hardware", config::DecoderEngine::Hardware},
+      };
+  app->add_option("--video-decoder-engine", config->video_decoder_engine,
+                  "Video decoder engine (Auto/Software/Hardware). Auto uses "
+                  "the Intel oneVPL or NVIDIA NVDEC decoder when it supports "
+                  "the codec and --max-hardware-decoders are not in use by "
+                  "other sources. default: Auto")
+      ->transform(
+          CLI::CheckedTransformer(decoder_engine_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::EncoderEngine>>
+      encoder_engine_assoc{
+          {"Software", config::EncoderEngine::Software},
+          {"Auto", config::EncoderEngine::Auto},
+          {"Hardware", config::EncoderEngine::Hardware},
+      };
+  app->add_option("--video-encoder-engine", config->video_encoder_engine,
+                  "VP9 and AV1 encoder engine (Software/Auto/Hardware). Auto "
+                  "uses the Intel oneVPL encoder when it supports the codec, "
+                  "Hardware fails otherwise. default: Software")
+      ->transform(
+          CLI::CheckedTransformer(encoder_engine_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--max-hardware-decoders", config->max_hardware_decoders,
+                  "Maximum number of sources decoded by Intel oneVPL or "
+                  "NVIDIA NVDEC at the same time. Each decoder uses its own "
+                  "session. default: 4")
+      ->check(CLI::Range(1, 64))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::AV1Decoder>> av1_decoder_assoc{
+      {"SVT-AV1", config::AV1Decoder::SVT_AV1},
+      {"dav1d", config::AV1Decoder::Dav1d},
+  };
+  app->add_option("--av1-decoder", config->av1_decoder,
+                  "Software AV1 decoder (SVT-AV1/dav1d). dav1d is available "
+                  "only when hisui is built with it. default: SVT-AV1")
+      ->transform(CLI::CheckedTransformer(av1_decoder_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::HugePages>> huge_pages_assoc{
+      {"none", config::HugePages::None},
+      {"transparent", config::HugePages::Transparent},
+      {"explicit", config::HugePages::Explicit},
+  };
+  app->add_option("--huge-pages", config->huge_pages,
+                  "Back large frame and canvas buffers with huge pages "
+                  "(none/transparent/explicit). explicit uses pages reserved "
+                  "in hugetlbfs and falls back to transparent. default: none")
+      ->transform(CLI::CheckedTransformer(huge_pages_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
   app->add_option("--show-progress-bar", config->show_progress_bar,
                   "Toggle to show progress bar. default: true");
+  app->add_option("--progress-interval", config->progress_interval,
+                  "Write progress to stderr as a JSON line at this interval "
+                  "in seconds instead of the progress bar (NON NEGATIVE "
+                  "NUMBER, disabled: 0). default: 0")
+      ->check(CLI::NonNegativeNumber);
 
   app->add_option("--layout", config->layout, "Layout Metadata File")
       ->check(CLI::ExistingFile);
@@ -279,12 +592,456 @@ void set_cli_options(CLI::App* app, Config* config) {
       ->check(CLI::Range(0, 1))
       ->group(OPTIONS_FOR_TUNING);
 
+  app->add_flag("--libvpx-active-map", config->libvpx_active_map,
+                "Skip encoding VP8/VP9 macroblocks unchanged since the "
+                "previous encoded frame. Ignored with --encode-profile "
+                "offline")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_flag("--measure-video-quality", config->measure_video_quality,
+                "Decode the VP8/VP9 output and log PSNR and SSIM against the "
+                "composed frames. Also shown in the success report. Slows "
+                "down encoding")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_flag("--report-perf-counters", config->report_perf_counters,
+                "Add cycles, instructions, cache misses and dTLB misses "
+                "counted with perf_event_open(2) to each stage in the "
+                "reports")
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::EncodeProfile>>
+      encode_profile_assoc{
+          {"realtime", config::EncodeProfile::Realtime},
+          {"offline", config::EncodeProfile::Offline},
+      };
+  app->add_option("--encode-profile", config->encode_profile,
+                  "VP8/VP9 and Opus encoding profile. offline uses good "
+                  "quality deadline, lookahead and alt-ref frames and 60 ms "
+                  "Opus frames for smaller files at higher CPU cost "
+                  "(realtime/offline). default: realtime")
+      ->transform(
+          CLI::CheckedTransformer(encode_profile_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::EncodeSpeed>> encode_speed_assoc{
+      {"manual", config::EncodeSpeed::Manual},
+      {"quality", config::EncodeSpeed::Quality},
+      {"balanced", config::EncodeSpeed::Balanced},
+      {"fast", config::EncodeSpeed::Fast},
+      {"adaptive", config::EncodeSpeed::Adaptive},
+  };
+  app->add_option(
+         "--encode-speed", config->encode_speed,
+         "VP8/VP9/AV1 encoder speed preset. Except manual, overrides "
+         "--libvpx-cpu-used, --libvpx-threads, --libvp9-tile-columns, "
+         "--libvp9-row-mt, --svt-av1-preset and --opus-complexity "
+         "(manual/quality/balanced/fast/adaptive). "
+         "default: manual")
+      ->transform(
+          CLI::CheckedTransformer(encode_speed_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--encode-realtime-factor", config->encode_realtime_factor,
+                  "Target ratio of media time to wall-clock time per encoder "
+                  "for --encode-speed adaptive (POSITIVE NUMBER). default: 1.0")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--degradation-realtime-factor",
+                  config->degradation_realtime_factor,
+                  "With --layout, lower the quality while the ratio of media "
+                  "time to wall-clock time is below this value: first the "
+                  "update rate of regions with a lower priority, then "
+                  "keyframe-only decoding of their small cells, then the "
+                  "encoder speed (NON-NEGATIVE NUMBER). 0 disables it. "
+                  "default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_flag("--deterministic", config->deterministic,
+                "Produce the same output for the same input and options on "
+                "every run and machine. Parallel decoding, composition and "
+                "encoding stay enabled, but VP8 realtime speed selection by "
+                "encoding time and the libvpx thread limit by CPU count are "
+                "disabled. Cannot be used with --encode-speed adaptive")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--svt-av1-preset", config->svt_av1_preset,
+                  "SVT-AV1 preset, faster with larger values. Overridden by "
+                  "--encode-speed except manual (0-13). default: 10")
+      ->check(CLI::Range(0, 13))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--svt-av1-tile-rows", config->svt_av1_tile_rows,
+                  "SVT-AV1 number of tile rows in log2 (0-6). "
+                  "default: 0 (split if the height is larger than 3840)")
+      ->check(CLI::Range(0, 6))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--svt-av1-tile-columns", config->svt_av1_tile_columns,
+                  "SVT-AV1 number of tile columns in log2 (0-4). "
+                  "default: 0 (split if the width is larger than 3840)")
+      ->check(CLI::Range(0, 4))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--svt-av1-lookahead", config->svt_av1_lookahead,
+                  "SVT-AV1 number of lookahead frames (0-120, SVT-AV1 "
+                  "default: -1). default: -1")
+      ->check(CLI::Range(-1, 120))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--svt-av1-cpus", config->svt_av1_cpus,
+                  "Comma separated CPU numbers SVT-AV1 threads run on. Shared "
+                  "out among concurrent jobs with --batch")
+      ->delimiter(',')
+      ->check(CLI::Range(0, CPU_SETSIZE - 1))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_flag("--av1-async-encode", config->av1_async_encode,
+                "Receive AV1 packets from SVT-AV1 on a separate thread so "
+                "that sending pictures does not wait for encoding")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--vpl-target-usage", config->vpl_target_usage,
+                  "oneVPL encoder target usage, faster with larger values "
+                  "(1-7). default: 4")
+      ->check(CLI::Range(1, 7))
+      ->group(OPTIONS_FOR_TUNING);
+  std::vector<std::pair<std::string, config::VPLLowPower>> vpl_low_power_assoc{
+      {"Auto", config::VPLLowPower::Auto},
+      {"On", config::VPLLowPower::On},
+      {"Off", config::VPLLowPower::Off},
+  };
+  app->add_option("--vpl-low-power", config->vpl_low_power,
+                  "oneVPL encoder low power (fixed function) mode "
+                  "(Auto/On/Off). Falls back to other modes if the runtime "
+                  "rejects it. default: Auto")
+      ->transform(
+          CLI::CheckedTransformer(vpl_low_power_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--vpl-async-depth", config->vpl_async_depth,
+                  "Number of frames submitted to the oneVPL encoder without "
+                  "waiting (1-16). default: 4")
+      ->check(CLI::Range(1, 16))
+      ->group(OPTIONS_FOR_TUNING);
+  std::vector<std::pair<std::string, config::VPLRateControl>>
+      vpl_rate_control_assoc{
+          {"VBR", config::VPLRateControl::VBR},
+          {"CBR", config::VPLRateControl::CBR},
+          {"CQP", config::VPLRateControl::CQP},
+      };
+  app->add_option("--vpl-rate-control", config->vpl_rate_control,
+                  "oneVPL encoder rate control method (VBR/CBR/CQP). "
+                  "default: VBR")
+      ->transform(
+          CLI::CheckedTransformer(vpl_rate_control_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--frame-buffer-capacity", config->frame_buffer_capacity,
+                  "Max number of encoded frames buffered per track before "
+                  "the encoder waits for the muxer (NON NEGATIVE INTEGER, "
+                  "unbounded: 0). default: 256")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--webm-cluster-duration", config->webm_cluster_duration,
+                  "Max duration of a cluster of the output WebM in seconds. "
+                  "A video keyframe always starts a new cluster, and each "
+                  "cluster gets a cue point (NON NEGATIVE NUMBER, mkvmuxer "
+                  "default: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--webm-cluster-size", config->webm_cluster_size,
+                  "Max size of a cluster of the output WebM (KiB, NON "
+                  "NEGATIVE INTEGER, mkvmuxer default: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--webm-cues", config->webm_cues,
+                  "Write Cues to the output WebM when it is seekable. "
+                  "default: true")
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--faststart-memory-limit", config->faststart_memory_limit,
+                  "Put the intermediate file of the faststart muxer on "
+                  "/dev/shm when the expected size of the samples is at most "
+                  "this size and --dir-for-faststart is not given (MiB, NON "
+                  "NEGATIVE INTEGER, disabled: 0). default: 256")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_option("--max-memory", config->max_memory,
+                  "Abort composition when the resident memory exceeds this "
+                  "size (MiB, NON NEGATIVE INTEGER, unlimited: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-pipeline-depth", config->video_pipeline_depth,
+                  "Number of composed frames in flight between composing and "
+                  "encoding (POSITIVE INTEGER, no pipelining: 1). default: 2")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_flag("--video-variable-frame-rate",
+                config->video_variable_frame_rate,
+                "Skip encoding frames while the composed image does not "
+                "change, producing variable frame rate output. At least one "
+                "frame per second is encoded")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-encode-segments", config->video_encode_segments,
+                  "Number of segments of the output timeline encoded in "
+                  "parallel by VP8/VP9/AV1 encoders. Encoded segments are kept "
+                  "in memory until written (POSITIVE INTEGER). default: 1")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-keyframe-interval",
+                  config->video_keyframe_interval,
+                  "Number of frames between keyframes. Keyframes are aligned "
+                  "to multiples of this number on the output timeline "
+                  "(NON NEGATIVE INTEGER, encoder default: 0, 2 seconds with "
+                  "--video-ladder). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-decode-threads", config->video_decode_threads,
+                  "Number of input videos decoded concurrently. Threads "
+                  "inside each decoder are set by --video-threads-per-decoder "
+                  "(POSITIVE INTEGER). default: 1")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-warm-up-time", config->video_warm_up_time,
+                  "Open each input video, parse it and decode its first "
+                  "frame on a background thread this many seconds before "
+                  "it appears, and release its decoder on a background "
+                  "thread after it ends (NON NEGATIVE NUMBER, 0 to "
+                  "disable). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--audio-decode-threads", config->audio_decode_threads,
+                  "Number of threads decoding input audio concurrently, "
+                  "decoding ahead while mixing (POSITIVE INTEGER). default: 1")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--audio-silence-level", config->audio_silence_level,
+                  "Leave out audio sources from mixing while the absolute "
+                  "values of their samples are at most this level, and skip "
+                  "decoding their Opus DTX packets (-1 to disable). "
+                  "default: 8")
+      ->check(CLI::Range(-1, 32767))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--audio-chunks", config->audio_chunks,
+                  "Split the Opus audio timeline into this many chunks, mix "
+                  "and encode them on separate threads and join them in "
+                  "order (POSITIVE INTEGER). default: 1")
+      ->check(CLI::PositiveNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_flag("--opus-passthrough", config->opus_passthrough,
+                "Copy Opus packets of the input to the output without "
+                "re-encoding where only one audio source is active")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--opus-frame-duration", config->opus_frame_duration,
+                  "Duration of Opus frames in milliseconds. Longer frames "
+                  "reduce packets and container overhead "
+                  "(10/20/40/60). default: 20, 60 with --encode-profile "
+                  "offline")
+      ->check(CLI::IsMember({10, 20, 40, 60}))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--opus-complexity", config->opus_complexity,
+                  "Opus encoder complexity (0-10). default: libopus default")
+      ->check(CLI::Range(0, 10))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::OpusBitRateMode>>
+      opus_bit_rate_mode_assoc{
+          {"vbr", config::OpusBitRateMode::VBR},
+          {"cvbr", config::OpusBitRateMode::CVBR},
+          {"cbr", config::OpusBitRateMode::CBR},
+      };
+  app->add_option("--opus-bit-rate-mode", config->opus_bit_rate_mode,
+                  "Opus bit rate mode (vbr/cvbr/cbr). default: cvbr")
+      ->transform(
+          CLI::CheckedTransformer(opus_bit_rate_mode_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::OpusApplication>>
+      opus_application_assoc{
+          {"audio", config::OpusApplication::Audio},
+          {"voip", config::OpusApplication::VoIP},
+          {"lowdelay", config::OpusApplication::LowDelay},
+      };
+  app->add_option("--opus-application", config->opus_application,
+                  "Opus application (audio/voip/lowdelay). default: audio")
+      ->transform(
+          CLI::CheckedTransformer(opus_application_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_flag("--video-remux", config->video_remux,
+                "Copy VP8/VP9 frames of the input to the output without "
+                "re-encoding when there is only one video source or a screen "
+                "capture is shown, if the codec and resolution are the same")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-threads-per-decoder",
+                  config->video_threads_per_decoder,
+                  "Number of threads used inside each VP8/VP9/AV1 decoder. "
+                  "The number of decoders running concurrently is set by "
+                  "--video-decode-threads "
+                  "(NON NEGATIVE INTEGER, by resolution and number of CPUs: "
+                  "0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--libvp9-decoder-row-mt", config->libvp9_decoder_row_mt,
+                  "libvp9 decoder row based multi-threading. "
+                  "default: 1 (0, 1)")
+      ->check(CLI::Range(0, 1))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--libvp9-decoder-skip-loop-filter",
+                  config->libvp9_decoder_skip_loop_filter,
+                  "Skip the loop filter of libvp9 decoder for sources "
+                  "displayed at half size or less. "
+                  "default: 0 (0, 1)")
+      ->check(CLI::Range(0, 1))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--openh264-decoder-threads",
+                  config->openh264_decoder_threads,
+                  "Number of threads used by each OpenH264 decoder. Requires "
+                  "OpenH264 2.1.0 or later (NON NEGATIVE INTEGER, disabled: "
+                  "0). default: 0")
+      ->check(CLI::Range(0, 16))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--openh264-decode-ahead", config->openh264_decode_ahead,
+                  "Decode each H.264 input on its own thread, keeping up to "
+                  "this number of frames decoded ahead (NON NEGATIVE "
+                  "INTEGER, disabled: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--webm-index-cache-dir", config->webm_index_cache_directory,
+                  "Directory to cache the track and frame index of input "
+                  "WebM files. The cache is reused while the file size and "
+                  "modification time are unchanged. default: none")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--audio-cache-dir", config->audio_cache_directory,
+                  "Directory to cache the encoded audio track. The cache is "
+                  "reused while the audio inputs, their sizes, modification "
+                  "times and intervals, and the audio mixer and encoder "
+                  "settings are unchanged. default: none")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--result-cache-dir", config->result_cache_directory,
+                  "Directory to keep composed outputs. When the inputs, their "
+                  "sizes and modification times, the metadata, the options "
+                  "and the hisui version are unchanged, the kept output is "
+                  "hard-linked to the output file instead of composing "
+                  "again. default: none")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--prefetch-threads", config->prefetch_threads,
+                  "Number of threads to issue read-ahead requests for input "
+                  "files. 0 issues them on the demuxing thread. default: 2")
+      ->check(CLI::Range(0, 64))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--read-bandwidth", config->read_bandwidth,
+                  "Upper limit of reading input files in MiB/s, shared by all "
+                  "compositions of this process. 0 is unlimited. default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--host-read-bandwidth", config->host_read_bandwidth,
+                  "Upper limit of reading input files in MiB/s, shared by all "
+                  "hisui processes on this host with the same "
+                  "--host-read-bandwidth-file. 0 is unlimited. default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--host-read-bandwidth-file",
+                  config->host_read_bandwidth_file,
+                  "File shared by processes to keep --host-read-bandwidth. "
+                  "default: /dev/shm/hisui-read-bandwidth")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--shared-frame-cache-size",
+                  config->shared_frame_cache_size,
+                  "Size in MiB of the cache of decoded frames shared by all "
+                  "hisui processes on this host with the same "
+                  "--shared-frame-cache-file. Concurrent compositions of the "
+                  "same recordings decode each frame once. 0 is disabled. "
+                  "default: 0")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--shared-frame-cache-file",
+                  config->shared_frame_cache_file,
+                  "File shared by processes to keep the frames of "
+                  "--shared-frame-cache-size. "
+                  "default: /dev/shm/hisui-frame-cache")
+      ->group(OPTIONS_FOR_TUNING);
+
+  std::vector<std::pair<std::string, config::IOPriority>> io_priority_assoc{
+      {"default", config::IOPriority::Default},
+      {"high", config::IOPriority::High},
+      {"low", config::IOPriority::Low},
+      {"idle", config::IOPriority::Idle},
+  };
+  app->add_option("--io-priority", config->io_priority,
+                  "I/O priority of this process (default/high/low/idle). "
+                  "idle reads only when the storage is otherwise unused. "
+                  "default: default")
+      ->transform(CLI::CheckedTransformer(io_priority_assoc, CLI::ignore_case))
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--codec-probe-cache-file", config->codec_probe_cache_file,
+                  "File to cache which hardware codecs are available on this "
+                  "host, so that later runs skip probing them. default: none")
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--video-compose-threads", config->video_compose_threads,
+                  "Number of threads used by parallel-grid video composer "
+                  "and by rendering layout regions and cells "
+                  "(NON NEGATIVE INTEGER, --job-threads: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--job-threads", config->job_threads,
+                  "Upper limit of threads used by each encoder, decoder and "
+                  "composer of one composition (NON NEGATIVE INTEGER, number "
+                  "of CPUs or --job-cpus, divided by --batch-jobs with "
+                  "--batch: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
+  app->add_option("--job-cpus", config->job_cpus,
+                  "Comma separated CPU numbers all threads of one composition "
+                  "(producers, codecs and muxer) run on. Memory is then "
+                  "allocated on their NUMA node. Shared out among concurrent "
+                  "jobs with --batch")
+      ->delimiter(',')
+      ->check(CLI::Range(0, CPU_SETSIZE - 1))
+      ->group(OPTIONS_FOR_TUNING);
+  app->add_flag("--batch-pin-cpus", config->batch_pin_cpus,
+                "With --batch, pin each concurrent job to its own share of "
+                "the CPUs hisui may run on, grouped by NUMA node, unless "
+                "--job-cpus is given")
+      ->group(OPTIONS_FOR_TUNING);
+
   app->add_option("--openh264-threads", config->openh264_threads,
                   "OpenH264 number of threads (NON NEGATIVE INTEGER)"
                   "default: 1 (multiple threads imp. disabled)")
       ->check(CLI::NonNegativeNumber)
       ->group(OPTIONS_FOR_TUNING);
 
+  app->add_option("--openh264-slices", config->openh264_slices,
+                  "OpenH264 number of slices per frame. Each slice can be "
+                  "encoded in parallel (NON NEGATIVE INTEGER, same as "
+                  "--openh264-threads: 0). default: 0")
+      ->check(CLI::NonNegativeNumber)
+      ->group(OPTIONS_FOR_TUNING);
+
   app->add_option("--openh264-min-qp", config->openh264_min_qp,
                   "OpenH264 minmum QP encoder supports. default: 0")
       ->check(CLI::Range(0, 51))
@@ -332,11 +1089,16 @@ void set_cli_options(CLI::App* app, Config* config) {
          "Log level (trace/debug/info/warn/error/critical/off). default: info")
       ->transform(CLI::CheckedTransformer(log_level_assoc, CLI::ignore_case))
       ->group(OPTIONS_FOR_DEVELOPING);
+  app->add_flag("--log-async", config->log_async,
+                "Write logs from a background thread so that composing "
+                "threads do not wait for the terminal")
+      ->group(OPTIONS_FOR_DEVELOPING);
 
   std::vector<std::pair<std::string, config::VideoComposer>>
       video_composer_assoc{
           {"grid", config::VideoComposer::Grid},
           {"parallel-grid", config::VideoComposer::ParallelGrid},
+          {"auto", config::VideoComposer::Auto},
       };
   app->add_option("--video-composer", config->video_composer, "video composer")
       ->transform(
@@ -353,10 +1115,61 @@ void set_cli_options(CLI::App* app, Config* config) {
 
   std::vector<std::pair<std::string, config::AudioMixer>> audio_mixer_assoc{
       {"simple", config::AudioMixer::Simple},
-      {"vttoth", config::AudioMixer::Vttoth}};
-  app->add_option("--audio-mixer", config->audio_mixer, "audio mixer")
+      {"vttoth", config::AudioMixer::Vttoth},
+      {"limiter", config::AudioMixer::Limiter}};
+  app->add_option("--audio-mixer", config->audio_mixer,
+                  "audio mixer (simple/vttoth/limiter). default: simple")
       ->transform(CLI::CheckedTransformer(audio_mixer_assoc, CLI::ignore_case))
       ->group(OPTIONS_FOR_DEVELOPING);
+
+  app->add_option("--profile-file", config->profile_filename,
+                  "Sample the stacks of all threads and write them in the "
+                  "folded stack format of flamegraph.pl. With --batch, "
+                  "_<index> of the job is appended to the file name")
+      ->group(OPTIONS_FOR_DEVELOPING);
+  app->add_option("--profile-frequency", config->profile_frequency,
+                  "Sampling frequency of --profile-file in Hz (1-1000). "
+                  "default: 99")
+      ->check(CLI::Range(1, 1000))
+      ->group(OPTIONS_FOR_DEVELOPING);
+  app->add_flag("--profile-on-signal", config->profile_on_signal,
+                "Start and stop sampling of --profile-file each time SIGUSR2 "
+                "is received")
+      ->group(OPTIONS_FOR_DEVELOPING);
+
+#ifdef USE_TRACE
+  app->add_option("--trace-file", config->trace_filename,
+                  "Write traced sections in Chrome trace event format")
+      ->group(OPTIONS_FOR_DEVELOPING);
+#endif
+}
+
+std::string get_result_cache_options(const CLI::App& app) {
+  // 入出力のファイル名, ログ, 報告, 同時に合成する数や CPU の割り当ては出力の内容を変えない.
+  // 入力の内容は別に key に含める
+  static const std::set<std::string> ignored_options = {
+      "--in-metadata-file", "--out-file", "--out-webm-file", "--batch",
+      "--batch-jobs", "--batch-pin-cpus", "--job-cpus", "--verbose",
+      "--log-level", "--log-async", "--show-progress-bar",
+      "--progress-interval", "--success-report", "--failure-report",
+      "--result-cache-dir", "--profile-file", "--profile-frequency",
+      "--profile-on-signal", "--trace-file", "--mezzanine-jobs",
+      "--out-hash", "--measure-video-quality", "--report-perf-counters"};
+
+  std::string options;
+  for (const auto* option : app.get_options()) {
+    if (option->count() == 0 ||
+        ignored_options.contains(option->get_name())) {
+      continue;
+    }
+    options += option->get_name();
+    for (const auto& result : option->results()) {
+      options += ' ';
+      options += result;
+    }
+    options += '\n';
+  }
+  return options;
 }
 
 bool Config::enabledReport() const {
@@ -371,11 +1184,425 @@ bool Config::enabledFailureReport() const {
   return failure_report != "";
 }
 
+bool Config::isStdoutOutput() const {
+  return out_filename == "-";
+}
+
+bool Config::isHLSOutput() const {
+  return out_container == hisui::config::OutContainer::MP4 &&
+         mp4_muxer == hisui::config::MP4Muxer::HLS;
+}
+
+std::string Config::getOutFilename() const {
+  if (out_filename != "") {
+    return out_filename;
+  }
+  std::filesystem::path metadata_path(in_metadata_filename);
+  if (out_container == hisui::config::OutContainer::WebM) {
+    if (audio_only) {
+      return metadata_path.replace_extension(".weba").string();
+    }
+    if (isVideoPart()) {
+      return metadata_path
+          .replace_filename(fmt::format("{}_part{}.webm",
+                                        metadata_path.stem().string(),
+                                        video_part_index))
+          .string();
+    }
+    return metadata_path.replace_extension(".webm").string();
+  }
+  if (mp4_muxer == hisui::config::MP4Muxer::HLS) {
+    return metadata_path.replace_extension(".m3u8").string();
+  }
+  if (audio_only) {
+    return metadata_path.replace_extension(".m4a").string();
+  }
+  return metadata_path.replace_extension(".mp4").string();
+}
+
+bool Config::isBatch() const {
+  return batch_filename != "";
+}
+
+bool Config::isVideoPart() const {
+  return video_part_count > 1;
+}
+
+bool Config::isConcat() const {
+  return !std::empty(concat_filenames);
+}
+
+bool Config::enabledCheckpoint() const {
+  return checkpoint_directory != "";
+}
+
+bool Config::isClip() const {
+  return clip_start > 0.0 || clip_end > 0.0;
+}
+
+double Config::getClipDuration(const double duration) const {
+  const auto end = clip_end > 0.0 ? std::min(clip_end, duration) : duration;
+  return std::max(0.0, end - clip_start);
+}
+
+std::uint64_t Config::getVideoWarmUpTime() const {
+  return static_cast<std::uint64_t>(
+      std::llround(video_warm_up_time * hisui::Constants::NANO_SECOND));
+}
+
+std::uint32_t Config::getJobThreads() const {
+  if (job_threads != 0) {
+    return job_threads;
+  }
+  if (!std::empty(job_cpus)) {
+    return static_cast<std::uint32_t>(std::size(job_cpus));
+  }
+  return hisui::util::get_number_of_usable_cpus();
+}
+
+std::size_t Config::getVideoComposeThreads() const {
+  return video_compose_threads != 0 ? video_compose_threads : getJobThreads();
+}
+
+// --video-ladder の場合は解像度ごとのキーフレームを揃えるため, 既定で 2 秒ごとにする.
+// HLS の場合は segment の境界にキーフレームが来るように, 既定で segment の長さごとにする
+std::uint32_t Config::getVideoKeyframeInterval() const {
+  if (video_keyframe_interval != 0) {
+    return video_keyframe_interval;
+  }
+  if (isHLSOutput()) {
+    return std::max(1U, static_cast<std::uint32_t>(std::lround(
+                            hls_segment_duration *
+                            static_cast<double>(
+                                out_video_frame_rate.numerator()) /
+                            static_cast<double>(
+                                out_video_frame_rate.denominator()))));
+  }
+  if (std::empty(video_ladder_heights)) {
+    return 0;
+  }
+  return static_cast<std::uint32_t>(2 * out_video_frame_rate.numerator() /
+                                    out_video_frame_rate.denominator());
+}
+
+// --opus-passthrough では入力の 20 ms のパケットをそのまま使うので 20 ms にする
+std::uint32_t Config::getOpusFrameDuration() const {
+  if (opus_frame_duration != 0) {
+    return opus_frame_duration;
+  }
+  if (encode_profile == hisui::config::EncodeProfile::Offline &&
+      !opus_passthrough) {
+    return 60;
+  }
+  return 20;
+}
+
+std::int32_t Config::getOpusComplexity() const {
+  switch (encode_speed) {
+    case hisui::config::EncodeSpeed::Manual:
+      return opus_complexity;
+    case hisui::config::EncodeSpeed::Quality:
+      return 10;
+    case hisui::config::EncodeSpeed::Fast:
+      return 5;
+    default:
+      return 8;
+  }
+}
+
+void Config::applyPreview() {
+  if (scaling_width == 0 || scaling_width > PREVIEW_SCALING_WIDTH) {
+    scaling_width = PREVIEW_SCALING_WIDTH;
+  }
+  if (scaling_height == 0 || scaling_height > PREVIEW_SCALING_HEIGHT) {
+    scaling_height = PREVIEW_SCALING_HEIGHT;
+  }
+  if (out_video_frame_rate > PREVIEW_FRAME_RATE) {
+    out_video_frame_rate = PREVIEW_FRAME_RATE;
+  }
+  libyuv_filter_mode = libyuv::kFilterNone;
+  encode_speed = hisui::config::EncodeSpeed::Fast;
+  // validate() で拒否される組み合わせでは再エンコードする
+  if (out_audio_codec == hisui::config::OutAudioCodec::Opus &&
+      out_audio_sample_rate == Constants::PCM_SAMPLE_RATE &&
+      (opus_frame_duration == 0 || opus_frame_duration == 20) &&
+      audio_chunks == 1 && out_pcm_filename == "") {
+    opus_passthrough = true;
+  }
+}
+
 void Config::validate() const {
   if (out_container == hisui::config::OutContainer::WebM &&
       out_audio_codec == hisui::config::OutAudioCodec::FDK_AAC) {
     throw std::runtime_error("hisui does not support AAC output in WebM");
   }
+#if !defined(USE_ONEVPL) && !defined(USE_NVDEC)
+  if (video_decoder_engine == hisui::config::DecoderEngine::Hardware) {
+    throw std::runtime_error(
+        "hisui is built without oneVPL or NVDEC and has no hardware decoder");
+  }
+#endif
+#ifndef USE_ONEVPL
+  if (video_encoder_engine == hisui::config::EncoderEngine::Hardware) {
+    throw std::runtime_error(
+        "hisui is built without oneVPL and has no hardware encoder");
+  }
+#endif
+#ifndef USE_DAV1D
+  if (av1_decoder == hisui::config::AV1Decoder::Dav1d) {
+    throw std::runtime_error("hisui is built without dav1d");
+  }
+#endif
+#ifdef USE_VAAPI
+  // layout の VideoProducer はまだ VA-API に対応していない
+  if (h264_encoder == hisui::config::H264Encoder::VAAPI &&
+      !std::empty(layout)) {
+    throw std::runtime_error(
+        "--h264-encoder VAAPI cannot be used with --layout");
+  }
+#endif
+  if (opus_passthrough &&
+      (out_audio_codec != hisui::config::OutAudioCodec::Opus ||
+       out_audio_sample_rate != Constants::PCM_SAMPLE_RATE)) {
+    throw std::runtime_error(
+        "hisui supports --opus-passthrough only with 48 kHz Opus output");
+  }
+  if (opus_passthrough && getOpusFrameDuration() != 20) {
+    throw std::runtime_error(
+        "hisui supports --opus-passthrough only with 20 ms Opus frames");
+  }
+  if (degradation_realtime_factor > 0 && layout == "") {
+    throw std::runtime_error(
+        "--degradation-realtime-factor can be used only with --layout");
+  }
+  if (deterministic && degradation_realtime_factor > 0) {
+    throw std::runtime_error(
+        "--degradation-realtime-factor cannot be used with --deterministic");
+  }
+  if (deterministic &&
+      encode_speed == hisui::config::EncodeSpeed::Adaptive) {
+    throw std::runtime_error(
+        "--encode-speed adaptive cannot be used with --deterministic");
+  }
+  if (out_audio_codec == hisui::config::OutAudioCodec::FDK_AAC &&
+      out_audio_sample_rate != Constants::PCM_SAMPLE_RATE) {
+    throw std::runtime_error(
+        "hisui supports --out-audio-sample-rate only with Opus");
+  }
+  // MP4 は書き終えてから moov などを書き戻す必要がある
+  if (out_container == hisui::config::OutContainer::MP4 && isStdoutOutput()) {
+    throw std::runtime_error("hisui does not support MP4 output to stdout");
+  }
+  if (mp4_interleave == hisui::config::MP4Interleave::Fine &&
+      (out_container != hisui::config::OutContainer::MP4 ||
+       (mp4_muxer != hisui::config::MP4Muxer::Simple &&
+        mp4_muxer != hisui::config::MP4Muxer::Faststart))) {
+    throw std::runtime_error(
+        "--mp4-interleave fine requires --mp4-muxer simple or faststart");
+  }
+  if (out_container == hisui::config::OutContainer::MP4 &&
+      out_audio_only_filename != "") {
+    throw std::runtime_error(
+        "hisui supports --out-audio-only-file only in WebM");
+  }
+  if (out_pcm_filename == "") {
+    if (out_pcm_sample_rate != 0 || out_pcm_mono || out_pcm_only) {
+      throw std::runtime_error(
+          "--out-pcm-sample-rate, --out-pcm-mono and --out-pcm-only require "
+          "--out-pcm-file");
+    }
+  } else {
+    // 合成した sample を使うので, 合成を省いたり分けたりするものとは併用できない
+    if (opus_passthrough || audio_chunks > 1 || isBatch() || isVideoPart() ||
+        enabledCheckpoint() || isConcat()) {
+      throw std::runtime_error(
+          "--out-pcm-file cannot be used with --opus-passthrough, "
+          "--audio-chunks, --batch, --video-part-count, --checkpoint-dir or "
+          "--concat");
+    }
+    if (!out_pcm_only && out_pcm_sample_rate != 0 &&
+        out_audio_sample_rate % out_pcm_sample_rate != 0) {
+      throw std::runtime_error(
+          "--out-pcm-sample-rate must divide --out-audio-sample-rate");
+    }
+    if (out_pcm_only && (!std::empty(layout) || !std::empty(out_hashes))) {
+      throw std::runtime_error(
+          "--out-pcm-only cannot be used with --layout or --out-hash");
+    }
+  }
+    if (isHLSOutput() && hls_part_duration >= hls_segment_duration) {
+    throw std::runtime_error(
+        "--hls-part-duration must be less than --hls-segment-duration");
+  }
+  if (audio_chunks > 1 && opus_passthrough) {
+    throw std::runtime_error(
+        "--audio-chunks cannot be used with --opus-passthrough");
+  }
+  if (isHLSOutput() && !std::empty(out_hashes)) {
+    throw std::runtime_error("--out-hash cannot be used with HLS output");
+  }
+  if (!std::empty(append_metadata_filenames)) {
+    if (isBatch() || !std::empty(layout) || live ||
+        screen_capture_metadata_filename != "") {
+      throw std::runtime_error(
+          "--append-metadata-file cannot be used with --batch, --layout, "
+          "--live or --screen-capture-report");
+    }
+  }
+  if (trim) {
+    if (!std::empty(layout) || isVideoPart() || enabledCheckpoint()) {
+      throw std::runtime_error(
+          "--trim cannot be used with --layout, --video-part-count or "
+          "--checkpoint-dir");
+    }
+  }
+  if (isBatch()) {
+    if (out_filename != "" || !std::empty(layout)) {
+      throw std::runtime_error(
+          "--batch cannot be used with --out-file or --layout");
+    }
+    if (batch_jobs > 1 && enabledReport()) {
+      throw std::runtime_error(
+          "--success-report and --failure-report require --batch-jobs 1");
+    }
+    // 同時に合成する job のスレッドは区別できない
+    if (batch_jobs > 1 && profile_filename != "") {
+      throw std::runtime_error("--profile-file requires --batch-jobs 1");
+    }
+  }
+  if (!std::empty(video_ladder_heights)) {
+    if (out_container != hisui::config::OutContainer::WebM ||
+        (out_video_codec != hisui::config::OutVideoCodec::VP8 &&
+         out_video_codec != hisui::config::OutVideoCodec::VP9)) {
+      throw std::runtime_error(
+          "hisui supports --video-ladder only with VP8/VP9 in WebM");
+    }
+    if (isStdoutOutput() || video_encode_segments > 1) {
+      throw std::runtime_error(
+          "--video-ladder cannot be used with stdout output or "
+          "--video-encode-segments");
+    }
+  }
+  if (participant_outputs) {
+    if (out_container != hisui::config::OutContainer::WebM ||
+        (out_video_codec != hisui::config::OutVideoCodec::VP8 &&
+         out_video_codec != hisui::config::OutVideoCodec::VP9)) {
+      throw std::runtime_error(
+          "hisui supports --participant-outputs only with VP8/VP9 in WebM");
+    }
+    if (audio_only || isStdoutOutput() || !std::empty(layout) ||
+        video_encode_segments > 1 || adaptive_grid || isVideoPart() ||
+        enabledCheckpoint()) {
+      throw std::runtime_error(
+          "--participant-outputs cannot be used with --audio-only, stdout "
+          "output, --layout, --video-encode-segments, --adaptive-grid, "
+          "--video-part-count or --checkpoint-dir");
+    }
+  }
+  if (participant_audio_outputs) {
+    if (out_container != hisui::config::OutContainer::WebM) {
+      throw std::runtime_error(
+          "hisui supports --participant-audio-outputs only in WebM");
+    }
+    if (isStdoutOutput() || isVideoPart() || enabledCheckpoint() ||
+        out_pcm_only) {
+      throw std::runtime_error(
+          "--participant-audio-outputs cannot be used with stdout output, "
+          "--video-part-count, --checkpoint-dir or --out-pcm-only");
+    }
+  }
+  if (adaptive_grid) {
+    if (out_container != hisui::config::OutContainer::WebM ||
+        (out_video_codec != hisui::config::OutVideoCodec::VP8 &&
+         out_video_codec != hisui::config::OutVideoCodec::VP9)) {
+      throw std::runtime_error(
+          "hisui supports --adaptive-grid only with VP8/VP9 in WebM");
+    }
+    if (!std::empty(layout) || !std::empty(video_ladder_heights) ||
+        video_encode_segments > 1 || isVideoPart() || enabledCheckpoint()) {
+      throw std::runtime_error(
+          "--adaptive-grid cannot be used with --layout, --video-ladder, "
+          "--video-encode-segments, --video-part-count or --checkpoint-dir");
+    }
+  }
+  if (isVideoPart()) {
+    if (video_part_index >= video_part_count) {
+      throw std::runtime_error(
+          "--video-part-index must be less than --video-part-count");
+    }
+    if (out_container != hisui::config::OutContainer::WebM ||
+        out_video_codec == hisui::config::OutVideoCodec::H264) {
+      throw std::runtime_error(
+          "hisui supports --video-part-count only with VP8/VP9/AV1 in WebM");
+    }
+    if (audio_only || isBatch() || !std::empty(layout) ||
+        !std::empty(video_ladder_heights) || video_encode_segments > 1 ||
+        out_audio_only_filename != "") {
+      throw std::runtime_error(
+          "--video-part-count cannot be used with --audio-only, --batch, "
+          "--layout, --video-ladder, --video-encode-segments or "
+          "--out-audio-only-file");
+    }
+  }
+  if (out_packet_ring_filename != "" &&
+      (out_container != hisui::config::OutContainer::WebM ||
+       out_pcm_only || isVideoPart())) {
+    throw std::runtime_error(
+        "--out-packet-ring-file can be used only with WebM output and cannot "
+        "be used with --out-pcm-only or --video-part-count");
+  }
+  if (enabledCheckpoint()) {
+    if (out_container != hisui::config::OutContainer::WebM ||
+        out_video_codec == hisui::config::OutVideoCodec::H264) {
+      throw std::runtime_error(
+          "hisui supports --checkpoint-dir only with VP8/VP9/AV1 in WebM");
+    }
+    if (audio_only || isBatch() || isStdoutOutput() || isVideoPart() ||
+        !std::empty(video_ladder_heights) || out_audio_only_filename != "") {
+      throw std::runtime_error(
+          "--checkpoint-dir cannot be used with --audio-only, --batch, "
+          "stdout output, --video-part-count, --video-ladder or "
+          "--out-audio-only-file");
+    }
+  }
+  if (mezzanine_directory != "") {
+    if (!std::empty(layout) || video_remux || enabledCheckpoint() ||
+        enabledReport()) {
+      throw std::runtime_error(
+          "--mezzanine-dir cannot be used with --layout, --video-remux, "
+          "--checkpoint-dir or reports");
+    }
+    if (!std::empty(mezzanine_sources) && isBatch()) {
+      throw std::runtime_error(
+          "--mezzanine-sources cannot be used with --batch");
+    }
+  } else if (!std::empty(mezzanine_sources)) {
+    throw std::runtime_error("--mezzanine-sources requires --mezzanine-dir");
+  }
+  if (isClip()) {
+    if (clip_start < 0.0 || clip_end < 0.0 ||
+        (clip_end > 0.0 && clip_end <= clip_start)) {
+      throw std::runtime_error(
+          "--start and --end must be non-negative and --end must be greater "
+          "than --start");
+    }
+    if (enabledCheckpoint()) {
+      throw std::runtime_error(
+          "--start and --end cannot be used with --checkpoint-dir");
+    }
+  }
+  if (isConcat()) {
+    if (out_filename == "" ||
+        out_container != hisui::config::OutContainer::WebM) {
+      throw std::runtime_error("--concat requires --out-file in WebM");
+    }
+    if (in_metadata_filename != "" || isBatch() || !std::empty(layout) ||
+        isVideoPart() || enabledCheckpoint()) {
+      throw std::runtime_error(
+          "--concat cannot be used with --in-metadata-file, --batch, "
+          "--layout, --video-part-count or --checkpoint-dir");
+    }
+  }
 }
 
 }  // namespace hisui
@@ -7,6 +7,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include <boost/cstdint.hpp>
 #include <boost/rational.hpp>
@@ -26,6 +27,8 @@ namespace config {
 enum struct AudioMixer {
   Simple,
   Vttoth,
+  // int32_t で足し合わせてから 1 度だけ limiter を掛ける
+  Limiter,
 };
 
 enum OutVideoCodec {
@@ -38,6 +41,8 @@ enum OutVideoCodec {
 enum struct VideoComposer {
   Grid,
   ParallelGrid,
+  // 合成にかかる時間を測って Grid か ParallelGrid を選ぶ
+  Auto,
 };
 
 enum struct VideoScaler {
@@ -45,6 +50,33 @@ enum struct VideoScaler {
   PreserveAspectRatio,
 };
 
+// 個々のオプションの代わりにエンコーダーの設定をまとめて決める
+enum struct EncodeSpeed {
+  Manual,
+  Quality,
+  Balanced,
+  Fast,
+  Adaptive,
+};
+
+enum struct OpusApplication {
+  Audio,
+  VoIP,
+  LowDelay,
+};
+
+enum struct OpusBitRateMode {
+  VBR,
+  CVBR,
+  CBR,
+};
+
+// libvpx の deadline, lag-in-frames, alt-ref と Opus のフレームの長さをまとめて決める
+enum struct EncodeProfile {
+  Realtime,
+  Offline,
+};
+
 enum struct OutContainer {
   WebM,
   MP4,
@@ -53,6 +85,17 @@ enum struct OutContainer {
 enum struct MP4Muxer {
   Simple,
   Faststart,
+  Fragmented,
+  HLS,
+};
+
+// Simple と Faststart で, 音声と映像のチャンクをどう並べるか
+enum struct MP4Interleave {
+  // 映像を受け取り次第書き, チャンクの区切りで音声を後ろにまとめて書く
+  Chunk,
+  // 同じ時間の音声と映像を溜めて音声, 映像の順に書く. 溜めた映像が
+  // mp4_chunk_max_size を超えた場合も区切り, 再生時に読む位置が前後しないようにする
+  Fine,
 };
 
 enum struct OutAudioCodec {
@@ -64,10 +107,73 @@ enum struct H264Encoder {
   Unspecified,
 #ifdef USE_ONEVPL
   OneVPL,
+#endif
+#ifdef USE_VAAPI
+  VAAPI,
 #endif
   OpenH264,
 };
 
+// Auto はハードウェアデコーダーが使えれば使い, 使えなければソフトウェアデコーダーにする
+enum struct DecoderEngine {
+  Auto,
+  Software,
+  Hardware,
+};
+
+// Auto は LowPower を指定せず, oneVPL のランタイムに任せる
+enum struct VPLLowPower {
+  Auto,
+  On,
+  Off,
+};
+
+enum struct VPLRateControl {
+  VBR,
+  CBR,
+  CQP,
+};
+
+// 合成の前に録画が壊れていないかを調べる. Exclude は壊れた録画を除いて合成する
+enum struct Preflight {
+  None,
+  Check,
+  Exclude,
+};
+
+// VP9 と AV1 のエンコーダー. Auto は oneVPL のエンコーダーが対応していれば使う
+enum struct EncoderEngine {
+  Software,
+  Auto,
+  Hardware,
+};
+
+enum struct AV1Decoder {
+  SVT_AV1,
+  Dav1d,
+};
+
+enum struct ThumbnailFormat {
+  JPEG,
+  PNG,
+};
+
+// 画像のバッファに使う huge page. Explicit は hugetlbfs に予約されたものを使い,
+// 足りなければ Transparent にする
+enum struct HugePages {
+  None,
+  Transparent,
+  Explicit,
+};
+
+// 入力を読むスレッドの I/O の優先度. High と Low は best-effort の最高と最低
+enum struct IOPriority {
+  Default,
+  High,
+  Low,
+  Idle,
+};
+
 }  // namespace config
 
 class Config {
@@ -75,9 +181,40 @@ class Config {
   bool enabledReport() const;
   bool enabledSuccessReport() const;
   bool enabledFailureReport() const;
+  // --out-file - が指定された場合は標準出力に書き出す
+  bool isStdoutOutput() const;
+  bool isHLSOutput() const;
+  // --out-file が無い場合はメタデータのファイル名から決める
+  std::string getOutFilename() const;
+  bool isBatch() const;
+  // --video-part-count が 2 以上の場合はタイムラインの一部の映像のみを書き出す
+  bool isVideoPart() const;
+  bool isConcat() const;
+  bool enabledCheckpoint() const;
+  // --start か --end が指定された場合はタイムラインの一部のみを書き出す
+  bool isClip() const;
+  // 長さ duration (秒) のタイムラインから書き出す部分の長さ (秒)
+  double getClipDuration(const double duration) const;
+  // 1 つの合成でエンコーダーやデコーダーなどがそれぞれ使うスレッド数の上限
+  std::uint32_t getJobThreads() const;
+  // --video-warm-up-time (ns)
+  std::uint64_t getVideoWarmUpTime() const;
+  std::size_t getVideoComposeThreads() const;
+  // キーフレームの間隔のフレーム数. 0 の場合はエンコーダーに任せる
+  std::uint32_t getVideoKeyframeInterval() const;
+  // Opus の 1 フレームの長さ (ms)
+  std::uint32_t getOpusFrameDuration() const;
+  // Opus の complexity. 負の場合は libopus に任せる
+  std::int32_t getOpusComplexity() const;
+  // --preview の場合に, 速度を優先して解像度, フレームレート, 拡縮やエンコードの設定を上書きする
+  void applyPreview();
   void validate() const;
 
   std::string in_metadata_filename;
+  // 再起動などで分かれた録画. in_metadata_filename の録画の後ろに, この順にタイムラインを繋げる
+  std::vector<std::string> append_metadata_filenames;
+  // 全ての録画が無い区間を出力から除く. layout の trim と同じもの
+  bool trim = false;
   std::string screen_capture_metadata_filename = "";
   std::string screen_capture_connection_id = "";
   config::OutVideoCodec out_video_codec = config::OutVideoCodec::VP9;
@@ -91,11 +228,70 @@ class Config {
   std::uint32_t libvpx_max_q = 50;
   std::uint32_t out_opus_bit_rate = Constants::OPUS_DEFAULT_BIT_RATE;
   std::uint32_t out_aac_bit_rate = Constants::FDK_AAC_DEFAULT_BIT_RATE;
+  std::uint32_t out_audio_sample_rate = Constants::PCM_SAMPLE_RATE;
 
   std::string out_filename = "";
+  // 空でなければ, このファイルに 1 行ずつ書かれたメタデータファイルを順に合成する
+  std::string batch_filename = "";
+  std::size_t batch_jobs = 1;
+  // --batch で, 合成している間に後に続くこの数のメタデータの入力を読んで page cache に載せる.
+  // 合成を始めていない分の合計が batch_prefetch_size (MiB) を超えない範囲で読む
+  std::size_t batch_prefetch_jobs = 0;
+  std::uint64_t batch_prefetch_size = 1024;
+  std::uint32_t job_threads = 0;
+  // 空でなければ 1 つの合成の全てのスレッドをこれらの CPU でのみ動かす.
+  // --batch では同時に合成する数で分け合う
+  std::vector<std::uint32_t> job_cpus;
+  // --batch で job_cpus が空ならば, 動ける CPU を NUMA node ごとにまとめて分け合う
+  bool batch_pin_cpus = false;
+  // 空でなければ同じ音声を音声のみのファイルにも書き出す
+  std::string out_audio_only_filename = "";
+  // 空でなければエンコードしたパケットを, 同じホストの別のプロセスが読める共有メモリのリングにも書く
+  std::string out_packet_ring_filename = "";
+  // MiB
+  std::uint64_t out_packet_ring_size = 64;
+  // 空でなければ合成した音声をエンコードせずに 16 bit の PCM でも書き出す.
+  // 拡張子が .wav ならば WAV, それ以外ならばヘッダーのない little endian の sample のみ
+  std::string out_pcm_filename = "";
+  // 0 ならば合成する sampling rate と同じ
+  std::uint32_t out_pcm_sample_rate = 0;
+  bool out_pcm_mono = false;
+  // 映像とエンコードした音声は書き出さず, out_pcm_filename のみを書き出す
+  bool out_pcm_only = false;
+  // 空でなければ同じ合成結果を縮小して, 高さごとに映像のみのファイルにも書き出す
+  std::vector<std::uint32_t> video_ladder_heights;
+  // 合成と同時に, 参加者ごとに 1 区画の大きさへ拡縮した映像のみのファイルも書き出す
+  bool participant_outputs = false;
+  // 合成した音声に加えて, 接続ごとの音声のみのファイルもタイムラインに揃えて書き出す
+  bool participant_audio_outputs = false;
+  // 複数のプロセスやマシンで分担するため, video_part_count 個に分けたタイムラインのうち
+  // video_part_index 番目の映像のみを書き出す
+  std::size_t video_part_index = 0;
+  std::size_t video_part_count = 1;
+  // 空でなければ合成はせず, part ごとの出力と音声のみの出力を out_filename に結合する
+  std::vector<std::string> concat_filenames;
+  // 空でなければ checkpoint_interval 秒ごとの part をこのディレクトリに書き出してから結合する
+  std::string checkpoint_directory = "";
+  double checkpoint_interval = 600.0;
+  // 空でなければ, 映像の source ごとに 1 区画の大きさへ拡縮した mezzanine を
+  // このディレクトリに書き出してから, mezzanine を合成する
+  std::string mezzanine_directory = "";
+  // 空でなければ合成はせず, これらの番号の source の mezzanine のみを書き出す
+  std::vector<std::size_t> mezzanine_sources;
+  // 同時に書き出す mezzanine の数
+  std::size_t mezzanine_jobs = 4;
+  // 書き出すファイルごとに計算するハッシュ値のアルゴリズム
+  std::vector<std::string> out_hashes;
+  // タイムラインの [clip_start, clip_end) (秒) のみを書き出す. clip_end が 0 ならば最後まで
+  double clip_start = 0.0;
+  double clip_end = 0.0;
   std::string directory_for_faststart_intermediate_file = "";
+  // 見込んだ mdat の大きさ (MiB) がこれ以下ならば中間ファイルをメモリー上に置く
+  std::uint64_t faststart_memory_limit = 256;
 
   std::size_t max_columns = 3;
+  // 表示中の source の数に合わせて grid の大きさとビットレートを切り替える
+  bool adaptive_grid = false;
 
   bool version = false;
   bool verbose = false;
@@ -107,29 +303,133 @@ class Config {
 
   // 以降は SPEC.rst にないオプション
   bool video_codec_engines = false;
+  // 合成はせず, 負荷の見積もりを書き出す
+  bool estimate = false;
+  config::Preflight preflight = config::Preflight::None;
+  // 確認用に, 画質を落として速く合成する
+  bool preview = false;
+  // 空でなければエンコードはせず, これらの時刻 (秒) のフレームのみを合成して画像に書き出す
+  std::vector<double> thumbnail_times;
+  config::ThumbnailFormat thumbnail_format = config::ThumbnailFormat::JPEG;
+  std::uint32_t thumbnail_quality = 90;
+  // 書き込み中の録画ファイルを, 追記を待ちながら合成する
+  bool live = false;
+  std::uint32_t live_idle_timeout = 30;
+  // --mp4-muxer hls の segment と LL-HLS の part の長さ (秒). part が 0 ならば part は作らない
+  double hls_segment_duration = 4.0;
+  double hls_part_duration = 0.0;
+  // 0 でなければ playlist にはこの数の segment のみを残し, 古い segment は削除する
+  std::uint32_t hls_playlist_size = 0;
   bool show_progress_bar = true;
+  double progress_interval = 0.0;
 
   config::H264Encoder h264_encoder = config::H264Encoder::Unspecified;
+  config::DecoderEngine video_decoder_engine = config::DecoderEngine::Auto;
+  config::EncoderEngine video_encoder_engine = config::EncoderEngine::Software;
+  std::uint32_t max_hardware_decoders = 4;
+  config::AV1Decoder av1_decoder = config::AV1Decoder::SVT_AV1;
+  config::HugePages huge_pages = config::HugePages::None;
 
 #ifdef NDEBUG
   spdlog::level::level_enum log_level = spdlog::level::info;
 #else
   spdlog::level::level_enum log_level = spdlog::level::debug;
 #endif
+  bool log_async = false;
   std::uint32_t scaling_width = 320;
   std::uint32_t scaling_height = 240;
 
   std::uint32_t screen_capture_width = 960;
   std::uint32_t screen_capture_height = 640;
   std::uint32_t screen_capture_bit_rate = 1000;
+  // screen capture のストリームを画面向けの設定でエンコードする
+  std::uint32_t screen_capture_tune_content = 1;
 
   std::uint32_t libvpx_threads = 0;
   std::int32_t libvpx_cpu_used = 8;
   std::uint32_t libvp9_frame_parallel = 1;
   std::uint32_t libvp9_tile_columns = 0;
   std::uint32_t libvp9_row_mt = 0;
+  // 直前のフレームから変わらない macroblock のエンコードを省く
+  bool libvpx_active_map = false;
+  // VP8/VP9 の出力をデコードして合成結果と比べ, PSNR と SSIM を集計する
+  bool measure_video_quality = false;
+  // 報告の処理の段階ごとに, perf_event_open(2) でハードウェアの計数を加える
+  bool report_perf_counters = false;
+
+  // SVT-AV1 の preset (enc_mode). --encode-speed が manual 以外ならば上書きされる
+  std::int32_t svt_av1_preset = 10;
+  // 2 を底とする対数で指定する
+  std::uint32_t svt_av1_tile_rows = 0;
+  std::uint32_t svt_av1_tile_columns = 0;
+  // 負の場合は SVT-AV1 のデフォルトを使う
+  std::int32_t svt_av1_lookahead = -1;
+  // 空でなければ SVT-AV1 のスレッドをこれらの CPU でのみ動かす.
+  // --batch では同時に合成する数で分け合う
+  std::vector<std::uint32_t> svt_av1_cpus;
+
+  // oneVPL エンコーダーの TargetUsage. 1 が最も高画質で, 7 が最も速い
+  std::uint32_t vpl_target_usage = 4;
+  config::VPLLowPower vpl_low_power = config::VPLLowPower::Auto;
+  // 同期を待たずに投入しておけるフレーム数
+  std::uint32_t vpl_async_depth = 4;
+  config::VPLRateControl vpl_rate_control = config::VPLRateControl::VBR;
+
+  config::EncodeProfile encode_profile = config::EncodeProfile::Realtime;
+  config::EncodeSpeed encode_speed = config::EncodeSpeed::Manual;
+  double encode_realtime_factor = 1.0;
+  // 0 より大きければ, 処理速度がこれを下回る間 layout の region の priority に従って品質を落とす
+  double degradation_realtime_factor = 0;
+  // 経過時間やマシンの CPU の数によって, 出力のビットストリームを変える判断をしない
+  bool deterministic = false;
+  bool av1_async_encode = false;
+
+  std::size_t frame_buffer_capacity = 256;
+  // WebM の cluster の上限. 0 ならば mkvmuxer に任せる
+  double webm_cluster_duration = 0;
+  std::uint64_t webm_cluster_size = 0;
+  bool webm_cues = true;
+  // 0 でなければ, 常駐メモリがこのサイズ (MiB) を超えた時点で合成を中止する
+  std::uint64_t max_memory = 0;
+  std::size_t video_pipeline_depth = 2;
+  std::size_t video_encode_segments = 1;
+  std::uint32_t video_keyframe_interval = 0;
+  // 合成結果が変わらない間のエンコードを省き, 可変フレームレートで出力する
+  bool video_variable_frame_rate = false;
+  std::size_t video_decode_threads = 1;
+  // 映像の source を区間の始まるこの時間 (秒) 前から別のスレッドで開いておく. 0 ならば行わない
+  double video_warm_up_time = 0.0;
+  std::size_t audio_decode_threads = 1;
+  // 振幅がこれ以下の音声の source は, その区間の合成から外す. 負ならば外さない
+  std::int32_t audio_silence_level = 8;
+  // Opus の音声をタイムラインの区間に分けて並列に合成する数
+  std::size_t audio_chunks = 1;
+  std::uint32_t video_threads_per_decoder = 0;
+  std::uint32_t libvp9_decoder_row_mt = 1;
+  std::uint32_t libvp9_decoder_skip_loop_filter = 0;
+  std::uint32_t openh264_decoder_threads = 0;
+  std::uint32_t openh264_decode_ahead = 0;
+  std::size_t video_compose_threads = 0;
+  std::string webm_index_cache_directory = "";
+  std::string audio_cache_directory = "";
+  std::string result_cache_directory = "";
+  // --result-cache-dir の key に含める, 指定されたオプション. main() で設定する
+  std::string result_cache_options = "";
+  std::size_t prefetch_threads = 2;
+  // 入力の読み込みの帯域 (MiB/s). 0 ならば制限しない
+  double read_bandwidth = 0.0;
+  double host_read_bandwidth = 0.0;
+  // 同じホストのプロセスが host_read_bandwidth を分け合うためのファイル
+  std::string host_read_bandwidth_file = "/dev/shm/hisui-read-bandwidth";
+  // 同じホストのプロセスでデコードしたフレームを共有するキャッシュの大きさ (MiB).
+  // 0 ならば使わない
+  std::size_t shared_frame_cache_size = 0;
+  std::string shared_frame_cache_file = "/dev/shm/hisui-frame-cache";
+  config::IOPriority io_priority = config::IOPriority::Default;
+  std::string codec_probe_cache_file = "";
 
   std::uint16_t openh264_threads = 1;
+  std::uint16_t openh264_slices = 0;
   std::int32_t openh264_min_qp = 0;
   std::int32_t openh264_max_qp = 51;
   ::EProfileIdc openh264_profile = ::PRO_BASELINE;
@@ -141,13 +441,35 @@ class Config {
   config::VideoScaler video_scaler = config::VideoScaler::PreserveAspectRatio;
   std::string openh264 = "";
 
+  // USE_TRACE を有効にしてビルドした場合のみ使う
+  std::string trace_filename = "";
+  // 空でなければ全スレッドのスタックを採取して folded stack の形式で書き出す
+  std::string profile_filename = "";
+  std::uint32_t profile_frequency = 99;
+  bool profile_on_signal = false;
+
   config::AudioMixer audio_mixer = config::AudioMixer::Simple;
   bool mix_screen_capture_audio = false;
+  bool opus_passthrough = false;
+  // 0 ならば --encode-profile で決める
+  std::uint32_t opus_frame_duration = 0;
+  // 負ならば libopus の既定値を使う. --encode-speed が manual 以外の場合は使わない
+  std::int32_t opus_complexity = -1;
+  config::OpusBitRateMode opus_bit_rate_mode = config::OpusBitRateMode::CVBR;
+  config::OpusApplication opus_application = config::OpusApplication::Audio;
+  bool video_remux = false;
 
   config::MP4Muxer mp4_muxer = config::MP4Muxer::Faststart;
+  // MP4 のチャンク (Fragmented では fragment) の長さ (ms). 0 ならば音声のコーデックで決める
+  std::uint32_t mp4_chunk_duration = 0;
+  config::MP4Interleave mp4_interleave = config::MP4Interleave::Chunk;
+  // MP4Interleave::Fine で溜める映像の上限 (KiB)
+  std::uint32_t mp4_chunk_max_size = 1024;
   config::OutAudioCodec out_audio_codec = config::OutAudioCodec::Opus;
 };
 
 void set_cli_options(CLI::App* app, Config* config);
+// 指定されたオプションのうち, 出力の内容に関わりうるものを 1 行ずつ並べる
+std::string get_result_cache_options(const CLI::App& app);
 
 }  // namespace hisui
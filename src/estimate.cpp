@@ -0,0 +1,277 @@
+#include "estimate.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/json/array.hpp>
+#include <boost/json/object.hpp>
+#include <boost/json/serialize.hpp>
+#include <boost/rational.hpp>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "layout/metadata.hpp"
+#include "metadata.hpp"
+#include "util/file.hpp"
+#include "video/image_source.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace hisui {
+
+namespace {
+
+struct Span {
+  double start_time;
+  double end_time;
+  // フレームごとにデコードする画素数. 静止画は一度しかデコードしないので 0
+  std::uint64_t pixels;
+};
+
+struct Estimation {
+  double duration = 0;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  std::vector<Span> spans = {};
+};
+
+struct SourceSize {
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  bool is_video = false;
+};
+
+SourceSize probe(const ArchiveItem& archive) {
+  const auto path = archive.getPath();
+  const auto extension = hisui::util::get_extension(path);
+  if (extension == ".webm") {
+    webm::input::VideoContext context(path.string());
+    if (!context.init()) {
+      spdlog::warn("failed to probe video track: {}", path.string());
+      return {};
+    }
+    return {.width = context.getWidth(),
+            .height = context.getHeight(),
+            .is_video = true};
+  }
+  if (extension == ".png" || extension == ".jpg" || extension == ".jpeg") {
+    video::ImageSource source(path.string());
+    return {.width = source.getWidth(), .height = source.getHeight()};
+  }
+  spdlog::info("unsupported video source: {}", path.string());
+  return {};
+}
+
+// GridComposer と同じ方法で出力の解像度を求める
+void grid_size(const hisui::Config& config,
+               const std::size_t size,
+               const std::uint32_t max_width,
+               const std::uint32_t max_height,
+               std::uint32_t* width,
+               std::uint32_t* height) {
+  if (size == 0) {
+    *width = 0;
+    *height = 0;
+    return;
+  }
+  const auto single_width =
+      config.scaling_width != 0 ? config.scaling_width : max_width;
+  const auto single_height =
+      config.scaling_height != 0 ? config.scaling_height : max_height;
+  const auto column = std::min(config.max_columns, size);
+  const auto row = column == 1 ? size : ((size + column - 1) / column);
+  *width = static_cast<std::uint32_t>(single_width * column);
+  *height = static_cast<std::uint32_t>(single_height * row);
+}
+
+Estimation estimate_metadata(const hisui::Config& config) {
+  if (std::empty(config.in_metadata_filename)) {
+    throw std::runtime_error("-f,--in-metadata-file is required");
+  }
+  MetadataSet metadata_set(parse_metadata(
+      config.in_metadata_filename, config.append_metadata_filenames));
+  if (!config.screen_capture_metadata_filename.empty()) {
+    metadata_set.setPrefered(
+        parse_metadata(config.screen_capture_metadata_filename));
+  } else if (!config.screen_capture_connection_id.empty()) {
+    metadata_set.split(config.screen_capture_connection_id);
+  }
+  if (config.trim) {
+    metadata_set.trim();
+  }
+
+  Estimation estimation{.duration = metadata_set.getMaxStopTimeOffset()};
+  if (config.audio_only) {
+    return estimation;
+  }
+
+  std::set<std::string> connection_ids;
+  std::uint32_t max_width = 0;
+  std::uint32_t max_height = 0;
+  for (const auto& archive : metadata_set.getNormalArchives()) {
+    const auto size = probe(archive);
+    max_width = std::max(max_width, size.width);
+    max_height = std::max(max_height, size.height);
+    connection_ids.insert(archive.getConnectionID());
+    estimation.spans.push_back(
+        {.start_time = archive.getStartTimeOffset(),
+         .end_time = archive.getStopTimeOffset(),
+         .pixels = size.is_video
+                       ? static_cast<std::uint64_t>(size.width) * size.height
+                       : 0});
+  }
+  grid_size(config, std::size(connection_ids), max_width, max_height,
+            &estimation.width, &estimation.height);
+
+  if (metadata_set.hasPreferred()) {
+    for (const auto& archive : metadata_set.getPreferred().getArchiveItems()) {
+      const auto size = probe(archive);
+      estimation.spans.push_back(
+          {.start_time = archive.getStartTimeOffset(),
+           .end_time = archive.getStopTimeOffset(),
+           .pixels = size.is_video
+                         ? static_cast<std::uint64_t>(size.width) * size.height
+                         : 0});
+    }
+    estimation.width =
+        std::max(estimation.width, config.screen_capture_width);
+    estimation.height =
+        std::max(estimation.height, config.screen_capture_height);
+  }
+  return estimation;
+}
+
+Estimation estimate_layout(hisui::Config* config) {
+  auto metadata = layout::parse_metadata(*config);
+  metadata.copyToConfig(config);
+
+  const auto resolution = metadata.getResolution();
+  Estimation estimation{.duration = metadata.getMaxEndTime(),
+                        .width = resolution.width,
+                        .height = resolution.height};
+  if (config->audio_only) {
+    estimation.width = 0;
+    estimation.height = 0;
+    return estimation;
+  }
+  // trim 後の区間を使う
+  for (const auto& region : metadata.getRegions()) {
+    for (const auto& source : region->getVideoSources()) {
+      const auto interval = source->getSourceInterval();
+      estimation.spans.push_back(
+          {.start_time = interval.start_time,
+           .end_time = interval.end_time,
+           .pixels = static_cast<std::uint64_t>(source->getWidth()) *
+                     source->getHeight()});
+    }
+  }
+  return estimation;
+}
+
+struct Event {
+  double time;
+  std::int64_t sources;
+  std::int64_t pixels;
+};
+
+boost::json::object make_result(const Estimation& estimation,
+                                const double frame_rate) {
+  std::vector<Event> events;
+  for (const auto& s : estimation.spans) {
+    const auto start_time = std::max(0.0, s.start_time);
+    const auto end_time = std::min(estimation.duration, s.end_time);
+    if (start_time >= end_time) {
+      continue;
+    }
+    const auto pixels = static_cast<std::int64_t>(s.pixels);
+    events.push_back({.time = start_time, .sources = 1, .pixels = pixels});
+    events.push_back({.time = end_time, .sources = -1, .pixels = -pixels});
+  }
+  // 同時刻では終了を先に処理し, 接しているだけの区間を重ねない
+  std::sort(std::begin(events), std::end(events),
+            [](const Event& a, const Event& b) {
+              if (a.time != b.time) {
+                return a.time < b.time;
+              }
+              return a.sources < b.sources;
+            });
+
+  boost::json::array timeline;
+  std::int64_t sources = 0;
+  std::int64_t pixels = 0;
+  std::int64_t max_sources = 0;
+  std::int64_t peak_pixels = 0;
+  double pixel_seconds = 0;
+  double last_time = 0;
+  for (std::size_t i = 0; i < std::size(events); ++i) {
+    const auto& e = events[i];
+    pixel_seconds += static_cast<double>(pixels) * (e.time - last_time);
+    last_time = e.time;
+    sources += e.sources;
+    pixels += e.pixels;
+    if (i + 1 < std::size(events) && events[i + 1].time == e.time) {
+      continue;
+    }
+    max_sources = std::max(max_sources, sources);
+    peak_pixels = std::max(peak_pixels, pixels);
+    timeline.push_back(boost::json::object{
+        {"time", e.time},
+        {"active_sources", sources},
+        {"decode_pixel_rate", static_cast<double>(pixels) * frame_rate},
+    });
+  }
+
+  const auto output_pixels =
+      static_cast<std::uint64_t>(estimation.width) * estimation.height;
+  return boost::json::object{
+      {"duration", estimation.duration},
+      {"output",
+       boost::json::object{
+           {"width", estimation.width},
+           {"height", estimation.height},
+           {"frame_rate", frame_rate},
+           {"pixel_rate", static_cast<double>(output_pixels) * frame_rate},
+       }},
+      {"sources", std::size(estimation.spans)},
+      {"max_active_sources", max_sources},
+      {"decode_pixel_rate",
+       boost::json::object{
+           {"peak", static_cast<double>(peak_pixels) * frame_rate},
+           {"average", estimation.duration > 0
+                           ? pixel_seconds / estimation.duration * frame_rate
+                           : 0.0},
+       }},
+      {"timeline", timeline},
+  };
+}
+
+}  // namespace
+
+int estimate(const hisui::Config& t_config) {
+  auto config = t_config;
+  try {
+    const auto estimation = std::empty(config.layout)
+                                ? estimate_metadata(config)
+                                : estimate_layout(&config);
+    // ソースも出力のフレームレートでデコードするものとして見積もる
+    const auto frame_rate =
+        boost::rational_cast<double>(config.out_video_frame_rate);
+    std::cout << boost::json::serialize(make_result(estimation, frame_rate))
+              << std::endl;
+  } catch (const std::exception& e) {
+    spdlog::error("estimation failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace hisui
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "config.hpp"
+
+namespace hisui {
+
+// 合成はせず, メタデータかレイアウトと WebM のヘッダーのみから
+// 合成にかかる負荷の見積もりを JSON で標準出力に書き出す
+int estimate(const hisui::Config&);
+
+}  // namespace hisui
@@ -2,12 +2,14 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 namespace hisui {
 
 struct Frame {
   const std::uint64_t timestamp;
-  std::uint8_t* data;
+  // FrameBufferPool から取得した領域. 参照がなくなるとプールに戻る
+  std::shared_ptr<std::uint8_t[]> data;
   const std::size_t data_size;
   const bool is_key;
 };
@@ -0,0 +1,85 @@
+#include "frame_buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace hisui {
+
+FrameBufferPool::FrameBufferPool(const std::size_t t_max_free_buffers)
+    : m_storage(std::make_shared<Storage>()) {
+  m_storage->max_free_buffers = t_max_free_buffers;
+}
+
+std::shared_ptr<std::uint8_t[]> FrameBufferPool::acquire(
+    const std::size_t size) {
+  Buffer buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_storage->mutex);
+    auto& free_buffers = m_storage->free_buffers;
+    // 足りる中で最も小さいものを選び, 音声の小さなパケットが
+    // 映像用の大きなバッファを占有しないようにする
+    auto it = std::end(free_buffers);
+    for (auto i = std::begin(free_buffers); i != std::end(free_buffers); ++i) {
+      if (i->capacity >= size &&
+          (it == std::end(free_buffers) || i->capacity < it->capacity)) {
+        it = i;
+      }
+    }
+    if (it != std::end(free_buffers)) {
+      buffer = std::move(*it);
+      free_buffers.erase(it);
+    }
+  }
+
+  if (!buffer.data) {
+    buffer.data.reset(new std::uint8_t[size]);
+    buffer.capacity = size;
+  }
+
+  std::weak_ptr<Storage> storage = m_storage;
+  const auto capacity = buffer.capacity;
+  return std::shared_ptr<std::uint8_t[]>(
+      buffer.data.release(), [storage, capacity](std::uint8_t* p) {
+        release(storage, {.data = std::unique_ptr<std::uint8_t[]>(p),
+                          .capacity = capacity});
+      });
+}
+
+std::size_t FrameBufferPool::getNumberOfFreeBuffers() const {
+  std::lock_guard<std::mutex> lock(m_storage->mutex);
+  return std::size(m_storage->free_buffers);
+}
+
+FrameBufferPool& FrameBufferPool::getInstance() {
+  static FrameBufferPool pool;
+  return pool;
+}
+
+void FrameBufferPool::release(const std::weak_ptr<Storage>& weak_storage,
+                              Buffer buffer) {
+  // プールが先に破棄されていればそのまま解放する
+  auto storage = weak_storage.lock();
+  if (!storage) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(storage->mutex);
+  auto& free_buffers = storage->free_buffers;
+  if (std::size(free_buffers) < storage->max_free_buffers) {
+    free_buffers.push_back(std::move(buffer));
+    return;
+  }
+  // 一杯の場合は最も小さいものと入れ替えて, 大きな領域を優先して残す
+  auto it = std::min_element(
+      std::begin(free_buffers), std::end(free_buffers),
+      [](const auto& a, const auto& b) { return a.capacity < b.capacity; });
+  if (it->capacity < buffer.capacity) {
+    *it = std::move(buffer);
+  }
+}
+
+}  // namespace hisui
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hisui {
+
+// エンコード済みのフレームを入れるバッファを回収して再利用する.
+// acquire() で得たバッファは参照がなくなるとプールに戻る
+class FrameBufferPool {
+ public:
+  explicit FrameBufferPool(const std::size_t t_max_free_buffers = 64);
+
+  FrameBufferPool(const FrameBufferPool&) = delete;
+  FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+  // 少なくとも size バイトの領域を持つバッファを返す
+  std::shared_ptr<std::uint8_t[]> acquire(const std::size_t size);
+  std::size_t getNumberOfFreeBuffers() const;
+
+  // エンコーダー間で共有するプール
+  static FrameBufferPool& getInstance();
+
+ private:
+  struct Buffer {
+    std::unique_ptr<std::uint8_t[]> data;
+    std::size_t capacity;
+  };
+
+  struct Storage {
+    std::mutex mutex;
+    std::vector<Buffer> free_buffers;
+    std::size_t max_free_buffers;
+  };
+
+  static void release(const std::weak_ptr<Storage>&, Buffer);
+
+  std::shared_ptr<Storage> m_storage;
+};
+
+}  // namespace hisui
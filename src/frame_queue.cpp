@@ -0,0 +1,110 @@
+#include "frame_queue.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "frame.hpp"
+
+namespace hisui {
+
+FrameQueue::FrameQueue(const std::size_t t_capacity)
+    : m_capacity(t_capacity) {}
+
+void FrameQueue::push(hisui::Frame frame) {
+  if (m_recorder) {
+    m_recorder(frame);
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_capacity != 0) {
+      m_cv_not_full.wait(lock, [this] {
+        return m_is_aborted || std::size(m_queue) < m_capacity;
+      });
+    }
+    if (m_is_aborted) {
+      throw std::runtime_error("FrameQueue is aborted");
+    }
+    if (m_is_closed) {
+      throw std::logic_error("FrameQueue::push() is called after close()");
+    }
+    m_queue.push(std::move(frame));
+    m_peak_size = std::max(m_peak_size, std::size(m_queue));
+  }
+  m_cv_not_empty.notify_one();
+}
+
+void FrameQueue::setRecorder(
+    std::function<void(const hisui::Frame&)> recorder) {
+  m_recorder = std::move(recorder);
+}
+
+void FrameQueue::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_closed = true;
+  }
+  m_cv_not_empty.notify_all();
+}
+
+void FrameQueue::abort() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_aborted = true;
+  }
+  m_cv_not_full.notify_all();
+  m_cv_not_empty.notify_all();
+}
+
+std::optional<hisui::Frame> FrameQueue::front() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_queue.empty()) {
+    return {};
+  }
+  return m_queue.front();
+}
+
+std::optional<hisui::Frame> FrameQueue::waitFront() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cv_not_empty.wait(lock, [this] {
+    return !m_queue.empty() || m_is_closed || m_is_aborted;
+  });
+  if (m_queue.empty()) {
+    return {};
+  }
+  return m_queue.front();
+}
+
+void FrameQueue::pop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.pop();
+  }
+  m_cv_not_full.notify_one();
+}
+
+bool FrameQueue::isClosed() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_is_closed;
+}
+
+bool FrameQueue::isFinished() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_is_closed && m_queue.empty();
+}
+
+std::size_t FrameQueue::size() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return std::size(m_queue);
+}
+
+std::size_t FrameQueue::peakSize() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_peak_size;
+}
+
+}  // namespace hisui
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+
+#include "frame.hpp"
+
+namespace hisui {
+
+// エンコーダー(producer)とマルチプレクサー(consumer)の間で Frame を受け渡す
+// capacity が 0 でなければ, 満杯の間 push() はブロックする
+class FrameQueue {
+ public:
+  explicit FrameQueue(const std::size_t t_capacity = 0);
+
+  FrameQueue(const FrameQueue&) = delete;
+  FrameQueue& operator=(const FrameQueue&) = delete;
+
+  // ロックの中で shared_ptr の参照数を増減させないよう, 値で受け取って move する
+  void push(hisui::Frame);
+  // push() された Frame を, キューに入れる前に push() したスレッドで渡す
+  void setRecorder(std::function<void(const hisui::Frame&)>);
+  void close();
+  void abort();
+
+  std::optional<hisui::Frame> front();
+  // Frame が来るか close() されるまでブロックする. close() 済みで空ならば値を返さない
+  std::optional<hisui::Frame> waitFront();
+  void pop();
+
+  bool isClosed();
+  bool isFinished();
+  std::size_t size();
+  // これまでに溜まった Frame の数の最大値
+  std::size_t peakSize();
+
+ private:
+  std::queue<hisui::Frame> m_queue;
+  const std::size_t m_capacity;
+  bool m_is_closed = false;
+  bool m_is_aborted = false;
+  std::size_t m_peak_size = 0;
+  std::function<void(const hisui::Frame&)> m_recorder;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv_not_empty;
+  std::condition_variable m_cv_not_full;
+};
+
+}  // namespace hisui
@@ -1,32 +1,59 @@
 #include <bits/exception.h>
+#include <spdlog/async.h>
 #include <spdlog/common.h>
 #include <spdlog/fmt/bundled/format.h>
 #include <spdlog/fmt/fmt.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <CLI/App.hpp>
 #include <CLI/Config.hpp>
 #include <CLI/Formatter.hpp>
 
+#include "batch_prefetcher.hpp"
+#include "composer.hpp"
 #include "config.hpp"
 #include "constants.hpp"
 #include "datetime.hpp"
+#include "estimate.hpp"
 #include "layout/compose.hpp"
 #include "metadata.hpp"
-#include "muxer/async_webm_muxer.hpp"
-#include "muxer/faststart_mp4_muxer.hpp"
-#include "muxer/muxer.hpp"
-#include "muxer/simple_mp4_muxer.hpp"
+#include "muxer/mezzanine.hpp"
 #include "report/reporter.hpp"
+#include "thumbnail.hpp"
+#include "util/cgroup.hpp"
+#include "util/cpu_affinity.hpp"
+#include "util/io_budget.hpp"
+#include "util/memory.hpp"
+#include "util/perf_counters.hpp"
+#include "util/profiler.hpp"
+#include "util/thread_pool.hpp"
+#include "util/trace.hpp"
 #include "version/version.hpp"
 #include "video/codec_engine.hpp"
+#include "video/codec_probe.hpp"
 #include "video/decoder_factory.hpp"
 #include "video/openh264_handler.hpp"
+#include "video/shared_frame_cache.hpp"
+#include "video/webm_source.hpp"
+#include "webm/concat.hpp"
+#include "webm/input/demuxer.hpp"
+#include "webm/input/prefetcher.hpp"
 
 #ifdef USE_ONEVPL
 #include "video/vpl_decoder.hpp"
@@ -34,16 +61,280 @@
 #include "video/vpl_session.hpp"
 #endif
 
-static void closeHandlersAndSession() {
-  if (hisui::video::OpenH264Handler::hasInstance()) {
-    hisui::video::OpenH264Handler::close();
+static hisui::MetadataSet parse_metadata_set(const hisui::Config& config) {
+  hisui::MetadataSet metadata_set(
+      hisui::parse_metadata(config.in_metadata_filename,
+                            config.append_metadata_filenames));
+
+  if (!config.screen_capture_metadata_filename.empty()) {
+    metadata_set.setPrefered(
+        hisui::parse_metadata(config.screen_capture_metadata_filename));
+  } else if (!config.screen_capture_connection_id.empty()) {
+    metadata_set.split(config.screen_capture_connection_id);
+  }
+  if (config.trim) {
+    metadata_set.trim();
   }
+  return metadata_set;
+}
 
-#ifdef USE_ONEVPL
-  if (hisui::video::VPLSession::hasInstance()) {
-    hisui::video::VPLSession::close();
+// 合成の結果のレポートを書き出して Reporter を閉じる
+static int write_report(const hisui::Config& config,
+                        const hisui::CompositionResult& result,
+                        const boost::json::string& normal_recording_id) {
+  const auto& report_directory =
+      result.succeeded ? config.success_report : config.failure_report;
+  if (report_directory != "" && result.report != "") {
+    try {
+      std::ofstream os(std::filesystem::path(report_directory) /
+                       fmt::format("{}_{}_{}.json",
+                                   hisui::datetime::get_current_utc_string(),
+                                   normal_recording_id,
+                                   result.succeeded ? "success" : "failure"));
+      os << result.report;
+      hisui::report::Reporter::close();
+    } catch (const std::exception& e) {
+      spdlog::error("reporting({}) failed: {}",
+                    result.succeeded ? "success" : "failure", e.what());
+      return EXIT_FAILURE;
+    }
   }
-#endif
+
+  return result.succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// config.in_metadata_filename の録画を合成する
+static int compose_metadata(const hisui::Config& config) {
+  hisui::CompositionResult result;
+  boost::json::string normal_recording_id;
+  try {
+    const auto metadata_set = parse_metadata_set(config);
+    normal_recording_id = metadata_set.getNormal().getRecordingID();
+    result = hisui::compose(config, metadata_set);
+  } catch (const std::exception& e) {
+    spdlog::error("setting up muxer failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  return write_report(config, result, normal_recording_id);
+}
+
+// --mezzanine-sources の source の mezzanine のみを書き出す
+static int write_mezzanine_sources(const hisui::Config& config) {
+  try {
+    hisui::muxer::write_mezzanines(
+        config, parse_metadata_set(config).getNormal().getArchiveItems(),
+        config.mezzanine_sources);
+  } catch (const std::exception& e) {
+    spdlog::error("writing mezzanines failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// --checkpoint-interval 秒ごとの part と音声を --checkpoint-dir に書き出してから結合する.
+// 書き出し終えたものは名前を付け替えて残すので, 失敗した後に再び実行するとその続きから合成する
+static int compose_with_checkpoints(const hisui::Config& config) {
+  std::size_t number_of_parts = 1;
+  std::string out_filename = config.out_filename;
+  boost::json::string normal_recording_id;
+  try {
+    hisui::MetadataSet metadata_set(
+        hisui::parse_metadata(config.in_metadata_filename,
+                              config.append_metadata_filenames));
+    normal_recording_id = metadata_set.getNormal().getRecordingID();
+    const double duration = metadata_set.getMaxStopTimeOffset();
+    number_of_parts = std::max<std::size_t>(
+        1, static_cast<std::size_t>(
+               std::ceil(duration / config.checkpoint_interval)));
+    std::filesystem::create_directories(config.checkpoint_directory);
+    if (out_filename == "") {
+      out_filename = std::filesystem::path(config.in_metadata_filename)
+                         .replace_extension(".webm")
+                         .string();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("setting up checkpoints failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+
+  // 最後の 1 つは音声のみの出力. 分割数を名前に含めて, 長さが変わった録画の part を使わないようにする
+  std::vector<std::string> filenames;
+  for (std::size_t i = 0; i <= number_of_parts; ++i) {
+    const auto path =
+        std::filesystem::path(config.checkpoint_directory) /
+        (i < number_of_parts
+             ? fmt::format("part{}_of_{}.webm", i, number_of_parts)
+             : std::string("audio.weba"));
+    filenames.push_back(path.string());
+    if (std::filesystem::exists(path)) {
+      spdlog::info("reusing checkpoint: {}", path.string());
+      continue;
+    }
+
+    hisui::Config job_config = config;
+    job_config.out_filename = path.string() + ".tmp";
+    job_config.out_hashes.clear();
+    if (i < number_of_parts) {
+      job_config.video_part_count = number_of_parts;
+      job_config.video_part_index = i;
+    } else {
+      job_config.audio_only = true;
+    }
+    spdlog::info("composing checkpoint: {}", path.string());
+    // Reporter は全ての part で同じものを使い, 最後に 1 度だけ書き出して閉じる
+    hisui::CompositionResult result;
+    try {
+      result = hisui::compose(job_config, parse_metadata_set(job_config));
+    } catch (const std::exception& e) {
+      spdlog::error("setting up muxer failed: {}", e.what());
+      return EXIT_FAILURE;
+    }
+    if (!result.succeeded) {
+      return write_report(config, result, normal_recording_id);
+    }
+    try {
+      std::filesystem::rename(job_config.out_filename, path);
+    } catch (const std::exception& e) {
+      spdlog::error("saving checkpoint failed: {}", e.what());
+      return EXIT_FAILURE;
+    }
+  }
+
+  hisui::CompositionResult result{.succeeded = true};
+  try {
+    hisui::webm::concat(filenames, out_filename, config.out_hashes);
+  } catch (const std::exception& e) {
+    spdlog::error("concat failed: {}", e.what());
+    result = {.error = e.what()};
+  }
+  if (hisui::report::Reporter::hasInstance()) {
+    auto& reporter = hisui::report::Reporter::getInstance();
+    result.report = result.succeeded
+                        ? reporter.makeSuccessReport()
+                        : reporter.makeFailureReport(result.error);
+  }
+  return write_report(config, result, normal_recording_id);
+}
+
+// --batch のファイルに並ぶ録画を, 最大 --batch-jobs 個ずつ同時に合成する.
+// OpenH264 のライブラリや VPL のセッションはすべての録画で使い回す
+static int run_batch(const hisui::Config& config) {
+  std::vector<std::string> metadata_filenames;
+  try {
+    std::ifstream ifs(config.batch_filename);
+    if (!ifs) {
+      throw std::runtime_error("Unable to open: " + config.batch_filename);
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (!std::empty(line) && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (std::empty(line) || line.front() == '#') {
+        continue;
+      }
+      metadata_filenames.push_back(line);
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("reading batch file failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+
+  // --svt-av1-cpus と --job-cpus を同時に合成する数で分け, 合成ごとに空いている組を使う
+  std::mutex cpu_sets_mutex;
+  auto free_cpu_sets =
+      hisui::util::split_cpus(config.svt_av1_cpus, config.batch_jobs);
+  auto free_job_cpu_sets =
+      hisui::util::split_cpus(config.job_cpus, config.batch_jobs);
+
+  std::unique_ptr<hisui::BatchPrefetcher> prefetcher;
+  if (config.batch_prefetch_jobs > 0) {
+    prefetcher = std::make_unique<hisui::BatchPrefetcher>(
+        metadata_filenames, config.batch_prefetch_jobs,
+        config.batch_prefetch_size * 1024 * 1024);
+  }
+
+  std::atomic<std::size_t> number_of_failures = 0;
+  hisui::util::ThreadPool thread_pool(config.batch_jobs - 1);
+  thread_pool.parallelFor(
+      std::size(metadata_filenames), [&](const std::size_t i) {
+        if (prefetcher) {
+          prefetcher->start(i);
+        }
+        hisui::Config job_config = config;
+        job_config.in_metadata_filename = metadata_filenames[i];
+        if (config.batch_jobs > 1) {
+          job_config.show_progress_bar = false;
+        }
+        {
+          std::lock_guard<std::mutex> lock(cpu_sets_mutex);
+          if (!std::empty(free_cpu_sets)) {
+            job_config.svt_av1_cpus = std::move(free_cpu_sets.back());
+            free_cpu_sets.pop_back();
+          }
+          if (!std::empty(free_job_cpu_sets)) {
+            job_config.job_cpus = std::move(free_job_cpu_sets.back());
+            free_job_cpu_sets.pop_back();
+          }
+        }
+        spdlog::info("composing {}", job_config.in_metadata_filename);
+
+        if (config.enabledReport()) {
+          hisui::report::Reporter::open();
+        }
+        int ret = EXIT_FAILURE;
+        try {
+          const auto job_profile_filename =
+              hisui::util::profiler::get_job_filename(config.profile_filename,
+                                                      i);
+          const hisui::util::profiler::Session profiler_session(
+              {.filename = job_profile_filename,
+               .frequency = config.profile_frequency,
+               .on_signal = config.profile_on_signal});
+          ret = compose_metadata(job_config);
+        } catch (const std::exception& e) {
+          spdlog::error("{}", e.what());
+        }
+        if (hisui::report::Reporter::hasInstance()) {
+          hisui::report::Reporter::close();
+        }
+
+        if (ret != EXIT_SUCCESS) {
+          spdlog::error("composing {} failed", job_config.in_metadata_filename);
+          ++number_of_failures;
+        }
+        {
+          std::lock_guard<std::mutex> lock(cpu_sets_mutex);
+          if (!std::empty(job_config.svt_av1_cpus)) {
+            free_cpu_sets.push_back(std::move(job_config.svt_av1_cpus));
+          }
+          if (!std::empty(job_config.job_cpus)) {
+            free_job_cpu_sets.push_back(std::move(job_config.job_cpus));
+          }
+        }
+      });
+
+  spdlog::info("batch finished: total={} failures={}",
+               std::size(metadata_filenames), number_of_failures.load());
+  return number_of_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// コンテナの中では cgroup の制限を超えると警告なく kill されるので,
+// --max-memory が無ければ制限の手前で合成を中止する.
+// /dev/shm に置く faststart の中間ファイルも制限に数えられるので抑える
+static void apply_cgroup_limits(hisui::Config* config) {
+  const auto& limits = hisui::util::get_cgroup_limits();
+  if (!limits.memory) {
+    return;
+  }
+  const std::uint64_t limit_mib = *limits.memory >> 20;
+  if (config->max_memory == 0) {
+    config->max_memory = std::max<std::uint64_t>(1, limit_mib / 10 * 9);
+    spdlog::info("max_memory={} MiB is derived from the cgroup memory limit",
+                 config->max_memory);
+  }
+  config->faststart_memory_limit =
+      std::min(config->faststart_memory_limit, limit_mib / 4);
 }
 
 int main(int argc, char** argv) {
@@ -53,18 +344,11 @@ int main(int argc, char** argv) {
   ::setenv("SVT_LOG", "-2", 1);
   ::setenv("LIBVA_MESSAGING_LEVEL", "0", 1);
 
-#ifdef USE_ONEVPL
-  try {
-    hisui::video::VPLSession::open();
-  } catch (const std::exception& e) {
-    spdlog::debug("failed to open VPL session: {}", e.what());
-  }
-#endif
-
   try {
     hisui::set_cli_options(&app, &config);
 
     CLI11_PARSE(app, argc, argv);
+    config.result_cache_options = hisui::get_result_cache_options(app);
 
     if (config.version) {
       std::cout << "Recording Composition Tool Hisui "
@@ -72,6 +356,26 @@ int main(int argc, char** argv) {
       return EXIT_SUCCESS;
     }
 
+    if (config.log_async) {
+      // キューが溢れた場合は書き出しを待つので, ログは失われない.
+      // 残ったログは終了時に spdlog の registry が書き出す
+      spdlog::init_thread_pool(8192, 1);
+    }
+    if (config.isStdoutOutput()) {
+      // 標準出力は出力ファイルに使うので, ログは標準エラー出力に出す
+      spdlog::set_default_logger(
+          config.log_async
+              ? spdlog::stderr_color_mt<spdlog::async_factory>("stderr")
+              : spdlog::stderr_color_mt("stderr"));
+      config.show_progress_bar = false;
+    } else if (config.log_async) {
+      spdlog::set_default_logger(
+          spdlog::stdout_color_mt<spdlog::async_factory>("async_stdout"));
+    }
+    if (config.progress_interval > 0) {
+      config.show_progress_bar = false;
+    }
+
     if (config.verbose) {
       spdlog::set_level(spdlog::level::debug);
     } else {
@@ -79,27 +383,102 @@ int main(int argc, char** argv) {
     }
     spdlog::debug("log level={}", static_cast<uint32_t>(config.log_level));
 
-    if (!std::empty(config.openh264)) {
-      try {
-        hisui::video::OpenH264Handler::open(config.openh264);
-      } catch (const std::exception& e) {
-        spdlog::warn("failed to open openh264 library: {}", e.what());
-      }
+    if (config.preview) {
+      config.applyPreview();
+      hisui::video::WebMSource::setAlwaysKeyFramesOnly(true);
+    }
+
+    // codec のライブラリとハードウェアは, 合成に必要になった時に初めて開く
+    hisui::video::OpenH264Handler::setLibraryPath(config.openh264);
+    hisui::video::set_codec_probe_cache_file(config.codec_probe_cache_file);
+
+    hisui::webm::input::Demuxer::setIndexCacheDirectory(
+        config.webm_index_cache_directory);
+    // 先読みのスレッドも引き継ぐよう, スレッドを作る前に設定する
+    switch (config.io_priority) {
+      case hisui::config::IOPriority::Default:
+        break;
+      case hisui::config::IOPriority::High:
+        hisui::util::set_io_priority(hisui::util::IOPriorityClass::BestEffort,
+                                     0);
+        break;
+      case hisui::config::IOPriority::Low:
+        hisui::util::set_io_priority(hisui::util::IOPriorityClass::BestEffort,
+                                     7);
+        break;
+      case hisui::config::IOPriority::Idle:
+        hisui::util::set_io_priority(hisui::util::IOPriorityClass::Idle, 0);
+        break;
+    }
+    constexpr double MIB = 1024.0 * 1024.0;
+    hisui::util::ReadBandwidth::setProcessLimit(
+        static_cast<std::uint64_t>(config.read_bandwidth * MIB));
+    hisui::util::ReadBandwidth::setHostLimit(
+        static_cast<std::uint64_t>(config.host_read_bandwidth * MIB),
+        config.host_read_bandwidth_file);
+    hisui::video::SharedFrameCache::setUp(
+        config.shared_frame_cache_file,
+        config.shared_frame_cache_size * static_cast<std::size_t>(MIB));
+    hisui::webm::input::Prefetcher::setNumberOfThreads(config.prefetch_threads);
+    if (config.live) {
+      hisui::webm::input::Demuxer::setLiveIdleTimeout(
+          std::chrono::seconds(config.live_idle_timeout));
+    }
+
+    if (config.huge_pages != hisui::config::HugePages::None) {
+      hisui::util::enable_huge_pages(config.huge_pages ==
+                                     hisui::config::HugePages::Explicit);
     }
 
-    if (config.enabledReport()) {
+    if (config.report_perf_counters && config.enabledReport()) {
+      hisui::util::PerfCounters::enable();
+    }
+    if (config.enabledReport() && !config.isBatch()) {
       hisui::report::Reporter::open();
     }
+
+    apply_cgroup_limits(&config);
   } catch (const std::exception& e) {
     spdlog::error("adjusting configuration failed: {}", e.what());
     return EXIT_FAILURE;
   }
 
+#ifdef USE_TRACE
+  // main() から戻る際に書き出す
+  const hisui::util::trace::Session trace_session(config.trace_filename);
+#endif
+  // --batch では job ごとに書き出す
+  const std::string profile_filename =
+      config.isBatch() ? "" : config.profile_filename;
+  const hisui::util::profiler::Session profiler_session(
+      {.filename = profile_filename,
+       .frequency = config.profile_frequency,
+       .on_signal = config.profile_on_signal});
+
+  if (config.estimate) {
+    // レイアウトの VideoSource はデコーダーを作るので, 先に設定しておく
+    hisui::video::DecoderFactory::setup(config);
+    const auto ret = hisui::estimate(config);
+
+    hisui::close_codec_handlers();
+
+    return ret;
+  }
+
+  if (!std::empty(config.thumbnail_times)) {
+    hisui::video::DecoderFactory::setup(config);
+    const auto ret = hisui::write_thumbnails(config);
+
+    hisui::close_codec_handlers();
+
+    return ret;
+  }
+
   if (!std::empty(config.layout)) {
     hisui::video::DecoderFactory::setup(config);
     auto ret = hisui::layout::compose(config);
 
-    closeHandlersAndSession();
+    hisui::close_codec_handlers();
 
     return ret;
   }
@@ -111,119 +490,56 @@ int main(int argc, char** argv) {
     return EXIT_SUCCESS;
   }
 
-  if (std::empty(config.in_metadata_filename)) {
-    spdlog::error("-f,--in-metadata-file is required");
-    return EXIT_FAILURE;
+  if (config.isConcat()) {
+    try {
+      hisui::webm::concat(config.concat_filenames, config.out_filename,
+                          config.out_hashes);
+    } catch (const std::exception& e) {
+      spdlog::error("concat failed: {}", e.what());
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
   }
 
-  hisui::video::DecoderFactory::setup(config);
-
-  hisui::muxer::Muxer* muxer = nullptr;
-
-  boost::json::string normal_recording_id;
-  try {
-    hisui::MetadataSet metadata_set(
-        hisui::parse_metadata(config.in_metadata_filename));
-
-    if (!config.screen_capture_metadata_filename.empty()) {
-      metadata_set.setPrefered(
-          hisui::parse_metadata(config.screen_capture_metadata_filename));
-    } else if (!config.screen_capture_connection_id.empty()) {
-      metadata_set.split(config.screen_capture_connection_id);
+  if (config.isBatch()) {
+    // 同時に合成する数で CPU を分け合い, スレッドを作りすぎないようにする
+    if (config.batch_pin_cpus && std::empty(config.job_cpus)) {
+      config.job_cpus = hisui::util::get_available_cpus_by_numa_node();
+      spdlog::debug("job_cpus=[{}]", fmt::join(config.job_cpus, ","));
     }
-    normal_recording_id = metadata_set.getNormal().getRecordingID();
-
-    if (config.out_container == hisui::config::OutContainer::WebM) {
-      muxer = new hisui::muxer::AsyncWebMMuxer(
-          config,
-          hisui::muxer::AsyncWebMMuxerParameters{
-              .audio_archive_items = metadata_set.getArchiveItems(),
-              .normal_archives = metadata_set.getNormal().getArchiveItems(),
-              .preferred_archives =
-                  metadata_set.hasPreferred()
-                      ? metadata_set.getPreferred().getArchiveItems()
-                      : std::vector<hisui::ArchiveItem>{},
-              .duration = metadata_set.getMaxStopTimeOffset(),
-          });
-    } else if (config.out_container == hisui::config::OutContainer::MP4) {
-      if (config.mp4_muxer == hisui::config::MP4Muxer::Simple) {
-        muxer = new hisui::muxer::SimpleMP4Muxer(
-            config,
-            hisui::muxer::MP4MuxerParameters{
-                .audio_archive_items = metadata_set.getArchiveItems(),
-                .normal_archives = metadata_set.getNormal().getArchiveItems(),
-                .preferred_archives =
-                    metadata_set.hasPreferred()
-                        ? metadata_set.getPreferred().getArchiveItems()
-                        : std::vector<hisui::ArchiveItem>{},
-                .duration = metadata_set.getMaxStopTimeOffset(),
-            });
-      } else if (config.mp4_muxer == hisui::config::MP4Muxer::Faststart) {
-        muxer = new hisui::muxer::FaststartMP4Muxer(
-            config,
-            hisui::muxer::MP4MuxerParameters{
-                .audio_archive_items = metadata_set.getArchiveItems(),
-                .normal_archives = metadata_set.getNormal().getArchiveItems(),
-                .preferred_archives =
-                    metadata_set.hasPreferred()
-                        ? metadata_set.getPreferred().getArchiveItems()
-                        : std::vector<hisui::ArchiveItem>{},
-                .duration = metadata_set.getMaxStopTimeOffset(),
-            });
-      } else {
-        throw std::runtime_error("config.mp4_muxer is invalid");
-      }
-    } else {
-      throw std::runtime_error("config.out_container is invalid");
+    if (config.job_threads == 0) {
+      const auto number_of_cpus =
+          !std::empty(config.job_cpus)
+              ? static_cast<std::uint32_t>(std::size(config.job_cpus))
+              : hisui::util::get_number_of_usable_cpus();
+      config.job_threads = std::max<std::uint32_t>(
+          1, number_of_cpus / static_cast<std::uint32_t>(config.batch_jobs));
     }
-  } catch (const std::exception& e) {
-    spdlog::error("setting up muxer failed: {}", e.what());
-    return EXIT_FAILURE;
+    spdlog::debug("job_threads={}", config.job_threads);
+    hisui::video::DecoderFactory::setup(config);
+    const auto ret = run_batch(config);
+
+    hisui::close_codec_handlers();
+
+    return ret;
   }
 
-  try {
-    muxer->setUp();
-    muxer->run();
-  } catch (const std::exception& e) {
-    spdlog::error("muxing failed: {}", e.what());
-    try {
-      muxer->cleanUp();
-    } catch (const std::exception& e) {
-      spdlog::error("cleaning up muxer failed: {}", e.what());
-    }
-    if (config.enabledFailureReport()) {
-      try {
-        std::ofstream os(std::filesystem::path(config.failure_report) /
-                         fmt::format("{}_{}_failure.json",
-                                     hisui::datetime::get_current_utc_string(),
-                                     normal_recording_id));
-        os << hisui::report::Reporter::getInstance().makeFailureReport(
-            e.what());
-        hisui::report::Reporter::close();
-      } catch (const std::exception& e) {
-        spdlog::error("reporting(failure) failed: {}", e.what());
-        return EXIT_FAILURE;
-      }
-    }
+  if (std::empty(config.in_metadata_filename)) {
+    spdlog::error("-f,--in-metadata-file is required");
     return EXIT_FAILURE;
   }
-  delete muxer;
-
-  closeHandlersAndSession();
 
-  if (config.enabledSuccessReport()) {
-    try {
-      std::ofstream os(std::filesystem::path(config.success_report) /
-                       fmt::format("{}_{}_success.json",
-                                   hisui::datetime::get_current_utc_string(),
-                                   normal_recording_id));
-      os << hisui::report::Reporter::getInstance().makeSuccessReport();
-      hisui::report::Reporter::close();
-    } catch (const std::exception& e) {
-      spdlog::error("reporting(success) failed: {}", e.what());
-      return EXIT_FAILURE;
-    }
+  hisui::video::DecoderFactory::setup(config);
+  int ret = EXIT_SUCCESS;
+  if (!std::empty(config.mezzanine_sources)) {
+    ret = write_mezzanine_sources(config);
+  } else if (config.enabledCheckpoint()) {
+    ret = compose_with_checkpoints(config);
+  } else {
+    ret = compose_metadata(config);
   }
 
-  return EXIT_SUCCESS;
+  hisui::close_codec_handlers();
+
+  return ret;
 }
@@ -28,29 +28,13 @@ std::shared_ptr<Archive> parse_archive(const std::string& filename) {
   if (!json_path_result.found) {
     throw std::invalid_argument(json_path_result.message);
   }
-  std::ifstream i(json_path_result.path);
-  if (!i.is_open()) {
-    throw std::runtime_error(
-        fmt::format("failed to open metadata json file: {}", filename));
-  }
-  std::string string_json((std::istreambuf_iterator<char>(i)),
-                          std::istreambuf_iterator<char>());
-  boost::json::error_code ec;
-  boost::json::value jv = boost::json::parse(string_json, ec);
-  if (ec) {
-    throw std::runtime_error(fmt::format(
-        "failed to parse metadata json file: message", ec.message()));
-  }
-
-  const auto current_path = std::filesystem::current_path();
-  std::filesystem::current_path(json_path_result.path.parent_path());
-
-  boost::json::object j;
-  if (jv.is_object()) {
-    j = jv.as_object();
-  } else {
+  const auto jv = hisui::util::parse_json_file(json_path_result.path);
+  if (!jv.is_object()) {
     throw std::runtime_error("jv is not object");
   }
+  const auto& j = jv.as_object();
+  // 並列に呼ばれるので current_path は変えず, json ファイルからの相対パスとして解決する
+  const auto base_directory = json_path_result.path.parent_path();
 
   auto connection_id =
       hisui::util::get_string_from_json_object(j, "connection_id");
@@ -60,7 +44,8 @@ std::shared_ptr<Archive> parse_archive(const std::string& filename) {
   // filename から webm ファイルの path を解決する
   auto filename_string =
       hisui::util::get_string_from_json_object(j, "filename");
-  auto filename_result = hisui::util::find_file(std::string(filename_string));
+  auto filename_result = hisui::util::find_file(std::string(filename_string),
+                                                base_directory);
   std::filesystem::path file_path;
   if (filename_result.found) {
     file_path = filename_result.path;
@@ -68,8 +53,8 @@ std::shared_ptr<Archive> parse_archive(const std::string& filename) {
     // filename でうまくいかなかったら file_path から webm ファイルの path を解決する
     auto file_path_string =
         hisui::util::get_string_from_json_object(j, "file_path");
-    auto file_path_result =
-        hisui::util::find_file(std::string(file_path_string));
+    auto file_path_result = hisui::util::find_file(
+        std::string(file_path_string), base_directory);
     if (file_path_result.found) {
       file_path = file_path_result.path;
     } else {
@@ -79,8 +64,6 @@ std::shared_ptr<Archive> parse_archive(const std::string& filename) {
     }
   }
 
-  std::filesystem::current_path(current_path);
-
   return std::make_shared<Archive>(
       ArchiveParameters{.path = json_path_result.path,
                         .file_path = file_path,
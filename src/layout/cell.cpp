@@ -6,13 +6,16 @@
 #include <limits>
 #include <stdexcept>
 
+#include "report/reporter.hpp"
+
 namespace hisui::layout {
 
 Cell::Cell(const CellParameters& params)
     : m_index(params.index),
       m_pos(params.pos),
       m_resolution(params.resolution),
-      m_status(params.status) {
+      m_status(params.status),
+      m_key_frames_only(params.key_frames_only) {
   m_end_time = std::numeric_limits<std::uint64_t>::max();
   if (m_status != CellStatus::Excluded) {
     m_scaler = std::make_shared<hisui::video::PreserveAspectRatioScaler>(
@@ -20,9 +23,27 @@ Cell::Cell(const CellParameters& params)
   }
 }
 
-const std::shared_ptr<hisui::video::YUVImage> Cell::getYUV(
-    const std::uint64_t t) {
-  return m_scaler->scale(m_source->getYUV(t));
+bool Cell::draw(const std::uint64_t t,
+                const std::array<std::uint8_t*, 3>& planes,
+                const std::array<std::uint32_t, 3>& strides,
+                const bool force) {
+  const auto source_image = m_source->getYUV(t)->getView();
+  if (!force && m_source_image_generation != 0 &&
+      source_image.generation == m_source_image_generation) {
+    return false;
+  }
+  hisui::report::ScaleTimer timer(m_source->getCounters());
+  m_scaler->scaleInto(source_image,
+                      {planes[0] + m_pos.y * strides[0] + m_pos.x,
+                       planes[1] + (m_pos.y >> 1) * strides[1] + (m_pos.x >> 1),
+                       planes[2] + (m_pos.y >> 1) * strides[2] + (m_pos.x >> 1)},
+                      strides);
+  m_source_image_generation = source_image.generation;
+  return true;
+}
+
+void Cell::advance(const std::uint64_t t) {
+  m_source->getYUV(t);
 }
 
 bool Cell::hasVideoSourceConnectionID(const std::string& connection_id) {
@@ -40,6 +61,9 @@ bool Cell::hasStatus(const CellStatus status) {
 void Cell::setSource(std::shared_ptr<VideoSource> source) {
   m_status = CellStatus::Used;
   m_source = source;
+  m_source->setDisplaySize(m_resolution);
+  m_source->setKeyFramesOnly(m_key_frames_only);
+  m_source_image_generation = 0;
   m_start_time = source->getMinEncodingTime();
   m_end_time = source->getMaxEncodingTime();
 }
@@ -49,6 +73,11 @@ void Cell::resetSource(const std::uint64_t time) {
     spdlog::debug("reset cell: {}", m_index);
     m_status = CellStatus::Idle;
     m_source = nullptr;
+    m_source_image_generation = 0;
+    // 次に source が割り当てられるまで拡縮用の画像を持たない
+    if (m_scaler) {
+      m_scaler->release();
+    }
     m_start_time = 0;
     m_end_time = std::numeric_limits<std::uint64_t>::max();
   }
@@ -2,6 +2,7 @@
 
 #include <libyuv/scale.h>
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -28,6 +29,8 @@ struct CellParameters {
   const Resolution& resolution;
   const CellStatus status = CellStatus::Fresh;
   const libyuv::FilterMode filter_mode = libyuv::kFilterBox;
+  // 割り当てた source にキーフレームのみをデコードさせる
+  const bool key_frames_only = false;
 };
 
 struct CellInformation {
@@ -46,7 +49,14 @@ class Cell {
   void resetSource(const std::uint64_t);
   std::uint64_t getStartTime() const;
   std::uint64_t getEndTime() const;
-  const std::shared_ptr<hisui::video::YUVImage> getYUV(const std::uint64_t);
+  // source の画像を拡縮して region の画像の cell の位置に直接描く.
+  // force でなく内容が前回描いた時から変わっていなければ, 描かずに false を返す
+  bool draw(const std::uint64_t,
+            const std::array<std::uint8_t*, 3>&,
+            const std::array<std::uint32_t, 3>&,
+            const bool force);
+  // 描画せずにデコードだけを進める. 覆い隠されている間に使う
+  void advance(const std::uint64_t);
   const CellInformation getInformation() const;
 
  private:
@@ -57,9 +67,11 @@ class Cell {
   std::shared_ptr<VideoSource> m_source;
   std::uint64_t m_start_time = 0;
   std::uint64_t m_end_time;
+  bool m_key_frames_only;
 
-  // std::shared_ptr<hisui::video::YUVImage> m_scaled_image;
   std::shared_ptr<hisui::video::PreserveAspectRatioScaler> m_scaler;
+  // 前回描いた元の画像の世代. 0 ならばまだ描いていない
+  std::uint64_t m_source_image_generation = 0;
 };
 
 struct ResetCellsSource {
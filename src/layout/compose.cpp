@@ -1,8 +1,10 @@
 #include "layout/compose.hpp"
 
+#include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
 #include <memory>
+#include <stdexcept>
 
 #include "config.hpp"
 #include "constants.hpp"
@@ -13,6 +15,8 @@
 #include "layout/vpx_video_producer.hpp"
 #include "muxer/async_webm_muxer.hpp"
 #include "muxer/faststart_mp4_muxer.hpp"
+#include "muxer/fragmented_mp4_muxer.hpp"
+#include "muxer/hls_muxer.hpp"
 #include "muxer/muxer.hpp"
 #include "muxer/no_video_producer.hpp"
 #include "muxer/simple_mp4_muxer.hpp"
@@ -33,6 +37,7 @@ int compose(const hisui::Config& t_config) {
   metadata.copyToConfig(&config);
 
   config.validate();
+  const double duration = config.getClipDuration(metadata.getMaxEndTime());
 
   std::shared_ptr<hisui::muxer::Muxer> muxer;
   std::shared_ptr<muxer::VideoProducer> video_producer;
@@ -41,6 +46,14 @@ int compose(const hisui::Config& t_config) {
       video_producer = std::make_shared<muxer::NoVideoProducer>();
     } else {
       if (config.out_video_codec == hisui::config::OutVideoCodec::H264) {
+        const auto resolution = metadata.getResolution();
+        if (resolution.width > MAX_H264_RESOLUTION_LENGTH ||
+            resolution.height > MAX_H264_RESOLUTION_LENGTH) {
+          throw std::runtime_error(fmt::format(
+              "H.264 supports resolution up to {0}x{0}: {1}x{2}",
+              MAX_H264_RESOLUTION_LENGTH, resolution.width,
+              resolution.height));
+        }
         if (config.h264_encoder == hisui::config::H264Encoder::OpenH264) {
           if (!hisui::video::OpenH264Handler::hasInstance()) {
             throw std::runtime_error("OpenH264 library is not loaded");
@@ -48,8 +61,9 @@ int compose(const hisui::Config& t_config) {
           video_producer = std::make_shared<OpenH264VideoProducer>(
               config, OpenH264VideoProducerParameters{
                           .regions = metadata.getRegions(),
+                          .overlays = metadata.getOverlays(),
                           .resolution = metadata.getResolution(),
-                          .duration = metadata.getMaxEndTime(),
+                          .duration = duration,
                           .timescale = config.out_container ==
                                                hisui::config::OutContainer::WebM
                                            ? hisui::Constants::NANO_SECOND
@@ -67,8 +81,9 @@ int compose(const hisui::Config& t_config) {
               config,
               VPLVideoProducerParameters{
                   .regions = metadata.getRegions(),
+                  .overlays = metadata.getOverlays(),
                   .resolution = metadata.getResolution(),
-                  .duration = metadata.getMaxEndTime(),
+                  .duration = duration,
                   .timescale =
                       config.out_container == hisui::config::OutContainer::WebM
                           ? hisui::Constants::NANO_SECOND
@@ -90,8 +105,9 @@ int compose(const hisui::Config& t_config) {
                 config,
                 VPLVideoProducerParameters{
                     .regions = metadata.getRegions(),
+                    .overlays = metadata.getOverlays(),
                     .resolution = metadata.getResolution(),
-                    .duration = metadata.getMaxEndTime(),
+                    .duration = duration,
                     .timescale = config.out_container ==
                                          hisui::config::OutContainer::WebM
                                      ? hisui::Constants::NANO_SECOND
@@ -106,8 +122,9 @@ int compose(const hisui::Config& t_config) {
                 config,
                 OpenH264VideoProducerParameters{
                     .regions = metadata.getRegions(),
+                    .overlays = metadata.getOverlays(),
                     .resolution = metadata.getResolution(),
-                    .duration = metadata.getMaxEndTime(),
+                    .duration = duration,
                     .timescale = config.out_container ==
                                          hisui::config::OutContainer::WebM
                                      ? hisui::Constants::NANO_SECOND
@@ -117,12 +134,30 @@ int compose(const hisui::Config& t_config) {
             throw std::runtime_error("H.264 dncoder is unavailable");
           }
         }
+#ifdef USE_ONEVPL
+      } else if (hisui::video::use_vpl_encoder(config,
+                                               config.out_video_codec)) {
+        video_producer = std::make_shared<VPLVideoProducer>(
+            config,
+            VPLVideoProducerParameters{
+                .regions = metadata.getRegions(),
+                .overlays = metadata.getOverlays(),
+                .resolution = metadata.getResolution(),
+                .duration = duration,
+                .timescale =
+                    config.out_container == hisui::config::OutContainer::WebM
+                        ? hisui::Constants::NANO_SECOND
+                        : 16000,  // TODO(haruyama): 整理する
+            },
+            config.out_video_codec);
+#endif
       } else if (config.out_video_codec == hisui::config::OutVideoCodec::AV1) {
         video_producer = std::make_shared<AV1VideoProducer>(
             config, AV1VideoProducerParameters{
                         .regions = metadata.getRegions(),
+                        .overlays = metadata.getOverlays(),
                         .resolution = metadata.getResolution(),
-                        .duration = metadata.getMaxEndTime(),
+                        .duration = duration,
                         .timescale = config.out_container ==
                                              hisui::config::OutContainer::WebM
                                          ? hisui::Constants::NANO_SECOND
@@ -132,8 +167,9 @@ int compose(const hisui::Config& t_config) {
         video_producer = std::make_shared<VPXVideoProducer>(
             config, VPXVideoProducerParameters{
                         .regions = metadata.getRegions(),
+                        .overlays = metadata.getOverlays(),
                         .resolution = metadata.getResolution(),
-                        .duration = metadata.getMaxEndTime(),
+                        .duration = duration,
                         .timescale = config.out_container ==
                                              hisui::config::OutContainer::WebM
                                          ? hisui::Constants::NANO_SECOND
@@ -154,18 +190,23 @@ int compose(const hisui::Config& t_config) {
           config, hisui::muxer::AsyncWebMMuxerParametersForLayout{
                       .audio_archive_items = audio_archive_items,
                       .video_producer = video_producer,
-                      .duration = metadata.getMaxEndTime()});
+                      .duration = duration});
 
     } else if (config.out_container == hisui::config::OutContainer::MP4) {
       auto params = hisui::muxer::MP4MuxerParametersForLayout{
           .audio_archive_items = audio_archive_items,
           .video_producer = video_producer,
-          .duration = metadata.getMaxEndTime()};
+          .duration = duration};
       if (config.mp4_muxer == hisui::config::MP4Muxer::Simple) {
         muxer = std::make_shared<hisui::muxer::SimpleMP4Muxer>(config, params);
       } else if (config.mp4_muxer == hisui::config::MP4Muxer::Faststart) {
         muxer =
             std::make_shared<hisui::muxer::FaststartMP4Muxer>(config, params);
+      } else if (config.mp4_muxer == hisui::config::MP4Muxer::Fragmented) {
+        muxer =
+            std::make_shared<hisui::muxer::FragmentedMP4Muxer>(config, params);
+      } else if (config.mp4_muxer == hisui::config::MP4Muxer::HLS) {
+        muxer = std::make_shared<hisui::muxer::HLSMuxer>(config, params);
       } else {
         throw std::runtime_error("config.mp4_muxer is invalid");
       }
@@ -1,68 +1,573 @@
 #include "layout/composer.hpp"
 
+#include <libyuv/planar_functions.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 
+#include "layout/degradation_policy.hpp"
+#include "layout/overlay.hpp"
 #include "layout/region.hpp"
+#include "util/allocation_counter.hpp"
+#include "util/thread_pool.hpp"
 #include "video/yuv.hpp"
 
 namespace hisui::layout {
 
+namespace {
+
+constexpr std::size_t MAX_COMPOSED_BUFFERS = 16;
+
+// 内容がこのフレーム数の間変わらなかった region を下地に描く.
+// 動画の region を描き直すたびに下地を作り直さないようにする
+constexpr std::uint64_t MIN_UNCHANGED_FRAMES_FOR_BASE = 30;
+
+// L2 キャッシュの大きさが分からない場合に使う
+constexpr std::size_t DEFAULT_L2_CACHE_SIZE = 1024 * 1024;
+
+// 帯の合成結果が L2 キャッシュの半分に収まる行数. 残りは region の画像を読むのに使う.
+// 色差の行が帯をまたがないよう偶数にする
+std::uint32_t calc_stripe_rows(const Resolution& resolution) {
+  const auto l2_cache_size = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+  const auto cache_size = l2_cache_size > 0
+                              ? static_cast<std::size_t>(l2_cache_size)
+                              : DEFAULT_L2_CACHE_SIZE;
+  // 1 行あたり輝度と色差で幅の 1.5 倍
+  const auto row_size =
+      std::max<std::size_t>(static_cast<std::size_t>(resolution.width) * 3 / 2,
+                            1);
+  const auto rows = std::max<std::size_t>(cache_size / 2 / row_size, 2);
+  return static_cast<std::uint32_t>(std::max<std::size_t>(
+      std::min<std::size_t>(rows, resolution.height + 1) & ~std::size_t{1},
+      2));
+}
+
+// 合成結果の輝度の行 [row_begin, row_end) の帯. 最後の帯は plane の末尾の端数も含む
+struct Stripe {
+  const std::uint32_t row_begin;
+  const std::uint32_t row_end;
+  const bool is_last;
+
+  // plane の行で表した帯と矩形の重なり. 重ならなければ begin >= end
+  std::pair<std::uint32_t, std::uint32_t> clip(
+      const std::size_t plane,
+      const std::uint32_t y,
+      const std::uint32_t height) const {
+    const std::uint32_t shift = plane == 0 ? 0 : 1;
+    const auto begin = std::max(y, row_begin >> shift);
+    const auto end = is_last
+                         ? y + height
+                         : std::min(y + height, (row_end + shift) >> shift);
+    return std::make_pair(begin, end);
+  }
+};
+
+void run_fill_operation(const std::array<unsigned char*, 3>& planes,
+                        const ComposeFillOperation& op,
+                        const Stripe& stripe) {
+  const auto [begin, end] = stripe.clip(op.plane, op.y, op.height);
+  if (begin >= end) {
+    return;
+  }
+  libyuv::SetPlane(
+      planes[op.plane] + static_cast<std::size_t>(begin) * op.stride + op.x,
+      static_cast<int>(op.stride), static_cast<int>(op.width),
+      static_cast<int>(end - begin), op.value);
+}
+
+void run_copy_operation(const std::array<unsigned char*, 3>& planes,
+                        const std::vector<RegionGetYUVResult>& results,
+                        const ComposeCopyOperation& op,
+                        const Stripe& stripe) {
+  const auto [begin, end] = stripe.clip(op.dst_plane, op.dst_y, op.height);
+  if (begin >= end) {
+    return;
+  }
+  const auto& yuv = results[op.region].yuv.planes;
+  const auto src_offset =
+      static_cast<std::size_t>(op.src_y + begin - op.dst_y) * op.src_stride +
+      op.src_x;
+  const auto dst = planes[op.dst_plane] +
+                   static_cast<std::size_t>(begin) * op.dst_stride + op.dst_x;
+  const auto height = static_cast<int>(end - begin);
+  if (op.is_interleaved) {
+    libyuv::MergeUVPlane(yuv[op.src_plane] + src_offset,
+                         static_cast<int>(op.src_stride),
+                         yuv[op.src_plane + 1] + src_offset,
+                         static_cast<int>(op.src_stride), dst,
+                         static_cast<int>(op.dst_stride),
+                         static_cast<int>(op.width), height);
+  } else {
+    libyuv::CopyPlane(yuv[op.src_plane] + src_offset,
+                      static_cast<int>(op.src_stride), dst,
+                      static_cast<int>(op.dst_stride),
+                      static_cast<int>(op.width), height);
+  }
+}
+
+}  // namespace
+
 Composer::Composer(const ComposerParameters& params)
-    : m_regions(params.regions), m_resolution(params.resolution) {
+    : m_regions(params.regions),
+      m_overlays(params.overlays),
+      m_resolution(params.resolution),
+      m_is_nv12(params.nv12),
+      m_stripe_rows(calc_stripe_rows(params.resolution)) {
+  if (params.number_of_threads > 1) {
+    m_thread_pool =
+        hisui::util::get_shared_thread_pool(params.number_of_threads - 1);
+  }
   m_plane_sizes[0] = m_resolution.width * m_resolution.height;
   m_plane_sizes[1] = (m_plane_sizes[0] + 3) >> 2;
   m_plane_sizes[2] = m_plane_sizes[1];
 
-  m_planes[0] = new unsigned char[m_plane_sizes[0]];
-  m_planes[1] = new unsigned char[m_plane_sizes[1]];
-  m_planes[2] = new unsigned char[m_plane_sizes[2]];
-
   m_plane_default_values[0] = 0;
   m_plane_default_values[1] = 128;
   m_plane_default_values[2] = 128;
+
+  for (const auto& region : m_regions) {
+    const auto& interval = region->getEncodingInterval();
+    m_visibility_change_times.push_back(interval.getLower());
+    m_visibility_change_times.push_back(interval.getUpper());
+  }
+  std::sort(std::begin(m_visibility_change_times),
+            std::end(m_visibility_change_times));
+  m_visibility_change_times.erase(
+      std::unique(std::begin(m_visibility_change_times),
+                  std::end(m_visibility_change_times)),
+      std::end(m_visibility_change_times));
+  m_occluders.resize(std::size(m_regions));
+  m_chroma_occluders.resize(std::size(m_regions));
+  m_hidden_regions.resize(std::size(m_regions));
+  m_unchanged_frames.resize(std::size(m_regions));
+  m_results.reserve(std::size(m_regions));
+
+  if (params.degradation_realtime_factor > 0) {
+    m_degradation_policy =
+        std::make_unique<DegradationPolicy>(DegradationPolicyParameters{
+            .regions = m_regions,
+            .target_realtime_factor = params.degradation_realtime_factor,
+            .set_encoder_speed_boost = params.set_encoder_speed_boost});
+  }
 }
 
-void Composer::compose(std::vector<unsigned char>* composed,
-                       const std::uint64_t t) {
-  // 全体を黒塗りする
-  for (std::size_t p = 0; p < 3; ++p) {
-    std::fill_n(m_planes[p], m_plane_sizes[p], m_plane_default_values[p]);
+Composer::~Composer() = default;
+
+// 描画される region の組が変わった時に, 各 region が上の region に覆われる部分を求め直す
+void Composer::updateVisibility(const std::uint64_t t) {
+  const auto number_of_change_times = std::size(m_visibility_change_times);
+  if (m_next_visibility_change >= number_of_change_times ||
+      t < m_visibility_change_times[m_next_visibility_change]) {
+    return;
+  }
+  while (m_next_visibility_change < number_of_change_times &&
+         t >= m_visibility_change_times[m_next_visibility_change]) {
+    ++m_next_visibility_change;
+  }
+  m_is_compiled = false;
+
+  // m_regions は z_pos でソートされている想定なので, 後ろの region ほど上に重なる.
+  // 色差は overlay_yuv_planes() が書き込む範囲で扱う
+  std::vector<hisui::video::PlaneRectangle> above;
+  std::vector<hisui::video::PlaneRectangle> chroma_above;
+  for (std::size_t n = std::size(m_regions); n > 0; --n) {
+    const auto i = n - 1;
+    const auto info = m_regions[i]->getInformation();
+    const hisui::video::PlaneRectangle area{.x = info.pos.x,
+                                            .y = info.pos.y,
+                                            .width = info.resolution.width,
+                                            .height = info.resolution.height};
+    const auto chroma_area = hisui::video::I420Plane<1>::floor(area);
+    auto occluders = hisui::video::clip_rectangles(above, area);
+    auto chroma_occluders =
+        hisui::video::clip_rectangles(chroma_above, chroma_area);
+    if (m_regions[i]->getEncodingInterval().isIn(t)) {
+      above.push_back(area);
+      chroma_above.push_back(chroma_area);
+    }
+    m_hidden_regions[i] =
+        hisui::video::is_covered_by_rectangles(area.width, area.height,
+                                               occluders) &&
+        hisui::video::is_covered_by_rectangles(
+            chroma_area.width, chroma_area.height, chroma_occluders);
+
+    const auto is_same_rectangles = [](const auto& a, const auto& b) {
+      return std::equal(std::begin(a), std::end(a), std::begin(b), std::end(b),
+                        [](const auto& r, const auto& s) {
+                          return r.x == s.x && r.y == s.y &&
+                                 r.width == s.width && r.height == s.height;
+                        });
+    };
+    if (!is_same_rectangles(occluders, m_occluders[i]) ||
+        !is_same_rectangles(chroma_occluders, m_chroma_occluders[i])) {
+      m_regions[i]->setOccluders(occluders, chroma_occluders);
+      m_occluders[i].swap(occluders);
+      m_chroma_occluders[i].swap(chroma_occluders);
+    }
+  }
+}
+
+void Composer::compile(const std::vector<bool>& rendered_regions) {
+  m_fill_operations.clear();
+  m_copy_operations.clear();
+  m_compiled_regions = rendered_regions;
+  m_is_compiled = true;
+  m_is_base_used = false;
+
+  using Chroma = hisui::video::I420Plane<1>;
+  const auto add_fills =
+      [this](const std::size_t plane, const std::uint32_t stride,
+             const std::uint32_t width, const std::uint32_t height,
+             const std::vector<hisui::video::PlaneRectangle>& rectangles,
+             const unsigned char value) {
+        for (const auto& r :
+             hisui::video::get_rectangles_outside(width, height, rectangles)) {
+          m_fill_operations.push_back({.plane = plane,
+                                       .x = r.x,
+                                       .y = r.y,
+                                       .stride = stride,
+                                       .width = r.width,
+                                       .height = r.height,
+                                       .value = value});
+        }
+      };
+  // 幅や高さが奇数の場合に残る plane の末尾
+  const auto add_tail_fill = [this](const std::size_t plane,
+                                    const std::uint32_t stride,
+                                    const std::uint32_t rows,
+                                    const std::size_t size,
+                                    const unsigned char value) {
+    const auto filled = static_cast<std::size_t>(stride) * rows;
+    if (filled < size) {
+      m_fill_operations.push_back(
+          {.plane = plane,
+           .x = 0,
+           .y = rows,
+           .stride = stride,
+           .width = static_cast<std::uint32_t>(size - filled),
+           .height = 1,
+           .value = value});
+    }
+  };
+
+  // 塗る部分は fill_yuv_planes_outside_rectangles() と,
+  // 重ねる部分は overlay_yuv_planes() と同じく色差は半分に切り捨てて扱う
+  std::vector<hisui::video::PlaneRectangle> rectangles;
+  std::vector<hisui::video::PlaneRectangle> chroma_rectangles;
+  for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+    if (rendered_regions[i]) {
+      const auto info = m_regions[i]->getInformation();
+      const hisui::video::PlaneRectangle area{.x = info.pos.x,
+                                              .y = info.pos.y,
+                                              .width = info.resolution.width,
+                                              .height = info.resolution.height};
+      rectangles.push_back(area);
+      const auto chroma_area = Chroma::floor(area);
+      if (m_is_nv12) {
+        // NV12 の色差は U と V を 1 組として, バイト単位の座標で塗る
+        chroma_rectangles.push_back({.x = chroma_area.x * 2,
+                                     .y = chroma_area.y,
+                                     .width = chroma_area.width * 2,
+                                     .height = chroma_area.height});
+      } else {
+        chroma_rectangles.push_back(chroma_area);
+      }
+    }
+  }
+  const auto width = m_resolution.width;
+  const auto height = m_resolution.height;
+  if (m_is_nv12) {
+    add_fills(0, width, width, height, rectangles, 0);
+    add_fills(1, width, Chroma::floor(width) * 2, Chroma::floor(height),
+              chroma_rectangles, Chroma::default_value);
+    add_tail_fill(1, width, Chroma::floor(height),
+                  static_cast<std::size_t>(width) * Chroma::ceil(height),
+                  Chroma::default_value);
+  } else {
+    hisui::video::for_each_i420_plane([&](const auto plane) {
+      using Plane = decltype(plane);
+      const auto p = Plane::index;
+      const auto plane_width = Plane::floor(width);
+      const auto plane_height = Plane::floor(height);
+      add_fills(p, plane_width, plane_width, plane_height,
+                p == 0 ? rectangles : chroma_rectangles, Plane::default_value);
+      add_tail_fill(p, plane_width, plane_height, m_plane_sizes[p],
+                    Plane::default_value);
+    });
   }
 
-  // m_regions は z_pos でソートされている想定
-  for (auto region : m_regions) {
-    auto result = region->getYUV(t);
-    if (!result.is_rendered) {
+  // m_regions は z_pos でソートされている想定. 上の region に覆われる部分は重ねない
+  for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+    if (!rendered_regions[i] || m_hidden_regions[i]) {
       continue;
     }
-    auto yuv_image = result.yuv;
-    auto info = region->getInformation();
-    // 位置と解像度を取得し YUV を重ねる
+    const auto info = m_regions[i]->getInformation();
+    hisui::video::for_each_i420_plane([&](const auto plane) {
+      using Plane = decltype(plane);
+      const auto p = Plane::index;
+      // NV12 の V は U と一緒に写す
+      if (m_is_nv12 && p == 2) {
+        return;
+      }
+      const auto src_stride = Plane::floor(info.resolution.width);
+      const auto dst_stride = m_is_nv12 ? width : Plane::floor(width);
+      const auto x = Plane::floor(info.pos.x);
+      const auto y = Plane::floor(info.pos.y);
+      // 色差を並べる場合は 1 画素が 2 バイトになる
+      const std::uint32_t bytes_per_pixel = m_is_nv12 && p == 1 ? 2 : 1;
+      for (const auto& r : hisui::video::get_rectangles_outside(
+               src_stride, Plane::floor(info.resolution.height),
+               p == 0 ? m_occluders[i] : m_chroma_occluders[i])) {
+        m_copy_operations.push_back({.region = i,
+                                     .src_plane = p,
+                                     .src_x = r.x,
+                                     .src_y = r.y,
+                                     .src_stride = src_stride,
+                                     .dst_plane = p,
+                                     .dst_x = (x + r.x) * bytes_per_pixel,
+                                     .dst_y = y + r.y,
+                                     .dst_stride = dst_stride,
+                                     .width = r.width,
+                                     .height = r.height,
+                                     .is_interleaved = bytes_per_pixel == 2});
+      }
+    });
+  }
+}
+
+// 輝度の行 [row_begin, row_end) とそれに対応する色差の行について,
+// region で覆われない部分を黒塗りし, 上の region に覆われない部分を重ね, overlay を重ねる.
+// 下地を使う場合は, 塗る部分と下地に描いた region の代わりに下地を写す.
+// is_base_kept ならば planes に残っている下地をそのまま使う. row_begin は偶数とする
+void Composer::composeStripe(const std::array<unsigned char*, 3>& planes,
+                             const std::vector<RegionGetYUVResult>& results,
+                             const std::uint32_t row_begin,
+                             const std::uint32_t row_end,
+                             const bool is_base_kept) const {
+  const Stripe stripe{.row_begin = row_begin,
+                      .row_end = row_end,
+                      .is_last = row_end >= m_resolution.height};
+
+  if (!m_is_base_used) {
+    for (const auto& op : m_fill_operations) {
+      run_fill_operation(planes, op, stripe);
+    }
+  } else if (!is_base_kept) {
+    // 帯の行は plane ごとに連続しているので, plane ごとに 1 回ずつ写す
+    const std::array<std::uint32_t, 3> strides = {
+        m_resolution.width,
+        m_is_nv12 ? m_resolution.width
+                  : hisui::video::I420Plane<1>::floor(m_resolution.width),
+        m_is_nv12 ? 0 : hisui::video::I420Plane<2>::floor(m_resolution.width)};
+    const std::array<std::size_t, 3> sizes = {
+        m_plane_sizes[0],
+        m_is_nv12 ? std::size(m_base) - m_plane_sizes[0] : m_plane_sizes[1],
+        m_is_nv12 ? 0 : m_plane_sizes[2]};
+    std::size_t offset = 0;
     for (std::size_t p = 0; p < 3; ++p) {
-      if (p == 0) {
-        hisui::video::overlay_yuv_planes(
-            m_planes[p], yuv_image->yuv[p], m_resolution.width, info.pos.x,
-            info.pos.y, info.resolution.width, info.resolution.height);
-      } else {
-        hisui::video::overlay_yuv_planes(
-            m_planes[p], yuv_image->yuv[p], m_resolution.width >> 1,
-            info.pos.x >> 1, info.pos.y >> 1, info.resolution.width >> 1,
-            info.resolution.height >> 1);
+      const std::uint32_t shift = p == 0 ? 0 : 1;
+      const auto begin_byte = std::min(
+          static_cast<std::size_t>(row_begin >> shift) * strides[p], sizes[p]);
+      const auto end_byte =
+          stripe.is_last
+              ? sizes[p]
+              : std::min(static_cast<std::size_t>((row_end + shift) >> shift) *
+                             strides[p],
+                         sizes[p]);
+      if (begin_byte < end_byte) {
+        std::memcpy(planes[p] + begin_byte, m_base.data() + offset + begin_byte,
+                    end_byte - begin_byte);
       }
+      offset += sizes[p];
+    }
+  }
+  for (const auto& op : m_copy_operations) {
+    if (m_is_base_used && m_base_regions[op.region]) {
+      continue;
+    }
+    run_copy_operation(planes, results, op, stripe);
+  }
+
+  // overlay は変化しないので, region を描き直した時だけ重ね直せばよい
+  for (const auto& overlay : m_overlays) {
+    if (m_is_nv12) {
+      overlay->blendNV12(planes[0], planes[1], m_resolution, row_begin,
+                         row_end);
+    } else {
+      overlay->blend(planes, m_resolution, row_begin, row_end);
     }
   }
-  auto base = 0;
-  for (std::size_t p = 0; p < 3; ++p) {
-    std::copy_n(m_planes[p], m_plane_sizes[p], composed->data() + base);
-    base += m_plane_sizes[p];
+}
+
+// 下地の帯に, 塗る部分と下地に描く region を描く
+void Composer::drawBaseStripe(const std::vector<RegionGetYUVResult>& results,
+                              const std::uint32_t row_begin,
+                              const std::uint32_t row_end) {
+  const Stripe stripe{.row_begin = row_begin,
+                      .row_end = row_end,
+                      .is_last = row_end >= m_resolution.height};
+  auto* base = m_base.data();
+  const std::array<unsigned char*, 3> planes = {
+      base, base + m_plane_sizes[0],
+      base + m_plane_sizes[0] + m_plane_sizes[1]};
+  for (const auto& op : m_fill_operations) {
+    run_fill_operation(planes, op, stripe);
+  }
+  for (const auto& op : m_copy_operations) {
+    if (m_base_regions[op.region]) {
+      run_copy_operation(planes, results, op, stripe);
+    }
+  }
+}
+
+void Composer::forEachStripe(
+    const std::function<void(std::uint32_t, std::uint32_t)>& f) {
+  const auto number_of_stripes =
+      (m_resolution.height + m_stripe_rows - 1) / m_stripe_rows;
+  const auto run = [&](const std::size_t n) {
+    const auto row_begin = static_cast<std::uint32_t>(n) * m_stripe_rows;
+    f(row_begin, std::min(row_begin + m_stripe_rows, m_resolution.height));
+  };
+  if (m_thread_pool && number_of_stripes > 1) {
+    m_thread_pool->parallelFor(number_of_stripes, run);
+  } else {
+    for (std::uint32_t n = 0; n < number_of_stripes; ++n) {
+      run(n);
+    }
+  }
+}
+
+// 十分な間内容が変わっていない region を下地に描く. region の重ねる部分は互いに重ならず,
+// 塗る部分とも重ならないので, z_pos によらず下地に描いた region の上に残りを重ねればよい
+void Composer::updateBase(const std::vector<RegionGetYUVResult>& results,
+                          const std::size_t buffer_size) {
+  auto& base_regions = m_next_base_regions;
+  base_regions.assign(std::size(m_regions), false);
+  bool has_base_region = false;
+  for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+    base_regions[i] = results[i].is_rendered && !m_hidden_regions[i] &&
+                      m_unchanged_frames[i] >= MIN_UNCHANGED_FRAMES_FOR_BASE;
+    has_base_region = has_base_region || base_regions[i];
+  }
+  if (!has_base_region) {
+    m_is_base_used = false;
+    return;
+  }
+  if (m_is_base_used && base_regions == m_base_regions &&
+      std::size(m_base) == buffer_size) {
+    return;
   }
+
+  m_base_regions.swap(base_regions);
+  m_base.resize(buffer_size);
+  forEachStripe([&](const std::uint32_t row_begin,
+                    const std::uint32_t row_end) {
+    drawBaseStripe(results, row_begin, row_end);
+  });
+  m_is_base_used = true;
+  ++m_base_generation;
 }
 
-Composer::~Composer() {
-  for (std::size_t p = 0; p < 3; ++p) {
-    delete[] m_planes[p];
+bool Composer::compose(std::vector<unsigned char>* composed,
+                       const std::uint64_t t) {
+  if (m_degradation_policy) {
+    m_degradation_policy->update(t);
+  }
+  HISUI_ALLOCATION_SCOPE("layout::Composer::compose");
+  updateVisibility(t);
+
+  // デコードを進めるため, 全ての region を毎回描画する
+  auto& results = m_results;
+  results.clear();
+  if (m_thread_pool) {
+    // region 内の cell はそれぞれ別の source を持つので,
+    // 全ての region の cell をまとめて分担する
+    m_cells_to_draw.clear();
+    for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+      m_regions[i]->startRendering(t);
+      const auto n = m_regions[i]->getNumberOfCellsToDraw();
+      for (std::size_t k = 0; k < n; ++k) {
+        m_cells_to_draw.emplace_back(i, k);
+      }
+    }
+    m_thread_pool->parallelFor(
+        std::size(m_cells_to_draw), [this](const std::size_t c) {
+          const auto [i, k] = m_cells_to_draw[c];
+          m_regions[i]->drawCell(k);
+        });
+    for (const auto& region : m_regions) {
+      results.push_back(region->finishRendering());
+    }
+  } else {
+    for (const auto& region : m_regions) {
+      results.push_back(region->getYUV(t));
+    }
+  }
+  for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+    m_unchanged_frames[i] =
+        results[i].is_changed ? 0 : m_unchanged_frames[i] + 1;
+  }
+  const bool is_changed =
+      std::any_of(std::begin(results), std::end(results),
+                  [](const auto& r) { return r.is_changed; });
+  if (is_changed) {
+    ++m_generation;
+  }
+  const bool is_static = m_is_composed && !is_changed;
+  m_is_composed = true;
+
+  // composed が前回描画した時から何も変わっていなければ描画しない
+  // エンコーダーは composed を読むだけなので, その内容は保たれている
+  if (auto it = m_composed_generations.find(composed->data());
+      it != std::end(m_composed_generations) && it->second == m_generation) {
+    return !is_static;
+  }
+
+  auto& rendered_regions = m_rendered_regions;
+  rendered_regions.assign(std::size(m_regions), false);
+  for (std::size_t i = 0; i < std::size(m_regions); ++i) {
+    rendered_regions[i] = results[i].is_rendered;
+  }
+  if (!m_is_compiled || rendered_regions != m_compiled_regions) {
+    compile(rendered_regions);
+  }
+  updateBase(results, std::size(*composed));
+
+  // composed に直接描画する
+  m_planes = {composed->data(), composed->data() + m_plane_sizes[0],
+              composed->data() + m_plane_sizes[0] + m_plane_sizes[1]};
+
+  auto base_it = m_base_generations.find(composed->data());
+  m_is_base_kept = m_is_base_used && std::empty(m_overlays) &&
+                   base_it != std::end(m_base_generations) &&
+                   base_it->second == m_base_generation;
+  // this のみを capture し, std::function が確保せずに保持できるようにする
+  forEachStripe([this](const std::uint32_t row_begin,
+                       const std::uint32_t row_end) {
+    composeStripe(m_planes, m_results, row_begin, row_end, m_is_base_kept);
+  });
+
+  // 使われなくなったバッファの分が溜まり続けないようにする
+  if (std::size(m_composed_generations) > MAX_COMPOSED_BUFFERS) {
+    m_composed_generations.clear();
+    m_base_generations.clear();
+  }
+  m_composed_generations[composed->data()] = m_generation;
+  if (m_is_base_used) {
+    m_base_generations[composed->data()] = m_base_generation;
+  } else {
+    m_base_generations.erase(composed->data());
   }
+  return !is_static;
 }
 
 }  // namespace hisui::layout
@@ -3,32 +3,157 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "layout/cell_util.hpp"
+#include "video/yuv.hpp"
+
+namespace hisui::util {
+
+class ThreadPool;
+
+}
 
 namespace hisui::layout {
 
+class DegradationPolicy;
+class Overlay;
 class Region;
+struct RegionGetYUVResult;
 
 struct ComposerParameters {
   const std::vector<std::shared_ptr<Region>>& regions;
   const Resolution& resolution;
+  // region ごと, cell ごとに並列に描画するスレッドの数
+  const std::size_t number_of_threads = 1;
+  // 全ての region の上に順に重ねる
+  const std::vector<std::shared_ptr<Overlay>> overlays = {};
+  // I420 でなく NV12 で描画する. NV12 を入力とするエンコーダーが変換せずに済む
+  const bool nv12 = false;
+  // 0 より大きければ, 処理速度がこれを下回る間 region の priority に従って品質を落とす
+  const double degradation_realtime_factor = 0;
+  // 品質を落とす最後の段階で, エンコーダーを速くする
+  const std::function<bool(const bool)> set_encoder_speed_boost = {};
+};
+
+// 合成結果のバッファの plane の矩形を value で塗る. x と width はバイト単位
+struct ComposeFillOperation {
+  const std::size_t plane;
+  const std::uint32_t x;
+  const std::uint32_t y;
+  const std::uint32_t stride;
+  const std::uint32_t width;
+  const std::uint32_t height;
+  const unsigned char value;
+};
+
+// region の画像の plane の矩形を, 合成結果のバッファの plane に写す.
+// is_interleaved ならば src_plane とその次の plane を NV12 の色差として並べる.
+// dst_x はバイト単位, width は region の画像の画素単位
+struct ComposeCopyOperation {
+  const std::size_t region;
+  const std::size_t src_plane;
+  const std::uint32_t src_x;
+  const std::uint32_t src_y;
+  const std::uint32_t src_stride;
+  const std::size_t dst_plane;
+  const std::uint32_t dst_x;
+  const std::uint32_t dst_y;
+  const std::uint32_t dst_stride;
+  const std::uint32_t width;
+  const std::uint32_t height;
+  const bool is_interleaved = false;
 };
 
 class Composer {
  public:
   explicit Composer(const ComposerParameters&);
   ~Composer();
-  void compose(std::vector<unsigned char>*, const std::uint64_t);
+  // 前回の呼び出しから合成結果が変わった場合に true を返す
+  bool compose(std::vector<unsigned char>*, const std::uint64_t);
 
  private:
   std::vector<std::shared_ptr<Region>> m_regions;
+  std::vector<std::shared_ptr<Overlay>> m_overlays;
   Resolution m_resolution;
+  bool m_is_nv12;
 
-  std::array<unsigned char*, 3> m_planes;
   std::array<std::size_t, 3> m_plane_sizes;
   std::array<unsigned char, 3> m_plane_default_values;
+
+  std::shared_ptr<hisui::util::ThreadPool> m_thread_pool;
+  // 全 region の描画する cell を (region の index, region 内の k) で並べたもの
+  std::vector<std::pair<std::size_t, std::size_t>> m_cells_to_draw;
+
+  // region の描画の有無が変わりうる時刻を昇順に並べたもの
+  std::vector<std::uint64_t> m_visibility_change_times;
+  std::size_t m_next_visibility_change = 0;
+  // region ごとに, 上に重なって描画される region に覆われる部分.
+  // region の輝度と色差の座標で持つ
+  std::vector<std::vector<hisui::video::PlaneRectangle>> m_occluders;
+  std::vector<std::vector<hisui::video::PlaneRectangle>> m_chroma_occluders;
+  std::vector<bool> m_hidden_regions;
+
+  void updateVisibility(const std::uint64_t);
+
+  // 描画される region の組と覆われる部分から, 塗りとコピーの手順を作る.
+  // それらが変わるまでは, 毎フレーム手順を順に実行するだけで合成できる
+  std::vector<ComposeFillOperation> m_fill_operations;
+  std::vector<ComposeCopyOperation> m_copy_operations;
+  // 手順を作った時に描画されていた region
+  std::vector<bool> m_compiled_regions;
+  bool m_is_compiled = false;
+
+  void compile(const std::vector<bool>&);
+
+  // 合成結果を輝度でこの行数ずつの帯に分け, 帯ごとに塗り, 重ね, overlay を行う.
+  // 帯に書き込む間はその部分がキャッシュに収まる
+  std::uint32_t m_stripe_rows;
+
+  void composeStripe(const std::array<unsigned char*, 3>&,
+                     const std::vector<RegionGetYUVResult>&,
+                     const std::uint32_t,
+                     const std::uint32_t,
+                     const bool) const;
+
+  // 内容が変わらなくなった region と塗る部分を描いておいた下地.
+  // 使う間は, 毎フレーム下地を帯ごとに写し, 残りの region と overlay だけを重ねる
+  std::vector<unsigned char> m_base;
+  // 下地に描いた region
+  std::vector<bool> m_base_regions;
+  bool m_is_base_used = false;
+  // 下地を描き直すたびに増やす
+  std::uint64_t m_base_generation = 0;
+  // overlay が無ければ, 出力先のバッファに残っている下地の部分は写し直さない.
+  // 出力先のバッファごとに, 最後に描画した時の m_base_generation を保持する
+  std::map<const unsigned char*, std::uint64_t> m_base_generations;
+  // region ごとに, 内容が変わらずに続いたフレームの数
+  std::vector<std::uint64_t> m_unchanged_frames;
+
+  void updateBase(const std::vector<RegionGetYUVResult>&, const std::size_t);
+  void drawBaseStripe(const std::vector<RegionGetYUVResult>&,
+                      const std::uint32_t,
+                      const std::uint32_t);
+  void forEachStripe(const std::function<void(std::uint32_t, std::uint32_t)>&);
+
+  // compose() の中でのみ使う. 毎フレーム確保し直さないよう使い回す
+  std::vector<RegionGetYUVResult> m_results;
+  std::vector<bool> m_rendered_regions;
+  std::vector<bool> m_next_base_regions;
+  std::array<unsigned char*, 3> m_planes = {};
+  bool m_is_base_kept = false;
+
+  std::unique_ptr<DegradationPolicy> m_degradation_policy;
+
+  // 合成結果が変わるたびに増やす
+  std::uint64_t m_generation = 0;
+  bool m_is_composed = false;
+  // 出力先のバッファごとに, 最後に描画した時の m_generation を保持する.
+  // パイプライン化した VideoProducer は複数のバッファを順に使い回すため
+  std::map<const unsigned char*, std::uint64_t> m_composed_generations;
 };
 }  // namespace hisui::layout
@@ -0,0 +1,198 @@
+#include "layout/degradation_policy.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <set>
+
+#include "constants.hpp"
+#include "layout/region.hpp"
+#include "layout/video_source.hpp"
+#include "report/reporter.hpp"
+
+namespace hisui::video {
+
+class Source;
+
+}
+
+namespace hisui::layout {
+
+namespace {
+
+// 出力の時刻でこの間隔 (ns) ごとに処理速度を調べ, 1 段階ずつ動かす
+constexpr std::uint64_t CHECK_INTERVAL = 2 * hisui::Constants::NANO_SECOND;
+// 落とすと戻すを繰り返さないよう, 戻す条件には幅を持たせる
+constexpr double RESTORE_MARGIN = 1.5;
+// FrameRate で描き直す頻度 (fps)
+constexpr double DEGRADED_FRAME_RATE = 5;
+// KeyFramesOnly は cell の高さがこれ以下の region のみを対象とする
+constexpr std::uint32_t SMALL_CELL_HEIGHT = 240;
+
+bool is_small_cell(const std::shared_ptr<Region>& region) {
+  const auto height = region->getCellHeight();
+  return height != 0 && height <= SMALL_CELL_HEIGHT;
+}
+
+}  // namespace
+
+std::string degradation_action_to_string(const DegradationAction action) {
+  switch (action) {
+    case DegradationAction::FrameRate:
+      return "frame_rate";
+    case DegradationAction::KeyFramesOnly:
+      return "key_frames_only";
+    case DegradationAction::EncoderSpeed:
+      return "encoder_speed";
+  }
+  return "";
+}
+
+DegradationPolicy::DegradationPolicy(const DegradationPolicyParameters& params)
+    : m_regions(params.regions),
+      m_target_realtime_factor(params.target_realtime_factor),
+      m_set_encoder_speed_boost(params.set_encoder_speed_boost) {
+  std::set<std::int32_t> priorities;
+  for (const auto& r : m_regions) {
+    priorities.insert(r->getPriority());
+  }
+  // 最も高い priority は対象としない
+  if (!std::empty(priorities)) {
+    priorities.erase(std::prev(std::end(priorities)));
+  }
+  for (const auto p : priorities) {
+    m_steps.push_back({.action = DegradationAction::FrameRate, .priority = p});
+  }
+  for (const auto p : priorities) {
+    if (std::any_of(std::begin(m_regions), std::end(m_regions),
+                    [p](const auto& r) {
+                      return r->getPriority() == p && is_small_cell(r);
+                    })) {
+      m_steps.push_back(
+          {.action = DegradationAction::KeyFramesOnly, .priority = p});
+    }
+  }
+  if (m_set_encoder_speed_boost) {
+    m_steps.push_back({.action = DegradationAction::EncoderSpeed});
+  }
+  for (const auto& s : m_steps) {
+    spdlog::debug("degradation step: action={} priority={}",
+                  degradation_action_to_string(s.action), s.priority);
+  }
+}
+
+void DegradationPolicy::update(const std::uint64_t t) {
+  update(t, std::chrono::steady_clock::now());
+}
+
+void DegradationPolicy::update(
+    const std::uint64_t t,
+    const std::chrono::steady_clock::time_point now) {
+  if (std::empty(m_steps)) {
+    return;
+  }
+  if (!m_is_started) {
+    m_is_started = true;
+    m_checked_time = t;
+    m_checked_wall_time = now;
+    return;
+  }
+  if (t < m_checked_time + CHECK_INTERVAL) {
+    return;
+  }
+  const double elapsed =
+      std::chrono::duration<double>(now - m_checked_wall_time).count();
+  const double factor =
+      elapsed > 0 ? static_cast<double>(t - m_checked_time) /
+                        hisui::Constants::NANO_SECOND / elapsed
+                  : std::numeric_limits<double>::infinity();
+  m_checked_time = t;
+  m_checked_wall_time = now;
+
+  if (factor < m_target_realtime_factor && m_level < std::size(m_steps)) {
+    ++m_level;
+    apply(t, factor, true);
+  } else if (factor >= m_target_realtime_factor * RESTORE_MARGIN &&
+             m_level > 0) {
+    --m_level;
+    apply(t, factor, false);
+  }
+}
+
+const std::vector<DegradationStep>& DegradationPolicy::getSteps() const {
+  return m_steps;
+}
+
+std::size_t DegradationPolicy::getLevel() const {
+  return m_level;
+}
+
+// m_level までの段階を全ての region に適用し直し, 直前に動かした段階を記録する
+void DegradationPolicy::apply(const std::uint64_t t,
+                              const double factor,
+                              const bool is_degraded) {
+  // 複数の region に表示する source は, 全ての region で許された場合のみ
+  // キーフレームのみにする
+  std::map<const hisui::video::Source*, bool> key_frames_only_sources;
+  for (const auto& r : m_regions) {
+    bool is_frame_rate_degraded = false;
+    bool is_key_frames_only = false;
+    for (std::size_t i = 0; i < m_level; ++i) {
+      if (m_steps[i].priority != r->getPriority()) {
+        continue;
+      }
+      if (m_steps[i].action == DegradationAction::FrameRate) {
+        is_frame_rate_degraded = true;
+      } else if (m_steps[i].action == DegradationAction::KeyFramesOnly) {
+        is_key_frames_only = is_small_cell(r);
+      }
+    }
+    r->setDegradedFrameRate(is_frame_rate_degraded ? DEGRADED_FRAME_RATE : 0);
+    for (const auto& vs : r->getVideoSources()) {
+      if (const auto source = vs->getSource(); source != nullptr) {
+        const auto [it, is_inserted] =
+            key_frames_only_sources.try_emplace(source, is_key_frames_only);
+        if (!is_inserted) {
+          it->second = it->second && is_key_frames_only;
+        }
+      }
+    }
+  }
+  for (const auto& r : m_regions) {
+    for (const auto& vs : r->getVideoSources()) {
+      if (const auto source = vs->getSource(); source != nullptr) {
+        vs->setDegradedKeyFramesOnly(key_frames_only_sources.at(source));
+      }
+    }
+  }
+
+  // 落とした場合は m_steps[m_level - 1], 戻した場合は m_steps[m_level] を動かした
+  const auto& step = is_degraded ? m_steps[m_level - 1] : m_steps[m_level];
+  if (step.action == DegradationAction::EncoderSpeed) {
+    if (!m_set_encoder_speed_boost(is_degraded) && is_degraded) {
+      spdlog::warn("the encoder does not support speed boost");
+    }
+  }
+
+  spdlog::info(
+      "degradation: time={:.2f} level={} action={} priority={} "
+      "realtime_factor={:.2f}",
+      static_cast<double>(t) / hisui::Constants::NANO_SECOND, m_level,
+      degradation_action_to_string(step.action), step.priority, factor);
+  if (hisui::report::Reporter::hasInstance()) {
+    hisui::report::Reporter::getInstance().registerDegradationChange({
+        .timestamp = t,
+        .level = m_level,
+        .action = degradation_action_to_string(step.action),
+        .priority = step.priority,
+        .realtime_factor = factor,
+    });
+  }
+}
+
+}  // namespace hisui::layout
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hisui::layout {
+
+class Region;
+
+enum class DegradationAction {
+  // region を描き直す頻度を下げる
+  FrameRate,
+  // region の source にキーフレームのみをデコードさせる
+  KeyFramesOnly,
+  // エンコーダーを最も速い設定にする
+  EncoderSpeed,
+};
+
+std::string degradation_action_to_string(const DegradationAction);
+
+struct DegradationStep {
+  const DegradationAction action;
+  // FrameRate と KeyFramesOnly で対象とする region の priority
+  const std::int32_t priority = 0;
+};
+
+struct DegradationPolicyParameters {
+  // prepare() 済みの region
+  const std::vector<std::shared_ptr<Region>>& regions;
+  // 出力の長さを処理にかかった時間で割った値がこれを下回ると品質を落とす
+  const double target_realtime_factor;
+  // エンコーダーを速くする, または戻す. 速くできなければ false を返す
+  const std::function<bool(const bool)> set_encoder_speed_boost = {};
+};
+
+// 合成が実時間に間に合わない間, region の priority の低いものから順に品質を落とす.
+// 最も priority の高い region は落とさない.
+// 段階は, 低い priority から順に描き直す頻度を下げ, 次に小さな cell の source を
+// キーフレームのみのデコードにし, 最後にエンコーダーを速くする.
+// 間に合うようになれば逆の順に 1 段階ずつ戻す
+class DegradationPolicy {
+ public:
+  explicit DegradationPolicy(const DegradationPolicyParameters&);
+
+  DegradationPolicy(const DegradationPolicy&) = delete;
+  DegradationPolicy& operator=(const DegradationPolicy&) = delete;
+
+  // 合成するフレームの時刻 (ns) ごとに呼ぶ
+  void update(const std::uint64_t);
+  // 経過時間を与えるもの. テストで使う
+  void update(const std::uint64_t, const std::chrono::steady_clock::time_point);
+  const std::vector<DegradationStep>& getSteps() const;
+  // 適用している段階の数
+  std::size_t getLevel() const;
+
+ private:
+  std::vector<std::shared_ptr<Region>> m_regions;
+  double m_target_realtime_factor;
+  std::function<bool(const bool)> m_set_encoder_speed_boost;
+  std::vector<DegradationStep> m_steps;
+  std::size_t m_level = 0;
+
+  // 前回判断した時のフレームの時刻と経過時間
+  bool m_is_started = false;
+  std::uint64_t m_checked_time = 0;
+  std::chrono::steady_clock::time_point m_checked_wall_time;
+
+  // is_degraded ならば 1 段階落とした, そうでなければ戻した
+  void apply(const std::uint64_t, const double, const bool is_degraded);
+};
+
+}  // namespace hisui::layout
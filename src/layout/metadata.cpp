@@ -6,9 +6,12 @@
 #include <cstdlib>
 #include <fstream>
 #include <list>
+#include <memory>
 #include <regex>
 #include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <boost/json/array.hpp>
 #include <boost/json/impl/array.hpp>
@@ -24,13 +27,14 @@
 #include "layout/source.hpp"
 #include "util/file.hpp"
 #include "util/json.hpp"
+#include "util/thread_pool.hpp"
 #include "util/wildcard.hpp"
 
 namespace hisui::layout {
 
 void Metadata::parseVideoLayout(
     boost::json::object j,
-    const std::vector<std::string>& fixed_excluded_patterns) {
+    const std::vector<hisui::util::WildcardPattern>& fixed_excluded_patterns) {
   auto key = "video_layout";
   if (!j.contains(key) || j[key].is_null()) {
     return;
@@ -53,12 +57,38 @@ void Metadata::parseVideoLayout(
   }
 }
 
+void Metadata::parseOverlays(boost::json::object j) {
+  auto overlays = hisui::util::get_array_from_json_object_with_default(
+      j, "overlays", boost::json::array());
+  for (const auto& v : overlays) {
+    if (!v.is_object()) {
+      throw std::invalid_argument("overlays contains a non-object value");
+    }
+    auto o = v.as_object();
+    const std::string image(
+        hisui::util::get_string_from_json_object(o, "image"));
+    const Position pos{
+        .x = static_cast<std::uint32_t>(
+            hisui::util::get_double_from_json_object_with_default(o, "x_pos",
+                                                                  0)),
+        .y = static_cast<std::uint32_t>(
+            hisui::util::get_double_from_json_object_with_default(o, "y_pos",
+                                                                  0))};
+    m_overlays.push_back(
+        std::make_shared<Overlay>(OverlayParameters{.file_path = image,
+                                                    .pos = pos}));
+  }
+}
+
 void Metadata::dump() const {
   spdlog::debug("format: {}",
                 m_format == hisui::config::OutContainer::MP4 ? "mp4" : "webm");
   spdlog::debug("bitrate: {}", m_bitrate);
   spdlog::debug("resolution: {}x{}", m_resolution.width, m_resolution.height);
   spdlog::debug("trim: {}", m_trim);
+  spdlog::debug("svt_av1: preset={} tile_rows={} tile_columns={} lookahead={}",
+                m_svt_av1_preset, m_svt_av1_tile_rows, m_svt_av1_tile_columns,
+                m_svt_av1_lookahead);
   spdlog::debug("audio_sources: [{}]",
                 fmt::join(m_audio_source_filenames, ", "));
   spdlog::debug("video_layout");
@@ -66,6 +96,9 @@ void Metadata::dump() const {
     region->dump();
     spdlog::debug("");
   }
+  for (const auto& overlay : m_overlays) {
+    overlay->dump();
+  }
   if (!std::empty(m_audio_archives)) {
     for (const auto& a : m_audio_archives) {
       a->dump();
@@ -117,6 +150,88 @@ Metadata::Metadata(const std::string& file_path,
   }
   m_trim = hisui::util::get_bool_from_json_object_with_default(j, "trim", true);
 
+  // 指定されていない値はコマンドラインの値を使う
+  boost::json::object svt_av1;
+  if (j.contains("svt_av1")) {
+    if (!j["svt_av1"].is_object()) {
+      throw std::invalid_argument("svt_av1 is not object");
+    }
+    svt_av1 = j["svt_av1"].as_object();
+  }
+  const auto get_svt_av1_value = [&svt_av1](const std::string& key,
+                                            const double default_value,
+                                            const double min,
+                                            const double max) {
+    const auto value = hisui::util::get_double_from_json_object_with_default(
+        svt_av1, key, default_value);
+    if (value < min || max < value) {
+      throw std::invalid_argument(
+          fmt::format("svt_av1.{} is invalid: {}", key, value));
+    }
+    return value;
+  };
+  m_svt_av1_preset = static_cast<std::int32_t>(
+      get_svt_av1_value("preset", config.svt_av1_preset, 0, 13));
+  m_svt_av1_tile_rows = static_cast<std::uint32_t>(
+      get_svt_av1_value("tile_rows", config.svt_av1_tile_rows, 0, 6));
+  m_svt_av1_tile_columns = static_cast<std::uint32_t>(
+      get_svt_av1_value("tile_columns", config.svt_av1_tile_columns, 0, 4));
+  m_svt_av1_lookahead = static_cast<std::int32_t>(
+      get_svt_av1_value("lookahead", config.svt_av1_lookahead, -1, 120));
+
+  boost::json::object vpl;
+  if (j.contains("vpl")) {
+    if (!j["vpl"].is_object()) {
+      throw std::invalid_argument("vpl is not object");
+    }
+    vpl = j["vpl"].as_object();
+  }
+  const auto get_vpl_value = [&vpl](const std::string& key,
+                                    const double default_value,
+                                    const double min, const double max) {
+    const auto value = hisui::util::get_double_from_json_object_with_default(
+        vpl, key, default_value);
+    if (value < min || max < value) {
+      throw std::invalid_argument(
+          fmt::format("vpl.{} is invalid: {}", key, value));
+    }
+    return value;
+  };
+  m_vpl_target_usage = static_cast<std::uint32_t>(
+      get_vpl_value("target_usage", config.vpl_target_usage, 1, 7));
+  m_vpl_async_depth = static_cast<std::uint32_t>(
+      get_vpl_value("async_depth", config.vpl_async_depth, 1, 16));
+  m_vpl_low_power = config.vpl_low_power;
+  if (vpl.contains("low_power")) {
+    const auto low_power =
+        hisui::util::get_string_from_json_object(vpl, "low_power");
+    if (low_power == "auto") {
+      m_vpl_low_power = hisui::config::VPLLowPower::Auto;
+    } else if (low_power == "on") {
+      m_vpl_low_power = hisui::config::VPLLowPower::On;
+    } else if (low_power == "off") {
+      m_vpl_low_power = hisui::config::VPLLowPower::Off;
+    } else {
+      throw std::invalid_argument(
+          fmt::format("vpl.low_power is invalid: {}", low_power));
+    }
+  }
+  m_vpl_rate_control = config.vpl_rate_control;
+  if (vpl.contains("rate_control")) {
+    const auto rate_control =
+        hisui::util::get_string_from_json_object(vpl, "rate_control");
+    if (rate_control == "vbr") {
+      m_vpl_rate_control = hisui::config::VPLRateControl::VBR;
+    } else if (rate_control == "cbr") {
+      m_vpl_rate_control = hisui::config::VPLRateControl::CBR;
+    } else if (rate_control == "cqp") {
+      m_vpl_rate_control = hisui::config::VPLRateControl::CQP;
+    } else {
+      throw std::invalid_argument(
+          fmt::format("vpl.rate_control is invalid: {}", rate_control));
+    }
+  }
+
   auto audio_sources = hisui::util::get_array_from_json_object_with_default(
       j, "audio_sources", boost::json::array());
 
@@ -124,7 +239,7 @@ Metadata::Metadata(const std::string& file_path,
   for (const auto& v : audio_sources) {
     if (v.is_string()) {
       auto pattern = std::string(v.as_string());
-      auto filenames = hisui::util::glob(pattern);
+      auto filenames = m_source_glob.glob(pattern);
       if (std::empty(filenames)) {
         throw std::invalid_argument(fmt::format(
             "pattern '{}' in audio_sources is not matched with filenames",
@@ -144,13 +259,10 @@ Metadata::Metadata(const std::string& file_path,
 
   for (const auto& v : audio_sources_excluded) {
     if (v.is_string()) {
-      auto pattern = std::string(v.as_string());
-      auto result = std::remove_if(std::begin(audio_source_filenames),
-                                   std::end(audio_source_filenames),
-                                   [&pattern](const auto& text) {
-                                     return hisui::util::wildcard_match(
-                                         {.text = text, .pattern = pattern});
-                                   });
+      const hisui::util::WildcardPattern pattern(std::string(v.as_string()));
+      auto result = std::remove_if(
+          std::begin(audio_source_filenames), std::end(audio_source_filenames),
+          [&pattern](const auto& text) { return pattern.match(text); });
       audio_source_filenames.erase(result, std::end(audio_source_filenames));
     } else {
       throw std::invalid_argument(fmt::format("{} contains a non-string value",
@@ -158,39 +270,28 @@ Metadata::Metadata(const std::string& file_path,
     }
   }
 
-  std::vector<std::string> fixed_excluded_patterns = {
-      m_path.filename(), "report-*.json", "*.webm"};
+  const std::vector<hisui::util::WildcardPattern> fixed_excluded_patterns = {
+      hisui::util::WildcardPattern(m_path.filename()),
+      hisui::util::WildcardPattern("report-*.json"),
+      hisui::util::WildcardPattern("*.webm")};
 
   for (const auto& pattern : fixed_excluded_patterns) {
-    auto result = std::remove_if(std::begin(audio_source_filenames),
-                                 std::end(audio_source_filenames),
-                                 [&pattern](const auto& text) {
-                                   return hisui::util::wildcard_match(
-                                       {.text = text, .pattern = pattern});
-                                 });
+    auto result = std::remove_if(
+        std::begin(audio_source_filenames), std::end(audio_source_filenames),
+        [&pattern](const auto& text) { return pattern.match(text); });
     audio_source_filenames.erase(result, std::end(audio_source_filenames));
   }
 
   m_audio_source_filenames = audio_source_filenames;
   parseVideoLayout(j, fixed_excluded_patterns);
+  // 画像のパスはレイアウトファイルからの相対パスとする
+  parseOverlays(j);
 }
 
 Metadata parse_metadata(const hisui::Config& config) {
   try {
     auto filename = config.layout;
-    std::ifstream i(filename);
-    if (!i.is_open()) {
-      throw std::runtime_error(
-          fmt::format("failed to open metadata json file: {}", filename));
-    }
-    std::string string_json((std::istreambuf_iterator<char>(i)),
-                            std::istreambuf_iterator<char>());
-    boost::json::error_code ec;
-    boost::json::value jv = boost::json::parse(string_json, ec);
-    if (ec) {
-      throw std::runtime_error(fmt::format(
-          "failed to parse metadata json file: message", ec.message()));
-    }
+    const auto jv = hisui::util::parse_json_file(filename);
 
     Metadata metadata(filename, jv, config);
 
@@ -223,14 +324,14 @@ void Metadata::prepare() {
   if (m_resolution.width < 16) {
     throw std::out_of_range(
         fmt::format("resolution.width({}) is too small", m_resolution.width));
-  } else if (m_resolution.width > 3840) {
+  } else if (m_resolution.width > MAX_RESOLUTION_LENGTH) {
     throw std::out_of_range(
         fmt::format("resolution.width({}) is too large", m_resolution.width));
   }
   if (m_resolution.height < 16) {
     throw std::out_of_range(
         fmt::format("resolution.height({}) is too small", m_resolution.height));
-  } else if (m_resolution.height > 3840) {
+  } else if (m_resolution.height > MAX_RESOLUTION_LENGTH) {
     throw std::out_of_range(
         fmt::format("resolution.height({}) is too large", m_resolution.height));
   }
@@ -248,14 +349,24 @@ void Metadata::prepare() {
   spdlog::debug("processing audio");
 
   std::list<std::vector<Interval>> list_of_trim_intervals;
-  for (const auto& f : m_audio_source_filenames) {
-    try {
-      auto archive = parse_archive(f);
-      m_audio_archives.push_back(archive);
-    } catch (const std::exception& e) {
-      spdlog::error("parsing audio_source({}) failed: {}", f, e.what());
+  std::vector<std::shared_ptr<Archive>> audio_archives(
+      std::size(m_audio_source_filenames));
+  std::vector<std::string> errors(std::size(m_audio_source_filenames));
+  hisui::util::parallel_for(
+      std::size(m_audio_source_filenames), [&](const std::size_t i) {
+        try {
+          audio_archives[i] = parse_archive(m_audio_source_filenames[i]);
+        } catch (const std::exception& e) {
+          errors[i] = e.what();
+        }
+      });
+  for (std::size_t i = 0; i < std::size(m_audio_source_filenames); ++i) {
+    if (!audio_archives[i]) {
+      spdlog::error("parsing audio_source({}) failed: {}",
+                    m_audio_source_filenames[i], errors[i]);
       std::exit(EXIT_FAILURE);
     }
+    m_audio_archives.push_back(audio_archives[i]);
   }
 
   // trim 可能な間隔を audio, video(regions) からそれぞれ算出
@@ -272,7 +383,9 @@ void Metadata::prepare() {
 
   for (const auto& region : m_regions) {
     try {
-      auto result = region->prepare({.resolution = m_resolution});
+      auto result = region->prepare(
+          {.resolution = m_resolution,
+           .video_source_cache = m_video_source_cache});
       list_of_trim_intervals.push_back(result.trim_intervals);
     } catch (const std::exception& e) {
       spdlog::error("preparing region '{}' failed: {}", region->getName(),
@@ -333,7 +446,7 @@ void Metadata::prepare() {
 std::shared_ptr<Region> Metadata::parseRegion(
     const std::string& name,
     boost::json::object jo,
-    const std::vector<std::string>& fixed_excluded_patterns) {
+    const std::vector<hisui::util::WildcardPattern>& fixed_excluded_patterns) {
   auto cells_excluded_array =
       hisui::util::get_array_from_json_object_with_default(
           jo, "cells_excluded", boost::json::array());
@@ -361,7 +474,7 @@ std::shared_ptr<Region> Metadata::parseRegion(
   for (const auto& v : video_sources) {
     if (v.is_string()) {
       auto pattern = std::string(v.as_string());
-      auto filenames = hisui::util::glob(pattern);
+      auto filenames = m_source_glob.glob(pattern);
       if (std::empty(filenames)) {
         throw std::invalid_argument(
             fmt::format("pattern '{}' is not matched with filenames", pattern));
@@ -380,13 +493,10 @@ std::shared_ptr<Region> Metadata::parseRegion(
 
   for (const auto& v : video_sources_excluded) {
     if (v.is_string()) {
-      auto pattern = std::string(v.as_string());
-      auto result = std::remove_if(std::begin(video_source_filenames),
-                                   std::end(video_source_filenames),
-                                   [&pattern](const auto& text) {
-                                     return hisui::util::wildcard_match(
-                                         {.text = text, .pattern = pattern});
-                                   });
+      const hisui::util::WildcardPattern pattern(std::string(v.as_string()));
+      auto result = std::remove_if(
+          std::begin(video_source_filenames), std::end(video_source_filenames),
+          [&pattern](const auto& text) { return pattern.match(text); });
       video_source_filenames.erase(result, std::end(video_source_filenames));
     } else {
       throw std::invalid_argument(fmt::format("{} contains a non-string value",
@@ -395,12 +505,9 @@ std::shared_ptr<Region> Metadata::parseRegion(
   }
 
   for (const auto& pattern : fixed_excluded_patterns) {
-    auto result = std::remove_if(std::begin(video_source_filenames),
-                                 std::end(video_source_filenames),
-                                 [&pattern](const auto& text) {
-                                   return hisui::util::wildcard_match(
-                                       {.text = text, .pattern = pattern});
-                                 });
+    auto result = std::remove_if(
+        std::begin(video_source_filenames), std::end(video_source_filenames),
+        [&pattern](const auto& text) { return pattern.match(text); });
     video_source_filenames.erase(result, std::end(video_source_filenames));
   }
 
@@ -418,6 +525,13 @@ std::shared_ptr<Region> Metadata::parseRegion(
         fmt::format("reuse is invalid: {}", reuse_string));
   }
 
+  const auto frame_rate = hisui::util::get_double_from_json_object_with_default(
+      jo, "frame_rate", 0);
+  if (frame_rate < 0) {
+    throw std::invalid_argument(
+        fmt::format("frame_rate is invalid: {}", frame_rate));
+  }
+
   RegionParameters params{
       .name = name,
       .pos{.x = static_cast<std::uint32_t>(
@@ -445,6 +559,13 @@ std::shared_ptr<Region> Metadata::parseRegion(
       .reuse = reuse,
       .video_source_filenames = video_source_filenames,
       .filter_mode = m_filter_mode,
+      .frame_rate = frame_rate,
+      .key_frames_only_max_cell_height = static_cast<std::uint32_t>(
+          hisui::util::get_double_from_json_object_with_default(
+              jo, "key_frames_only_max_cell_height", 0)),
+      .priority = static_cast<std::int32_t>(
+          hisui::util::get_double_from_json_object_with_default(jo, "priority",
+                                                                0)),
   };
 
   return std::make_shared<Region>(params);
@@ -455,6 +576,14 @@ void Metadata::copyToConfig(hisui::Config* config) const {
   config->out_video_bit_rate = static_cast<std::uint32_t>(m_bitrate);
   config->out_container = m_format;
   config->in_metadata_filename = m_path.string();
+  config->svt_av1_preset = m_svt_av1_preset;
+  config->svt_av1_tile_rows = m_svt_av1_tile_rows;
+  config->svt_av1_tile_columns = m_svt_av1_tile_columns;
+  config->svt_av1_lookahead = m_svt_av1_lookahead;
+  config->vpl_target_usage = m_vpl_target_usage;
+  config->vpl_low_power = m_vpl_low_power;
+  config->vpl_async_depth = m_vpl_async_depth;
+  config->vpl_rate_control = m_vpl_rate_control;
 }
 
 double Metadata::getMaxEndTime() const {
@@ -473,4 +602,8 @@ std::vector<std::shared_ptr<Region>> Metadata::getRegions() const {
   return m_regions;
 }
 
+std::vector<std::shared_ptr<Overlay>> Metadata::getOverlays() const {
+  return m_overlays;
+}
+
 }  // namespace hisui::layout
@@ -2,6 +2,7 @@
 
 #include <libyuv/scale.h>
 
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <string>
@@ -18,10 +19,20 @@
 #include "config.hpp"
 #include "layout/archive.hpp"
 #include "layout/cell_util.hpp"
+#include "layout/overlay.hpp"
 #include "layout/region.hpp"
+#include "layout/video_source.hpp"
+#include "util/file.hpp"
+#include "util/wildcard.hpp"
 
 namespace hisui::layout {
 
+// resolution の幅と高さの最大値. 3840 を超える場合の映像は, エンコーダーが
+// タイルや行に分けて並列にエンコードする
+inline constexpr std::uint32_t MAX_RESOLUTION_LENGTH = 8192;
+// OpenH264 や oneVPL は H.264 のレベルの上限を超える大きさをエンコードできない
+inline constexpr std::uint32_t MAX_H264_RESOLUTION_LENGTH = 3840;
+
 class Metadata {
  public:
   Metadata(const std::string&, const boost::json::value&, const hisui::Config&);
@@ -30,6 +41,7 @@ class Metadata {
   void copyToConfig(hisui::Config*) const;
   double getMaxEndTime() const;
   std::vector<std::shared_ptr<Region>> getRegions() const;
+  std::vector<std::shared_ptr<Overlay>> getOverlays() const;
   Resolution getResolution() const;
   void resetPath() const;
 
@@ -44,6 +56,14 @@ class Metadata {
   hisui::config::OutContainer m_format;
   Resolution m_resolution;
   bool m_trim;
+  std::int32_t m_svt_av1_preset;
+  std::uint32_t m_svt_av1_tile_rows;
+  std::uint32_t m_svt_av1_tile_columns;
+  std::int32_t m_svt_av1_lookahead;
+  std::uint32_t m_vpl_target_usage;
+  hisui::config::VPLLowPower m_vpl_low_power;
+  std::uint32_t m_vpl_async_depth;
+  hisui::config::VPLRateControl m_vpl_rate_control;
   std::filesystem::path m_working_path;
 
   std::vector<std::shared_ptr<Archive>> m_audio_archives;
@@ -51,15 +71,20 @@ class Metadata {
   double m_audio_max_end_time;
   double m_max_end_time;
   std::vector<std::shared_ptr<Region>> m_regions;
+  VideoSourceCache m_video_source_cache;
+  std::vector<std::shared_ptr<Overlay>> m_overlays;
   libyuv::FilterMode m_filter_mode;
+  // audio_sources と video_sources で同じディレクトリを何度も読まないようにする
+  hisui::util::DirectoryGlob m_source_glob;
 
   void parseVideoLayout(
       boost::json::object j,
-      const std::vector<std::string>& fixed_excluded_patterns);
+      const std::vector<hisui::util::WildcardPattern>& fixed_excluded_patterns);
+  void parseOverlays(boost::json::object j);
   std::shared_ptr<Region> parseRegion(
       const std::string& name,
       boost::json::object jo,
-      const std::vector<std::string>& fixed_excluded_patterns);
+      const std::vector<hisui::util::WildcardPattern>& fixed_excluded_patterns);
 };
 
 Metadata parse_metadata(const hisui::Config&);
@@ -0,0 +1,90 @@
+#include "layout/overlay.hpp"
+
+#include <fmt/core.h>
+#include <libyuv/convert.h>
+#include <spdlog/spdlog.h>
+#include <stb_image.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "video/alpha_overlay.hpp"
+#include "video/yuv.hpp"
+
+namespace hisui::layout {
+
+Overlay::Overlay(const OverlayParameters& params)
+    : m_file_path(params.file_path), m_pos(params.pos) {
+  int width, height, comp;
+  unsigned char* data =
+      stbi_load(m_file_path.c_str(), &width, &height, &comp, 4);
+  if (data == nullptr) {
+    throw std::runtime_error(
+        fmt::format("failed to load overlay image: file_path={} reason={}",
+                    m_file_path, stbi_failure_reason()));
+  }
+
+  hisui::video::YUVImage yuv_image(static_cast<std::uint32_t>(width),
+                                   static_cast<std::uint32_t>(height));
+  const auto ret = libyuv::ABGRToI420(
+      data, width * 4, yuv_image.yuv[0],
+      static_cast<int>(yuv_image.getStride(0)), yuv_image.yuv[1],
+      static_cast<int>(yuv_image.getStride(1)), yuv_image.yuv[2],
+      static_cast<int>(yuv_image.getStride(2)), width, height);
+  if (ret != 0) {
+    stbi_image_free(data);
+    throw std::runtime_error(
+        fmt::format("libyuv::ABGRToI420() failed: file_path={}", m_file_path));
+  }
+
+  const auto size = static_cast<std::size_t>(width) *
+                    static_cast<std::size_t>(height);
+  std::vector<std::uint8_t> alpha(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    alpha[i] = data[4 * i + 3];
+  }
+  stbi_image_free(data);
+
+  m_alpha_overlay = std::make_unique<hisui::video::AlphaOverlay>(
+      std::array<const std::uint8_t*, 3>{yuv_image.yuv[0], yuv_image.yuv[1],
+                                         yuv_image.yuv[2]},
+      std::array<std::uint32_t, 3>{yuv_image.getStride(0),
+                                   yuv_image.getStride(1),
+                                   yuv_image.getStride(2)},
+      alpha.data(), static_cast<std::uint32_t>(width),
+      static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height));
+}
+
+Overlay::~Overlay() = default;
+
+void Overlay::blend(const std::array<unsigned char*, 3>& planes,
+                    const Resolution& resolution,
+                    const std::uint32_t row_begin,
+                    const std::uint32_t row_end) const {
+  m_alpha_overlay->blend(planes, resolution.width, resolution.height, m_pos.x,
+                         m_pos.y, row_begin, row_end);
+}
+
+void Overlay::blendNV12(unsigned char* y_plane,
+                        unsigned char* uv_plane,
+                        const Resolution& resolution,
+                        const std::uint32_t row_begin,
+                        const std::uint32_t row_end) const {
+  m_alpha_overlay->blendNV12(y_plane, uv_plane, resolution.width,
+                             resolution.height, m_pos.x, m_pos.y, row_begin,
+                             row_end);
+}
+
+void Overlay::dump() const {
+  spdlog::debug("overlay: image={} pos={}x{} size={}x{} blended_pixels={}",
+                m_file_path, m_pos.x, m_pos.y, m_alpha_overlay->getWidth(),
+                m_alpha_overlay->getHeight(),
+                m_alpha_overlay->getNumberOfBlendedPixels());
+}
+
+}  // namespace hisui::layout
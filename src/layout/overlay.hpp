@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "layout/cell_util.hpp"
+
+namespace hisui::video {
+
+class AlphaOverlay;
+
+}  // namespace hisui::video
+
+namespace hisui::layout {
+
+struct OverlayParameters {
+  const std::string& file_path;
+  const Position& pos;
+};
+
+// 全ての region の上に重ねる透過のある静止画
+class Overlay {
+ public:
+  explicit Overlay(const OverlayParameters&);
+  ~Overlay();
+  // 出力の解像度の I420 の planes の, 輝度の行 [row_begin, row_end) に重ねる
+  void blend(const std::array<unsigned char*, 3>&,
+             const Resolution&,
+             const std::uint32_t row_begin = 0,
+             const std::uint32_t row_end =
+                 std::numeric_limits<std::uint32_t>::max()) const;
+  void blendNV12(unsigned char*,
+                 unsigned char*,
+                 const Resolution&,
+                 const std::uint32_t row_begin = 0,
+                 const std::uint32_t row_end =
+                     std::numeric_limits<std::uint32_t>::max()) const;
+  void dump() const;
+
+ private:
+  std::string m_file_path;
+  Position m_pos;
+  std::unique_ptr<hisui::video::AlphaOverlay> m_alpha_overlay;
+};
+
+}  // namespace hisui::layout
@@ -4,11 +4,21 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "constants.hpp"
 #include "layout/overlap.hpp"
 #include "layout/source.hpp"
+#include "util/thread_pool.hpp"
+#include "video/shared_source.hpp"
+#include "video/webm_source.hpp"
 #include "video/yuv.hpp"
 
 namespace hisui::layout {
@@ -25,6 +35,25 @@ std::int32_t Region::getZPos() const {
   return m_z_pos;
 }
 
+std::int32_t Region::getPriority() const {
+  return m_priority;
+}
+
+std::uint32_t Region::getCellHeight() const {
+  return std::empty(m_cells) ? 0 : m_cell_height;
+}
+
+void Region::setDegradedFrameRate(const double frame_rate) {
+  if (frame_rate <= 0) {
+    m_frame_interval = m_normal_frame_interval;
+    return;
+  }
+  m_frame_interval = std::max(
+      m_normal_frame_interval,
+      static_cast<std::uint64_t>(std::llround(
+          static_cast<double>(hisui::Constants::NANO_SECOND) / frame_rate)));
+}
+
 void Region::validateAndAdjust(const RegionPrepareParameters& params) {
   if (params.resolution.width < m_pos.x) {
     throw std::out_of_range(
@@ -115,17 +144,61 @@ const RegionPrepareResult Region::prepare(
     const RegionPrepareParameters& params) {
   validateAndAdjust(params);
 
-  std::size_t index = 0;
-  for (const auto& f : m_video_source_filenames) {
+  // archive の解析と WebM の解析には時間がかかるので, ソースは並列に作る
+  const auto number_of_sources = std::size(m_video_source_filenames);
+  const std::size_t base_index = std::size(m_video_sources);
+  std::vector<std::shared_ptr<Archive>> archives(number_of_sources);
+  std::vector<std::string> errors(number_of_sources);
+  hisui::util::parallel_for(number_of_sources, [&](const std::size_t i) {
     try {
-      auto archive = parse_archive(f);
-      m_video_sources.push_back(
-          std::make_shared<VideoSource>(archive->getSourceParameters(index++)));
+      archives[i] = parse_archive(m_video_source_filenames[i]);
     } catch (const std::exception& e) {
-      spdlog::error("region {}: parsing video_source({}) failed: {}", m_name, f,
-                    e.what());
+      errors[i] = e.what();
+    }
+  });
+
+  // 他の region や同じ region で既に使うファイルはデコーダーを共有する
+  auto& cache = params.video_source_cache;
+  std::vector<VideoSourceCache::key_type> keys(number_of_sources);
+  std::vector<std::size_t> indices_to_open;
+  for (std::size_t i = 0; i < number_of_sources; ++i) {
+    if (!archives[i]) {
+      continue;
+    }
+    const auto source_params = archives[i]->getSourceParameters(0);
+    keys[i] = {std::filesystem::absolute(source_params.file_path)
+                   .lexically_normal(),
+               source_params.start_time};
+    if (cache.emplace(keys[i], nullptr).second) {
+      indices_to_open.push_back(i);
+    }
+  }
+  std::vector<std::shared_ptr<hisui::video::Source>> opened(
+      std::size(indices_to_open));
+  hisui::util::parallel_for(
+      std::size(indices_to_open), [&](const std::size_t k) {
+        const auto i = indices_to_open[k];
+        try {
+          opened[k] = std::make_shared<hisui::video::SharedSource>(
+              std::make_shared<hisui::video::WebMSource>(
+                  keys[i].first.string()));
+        } catch (const std::exception& e) {
+          errors[i] = e.what();
+        }
+      });
+  for (std::size_t k = 0; k < std::size(indices_to_open); ++k) {
+    cache[keys[indices_to_open[k]]] = opened[k];
+  }
+
+  for (std::size_t i = 0; i < number_of_sources; ++i) {
+    const auto source = archives[i] ? cache[keys[i]] : nullptr;
+    if (!source) {
+      spdlog::error("region {}: parsing video_source({}) failed: {}", m_name,
+                    m_video_source_filenames[i], errors[i]);
       std::exit(EXIT_FAILURE);
     }
+    m_video_sources.push_back(std::make_shared<VideoSource>(
+        archives[i]->getSourceParameters(base_index + i), source));
   }
 
   // 最大に overlap する video の数, trim 可能な interval, 終了時間を算出
@@ -171,6 +244,13 @@ const RegionPrepareResult Region::prepare(
           !(m_resolution.height == params.resolution.height),
   });
 
+  m_cell_height = cell_resolution_and_posiitons.resolution.height;
+  // 小さな cell では動きが目立たないので, キーフレームのみをデコードさせる
+  const bool key_frames_only =
+      m_key_frames_only_max_cell_height != 0 &&
+      cell_resolution_and_posiitons.resolution.height <=
+          m_key_frames_only_max_cell_height;
+
   // cell に情報を詰め m_cells に追加する
   for (std::size_t i = 0; i < m_grid_dimension.rows * m_grid_dimension.columns;
        ++i) {
@@ -188,12 +268,14 @@ const RegionPrepareResult Region::prepare(
                        .pos = cell_resolution_and_posiitons.positions[i],
                        .resolution = cell_resolution_and_posiitons.resolution,
                        .status = status,
-                       .filter_mode = m_filter_mode}));
+                       .filter_mode = m_filter_mode,
+                       .key_frames_only = key_frames_only}));
     auto info = m_cells[i]->getInformation();
     spdlog::debug("    cell[{}]: x: {}, y:{}, w:{}, h:{}", i, info.pos.x,
                   info.pos.y, info.resolution.width, info.resolution.height);
   }
   spdlog::debug("    cell size: {}", std::size(m_cells));
+  m_hidden_cells.assign(std::size(m_cells), false);
 
   // YUV のサイズ
   m_plane_sizes[0] = m_resolution.width * m_resolution.height;
@@ -215,6 +297,11 @@ double Region::getMaxEndTime() const {
   return m_max_end_time;
 }
 
+const std::vector<std::shared_ptr<VideoSource>>& Region::getVideoSources()
+    const {
+  return m_video_sources;
+}
+
 void Region::substructTrimIntervals(const TrimIntervals& params) {
   for (auto s : m_video_sources) {
     s->substructTrimIntervals(params);
@@ -236,10 +323,10 @@ void Region::substructTrimIntervals(const TrimIntervals& params) {
 }
 
 // cells の中の cell に video_source を設定する (設定できない場合もある)
-void set_video_source_to_cells(const SetVideoSourceToCells& params) {
-  auto video_source = params.video_source;
-  auto reuse = params.reuse;
-  auto cells = params.cells;
+bool set_video_source_to_cells(const SetVideoSourceToCells& params) {
+  const auto& video_source = params.video_source;
+  const auto reuse = params.reuse;
+  const auto& cells = params.cells;
 
   // spdlog::debug("show_newest: {} {} {}", reuse, video_source->index,
   //               video_source->encoding_interval.getUpper());
@@ -251,19 +338,19 @@ void set_video_source_to_cells(const SetVideoSourceToCells& params) {
         return cell->hasVideoSourceIndex(video_source->getIndex());
       });
   if (it_index != std::end(cells)) {
-    return;
+    return false;
   }
   auto it_fresh = std::find_if(
       std::begin(cells), std::end(cells),
       [](const auto& cell) { return cell->hasStatus(CellStatus::Fresh); });
   if (it_fresh != std::end(cells)) {
     (*it_fresh)->setSource(video_source);
-    return;
+    return true;
   }
 
   // Reuse が none なら終了
   if (reuse == Reuse::None) {
-    return;
+    return false;
   }
 
   // Idle な cell があればその先頭を利用する
@@ -272,39 +359,29 @@ void set_video_source_to_cells(const SetVideoSourceToCells& params) {
       [](const auto& cell) { return cell->hasStatus(CellStatus::Idle); });
   if (it_idle != std::end(cells)) {
     (*it_idle)->setSource(video_source);
-    return;
+    return true;
   }
 
   // Reuse が show_oldest なら終了
   if (reuse == Reuse::ShowOldest) {
-    return;
+    return false;
   }
 
-  // 開始時間が video_source よりも前の Used Cell を取得する
-  std::vector<std::shared_ptr<Cell>> candidates;
-  std::copy_if(
-      std::begin(cells), std::end(cells), std::back_inserter(candidates),
-      [&video_source](const auto& cell) {
-        return cell->getStartTime() < video_source->getMinEncodingTime();
-      });
-
-  auto size = std::size(candidates);
-  if (size == 0) {
-    return;
-  } else if (size == 1) {
-    candidates[0]->setSource(video_source);
-    return;
+  // 開始時間が video_source よりも前の Used Cell のうち, 終了時刻が最小の cell を選択する.
+  // 毎フレーム呼ばれるので, 候補を別の vector に集めずに 1 度の走査で選ぶ
+  const std::shared_ptr<Cell>* selected = nullptr;
+  for (const auto& cell : cells) {
+    if (cell->getStartTime() < video_source->getMinEncodingTime() &&
+        (selected == nullptr ||
+         cell->getEndTime() < (*selected)->getEndTime())) {
+      selected = &cell;
+    }
   }
-
-  // 終了時刻が最小の cell を選択する
-  auto it_min = std::min_element(std::begin(candidates), std::end(candidates),
-                                 [](const auto& a, const auto& b) {
-                                   return a->getEndTime() < b->getEndTime();
-                                 });
-
-  if (it_min != std::end(cells)) {
-    (*it_min)->setSource(video_source);
+  if (selected == nullptr) {
+    return false;
   }
+  (*selected)->setSource(video_source);
+  return true;
 }
 
 Region::Region(const RegionParameters& params)
@@ -317,7 +394,18 @@ Region::Region(const RegionParameters& params)
       m_cells_excluded(params.cells_excluded),
       m_reuse(params.reuse),
       m_video_source_filenames(params.video_source_filenames),
-      m_filter_mode(params.filter_mode) {}
+      m_filter_mode(params.filter_mode),
+      m_frame_interval(
+          params.frame_rate > 0
+              ? static_cast<std::uint64_t>(std::llround(
+                    static_cast<double>(hisui::Constants::NANO_SECOND) /
+                    params.frame_rate))
+              : 0),
+      m_key_frames_only_max_cell_height(
+          params.key_frames_only_max_cell_height),
+      m_priority(params.priority),
+      m_normal_frame_interval(m_frame_interval),
+      m_video_sources(params.video_sources) {}
 
 void Region::dump() const {
   spdlog::debug("  name: {}", m_name);
@@ -332,6 +420,13 @@ void Region::dump() const {
   spdlog::debug("  reuse: {}", m_reuse == Reuse::None         ? "none"
                                : m_reuse == Reuse::ShowOldest ? "show_oldest"
                                                               : "show_newest");
+  if (m_frame_interval != 0) {
+    spdlog::debug("  frame_interval: {} ns", m_frame_interval);
+  }
+  if (m_key_frames_only_max_cell_height != 0) {
+    spdlog::debug("  key_frames_only_max_cell_height: {}",
+                  m_key_frames_only_max_cell_height);
+  }
   if (!std::empty(m_video_sources)) {
     spdlog::debug("  grid_dimension: {}x{}", m_grid_dimension.columns,
                   m_grid_dimension.rows);
@@ -352,48 +447,198 @@ void Region::setEncodingInterval() {
   for (auto& s : m_video_sources) {
     s->setEncodingInterval(hisui::Constants::NANO_SECOND);
   }
+
+  // cell の割り当ては source が始まるか終わる時にしか変わらない
+  m_assignment_change_times.clear();
+  for (const auto& s : m_video_sources) {
+    m_assignment_change_times.push_back(s->getMinEncodingTime());
+    m_assignment_change_times.push_back(s->getMaxEncodingTime());
+  }
+  std::sort(std::begin(m_assignment_change_times),
+            std::end(m_assignment_change_times));
+  m_assignment_change_times.erase(
+      std::unique(std::begin(m_assignment_change_times),
+                  std::end(m_assignment_change_times)),
+      std::end(m_assignment_change_times));
+  m_next_assignment_change = 0;
+  m_active_video_sources.clear();
+  m_is_assignment_settled = false;
 }
 
 RegionGetYUVResult Region::getYUV(const std::uint64_t t) {
+  startRendering(t);
+  for (std::size_t k = 0; k < std::size(m_cells_to_draw); ++k) {
+    drawCell(k);
+  }
+  return finishRendering();
+}
+
+void Region::startRendering(const std::uint64_t t) {
+  m_rendering_time = t;
+  m_cells_to_draw.clear();
+
+  // 時刻は戻らないので, 割り当てが変わりうる時刻を過ぎた時だけ区間内の source を求め直す.
+  // 区間を過ぎた source が再び表示されることはない
+  const auto number_of_change_times = std::size(m_assignment_change_times);
+  if (m_next_assignment_change < number_of_change_times &&
+      t >= m_assignment_change_times[m_next_assignment_change]) {
+    while (m_next_assignment_change < number_of_change_times &&
+           t >= m_assignment_change_times[m_next_assignment_change]) {
+      ++m_next_assignment_change;
+    }
+    m_active_video_sources.clear();
+    for (const auto& video_source : m_video_sources) {
+      if (t >= video_source->getMaxEncodingTime()) {
+        video_source->release();
+      } else if (video_source->isIn(t)) {
+        m_active_video_sources.push_back(video_source);
+      }
+    }
+    m_is_assignment_settled = false;
+  }
+
   if (!m_encoding_interval.isIn(t)) {
-    return {.is_rendered = false, .yuv = m_yuv_image};
+    m_is_changed = m_is_rendered;
+    m_is_rendered = false;
+    return;
   }
 
-  reset_cells_source({.cells = m_cells, .time = t});
+  // 割り当て直しても変わらなくなれば, 次の時刻まで同じ結果になるので省く
+  bool is_assigned = false;
+  if (!m_is_assignment_settled) {
+    reset_cells_source({.cells = m_cells, .time = t});
+    for (const auto& video_source : m_active_video_sources) {
+      if (set_video_source_to_cells({.video_source = video_source,
+                                     .reuse = m_reuse,
+                                     .cells = m_cells})) {
+        is_assigned = true;
+      }
+    }
+    m_is_assignment_settled = !is_assigned;
+  }
 
-  for (const auto& video_source : m_video_sources) {
-    if (video_source->isIn(t)) {
-      set_video_source_to_cells(
-          {.video_source = video_source, .reuse = m_reuse, .cells = m_cells});
+  const auto number_of_cells = std::size(m_cells);
+  auto& used_cells = m_next_used_cells;
+  used_cells.assign(number_of_cells, false);
+  for (std::size_t i = 0; i < number_of_cells; ++i) {
+    used_cells[i] = m_cells[i]->hasStatus(CellStatus::Used);
+    if (used_cells[i]) {
+      m_cells_to_draw.push_back(i);
     }
   }
 
-  for (std::size_t p = 0; p < 3; ++p) {
-    std::fill_n(m_yuv_image->yuv[p], m_plane_sizes[p],
-                m_plane_default_values[p]);
-  }
-
-  for (auto& cell : m_cells) {
-    if (cell->hasStatus(CellStatus::Used)) {
-      auto yuv_image = cell->getYUV(t);
-      auto info = cell->getInformation();
-      for (std::size_t p = 0; p < 3; ++p) {
-        if (p == 0) {
-          hisui::video::overlay_yuv_planes(
-              m_yuv_image->yuv[p], yuv_image->yuv[p], m_resolution.width,
-              info.pos.x, info.pos.y, info.resolution.width,
-              info.resolution.height);
-        } else {
-          hisui::video::overlay_yuv_planes(
-              m_yuv_image->yuv[p], yuv_image->yuv[p], m_resolution.width >> 1,
-              info.pos.x >> 1, info.pos.y >> 1, info.resolution.width >> 1,
-              info.resolution.height >> 1);
-        }
-      }
+  // 次に描き直す時刻までは, 割り当てと覆われ方が変わらなければ前の画像をそのまま使い,
+  // source のデコードと拡縮を省く. 省いた分のデコードは次に描く時に進める
+  if (m_frame_interval != 0 && m_is_rendered && t < m_next_update_time &&
+      !is_assigned && !m_is_occlusion_changed && used_cells == m_used_cells) {
+    m_cells_to_draw.clear();
+    m_cells_changed.clear();
+    m_is_changed = false;
+    return;
+  }
+  if (m_frame_interval != 0) {
+    m_next_update_time = (t / m_frame_interval + 1) * m_frame_interval;
+  }
+
+  // 前回と Used な cell が同じならば, 内容の変わった cell だけを描き直す
+  m_is_redrawn =
+      !m_is_rendered || used_cells != m_used_cells || m_is_occlusion_changed;
+  m_is_occlusion_changed = false;
+  if (m_is_redrawn && !m_is_hidden) {
+    // Used な cell で覆われない部分だけを塗る
+    auto& rectangles = m_used_cell_rectangles;
+    rectangles.clear();
+    for (const auto i : m_cells_to_draw) {
+      auto info = m_cells[i]->getInformation();
+      rectangles.push_back({.x = info.pos.x,
+                            .y = info.pos.y,
+                            .width = info.resolution.width,
+                            .height = info.resolution.height});
     }
+    hisui::video::fill_yuv_planes_outside_rectangles(
+        m_yuv_image->yuv, m_plane_sizes, m_resolution.width,
+        m_resolution.height, rectangles, m_plane_default_values);
+  }
+
+  m_cells_changed.assign(std::size(m_cells_to_draw), 0);
+  m_is_changed = m_is_redrawn;
+  m_is_rendered = true;
+  m_used_cells.swap(used_cells);
+}
+
+std::size_t Region::getNumberOfCellsToDraw() const {
+  return std::size(m_cells_to_draw);
+}
+
+void Region::drawCell(const std::size_t k) {
+  // fill_yuv_planes_outside_rectangles() と同じく色差の stride は幅の半分とする
+  const std::array<std::uint32_t, 3> strides = {
+      hisui::video::I420Plane<0>::floor(m_resolution.width),
+      hisui::video::I420Plane<1>::floor(m_resolution.width),
+      hisui::video::I420Plane<2>::floor(m_resolution.width)};
+  const auto i = m_cells_to_draw[k];
+  if (m_hidden_cells[i]) {
+    m_cells[i]->advance(m_rendering_time);
+    return;
+  }
+  // デコードを進めるため, 描き直さない場合も draw() は毎回呼ぶ
+  if (m_cells[i]->draw(m_rendering_time, m_yuv_image->yuv, strides,
+                       m_is_redrawn)) {
+    m_cells_changed[k] = 1;
   }
+}
 
-  return {.is_rendered = true, .yuv = m_yuv_image};
+void Region::setOccluders(
+    const std::vector<hisui::video::PlaneRectangle>& occluders,
+    const std::vector<hisui::video::PlaneRectangle>& chroma_occluders) {
+  // 輝度と色差の両方が覆われていなければ, 描かない部分が見えてしまう
+  const auto is_covered = [&occluders, &chroma_occluders](
+                              const hisui::video::PlaneRectangle& area) {
+    return hisui::video::is_covered_by_rectangles(
+               area.width, area.height,
+               hisui::video::clip_rectangles(occluders, area)) &&
+           hisui::video::is_covered_by_rectangles(
+               hisui::video::I420Plane<1>::floor(area.width),
+               hisui::video::I420Plane<1>::floor(area.height),
+               hisui::video::clip_rectangles(
+                   chroma_occluders,
+                   hisui::video::I420Plane<1>::floor(area)));
+  };
+  m_is_hidden = is_covered({.x = 0,
+                            .y = 0,
+                            .width = m_resolution.width,
+                            .height = m_resolution.height});
+  for (std::size_t i = 0; i < std::size(m_cells); ++i) {
+    const auto info = m_cells[i]->getInformation();
+    m_hidden_cells[i] = m_is_hidden ||
+                        is_covered({.x = info.pos.x,
+                                    .y = info.pos.y,
+                                    .width = info.resolution.width,
+                                    .height = info.resolution.height});
+  }
+  m_is_occlusion_changed = true;
+}
+
+const hisui::util::Interval& Region::getEncodingInterval() const {
+  return m_encoding_interval;
+}
+
+RegionGetYUVResult Region::finishRendering() {
+  if (!m_is_rendered) {
+    return {.is_rendered = false,
+            .yuv = m_yuv_image->getView(),
+            .is_changed = m_is_changed};
+  }
+  if (std::find(std::begin(m_cells_changed), std::end(m_cells_changed), 1) !=
+      std::end(m_cells_changed)) {
+    m_is_changed = true;
+  }
+  if (m_is_changed) {
+    m_yuv_image->updateGeneration();
+  }
+  return {.is_rendered = true,
+          .yuv = m_yuv_image->getView(),
+          .is_changed = m_is_changed};
 }
 
 }  // namespace hisui::layout
@@ -2,6 +2,7 @@
 
 #include <libyuv/scale.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -34,10 +35,19 @@ struct RegionParameters {
   const Reuse reuse;
   const std::vector<std::string>& video_source_filenames = {};
   const libyuv::FilterMode filter_mode = libyuv::kFilterBox;
+  // 0 でなければ, この頻度 (fps) でのみ source から新しいフレームを描き, その間は前の画像を使う
+  const double frame_rate = 0;
+  // 0 でなければ, cell の高さがこれ以下の場合に source のキーフレームのみをデコードする
+  const std::uint32_t key_frames_only_max_cell_height = 0;
+  // video_source_filenames に加えて使う, 作成済みの VideoSource
+  const std::vector<std::shared_ptr<VideoSource>>& video_sources = {};
+  // 合成が間に合わない場合は, この値の小さい region から順に品質を落とす
+  const std::int32_t priority = 0;
 };
 
 struct RegionPrepareParameters {
   const Resolution& resolution;
+  VideoSourceCache& video_source_cache;
 };
 
 struct RegionPrepareResult {
@@ -46,7 +56,10 @@ struct RegionPrepareResult {
 
 struct RegionGetYUVResult {
   const bool is_rendered;
-  const std::shared_ptr<hisui::video::YUVImage> yuv;
+  // region が持つ画像の参照. 次の startRendering() まで有効
+  const hisui::video::YUVImageView yuv;
+  // 前回の getYUV() から描画の有無か内容が変わったか
+  const bool is_changed = true;
 };
 
 class Region {
@@ -62,6 +75,25 @@ class Region {
   double getMaxEndTime() const;
   void setEncodingInterval();
   RegionGetYUVResult getYUV(const std::uint64_t);
+  // getYUV() を 3 段階に分けたもの. startRendering() の後,
+  // k < getNumberOfCellsToDraw() について drawCell(k) を呼び,
+  // finishRendering() で結果を得る. 異なる k の drawCell() は並列に呼んでよい
+  void startRendering(const std::uint64_t);
+  std::size_t getNumberOfCellsToDraw() const;
+  void drawCell(const std::size_t);
+  RegionGetYUVResult finishRendering();
+  // 上に重なる region に覆われる部分を, この region の輝度と色差の座標で設定する.
+  // 覆われた cell は描画せずにデコードだけを進める
+  void setOccluders(const std::vector<hisui::video::PlaneRectangle>&,
+                    const std::vector<hisui::video::PlaneRectangle>&);
+  const hisui::util::Interval& getEncodingInterval() const;
+  const std::vector<std::shared_ptr<VideoSource>>& getVideoSources() const;
+  std::int32_t getPriority() const;
+  // prepare() 後の cell の高さ. cell が無ければ 0
+  std::uint32_t getCellHeight() const;
+  // 0 でなければ, frame_rate の指定より低い場合に限り, この頻度 (fps) で描き直す.
+  // 0 ならば frame_rate の指定に戻す
+  void setDegradedFrameRate(const double);
 
  private:
   std::string m_name;
@@ -74,9 +106,16 @@ class Region {
   Reuse m_reuse;
   std::vector<std::string> m_video_source_filenames;
   libyuv::FilterMode m_filter_mode;
+  // 描き直す間隔 (ns). 0 ならば毎フレーム描く
+  std::uint64_t m_frame_interval;
+  std::uint32_t m_key_frames_only_max_cell_height;
+  std::int32_t m_priority;
+  // frame_rate の指定による m_frame_interval
+  std::uint64_t m_normal_frame_interval;
 
   // computed
   GridDimension m_grid_dimension;
+  std::uint32_t m_cell_height = 0;
   std::vector<std::shared_ptr<VideoSource>> m_video_sources;
   std::vector<std::shared_ptr<Cell>> m_cells;
   double m_min_start_time;
@@ -86,6 +125,36 @@ class Region {
   std::shared_ptr<hisui::video::YUVImage> m_yuv_image;
   std::array<std::size_t, 3> m_plane_sizes;
   std::array<unsigned char, 3> m_plane_default_values;
+  bool m_is_rendered = false;
+  // 前回描画した時に Used だった cell
+  std::vector<bool> m_used_cells;
+  // cell の割り当てが変わりうる時刻 (source の開始時刻と終了時刻) を昇順に並べたもの
+  std::vector<std::uint64_t> m_assignment_change_times;
+  std::size_t m_next_assignment_change = 0;
+  // 直近の m_assignment_change_times の区間内にある source
+  std::vector<std::shared_ptr<VideoSource>> m_active_video_sources;
+  // 割り当て直しても変わらないことを確認済みか
+  bool m_is_assignment_settled = false;
+
+  // 上に重なる region に全体が覆われているか
+  bool m_is_hidden = false;
+  // cell ごとに, 上に重なる region に覆われているか
+  std::vector<bool> m_hidden_cells;
+  // 覆われていた部分は描いていないので, 次は全体を描き直す
+  bool m_is_occlusion_changed = false;
+  // m_frame_interval が 0 でない場合に, 次に描き直す時刻
+  std::uint64_t m_next_update_time = 0;
+
+  // startRendering() から finishRendering() までの間の状態
+  std::uint64_t m_rendering_time = 0;
+  bool m_is_redrawn = false;
+  bool m_is_changed = false;
+  // 描画する m_cells の index と, その cell の内容が変わったか
+  std::vector<std::size_t> m_cells_to_draw;
+  std::vector<std::uint8_t> m_cells_changed;
+  // 毎フレーム確保し直さないよう使い回す作業用の領域
+  std::vector<bool> m_next_used_cells;
+  std::vector<hisui::video::PlaneRectangle> m_used_cell_rectangles;
 
   void validateAndAdjust(const RegionPrepareParameters&);
 };
@@ -96,6 +165,7 @@ struct SetVideoSourceToCells {
   const std::vector<std::shared_ptr<Cell>>& cells;
 };
 
-void set_video_source_to_cells(const SetVideoSourceToCells&);
+// video_source を新たに cell に設定した場合に true を返す
+bool set_video_source_to_cells(const SetVideoSourceToCells&);
 
 }  // namespace hisui::layout
@@ -5,6 +5,7 @@
 #include <filesystem>
 #include <string>
 
+#include "report/reporter.hpp"
 #include "util/interval.hpp"
 #include "video/source.hpp"
 #include "video/webm_source.hpp"
@@ -24,11 +25,64 @@ VideoSource::VideoSource(const SourceParameters& params) : Source(params) {
     return;
   }
   m_source = std::make_shared<hisui::video::WebMSource>(m_file_path.string());
+  if (hisui::report::Reporter::hasInstance()) {
+    m_counters = hisui::report::Reporter::getInstance().getDecoderCounters(
+        m_file_path.string());
+  }
+}
+
+VideoSource::VideoSource(const SourceParameters& params,
+                         const std::shared_ptr<hisui::video::Source>& source)
+    : Source(params), m_source(source) {
+  if (hisui::report::Reporter::hasInstance()) {
+    m_counters = hisui::report::Reporter::getInstance().getDecoderCounters(
+        m_file_path.string());
+  }
 }
 
-const std::shared_ptr<hisui::video::YUVImage> VideoSource::getYUV(
+const std::shared_ptr<hisui::video::YUVImage>& VideoSource::getYUV(
     const std::uint64_t t) {
   return m_source->getYUV(m_encoding_interval.getSubstructLower(t));
 }
 
+std::uint32_t VideoSource::getWidth() const {
+  return m_source ? m_source->getWidth() : 0;
+}
+
+std::uint32_t VideoSource::getHeight() const {
+  return m_source ? m_source->getHeight() : 0;
+}
+
+void VideoSource::setDisplaySize(const Resolution& resolution) {
+  if (m_source) {
+    m_source->setDisplaySize(resolution.width, resolution.height);
+  }
+}
+
+void VideoSource::setKeyFramesOnly(const bool key_frames_only) {
+  if (m_source) {
+    m_source->setKeyFramesOnly(key_frames_only);
+  }
+}
+
+void VideoSource::setDegradedKeyFramesOnly(const bool key_frames_only) {
+  if (m_source) {
+    m_source->setDegradedKeyFramesOnly(key_frames_only);
+  }
+}
+
+const hisui::video::Source* VideoSource::getSource() const {
+  return m_source.get();
+}
+
+hisui::report::DecoderCounters* VideoSource::getCounters() const {
+  return m_counters;
+}
+
+void VideoSource::release() {
+  if (m_source) {
+    m_source->release();
+  }
+}
+
 }  // namespace hisui::layout
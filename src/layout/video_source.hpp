@@ -1,8 +1,12 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <utility>
 
+#include "layout/cell_util.hpp"
 #include "layout/source.hpp"
 
 namespace hisui::video {
@@ -12,15 +16,42 @@ class YUVImage;
 
 }  // namespace hisui::video
 
+namespace hisui::report {
+
+struct DecoderCounters;
+
+}  // namespace hisui::report
+
 namespace hisui::layout {
 
+// ファイルと開始時刻が同じ video_source は 1 つの video::Source を使う.
+// region をまたいで使うので Metadata が持つ
+using VideoSourceCache =
+    std::map<std::pair<std::filesystem::path, double>,
+             std::shared_ptr<hisui::video::Source>>;
+
 class VideoSource : public Source {
  public:
   explicit VideoSource(const SourceParameters&);
-  const std::shared_ptr<hisui::video::YUVImage> getYUV(const std::uint64_t);
+  // ファイルを開かずに, 与えられた video::Source から YUV を得る
+  VideoSource(const SourceParameters&,
+              const std::shared_ptr<hisui::video::Source>&);
+  const std::shared_ptr<hisui::video::YUVImage>& getYUV(const std::uint64_t);
+  std::uint32_t getWidth() const;
+  std::uint32_t getHeight() const;
+  // 区間を過ぎた source のデコーダーを解放する
+  void release();
+  void setDisplaySize(const Resolution&);
+  void setKeyFramesOnly(const bool);
+  void setDegradedKeyFramesOnly(const bool);
+  // testing ならば nullptr. 同じ video::Source を使う VideoSource を見分けるのに使う
+  const hisui::video::Source* getSource() const;
+  // Reporter が開かれていなければ nullptr
+  hisui::report::DecoderCounters* getCounters() const;
 
  private:
   std::shared_ptr<hisui::video::Source> m_source;
+  hisui::report::DecoderCounters* m_counters = nullptr;
 };
 
 }  // namespace hisui::layout
@@ -1,12 +1,9 @@
 #include "layout/vpx_video_producer.hpp"
 
-#include <spdlog/spdlog.h>
-
 #include <cstdint>
 #include <vector>
 
 #include <boost/rational.hpp>
-#include <progresscpp/ProgressBar.hpp>
 
 #include "config.hpp"
 #include "layout/metadata.hpp"
@@ -24,7 +21,11 @@ namespace hisui::layout {
 
 VPXVideoProducer::VPXVideoProducer(const hisui::Config& t_config,
                                    const VPXVideoProducerParameters& params)
-    : VideoProducer({.show_progress_bar = t_config.show_progress_bar}),
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .pipeline_depth = t_config.video_pipeline_depth,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}),
       m_resolution(params.resolution) {
   m_frame_rate = t_config.out_video_frame_rate;
   m_duration = params.duration;
@@ -37,7 +38,14 @@ VPXVideoProducer::VPXVideoProducer(const hisui::Config& t_config,
   }
 
   m_layout_composer = std::make_shared<Composer>(ComposerParameters{
-      .regions = params.regions, .resolution = m_resolution});
+      .regions = params.regions,
+      .resolution = m_resolution,
+      .number_of_threads = t_config.getVideoComposeThreads(),
+      .overlays = params.overlays,
+      .degradation_realtime_factor = t_config.degradation_realtime_factor,
+      .set_encoder_speed_boost = [this](const bool is_boosted) {
+        return m_encoder->setSpeedBoost(is_boosted);
+      }});
 
   m_encoder = std::make_shared<hisui::video::BufferVPXEncoder>(
       &m_buffer, vpx_config, params.timescale);
@@ -48,47 +56,11 @@ void VPXVideoProducer::produce() {
     return;
   }
 
-  try {
-    std::vector<unsigned char> raw_image;
-
-    raw_image.resize(m_resolution.width * m_resolution.height * 3 >> 1);
-
-    const std::uint64_t max_time = static_cast<std::uint64_t>(
-        std::ceil(m_duration * hisui::Constants::NANO_SECOND));
-
-    progresscpp::ProgressBar progress_bar(max_time, 60);
-
-    for (std::uint64_t t = 0, step = hisui::Constants::NANO_SECOND *
-                                     m_frame_rate.denominator() /
-                                     m_frame_rate.numerator();
-         t < max_time; t += step) {
-      m_layout_composer->compose(&raw_image, t);
-      {
-        std::lock_guard<std::mutex> lock(m_mutex_buffer);
-        m_encoder->outputImage(raw_image);
-      }
-
-      if (m_show_progress_bar) {
-        progress_bar.setTicks(t);
-        progress_bar.display();
-      }
-    }
-
-    {
-      std::lock_guard<std::mutex> lock(m_mutex_buffer);
-      m_encoder->flush();
-      m_is_finished = true;
-    }
-
-    if (m_show_progress_bar) {
-      progress_bar.setTicks(max_time);
-      progress_bar.done();
-    }
-  } catch (const std::exception& e) {
-    spdlog::error("VideoProducer::produce() failed: what={}", e.what());
-    m_is_finished = true;
-    throw;
-  }
+  produceFrames(m_resolution.width * m_resolution.height * 3 >> 1,
+                [this](std::vector<unsigned char>* raw_image,
+                       const std::uint64_t t) {
+                  return m_layout_composer->compose(raw_image, t);
+                });
 }
 
 std::uint32_t VPXVideoProducer::getWidth() const {
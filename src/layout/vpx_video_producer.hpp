@@ -20,6 +20,7 @@ namespace hisui::layout {
 
 struct VPXVideoProducerParameters {
   const std::vector<std::shared_ptr<Region>>& regions;
+  const std::vector<std::shared_ptr<Overlay>> overlays = {};
   const Resolution& resolution;
   const double duration;
   const std::uint64_t timescale = hisui::Constants::NANO_SECOND;
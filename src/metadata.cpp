@@ -9,7 +9,10 @@
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <limits>
+#include <set>
 #include <stdexcept>
+#include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -23,6 +26,10 @@
 #include <boost/json/value.hpp>
 
 #include "archive_item.hpp"
+#include "layout/interval.hpp"
+#include "layout/overlap.hpp"
+#include "layout/reuse.hpp"
+#include "util/file.hpp"
 #include "util/json.hpp"
 
 namespace hisui {
@@ -79,6 +86,11 @@ Metadata::Metadata(const std::string& file_path, const boost::json::value& jv)
 
   for (const auto& a : archives) {
     std::filesystem::path path(get<0>(a));
+    if (hisui::util::is_url(get<0>(a))) {
+      // オブジェクトストレージなどの URL はそのまま Range リクエストで読む
+      m_archives.push_back(ArchiveItem(path, get<1>(a), get<2>(a), get<3>(a)));
+      continue;
+    }
     if (path.is_relative()) {
       path = std::filesystem::absolute(path);
     }
@@ -164,19 +176,7 @@ boost::json::string Metadata::getRecordingID() const {
 }
 
 Metadata parse_metadata(const std::string& filename) {
-  std::ifstream i(filename);
-  if (!i.is_open()) {
-    throw std::runtime_error(
-        fmt::format("failed to open metadata json file: {}", filename));
-  }
-  std::string string_json((std::istreambuf_iterator<char>(i)),
-                          std::istreambuf_iterator<char>());
-  boost::json::error_code ec;
-  boost::json::value jv = boost::json::parse(string_json, ec);
-  if (ec) {
-    throw std::runtime_error(fmt::format(
-        "failed to parse metadata json file: message: {}", ec.message()));
-  }
+  const auto jv = hisui::util::parse_json_file(filename);
 
   Metadata metadata(filename, jv);
 
@@ -193,6 +193,43 @@ Metadata parse_metadata(const std::string& filename) {
   return metadata;
 }
 
+Metadata parse_metadata(const std::string& filename,
+                        const std::vector<std::string>& following_filenames) {
+  auto metadata = parse_metadata(filename);
+  for (const auto& following_filename : following_filenames) {
+    metadata.append(parse_metadata(following_filename));
+  }
+  return metadata;
+}
+
+void Metadata::append(Metadata following) {
+  following.adjustTimeOffsets(m_max_stop_time_offset);
+  spdlog::debug("{} starts at {}", following.getPath().string(),
+                m_max_stop_time_offset);
+  // ずらした後は全て後ろの録画の方が遅く始まるので, 開始時刻の順のまま並ぶ
+  const auto archives = following.getArchiveItems();
+  m_archives.insert(std::end(m_archives), std::begin(archives),
+                    std::end(archives));
+  setTimeOffsets();
+}
+
+void Metadata::substructTrimIntervals(
+    const std::vector<hisui::layout::Interval>& trim_intervals) {
+  for (auto& archive : m_archives) {
+    double diff = 0;
+    for (const auto& i : trim_intervals) {
+      if (i.end_time > archive.getStartTimeOffset()) {
+        break;
+      }
+      diff += i.end_time - i.start_time;
+    }
+    archive.adjustTimeOffsets(-diff);
+  }
+  m_min_start_time_offset = std::numeric_limits<double>::max();
+  m_max_stop_time_offset = std::numeric_limits<double>::min();
+  setTimeOffsets();
+}
+
 void Metadata::adjustTimeOffsets(double diff) {
   m_min_start_time_offset += diff;
   m_max_stop_time_offset += diff;
@@ -251,6 +288,36 @@ double MetadataSet::getMaxStopTimeOffset() const {
   return m_normal.getMaxStopTimeOffset();
 }
 
+// layout の trim と同じく, 全ての録画が無い区間を除く.
+// 合成しても黒い画像と無音になるだけの区間をデコード, 合成, エンコードせずに済む
+void MetadataSet::trim() {
+  std::vector<hisui::layout::Interval> intervals;
+  for (const auto& archive : getArchiveItems()) {
+    intervals.push_back({.start_time = archive.getStartTimeOffset(),
+                         .end_time = archive.getStopTimeOffset()});
+  }
+  if (std::empty(intervals)) {
+    return;
+  }
+  const auto result = hisui::layout::overlap_intervals(
+      {.intervals = intervals, .reuse = hisui::layout::Reuse::None});
+  // 最後の録画より後の区間は合成しないので除く
+  std::vector<hisui::layout::Interval> trim_intervals;
+  for (const auto& i : result.trim_intervals) {
+    if (i.start_time < result.max_end_time) {
+      spdlog::debug("trim_interval: [{}, {}]", i.start_time, i.end_time);
+      trim_intervals.push_back(i);
+    }
+  }
+  if (std::empty(trim_intervals)) {
+    return;
+  }
+  m_normal.substructTrimIntervals(trim_intervals);
+  if (m_has_preferred) {
+    m_preferred.substructTrimIntervals(trim_intervals);
+  }
+}
+
 void MetadataSet::split(const std::string& connection_id) {
   m_preferred.copyWithoutArchives(m_normal);
   const auto archives = m_normal.deleteArchivesByConnectionID(connection_id);
@@ -263,6 +330,18 @@ void MetadataSet::split(const std::string& connection_id) {
   m_has_preferred = true;
 }
 
+void MetadataSet::removeArchives(const std::set<std::string>& paths) {
+  for (auto* metadata : {&m_normal, &m_preferred}) {
+    std::vector<ArchiveItem> archives;
+    for (const auto& archive : metadata->getArchiveItems()) {
+      if (!paths.contains(archive.getPath().string())) {
+        archives.push_back(archive);
+      }
+    }
+    metadata->setArchives(archives);
+  }
+}
+
 void Metadata::copyWithoutArchives(const Metadata& orig) {
   m_path = orig.getPath();
   m_min_start_time_offset = orig.getMinStartTimeOffset();
@@ -2,6 +2,7 @@
 
 #include <filesystem>
 #include <limits>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,7 @@
 #include <boost/json/value.hpp>
 
 #include "archive_item.hpp"
+#include "layout/interval.hpp"
 
 namespace hisui {
 
@@ -27,9 +29,14 @@ class Metadata {
   boost::json::string getRecordingID() const;
 
   void adjustTimeOffsets(double);
+  // 続きの録画を, この録画が終わった時刻から始まるようにずらして加える
+  void append(Metadata);
   void copyWithoutArchives(const Metadata&);
   void setArchives(const std::vector<ArchiveItem>&);
   std::vector<ArchiveItem> deleteArchivesByConnectionID(const std::string&);
+  // 区間 (秒) を昇順に並べたもの. 区間を除き, 後の録画をその長さだけ前に詰める.
+  // 録画の途中にある区間は扱わない
+  void substructTrimIntervals(const std::vector<hisui::layout::Interval>&);
 
  private:
   boost::json::array prepare(const boost::json::value& jv);
@@ -44,18 +51,24 @@ class Metadata {
 };
 
 Metadata parse_metadata(const std::string&);
+// 最初の録画の後ろに, 続きの録画を順に繋げた 1 つの Metadata を返す
+Metadata parse_metadata(const std::string&, const std::vector<std::string>&);
 
 class MetadataSet {
  public:
   explicit MetadataSet(const Metadata&);
   void setPrefered(const Metadata&);
   void split(const std::string&);
+  // 指定したパスの録画を normal と preferred から除く
+  void removeArchives(const std::set<std::string>&);
   Metadata getNormal() const;
   Metadata getPreferred() const;
   bool hasPreferred() const;
   std::vector<ArchiveItem> getNormalArchives() const;
   std::vector<ArchiveItem> getArchiveItems() const;
   double getMaxStopTimeOffset() const;
+  // normal と preferred のどの録画も無い区間を除き, 後の録画を前に詰める
+  void trim();
 
  private:
   Metadata m_normal;
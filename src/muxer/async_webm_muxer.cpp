@@ -2,25 +2,35 @@
 
 #include <spdlog/spdlog.h>
 
+#include <fmt/core.h>
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
 #include <exception>
 #include <filesystem>
+#include <future>
 #include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "archive_item.hpp"
 #include "audio/opus.hpp"
 #include "config.hpp"
 #include "constants.hpp"
 #include "frame.hpp"
+#include "frame_queue.hpp"
 #include "muxer/audio_producer.hpp"
 #include "muxer/av1_video_producer.hpp"
-#include "muxer/multi_channel_vpx_video_producer.hpp"
+#include "muxer/multi_channel_video_producer.hpp"
 #include "muxer/no_video_producer.hpp"
 #include "muxer/openh264_video_producer.hpp"
 #include "muxer/opus_audio_producer.hpp"
+#include "muxer/remux_video_producer.hpp"
 #include "muxer/video_producer.hpp"
 #include "muxer/vpx_video_producer.hpp"
 #include "report/reporter.hpp"
@@ -33,8 +43,54 @@
 #include "video/vpl_session.hpp"
 #endif
 
+#ifdef USE_VAAPI
+#include "muxer/vaapi_video_producer.hpp"
+#include "video/vaapi_h264_encoder.hpp"
+#endif
+
 namespace hisui::muxer {
 
+namespace {
+
+// foo.webm に対して foo_720p.webm を返す
+std::string get_rendition_filename(const std::string& out_filename,
+                                   const std::uint32_t height) {
+  std::filesystem::path path(out_filename);
+  const auto extension = path.extension().string();
+  path.replace_filename(
+      fmt::format("{}_{}p{}", path.stem().string(), height, extension));
+  return path.string();
+}
+
+// foo.webm に対して foo_<connection_id>.webm を返す
+std::string get_participant_filename(const std::string& out_filename,
+                                     const std::string& connection_id) {
+  std::filesystem::path path(out_filename);
+  const auto extension = path.extension().string();
+  path.replace_filename(
+      fmt::format("{}_{}{}", path.stem().string(), connection_id, extension));
+  return path.string();
+}
+
+hisui::webm::output::ContextParameters make_context_parameters(
+    const hisui::Config& config) {
+  return {.max_cluster_duration_ns = static_cast<std::uint64_t>(std::llround(
+              config.webm_cluster_duration * hisui::Constants::NANO_SECOND)),
+          .max_cluster_size = config.webm_cluster_size << 10,
+          .output_cues = config.webm_cues,
+          .hashes = config.out_hashes};
+}
+
+// WebM の CodecPrivate に入れる映像の extradata
+std::vector<std::uint8_t> get_video_private_data(const hisui::Config& config) {
+  if (config.out_video_codec == hisui::config::OutVideoCodec::AV1) {
+    return {0x81, 0x00, 0x06, 0x00};
+  }
+  return {};
+}
+
+}  // namespace
+
 AsyncWebMMuxer::AsyncWebMMuxer(const hisui::Config& t_config,
                                const AsyncWebMMuxerParameters& params)
     : m_config(t_config),
@@ -52,17 +108,23 @@ AsyncWebMMuxer::AsyncWebMMuxer(const hisui::Config& t_config,
 }
 
 void AsyncWebMMuxer::setUp() {
-  if (m_config.out_filename == "") {
-    std::filesystem::path metadata_path(m_config.in_metadata_filename);
-    if (m_config.audio_only) {
-      m_config.out_filename = metadata_path.replace_extension(".weba");
-    } else {
-      m_config.out_filename = metadata_path.replace_extension(".webm");
-    }
-  }
+  m_config.out_filename = m_config.getOutFilename();
+
+  // 音声の入力の読み込みとエンコーダーの作成は映像と独立しているので,
+  // 出力ファイルの作成や映像のエンコーダーの初期化と並行して行う.
+  // part には音声を入れない. 音声は --audio-only で 1 回だけ合成して --concat で結合する.
+  // part ごとに Opus をエンコードすると, 継ぎ目ごとに pre-skip が入ってしまう
+  auto audio_producer_future = std::async(
+      std::launch::async,
+      [config = m_config,
+       archives = m_config.isVideoPart() ? std::vector<hisui::ArchiveItem>{}
+                                         : m_audio_archives,
+       duration = m_config.isVideoPart() ? 0.0 : m_duration] {
+        return std::make_shared<OpusAudioProducer>(config, archives, duration);
+      });
 
-  m_context =
-      std::make_unique<hisui::webm::output::Context>(m_config.out_filename);
+  m_context = std::make_unique<hisui::webm::output::Context>(
+      m_config.out_filename, make_context_parameters(m_config));
   m_context->init();
 
   if (!m_video_producer) {
@@ -76,8 +138,12 @@ void AsyncWebMMuxer::setUp() {
       }
 
       if (!std::empty(m_preferred_archives)) {
-        m_video_producer = std::make_shared<MultiChannelVPXVideoProducer>(
-            m_config, MultiChannelVPXVideoProducerParameters{
+        if (m_config.isVideoPart()) {
+          throw std::runtime_error(
+              "--video-part-count is not supported with screen capture");
+        }
+        m_video_producer = std::make_shared<MultiChannelVideoProducer>(
+            m_config, MultiChannelVideoProducerParameters{
                           .normal_archives = m_normal_archives,
                           .preferred_archives = m_preferred_archives,
                           .duration = m_duration,
@@ -90,53 +156,160 @@ void AsyncWebMMuxer::setUp() {
 
   if (!m_config.audio_only) {
     setVideoTrack();
+    if (!std::empty(m_config.video_ladder_heights) ||
+        m_config.participant_outputs) {
+      setUpRenditions();
+    }
   }
 
-  auto audio_producer = std::make_shared<OpusAudioProducer>(
-      m_config, m_audio_archives, m_duration);
-  const auto skip = audio_producer->getSkip();
+  const auto audio_producer = audio_producer_future.get();
   m_audio_producer = audio_producer;
+  if (!m_config.isVideoPart()) {
+    const auto skip = audio_producer->getSkip();
 
-  const auto private_data =
-      hisui::audio::create_opus_private_data({.skip = skip});
+    const auto private_data =
+        hisui::audio::create_opus_private_data(
+            {.skip = skip, .sample_rate = m_config.out_audio_sample_rate});
 
-  m_context->setAudioTrack(static_cast<std::uint64_t>(skip) *
-                               hisui::Constants::NANO_SECOND /
-                               hisui::Constants::PCM_SAMPLE_RATE,
-                           private_data.data(), std::size(private_data));
+    const auto codec_delay = static_cast<std::uint64_t>(skip) *
+                             hisui::Constants::NANO_SECOND /
+                             hisui::Constants::PCM_SAMPLE_RATE;
+    m_context->setAudioTrack(codec_delay, private_data.data(),
+                             std::size(private_data));
+
+    // 音声のエンコード結果をそのまま使うので, 合成とエンコードは 1 回で済む
+    if (!m_config.audio_only && m_config.out_audio_only_filename != "") {
+      m_audio_only_context = std::make_unique<hisui::webm::output::Context>(
+          m_config.out_audio_only_filename, make_context_parameters(m_config));
+      m_audio_only_context->init();
+      m_audio_only_context->setAudioTrack(codec_delay, private_data.data(),
+                                          std::size(private_data));
+    }
+
+    if (m_config.participant_audio_outputs) {
+      setUpParticipantAudio();
+    }
+
+    if (m_config.out_packet_ring_filename != "") {
+      setUpPacketRing({std::begin(private_data), std::end(private_data)});
+    }
+  }
 
   if (hisui::report::Reporter::hasInstance()) {
     hisui::report::Reporter::getInstance().registerOutput({
         .container = "WebM",
         .video_codec = getVideoCodecName(m_config),
-        .audio_codec = "opus",
+        .audio_codec = m_config.isVideoPart() ? "none" : "opus",
         .duration = m_duration,
     });
   }
 }
 
 void AsyncWebMMuxer::appendAudio(hisui::Frame frame) {
-  m_context->addAudioFrame(frame.data, frame.data_size, frame.timestamp);
-  delete[] frame.data;
+  if (m_config.isVideoPart()) {
+    m_audio_producer->bufferPop();
+    return;
+  }
+  m_context->addAudioFrame(frame.data.get(), frame.data_size, frame.timestamp);
+  if (m_packet_ring) {
+    m_packet_ring->addAudioFrame(frame);
+  }
+  if (m_audio_only_context) {
+    m_audio_only_context->addAudioFrame(frame.data.get(), frame.data_size,
+                                        frame.timestamp);
+  }
   m_audio_producer->bufferPop();
 }
 
 void AsyncWebMMuxer::appendVideo(hisui::Frame frame) {
-  m_context->addVideoFrame(frame.data, frame.data_size, frame.timestamp,
+  m_context->addVideoFrame(frame.data.get(), frame.data_size, frame.timestamp,
                            frame.is_key);
-  delete[] frame.data;
+  if (m_packet_ring) {
+    m_packet_ring->addVideoFrame(frame);
+  }
   m_video_producer->bufferPop();
 }
 
 void AsyncWebMMuxer::run() {
-  mux();
+  std::vector<std::future<void>> futures;
+  for (std::size_t i = 0; i < std::size(m_renditions); ++i) {
+    futures.push_back(std::async(
+        std::launch::async, [buffer = m_renditions[i].buffer,
+                             context = m_rendition_contexts[i].get()] {
+          try {
+            while (const auto frame = buffer->waitFront()) {
+              context->addVideoFrame(frame->data.get(), frame->data_size,
+                                     frame->timestamp, frame->is_key);
+              buffer->pop();
+            }
+          } catch (...) {
+            // エンコーダーが書き込む際に失敗させて, 処理全体を止める
+            buffer->abort();
+            throw;
+          }
+        }));
+  }
+
+  for (std::size_t i = 0; i < std::size(m_participant_audio_producers); ++i) {
+    futures.push_back(std::async(
+        std::launch::async,
+        [producer = m_participant_audio_producers[i],
+         context = m_participant_audio_contexts[i].get(),
+         start_time = m_config.clip_start] {
+          producer->setStartTime(start_time);
+          auto produce_future = std::async(std::launch::async,
+                                           &AudioProducer::produce, producer);
+          try {
+            while (const auto frame = producer->waitBufferFront()) {
+              context->addAudioFrame(frame->data.get(), frame->data_size,
+                                     frame->timestamp);
+              producer->bufferPop();
+            }
+          } catch (...) {
+            producer->abort();
+            produce_future.wait();
+            throw;
+          }
+          produce_future.get();
+        }));
+  }
+
+  try {
+    mux({.progress_interval = m_config.progress_interval,
+         .duration = m_duration,
+         .start_time = m_config.clip_start,
+         .max_memory = m_config.max_memory << 20});
+  } catch (...) {
+    for (auto& r : m_renditions) {
+      r.buffer->abort();
+    }
+    for (auto& p : m_participant_audio_producers) {
+      p->abort();
+    }
+    throw;
+  }
+  for (auto& f : futures) {
+    f.get();
+  }
 }
 
-void AsyncWebMMuxer::cleanUp() {}
+void AsyncWebMMuxer::cleanUp() {
+  if (m_packet_ring) {
+    m_packet_ring->fail();
+  }
+}
 
-void AsyncWebMMuxer::muxFinalize() {}
+void AsyncWebMMuxer::muxFinalize() {
+  if (m_packet_ring) {
+    m_packet_ring->finish();
+  }
+}
 
 std::shared_ptr<VideoProducer> AsyncWebMMuxer::makeVideoProducer() {
+  if (auto producer = make_remux_video_producer(m_config, m_normal_archives,
+                                                m_duration)) {
+    return producer;
+  }
   if (m_config.out_video_codec == hisui::config::OutVideoCodec::H264) {
     if (m_config.h264_encoder == hisui::config::H264Encoder::OpenH264) {
       if (!hisui::video::OpenH264Handler::hasInstance()) {
@@ -161,6 +334,16 @@ std::shared_ptr<VideoProducer> AsyncWebMMuxer::makeVideoProducer() {
           fourcc);
     }
 #endif
+#ifdef USE_VAAPI
+    if (m_config.h264_encoder == hisui::config::H264Encoder::VAAPI) {
+      if (!hisui::video::VAAPIH264Encoder::isSupported()) {
+        throw std::runtime_error("VA-API H.264 encoder is not supported");
+      }
+      return std::make_shared<VAAPIVideoProducer>(
+          m_config, VAAPIVideoProducerParameters{.archives = m_normal_archives,
+                                                 .duration = m_duration});
+    }
+#endif
 
     // Unspecified
 #ifdef USE_ONEVPL
@@ -173,6 +356,14 @@ std::shared_ptr<VideoProducer> AsyncWebMMuxer::makeVideoProducer() {
                                      .duration = m_duration},
           hisui::config::OutVideoCodec::H264);
     } else  // NOLINT
+#endif
+#ifdef USE_VAAPI
+        if (hisui::video::VAAPIH264Encoder::isSupported()) {
+      spdlog::debug("use VAAPIVideoProducer");
+      return std::make_shared<VAAPIVideoProducer>(
+          m_config, VAAPIVideoProducerParameters{.archives = m_normal_archives,
+                                                 .duration = m_duration});
+    } else  // NOLINT
 #endif
         if (hisui::video::OpenH264Handler::hasInstance()) {
       spdlog::debug("use OpenH264VideoProducer");
@@ -181,6 +372,15 @@ std::shared_ptr<VideoProducer> AsyncWebMMuxer::makeVideoProducer() {
                         .archives = m_normal_archives, .duration = m_duration});
     }
     throw std::runtime_error("H.264 encoder is unavailable");
+#ifdef USE_ONEVPL
+  } else if (hisui::video::use_vpl_encoder(m_config,
+                                           m_config.out_video_codec)) {
+    return std::make_shared<VPLVideoProducer>(
+        m_config,
+        VPLVideoProducerParameters{.archives = m_normal_archives,
+                                   .duration = m_duration},
+        m_config.out_video_codec);
+#endif
   } else if (m_config.out_video_codec == hisui::config::OutVideoCodec::AV1) {
     return std::make_shared<AV1VideoProducer>(
         m_config, AV1VideoProducerParameters{.archives = m_normal_archives,
@@ -192,18 +392,102 @@ std::shared_ptr<VideoProducer> AsyncWebMMuxer::makeVideoProducer() {
   }
 }
 
-void AsyncWebMMuxer::setVideoTrack() {
-  if (m_config.out_video_codec == hisui::config::OutVideoCodec::AV1) {
-    const std::array<std::uint8_t, 4> private_data{0x81, 0x00, 0x06, 0x00};
-    m_context->setVideoTrack(m_video_producer->getWidth(),
-                             m_video_producer->getHeight(),
-                             m_video_producer->getFourcc(), private_data.data(),
-                             std::size(private_data));
-  } else {
-    m_context->setVideoTrack(m_video_producer->getWidth(),
-                             m_video_producer->getHeight(),
-                             m_video_producer->getFourcc(), nullptr, 0);
+void AsyncWebMMuxer::setUpRenditions() {
+  m_renditions = m_video_producer->getRenditions();
+  if (std::empty(m_renditions)) {
+    throw std::runtime_error(
+        "--video-ladder and --participant-outputs are not supported with "
+        "this video source");
+  }
+  for (const auto& r : m_renditions) {
+    const auto filename =
+        r.connection_id != ""
+            ? get_participant_filename(m_config.out_filename, r.connection_id)
+            : get_rendition_filename(m_config.out_filename, r.height);
+    spdlog::debug("rendition: {}x{} {}", r.width, r.height, filename);
+    auto context = std::make_unique<hisui::webm::output::Context>(
+        filename, make_context_parameters(m_config));
+    context->init();
+    context->setVideoTrack(r.width, r.height, m_video_producer->getFourcc(),
+                           nullptr, 0);
+    m_rendition_contexts.push_back(std::move(context));
+  }
+}
+
+// 接続ごとに source が 1 つなので, Opus のパケットはデコードせずにそのまま使い,
+// 録画のない間だけ無音をエンコードする
+void AsyncWebMMuxer::setUpParticipantAudio() {
+  std::vector<std::pair<std::string, std::vector<hisui::ArchiveItem>>>
+      participants;
+  for (const auto& archive : m_audio_archives) {
+    const auto it = std::find_if(
+        std::begin(participants), std::end(participants),
+        [&archive](const auto& p) {
+          return p.first == archive.getConnectionID();
+        });
+    if (it == std::end(participants)) {
+      participants.push_back({archive.getConnectionID(), {archive}});
+    } else {
+      it->second.push_back(archive);
+    }
+  }
+
+  hisui::Config config = m_config;
+  config.opus_passthrough =
+      m_config.out_audio_sample_rate == hisui::Constants::PCM_SAMPLE_RATE &&
+      m_config.getOpusFrameDuration() == 20;
+  config.audio_chunks = 1;
+  config.audio_silence_level = -1;
+  config.out_pcm_filename = "";
+  config.show_progress_bar = false;
+  for (const auto& [connection_id, archives] : participants) {
+    auto filename = std::filesystem::path(
+        get_participant_filename(m_config.out_filename, connection_id));
+    filename.replace_extension(".weba");
+    spdlog::debug("participant audio: {}", filename.string());
+
+    const auto producer =
+        std::make_shared<OpusAudioProducer>(config, archives, m_duration);
+    const auto skip = producer->getSkip();
+    const auto private_data = hisui::audio::create_opus_private_data(
+        {.skip = skip, .sample_rate = m_config.out_audio_sample_rate});
+    auto context = std::make_unique<hisui::webm::output::Context>(
+        filename.string(), make_context_parameters(m_config));
+    context->init();
+    context->setAudioTrack(static_cast<std::uint64_t>(skip) *
+                               hisui::Constants::NANO_SECOND /
+                               hisui::Constants::PCM_SAMPLE_RATE,
+                           private_data.data(), std::size(private_data));
+    m_participant_audio_producers.push_back(producer);
+    m_participant_audio_contexts.push_back(std::move(context));
   }
 }
 
+void AsyncWebMMuxer::setUpPacketRing(
+    const std::vector<std::uint8_t>& audio_private_data) {
+  const auto video_private_data = get_video_private_data(m_config);
+  const bool has_video = !m_config.audio_only;
+  m_packet_ring = std::make_unique<PacketRingWriter>(
+      m_config.out_packet_ring_filename, m_config.out_packet_ring_size << 20,
+      PacketRingParameters{
+          .video_fourcc = has_video ? m_video_producer->getFourcc() : 0,
+          .video_width = has_video ? m_video_producer->getWidth() : 0,
+          .video_height = has_video ? m_video_producer->getHeight() : 0,
+          .video_extra_data = video_private_data,
+          .audio_fourcc = PacketRingWriter::OPUS_FOURCC,
+          .audio_sample_rate = m_config.out_audio_sample_rate,
+          .audio_channels = 2,
+          .audio_extra_data = audio_private_data,
+      });
+}
+
+void AsyncWebMMuxer::setVideoTrack() {
+  const auto private_data = get_video_private_data(m_config);
+  m_context->setVideoTrack(
+      m_video_producer->getWidth(), m_video_producer->getHeight(),
+      m_video_producer->getFourcc(),
+      std::empty(private_data) ? nullptr : private_data.data(),
+      std::size(private_data));
+}
+
 }  // namespace hisui::muxer
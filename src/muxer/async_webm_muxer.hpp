@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -7,6 +8,8 @@
 #include "config.hpp"
 #include "metadata.hpp"
 #include "muxer/muxer.hpp"
+#include "muxer/packet_ring_writer.hpp"
+#include "muxer/video_producer.hpp"
 #include "webm/output/context.hpp"
 
 namespace hisui {
@@ -46,6 +49,18 @@ class AsyncWebMMuxer : public Muxer {
   void appendVideo(hisui::Frame) override;
 
   std::unique_ptr<hisui::webm::output::Context> m_context;
+  // --out-audio-only-file が指定された場合の音声のみの出力
+  std::unique_ptr<hisui::webm::output::Context> m_audio_only_context;
+  // --out-packet-ring-file が指定された場合の共有メモリへの出力
+  std::unique_ptr<PacketRingWriter> m_packet_ring;
+  // --video-ladder で追加する映像のみの出力
+  std::vector<VideoRendition> m_renditions;
+  std::vector<std::unique_ptr<hisui::webm::output::Context>>
+      m_rendition_contexts;
+  // --participant-audio-outputs で追加する, 接続ごとの音声のみの出力
+  std::vector<std::shared_ptr<AudioProducer>> m_participant_audio_producers;
+  std::vector<std::unique_ptr<hisui::webm::output::Context>>
+      m_participant_audio_contexts;
 
   bool has_preferred;
   hisui::Config m_config;
@@ -56,6 +71,9 @@ class AsyncWebMMuxer : public Muxer {
   std::size_t m_normal_archive_size;
   std::shared_ptr<VideoProducer> makeVideoProducer();
   void setVideoTrack();
+  void setUpRenditions();
+  void setUpParticipantAudio();
+  void setUpPacketRing(const std::vector<std::uint8_t>&);
 };
 
 }  // namespace hisui::muxer
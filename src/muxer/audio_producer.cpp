@@ -4,10 +4,15 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <future>
+#include <limits>
 #include <memory>
-#include <mutex>
+#include <optional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -16,93 +21,383 @@
 #include "audio/basic_sequencer.hpp"
 #include "audio/encoder.hpp"
 #include "audio/mixer.hpp"
+#include "audio/packet_cache.hpp"
+#include "audio/pcm_writer.hpp"
 #include "config.hpp"
 #include "constants.hpp"
 #include "frame.hpp"
+#include "frame_queue.hpp"
+#include "report/reporter.hpp"
+#include "util/file.hpp"
 
 namespace hisui::muxer {
 
+namespace {
+
+// 区間を分ける場合に, 各区間の手前から余分にエンコードして捨てるフレームの数.
+// その間にエンコーダーの状態が, 直前の区間から続けてエンコードした場合に近づく
+constexpr std::uint64_t CHUNK_PRE_ROLL_FRAMES = 4;
+
+// sequencer から読んだ source ごとの sample を 1 つに合成する.
+// 合成の関数は block ごとに 1 度だけ選び, source ごとのループでは直接呼ぶ
+class BlockMixer {
+ public:
+  BlockMixer(const hisui::config::AudioMixer t_mixer,
+             const std::size_t block_size)
+      : m_mixer(t_mixer),
+        m_mixed(block_size * 2),
+        m_bus(t_mixer == hisui::config::AudioMixer::Limiter ? block_size * 2
+                                                            : 0) {}
+
+  // 返り値は次の呼び出しまで有効
+  const std::int16_t* mix(hisui::audio::Sequencer* sequencer,
+                          const std::uint64_t position,
+                          const std::size_t n) {
+    sequencer->getSamples(&m_blocks, position, n);
+    if (std::empty(m_blocks)) {
+      std::fill_n(m_mixed.data(), n * 2, 0);
+      return m_mixed.data();
+    }
+    switch (m_mixer) {
+      case hisui::config::AudioMixer::Simple:
+        mixPairwise<hisui::audio::mix_samples_simple>(n * 2);
+        break;
+      case hisui::config::AudioMixer::Vttoth:
+        mixPairwise<hisui::audio::mix_samples_vttoth>(n * 2);
+        break;
+      case hisui::config::AudioMixer::Limiter:
+        // 0 で埋めてから足す代わりに, 最初の source で bus を初期化する
+        std::copy_n(m_blocks[0], n * 2, m_bus.data());
+        for (std::size_t i = 1; i < std::size(m_blocks); ++i) {
+          hisui::audio::accumulate_samples(m_bus.data(), m_blocks[i], n * 2);
+        }
+        hisui::audio::limit_samples(m_mixed.data(), m_bus.data(), n * 2);
+        break;
+    }
+    return m_mixed.data();
+  }
+
+ private:
+  template <void (*MixSamples)(std::int16_t*,
+                               const std::int16_t*,
+                               const std::size_t)>
+  void mixPairwise(const std::size_t size) {
+    std::copy_n(m_blocks[0], size, m_mixed.data());
+    for (std::size_t i = 1; i < std::size(m_blocks); ++i) {
+      MixSamples(m_mixed.data(), m_blocks[i], size);
+    }
+  }
+
+  hisui::config::AudioMixer m_mixer;
+  std::vector<const std::int16_t*> m_blocks;
+  std::vector<std::int16_t> m_mixed;
+  std::vector<std::int32_t> m_bus;
+};
+
+}  // namespace
+
 AudioProducer::AudioProducer(const AudioProducerParameters& params)
-    : m_duration(params.duration),
+    : m_buffer(params.buffer_capacity),
+      m_mixer(params.mixer),
+      m_duration(params.duration),
+      m_sample_rate(params.sample_rate),
+      m_block_size(static_cast<std::size_t>(
+          hisui::Constants::OPUS_ENCODE_FRAME_SIZE * params.sample_rate /
+          hisui::Constants::PCM_SAMPLE_RATE)),
+      m_decode_threads(params.decode_threads),
+      m_silence_level(params.silence_level),
+      m_chunks(params.pcm_writer ? 1 : params.chunks),
+      m_opus_passthrough(params.opus_passthrough && !params.pcm_writer),
+      m_cache_directory(params.pcm_writer ? "" : params.cache_directory),
+      m_pcm_writer(params.pcm_writer),
       m_show_progress_bar(params.show_progress_bar) {
-  switch (params.mixer) {
-    case hisui::config::AudioMixer::Simple:
-      m_mix_sample = hisui::audio::mix_sample_simple;
-      break;
-    case hisui::config::AudioMixer::Vttoth:
-      m_mix_sample = hisui::audio::mix_sample_vttoth;
-      break;
+  m_sequencer = std::make_unique<hisui::audio::BasicSequencer>(
+      params.archives, params.decode_threads, params.sample_rate,
+      params.silence_level);
+  if (m_chunks > 1) {
+    m_archives = params.archives;
+  }
+
+  if (!std::empty(m_cache_directory)) {
+    const auto archives_key = hisui::audio::make_archives_key(params.archives);
+    if (std::empty(archives_key)) {
+      spdlog::debug("audio cache is not used for these inputs");
+    } else {
+      m_cache_key = fmt::format(
+          "{}mixer={} duration={} sample_rate={} opus_passthrough={} "
+          "chunks={} silence_level={}\n{}\n",
+          archives_key, static_cast<int>(params.mixer), m_duration,
+          m_sample_rate, m_opus_passthrough, m_chunks, m_silence_level,
+          params.encoder_settings);
+    }
   }
-  m_sequencer = std::make_unique<hisui::audio::BasicSequencer>(params.archives);
 }
 
 void AudioProducer::produce() {
   try {
-    std::vector<std::pair<std::int16_t, std::int16_t>> samples;
+    std::optional<hisui::audio::PacketCache> cache;
+    if (!std::empty(m_cache_key)) {
+      cache.emplace(m_cache_directory,
+                    fmt::format("{}start={}\n", m_cache_key, m_start_position));
+      if (produceFromCache(*cache)) {
+        return;
+      }
+      cache->startRecording();
+      m_buffer.setRecorder(
+          [&cache](const hisui::Frame& frame) { cache->record(frame); });
+    }
+    produceFromSources();
+    if (cache) {
+      m_buffer.setRecorder(nullptr);
+      cache->commit();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("AudioProducer::produce() failed: what={}", e.what());
+    m_buffer.setRecorder(nullptr);
+    m_buffer.close();
+    throw;
+  }
+}
 
-    const std::uint64_t max_time = static_cast<std::uint64_t>(
-        std::ceil(m_duration * hisui::Constants::PCM_SAMPLE_RATE));
+bool AudioProducer::produceFromCache(
+    const hisui::audio::PacketCache& cache) {
+  auto frames = cache.load();
+  if (!frames) {
+    return false;
+  }
+  for (auto& frame : *frames) {
+    m_buffer.push(std::move(frame));
+  }
+  m_progress_samples = static_cast<std::uint64_t>(
+      std::ceil(m_duration * m_sample_rate));
+  m_buffer.close();
+  spdlog::info("audio was read from cache: packets={}", std::size(*frames));
+  return true;
+}
 
-    progresscpp::ProgressBar progress_bar(max_time, 60);
+void AudioProducer::produceFromSources() {
+  const std::uint64_t max_time =
+      static_cast<std::uint64_t>(std::ceil(m_duration * m_sample_rate));
+  if (m_chunks > 1 && m_encoder_factory) {
+    produceInChunks(max_time);
+    return;
+  }
 
-    for (std::uint64_t p = 0; p < max_time; ++p) {
-      std::int16_t left = 0;
-      std::int16_t right = 0;
-      m_sequencer->getSamples(&samples, p);
-      for (const auto& s : samples) {
-        const auto [l, r] = s;
-        if (l != 0) {
-          left = m_mix_sample(left, l);
-        }
-        if (r != 0) {
-          right = m_mix_sample(right, r);
-        }
-      }
+  BlockMixer mixer(m_mixer, m_block_size);
+  progresscpp::ProgressBar progress_bar(max_time, 60);
+  std::uint64_t number_of_passthrough_packets = 0;
+  if (m_start_position > 0) {
+    m_sequencer->seek(m_start_position);
+  }
+
+  for (std::uint64_t p = 0; p < max_time; p += m_block_size) {
+    const auto n = static_cast<std::size_t>(
+        std::min(static_cast<std::uint64_t>(m_block_size), max_time - p));
+    const std::uint8_t* packet = nullptr;
+    std::size_t packet_size = 0;
+    if (m_opus_passthrough && n == m_block_size &&
+        m_sequencer->getPacket(&packet, &packet_size, m_start_position + p,
+                               n)) {
+      hisui::report::StageTimer timer("audio_passthrough");
+      m_encoder->addPacket(packet, packet_size);
+      ++number_of_passthrough_packets;
+    } else {
+      const std::int16_t* samples;
       {
-        std::lock_guard<std::mutex> lock(m_mutex_buffer);
-        m_encoder->addSample(left, right);
+        hisui::report::StageTimer timer("audio_decode");
+        samples = mixer.mix(m_sequencer.get(), m_start_position + p, n);
       }
-
-      // 毎回 setTicks & display すると顕著に遅くなる
-      if (m_show_progress_bar && p % 100000 == 0) {
-        progress_bar.setTicks(p);
-        progress_bar.display();
+      hisui::report::StageTimer timer("audio_encode");
+      m_encoder->addSamples(samples, n);
+      if (m_pcm_writer) {
+        m_pcm_writer->addSamples(samples, n);
       }
     }
+    m_progress_samples = p + n;
+
+    // 毎回 setTicks & display すると顕著に遅くなる
+    if (m_show_progress_bar && (p / m_block_size) % 100 == 0) {
+      progress_bar.setTicks(p);
+      progress_bar.display();
+    }
+  }
+
+  m_encoder->flush();
+  if (m_pcm_writer) {
+    m_pcm_writer->flush();
+  }
+  m_buffer.close();
+  if (m_opus_passthrough) {
+    spdlog::debug("AudioProducer: passthrough packets: {}/{}",
+                  number_of_passthrough_packets,
+                  (max_time + m_block_size - 1) / m_block_size);
+  }
+
+  if (m_show_progress_bar) {
+    progress_bar.setTicks(max_time);
+    progress_bar.done();
+  }
+}
+
+// 先頭の区間はこのスレッドで合成して m_buffer に直接出力し, 残りの区間は別のスレッドで
+// 合成しておいて順に出力する
+void AudioProducer::produceInChunks(const std::uint64_t max_time) {
+  // 区間の境界はエンコーダーのフレームの境界に揃え, 手前に pre-roll を取れる長さにする
+  const std::uint64_t frame_size = m_encoder_frame_size;
+  const std::uint64_t number_of_frames =
+      (max_time + frame_size - 1) / frame_size;
+  const std::uint64_t chunks = m_chunks;
+  const std::uint64_t frames_per_chunk = std::max(
+      CHUNK_PRE_ROLL_FRAMES, (number_of_frames + chunks - 1) / chunks);
+  const std::uint64_t chunk_size = frames_per_chunk * frame_size;
 
+  std::vector<std::future<std::vector<hisui::Frame>>> tasks;
+  for (std::uint64_t begin = chunk_size; begin < max_time;
+       begin += chunk_size) {
+    const auto end = std::min(begin + chunk_size, max_time);
+    tasks.push_back(
+        std::async(std::launch::async, [this, begin, end, max_time] {
+          return encodeChunk(begin, end, end == max_time);
+        }));
+  }
+  spdlog::debug("AudioProducer: chunks={} chunk_size={}",
+                std::size(tasks) + 1, chunk_size);
+
+  progresscpp::ProgressBar progress_bar(max_time, 60);
+  BlockMixer mixer(m_mixer, m_block_size);
+  if (m_start_position > 0) {
+    m_sequencer->seek(m_start_position);
+  }
+  const auto first_end = std::min(chunk_size, max_time);
+  for (std::uint64_t p = 0; p < first_end; p += m_block_size) {
+    const auto n = static_cast<std::size_t>(
+        std::min(static_cast<std::uint64_t>(m_block_size), first_end - p));
+    const std::int16_t* samples;
     {
-      std::lock_guard<std::mutex> lock(m_mutex_buffer);
-      m_encoder->flush();
-      m_is_finished = true;
+      hisui::report::StageTimer timer("audio_decode");
+      samples = mixer.mix(m_sequencer.get(), m_start_position + p, n);
     }
+    hisui::report::StageTimer timer("audio_encode");
+    m_encoder->addSamples(samples, n);
+    m_progress_samples = p + n;
+  }
+  if (std::empty(tasks)) {
+    m_encoder->flush();
+  }
 
+  auto position = first_end;
+  for (auto& task : tasks) {
+    for (auto& frame : task.get()) {
+      m_buffer.push(std::move(frame));
+    }
+    position = std::min(position + chunk_size, max_time);
+    m_progress_samples = position;
     if (m_show_progress_bar) {
-      progress_bar.setTicks(max_time);
-      progress_bar.done();
+      progress_bar.setTicks(position);
+      progress_bar.display();
     }
-  } catch (const std::exception& e) {
-    spdlog::error("AudioProducer::produce() failed: what={}", e.what());
-    m_is_finished = true;
-    throw;
+  }
+  m_buffer.close();
+
+  if (m_show_progress_bar) {
+    progress_bar.setTicks(max_time);
+    progress_bar.done();
   }
 }
 
+std::vector<hisui::Frame> AudioProducer::encodeChunk(const std::uint64_t begin,
+                                                     const std::uint64_t end,
+                                                     const bool is_last) {
+  // デコーダーは seek() が手前から追従させるので, ここではエンコーダーの分だけ戻る
+  const std::uint64_t pre_roll = CHUNK_PRE_ROLL_FRAMES * m_encoder_frame_size;
+  hisui::audio::BasicSequencer sequencer(m_archives, m_decode_threads,
+                                         m_sample_rate, m_silence_level);
+  sequencer.seek(m_start_position + begin - pre_roll);
+  hisui::FrameQueue queue;
+  const auto encoder = m_encoder_factory(
+      &queue, begin / m_encoder_frame_size - CHUNK_PRE_ROLL_FRAMES);
+
+  BlockMixer mixer(m_mixer, m_block_size);
+  for (std::uint64_t p = begin - pre_roll; p < end; p += m_block_size) {
+    const auto n = static_cast<std::size_t>(
+        std::min(static_cast<std::uint64_t>(m_block_size), end - p));
+    const std::int16_t* samples;
+    {
+      hisui::report::StageTimer timer("audio_decode");
+      samples = mixer.mix(&sequencer, m_start_position + p, n);
+    }
+    hisui::report::StageTimer timer("audio_encode");
+    encoder->addSamples(samples, n);
+  }
+  if (is_last) {
+    encoder->flush();
+  }
+  queue.close();
+
+  std::vector<hisui::Frame> frames;
+  for (std::uint64_t i = 0; auto frame = queue.front(); ++i) {
+    queue.pop();
+    if (i >= CHUNK_PRE_ROLL_FRAMES) {
+      frames.push_back(std::move(*frame));
+    }
+  }
+  return frames;
+}
+
 void AudioProducer::bufferPop() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
   m_buffer.pop();
 }
 
 std::optional<hisui::Frame> AudioProducer::bufferFront() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
-  if (m_buffer.empty()) {
-    return {};
-  }
   return m_buffer.front();
 }
 
+std::optional<hisui::Frame> AudioProducer::waitBufferFront() {
+  return m_buffer.waitFront();
+}
+
+void AudioProducer::abort() {
+  m_buffer.abort();
+}
+
 bool AudioProducer::isFinished() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
-  return m_is_finished && m_buffer.empty();
+  return m_buffer.isFinished();
+}
+
+std::size_t AudioProducer::getBufferPeakSize() {
+  return m_buffer.peakSize();
+}
+
+std::size_t AudioProducer::getBufferSize() {
+  return m_buffer.size();
+}
+
+double AudioProducer::getProgressTime() {
+  if (m_buffer.isClosed()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return static_cast<double>(m_progress_samples.load()) / m_sample_rate;
+}
+
+void AudioProducer::setStartTime(const double start_time) {
+  m_start_position =
+      static_cast<std::uint64_t>(std::llround(start_time * m_sample_rate));
+}
+
+std::shared_ptr<hisui::audio::Encoder> make_pcm_writer(
+    const hisui::Config& config,
+    const std::uint32_t sample_rate) {
+  if (config.out_pcm_filename == "") {
+    return nullptr;
+  }
+  return std::make_shared<hisui::audio::PCMWriter>(
+      config.out_pcm_filename,
+      hisui::audio::PCMWriterParameters{
+          .sample_rate = sample_rate,
+          .out_sample_rate = config.out_pcm_sample_rate,
+          .channels = static_cast<std::uint16_t>(config.out_pcm_mono ? 1 : 2),
+          .wav = hisui::util::get_extension(config.out_pcm_filename) ==
+                 ".wav"});
 }
 
 }  // namespace hisui::muxer
@@ -1,17 +1,27 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
-#include <mutex>
 #include <optional>
-#include <queue>
+#include <string>
 #include <vector>
 
 #include "archive_item.hpp"
 #include "audio/encoder.hpp"
 #include "audio/sequencer.hpp"
 #include "config.hpp"
+#include "constants.hpp"
 #include "frame.hpp"
+#include "frame_queue.hpp"
+
+namespace hisui::audio {
+
+class PacketCache;
+
+}  // namespace hisui::audio
 
 namespace hisui::muxer {
 
@@ -20,6 +30,24 @@ struct AudioProducerParameters {
   const hisui::config::AudioMixer mixer;
   const double duration;
   const bool show_progress_bar = true;
+  const std::size_t buffer_capacity = 0;  // 0: unbounded
+  const std::size_t decode_threads = 1;
+  const std::uint32_t sample_rate = hisui::Constants::PCM_SAMPLE_RATE;
+  // 振幅がこれ以下の source はその区間の合成から外す. 負ならば外さない
+  const std::int32_t silence_level = -1;
+  // source が 1 つだけの区間は, Opus のフレームをデコードせずにそのまま出力する.
+  // encoder が Encoder::addPacket() に対応している場合にだけ指定できる
+  const bool opus_passthrough = false;
+  // 空でなければ, 入力と設定が同じ場合にエンコード済みのパケットをここから読む
+  const std::string cache_directory = "";
+  // cache の key に含める, エンコーダーの設定
+  const std::string encoder_settings = "";
+  // 1 より大きければ, タイムラインをこの数の区間に分けて並列にデコード, 合成, エンコードし,
+  // 順に繋げる. 派生クラスが m_encoder_factory を設定した場合にだけ使う
+  const std::size_t chunks = 1;
+  // nullptr でなければ, 合成した sample をエンコーダーに加えてこれにも渡す.
+  // 合成した sample が必要なので, cache, opus_passthrough, chunks は使わない
+  const std::shared_ptr<hisui::audio::Encoder> pcm_writer = nullptr;
 };
 
 class AudioProducer {
@@ -29,21 +57,63 @@ class AudioProducer {
   void produce();
   void bufferPop();
   std::optional<hisui::Frame> bufferFront();
+  std::optional<hisui::Frame> waitBufferFront();
+  void abort();
   bool isFinished();
+  std::size_t getBufferPeakSize();
+  std::size_t getBufferSize();
+  // 合成を終えたタイムライン上の時刻 (秒). 終えていれば無限大を返す
+  double getProgressTime();
+  // タイムライン上のこの時刻 (秒) から合成する. 出力は 0 から始まる
+  void setStartTime(const double);
 
  protected:
   std::shared_ptr<hisui::audio::Encoder> m_encoder;
-  std::queue<hisui::Frame> m_buffer;
+  hisui::FrameQueue m_buffer;
+  // 区間ごとのエンコーダーを作る. 引数は出力先と, 最初に出力するフレームの番号
+  std::function<std::shared_ptr<hisui::audio::Encoder>(hisui::FrameQueue*,
+                                                       const std::uint64_t)>
+      m_encoder_factory;
+  // エンコーダーの 1 フレームの sample 数. 区間の境界をフレームの境界に揃える
+  std::size_t m_encoder_frame_size = 0;
 
  private:
   std::unique_ptr<hisui::audio::Sequencer> m_sequencer;
-  std::int16_t (*m_mix_sample)(const std::int16_t, const std::int16_t);
+  hisui::config::AudioMixer m_mixer;
   double m_duration;
-
-  std::mutex m_mutex_buffer;
+  std::uint32_t m_sample_rate;
+  // 1 度に扱う sample の数. Opus の 1 フレーム分 (20 ms) にしておく
+  std::size_t m_block_size;
+  std::atomic<std::uint64_t> m_progress_samples = 0;
+  // 合成を始めるタイムライン上の位置 (sample)
+  std::uint64_t m_start_position = 0;
+  // 区間ごとに sequencer を作るために残す. m_chunks が 1 ならば空
+  std::vector<hisui::ArchiveItem> m_archives;
+  std::size_t m_decode_threads;
+  std::int32_t m_silence_level;
+  std::size_t m_chunks;
+  bool m_opus_passthrough;
+  std::string m_cache_directory;
+  // 空ならば cache を使わない. 合成を始める位置は produce() で加える
+  std::string m_cache_key;
+  std::shared_ptr<hisui::audio::Encoder> m_pcm_writer;
 
   bool m_show_progress_bar;
-  bool m_is_finished = false;
+
+  // cache にあれば全てのパケットを m_buffer に入れて true を返す
+  bool produceFromCache(const hisui::audio::PacketCache&);
+  void produceFromSources();
+  void produceInChunks(const std::uint64_t);
+  // 合成を始める位置から [begin, end) を別の sequencer と encoder で合成し, 出力したフレームを返す.
+  // 境界で途切れないよう, 少し手前から合成してその分のフレームは捨てる
+  std::vector<hisui::Frame> encodeChunk(const std::uint64_t begin,
+                                        const std::uint64_t end,
+                                        const bool is_last);
 };
 
+// --out-pcm-file が空でなければ, sample_rate で合成した sample を書き出す PCMWriter を返す
+std::shared_ptr<hisui::audio::Encoder> make_pcm_writer(
+    const hisui::Config&,
+    const std::uint32_t sample_rate);
+
 }  // namespace hisui::muxer
@@ -2,12 +2,16 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <boost/rational.hpp>
 
+#include "archive_item.hpp"
 #include "config.hpp"
+#include "frame_queue.hpp"
 #include "metadata.hpp"
 #include "muxer/video_producer.hpp"
+#include "video/adaptive_grid_composer.hpp"
 #include "video/basic_sequencer.hpp"
 #include "video/buffer_av1_encoder.hpp"
 #include "video/composer.hpp"
@@ -17,43 +21,104 @@
 
 namespace hisui::muxer {
 
-AV1VideoProducer::AV1VideoProducer(const hisui::Config& t_config,
-                                   const AV1VideoProducerParameters& params)
-    : VideoProducer({.show_progress_bar = t_config.show_progress_bar}) {
-  m_sequencer = std::make_shared<hisui::video::BasicSequencer>(params.archives);
+namespace {
+
+struct Components {
+  std::shared_ptr<hisui::video::Sequencer> sequencer;
+  std::shared_ptr<hisui::video::Composer> composer;
+  std::shared_ptr<hisui::video::Encoder> encoder;
+};
+
+Components create_components(const hisui::Config& config,
+                             const std::vector<hisui::ArchiveItem>& archives,
+                             const std::uint64_t timescale,
+                             hisui::FrameQueue* buffer) {
+  Components components;
+  components.sequencer = std::make_shared<hisui::video::BasicSequencer>(
+      archives, config.video_decode_threads, config.getVideoWarmUpTime());
+  const auto& sequencer = components.sequencer;
 
-  const auto scaling_width = t_config.scaling_width != 0
-                                 ? t_config.scaling_width
-                                 : m_sequencer->getMaxWidth();
-  const auto scaling_height = t_config.scaling_height != 0
-                                  ? t_config.scaling_height
-                                  : m_sequencer->getMaxHeight();
+  const auto scaling_width = config.scaling_width != 0
+                                 ? config.scaling_width
+                                 : sequencer->getMaxWidth();
+  const auto scaling_height = config.scaling_height != 0
+                                  ? config.scaling_height
+                                  : sequencer->getMaxHeight();
 
-  switch (t_config.video_composer) {
+  switch (config.video_composer) {
     case hisui::config::VideoComposer::Grid:
-      m_composer = std::make_shared<hisui::video::GridComposer>(
-          scaling_width, scaling_height, m_sequencer->getSize(),
-          t_config.max_columns, t_config.video_scaler,
-          t_config.libyuv_filter_mode);
+      components.composer = std::make_shared<hisui::video::GridComposer>(
+          scaling_width, scaling_height, sequencer->getSize(),
+          config.max_columns, config.video_scaler, config.libyuv_filter_mode);
       break;
     case hisui::config::VideoComposer::ParallelGrid:
-      m_composer = std::make_shared<hisui::video::ParallelGridComposer>(
-          scaling_width, scaling_height, m_sequencer->getSize(),
-          t_config.max_columns, t_config.video_scaler,
-          t_config.libyuv_filter_mode);
+      components.composer =
+          std::make_shared<hisui::video::ParallelGridComposer>(
+              scaling_width, scaling_height, sequencer->getSize(),
+              config.max_columns, config.video_scaler,
+              config.libyuv_filter_mode, config.getVideoComposeThreads());
+      break;
+    case hisui::config::VideoComposer::Auto:
+      components.composer =
+          std::make_shared<hisui::video::AdaptiveGridComposer>(
+              scaling_width, scaling_height, sequencer->getSize(),
+              config.max_columns, config.video_scaler,
+              config.libyuv_filter_mode, config.getVideoComposeThreads());
       break;
   }
 
-  hisui::video::AV1EncoderConfig av1_config(m_composer->getWidth(),
-                                            m_composer->getHeight(), t_config);
+  hisui::video::AV1EncoderConfig av1_config(components.composer->getWidth(),
+                                            components.composer->getHeight(),
+                                            config);
+  components.encoder = std::make_shared<hisui::video::BufferAV1Encoder>(
+      buffer, av1_config, timescale);
+
+  return components;
+}
+
+}  // namespace
 
-  m_encoder = std::make_shared<hisui::video::BufferAV1Encoder>(
-      &m_buffer, av1_config, params.timescale);
+AV1VideoProducer::AV1VideoProducer(const hisui::Config& t_config,
+                                   const AV1VideoProducerParameters& params)
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .pipeline_depth = t_config.video_pipeline_depth,
+                     .encode_segments = t_config.video_encode_segments,
+                     .part_index = t_config.video_part_index,
+                     .part_count = t_config.video_part_count,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}),
+      m_config(t_config),
+      m_archives(params.archives),
+      m_timescale(params.timescale) {
+  const auto components = create_components(m_config, m_archives,
+                                             m_timescale, &m_buffer);
+  m_sequencer = components.sequencer;
+  m_composer = components.composer;
+  m_encoder = components.encoder;
 
   m_duration = params.duration;
   m_frame_rate = t_config.out_video_frame_rate;
 }
 
+void AV1VideoProducer::produce() {
+  if (isFinished()) {
+    return;
+  }
+
+  produceSegments(
+      m_composer->getWidth() * m_composer->getHeight() * 3 >> 1, m_timescale,
+      makeComposeFunction(m_sequencer, m_composer),
+      [this](hisui::FrameQueue* buffer) {
+        const auto components =
+            create_components(m_config, m_archives, m_timescale, buffer);
+        return EncodingSegment{
+            .encoder = components.encoder,
+            .compose = makeComposeFunction(components.sequencer,
+                                           components.composer)};
+      });
+}
+
 const std::vector<std::uint8_t>& AV1VideoProducer::getExtraData() const {
   return m_encoder->getExtraData();
 }
@@ -4,12 +4,12 @@
 #include <vector>
 
 #include "archive_item.hpp"
+#include "config.hpp"
 #include "constants.hpp"
 #include "muxer/video_producer.hpp"
 
 namespace hisui {
 
-class Config;
 class Metadata;
 
 }  // namespace hisui
@@ -25,7 +25,14 @@ struct AV1VideoProducerParameters {
 class AV1VideoProducer : public VideoProducer {
  public:
   AV1VideoProducer(const hisui::Config&, const AV1VideoProducerParameters&);
+
+  void produce() override;
   const std::vector<std::uint8_t>& getExtraData() const override;
+
+ private:
+  const hisui::Config m_config;
+  const std::vector<hisui::ArchiveItem> m_archives;
+  const std::uint64_t m_timescale;
 };
 
 }  // namespace hisui::muxer
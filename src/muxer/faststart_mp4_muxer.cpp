@@ -1,18 +1,28 @@
 #include "muxer/faststart_mp4_muxer.hpp"
 
 #include <bits/exception.h>
+#include <fcntl.h>
 #include <spdlog/fmt/bundled/format.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
+#include <unistd.h>
 
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <iosfwd>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <vector>
 
+#include "archive_item.hpp"
 #include "config.hpp"
+#include "constants.hpp"
 #include "metadata.hpp"
 #include "shiguredo/mp4/track/soun.hpp"
 #include "shiguredo/mp4/track/vide.hpp"
@@ -26,35 +36,93 @@ class Track;
 
 namespace hisui::muxer {
 
+namespace {
+
+constexpr char MEMORY_DIRECTORY[] = "/dev/shm";
+
+// 可変ビットレートで見込みを超えても収まるよう, ビットレートから求めた値の 2 倍にする.
+// 映像をそのまま書き出す場合は入力ファイルの大きさを使う
+std::uint64_t expect_mdat_size(
+    const hisui::Config& config,
+    const double duration,
+    const std::vector<hisui::ArchiveItem>& normal_archives) {
+  std::uint64_t bit_rate =
+      config.out_audio_codec == hisui::config::OutAudioCodec::FDK_AAC
+          ? config.out_aac_bit_rate
+          : config.out_opus_bit_rate;
+  std::uint64_t video_size = 0;
+  if (!config.audio_only) {
+    if (config.video_remux && std::size(normal_archives) == 1) {
+      std::error_code ec;
+      video_size = std::filesystem::file_size(
+          normal_archives.front().getPath(), ec);
+      if (ec) {
+        return std::numeric_limits<std::uint64_t>::max();
+      }
+    } else {
+      const std::uint64_t video_bit_rate =
+          config.out_video_bit_rate != 0
+              ? config.out_video_bit_rate
+              : std::size(normal_archives) *
+                    hisui::Constants::VIDEO_VPX_BIT_RATE_PER_FILE;
+      bit_rate += video_bit_rate * 1000;
+    }
+  }
+  return 2 * (video_size + static_cast<std::uint64_t>(std::ceil(
+                               static_cast<double>(bit_rate) * duration / 8)));
+}
+
+}  // namespace
+
 FaststartMP4Muxer::FaststartMP4Muxer(const hisui::Config& t_config,
                                      const MP4MuxerParameters& params)
-    : MP4Muxer(params), m_config(t_config) {}
+    : MP4Muxer(params),
+      m_config(t_config),
+      m_expected_mdat_size(expect_mdat_size(t_config,
+                                            params.duration,
+                                            params.normal_archives)) {}
 
 FaststartMP4Muxer::FaststartMP4Muxer(const hisui::Config& t_config,
                                      const MP4MuxerParametersForLayout& params)
-    : MP4Muxer(params), m_config(t_config) {}
-
-void FaststartMP4Muxer::setUp() {
-  std::filesystem::path directory_for_faststart_intermediate_file;
+    : MP4Muxer(params),
+      m_config(t_config),
+      m_expected_mdat_size(expect_mdat_size(t_config, params.duration, {})) {}
 
+// 指定が無く, 出力が小さいと見込める場合は中間ファイルをメモリー上に置き,
+// ネットワーク越しのファイルシステムへの書き込みと読み戻しを省く
+std::filesystem::path FaststartMP4Muxer::getIntermediateDirectory() const {
   if (m_config.directory_for_faststart_intermediate_file != "") {
-    directory_for_faststart_intermediate_file =
-        m_config.directory_for_faststart_intermediate_file;
-    if (!std::filesystem::is_directory(
-            directory_for_faststart_intermediate_file)) {
+    const std::filesystem::path directory(
+        m_config.directory_for_faststart_intermediate_file);
+    if (!std::filesystem::is_directory(directory)) {
       throw std::invalid_argument(
           fmt::format("{} is not directory",
                       m_config.directory_for_faststart_intermediate_file));
     }
-  } else {
-    std::filesystem::path metadata_path(m_config.in_metadata_filename);
-    spdlog::debug("metadata_path: {}", metadata_path.string());
+    return directory;
+  }
 
-    if (metadata_path.is_relative()) {
-      metadata_path = std::filesystem::absolute(metadata_path);
+  if (m_expected_mdat_size <= m_config.faststart_memory_limit << 20) {
+    std::error_code ec;
+    const auto space = std::filesystem::space(MEMORY_DIRECTORY, ec);
+    if (!ec && space.available > m_expected_mdat_size) {
+      spdlog::debug("expected mdat size: {}", m_expected_mdat_size);
+      return MEMORY_DIRECTORY;
     }
-    directory_for_faststart_intermediate_file = metadata_path.parent_path();
   }
+
+  std::filesystem::path metadata_path(m_config.in_metadata_filename);
+  spdlog::debug("metadata_path: {}", metadata_path.string());
+
+  if (metadata_path.is_relative()) {
+    metadata_path = std::filesystem::absolute(metadata_path);
+  }
+  return metadata_path.parent_path();
+}
+
+void FaststartMP4Muxer::setUp() {
+  const auto directory_for_faststart_intermediate_file =
+      getIntermediateDirectory();
   spdlog::debug("directory_for_faststart_intermediate_file: {}",
                 directory_for_faststart_intermediate_file.string());
 
@@ -92,7 +160,10 @@ void FaststartMP4Muxer::setUp() {
 void FaststartMP4Muxer::run() {
   m_faststart_writer->writeFtypBox();
 
-  mux();
+  mux({.progress_interval = m_config.progress_interval,
+       .duration = m_duration,
+       .start_time = m_config.clip_start,
+       .max_memory = m_config.max_memory << 20});
 
   if (m_vide_track) {
     m_faststart_writer->appendTrakAndUdtaBoxInfo(
@@ -102,7 +173,72 @@ void FaststartMP4Muxer::run() {
   }
   m_faststart_writer->writeMoovBox();
   m_faststart_writer->writeMdatHeader();
-  m_faststart_writer->copyMdatData();
+  // ハッシュ値を計算する場合は, サンプルデータも m_ofs を通して書く
+  if (m_hasher || !copyMdatDataInKernel()) {
+    m_faststart_writer->copyMdatData();
+  }
+  finishOutput();
+}
+
+// 中間ファイルがちょうどサンプルデータだけを含んでいることを確かめられた場合は
+// copy_file_range() でカーネル内でコピーする. reflink に対応したファイルシステムでは
+// データブロックは複製されない. コピーを始められなかった場合は false を返す
+bool FaststartMP4Muxer::copyMdatDataInKernel() {
+  const std::filesystem::path path =
+      m_faststart_writer->getIntermediateFilePath();
+  std::error_code ec;
+  const std::uint64_t size = std::filesystem::file_size(path, ec);
+  if (ec || size != m_mdat_data_size) {
+    spdlog::debug(
+        "intermediate file size mismatch: file_size={} mdat_data_size={}",
+        ec ? 0 : size, m_mdat_data_size);
+    return false;
+  }
+
+  m_ofs.flush();
+  const auto position = m_ofs.tellp();
+  if (!m_ofs || position < 0) {
+    return false;
+  }
+
+  const int in_fd = ::open(path.c_str(), O_RDONLY);
+  if (in_fd == -1) {
+    return false;
+  }
+  const int out_fd = ::open(m_out_filename.c_str(), O_WRONLY);
+  if (out_fd == -1) {
+    ::close(in_fd);
+    return false;
+  }
+
+  ::off64_t in_offset = 0;
+  ::off64_t out_offset = static_cast<::off64_t>(position);
+  std::uint64_t copied = 0;
+  int error = 0;
+  while (copied < size) {
+    const auto ret = ::copy_file_range(in_fd, &in_offset, out_fd, &out_offset,
+                                       size - copied, 0);
+    if (ret <= 0) {
+      error = ret == 0 ? EIO : errno;
+      break;
+    }
+    copied += static_cast<std::uint64_t>(ret);
+  }
+  ::close(in_fd);
+  ::close(out_fd);
+
+  if (copied == size) {
+    m_ofs.seekp(0, std::ios_base::end);
+    return true;
+  }
+  if (copied == 0) {
+    // EXDEV や ENOSYS など. 出力には何も書いていないので通常のコピーに任せる
+    spdlog::debug("copy_file_range() failed: error={}", std::strerror(error));
+    return false;
+  }
+  throw std::runtime_error(
+      fmt::format("copy_file_range() failed: copied={} size={} error={}",
+                  copied, size, std::strerror(error)));
 }
 
 void FaststartMP4Muxer::cleanUp() {
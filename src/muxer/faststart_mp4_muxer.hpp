@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
 #include <memory>
+#include <vector>
 
+#include "archive_item.hpp"
 #include "config.hpp"
 #include "metadata.hpp"
 #include "muxer/mp4_muxer.hpp"
@@ -24,9 +28,15 @@ class FaststartMP4Muxer : public MP4Muxer {
   void cleanUp() override;
 
  private:
+  bool copyMdatDataInKernel();
+
+  std::filesystem::path getIntermediateDirectory() const;
+
   std::shared_ptr<shiguredo::mp4::writer::FaststartWriter> m_faststart_writer;
 
   hisui::Config m_config;
+  // 出力するサンプルデータの大きさの見込み (バイト)
+  std::uint64_t m_expected_mdat_size;
 };
 
 }  // namespace hisui::muxer
@@ -1,5 +1,7 @@
 #include "muxer/fdk_aac_audio_producer.hpp"
 
+#include <fmt/core.h>
+
 #include <memory>
 
 #include "audio/basic_sequencer.hpp"
@@ -16,7 +18,16 @@ FDKAACAudioProducer::FDKAACAudioProducer(
                      .mixer = t_config.audio_mixer,
                      .duration = params.duration,
                      .show_progress_bar =
-                         t_config.show_progress_bar && t_config.audio_only}) {
+                         t_config.show_progress_bar && t_config.audio_only,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .decode_threads = t_config.audio_decode_threads,
+                     .sample_rate = t_config.out_audio_sample_rate,
+                     .silence_level = t_config.audio_silence_level,
+                     .cache_directory = t_config.audio_cache_directory,
+                     .encoder_settings = fmt::format(
+                         "fdk_aac bit_rate={}", t_config.out_aac_bit_rate),
+                     .pcm_writer = make_pcm_writer(
+                         t_config, t_config.out_audio_sample_rate)}) {
   m_encoder = std::make_shared<hisui::audio::BufferFDKAACEncoder>(
       &m_buffer, hisui::audio::BufferFDKAACEncoderParameters{
                      .bit_rate = t_config.out_aac_bit_rate});
@@ -0,0 +1,692 @@
+#include "muxer/fragmented_mp4.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+
+namespace hisui::muxer {
+
+namespace {
+
+// 箱の大きさは end() で書き戻す
+class BoxWriter {
+ public:
+  explicit BoxWriter(std::vector<std::uint8_t>* t_buffer)
+      : m_buffer(t_buffer) {}
+
+  std::size_t begin(const std::string_view type) {
+    const auto offset = std::size(*m_buffer);
+    u32(0);
+    bytes(reinterpret_cast<const std::uint8_t*>(std::data(type)),
+          std::size(type));
+    return offset;
+  }
+
+  std::size_t beginFull(const std::string_view type,
+                        const std::uint8_t version,
+                        const std::uint32_t flags) {
+    const auto offset = begin(type);
+    u32((static_cast<std::uint32_t>(version) << 24) | flags);
+    return offset;
+  }
+
+  void end(const std::size_t offset) {
+    const auto size = std::size(*m_buffer) - offset;
+    for (std::size_t i = 0; i < 4; ++i) {
+      (*m_buffer)[offset + i] =
+          static_cast<std::uint8_t>(size >> (8 * (3 - i)));
+    }
+  }
+
+  void u8(const std::uint8_t value) { m_buffer->push_back(value); }
+
+  void u16(const std::uint16_t value) {
+    u8(static_cast<std::uint8_t>(value >> 8));
+    u8(static_cast<std::uint8_t>(value));
+  }
+
+  void u32(const std::uint32_t value) {
+    u16(static_cast<std::uint16_t>(value >> 16));
+    u16(static_cast<std::uint16_t>(value));
+  }
+
+  void u64(const std::uint64_t value) {
+    u32(static_cast<std::uint32_t>(value >> 32));
+    u32(static_cast<std::uint32_t>(value));
+  }
+
+  void zeros(const std::size_t size) {
+    m_buffer->insert(std::end(*m_buffer), size, 0);
+  }
+
+  void bytes(const std::uint8_t* data, const std::size_t size) {
+    m_buffer->insert(std::end(*m_buffer), data, data + size);
+  }
+
+  void bytes(const std::vector<std::uint8_t>& data) {
+    bytes(std::data(data), std::size(data));
+  }
+
+  void matrix() {
+    for (const auto value : std::array<std::uint32_t, 9>{
+             0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000}) {
+      u32(value);
+    }
+  }
+
+ private:
+  std::vector<std::uint8_t>* m_buffer;
+};
+
+void write_visual_sample_entry_header(BoxWriter* w,
+                                      const std::uint32_t width,
+                                      const std::uint32_t height) {
+  w->zeros(6);
+  w->u16(1);  // data_reference_index
+  w->zeros(16);
+  w->u16(static_cast<std::uint16_t>(width));
+  w->u16(static_cast<std::uint16_t>(height));
+  w->u32(0x00480000);  // 72 dpi
+  w->u32(0x00480000);
+  w->u32(0);
+  w->u16(1);  // frame_count
+  w->zeros(32);
+  w->u16(0x0018);
+  w->u16(0xffff);
+}
+
+void write_audio_sample_entry_header(BoxWriter* w) {
+  w->zeros(6);
+  w->u16(1);  // data_reference_index
+  w->zeros(8);
+  w->u16(2);   // channelcount
+  w->u16(16);  // samplesize
+  w->zeros(4);
+  w->u32(static_cast<std::uint32_t>(Constants::PCM_SAMPLE_RATE) << 16);
+}
+
+// 出力の画素数から VP8/VP9 の level を見積もる. 30 fps 程度を想定する
+std::uint8_t get_vpx_level(const std::uint32_t width,
+                           const std::uint32_t height) {
+  static constexpr std::array<std::pair<std::uint64_t, std::uint8_t>, 8>
+      levels{{{36864, 10},
+              {73728, 11},
+              {122880, 20},
+              {245760, 21},
+              {552960, 30},
+              {983040, 31},
+              {2228224, 40},
+              {8912896, 50}}};
+  const auto size = static_cast<std::uint64_t>(width) * height;
+  for (const auto& [max_size, level] : levels) {
+    if (size <= max_size) {
+      return level;
+    }
+  }
+  return 60;
+}
+
+class BitReader {
+ public:
+  BitReader(const std::uint8_t* t_data, const std::size_t t_size)
+      : m_data(t_data), m_size(t_size) {}
+
+  std::uint32_t read(const std::size_t bits) {
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < bits; ++i) {
+      if (m_position >= m_size * 8) {
+        throw std::runtime_error("AV1 sequence header is too short");
+      }
+      value = (value << 1) |
+              ((m_data[m_position / 8] >> (7 - m_position % 8)) & 1U);
+      ++m_position;
+    }
+    return value;
+  }
+
+ private:
+  const std::uint8_t* m_data;
+  const std::size_t m_size;
+  std::size_t m_position = 0;
+};
+
+struct AV1SequenceHeaderInfo {
+  std::uint8_t seq_profile;
+  std::uint8_t seq_level_idx_0;
+  std::uint8_t seq_tier_0;
+};
+
+// Sequence Header OBU の先頭の operating point までを読む
+AV1SequenceHeaderInfo parse_av1_sequence_header(
+    const std::vector<std::uint8_t>& obus) {
+  if (std::empty(obus) || ((obus[0] >> 3) & 0xf) != 1) {
+    throw std::runtime_error("AV1 sequence header OBU is not found");
+  }
+  std::size_t offset = (obus[0] & 0x04) ? 2 : 1;
+  if (obus[0] & 0x02) {
+    // obu_size (leb128)
+    while (offset < std::size(obus) && (obus[offset] & 0x80)) {
+      ++offset;
+    }
+    ++offset;
+  }
+  if (offset >= std::size(obus)) {
+    throw std::runtime_error("AV1 sequence header is too short");
+  }
+  BitReader r(std::data(obus) + offset, std::size(obus) - offset);
+  AV1SequenceHeaderInfo info{};
+  info.seq_profile = static_cast<std::uint8_t>(r.read(3));
+  r.read(1);  // still_picture
+  if (r.read(1)) {
+    // reduced_still_picture_header
+    info.seq_level_idx_0 = static_cast<std::uint8_t>(r.read(5));
+    return info;
+  }
+  if (r.read(1)) {
+    // timing_info
+    r.read(32);
+    r.read(32);
+    if (r.read(1)) {
+      // num_ticks_per_picture_minus_1 (uvlc)
+      std::size_t leading_zeros = 0;
+      while (r.read(1) == 0) {
+        if (++leading_zeros >= 32) {
+          throw std::runtime_error("invalid AV1 timing_info");
+        }
+      }
+      r.read(leading_zeros);
+    }
+    if (r.read(1)) {
+      // decoder_model_info
+      r.read(5);
+      r.read(32);
+      r.read(5);
+      r.read(5);
+    }
+  }
+  r.read(1);  // initial_display_delay_present_flag
+  r.read(5);  // operating_points_cnt_minus_1
+  r.read(12);  // operating_point_idc[0]
+  info.seq_level_idx_0 = static_cast<std::uint8_t>(r.read(5));
+  if (info.seq_level_idx_0 > 7) {
+    info.seq_tier_0 = static_cast<std::uint8_t>(r.read(1));
+  }
+  return info;
+}
+
+// start code の次の位置を返す. 見つからなければ size を返す
+std::size_t find_next_nal_unit(const std::uint8_t* data,
+                               const std::size_t size,
+                               std::size_t offset) {
+  while (offset + 3 <= size) {
+    if (data[offset] == 0 && data[offset + 1] == 0) {
+      if (data[offset + 2] == 1) {
+        return offset + 3;
+      }
+      if (data[offset + 2] == 0 && offset + 4 <= size &&
+          data[offset + 3] == 1) {
+        return offset + 4;
+      }
+    }
+    ++offset;
+  }
+  return size;
+}
+
+template <class F>
+void for_each_nal_unit(const std::uint8_t* data,
+                       const std::size_t size,
+                       const F& f) {
+  auto begin = find_next_nal_unit(data, size, 0);
+  while (begin < size) {
+    const auto next = find_next_nal_unit(data, size, begin);
+    auto end = next;
+    if (next < size) {
+      // start code の分を戻し, 末尾の 0 (trailing_zero_8bits) も除く
+      end = next - 3;
+      while (end > begin && data[end - 1] == 0) {
+        --end;
+      }
+    }
+    f(data + begin, end - begin);
+    begin = next;
+  }
+}
+
+}  // namespace
+
+std::vector<std::uint8_t> make_fragmented_mp4_init_segment(
+    const std::vector<FragmentedMP4Track>& tracks,
+    const std::uint64_t fragment_duration) {
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+
+  const auto ftyp = w.begin("ftyp");
+  w.bytes(reinterpret_cast<const std::uint8_t*>("iso6"), 4);
+  w.u32(0);
+  for (const auto brand : {"iso6", "cmfc", "mp41"}) {
+    w.bytes(reinterpret_cast<const std::uint8_t*>(brand), 4);
+  }
+  w.end(ftyp);
+
+  const auto moov = w.begin("moov");
+  const auto mvhd = w.beginFull("mvhd", 0, 0);
+  w.u32(0);
+  w.u32(0);
+  w.u32(1000);  // timescale
+  w.u32(0);     // duration
+  w.u32(0x00010000);
+  w.u16(0x0100);
+  w.zeros(10);
+  w.matrix();
+  w.zeros(24);
+  std::uint32_t next_track_id = 1;
+  for (const auto& track : tracks) {
+    next_track_id = std::max(next_track_id, track.track_id + 1);
+  }
+  w.u32(next_track_id);
+  w.end(mvhd);
+
+  for (const auto& track : tracks) {
+    const auto trak = w.begin("trak");
+    const auto tkhd = w.beginFull("tkhd", 0, 0x000003);
+    w.u32(0);
+    w.u32(0);
+    w.u32(track.track_id);
+    w.u32(0);
+    w.u32(0);  // duration
+    w.zeros(8);
+    w.u16(0);  // layer
+    w.u16(0);  // alternate_group
+    w.u16(track.is_video ? 0 : 0x0100);
+    w.u16(0);
+    w.matrix();
+    w.u32(track.width << 16);
+    w.u32(track.height << 16);
+    w.end(tkhd);
+
+    const auto mdia = w.begin("mdia");
+    const auto mdhd = w.beginFull("mdhd", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.u32(track.timescale);
+    w.u32(0);
+    w.u16(0x55c4);  // und
+    w.u16(0);
+    w.end(mdhd);
+
+    const auto hdlr = w.beginFull("hdlr", 0, 0);
+    w.u32(0);
+    w.bytes(reinterpret_cast<const std::uint8_t*>(track.is_video ? "vide"
+                                                                 : "soun"),
+            4);
+    w.zeros(12);
+    const std::string_view name =
+        track.is_video ? "VideoHandler" : "SoundHandler";
+    w.bytes(reinterpret_cast<const std::uint8_t*>(std::data(name)),
+            std::size(name));
+    w.u8(0);
+    w.end(hdlr);
+
+    const auto minf = w.begin("minf");
+    if (track.is_video) {
+      const auto vmhd = w.beginFull("vmhd", 0, 1);
+      w.zeros(8);
+      w.end(vmhd);
+    } else {
+      const auto smhd = w.beginFull("smhd", 0, 0);
+      w.zeros(4);
+      w.end(smhd);
+    }
+    const auto dinf = w.begin("dinf");
+    const auto dref = w.beginFull("dref", 0, 0);
+    w.u32(1);
+    w.end(w.beginFull("url ", 0, 1));
+    w.end(dref);
+    w.end(dinf);
+
+    // サンプルは moof に書くので, stbl は sample entry 以外を空にする
+    const auto stbl = w.begin("stbl");
+    const auto stsd = w.beginFull("stsd", 0, 0);
+    w.u32(1);
+    w.bytes(track.sample_entry);
+    w.end(stsd);
+    for (const auto type : {"stts", "stsc", "stco"}) {
+      const auto box = w.beginFull(type, 0, 0);
+      w.u32(0);
+      w.end(box);
+    }
+    const auto stsz = w.beginFull("stsz", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.end(stsz);
+    w.end(stbl);
+    w.end(minf);
+    w.end(mdia);
+    w.end(trak);
+  }
+
+  const auto mvex = w.begin("mvex");
+  if (fragment_duration > 0) {
+    const auto mehd = w.beginFull("mehd", 1, 0);
+    w.u64(fragment_duration);
+    w.end(mehd);
+  }
+  for (const auto& track : tracks) {
+    const auto trex = w.beginFull("trex", 0, 0);
+    w.u32(track.track_id);
+    w.u32(1);  // default_sample_description_index
+    w.u32(0);
+    w.u32(0);
+    w.u32(0);
+    w.end(trex);
+  }
+  w.end(mvex);
+  w.end(moov);
+
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_fragmented_mp4_fragment(
+    const std::uint32_t sequence_number,
+    const std::vector<FragmentedMP4TrackFragment>& fragments) {
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+
+  const auto moof = w.begin("moof");
+  const auto mfhd = w.beginFull("mfhd", 0, 0);
+  w.u32(sequence_number);
+  w.end(mfhd);
+
+  // data_offset は moof の大きさが決まってから書き戻す
+  std::vector<std::size_t> data_offset_positions;
+  for (const auto& fragment : fragments) {
+    const auto traf = w.begin("traf");
+    const auto& samples = fragment.samples;
+    // 全てのサンプルで同じ値は tfhd の default にまとめ, trun には書かない.
+    // 映像のフラグは先頭のキーフレームだけが異なることが多いので
+    // first_sample_flags で表す
+    const auto has_same = [&samples](auto get, const std::size_t first) {
+      for (std::size_t i = first + 1; i < std::size(samples); ++i) {
+        if (get(samples[i]) != get(samples[first])) {
+          return false;
+        }
+      }
+      return true;
+    };
+    const auto get_duration = [](const FragmentedMP4Sample& sample) {
+      return sample.duration;
+    };
+    const auto get_size = [](const FragmentedMP4Sample& sample) {
+      return sample.size;
+    };
+    const auto get_flags = [](const FragmentedMP4Sample& sample) {
+      // キーフレーム以外は sample_depends_on = 1, sample_is_non_sync_sample = 1
+      return sample.is_key ? 0x02000000U : 0x01010000U;
+    };
+    const auto is_same_duration = has_same(get_duration, 0);
+    const auto is_same_size = has_same(get_size, 0);
+    const auto is_same_flags = has_same(get_flags, 0);
+    const auto has_first_sample_flags = !is_same_flags &&
+                                        std::size(samples) > 1 &&
+                                        has_same(get_flags, 1);
+    const auto has_default_flags = is_same_flags || has_first_sample_flags;
+
+    // default-base-is-moof
+    std::uint32_t tfhd_flags = 0x020000;
+    if (is_same_duration) {
+      tfhd_flags |= 0x000008;
+    }
+    if (is_same_size) {
+      tfhd_flags |= 0x000010;
+    }
+    if (has_default_flags) {
+      tfhd_flags |= 0x000020;
+    }
+    const auto tfhd = w.beginFull("tfhd", 0, tfhd_flags);
+    w.u32(fragment.track_id);
+    if (is_same_duration) {
+      w.u32(samples.front().duration);
+    }
+    if (is_same_size) {
+      w.u32(samples.front().size);
+    }
+    if (has_default_flags) {
+      w.u32(get_flags(samples.back()));
+    }
+    w.end(tfhd);
+
+    const auto tfdt = w.beginFull("tfdt", 1, 0);
+    w.u64(fragment.base_media_decode_time);
+    w.end(tfdt);
+
+    // data-offset は常に書く
+    std::uint32_t trun_flags = 0x000001;
+    if (has_first_sample_flags) {
+      trun_flags |= 0x000004;
+    }
+    if (!is_same_duration) {
+      trun_flags |= 0x000100;
+    }
+    if (!is_same_size) {
+      trun_flags |= 0x000200;
+    }
+    if (!has_default_flags) {
+      trun_flags |= 0x000400;
+    }
+    const auto trun = w.beginFull("trun", 0, trun_flags);
+    w.u32(static_cast<std::uint32_t>(std::size(samples)));
+    data_offset_positions.push_back(std::size(buffer));
+    w.u32(0);
+    if (has_first_sample_flags) {
+      w.u32(get_flags(samples.front()));
+    }
+    for (const auto& sample : samples) {
+      if (!is_same_duration) {
+        w.u32(sample.duration);
+      }
+      if (!is_same_size) {
+        w.u32(sample.size);
+      }
+      if (!has_default_flags) {
+        w.u32(get_flags(sample));
+      }
+    }
+    w.end(trun);
+    w.end(traf);
+  }
+  w.end(moof);
+
+  std::size_t data_size = 0;
+  for (const auto& fragment : fragments) {
+    data_size += std::size(fragment.data);
+  }
+  w.u32(static_cast<std::uint32_t>(8 + data_size));
+  w.bytes(reinterpret_cast<const std::uint8_t*>("mdat"), 4);
+
+  std::size_t data_offset = std::size(buffer);
+  for (std::size_t i = 0; i < std::size(fragments); ++i) {
+    for (std::size_t k = 0; k < 4; ++k) {
+      buffer[data_offset_positions[i] + k] =
+          static_cast<std::uint8_t>(data_offset >> (8 * (3 - k)));
+    }
+    data_offset += std::size(fragments[i].data);
+  }
+  for (const auto& fragment : fragments) {
+    w.bytes(fragment.data);
+  }
+
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_avc1_sample_entry(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::uint8_t* key_frame,
+    const std::size_t key_frame_size) {
+  std::vector<std::uint8_t> sps;
+  std::vector<std::uint8_t> pps;
+  for_each_nal_unit(key_frame, key_frame_size,
+                    [&sps, &pps](const std::uint8_t* nal, std::size_t size) {
+                      if (size == 0) {
+                        return;
+                      }
+                      const auto type = nal[0] & 0x1f;
+                      if (type == 7 && std::empty(sps)) {
+                        sps.assign(nal, nal + size);
+                      } else if (type == 8 && std::empty(pps)) {
+                        pps.assign(nal, nal + size);
+                      }
+                    });
+  if (std::size(sps) < 4 || std::empty(pps)) {
+    throw std::runtime_error("SPS or PPS is not found in the H.264 key frame");
+  }
+
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+  const auto avc1 = w.begin("avc1");
+  write_visual_sample_entry_header(&w, width, height);
+  const auto avcC = w.begin("avcC");
+  w.u8(1);
+  w.u8(sps[1]);  // profile_idc
+  w.u8(sps[2]);  // constraint_set_flags
+  w.u8(sps[3]);  // level_idc
+  w.u8(0xff);    // lengthSizeMinusOne = 3
+  w.u8(0xe1);    // numOfSequenceParameterSets = 1
+  w.u16(static_cast<std::uint16_t>(std::size(sps)));
+  w.bytes(sps);
+  w.u8(1);
+  w.u16(static_cast<std::uint16_t>(std::size(pps)));
+  w.bytes(pps);
+  if (sps[1] == 100 || sps[1] == 110 || sps[1] == 122 || sps[1] == 144) {
+    // hisui が出力するのは 8 bit の 4:2:0 のみ
+    w.u8(0xfc | 1);
+    w.u8(0xf8);
+    w.u8(0xf8);
+    w.u8(0);
+  }
+  w.end(avcC);
+  w.end(avc1);
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_vpx_sample_entry(const std::uint32_t fourcc,
+                                                const std::uint32_t width,
+                                                const std::uint32_t height) {
+  if (fourcc != Constants::VP8_FOURCC && fourcc != Constants::VP9_FOURCC) {
+    throw std::invalid_argument(fmt::format("unknown fourcc: {}", fourcc));
+  }
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+  const auto entry =
+      w.begin(fourcc == Constants::VP8_FOURCC ? "vp08" : "vp09");
+  write_visual_sample_entry_header(&w, width, height);
+  const auto vpcC = w.beginFull("vpcC", 1, 0);
+  w.u8(0);  // profile
+  w.u8(get_vpx_level(width, height));
+  // bitDepth = 8, chromaSubsampling = 1 (4:2:0), videoFullRangeFlag = 0
+  w.u8(0x82);
+  w.u8(2);  // colourPrimaries (unspecified)
+  w.u8(2);  // transferCharacteristics
+  w.u8(2);  // matrixCoefficients
+  w.u16(0);  // codecIntializationDataSize
+  w.end(vpcC);
+  w.end(entry);
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_av01_sample_entry(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<std::uint8_t>& config_OBUs) {
+  const auto info = parse_av1_sequence_header(config_OBUs);
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+  const auto av01 = w.begin("av01");
+  write_visual_sample_entry_header(&w, width, height);
+  const auto av1C = w.begin("av1C");
+  w.u8(0x81);
+  w.u8(static_cast<std::uint8_t>((info.seq_profile << 5) |
+                                 info.seq_level_idx_0));
+  // hisui が出力するのは 8 bit の 4:2:0 のみ
+  w.u8(static_cast<std::uint8_t>((info.seq_tier_0 << 7) | 0x0c));
+  w.u8(0);
+  w.bytes(config_OBUs);
+  w.end(av1C);
+  w.end(av01);
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_opus_sample_entry(const std::uint16_t pre_skip) {
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+  const auto opus = w.begin("Opus");
+  write_audio_sample_entry_header(&w);
+  const auto dOps = w.begin("dOps");
+  w.u8(0);  // Version
+  w.u8(2);  // OutputChannelCount
+  w.u16(pre_skip);
+  w.u32(Constants::PCM_SAMPLE_RATE);
+  w.u16(0);  // OutputGain
+  w.u8(0);   // ChannelMappingFamily
+  w.end(dOps);
+  w.end(opus);
+  return buffer;
+}
+
+std::vector<std::uint8_t> make_aac_sample_entry(const std::uint32_t bit_rate) {
+  std::vector<std::uint8_t> buffer;
+  BoxWriter w(&buffer);
+  const auto mp4a = w.begin("mp4a");
+  write_audio_sample_entry_header(&w);
+  const auto esds = w.beginFull("esds", 0, 0);
+  // 各 descriptor の長さは 128 未満なので 1 バイトで表す
+  w.u8(0x03);  // ES_DescrTag
+  w.u8(3 + 2 + 13 + 2 + 2 + 3);
+  w.u16(0);  // ES_ID
+  w.u8(0);
+  w.u8(0x04);  // DecoderConfigDescrTag
+  w.u8(13 + 2 + 2);
+  w.u8(0x40);  // objectTypeIndication (MPEG-4 Audio)
+  w.u8(0x15);  // streamType = 5 (audio), upStream = 0, reserved = 1
+  w.u8(0);     // bufferSizeDB
+  w.u16(0);
+  w.u32(bit_rate);
+  w.u32(bit_rate);
+  w.u8(0x05);  // DecSpecificInfoTag
+  w.u8(2);
+  // AudioSpecificConfig: AAC-LC, 48000 Hz, 2 ch
+  w.u16((2 << 11) | (3 << 7) | (2 << 3));
+  w.u8(0x06);  // SLConfigDescrTag
+  w.u8(1);
+  w.u8(0x02);
+  w.end(esds);
+  w.end(mp4a);
+  return buffer;
+}
+
+void append_annexb_as_length_prefixed(std::vector<std::uint8_t>* output,
+                                      const std::uint8_t* data,
+                                      const std::size_t size) {
+  for_each_nal_unit(data, size,
+                    [output](const std::uint8_t* nal, std::size_t nal_size) {
+                      if (nal_size == 0) {
+                        return;
+                      }
+                      BoxWriter w(output);
+                      w.u32(static_cast<std::uint32_t>(nal_size));
+                      w.bytes(nal, nal_size);
+                    });
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace hisui::muxer {
+
+// CMAF の fragmented MP4 (初期化 segment と moof + mdat) を組み立てる
+
+struct FragmentedMP4Track {
+  const std::uint32_t track_id;
+  const std::uint32_t timescale;
+  const bool is_video;
+  const std::uint32_t width = 0;
+  const std::uint32_t height = 0;
+  // stsd に入れる sample entry の箱
+  std::vector<std::uint8_t> sample_entry;
+};
+
+struct FragmentedMP4Sample {
+  std::uint32_t duration;
+  const std::uint32_t size;
+  const bool is_key;
+};
+
+struct FragmentedMP4TrackFragment {
+  const std::uint32_t track_id;
+  const std::uint64_t base_media_decode_time;
+  const std::vector<FragmentedMP4Sample>& samples;
+  // samples の順に並べたサンプルデータ
+  const std::vector<std::uint8_t>& data;
+};
+
+// ftyp と moov (mvex を含む) を返す.
+// fragment_duration (ms) が 0 でなければ mehd に全体の長さとして書く
+std::vector<std::uint8_t> make_fragmented_mp4_init_segment(
+    const std::vector<FragmentedMP4Track>&,
+    const std::uint64_t fragment_duration = 0);
+
+// moof と mdat を返す. mdat には fragments の順にサンプルデータを並べる.
+// 全てのサンプルで共通の duration, size, flags は tfhd の default で表す
+std::vector<std::uint8_t> make_fragmented_mp4_fragment(
+    const std::uint32_t sequence_number,
+    const std::vector<FragmentedMP4TrackFragment>&);
+
+// Annex B のキーフレームに含まれる SPS と PPS から avc1 を作る
+std::vector<std::uint8_t> make_avc1_sample_entry(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::uint8_t* key_frame,
+    const std::size_t key_frame_size);
+
+// fourcc は VP8 か VP9
+std::vector<std::uint8_t> make_vpx_sample_entry(const std::uint32_t fourcc,
+                                                const std::uint32_t width,
+                                                const std::uint32_t height);
+
+// config_OBUs はエンコーダーが出力した Sequence Header OBU
+std::vector<std::uint8_t> make_av01_sample_entry(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<std::uint8_t>& config_OBUs);
+
+std::vector<std::uint8_t> make_opus_sample_entry(const std::uint16_t pre_skip);
+
+// 48 kHz, 2 ch の AAC-LC
+std::vector<std::uint8_t> make_aac_sample_entry(const std::uint32_t bit_rate);
+
+// Annex B の NAL unit を 4 バイトの長さを前置した形式にして output に追加する
+void append_annexb_as_length_prefixed(std::vector<std::uint8_t>* output,
+                                      const std::uint8_t* data,
+                                      const std::size_t size);
+
+}  // namespace hisui::muxer
@@ -0,0 +1,270 @@
+#include "muxer/fragmented_mp4_muxer.hpp"
+
+#include <fmt/core.h>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "config.hpp"
+#include "constants.hpp"
+#include "muxer/audio_producer.hpp"
+#include "muxer/fragmented_mp4.hpp"
+#include "muxer/video_producer.hpp"
+#include "report/reporter.hpp"
+
+namespace hisui::muxer {
+
+namespace {
+
+// MP4Muxer と同じ timescale
+constexpr std::uint32_t VIDEO_TIMESCALE = 16000;
+constexpr std::uint32_t AUDIO_TIMESCALE = 48000;
+
+}  // namespace
+
+FragmentedMP4Muxer::FragmentedMP4Muxer(const hisui::Config& t_config,
+                                       const MP4MuxerParameters& params)
+    : MP4Muxer(params), m_config(t_config) {}
+
+FragmentedMP4Muxer::FragmentedMP4Muxer(
+    const hisui::Config& t_config,
+    const MP4MuxerParametersForLayout& params)
+    : MP4Muxer(params), m_config(t_config) {}
+
+void FragmentedMP4Muxer::setUp() {
+  const auto config = initializeProducers(m_config);
+
+  std::uint32_t track_id = 1;
+  if (!config.audio_only) {
+    const auto fourcc = m_video_producer->getFourcc();
+    const auto width = m_video_producer->getWidth();
+    const auto height = m_video_producer->getHeight();
+    std::vector<std::uint8_t> sample_entry;
+    if (fourcc == hisui::Constants::AV1_FOURCC) {
+      sample_entry = make_av01_sample_entry(width, height,
+                                            m_video_producer->getExtraData());
+    } else if (fourcc == hisui::Constants::VP8_FOURCC ||
+               fourcc == hisui::Constants::VP9_FOURCC) {
+      sample_entry = make_vpx_sample_entry(fourcc, width, height);
+    } else if (fourcc != hisui::Constants::H264_FOURCC) {
+      throw std::runtime_error(fmt::format("unknown fourcc: {}", fourcc));
+    }
+    // H.264 の sample entry は最初のキーフレームの SPS と PPS から作る
+    m_video.emplace(Track{
+        .track = {.track_id = track_id++,
+                  .timescale = VIDEO_TIMESCALE,
+                  .is_video = true,
+                  .width = width,
+                  .height = height,
+                  .sample_entry = sample_entry},
+        .fourcc = fourcc,
+        .last_duration = static_cast<std::uint32_t>(
+            VIDEO_TIMESCALE * config.out_video_frame_rate.denominator() /
+            config.out_video_frame_rate.numerator()),
+    });
+    m_timescale_ratio.assign(AUDIO_TIMESCALE, VIDEO_TIMESCALE);
+  }
+
+  const auto is_aac =
+      config.out_audio_codec == config::OutAudioCodec::FDK_AAC;
+  m_audio.emplace(Track{
+      .track = {.track_id = track_id,
+                .timescale = AUDIO_TIMESCALE,
+                .is_video = false,
+                .sample_entry =
+                    is_aac ? make_aac_sample_entry(config.out_aac_bit_rate)
+                           : make_opus_sample_entry(
+                                 static_cast<std::uint16_t>(m_audio_pre_skip))},
+      .last_duration =
+          is_aac ? 1024U
+                 : config.getOpusFrameDuration() * AUDIO_TIMESCALE / 1000,
+  });
+
+  // m_chunk_interval は ms
+  m_fragment_length = m_chunk_interval * getMainTrack()->track.timescale / 1000;
+
+  if (hisui::report::Reporter::hasInstance()) {
+    hisui::report::Reporter::getInstance().registerOutput({
+        .container = "MP4",
+        .mux_type =
+            config.mp4_muxer == config::MP4Muxer::HLS ? "hls" : "fragmented",
+        .video_codec = getVideoCodecName(config),
+        .audio_codec = is_aac ? "aac" : "opus",
+        .duration = m_duration,
+    });
+  }
+}
+
+void FragmentedMP4Muxer::run() {
+  m_ofs = std::ofstream(m_out_filename,
+                        std::ios_base::binary | std::ios_base::trunc);
+  if (!m_ofs) {
+    throw std::runtime_error(fmt::format("opening {} failed", m_out_filename));
+  }
+  mux({.progress_interval = m_config.progress_interval,
+       .duration = m_duration,
+       .start_time = m_config.clip_start,
+       .max_memory = m_config.max_memory << 20});
+  finishOutput();
+}
+
+void FragmentedMP4Muxer::cleanUp() {}
+
+FragmentedMP4Muxer::Track* FragmentedMP4Muxer::getMainTrack() {
+  return m_video ? &m_video.value() : &m_audio.value();
+}
+
+std::uint64_t FragmentedMP4Muxer::getEndTimestamp() {
+  const auto main_track = getMainTrack();
+  return main_track->last_timestamp + main_track->last_duration;
+}
+
+void FragmentedMP4Muxer::appendVideo(hisui::Frame frame) {
+  cutBefore(frame);
+  appendSample(&m_video.value(), frame);
+  m_video_producer->bufferPop();
+}
+
+void FragmentedMP4Muxer::appendAudio(hisui::Frame frame) {
+  if (!m_video) {
+    cutBefore(frame);
+  }
+  appendSample(&m_audio.value(), frame);
+  m_audio_producer->bufferPop();
+}
+
+// fragment はキーフレームから始まらなくてよいので, 時間だけで区切る
+void FragmentedMP4Muxer::cutBefore(const hisui::Frame& frame) {
+  if (!m_is_started) {
+    m_is_started = true;
+    m_fragment_start = frame.timestamp;
+    return;
+  }
+  if (frame.timestamp >= m_fragment_start + m_fragment_length) {
+    writeFragment(frame.timestamp);
+  }
+}
+
+void FragmentedMP4Muxer::appendSample(Track* track, const hisui::Frame& frame) {
+  if (std::empty(track->samples)) {
+    track->base_media_decode_time = frame.timestamp;
+  } else if (frame.timestamp > track->last_timestamp) {
+    track->last_duration =
+        static_cast<std::uint32_t>(frame.timestamp - track->last_timestamp);
+    track->samples.back().duration = track->last_duration;
+  }
+
+  const auto offset = std::size(track->data);
+  const auto* data = frame.data.get();
+  auto size = frame.data_size;
+  if (track->fourcc == hisui::Constants::H264_FOURCC) {
+    if (std::empty(track->track.sample_entry) && frame.is_key) {
+      track->track.sample_entry = make_avc1_sample_entry(
+          track->track.width, track->track.height, data, size);
+    }
+    append_annexb_as_length_prefixed(&track->data, data, size);
+  } else {
+    if (track->fourcc == hisui::Constants::AV1_FOURCC && size >= 2 &&
+        data[0] == 0x12 && data[1] == 0x00) {
+      // MP4 のサンプルには Temporal Delimiter OBU を入れない
+      data += 2;
+      size -= 2;
+    }
+    track->data.insert(std::end(track->data), data, data + size);
+  }
+  track->samples.push_back({
+      .duration = track->last_duration,
+      .size = static_cast<std::uint32_t>(std::size(track->data) - offset),
+      .is_key = frame.is_key || !track->track.is_video,
+  });
+  track->last_timestamp = frame.timestamp;
+}
+
+FragmentedMP4Muxer::Fragment FragmentedMP4Muxer::makeFragment(
+    const std::uint64_t end_timestamp) {
+  auto main_track = getMainTrack();
+  if (!std::empty(main_track->samples) &&
+      end_timestamp > main_track->last_timestamp) {
+    main_track->samples.back().duration = static_cast<std::uint32_t>(
+        end_timestamp - main_track->last_timestamp);
+  }
+
+  std::vector<FragmentedMP4TrackFragment> fragments;
+  for (auto track : {&m_video, &m_audio}) {
+    if (*track && !std::empty((*track)->samples)) {
+      fragments.push_back({
+          .track_id = (*track)->track.track_id,
+          .base_media_decode_time = (*track)->base_media_decode_time,
+          .samples = (*track)->samples,
+          .data = (*track)->data,
+      });
+    }
+  }
+  if (std::empty(fragments)) {
+    return {.data = {}, .is_independent = true};
+  }
+
+  Fragment fragment{
+      .data = make_fragmented_mp4_fragment(m_sequence_number++, fragments),
+      .is_independent = !m_video || (!std::empty(m_video->samples) &&
+                                     m_video->samples.front().is_key),
+  };
+  m_fragment_start = end_timestamp;
+
+  // capacity を残して次の fragment でも使う
+  for (auto track : {&m_video, &m_audio}) {
+    if (*track) {
+      (*track)->samples.clear();
+      (*track)->data.clear();
+    }
+  }
+  return fragment;
+}
+
+std::vector<std::uint8_t> FragmentedMP4Muxer::makeInitSegment(
+    const std::uint64_t fragment_duration) const {
+  std::vector<FragmentedMP4Track> tracks;
+  if (m_video) {
+    if (std::empty(m_video->track.sample_entry)) {
+      throw std::runtime_error(
+          "H.264 key frame with SPS and PPS has not been encoded");
+    }
+    tracks.push_back(m_video->track);
+  }
+  tracks.push_back(m_audio->track);
+  return make_fragmented_mp4_init_segment(tracks, fragment_duration);
+}
+
+void FragmentedMP4Muxer::writeFragment(const std::uint64_t end_timestamp) {
+  const auto fragment = makeFragment(end_timestamp);
+  if (std::empty(fragment.data)) {
+    return;
+  }
+  // H.264 の sample entry は最初の fragment を作るまで決まらない
+  if (!m_is_init_segment_written) {
+    const auto init_segment = makeInitSegment(
+        static_cast<std::uint64_t>(std::llround(m_duration * 1000)));
+    m_ofs.write(reinterpret_cast<const char*>(std::data(init_segment)),
+                static_cast<std::streamsize>(std::size(init_segment)));
+    m_is_init_segment_written = true;
+  }
+  m_ofs.write(reinterpret_cast<const char*>(std::data(fragment.data)),
+              static_cast<std::streamsize>(std::size(fragment.data)));
+  if (!m_ofs) {
+    throw std::runtime_error(
+        fmt::format("writing {} failed", m_out_filename));
+  }
+}
+
+void FragmentedMP4Muxer::muxFinalize() {
+  if (m_is_started) {
+    writeFragment(getEndTimestamp());
+  }
+  m_ofs.flush();
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "config.hpp"
+#include "frame.hpp"
+#include "muxer/fragmented_mp4.hpp"
+#include "muxer/mp4_muxer.hpp"
+
+namespace hisui::muxer {
+
+// out_filename に初期化 segment と, 一定の間隔ごとの moof + mdat を書き出す.
+// サンプルの情報は fragment ごとに書き出すので, 長い出力でもメモリに溜まらず,
+// 最後に moov を書く必要もない
+class FragmentedMP4Muxer : public MP4Muxer {
+ public:
+  FragmentedMP4Muxer(const hisui::Config&, const MP4MuxerParameters&);
+  FragmentedMP4Muxer(const hisui::Config&, const MP4MuxerParametersForLayout&);
+
+  void setUp() override;
+  void run() override;
+  void cleanUp() override;
+
+ protected:
+  struct Track {
+    FragmentedMP4Track track;
+    std::uint32_t fourcc = 0;
+    std::vector<FragmentedMP4Sample> samples = {};
+    std::vector<std::uint8_t> data = {};
+    std::uint64_t base_media_decode_time = 0;
+    std::uint64_t last_timestamp = 0;
+    // 次のサンプルが来るまで分からない, 最後のサンプルの長さの見込み
+    std::uint32_t last_duration;
+  };
+
+  struct Fragment {
+    // moof と mdat. サンプルが無ければ空
+    const std::vector<std::uint8_t> data;
+    // 映像が無いか, 映像がキーフレームから始まる
+    const bool is_independent;
+  };
+
+  void muxFinalize() override;
+  // 区切りを決めるトラック (映像が無ければ音声) のフレームを追加する前に呼ぶ
+  virtual void cutBefore(const hisui::Frame&);
+  // 区切りを決めるトラックの timestamp が end_timestamp の時点までを fragment にする
+  Fragment makeFragment(const std::uint64_t end_timestamp);
+  // fragment_duration は mehd に書く全体の長さ (ms). 0 ならば mehd を書かない
+  std::vector<std::uint8_t> makeInitSegment(
+      const std::uint64_t fragment_duration = 0) const;
+  Track* getMainTrack();
+  // 区切りを決めるトラックの最後のサンプルの終わりの timestamp
+  std::uint64_t getEndTimestamp();
+
+  hisui::Config m_config;
+  std::optional<Track> m_video;
+  std::optional<Track> m_audio;
+  bool m_is_started = false;
+  std::uint64_t m_fragment_start = 0;
+
+ private:
+  void appendAudio(hisui::Frame) override;
+  void appendVideo(hisui::Frame) override;
+  void appendSample(Track*, const hisui::Frame&);
+  void writeFragment(const std::uint64_t end_timestamp);
+
+  // 区切りを決めるトラックの timescale での fragment の長さ
+  std::uint64_t m_fragment_length = 0;
+  std::uint32_t m_sequence_number = 1;
+  bool m_is_init_segment_written = false;
+};
+
+}  // namespace hisui::muxer
@@ -0,0 +1,209 @@
+#include "muxer/hls_muxer.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "muxer/fragmented_mp4_muxer.hpp"
+#include "muxer/hls_playlist.hpp"
+
+namespace hisui::muxer {
+
+HLSMuxer::HLSMuxer(const hisui::Config& t_config,
+                   const MP4MuxerParameters& params)
+    : FragmentedMP4Muxer(t_config, params) {}
+
+HLSMuxer::HLSMuxer(const hisui::Config& t_config,
+                   const MP4MuxerParametersForLayout& params)
+    : FragmentedMP4Muxer(t_config, params) {}
+
+void HLSMuxer::setUp() {
+  FragmentedMP4Muxer::setUp();
+  const std::filesystem::path playlist_path(m_out_filename);
+  m_directory = playlist_path.parent_path();
+  m_stem = playlist_path.stem().string();
+
+  const auto timescale = getMainTrack()->track.timescale;
+  m_segment_length = static_cast<std::uint64_t>(
+      std::llround(m_config.hls_segment_duration * timescale));
+  m_part_length = static_cast<std::uint64_t>(
+      std::llround(m_config.hls_part_duration * timescale));
+  m_target_duration =
+      static_cast<std::uint32_t>(std::ceil(m_config.hls_segment_duration));
+}
+
+void HLSMuxer::run() {
+  if (!m_directory.empty()) {
+    std::filesystem::create_directories(m_directory);
+  }
+  mux({.progress_interval = m_config.progress_interval,
+       .duration = m_duration,
+       .start_time = m_config.clip_start,
+       .max_memory = m_config.max_memory << 20});
+}
+
+// 書き終えた segment と playlist は失敗しても残す
+void HLSMuxer::cleanUp() {}
+
+std::string HLSMuxer::getSegmentURI(const std::size_t index) const {
+  return fmt::format("{}_{:05}.m4s", m_stem, index);
+}
+
+void HLSMuxer::cutBefore(const hisui::Frame& frame) {
+  if (!m_is_started) {
+    m_is_started = true;
+    m_segment_start = frame.timestamp;
+    m_fragment_start = frame.timestamp;
+    return;
+  }
+  const auto can_start_segment = frame.is_key || !m_video;
+  if (can_start_segment &&
+      frame.timestamp >= m_segment_start + m_segment_length) {
+    finishSegment(frame.timestamp);
+    writePlaylist(false);
+  } else if (m_part_length > 0 &&
+             frame.timestamp >= m_fragment_start + m_part_length) {
+    flushFragment(frame.timestamp);
+    writePlaylist(false);
+  }
+}
+
+void HLSMuxer::flushFragment(const std::uint64_t end_timestamp) {
+  const auto part_start = m_fragment_start;
+  const auto fragment = makeFragment(end_timestamp);
+  if (std::empty(fragment.data)) {
+    return;
+  }
+  if (!m_is_init_segment_written) {
+    writeInitSegment();
+  }
+
+  if (!m_segment_ofs.is_open()) {
+    const auto path = m_directory / getSegmentURI(m_segment_index);
+    m_segment_ofs.open(path, std::ios_base::binary | std::ios_base::trunc);
+    if (!m_segment_ofs) {
+      throw std::runtime_error(
+          fmt::format("opening {} failed", path.string()));
+    }
+    m_segment_size = 0;
+  }
+  m_segment_ofs.write(reinterpret_cast<const char*>(std::data(fragment.data)),
+                      static_cast<std::streamsize>(std::size(fragment.data)));
+  m_segment_ofs.flush();
+  if (!m_segment_ofs) {
+    throw std::runtime_error(
+        fmt::format("writing {} failed", getSegmentURI(m_segment_index)));
+  }
+
+  m_parts.push_back({
+      .duration = static_cast<double>(end_timestamp - part_start) /
+                  getMainTrack()->track.timescale,
+      .offset = m_segment_size,
+      .size = std::size(fragment.data),
+      .is_independent = fragment.is_independent,
+  });
+  m_segment_size += std::size(fragment.data);
+}
+
+void HLSMuxer::finishSegment(const std::uint64_t end_timestamp) {
+  flushFragment(end_timestamp);
+  if (!m_segment_ofs.is_open()) {
+    return;
+  }
+  m_segment_ofs.close();
+
+  const auto duration = static_cast<double>(end_timestamp - m_segment_start) /
+                        getMainTrack()->track.timescale;
+  if (std::lround(duration) > m_target_duration) {
+    spdlog::warn(
+        "HLS segment {} is longer than the target duration: {:.3f}s. "
+        "keyframes should be placed every --hls-segment-duration seconds",
+        m_segment_index, duration);
+  }
+  m_segments.push_back({.uri = getSegmentURI(m_segment_index),
+                        .duration = duration,
+                        .parts = std::move(m_parts)});
+  m_parts.clear();
+  ++m_segment_index;
+  m_segment_start = end_timestamp;
+  m_fragment_start = end_timestamp;
+
+  const auto playlist_size = m_config.hls_playlist_size;
+  if (playlist_size == 0 || std::size(m_segments) <= playlist_size) {
+    return;
+  }
+  m_expired_uris.push_back(m_segments.front().uri);
+  m_segments.pop_front();
+  ++m_media_sequence;
+  while (std::size(m_expired_uris) > playlist_size) {
+    std::error_code ec;
+    std::filesystem::remove(m_directory / m_expired_uris.front(), ec);
+    if (ec) {
+      spdlog::warn("removing {} failed: {}", m_expired_uris.front(),
+                   ec.message());
+    }
+    m_expired_uris.pop_front();
+  }
+}
+
+void HLSMuxer::writeInitSegment() {
+  const auto init_segment = makeInitSegment();
+
+  const auto path = m_directory / fmt::format("{}_init.mp4", m_stem);
+  std::ofstream ofs(path, std::ios_base::binary | std::ios_base::trunc);
+  ofs.write(reinterpret_cast<const char*>(std::data(init_segment)),
+            static_cast<std::streamsize>(std::size(init_segment)));
+  if (!ofs) {
+    throw std::runtime_error(fmt::format("writing {} failed", path.string()));
+  }
+  m_is_init_segment_written = true;
+}
+
+void HLSMuxer::writePlaylist(const bool is_finished) {
+  const auto playlist = make_hls_playlist({
+      .init_segment_uri = fmt::format("{}_init.mp4", m_stem),
+      .target_duration = m_target_duration,
+      .part_duration = m_part_length > 0 ? m_config.hls_part_duration : 0.0,
+      .is_event = m_config.hls_playlist_size == 0,
+      .media_sequence = m_media_sequence,
+      .segments = m_segments,
+      .current_segment_uri = getSegmentURI(m_segment_index),
+      .current_parts = m_parts,
+      .is_finished = is_finished,
+  });
+
+  const std::filesystem::path path(m_out_filename);
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios_base::trunc);
+    ofs.write(std::data(playlist),
+              static_cast<std::streamsize>(std::size(playlist)));
+    if (!ofs) {
+      throw std::runtime_error(
+          fmt::format("writing {} failed", tmp_path.string()));
+    }
+  }
+  // 書きかけの playlist を読まれないように, 書き終えてから置き換える
+  std::filesystem::rename(tmp_path, path);
+}
+
+void HLSMuxer::muxFinalize() {
+  if (m_is_started) {
+    finishSegment(getEndTimestamp());
+  }
+  writePlaylist(true);
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "frame.hpp"
+#include "muxer/fragmented_mp4_muxer.hpp"
+#include "muxer/hls_playlist.hpp"
+#include "muxer/mp4_muxer.hpp"
+
+namespace hisui::muxer {
+
+// playlist (out_filename) と同じディレクトリに, 初期化 segment と
+// キーフレームで区切った fMP4 の segment を書きながら playlist を更新する.
+// メモリに溜めるのは書き出す前の 1 つの fragment (part か segment) のみ
+class HLSMuxer : public FragmentedMP4Muxer {
+ public:
+  HLSMuxer(const hisui::Config&, const MP4MuxerParameters&);
+  HLSMuxer(const hisui::Config&, const MP4MuxerParametersForLayout&);
+
+  void setUp() override;
+  void run() override;
+  void cleanUp() override;
+
+ private:
+  void muxFinalize() override;
+  // キーフレームの前で segment を, 時間で part を区切る
+  void cutBefore(const hisui::Frame&) override;
+  // 区切りを決めるトラックの timestamp が end_timestamp の時点までを fragment として書き出す
+  void flushFragment(const std::uint64_t end_timestamp);
+  void finishSegment(const std::uint64_t end_timestamp);
+  void writeInitSegment();
+  void writePlaylist(const bool is_finished);
+  std::string getSegmentURI(const std::size_t) const;
+
+  std::filesystem::path m_directory;
+  std::string m_stem;
+
+  // 区切りを決めるトラックの timescale での長さ
+  std::uint64_t m_segment_length = 0;
+  std::uint64_t m_part_length = 0;
+  std::uint32_t m_target_duration = 0;
+
+  bool m_is_init_segment_written = false;
+  std::uint64_t m_segment_start = 0;
+
+  std::size_t m_segment_index = 0;
+  std::ofstream m_segment_ofs;
+  std::uint64_t m_segment_size = 0;
+  std::vector<HLSPart> m_parts;
+  std::deque<HLSSegment> m_segments;
+  std::size_t m_media_sequence = 0;
+  // playlist から外れた segment. 再生中のクライアントのためにしばらく残してから削除する
+  std::deque<std::string> m_expired_uris;
+};
+
+}  // namespace hisui::muxer
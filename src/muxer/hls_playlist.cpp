@@ -0,0 +1,62 @@
+#include "muxer/hls_playlist.hpp"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace hisui::muxer {
+
+namespace {
+
+void append_parts(std::string* playlist,
+                  const std::string& uri,
+                  const std::vector<HLSPart>& parts) {
+  for (const auto& part : parts) {
+    *playlist += fmt::format(
+        "#EXT-X-PART:DURATION={:.5f},URI=\"{}\",BYTERANGE=\"{}@{}\"{}\n",
+        part.duration, uri, part.size, part.offset,
+        part.is_independent ? ",INDEPENDENT=YES" : "");
+  }
+}
+
+}  // namespace
+
+std::string make_hls_playlist(const HLSPlaylistParameters& params) {
+  const auto is_low_latency = params.part_duration > 0;
+  std::string playlist = "#EXTM3U\n";
+  playlist += fmt::format("#EXT-X-VERSION:{}\n", is_low_latency ? 9 : 7);
+  playlist += fmt::format("#EXT-X-TARGETDURATION:{}\n", params.target_duration);
+  if (params.is_event) {
+    playlist += "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+  }
+  playlist += fmt::format("#EXT-X-MEDIA-SEQUENCE:{}\n", params.media_sequence);
+  playlist += "#EXT-X-INDEPENDENT-SEGMENTS\n";
+  if (is_low_latency) {
+    playlist += fmt::format("#EXT-X-SERVER-CONTROL:PART-HOLD-BACK={:.3f}\n",
+                            3 * params.part_duration);
+    playlist += fmt::format("#EXT-X-PART-INF:PART-TARGET={:.3f}\n",
+                            params.part_duration);
+  }
+  playlist += fmt::format("#EXT-X-MAP:URI=\"{}\"\n", params.init_segment_uri);
+  const auto& segments = params.segments;
+  for (std::size_t i = 0; i < std::size(segments); ++i) {
+    const auto& segment = segments[i];
+    // part は末尾の 2 つの segment と書き込み中の segment の分のみを載せる
+    if (is_low_latency && i + 2 >= std::size(segments)) {
+      append_parts(&playlist, segment.uri, segment.parts);
+    }
+    playlist += fmt::format("#EXTINF:{:.5f},\n{}\n", segment.duration,
+                            segment.uri);
+  }
+  if (params.is_finished) {
+    playlist += "#EXT-X-ENDLIST\n";
+  } else if (is_low_latency) {
+    append_parts(&playlist, params.current_segment_uri, params.current_parts);
+  }
+  return playlist;
+}
+
+}  // namespace hisui::muxer
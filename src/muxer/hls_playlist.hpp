@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace hisui::muxer {
+
+struct HLSPart {
+  const double duration;
+  const std::uint64_t offset;
+  const std::uint64_t size;
+  const bool is_independent;
+};
+
+struct HLSSegment {
+  const std::string uri;
+  const double duration;
+  const std::vector<HLSPart> parts;
+};
+
+struct HLSPlaylistParameters {
+  const std::string& init_segment_uri;
+  const std::uint32_t target_duration;
+  // 0 でなければ Low-Latency HLS の part を載せる
+  const double part_duration;
+  // --hls-playlist-size が 0 で segment を playlist から外さない場合は true
+  const bool is_event;
+  const std::size_t media_sequence;
+  const std::deque<HLSSegment>& segments;
+  // 書き込み中の segment
+  const std::string& current_segment_uri;
+  const std::vector<HLSPart>& current_parts;
+  const bool is_finished;
+};
+
+// Media Playlist (.m3u8) の内容を返す
+std::string make_hls_playlist(const HLSPlaylistParameters&);
+
+}  // namespace hisui::muxer
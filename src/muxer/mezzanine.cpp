@@ -0,0 +1,184 @@
+#include "muxer/mezzanine.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "audio/packet_cache.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "muxer/async_webm_muxer.hpp"
+#include "util/thread_pool.hpp"
+#include "version/version.hpp"
+
+namespace hisui::muxer {
+
+namespace {
+
+// 合成する際に拡縮し直しても劣化が目立たないよう, 通常の 1 source 分より高くする
+constexpr std::uint32_t BIT_RATE_FACTOR = 4;
+
+std::filesystem::path get_mezzanine_path(const hisui::Config& config,
+                                         const hisui::ArchiveItem& archive) {
+  auto archive_key = hisui::audio::make_archives_key({archive});
+  if (archive_key == "") {
+    // URL は内容が変わったかを確かめられないので, URL と区間のみで区別する
+    archive_key = fmt::format("{} start={} stop={}\n",
+                              archive.getPath().string(),
+                              archive.getStartTimeOffset(),
+                              archive.getStopTimeOffset());
+  }
+  // 入力か拡縮の設定が変われば別のファイルにする
+  const auto key = fmt::format(
+      "{}scaling={}x{} scaler={} filter={} frame_rate={}/{} hisui={}",
+      archive_key, config.scaling_width, config.scaling_height,
+      static_cast<int>(config.video_scaler),
+      static_cast<int>(config.libyuv_filter_mode),
+      config.out_video_frame_rate.numerator(),
+      config.out_video_frame_rate.denominator(),
+      hisui::version::get_hisui_version());
+  return std::filesystem::path(config.mezzanine_directory) /
+         fmt::format("mezzanine.{:016x}.webm", std::hash<std::string>{}(key));
+}
+
+void write_mezzanine(const hisui::Config& config,
+                     const hisui::ArchiveItem& archive,
+                     const std::filesystem::path& path) {
+  hisui::Config job_config = config;
+  job_config.out_container = hisui::config::OutContainer::WebM;
+  job_config.out_video_codec = hisui::config::OutVideoCodec::VP8;
+  job_config.out_video_bit_rate =
+      BIT_RATE_FACTOR * hisui::Constants::VIDEO_VPX_BIT_RATE_PER_FILE;
+  job_config.audio_only = false;
+  job_config.out_audio_only_filename = "";
+  job_config.out_pcm_filename = "";
+  job_config.video_ladder_heights.clear();
+  job_config.participant_outputs = false;
+  job_config.participant_audio_outputs = false;
+  job_config.out_hashes.clear();
+  job_config.video_part_index = 0;
+  job_config.video_part_count = 1;
+  job_config.clip_start = 0.0;
+  job_config.clip_end = 0.0;
+  job_config.adaptive_grid = false;
+  job_config.audio_cache_directory = "";
+  job_config.opus_passthrough = false;
+  job_config.show_progress_bar = false;
+  job_config.progress_interval = 0.0;
+  // 同じ source を分担した他のプロセスが書きかけのファイルを使わないよう,
+  // 別の名前で書いてから置き換える
+  auto tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", ::getpid());
+  job_config.out_filename = tmp_path.string();
+
+  // source の区間のみを 1 区画の大きさで合成する. 音声は元の録画から合成するので使わない
+  auto item = archive;
+  item.adjustTimeOffsets(-archive.getStartTimeOffset());
+  const std::vector<hisui::ArchiveItem> normal_archives = {item};
+  AsyncWebMMuxer muxer(job_config,
+                       AsyncWebMMuxerParameters{
+                           .audio_archive_items = {},
+                           .normal_archives = normal_archives,
+                           .preferred_archives = {},
+                           .duration = item.getStopTimeOffset(),
+                       });
+  try {
+    muxer.setUp();
+    muxer.run();
+    std::filesystem::rename(tmp_path, path);
+  } catch (const std::exception& e) {
+    try {
+      muxer.cleanUp();
+    } catch (const std::exception& cleanup_error) {
+      spdlog::error("cleaning up muxer failed: {}", cleanup_error.what());
+    }
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+    throw std::runtime_error(fmt::format("writing mezzanine of {} failed: {}",
+                                         archive.getPath().string(),
+                                         e.what()));
+  }
+}
+
+}  // namespace
+
+void write_mezzanines(const hisui::Config& config,
+                      const std::vector<hisui::ArchiveItem>& archives,
+                      const std::vector<std::size_t>& indices) {
+  std::vector<std::size_t> targets;
+  if (std::empty(indices)) {
+    for (std::size_t i = 0; i < std::size(archives); ++i) {
+      targets.push_back(i);
+    }
+  } else {
+    for (const auto i : indices) {
+      if (i >= std::size(archives)) {
+        throw std::invalid_argument(
+            fmt::format("--mezzanine-sources must be less than {}: {}",
+                        std::size(archives), i));
+      }
+      targets.push_back(i);
+    }
+  }
+
+  std::vector<std::size_t> missing_targets;
+  std::vector<std::filesystem::path> paths;
+  for (const auto i : targets) {
+    auto path = get_mezzanine_path(config, archives[i]);
+    if (std::filesystem::exists(path)) {
+      spdlog::info("reusing mezzanine: {}", path.string());
+      continue;
+    }
+    missing_targets.push_back(i);
+    paths.push_back(std::move(path));
+  }
+  if (std::empty(missing_targets)) {
+    return;
+  }
+
+  std::filesystem::create_directories(config.mezzanine_directory);
+  const auto jobs = std::min(config.mezzanine_jobs, std::size(missing_targets));
+  // 同時に書き出す数でスレッドを分け合い, CPU の数より多くならないようにする
+  hisui::Config job_config = config;
+  job_config.job_threads = std::max<std::uint32_t>(
+      1, config.getJobThreads() / static_cast<std::uint32_t>(jobs));
+  hisui::util::ThreadPool thread_pool(jobs - 1);
+  thread_pool.parallelFor(
+      std::size(missing_targets), [&](const std::size_t i) {
+        const auto& archive = archives[missing_targets[i]];
+        spdlog::info("writing mezzanine: source={} file={}", missing_targets[i],
+                     archive.getPath().string());
+        write_mezzanine(job_config, archive, paths[i]);
+      });
+}
+
+std::vector<hisui::ArchiveItem> get_mezzanine_archives(
+    const hisui::Config& config,
+    const std::vector<hisui::ArchiveItem>& archives) {
+  write_mezzanines(config, archives);
+
+  std::vector<hisui::ArchiveItem> mezzanines;
+  for (const auto& archive : archives) {
+    mezzanines.emplace_back(get_mezzanine_path(config, archive),
+                            archive.getConnectionID(),
+                            archive.getStartTimeOffset(),
+                            archive.getStopTimeOffset());
+  }
+  return mezzanines;
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+
+namespace hisui::muxer {
+
+// 映像の source ごとに, 1 区画の大きさへ拡縮して VP8 で軽く圧縮した mezzanine を
+// config.mezzanine_directory に書き出す. デコードと拡縮は source ごとに独立しているので,
+// 複数のプロセスやマシンで分担できる. indices が空ならば全ての source について書き出す.
+// 既に書き出したものは書き出さない
+void write_mezzanines(const hisui::Config&,
+                      const std::vector<hisui::ArchiveItem>& archives,
+                      const std::vector<std::size_t>& indices = {});
+
+// archives のそれぞれを, 同じ区間に置いた mezzanine に置き換えたもの.
+// まだ書き出していない mezzanine は先に書き出す
+std::vector<hisui::ArchiveItem> get_mezzanine_archives(
+    const hisui::Config&,
+    const std::vector<hisui::ArchiveItem>& archives);
+
+}  // namespace hisui::muxer
@@ -1,11 +1,15 @@
 #include "muxer/mp4_muxer.hpp"
 
+#include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
+#include <cstddef>
 #include <cstdint>
-#include <filesystem>
+#include <future>
 #include <iterator>
 #include <memory>
+#include <ostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -17,10 +21,11 @@
 #include "metadata.hpp"
 #include "muxer/audio_producer.hpp"
 #include "muxer/av1_video_producer.hpp"
-#include "muxer/multi_channel_vpx_video_producer.hpp"
+#include "muxer/multi_channel_video_producer.hpp"
 #include "muxer/no_video_producer.hpp"
 #include "muxer/openh264_video_producer.hpp"
 #include "muxer/opus_audio_producer.hpp"
+#include "muxer/remux_video_producer.hpp"
 #include "muxer/video_producer.hpp"
 #include "muxer/vpx_video_producer.hpp"
 #include "report/reporter.hpp"
@@ -31,6 +36,7 @@
 #include "shiguredo/mp4/track/vide.hpp"
 #include "shiguredo/mp4/track/vpx.hpp"
 #include "shiguredo/mp4/writer/writer.hpp"
+#include "util/output_hasher.hpp"
 #include "video/openh264_handler.hpp"
 
 #ifdef USE_FDK_AAC
@@ -44,6 +50,11 @@
 #include "video/vpl_session.hpp"
 #endif
 
+#ifdef USE_VAAPI
+#include "muxer/vaapi_video_producer.hpp"
+#include "video/vaapi_h264_encoder.hpp"
+#endif
+
 namespace hisui::muxer {
 
 MP4Muxer::MP4Muxer(const MP4MuxerParameters& params)
@@ -58,10 +69,7 @@ MP4Muxer::MP4Muxer(const MP4MuxerParametersForLayout& params)
   m_video_producer = params.video_producer;
 }
 
-void MP4Muxer::initialize(
-    const hisui::Config& config_orig,
-    std::shared_ptr<shiguredo::mp4::writer::Writer> writer) {
-  m_writer = writer;
+hisui::Config MP4Muxer::initializeProducers(const hisui::Config& config_orig) {
   hisui::Config config = config_orig;
   if (config.out_video_bit_rate == 0) {
     config.out_video_bit_rate =
@@ -71,30 +79,37 @@ void MP4Muxer::initialize(
     config.out_video_bit_rate = config.out_video_bit_rate;
   }
 
-  if (config.out_filename == "") {
-    std::filesystem::path metadata_path(config.in_metadata_filename);
-    if (config.audio_only) {
-      config.out_filename = metadata_path.replace_extension(".m4a");
-    } else {
-      config.out_filename = metadata_path.replace_extension(".mp4");
-    }
-  }
+  config.out_filename = config.getOutFilename();
 
-  if (config.out_audio_codec == config::OutAudioCodec::FDK_AAC) {
+  if (config.mp4_chunk_duration != 0) {
+    m_chunk_interval = config.mp4_chunk_duration;
+  } else if (config.out_audio_codec == config::OutAudioCodec::FDK_AAC) {
     m_chunk_interval = 960;  // 960ms
   } else {
     m_chunk_interval = 1000;  // 1000 ms
   }
+  m_is_fine_interleaved =
+      config.mp4_interleave == config::MP4Interleave::Fine;
+  m_max_video_buffer_size =
+      static_cast<std::size_t>(config.mp4_chunk_max_size) * 1024;
 
-  m_ofs = std::ofstream(config.out_filename, std::ios_base::binary);
+  m_out_filename = config.out_filename;
+  // 音声の入力の読み込みとエンコーダーの作成は映像と独立しているので,
+  // 映像の producer の作成 (エンコーダーの初期化) と並行して行う
+  auto audio_producer_future = std::async(
+      std::launch::async, [this, config] { return makeAudioProducer(config); });
   if (config.audio_only) {
     m_video_producer = std::make_shared<NoVideoProducer>();
     m_timescale_ratio.assign(1, 1);
   } else {
+    if (!m_video_producer && std::empty(m_preferred_archives)) {
+      m_video_producer = make_remux_video_producer(config, m_normal_archives,
+                                                   m_duration, 16000);
+    }
     if (!m_video_producer) {
       if (!std::empty(m_preferred_archives)) {
-        m_video_producer = std::make_shared<MultiChannelVPXVideoProducer>(
-            config, MultiChannelVPXVideoProducerParameters{
+        m_video_producer = std::make_shared<MultiChannelVideoProducer>(
+            config, MultiChannelVideoProducerParameters{
                         .normal_archives = m_normal_archives,
                         .preferred_archives = m_preferred_archives,
                         .duration = m_duration,
@@ -128,6 +143,18 @@ void MP4Muxer::initialize(
                 fourcc);
           }
 #endif
+#ifdef USE_VAAPI
+          if (config.h264_encoder == hisui::config::H264Encoder::VAAPI) {
+            if (!hisui::video::VAAPIH264Encoder::isSupported()) {
+              throw std::runtime_error("VA-API H.264 encoder is not supported");
+            }
+            m_video_producer = std::make_shared<VAAPIVideoProducer>(
+                config,
+                VAAPIVideoProducerParameters{.archives = m_normal_archives,
+                                             .duration = m_duration,
+                                             .timescale = 16000});
+          }
+#endif
 
           // Unspecified
 
@@ -145,6 +172,16 @@ void MP4Muxer::initialize(
                                              .timescale = 16000},
                   fourcc);
             } else  // NOLINT
+#endif
+#ifdef USE_VAAPI
+                if (hisui::video::VAAPIH264Encoder::isSupported()) {
+              spdlog::debug("use VAAPIVideoProducer");
+              m_video_producer = std::make_shared<VAAPIVideoProducer>(
+                  config,
+                  VAAPIVideoProducerParameters{.archives = m_normal_archives,
+                                               .duration = m_duration,
+                                               .timescale = 16000});
+            } else  // NOLINT
 #endif
                 if (hisui::video::OpenH264Handler::hasInstance()) {
               spdlog::debug("use OpenH264VideoProducer");
@@ -157,6 +194,16 @@ void MP4Muxer::initialize(
               throw std::runtime_error("H.264 encoder is unavailable");
             }
           }
+#ifdef USE_ONEVPL
+        } else if (hisui::video::use_vpl_encoder(config,
+                                                 config.out_video_codec)) {
+          m_video_producer = std::make_shared<VPLVideoProducer>(
+              config,
+              VPLVideoProducerParameters{.archives = m_normal_archives,
+                                         .duration = m_duration,
+                                         .timescale = 16000},
+              config.out_video_codec);
+#endif
         } else if (config.out_video_codec ==
                    hisui::config::OutVideoCodec::AV1) {
           m_video_producer = std::make_shared<AV1VideoProducer>(
@@ -171,6 +218,45 @@ void MP4Muxer::initialize(
         }
       }
     }
+  }
+
+  m_audio_producer = audio_producer_future.get();
+  return config;
+}
+
+std::shared_ptr<AudioProducer> MP4Muxer::makeAudioProducer(
+    const hisui::Config& config) {
+  if (config.out_audio_codec == config::OutAudioCodec::FDK_AAC) {
+#ifdef USE_FDK_AAC
+    return std::make_shared<FDKAACAudioProducer>(
+        config, FDKAACAudioProducerParameters{.archives = m_audio_archives,
+                                              .duration = m_duration});
+#else
+    throw std::logic_error("AAC: inconsistent setting");
+#endif
+  }
+  auto audio_producer = std::make_shared<OpusAudioProducer>(
+      config, m_audio_archives, m_duration, 48000);
+  m_audio_pre_skip = static_cast<std::uint64_t>(audio_producer->getSkip());
+  return audio_producer;
+}
+
+void MP4Muxer::initialize(
+    const hisui::Config& config_orig,
+    std::shared_ptr<shiguredo::mp4::writer::Writer> writer) {
+  m_writer = writer;
+  const auto config = initializeProducers(config_orig);
+  m_ofs = std::ofstream(m_out_filename, std::ios_base::binary);
+  if (!std::empty(config.out_hashes)) {
+    m_hasher = std::make_unique<hisui::util::OutputHasher>(m_out_filename,
+                                                           config.out_hashes);
+    // writer は m_ofs を参照しているので, m_ofs の streambuf を差し替えて書き込みを通す.
+    // 開き直しても m_ofs の filebuf は同じものを使い続ける
+    m_hashing_streambuf = std::make_unique<hisui::util::HashingStreambuf>(
+        m_ofs.rdbuf(), m_hasher.get());
+    static_cast<std::ostream&>(m_ofs).rdbuf(m_hashing_streambuf.get());
+  }
+  if (!config.audio_only) {
     if (config.out_video_codec == config::OutVideoCodec::H264) {
       m_vide_track = std::make_shared<shiguredo::mp4::track::H264Track>(
           shiguredo::mp4::track::H264TrackParameters{
@@ -206,9 +292,6 @@ void MP4Muxer::initialize(
 
   if (config.out_audio_codec == config::OutAudioCodec::FDK_AAC) {
 #ifdef USE_FDK_AAC
-    m_audio_producer = std::make_shared<FDKAACAudioProducer>(
-        config, FDKAACAudioProducerParameters{.archives = m_audio_archives,
-                                              .duration = m_duration});
     m_soun_track = std::make_shared<shiguredo::mp4::track::AACTrack>(
         shiguredo::mp4::track::AACTrackParameters{
             .timescale = 48000,
@@ -219,17 +302,11 @@ void MP4Muxer::initialize(
             .avg_bitrate = config.out_aac_bit_rate,
             .writer = m_writer.get(),
         });
-#else
-    throw std::logic_error("AAC: inconsistent setting");
 #endif
   } else {
-    auto audio_producer = std::make_shared<OpusAudioProducer>(
-        config, m_audio_archives, m_duration, 48000);
-    const auto skip = audio_producer->getSkip();
-    m_audio_producer = audio_producer;
     m_soun_track = std::make_shared<shiguredo::mp4::track::OpusTrack>(
         shiguredo::mp4::track::OpusTrackParameters{
-            .pre_skip = static_cast<std::uint64_t>(skip),
+            .pre_skip = m_audio_pre_skip,
             .duration = static_cast<float>(m_duration),
             .track_id = m_writer->getAndUpdateNextTrackID(),
             .writer = m_writer.get()});
@@ -277,30 +354,69 @@ void MP4Muxer::appendVideo(hisui::Frame frame) {
     writeTrackData();
   }
 
-  m_video_buffer.push_back(frame);
+  if (m_is_fine_interleaved) {
+    // 溜めた映像が大きくなれば, 時間に達する前でもそこまでの音声と映像を書く.
+    // 音声はタイムスタンプ順に受け取っているので, 映像と同じ時刻まで揃っている
+    if (m_video_buffer_size + frame.data_size > m_max_video_buffer_size &&
+        !std::empty(m_video_buffer)) {
+      writeTrackData();
+    }
+    m_video_buffer_size += frame.data_size;
+    m_video_buffer.push_back(frame);
+    m_video_producer->bufferPop();
+    return;
+  }
+
+  // チャンク内では映像だけを書き込むので, 映像は溜めずにそのままトラックへ渡す
+  m_vide_track->addData(frame.timestamp, frame.data.get(), frame.data_size,
+                        frame.is_key);
+  m_mdat_data_size += frame.data_size;
   m_video_producer->bufferPop();
 }
 
 void MP4Muxer::writeTrackData() {
-  for (const auto f : m_audio_buffer) {
-    m_soun_track->addData(f.timestamp, f.data, f.data_size, f.is_key);
-    delete[] f.data;
-  }
-  m_soun_track->terminateCurrentChunk();
-  m_audio_buffer.clear();
-  if (!m_vide_track) {
+  if (m_is_fine_interleaved) {
+    writeAudioChunk();
+    if (m_vide_track && !std::empty(m_video_buffer)) {
+      for (const auto& f : m_video_buffer) {
+        m_vide_track->addData(f.timestamp, f.data.get(), f.data_size,
+                              f.is_key);
+        m_mdat_data_size += f.data_size;
+      }
+      m_vide_track->terminateCurrentChunk();
+    }
+    m_video_buffer.clear();
+    m_video_buffer_size = 0;
     return;
   }
-  for (const auto f : m_video_buffer) {
-    m_vide_track->addData(f.timestamp, f.data, f.data_size, f.is_key);
-    delete[] f.data;
+  if (m_vide_track) {
+    m_vide_track->terminateCurrentChunk();
+  }
+  writeAudioChunk();
+}
+
+void MP4Muxer::writeAudioChunk() {
+  for (const auto& f : m_audio_buffer) {
+    m_soun_track->addData(f.timestamp, f.data.get(), f.data_size, f.is_key);
+    m_mdat_data_size += f.data_size;
   }
-  m_vide_track->terminateCurrentChunk();
-  m_video_buffer.clear();
+  m_soun_track->terminateCurrentChunk();
+  m_audio_buffer.clear();
 }
 
 void MP4Muxer::muxFinalize() {
   writeTrackData();
 }
 
+void MP4Muxer::finishOutput() {
+  if (!m_hasher) {
+    return;
+  }
+  m_ofs.close();
+  if (!m_ofs) {
+    throw std::runtime_error(fmt::format("writing {} failed", m_out_filename));
+  }
+  m_hasher->finish();
+}
+
 }  // namespace hisui::muxer
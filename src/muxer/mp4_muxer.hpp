@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <memory>
@@ -9,6 +10,7 @@
 #include "archive_item.hpp"
 #include "frame.hpp"
 #include "muxer/muxer.hpp"
+#include "util/output_hasher.hpp"
 
 namespace hisui {
 
@@ -52,7 +54,10 @@ class MP4Muxer : public Muxer {
   virtual ~MP4Muxer();
 
  protected:
+  std::string m_out_filename;
   std::ofstream m_ofs;
+  std::unique_ptr<hisui::util::OutputHasher> m_hasher;
+  std::unique_ptr<hisui::util::HashingStreambuf> m_hashing_streambuf;
   std::shared_ptr<shiguredo::mp4::writer::Writer> m_writer;
   std::shared_ptr<shiguredo::mp4::track::VideTrack> m_vide_track;
   std::shared_ptr<shiguredo::mp4::track::SounTrack> m_soun_track;
@@ -60,16 +65,32 @@ class MP4Muxer : public Muxer {
 
   std::uint64_t m_chunk_start = 0;
   std::vector<hisui::Frame> m_audio_buffer;
+  // config::MP4Interleave::Fine の場合はチャンクの映像も溜め, 音声の後に書く
+  bool m_is_fine_interleaved = false;
   std::vector<hisui::Frame> m_video_buffer;
+  std::size_t m_video_buffer_size = 0;
+  std::size_t m_max_video_buffer_size = 0;
+  // トラックに渡したサンプルデータの合計サイズ
+  std::uint64_t m_mdat_data_size = 0;
 
   void muxFinalize() override;
   void appendAudio(hisui::Frame) override;
   void appendVideo(hisui::Frame) override;
 
   void writeTrackData();
+  void writeAudioChunk();
+  // 出力を書き終えた後に呼ぶ
+  void finishOutput();
   void initialize(const hisui::Config&,
                   std::shared_ptr<shiguredo::mp4::writer::Writer>);
+  // producer のみを作り, 出力ファイル名などを補った config を返す
+  hisui::Config initializeProducers(const hisui::Config&);
+  // initializeProducers() が映像の producer と並行して, 別のスレッドで呼ぶ.
+  // Opus の場合は m_audio_pre_skip も設定する
+  std::shared_ptr<AudioProducer> makeAudioProducer(const hisui::Config&);
   double m_duration;
+  // Opus の場合の pre-skip
+  std::uint64_t m_audio_pre_skip = 0;
 
  private:
   std::vector<hisui::ArchiveItem> m_audio_archives;
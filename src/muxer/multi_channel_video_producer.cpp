@@ -0,0 +1,402 @@
+#include "muxer/multi_channel_video_producer.hpp"
+
+#include <bits/exception.h>
+#include <libyuv/planar_functions.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/rational.hpp>
+#include <progresscpp/ProgressBar.hpp>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "metadata.hpp"
+#include "muxer/remux_frames.hpp"
+#include "muxer/video_producer.hpp"
+#include "util/memory.hpp"
+#include "video/adaptive_grid_composer.hpp"
+#include "video/buffer_av1_encoder.hpp"
+#include "video/buffer_openh264_encoder.hpp"
+#include "video/buffer_vpx_encoder.hpp"
+#include "video/composer.hpp"
+#include "video/encoder.hpp"
+#include "video/grid_composer.hpp"
+#include "video/multi_channel_sequencer.hpp"
+#include "video/openh264.hpp"
+#include "video/openh264_handler.hpp"
+#include "video/parallel_grid_composer.hpp"
+#include "video/sequencer.hpp"
+#include "video/vpx.hpp"
+
+#ifdef USE_ONEVPL
+#include "video/vpl_encoder.hpp"
+#include "video/vpl_session.hpp"
+#endif
+
+namespace hisui::video {
+
+class YUVImage;
+
+}
+
+namespace hisui::muxer {
+
+namespace {
+
+std::shared_ptr<hisui::video::Encoder> create_h264_encoder(
+    const hisui::Config& config,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    hisui::FrameQueue* buffer,
+    const std::uint64_t timescale) {
+#ifdef USE_ONEVPL
+  const bool is_vpl_supported =
+      hisui::video::VPLSession::hasInstance() &&
+      hisui::video::VPLEncoder::isSupported(hisui::Constants::H264_FOURCC);
+  if (config.h264_encoder == hisui::config::H264Encoder::OneVPL &&
+      !is_vpl_supported) {
+    throw std::runtime_error("oneVPL H.264 encoder is not supported");
+  }
+  if (config.h264_encoder != hisui::config::H264Encoder::OpenH264 &&
+      is_vpl_supported) {
+    spdlog::debug("use VPLEncoder");
+    hisui::video::VPLEncoderConfig vpl_config(width, height, config);
+    return std::make_shared<hisui::video::VPLEncoder>(
+        hisui::Constants::H264_FOURCC, buffer, vpl_config, timescale);
+  }
+#endif
+  if (!hisui::video::OpenH264Handler::hasInstance()) {
+    if (config.h264_encoder == hisui::config::H264Encoder::OpenH264) {
+      throw std::runtime_error("OpenH264 library is not loaded");
+    }
+    throw std::runtime_error("H.264 encoder is unavailable");
+  }
+  spdlog::debug("use BufferOpenH264Encoder");
+  hisui::video::OpenH264EncoderConfig openh264_config(width, height, config);
+  return std::make_shared<hisui::video::BufferOpenH264Encoder>(
+      buffer, openh264_config, timescale);
+}
+
+// 他の VideoProducer と同じ規則で out_video_codec のエンコーダーを選ぶ
+std::shared_ptr<hisui::video::Encoder> create_encoder(
+    const hisui::Config& config,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    hisui::FrameQueue* buffer,
+    const std::uint64_t timescale) {
+#ifdef USE_ONEVPL
+  if (hisui::video::use_vpl_encoder(config, config.out_video_codec)) {
+    hisui::video::VPLEncoderConfig vpl_config(width, height, config);
+    return std::make_shared<hisui::video::VPLEncoder>(
+        config.out_video_codec, buffer, vpl_config, timescale);
+  }
+#endif
+  switch (config.out_video_codec) {
+    case hisui::config::OutVideoCodec::H264:
+      return create_h264_encoder(config, width, height, buffer, timescale);
+    case hisui::config::OutVideoCodec::AV1: {
+      hisui::video::AV1EncoderConfig av1_config(width, height, config);
+      return std::make_shared<hisui::video::BufferAV1Encoder>(
+          buffer, av1_config, timescale);
+    }
+    default: {
+      hisui::video::VPXEncoderConfig vpx_config(width, height, config);
+      return std::make_shared<hisui::video::BufferVPXEncoder>(
+          buffer, vpx_config, timescale);
+    }
+  }
+}
+
+}  // namespace
+
+MultiChannelVideoProducer::MultiChannelVideoProducer(
+    const hisui::Config& t_config,
+    const MultiChannelVideoProducerParameters& params)
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}),
+      m_normal_bit_rate(t_config.out_video_bit_rate),
+      m_preferred_bit_rate(t_config.screen_capture_bit_rate),
+      m_is_preferred_screen_content(t_config.screen_capture_tune_content != 0),
+      m_timescale(params.timescale) {
+  m_sequencer = std::make_shared<hisui::video::MultiChannelSequencer>(
+      params.normal_archives, params.preferred_archives,
+      t_config.video_decode_threads, t_config.getVideoWarmUpTime());
+
+  const auto scaling_width = t_config.scaling_width != 0
+                                 ? t_config.scaling_width
+                                 : m_sequencer->getMaxWidth();
+  const auto scaling_height = t_config.scaling_height != 0
+                                  ? t_config.scaling_height
+                                  : m_sequencer->getMaxHeight();
+
+  switch (t_config.video_composer) {
+    case hisui::config::VideoComposer::Grid:
+      m_normal_channel_composer = std::make_shared<hisui::video::GridComposer>(
+          scaling_width, scaling_height, m_sequencer->getSize(),
+          t_config.max_columns, t_config.video_scaler,
+          t_config.libyuv_filter_mode);
+      m_preferred_channel_composer =
+          std::make_shared<hisui::video::GridComposer>(
+              t_config.screen_capture_width, t_config.screen_capture_height, 1,
+              1, t_config.video_scaler, t_config.libyuv_filter_mode);
+      break;
+    case hisui::config::VideoComposer::ParallelGrid:
+      m_normal_channel_composer =
+          std::make_shared<hisui::video::ParallelGridComposer>(
+              scaling_width, scaling_height, m_sequencer->getSize(),
+              t_config.max_columns, t_config.video_scaler,
+              t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
+      m_preferred_channel_composer =
+          std::make_shared<hisui::video::GridComposer>(
+              t_config.screen_capture_width, t_config.screen_capture_height, 1,
+              1, t_config.video_scaler, t_config.libyuv_filter_mode);
+      break;
+    case hisui::config::VideoComposer::Auto:
+      m_normal_channel_composer =
+          std::make_shared<hisui::video::AdaptiveGridComposer>(
+              scaling_width, scaling_height, m_sequencer->getSize(),
+              t_config.max_columns, t_config.video_scaler,
+              t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
+      m_preferred_channel_composer =
+          std::make_shared<hisui::video::GridComposer>(
+              t_config.screen_capture_width, t_config.screen_capture_height, 1,
+              1, t_config.video_scaler, t_config.libyuv_filter_mode);
+      break;
+  }
+
+  m_composer = m_normal_channel_composer;
+
+  const auto max_width = std::max(m_normal_channel_composer->getWidth(),
+                                  m_preferred_channel_composer->getWidth());
+  const auto max_height = std::max(m_normal_channel_composer->getHeight(),
+                                   m_preferred_channel_composer->getHeight());
+  m_encoder = create_encoder(t_config, max_width, max_height, &m_buffer,
+                             params.timescale);
+  if (m_encoder->isResolutionChangeable()) {
+    m_width = m_normal_channel_composer->getWidth();
+    m_height = m_normal_channel_composer->getHeight();
+  } else {
+    // preferred は canvas 全体に拡縮し, 通常の合成結果は拡縮せずに中央に置く
+    m_width = max_width;
+    m_height = max_height;
+    m_preferred_channel_composer =
+        std::make_shared<hisui::video::GridComposer>(
+            m_width, m_height, 1, 1, t_config.video_scaler,
+            t_config.libyuv_filter_mode);
+    m_is_letterboxed = m_normal_channel_composer->getWidth() != m_width ||
+                       m_normal_channel_composer->getHeight() != m_height;
+  }
+
+  m_duration = params.duration;
+  m_frame_rate = t_config.out_video_frame_rate;
+
+  // 入力のフレームの時刻はタイムラインの先頭が基準なので, 一部を書き出す場合は使わない
+  if (t_config.video_remux && !t_config.isClip()) {
+    setUpPassthroughIntervals(t_config, params.preferred_archives);
+  }
+}
+
+void MultiChannelVideoProducer::setUpPassthroughIntervals(
+    const hisui::Config& config,
+    const std::vector<hisui::ArchiveItem>& preferred_archives) {
+  const std::uint64_t max_time = getMaxTime();
+  for (const auto& archive : preferred_archives) {
+    const auto path = archive.getPath().string();
+    // 他の preferred と重なる場合は, 時刻によって表示される方が変わるので扱わない
+    const bool overlaps = std::any_of(
+        std::begin(preferred_archives), std::end(preferred_archives),
+        [&archive](const auto& other) {
+          return &other != &archive &&
+                 other.getStartTimeOffset() < archive.getStopTimeOffset() &&
+                 archive.getStartTimeOffset() < other.getStopTimeOffset();
+        });
+    const auto track = overlaps ? std::nullopt : find_remuxable_track(path);
+    if (!track ||
+        track->fourcc != static_cast<std::uint32_t>(config.out_video_codec) ||
+        track->width != m_preferred_channel_composer->getWidth() ||
+        track->height != m_preferred_channel_composer->getHeight()) {
+      spdlog::info("screen capture is re-encoded: {}", path);
+      continue;
+    }
+
+    // 最初のキーフレームまではエンコードする
+    const auto start_ns = static_cast<std::uint64_t>(std::floor(
+        archive.getStartTimeOffset() * hisui::Constants::NANO_SECOND));
+    const auto begin = start_ns + track->key_frame_timestamps.front();
+    const auto end = std::min(
+        max_time, static_cast<std::uint64_t>(
+                      std::ceil(archive.getStopTimeOffset() *
+                                hisui::Constants::NANO_SECOND)));
+    if (begin < end) {
+      m_passthrough_intervals.push_back(
+          {.file_path = path, .start_ns = start_ns, .begin = begin, .end = end});
+    }
+  }
+  std::sort(std::begin(m_passthrough_intervals),
+            std::end(m_passthrough_intervals),
+            [](const auto& a, const auto& b) { return a.begin < b.begin; });
+}
+
+void MultiChannelVideoProducer::produce() {
+  if (isFinished()) {
+    return;
+  }
+
+  try {
+    std::vector<std::shared_ptr<video::YUVImage>> yuvs;
+    std::vector<unsigned char> raw_image;
+    yuvs.resize(m_sequencer->getSize());
+
+    const std::uint64_t max_time = getMaxTime();
+
+    progresscpp::ProgressBar progress_bar(max_time, 60);
+
+    const std::uint64_t step = hisui::Constants::NANO_SECOND *
+                               m_frame_rate.denominator() /
+                               m_frame_rate.numerator();
+    std::size_t next_passthrough = 0;
+    // 直前に出力したのが preferred かどうか. 最初は canvas の余白を塗るために true にする
+    bool is_preferred = true;
+    std::uint64_t t = 0;
+    while (t < max_time) {
+      if (next_passthrough < std::size(m_passthrough_intervals) &&
+          t >= m_passthrough_intervals[next_passthrough].begin) {
+        // エンコーダー内のフレームを出し切ってから入力のフレームを続ける.
+        // その間の時刻はエンコーダーの pts だけを進め, 次にエンコードする画像はキーフレームにする
+        const auto& interval = m_passthrough_intervals[next_passthrough++];
+        spdlog::debug("screen capture passthrough: [{}, {}) {}",
+                      interval.begin, interval.end, interval.file_path);
+        m_encoder->flush();
+        copy_frames(interval.file_path, interval.start_ns, interval.begin,
+                    interval.end, m_timescale, &m_buffer,
+                    [](const std::uint64_t) {});
+        for (; t < interval.end; t += step) {
+          m_encoder->skipImage();
+          if (m_show_progress_bar) {
+            progress_bar.setTicks(t);
+            progress_bar.display();
+          }
+        }
+        m_encoder->forceKeyFrame();
+        continue;
+      }
+
+      auto result = m_sequencer->getYUVs(&yuvs, m_start_time + t);
+      if (result.is_preferred_stream) {
+        hisui::util::resize_with_huge_pages(
+            &raw_image, m_preferred_channel_composer->getWidth() *
+                                m_preferred_channel_composer->getHeight() * 3 >>
+                            1);
+        m_preferred_channel_composer->compose(&raw_image, {yuvs[0]});
+        m_encoder->setScreenContent(m_is_preferred_screen_content);
+        m_encoder->setResolutionAndBitrate(
+            m_preferred_channel_composer->getWidth(),
+            m_preferred_channel_composer->getHeight(), m_preferred_bit_rate);
+        m_encoder->outputImage(raw_image);
+        is_preferred = true;
+      } else if (m_is_letterboxed) {
+        hisui::util::resize_with_huge_pages(
+            &m_normal_image, m_normal_channel_composer->getWidth() *
+                                     m_normal_channel_composer->getHeight() *
+                                     3 >>
+                                 1);
+        m_normal_channel_composer->compose(&m_normal_image, yuvs);
+        hisui::util::resize_with_huge_pages(&raw_image,
+                                            m_width * m_height * 3 >> 1);
+        // preferred が canvas 全体に書き込んだ後だけ余白を塗り直す
+        copyIntoCanvas(&raw_image, is_preferred);
+        m_encoder->setScreenContent(false);
+        m_encoder->setResolutionAndBitrate(m_width, m_height,
+                                           m_normal_bit_rate);
+        m_encoder->outputImage(raw_image);
+        is_preferred = false;
+      } else {
+        hisui::util::resize_with_huge_pages(
+            &raw_image, m_normal_channel_composer->getWidth() *
+                                m_normal_channel_composer->getHeight() * 3 >>
+                            1);
+        m_normal_channel_composer->compose(&raw_image, yuvs);
+        m_encoder->setScreenContent(false);
+        m_encoder->setResolutionAndBitrate(
+            m_normal_channel_composer->getWidth(),
+            m_normal_channel_composer->getHeight(), m_normal_bit_rate);
+        m_encoder->outputImage(raw_image);
+        is_preferred = false;
+      }
+      if (m_show_progress_bar) {
+        progress_bar.setTicks(t);
+        progress_bar.display();
+      }
+      t += step;
+    }
+
+    m_encoder->flush();
+    m_buffer.close();
+
+    if (m_show_progress_bar) {
+      progress_bar.setTicks(max_time);
+      progress_bar.done();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("VideoProducer::produce() failed: what={}", e.what());
+    m_buffer.close();
+    throw;
+  }
+}
+
+void MultiChannelVideoProducer::copyIntoCanvas(
+    std::vector<unsigned char>* canvas,
+    const bool fill_border) {
+  const auto width = m_normal_channel_composer->getWidth();
+  const auto height = m_normal_channel_composer->getHeight();
+  // 色差の位置がずれないよう偶数にする
+  const auto x = ((m_width - width) >> 1) & ~1U;
+  const auto y = ((m_height - height) >> 1) & ~1U;
+
+  unsigned char* dst_y = canvas->data();
+  unsigned char* dst_u = dst_y + m_width * m_height;
+  unsigned char* dst_v = dst_u + ((m_width * m_height + 3) >> 2);
+  const auto dst_stride_y = static_cast<int>(m_width);
+  const auto dst_stride_uv = static_cast<int>((m_width + 1) >> 1);
+  if (fill_border) {
+    std::fill(dst_y, dst_u, 0);
+    std::fill(dst_u, canvas->data() + std::size(*canvas), 128);
+  }
+
+  const unsigned char* src_y = m_normal_image.data();
+  const unsigned char* src_u = src_y + width * height;
+  const unsigned char* src_v = src_u + ((width * height + 3) >> 2);
+  const auto src_stride_y = static_cast<int>(width);
+  const auto src_stride_uv = static_cast<int>((width + 1) >> 1);
+  ::libyuv::I420Copy(
+      src_y, src_stride_y, src_u, src_stride_uv, src_v, src_stride_uv,
+      dst_y + y * m_width + x, dst_stride_y,
+      dst_u + (y >> 1) * static_cast<std::uint32_t>(dst_stride_uv) + (x >> 1),
+      dst_stride_uv,
+      dst_v + (y >> 1) * static_cast<std::uint32_t>(dst_stride_uv) + (x >> 1),
+      dst_stride_uv, static_cast<int>(width), static_cast<int>(height));
+}
+
+std::uint32_t MultiChannelVideoProducer::getWidth() const {
+  return m_width;
+}
+
+std::uint32_t MultiChannelVideoProducer::getHeight() const {
+  return m_height;
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "constants.hpp"
+#include "muxer/video_producer.hpp"
+
+namespace hisui {
+
+class Config;
+class MetadataSet;
+
+}  // namespace hisui
+
+namespace hisui::video {
+
+class Composer;
+
+}
+
+namespace hisui::muxer {
+
+struct MultiChannelVideoProducerParameters {
+  const std::vector<hisui::ArchiveItem>& normal_archives = {};
+  const std::vector<hisui::ArchiveItem>& preferred_archives = {};
+  const double duration;
+  const std::uint64_t timescale = hisui::Constants::NANO_SECOND;
+};
+
+// preferred (画面共有) の source がある間はそれだけを出力する.
+// 解像度を変えられないエンコーダーでは, 両方を最大の大きさの canvas に収めて出力する
+class MultiChannelVideoProducer : public VideoProducer {
+ public:
+  MultiChannelVideoProducer(const hisui::Config&,
+                            const MultiChannelVideoProducerParameters&);
+
+  void produce() override;
+  std::uint32_t getWidth() const override;
+  std::uint32_t getHeight() const override;
+
+ private:
+  // フレームをそのまま出力する preferred の区間. begin はキーフレームのタイムライン上の時刻
+  struct PassthroughInterval {
+    std::string file_path;
+    std::uint64_t start_ns;
+    std::uint64_t begin;
+    std::uint64_t end;
+  };
+
+  void setUpPassthroughIntervals(const hisui::Config&,
+                                 const std::vector<hisui::ArchiveItem>&);
+  // 通常の合成結果を canvas の中央に書き込む. fill_border の場合は余白を黒で塗る
+  void copyIntoCanvas(std::vector<unsigned char>*, const bool);
+
+  std::shared_ptr<hisui::video::Composer> m_normal_channel_composer;
+  std::shared_ptr<hisui::video::Composer> m_preferred_channel_composer;
+
+  const std::uint32_t m_normal_bit_rate;
+  const std::uint32_t m_preferred_bit_rate;
+  const bool m_is_preferred_screen_content;
+  const std::uint64_t m_timescale;
+  std::vector<PassthroughInterval> m_passthrough_intervals;
+  std::uint32_t m_width;
+  std::uint32_t m_height;
+  // 解像度を変えられないエンコーダーで, 通常の合成結果が canvas より小さい場合に使う
+  bool m_is_letterboxed = false;
+  std::vector<unsigned char> m_normal_image;
+};
+
+}  // namespace hisui::muxer
@@ -1,13 +1,15 @@
 #include "muxer/muxer.hpp"
 
 #include <cxxabi.h>
+#include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
-#include <chrono>
+#include <algorithm>
 #include <future>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <system_error>
-#include <thread>
 
 #include <boost/cstdint.hpp>
 #include <boost/exception/exception.hpp>
@@ -16,82 +18,131 @@
 #include "frame.hpp"
 #include "muxer/audio_producer.hpp"
 #include "muxer/video_producer.hpp"
+#include "report/progress_writer.hpp"
+#include "report/reporter.hpp"
+#include "util/memory.hpp"
+#include "util/trace.hpp"
 
 namespace hisui::muxer {
 
-void Muxer::mux() {
+void Muxer::mux(const MuxParameters& params) {
+  HISUI_TRACE_SCOPE("Muxer::mux");
+  std::unique_ptr<hisui::report::ProgressWriter> progress_writer;
+  if (params.progress_interval > 0) {
+    progress_writer = std::make_unique<hisui::report::ProgressWriter>(
+        hisui::report::ProgressWriterParameters{
+            .interval = params.progress_interval, .duration = params.duration},
+        [this, duration = params.duration] { return getProgress(duration); });
+  }
+
+  m_video_producer->setStartTime(params.start_time);
+  m_audio_producer->setStartTime(params.start_time);
+
   auto video_future =
       std::async(std::launch::async, &VideoProducer::produce, m_video_producer);
 
   auto audio_future =
       std::async(std::launch::async, &AudioProducer::produce, m_audio_producer);
 
-  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  try {
+    interleave(params.max_memory);
+    audio_future.get();
+    spdlog::debug("audio was processed");
+    video_future.get();
+    spdlog::debug("video was processed");
+    if (hisui::report::Reporter::hasInstance()) {
+      auto& reporter = hisui::report::Reporter::getInstance();
+      reporter.registerPeakQueueSize("video",
+                                     m_video_producer->getBufferPeakSize());
+      reporter.registerPeakQueueSize("audio",
+                                     m_audio_producer->getBufferPeakSize());
+    }
+  } catch (...) {
+    // 失敗した場合に, もう一方の producer がバッファの空きを待ち続けないようにする
+    m_video_producer->abort();
+    m_audio_producer->abort();
+    throw;
+  }
+  progress_writer.reset();
 
-  bool video_finished = false;
+  muxFinalize();
+}
+
+hisui::report::Progress Muxer::getProgress(const double duration) {
+  return {
+      .media_time = std::min({m_video_producer->getProgressTime(),
+                              m_audio_producer->getProgressTime(), duration}),
+      .video_frames = m_muxed_video_frames.load(),
+      .audio_frames = m_muxed_audio_frames.load(),
+      .video_queue_size = m_video_producer->getBufferSize(),
+      .audio_queue_size = m_audio_producer->getBufferSize(),
+  };
+}
 
-  while (!m_audio_producer->isFinished()) {
-    const auto audio_front = m_audio_producer->bufferFront();
+void Muxer::interleave(const std::uint64_t max_memory) {
+  bool video_finished = false;
+  // /proc を読むので, 映像の一定のフレーム数ごとにだけ確かめる
+  auto check_memory = [this, max_memory] {
+    static constexpr std::uint64_t CHECK_INTERVAL_FRAMES = 30;
+    if (max_memory == 0 || m_muxed_video_frames % CHECK_INTERVAL_FRAMES != 0) {
+      return;
+    }
+    const auto size = hisui::util::get_resident_memory_size();
+    if (size > max_memory) {
+      throw std::runtime_error(fmt::format(
+          "resident memory exceeded --max-memory: resident={}MiB max={}MiB",
+          size >> 20, max_memory >> 20));
+    }
+  };
+  auto append_audio = [this](const hisui::Frame& frame) {
+    HISUI_TRACE_SCOPE("Muxer::appendAudio");
+    hisui::report::StageTimer timer("mux");
+    appendAudio(frame);
+    ++m_muxed_audio_frames;
+  };
+  auto append_video = [this, &check_memory](const hisui::Frame& frame) {
+    HISUI_TRACE_SCOPE("Muxer::appendVideo");
+    hisui::report::StageTimer timer("mux");
+    appendVideo(frame);
+    ++m_muxed_video_frames;
+    check_memory();
+  };
+
+  while (true) {
+    const auto audio_front = m_audio_producer->waitBufferFront();
     if (!audio_front.has_value()) {
-      spdlog::debug("audio queue is empty");
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      continue;
+      break;
     }
-    const auto audio_timestamp = audio_front.value().timestamp;
-
     if (video_finished) {
-      appendAudio(audio_front.value());
+      append_audio(audio_front.value());
       continue;
     }
-
-    if (m_video_producer->isFinished()) {
+    const auto video_front = m_video_producer->waitBufferFront();
+    if (!video_front.has_value()) {
       video_finished = true;
-      video_future.get();
-      spdlog::debug("video was processed");
-      appendAudio(audio_front.value());
+      spdlog::debug("video queue was drained");
+      append_audio(audio_front.value());
       continue;
     }
 
-    const auto video_front = m_video_producer->bufferFront();
-    if (!video_front.has_value()) {
-      spdlog::debug("video queue is empty (1)");
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-      continue;
-    }
     const auto video_timestamp =
         video_front.value().timestamp * m_timescale_ratio;
-
-    if (video_timestamp <= audio_timestamp) {
-      appendVideo(video_front.value());
+    if (video_timestamp <= audio_front.value().timestamp) {
+      append_video(video_front.value());
       continue;
     }
-    appendAudio(audio_front.value());
+    append_audio(audio_front.value());
   }
 
-  audio_future.get();
-  spdlog::debug("audio was processed");
+  spdlog::debug("audio queue was drained");
 
-  if (video_finished) {
-    muxFinalize();
-    return;
-  }
-
-  spdlog::debug("video is processing");
-  while (!m_video_producer->isFinished()) {
-    const auto video_front = m_video_producer->bufferFront();
+  while (!video_finished) {
+    const auto video_front = m_video_producer->waitBufferFront();
     if (!video_front.has_value()) {
-      spdlog::debug("video queue is empty (2)");
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-      continue;
+      break;
     }
-
-    appendVideo(video_front.value());
+    append_video(video_front.value());
   }
-
-  video_future.get();
-  spdlog::debug("video was processed");
-
-  muxFinalize();
 }
 
 std::string Muxer::getVideoCodecName(const hisui::Config& config) {
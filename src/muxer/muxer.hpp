@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -7,6 +8,8 @@
 #include <boost/cstdint.hpp>
 #include <boost/rational.hpp>
 
+#include "report/progress_writer.hpp"
+
 namespace hisui {
 
 class Config;
@@ -19,6 +22,16 @@ namespace hisui::muxer {
 class AudioProducer;
 class VideoProducer;
 
+struct MuxParameters {
+  // 0 でなければ, この間隔 (秒) で進捗を JSON で標準エラー出力に書き出す
+  const double progress_interval = 0.0;
+  const double duration = 0.0;
+  // タイムライン上のこの時刻 (秒) から duration 秒分を書き出す
+  const double start_time = 0.0;
+  // 0 でなければ, 常駐メモリがこのサイズ (バイト) を超えた時点で合成を中止する
+  const std::uint64_t max_memory = 0;
+};
+
 class Muxer {
  public:
   virtual ~Muxer() = default;
@@ -27,7 +40,7 @@ class Muxer {
   virtual void cleanUp() = 0;
 
  protected:
-  void mux();
+  void mux(const MuxParameters& = {});
   std::string getVideoCodecName(const hisui::Config& config);
 
   std::shared_ptr<VideoProducer> m_video_producer = nullptr;
@@ -35,6 +48,12 @@ class Muxer {
   boost::rational<std::uint64_t> m_timescale_ratio = 1;
 
  private:
+  void interleave(const std::uint64_t);
+  hisui::report::Progress getProgress(const double);
+
+  std::atomic<std::uint64_t> m_muxed_video_frames = 0;
+  std::atomic<std::uint64_t> m_muxed_audio_frames = 0;
+
   virtual void muxFinalize() = 0;
   virtual void appendAudio(hisui::Frame) = 0;
   virtual void appendVideo(hisui::Frame) = 0;
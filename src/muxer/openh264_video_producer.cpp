@@ -8,6 +8,7 @@
 #include "config.hpp"
 #include "metadata.hpp"
 #include "muxer/video_producer.hpp"
+#include "video/adaptive_grid_composer.hpp"
 #include "video/basic_sequencer.hpp"
 #include "video/buffer_openh264_encoder.hpp"
 #include "video/composer.hpp"
@@ -21,8 +22,14 @@ namespace hisui::muxer {
 OpenH264VideoProducer::OpenH264VideoProducer(
     const hisui::Config& t_config,
     const OpenH264VideoProducerParameters& params)
-    : VideoProducer({.show_progress_bar = t_config.show_progress_bar}) {
-  m_sequencer = std::make_shared<hisui::video::BasicSequencer>(params.archives);
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .pipeline_depth = t_config.video_pipeline_depth,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}) {
+  m_sequencer = std::make_shared<hisui::video::BasicSequencer>(
+      params.archives, t_config.video_decode_threads,
+      t_config.getVideoWarmUpTime());
 
   const auto scaling_width = t_config.scaling_width != 0
                                  ? t_config.scaling_width
@@ -42,7 +49,13 @@ OpenH264VideoProducer::OpenH264VideoProducer(
       m_composer = std::make_shared<hisui::video::ParallelGridComposer>(
           scaling_width, scaling_height, m_sequencer->getSize(),
           t_config.max_columns, t_config.video_scaler,
-          t_config.libyuv_filter_mode);
+          t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
+      break;
+    case hisui::config::VideoComposer::Auto:
+      m_composer = std::make_shared<hisui::video::AdaptiveGridComposer>(
+          scaling_width, scaling_height, m_sequencer->getSize(),
+          t_config.max_columns, t_config.video_scaler,
+          t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
       break;
   }
 
@@ -1,17 +1,38 @@
 #include "muxer/opus_audio_producer.hpp"
 
+#include <fmt/core.h>
+#include <opus_defines.h>
 #include <opus_types.h>
+
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 #include "audio/basic_sequencer.hpp"
 #include "audio/buffer_opus_encoder.hpp"
 #include "audio/mixer.hpp"
 #include "config.hpp"
+#include "frame_queue.hpp"
 #include "metadata.hpp"
 #include "muxer/audio_producer.hpp"
 
 namespace hisui::muxer {
 
+namespace {
+
+int get_opus_application(const config::OpusApplication application) {
+  switch (application) {
+    case config::OpusApplication::VoIP:
+      return OPUS_APPLICATION_VOIP;
+    case config::OpusApplication::LowDelay:
+      return OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+    default:
+      return OPUS_APPLICATION_AUDIO;
+  }
+}
+
+}  // namespace
+
 OpusAudioProducer::OpusAudioProducer(
     const hisui::Config& t_config,
     const std::vector<hisui::ArchiveItem> t_archives,
@@ -21,11 +42,52 @@ OpusAudioProducer::OpusAudioProducer(
                      .mixer = t_config.audio_mixer,
                      .duration = t_duration,
                      .show_progress_bar =
-                         t_config.show_progress_bar && t_config.audio_only}) {
-  auto encoder = std::make_shared<hisui::audio::BufferOpusEncoder>(
-      &m_buffer,
-      hisui::audio::BufferOpusEncoderParameters{
-          .bit_rate = t_config.out_opus_bit_rate, .timescale = timescale});
+                         t_config.show_progress_bar && t_config.audio_only,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .decode_threads = t_config.audio_decode_threads,
+                     .sample_rate = t_config.out_audio_sample_rate,
+                     .silence_level = t_config.audio_silence_level,
+                     .opus_passthrough = t_config.opus_passthrough,
+                     .cache_directory = t_config.audio_cache_directory,
+                     .encoder_settings = fmt::format(
+                         "opus bit_rate={} timescale={} frame_duration={} "
+                         "application={} bit_rate_mode={} complexity={}",
+                         t_config.out_opus_bit_rate, timescale,
+                         t_config.getOpusFrameDuration(),
+                         static_cast<int>(t_config.opus_application),
+                         static_cast<int>(t_config.opus_bit_rate_mode),
+                         t_config.getOpusComplexity()),
+                     .chunks = t_config.audio_chunks,
+                     .pcm_writer = make_pcm_writer(
+                         t_config, t_config.out_audio_sample_rate)}) {
+  const hisui::audio::BufferOpusEncoderParameters params{
+      .bit_rate = t_config.out_opus_bit_rate,
+      .timescale = timescale,
+      .sample_rate = t_config.out_audio_sample_rate,
+      .frame_duration = t_config.getOpusFrameDuration(),
+      .application = get_opus_application(t_config.opus_application),
+      .vbr = t_config.opus_bit_rate_mode != config::OpusBitRateMode::CBR,
+      .constrained_vbr =
+          t_config.opus_bit_rate_mode == config::OpusBitRateMode::CVBR,
+      .complexity = t_config.getOpusComplexity()};
+  auto encoder =
+      std::make_shared<hisui::audio::BufferOpusEncoder>(&m_buffer, params);
+  m_encoder_factory = [params](hisui::FrameQueue* buffer,
+                               const std::uint64_t first_frame) {
+    return std::make_shared<hisui::audio::BufferOpusEncoder>(
+        buffer, hisui::audio::BufferOpusEncoderParameters{
+                    .bit_rate = params.bit_rate,
+                    .timescale = params.timescale,
+                    .sample_rate = params.sample_rate,
+                    .frame_duration = params.frame_duration,
+                    .application = params.application,
+                    .vbr = params.vbr,
+                    .constrained_vbr = params.constrained_vbr,
+                    .complexity = params.complexity,
+                    .first_frame = first_frame});
+  };
+  m_encoder_frame_size = static_cast<std::size_t>(params.frame_duration) *
+                         params.sample_rate / 1000;
   m_skip = encoder->getSkip();
   m_encoder = encoder;
 }
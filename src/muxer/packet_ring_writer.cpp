@@ -0,0 +1,214 @@
+#include "muxer/packet_ring_writer.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frame.hpp"
+
+namespace hisui::muxer {
+
+// 共有メモリに置くので, 位置は std::atomic_ref で読み書きする
+struct PacketRingHeader {
+  std::uint64_t magic;
+  std::uint64_t generation;
+  std::uint64_t data_offset;
+  std::uint64_t data_size;
+  std::uint64_t reserved_position;
+  std::uint64_t written_position;
+  std::uint64_t key_frame_position;
+  std::uint64_t state;
+  std::uint32_t video_fourcc;
+  std::uint32_t video_width;
+  std::uint32_t video_height;
+  std::uint32_t audio_fourcc;
+  std::uint32_t audio_sample_rate;
+  std::uint32_t audio_channels;
+  std::uint32_t video_extra_data_size;
+  std::uint32_t audio_extra_data_size;
+  std::uint8_t video_extra_data[PacketRingWriter::MAX_EXTRA_DATA_SIZE];
+  std::uint8_t audio_extra_data[PacketRingWriter::MAX_EXTRA_DATA_SIZE];
+};
+
+static_assert(offsetof(PacketRingHeader, video_fourcc) == 64);
+static_assert(offsetof(PacketRingHeader, video_extra_data) == 96);
+static_assert(sizeof(PacketRingHeader) <= PacketRingWriter::HEADER_SIZE);
+
+namespace {
+
+struct PacketRecordHeader {
+  std::uint64_t timestamp;
+  std::uint32_t size;
+  std::uint32_t flags;
+};
+
+static_assert(sizeof(PacketRecordHeader) ==
+              PacketRingWriter::RECORD_HEADER_SIZE);
+static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+
+std::atomic_ref<std::uint64_t> ref(std::uint64_t* value) {
+  return std::atomic_ref<std::uint64_t>(*value);
+}
+
+std::size_t align(const std::size_t size) {
+  return (size + PacketRingWriter::RECORD_ALIGNMENT - 1) /
+         PacketRingWriter::RECORD_ALIGNMENT *
+         PacketRingWriter::RECORD_ALIGNMENT;
+}
+
+void copy_extra_data(const std::vector<std::uint8_t>& extra_data,
+                     std::uint8_t* dst,
+                     std::uint32_t* size) {
+  if (std::size(extra_data) > PacketRingWriter::MAX_EXTRA_DATA_SIZE) {
+    throw std::invalid_argument(fmt::format(
+        "extra data is too large for packet ring: size={}",
+        std::size(extra_data)));
+  }
+  std::memcpy(dst, extra_data.data(), std::size(extra_data));
+  *size = static_cast<std::uint32_t>(std::size(extra_data));
+}
+
+}  // namespace
+
+PacketRingWriter::PacketRingWriter(const std::string& path,
+                                   const std::size_t size,
+                                   const PacketRingParameters& params)
+    : m_size(HEADER_SIZE + size / RECORD_ALIGNMENT * RECORD_ALIGNMENT),
+      m_data_size(size / RECORD_ALIGNMENT * RECORD_ALIGNMENT) {
+  if (m_data_size < RECORD_HEADER_SIZE) {
+    throw std::invalid_argument(
+        fmt::format("packet ring is too small: size={}", size));
+  }
+  // 読む側が前の generation のヘッダーを読まないよう, 作り直す
+  ::unlink(path.c_str());
+  const int fd =
+      ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("opening {} failed: {}", path,
+                                         std::strerror(errno)));
+  }
+  if (::ftruncate(fd, static_cast<off_t>(m_size)) == -1) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error(fmt::format("resizing {} failed: {}", path,
+                                         std::strerror(error)));
+  }
+  void* data =
+      ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(fmt::format("mmap() failed: file_path={} error={}",
+                                         path, std::strerror(error)));
+  }
+  m_data = static_cast<unsigned char*>(data);
+  m_header = reinterpret_cast<PacketRingHeader*>(m_data);
+
+  m_header->generation = static_cast<std::uint64_t>(
+      std::chrono::system_clock::now().time_since_epoch().count());
+  m_header->data_offset = HEADER_SIZE;
+  m_header->data_size = m_data_size;
+  m_header->video_fourcc = params.video_fourcc;
+  m_header->video_width = params.video_width;
+  m_header->video_height = params.video_height;
+  m_header->audio_fourcc = params.audio_fourcc;
+  m_header->audio_sample_rate = params.audio_sample_rate;
+  m_header->audio_channels = params.audio_channels;
+  try {
+    copy_extra_data(params.video_extra_data, m_header->video_extra_data,
+                    &m_header->video_extra_data_size);
+    copy_extra_data(params.audio_extra_data, m_header->audio_extra_data,
+                    &m_header->audio_extra_data_size);
+  } catch (...) {
+    ::munmap(m_data, m_size);
+    throw;
+  }
+  ref(&m_header->magic).store(MAGIC, std::memory_order_release);
+}
+
+PacketRingWriter::~PacketRingWriter() {
+  // 読む側が書き終わるのを待ち続けないようにする
+  auto state = STATE_WRITING;
+  ref(&m_header->state)
+      .compare_exchange_strong(state, STATE_FAILED, std::memory_order_release,
+                               std::memory_order_relaxed);
+  ::munmap(m_data, m_size);
+}
+
+void PacketRingWriter::addVideoFrame(const hisui::Frame& frame) {
+  write(frame.data.get(), frame.data_size, frame.timestamp,
+        frame.is_key ? FLAG_KEY_FRAME : 0);
+  if (frame.is_key) {
+    ref(&m_header->key_frame_position)
+        .store(m_position - align(RECORD_HEADER_SIZE + frame.data_size),
+               std::memory_order_release);
+  }
+}
+
+void PacketRingWriter::addAudioFrame(const hisui::Frame& frame) {
+  write(frame.data.get(), frame.data_size, frame.timestamp, FLAG_AUDIO);
+}
+
+void PacketRingWriter::finish() {
+  ref(&m_header->state).store(STATE_FINISHED, std::memory_order_release);
+}
+
+void PacketRingWriter::fail() {
+  ref(&m_header->state).store(STATE_FAILED, std::memory_order_release);
+}
+
+void PacketRingWriter::write(const std::uint8_t* data,
+                             const std::size_t size,
+                             const std::uint64_t timestamp,
+                             const std::uint32_t flags) {
+  const auto record_size = align(RECORD_HEADER_SIZE + size);
+  if (record_size > m_data_size) {
+    throw std::runtime_error(fmt::format(
+        "packet is too large for packet ring: size={} ring_size={}", size,
+        m_data_size));
+  }
+  auto offset = m_position % m_data_size;
+  if (m_data_size - offset < record_size) {
+    // リングの終わりまでを埋める. 残りは RECORD_ALIGNMENT の倍数なので header は収まる
+    const auto padding_size = m_data_size - offset;
+    ref(&m_header->reserved_position)
+        .store(m_position + padding_size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const PacketRecordHeader padding{
+        .timestamp = timestamp,
+        .size = static_cast<std::uint32_t>(padding_size - RECORD_HEADER_SIZE),
+        .flags = FLAG_PADDING};
+    std::memcpy(m_data + HEADER_SIZE + offset, &padding, sizeof(padding));
+    m_position += padding_size;
+    ref(&m_header->written_position)
+        .store(m_position, std::memory_order_release);
+    offset = 0;
+  }
+
+  // 上書きする範囲を読む側に先に知らせてから書き込む
+  ref(&m_header->reserved_position)
+      .store(m_position + record_size, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  const PacketRecordHeader header{.timestamp = timestamp,
+                                  .size = static_cast<std::uint32_t>(size),
+                                  .flags = flags};
+  auto* record = m_data + HEADER_SIZE + offset;
+  std::memcpy(record, &header, sizeof(header));
+  std::memcpy(record + RECORD_HEADER_SIZE, data, size);
+  m_position += record_size;
+  ref(&m_header->written_position).store(m_position, std::memory_order_release);
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hisui {
+
+struct Frame;
+
+}
+
+namespace hisui::muxer {
+
+struct PacketRingHeader;
+
+struct PacketRingParameters {
+  const std::uint32_t video_fourcc = 0;
+  const std::uint32_t video_width = 0;
+  const std::uint32_t video_height = 0;
+  const std::vector<std::uint8_t>& video_extra_data = {};
+  const std::uint32_t audio_fourcc = 0;
+  const std::uint32_t audio_sample_rate = 0;
+  const std::uint32_t audio_channels = 0;
+  const std::vector<std::uint8_t>& audio_extra_data = {};
+};
+
+// エンコードしたパケットを, 同じホストの別のプロセスが読めるよう共有メモリのリングに書く.
+// 読む側はファイルを mmap() してリングの上のパケットをそのまま使い, 写す必要はない.
+// 書く側は読む側を待たず, 古いパケットから上書きする.
+//
+// 値は全てホストのバイト順. 先頭の HEADER_SIZE バイトがヘッダーで, 以下の offset に置く.
+//   0: magic (u64) MAGIC. 他の値を書き終えてから書く
+//   8: generation (u64) 開くたびに変わる値
+//   16: data_offset (u64) リングの先頭. HEADER_SIZE
+//   24: data_size (u64) リングの大きさ. RECORD_ALIGNMENT の倍数
+//   32: reserved_position (u64) 書き始めた record の終わりの位置
+//   40: written_position (u64) 書き終えた record の終わりの位置
+//   48: key_frame_position (u64) 最後に書いた映像のキーフレームの record の位置
+//   56: state (u64) 書き込み中は STATE_WRITING, 全てのパケットを書き終えたら STATE_FINISHED,
+//       合成に失敗して途中で止めたら STATE_FAILED
+//   64: video_fourcc (u32), 68: video_width (u32), 72: video_height (u32)
+//   76: audio_fourcc (u32) 音声が無ければ 0
+//   80: audio_sample_rate (u32), 84: audio_channels (u32)
+//   88: video_extra_data_size (u32), 92: audio_extra_data_size (u32)
+//   96: video_extra_data (MAX_EXTRA_DATA_SIZE バイト)
+//   96 + MAX_EXTRA_DATA_SIZE: audio_extra_data (MAX_EXTRA_DATA_SIZE バイト)
+// 位置は書き始めてからのバイト数で, リング上の offset は位置を data_size で割った余り.
+// 位置の値は 8 バイトの atomic な読み書きで扱う.
+//
+// record は RECORD_ALIGNMENT バイト境界に置き, リングの終わりをまたがない.
+//   0: timestamp (u64) ns
+//   8: size (u32) 続くパケットのバイト数
+//   12: flags (u32) FLAG_KEY_FRAME, FLAG_AUDIO, FLAG_PADDING の組み合わせ
+//   16: パケット. 次の record は RECORD_ALIGNMENT に切り上げた位置から
+// FLAG_PADDING の record はパケットを持たず, 次の record はリングの先頭から始まる.
+//
+// 読む側は written_position まで record を順に読む. 使い終えた後に reserved_position を読み,
+// 「record の位置 + data_size」を超えていれば上書きされた可能性があるので結果を捨て,
+// key_frame_position から読み直す
+class PacketRingWriter {
+ public:
+  static constexpr std::uint64_t MAGIC = 0x6869737569707231;  // "hisuipr1"
+  static constexpr std::size_t HEADER_SIZE = 4096;
+  static constexpr std::size_t MAX_EXTRA_DATA_SIZE = 1024;
+  static constexpr std::size_t RECORD_ALIGNMENT = 16;
+  static constexpr std::size_t RECORD_HEADER_SIZE = 16;
+  static constexpr std::uint32_t FLAG_KEY_FRAME = 1;
+  static constexpr std::uint32_t FLAG_AUDIO = 2;
+  static constexpr std::uint32_t FLAG_PADDING = 4;
+  static constexpr std::uint32_t OPUS_FOURCC = 0x7375704f;  // "Opus"
+  static constexpr std::uint64_t STATE_WRITING = 0;
+  static constexpr std::uint64_t STATE_FINISHED = 1;
+  static constexpr std::uint64_t STATE_FAILED = 2;
+
+  // path のファイルを作り直し, リングを size バイトにして mmap() する
+  PacketRingWriter(const std::string& path,
+                   const std::size_t size,
+                   const PacketRingParameters&);
+  // finish() を呼ばずに破棄した場合は STATE_FAILED にする
+  ~PacketRingWriter();
+
+  PacketRingWriter(const PacketRingWriter&) = delete;
+  PacketRingWriter& operator=(const PacketRingWriter&) = delete;
+
+  void addVideoFrame(const hisui::Frame&);
+  void addAudioFrame(const hisui::Frame&);
+  void finish();
+  // 以降は書かないことを読む側に知らせる
+  void fail();
+
+ private:
+  std::size_t m_size;
+  unsigned char* m_data = nullptr;
+  PacketRingHeader* m_header = nullptr;
+  std::size_t m_data_size;
+  std::uint64_t m_position = 0;
+
+  void write(const std::uint8_t*,
+             const std::size_t,
+             const std::uint64_t,
+             const std::uint32_t);
+};
+
+}  // namespace hisui::muxer
@@ -0,0 +1,82 @@
+#include "muxer/pcm_muxer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "frame.hpp"
+#include "muxer/audio_producer.hpp"
+#include "muxer/no_video_producer.hpp"
+#include "report/reporter.hpp"
+
+namespace hisui::muxer {
+
+namespace {
+
+// エンコーダーの代わりに PCMWriter に sample を渡す. m_buffer には何も出力しない
+class PCMAudioProducer : public AudioProducer {
+ public:
+  PCMAudioProducer(const hisui::Config& config,
+                   const std::vector<hisui::ArchiveItem>& archives,
+                   const double duration,
+                   const std::uint32_t sample_rate)
+      : AudioProducer({.archives = archives,
+                       .mixer = config.audio_mixer,
+                       .duration = duration,
+                       .show_progress_bar = config.show_progress_bar,
+                       .buffer_capacity = config.frame_buffer_capacity,
+                       .decode_threads = config.audio_decode_threads,
+                       .sample_rate = sample_rate,
+                       .silence_level = config.audio_silence_level}) {
+    m_encoder = make_pcm_writer(config, sample_rate);
+  }
+};
+
+}  // namespace
+
+PCMMuxer::PCMMuxer(const hisui::Config& t_config,
+                   const PCMMuxerParameters& params)
+    : m_config(t_config),
+      m_audio_archives(params.audio_archive_items),
+      m_duration(params.duration) {}
+
+void PCMMuxer::setUp() {
+  // 書き出す sampling rate でデコードして, 間引かずに済ませる
+  const auto sample_rate = m_config.out_pcm_sample_rate != 0
+                               ? m_config.out_pcm_sample_rate
+                               : m_config.out_audio_sample_rate;
+  m_video_producer = std::make_shared<NoVideoProducer>();
+  m_audio_producer = std::make_shared<PCMAudioProducer>(
+      m_config, m_audio_archives, m_duration, sample_rate);
+
+  if (hisui::report::Reporter::hasInstance()) {
+    hisui::report::Reporter::getInstance().registerOutput({
+        .container = "PCM",
+        .video_codec = "none",
+        .audio_codec = "pcm",
+        .duration = m_duration,
+    });
+  }
+}
+
+void PCMMuxer::run() {
+  mux({.progress_interval = m_config.progress_interval,
+       .duration = m_duration,
+       .start_time = m_config.clip_start,
+       .max_memory = m_config.max_memory << 20});
+}
+
+void PCMMuxer::cleanUp() {}
+
+void PCMMuxer::appendAudio(hisui::Frame) {
+  throw std::logic_error("PCMMuxer does not mux encoded audio");
+}
+
+void PCMMuxer::appendVideo(hisui::Frame) {
+  throw std::logic_error("PCMMuxer does not mux video");
+}
+
+}  // namespace hisui::muxer
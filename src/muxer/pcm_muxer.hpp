@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "muxer/muxer.hpp"
+
+namespace hisui {
+
+struct Frame;
+
+}
+
+namespace hisui::muxer {
+
+struct PCMMuxerParameters {
+  const std::vector<hisui::ArchiveItem>& audio_archive_items;
+  const double duration;
+};
+
+// --out-pcm-only の場合に, 合成した音声をエンコードせずに --out-pcm-file にのみ書き出す.
+// 映像は合成しない
+class PCMMuxer : public Muxer {
+ public:
+  PCMMuxer(const hisui::Config&, const PCMMuxerParameters&);
+
+  void setUp() override;
+  void run() override;
+  void cleanUp() override;
+
+ private:
+  void muxFinalize() override {}
+  void appendAudio(hisui::Frame) override;
+  void appendVideo(hisui::Frame) override;
+
+  hisui::Config m_config;
+  std::vector<hisui::ArchiveItem> m_audio_archives;
+  double m_duration;
+};
+
+}  // namespace hisui::muxer
@@ -0,0 +1,125 @@
+#include "muxer/remux_frames.hpp"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "constants.hpp"
+#include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
+#include "video/vp8_header.hpp"
+#include "video/vp9_header.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace hisui::muxer {
+
+namespace {
+
+// 出力のトラックは 8 bit 4:2:0 とするので, VP9 はプロファイル 0 のみ扱う
+bool get_key_frame_size(const std::uint32_t fourcc,
+                        const unsigned char* data,
+                        const std::size_t size,
+                        std::uint32_t* width,
+                        std::uint32_t* height) {
+  if (fourcc == hisui::Constants::VP8_FOURCC) {
+    return hisui::video::get_vp8_key_frame_size(data, size, width, height);
+  }
+  std::uint32_t profile = 0;
+  return hisui::video::get_vp9_key_frame_size(data, size, &profile, width,
+                                              height) &&
+         profile == 0;
+}
+
+}  // namespace
+
+std::optional<RemuxableTrack> find_remuxable_track(
+    const std::string& file_path) {
+  hisui::webm::input::VideoContext webm(file_path);
+  if (!webm.init()) {
+    return {};
+  }
+  RemuxableTrack track{.fourcc = webm.getFourcc(),
+                       .width = webm.getWidth(),
+                       .height = webm.getHeight(),
+                       .key_frame_timestamps = {}};
+  if (track.fourcc != hisui::Constants::VP8_FOURCC &&
+      track.fourcc != hisui::Constants::VP9_FOURCC) {
+    return {};
+  }
+
+  // 途中で解像度が変わっている場合は合成しないと 1 つのトラックにできない
+  while (webm.readFrame()) {
+    if (!webm.isKeyFrame() || webm.getTimestamp() < 0) {
+      continue;
+    }
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    if (!get_key_frame_size(track.fourcc, webm.getBuffer(),
+                            webm.getBufferSize(), &width, &height) ||
+        width != track.width || height != track.height) {
+      return {};
+    }
+    track.key_frame_timestamps.push_back(
+        static_cast<std::uint64_t>(webm.getTimestamp()));
+  }
+  if (std::empty(track.key_frame_timestamps)) {
+    return {};
+  }
+  return track;
+}
+
+void copy_frames(
+    const std::string& file_path,
+    const std::uint64_t start_ns,
+    const std::uint64_t begin,
+    const std::uint64_t end,
+    const std::uint64_t timescale,
+    hisui::FrameQueue* buffer,
+    const std::function<void(const std::uint64_t)>& show_progress) {
+  hisui::webm::input::VideoContext webm(file_path);
+  if (!webm.init()) {
+    throw std::runtime_error(
+        fmt::format("failed to reopen video track: file_path={}", file_path));
+  }
+
+  // キーフレームより前のフレームは復号できないので捨てる
+  bool has_key_frame = false;
+  while (webm.readFrame()) {
+    if (webm.getTimestamp() < 0) {
+      continue;
+    }
+    const auto t = start_ns + static_cast<std::uint64_t>(webm.getTimestamp());
+    if (t >= end) {
+      break;
+    }
+    if (t < begin || (!has_key_frame && !webm.isKeyFrame())) {
+      continue;
+    }
+    has_key_frame = true;
+
+    const auto size = webm.getBufferSize();
+    auto data = hisui::FrameBufferPool::getInstance().acquire(size);
+    std::memcpy(data.get(), webm.getBuffer(), size);
+    // ns から変換する際に timescale を掛けても溢れないよう, 秒とそれ未満に分ける
+    const std::uint64_t timestamp =
+        t / hisui::Constants::NANO_SECOND * timescale +
+        t % hisui::Constants::NANO_SECOND * timescale /
+            hisui::Constants::NANO_SECOND;
+    buffer->push(hisui::Frame{.timestamp = timestamp,
+                              .data = std::move(data),
+                              .data_size = size,
+                              .is_key = webm.isKeyFrame()});
+    show_progress(t);
+  }
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "frame_queue.hpp"
+
+namespace hisui::muxer {
+
+// フレームをそのまま出力できる VP8 か VP9 の映像トラック
+struct RemuxableTrack {
+  std::uint32_t fourcc;
+  std::uint32_t width;
+  std::uint32_t height;
+  // ファイル内の時刻 (ns)
+  std::vector<std::uint64_t> key_frame_timestamps;
+};
+
+// 映像トラックが VP8 か VP9 (プロファイル 0) で, 全てのキーフレームの解像度が
+// トラックのものと同じであれば返す. そうでなければ空
+std::optional<RemuxableTrack> find_remuxable_track(const std::string&);
+
+// file_path のフレームのうち, ファイル内の時刻に start_ns を足したタイムライン上の時刻が
+// [begin, end) のものを, 最初のキーフレームから timescale の時刻にして buffer に出力する.
+// フレームを出力するごとにタイムライン上の時刻で show_progress を呼ぶ
+void copy_frames(const std::string& file_path,
+                 const std::uint64_t start_ns,
+                 const std::uint64_t begin,
+                 const std::uint64_t end,
+                 const std::uint64_t timescale,
+                 hisui::FrameQueue* buffer,
+                 const std::function<void(const std::uint64_t)>& show_progress);
+
+}  // namespace hisui::muxer
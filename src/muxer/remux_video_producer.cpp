@@ -0,0 +1,130 @@
+#include "muxer/remux_video_producer.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <progresscpp/ProgressBar.hpp>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "frame_queue.hpp"
+#include "muxer/remux_frames.hpp"
+#include "muxer/video_producer.hpp"
+#include "util/trace.hpp"
+
+namespace hisui::muxer {
+
+RemuxVideoProducer::RemuxVideoProducer(
+    const hisui::Config& config,
+    const RemuxVideoProducerParameters& params)
+    : VideoProducer({.show_progress_bar = config.show_progress_bar,
+                     .buffer_capacity = config.frame_buffer_capacity}),
+      m_archive(params.archive),
+      m_fourcc(params.fourcc),
+      m_width(params.width),
+      m_height(params.height),
+      m_timescale(params.timescale) {
+  m_duration = params.duration;
+  m_frame_rate = config.out_video_frame_rate;
+}
+
+void RemuxVideoProducer::produce() {
+  if (isFinished()) {
+    return;
+  }
+
+  HISUI_TRACE_SCOPE("RemuxVideoProducer::produce");
+  try {
+    const std::uint64_t max_time = getMaxTime();
+    const auto start_ns = static_cast<std::uint64_t>(std::floor(
+        m_archive.getStartTimeOffset() * hisui::Constants::NANO_SECOND));
+    const auto end_ns = std::min(
+        max_time, static_cast<std::uint64_t>(
+                      std::ceil(m_archive.getStopTimeOffset() *
+                                hisui::Constants::NANO_SECOND)));
+    progresscpp::ProgressBar progress_bar(max_time, 60);
+
+    copy_frames(m_archive.getPath().string(), start_ns, start_ns, end_ns,
+                m_timescale, &m_buffer,
+                [this, &progress_bar](const std::uint64_t t) {
+                  m_progress_ns = t;
+                  if (m_show_progress_bar) {
+                    progress_bar.setTicks(t);
+                    progress_bar.display();
+                  }
+                });
+
+    m_buffer.close();
+
+    if (m_show_progress_bar) {
+      progress_bar.setTicks(max_time);
+      progress_bar.done();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("RemuxVideoProducer::produce() failed: what={}", e.what());
+    m_buffer.close();
+    throw;
+  }
+}
+
+std::uint32_t RemuxVideoProducer::getWidth() const {
+  return m_width;
+}
+
+std::uint32_t RemuxVideoProducer::getHeight() const {
+  return m_height;
+}
+
+std::uint32_t RemuxVideoProducer::getFourcc() const {
+  return m_fourcc;
+}
+
+std::shared_ptr<VideoProducer> make_remux_video_producer(
+    const hisui::Config& config,
+    const std::vector<hisui::ArchiveItem>& archives,
+    const double duration,
+    const std::uint64_t timescale) {
+  if (!config.video_remux) {
+    return nullptr;
+  }
+  if (std::size(archives) != 1 || !std::empty(config.video_ladder_heights) ||
+      config.participant_outputs || config.isVideoPart() || config.isClip() ||
+      config.scaling_width != 0 || config.scaling_height != 0) {
+    spdlog::info(
+        "--video-remux is not applied: it requires a single video source "
+        "without --video-ladder, --participant-outputs, --video-part-count, "
+        "--start, --end or --scaling-width/height");
+    return nullptr;
+  }
+
+  const auto& archive = archives.front();
+  const auto track = find_remuxable_track(archive.getPath().string());
+  if (!track ||
+      track->fourcc != static_cast<std::uint32_t>(config.out_video_codec)) {
+    spdlog::info(
+        "--video-remux is not applied: the input is not VP8 or VP9 of the "
+        "same codec as --out-video-codec and a constant resolution: {}",
+        archive.getPath().string());
+    return nullptr;
+  }
+
+  spdlog::debug("use RemuxVideoProducer: {}x{}", track->width, track->height);
+  return std::make_shared<RemuxVideoProducer>(
+      config, RemuxVideoProducerParameters{.archive = archive,
+                                           .fourcc = track->fourcc,
+                                           .width = track->width,
+                                           .height = track->height,
+                                           .duration = duration,
+                                           .timescale = timescale});
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "muxer/video_producer.hpp"
+
+namespace hisui::muxer {
+
+struct RemuxVideoProducerParameters {
+  const hisui::ArchiveItem& archive;
+  const std::uint32_t fourcc;
+  const std::uint32_t width;
+  const std::uint32_t height;
+  const double duration;
+  const std::uint64_t timescale = hisui::Constants::NANO_SECOND;
+};
+
+// 入力のフレームをデコードもエンコードもせずに, タイムライン上の時刻に置き換えて出力する
+class RemuxVideoProducer : public VideoProducer {
+ public:
+  RemuxVideoProducer(const hisui::Config&,
+                     const RemuxVideoProducerParameters&);
+
+  void produce() override;
+
+  std::uint32_t getWidth() const override;
+  std::uint32_t getHeight() const override;
+  std::uint32_t getFourcc() const override;
+
+ private:
+  const hisui::ArchiveItem m_archive;
+  const std::uint32_t m_fourcc;
+  const std::uint32_t m_width;
+  const std::uint32_t m_height;
+  const std::uint64_t m_timescale;
+};
+
+// --video-remux が指定され, 入力が 1 つだけで, コーデックが出力と同じ VP8 か VP9 で,
+// 全てのキーフレームの解像度がトラックのものと同じ場合に RemuxVideoProducer を作る.
+// 条件を満たさない場合は nullptr を返すので, エンコードする VideoProducer を使う
+std::shared_ptr<VideoProducer> make_remux_video_producer(
+    const hisui::Config&,
+    const std::vector<hisui::ArchiveItem>&,
+    const double,
+    const std::uint64_t = hisui::Constants::NANO_SECOND);
+
+}  // namespace hisui::muxer
@@ -48,7 +48,10 @@ void SimpleMP4Muxer::setUp() {
 void SimpleMP4Muxer::run() {
   m_simple_writer->writeFtypBox();
 
-  mux();
+  mux({.progress_interval = m_config.progress_interval,
+       .duration = m_duration,
+       .start_time = m_config.clip_start,
+       .max_memory = m_config.max_memory << 20});
 
   if (m_vide_track) {
     m_simple_writer->appendTrakAndUdtaBoxInfo(
@@ -58,6 +61,7 @@ void SimpleMP4Muxer::run() {
   }
   m_simple_writer->writeFreeBoxAndMdatHeader();
   m_simple_writer->writeMoovBox();
+  finishOutput();
 }
 
 void SimpleMP4Muxer::cleanUp() {}
@@ -0,0 +1,70 @@
+#include "muxer/vaapi_video_producer.hpp"
+
+#include <cstdint>
+#include <memory>
+
+#include <boost/rational.hpp>
+
+#include "config.hpp"
+#include "metadata.hpp"
+#include "muxer/video_producer.hpp"
+#include "video/adaptive_grid_composer.hpp"
+#include "video/basic_sequencer.hpp"
+#include "video/composer.hpp"
+#include "video/grid_composer.hpp"
+#include "video/parallel_grid_composer.hpp"
+#include "video/sequencer.hpp"
+#include "video/vaapi_h264_encoder.hpp"
+
+namespace hisui::muxer {
+
+VAAPIVideoProducer::VAAPIVideoProducer(
+    const hisui::Config& t_config,
+    const VAAPIVideoProducerParameters& params)
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .pipeline_depth = t_config.video_pipeline_depth,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}) {
+  m_sequencer = std::make_shared<hisui::video::BasicSequencer>(
+      params.archives, t_config.video_decode_threads);
+
+  const auto scaling_width = t_config.scaling_width != 0
+                                 ? t_config.scaling_width
+                                 : m_sequencer->getMaxWidth();
+  const auto scaling_height = t_config.scaling_height != 0
+                                  ? t_config.scaling_height
+                                  : m_sequencer->getMaxHeight();
+
+  switch (t_config.video_composer) {
+    case hisui::config::VideoComposer::Grid:
+      m_composer = std::make_shared<hisui::video::GridComposer>(
+          scaling_width, scaling_height, m_sequencer->getSize(),
+          t_config.max_columns, t_config.video_scaler,
+          t_config.libyuv_filter_mode);
+      break;
+    case hisui::config::VideoComposer::ParallelGrid:
+      m_composer = std::make_shared<hisui::video::ParallelGridComposer>(
+          scaling_width, scaling_height, m_sequencer->getSize(),
+          t_config.max_columns, t_config.video_scaler,
+          t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
+      break;
+    case hisui::config::VideoComposer::Auto:
+      m_composer = std::make_shared<hisui::video::AdaptiveGridComposer>(
+          scaling_width, scaling_height, m_sequencer->getSize(),
+          t_config.max_columns, t_config.video_scaler,
+          t_config.libyuv_filter_mode, t_config.getVideoComposeThreads());
+      break;
+  }
+
+  hisui::video::VAAPIH264EncoderConfig vaapi_config(
+      m_composer->getWidth(), m_composer->getHeight(), t_config);
+
+  m_encoder = std::make_shared<hisui::video::VAAPIH264Encoder>(
+      &m_buffer, vaapi_config, params.timescale);
+
+  m_duration = params.duration;
+  m_frame_rate = t_config.out_video_frame_rate;
+}
+
+}  // namespace hisui::muxer
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "constants.hpp"
+#include "muxer/video_producer.hpp"
+
+namespace hisui {
+
+class Config;
+class Metadata;
+
+}  // namespace hisui
+
+namespace hisui::muxer {
+
+struct VAAPIVideoProducerParameters {
+  const std::vector<hisui::ArchiveItem>& archives;
+  const double duration;
+  const std::uint64_t timescale = hisui::Constants::NANO_SECOND;
+};
+
+class VAAPIVideoProducer : public VideoProducer {
+ public:
+  VAAPIVideoProducer(const hisui::Config&,
+                     const VAAPIVideoProducerParameters&);
+};
+
+}  // namespace hisui::muxer
@@ -4,11 +4,16 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
 #include <memory>
-#include <mutex>
 #include <optional>
+#include <tuple>
 #include <vector>
 
 #include <boost/rational.hpp>
@@ -16,88 +21,406 @@
 
 #include "constants.hpp"
 #include "frame.hpp"
+#include "frame_queue.hpp"
+#include "report/reporter.hpp"
+#include "util/allocation_counter.hpp"
+#include "util/blocking_queue.hpp"
+#include "util/memory.hpp"
+#include "util/trace.hpp"
 #include "video/composer.hpp"
 #include "video/encoder.hpp"
 #include "video/sequencer.hpp"
-
-namespace hisui::video {
-
-class YUVImage;
-
-}
+#include "video/yuv.hpp"
 
 namespace hisui::muxer {
 
 VideoProducer::VideoProducer(const VideoProducerParameters& params)
-    : m_show_progress_bar(params.show_progress_bar),
-      m_is_finished(params.is_finished) {}
+    : m_buffer(params.buffer_capacity),
+      m_show_progress_bar(params.show_progress_bar),
+      m_pipeline_depth(params.pipeline_depth),
+      m_encode_segments(params.encode_segments),
+      m_part_index(params.part_index),
+      m_part_count(params.part_count),
+      m_variable_frame_rate(params.variable_frame_rate) {
+  if (params.is_finished) {
+    m_buffer.close();
+  }
+}
 
 void VideoProducer::produce() {
   if (isFinished()) {
     return;
   }
 
-  try {
-    std::vector<std::shared_ptr<video::YUVImage>> yuvs;
-    std::vector<unsigned char> raw_image;
-    yuvs.resize(m_sequencer->getSize());
-    raw_image.resize(m_composer->getWidth() * m_composer->getHeight() * 3 >> 1);
+  produceFrames(m_composer->getWidth() * m_composer->getHeight() * 3 >> 1,
+                makeComposeFunction(m_sequencer, m_composer));
+}
 
-    const std::uint64_t max_time = static_cast<std::uint64_t>(
-        std::ceil(m_duration * hisui::Constants::NANO_SECOND));
+VideoProducer::ComposeFunction VideoProducer::makeComposeFunction(
+    std::shared_ptr<hisui::video::Sequencer> sequencer,
+    std::shared_ptr<hisui::video::Composer> composer) const {
+  auto yuvs = std::make_shared<std::vector<std::shared_ptr<video::YUVImage>>>(
+      sequencer->getSize());
+  // 前回の合成に使った画像の世代. 空の場合は未合成
+  auto generations = std::make_shared<std::vector<std::uint64_t>>();
+  return [sequencer, composer, yuvs, generations,
+          is_change_detected = m_variable_frame_rate](
+             std::vector<unsigned char>* raw_image, const std::uint64_t t) {
+    {
+      HISUI_TRACE_SCOPE("Sequencer::getYUVs");
+      hisui::report::StageTimer timer("video_decode");
+      sequencer->getYUVs(yuvs.get(), t);
+    }
+    // どの source も新しい画像を返さなければ合成結果も変わらない.
+    // pipeline_depth が 2 以上の場合は raw_image が前回と別の領域になるので合成は省かない
+    bool is_changed = true;
+    if (is_change_detected) {
+      is_changed = std::empty(*generations);
+      generations->resize(std::size(*yuvs));
+      for (std::size_t i = 0; i < std::size(*yuvs); ++i) {
+        const auto generation = (*yuvs)[i] ? (*yuvs)[i]->getGeneration() : 0;
+        if (generation != (*generations)[i]) {
+          (*generations)[i] = generation;
+          is_changed = true;
+        }
+      }
+    }
+    HISUI_TRACE_SCOPE("Composer::compose");
+    hisui::report::StageTimer timer("video_compose");
+    HISUI_ALLOCATION_SCOPE("Composer::compose");
+    composer->compose(raw_image, *yuvs);
+    return is_changed;
+  };
+}
 
+void VideoProducer::produceFrames(const std::size_t image_size,
+                                  const ComposeFunction& compose) {
+  HISUI_TRACE_SCOPE("VideoProducer::produce");
+  try {
+    const std::uint64_t max_time = getMaxTime();
     progresscpp::ProgressBar progress_bar(max_time, 60);
 
-    for (std::uint64_t t = 0, step = hisui::Constants::NANO_SECOND *
-                                     m_frame_rate.denominator() /
-                                     m_frame_rate.numerator();
-         t < max_time; t += step) {
-      m_sequencer->getYUVs(&yuvs, t);
-      m_composer->compose(&raw_image, yuvs);
-      {
-        std::lock_guard<std::mutex> lock(m_mutex_buffer);
-        m_encoder->outputImage(raw_image);
+    encodeFrames(m_encoder.get(), image_size, compose, 0, max_time,
+                 [this, &progress_bar](const std::uint64_t t) {
+                   m_progress_ns = t;
+                   if (m_show_progress_bar) {
+                     progress_bar.setTicks(t);
+                     progress_bar.display();
+                   }
+                 });
+
+    m_encoder->flush();
+    m_buffer.close();
+
+    if (m_show_progress_bar) {
+      progress_bar.setTicks(max_time);
+      progress_bar.done();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("VideoProducer::produce() failed: what={}", e.what());
+    m_buffer.close();
+    throw;
+  }
+}
+
+void VideoProducer::produceSegments(const std::size_t image_size,
+                                    const std::uint64_t timescale,
+                                    const ComposeFunction& compose,
+                                    const SegmentFactory& create_segment) {
+  HISUI_TRACE_SCOPE("VideoProducer::produce");
+  if (m_part_count > 1) {
+    producePart(image_size, timescale, compose);
+    return;
+  }
+
+  const std::uint64_t max_time = getMaxTime();
+  const std::uint64_t step = getStep();
+  const std::uint64_t number_of_frames = (max_time + step - 1) / step;
+  const std::uint64_t number_of_segments =
+      std::min<std::uint64_t>(m_encode_segments, number_of_frames);
+  if (number_of_segments <= 1) {
+    produceFrames(image_size, compose);
+    return;
+  }
+
+  // 区間の境界はフレーム単位で揃える. 各区間のエンコーダーは先頭をキーフレームにする
+  std::vector<std::uint64_t> first_frames;
+  for (std::uint64_t i = 0; i <= number_of_segments; ++i) {
+    first_frames.push_back(number_of_frames * i / number_of_segments);
+  }
+
+  // 2 番目以降の区間の出力は前の区間を出力し終えるまで溜めておく
+  std::vector<std::unique_ptr<hisui::FrameQueue>> queues;
+  std::vector<std::future<void>> futures;
+  auto abort_segments = [&queues, &futures] {
+    for (auto& q : queues) {
+      q->abort();
+    }
+    for (auto& f : futures) {
+      if (f.valid()) {
+        f.wait();
       }
+    }
+  };
+
+  try {
+    for (std::uint64_t i = 1; i < number_of_segments; ++i) {
+      queues.push_back(std::make_unique<hisui::FrameQueue>());
+      futures.push_back(std::async(
+          std::launch::async,
+          [this, &create_segment, image_size, queue = queues.back().get(),
+           begin = first_frames[i] * step,
+           end = std::min(first_frames[i + 1] * step, max_time)] {
+            try {
+              const auto segment = create_segment(queue);
+              encodeFrames(segment.encoder.get(), image_size, segment.compose,
+                           begin, end, [](const std::uint64_t) {});
+              segment.encoder->flush();
+            } catch (...) {
+              queue->close();
+              throw;
+            }
+            queue->close();
+          }));
+    }
 
+    progresscpp::ProgressBar progress_bar(max_time, 60);
+    auto show_progress = [this, &progress_bar](const std::uint64_t t) {
+      m_progress_ns = t;
       if (m_show_progress_bar) {
         progress_bar.setTicks(t);
         progress_bar.display();
       }
-    }
+    };
 
-    {
-      std::lock_guard<std::mutex> lock(m_mutex_buffer);
-      m_encoder->flush();
-      m_is_finished = true;
+    encodeFrames(m_encoder.get(), image_size, compose, 0,
+                 first_frames[1] * step, show_progress);
+    m_encoder->flush();
+
+    for (std::uint64_t i = 1; i < number_of_segments; ++i) {
+      const std::uint64_t offset = first_frames[i] * timescale *
+                                   m_frame_rate.denominator() /
+                                   m_frame_rate.numerator();
+      auto& queue = queues[i - 1];
+      while (const auto frame = queue->waitFront()) {
+        m_buffer.push(hisui::Frame{.timestamp = frame->timestamp + offset,
+                                   .data = frame->data,
+                                   .data_size = frame->data_size,
+                                   .is_key = frame->is_key});
+        queue->pop();
+      }
+      futures[i - 1].get();
+      show_progress(std::min(first_frames[i + 1] * step, max_time));
     }
 
+    m_buffer.close();
+
     if (m_show_progress_bar) {
       progress_bar.setTicks(max_time);
       progress_bar.done();
     }
   } catch (const std::exception& e) {
     spdlog::error("VideoProducer::produce() failed: what={}", e.what());
-    m_is_finished = true;
+    abort_segments();
+    m_buffer.close();
     throw;
   }
 }
 
+void VideoProducer::producePart(const std::size_t image_size,
+                                const std::uint64_t timescale,
+                                const ComposeFunction& compose) {
+  try {
+    const std::uint64_t max_time = getMaxTime();
+    const std::uint64_t step = getStep();
+    const std::uint64_t number_of_frames = (max_time + step - 1) / step;
+
+    // produceSegments() と同じくフレーム単位で区切るので, 別のプロセスでエンコードした
+    // part を順に並べるとタイムライン全体になる. 新しいエンコーダーなので先頭はキーフレームになる
+    const std::uint64_t first_frame =
+        number_of_frames * m_part_index / m_part_count;
+    const std::uint64_t last_frame =
+        number_of_frames * (m_part_index + 1) / m_part_count;
+    const std::uint64_t begin = std::min(first_frame * step, max_time);
+    const std::uint64_t end = std::min(last_frame * step, max_time);
+    m_timestamp_offset = first_frame * timescale * m_frame_rate.denominator() /
+                         m_frame_rate.numerator();
+    spdlog::debug("part {}/{}: frames=[{}, {})", m_part_index, m_part_count,
+                  first_frame, last_frame);
+
+    progresscpp::ProgressBar progress_bar(
+        std::max<std::uint64_t>(end - begin, 1), 60);
+    encodeFrames(m_encoder.get(), image_size, compose, begin, end,
+                 [this, &progress_bar, begin](const std::uint64_t t) {
+                   m_progress_ns = t;
+                   if (m_show_progress_bar) {
+                     progress_bar.setTicks(t - begin);
+                     progress_bar.display();
+                   }
+                 });
+
+    m_encoder->flush();
+    m_buffer.close();
+
+    if (m_show_progress_bar) {
+      progress_bar.setTicks(end - begin);
+      progress_bar.done();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("VideoProducer::produce() failed: what={}", e.what());
+    m_buffer.close();
+    throw;
+  }
+}
+
+void VideoProducer::encodeFrames(
+    hisui::video::Encoder* encoder,
+    const std::size_t image_size,
+    const ComposeFunction& compose,
+    const std::uint64_t begin,
+    const std::uint64_t end,
+    const std::function<void(const std::uint64_t)>& show_progress) {
+  const std::uint64_t max_time = getMaxTime();
+  const std::uint64_t step = getStep();
+
+  // m_variable_frame_rate の場合, 合成結果が変わらない間はエンコードを省いてフレームレートを下げる.
+  // 間隔が空きすぎないよう 1 秒に 1 枚はエンコードし, 長さを保つため最後のフレームもエンコードする
+  const std::uint64_t max_skipped_frames =
+      m_frame_rate.numerator() / m_frame_rate.denominator();
+  std::uint64_t skipped_frames = 0;
+  auto output_image = [&](const std::vector<unsigned char>& raw_image,
+                          const std::uint64_t t, const bool is_changed) {
+    if (m_variable_frame_rate && !is_changed && t != begin &&
+        skipped_frames < max_skipped_frames && t + step < max_time &&
+        encoder->skipImage()) {
+      ++skipped_frames;
+      return;
+    }
+    skipped_frames = 0;
+    HISUI_TRACE_SCOPE("Encoder::outputImage");
+    hisui::report::StageTimer timer("video_encode");
+    encoder->outputImage(raw_image);
+  };
+
+  if (m_pipeline_depth <= 1) {
+    std::vector<unsigned char> raw_image;
+    hisui::util::resize_with_huge_pages(&raw_image, image_size);
+    for (std::uint64_t t = begin; t < end; t += step) {
+      const bool is_changed = compose(&raw_image, m_start_time + t);
+      output_image(raw_image, t, is_changed);
+      show_progress(t);
+    }
+    return;
+  }
+
+  // 合成とエンコードを別スレッドで行い, 合成済みの画像を m_pipeline_depth 枚まで先行させる
+  std::vector<std::vector<unsigned char>> raw_images(m_pipeline_depth);
+  for (auto& raw_image : raw_images) {
+    hisui::util::resize_with_huge_pages(&raw_image, image_size);
+  }
+  hisui::util::BlockingQueue<std::size_t> free_images;
+  hisui::util::BlockingQueue<std::tuple<std::size_t, std::uint64_t, bool>>
+      composed_images;
+  for (std::size_t i = 0; i < m_pipeline_depth; ++i) {
+    free_images.push(i);
+  }
+
+  auto compose_future = std::async(std::launch::async, [&] {
+    try {
+      for (std::uint64_t t = begin; t < end; t += step) {
+        const auto index = free_images.pop();
+        if (!index.has_value()) {
+          break;
+        }
+        const bool is_changed =
+            compose(&raw_images[index.value()], m_start_time + t);
+        composed_images.push({index.value(), t, is_changed});
+      }
+    } catch (...) {
+      composed_images.close();
+      throw;
+    }
+    composed_images.close();
+  });
+
+  try {
+    while (true) {
+      const auto composed = composed_images.pop();
+      if (!composed.has_value()) {
+        break;
+      }
+      const auto [index, t, is_changed] = composed.value();
+      output_image(raw_images[index], t, is_changed);
+      free_images.push(index);
+      show_progress(t);
+    }
+  } catch (...) {
+    free_images.close();
+    throw;
+  }
+  compose_future.get();
+}
+
+std::uint64_t VideoProducer::getMaxTime() const {
+  return static_cast<std::uint64_t>(
+      std::ceil(m_duration * hisui::Constants::NANO_SECOND));
+}
+
+std::uint64_t VideoProducer::getStep() const {
+  return hisui::Constants::NANO_SECOND * m_frame_rate.denominator() /
+         m_frame_rate.numerator();
+}
+
 void VideoProducer::bufferPop() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
   m_buffer.pop();
 }
 
 std::optional<hisui::Frame> VideoProducer::bufferFront() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
-  if (m_buffer.empty()) {
-    return {};
+  return addTimestampOffset(m_buffer.front());
+}
+
+std::optional<hisui::Frame> VideoProducer::waitBufferFront() {
+  return addTimestampOffset(m_buffer.waitFront());
+}
+
+std::optional<hisui::Frame> VideoProducer::addTimestampOffset(
+    const std::optional<hisui::Frame>& frame) const {
+  if (!frame.has_value() || m_timestamp_offset == 0) {
+    return frame;
   }
-  return m_buffer.front();
+  return hisui::Frame{.timestamp = frame->timestamp + m_timestamp_offset,
+                      .data = frame->data,
+                      .data_size = frame->data_size,
+                      .is_key = frame->is_key};
+}
+
+void VideoProducer::abort() {
+  m_buffer.abort();
 }
 
 bool VideoProducer::isFinished() {
-  std::lock_guard<std::mutex> lock(m_mutex_buffer);
-  return m_is_finished && m_buffer.empty();
+  return m_buffer.isFinished();
+}
+
+std::size_t VideoProducer::getBufferPeakSize() {
+  return m_buffer.peakSize();
+}
+
+std::size_t VideoProducer::getBufferSize() {
+  return m_buffer.size();
+}
+
+double VideoProducer::getProgressTime() {
+  if (m_buffer.isClosed()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return static_cast<double>(m_progress_ns.load()) /
+         hisui::Constants::NANO_SECOND;
+}
+
+void VideoProducer::setStartTime(const double start_time) {
+  m_start_time = static_cast<std::uint64_t>(
+      std::llround(start_time * hisui::Constants::NANO_SECOND));
 }
 
 std::uint32_t VideoProducer::getWidth() const {
@@ -113,7 +436,15 @@ std::uint32_t VideoProducer::getFourcc() const {
 }
 
 const std::vector<std::uint8_t>& VideoProducer::getExtraData() const {
-  throw std::logic_error("VideoProducer::getExtraData() should not be called");
+  if (!m_encoder) {
+    throw std::logic_error(
+        "VideoProducer::getExtraData() should not be called");
+  }
+  return m_encoder->getExtraData();
+}
+
+std::vector<VideoRendition> VideoProducer::getRenditions() const {
+  return {};
 }
 
 }  // namespace hisui::muxer
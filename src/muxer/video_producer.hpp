@@ -1,16 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
-#include <mutex>
 #include <optional>
-#include <queue>
+#include <string>
 #include <vector>
 
 #include <boost/cstdint.hpp>
 #include <boost/rational.hpp>
 
 #include "frame.hpp"
+#include "frame_queue.hpp"
 #include "video/composer.hpp"
 #include "video/encoder.hpp"
 #include "video/sequencer.hpp"
@@ -20,6 +23,23 @@ namespace hisui::muxer {
 struct VideoProducerParameters {
   const bool show_progress_bar = true;
   const bool is_finished = false;
+  const std::size_t buffer_capacity = 0;  // 0: unbounded
+  const std::size_t pipeline_depth = 1;   // 1: 合成とエンコードを交互に行う
+  const std::size_t encode_segments = 1;  // 1: 分割せずにエンコードする
+  // part_count 個に分けたタイムラインのうち part_index 番目だけをエンコードする
+  const std::size_t part_index = 0;
+  const std::size_t part_count = 1;  // 1: タイムライン全体をエンコードする
+  // 合成結果が変わらない間のエンコードを省く
+  const bool variable_frame_rate = false;
+};
+
+// --video-ladder で追加する映像のみの出力. エンコード結果は buffer に出力される
+struct VideoRendition {
+  const std::uint32_t width;
+  const std::uint32_t height;
+  hisui::FrameQueue* buffer;
+  // 空でなければ合成結果ではなく, この connection_id の参加者のみの映像
+  const std::string connection_id = "";
 };
 
 class VideoProducer {
@@ -30,29 +50,86 @@ class VideoProducer {
   virtual void produce();
   void bufferPop();
   std::optional<hisui::Frame> bufferFront();
+  std::optional<hisui::Frame> waitBufferFront();
+  void abort();
   bool isFinished();
+  std::size_t getBufferPeakSize();
+  std::size_t getBufferSize();
+  // 合成を終えたタイムライン上の時刻 (秒). 終えていれば無限大を返す
+  double getProgressTime();
+  // タイムライン上のこの時刻 (秒) から合成する. 出力の pts は 0 から始まる
+  void setStartTime(const double);
 
   virtual std::uint32_t getWidth() const;
   virtual std::uint32_t getHeight() const;
-  std::uint32_t getFourcc() const;
+  virtual std::uint32_t getFourcc() const;
 
   virtual const std::vector<std::uint8_t>& getExtraData() const;
+  virtual std::vector<VideoRendition> getRenditions() const;
 
  protected:
+  // 直前のフレームから合成結果が変わった場合に true を返す
+  using ComposeFunction =
+      std::function<bool(std::vector<unsigned char>*, const std::uint64_t)>;
+  void produceFrames(const std::size_t, const ComposeFunction&);
+  // sequencer から取得した画像を composer で合成する ComposeFunction を返す.
+  // m_variable_frame_rate でなければ常に変わったものとする
+  ComposeFunction makeComposeFunction(
+      std::shared_ptr<hisui::video::Sequencer>,
+      std::shared_ptr<hisui::video::Composer>) const;
+
+  // 時間方向に分割した区間を独立にエンコードするための合成関数とエンコーダー.
+  // エンコーダーは引数の FrameQueue に出力し, pts は区間の先頭を 0 とする
+  struct EncodingSegment {
+    std::shared_ptr<hisui::video::Encoder> encoder;
+    ComposeFunction compose;
+  };
+  using SegmentFactory = std::function<EncodingSegment(hisui::FrameQueue*)>;
+  // m_encode_segments 個の区間に分けて並列にエンコードし, 順に m_buffer へ出力する.
+  // 最初の区間は m_encoder と compose で処理する.
+  // m_part_count が 2 以上の場合は m_part_index 番目の区間だけをエンコードする
+  void produceSegments(const std::size_t,
+                       const std::uint64_t,
+                       const ComposeFunction&,
+                       const SegmentFactory&);
+  std::uint64_t getMaxTime() const;
+
   std::shared_ptr<hisui::video::Sequencer> m_sequencer;
   std::shared_ptr<hisui::video::Encoder> m_encoder;
   std::shared_ptr<hisui::video::Composer> m_composer;
 
-  std::queue<hisui::Frame> m_buffer;
+  hisui::FrameQueue m_buffer;
 
   bool m_show_progress_bar;
-
-  bool m_is_finished = false;
-
-  std::mutex m_mutex_buffer;
+  std::size_t m_pipeline_depth;
+  std::size_t m_encode_segments;
+  std::size_t m_part_index;
+  std::size_t m_part_count;
+  bool m_variable_frame_rate;
 
   double m_duration;
   boost::rational<std::uint64_t> m_frame_rate;
+  std::atomic<std::uint64_t> m_progress_ns = 0;
+  // 合成を始めるタイムライン上の時刻 (ns)
+  std::uint64_t m_start_time = 0;
+
+ private:
+  // [begin, end) の時刻のフレームを合成して encoder に渡す
+  void encodeFrames(hisui::video::Encoder*,
+                    const std::size_t,
+                    const ComposeFunction&,
+                    const std::uint64_t,
+                    const std::uint64_t,
+                    const std::function<void(const std::uint64_t)>&);
+  void producePart(const std::size_t,
+                   const std::uint64_t,
+                   const ComposeFunction&);
+  std::optional<hisui::Frame> addTimestampOffset(
+      const std::optional<hisui::Frame>&) const;
+  std::uint64_t getStep() const;
+
+  // m_buffer のフレームの pts に足す値. part をエンコードする場合にタイムライン上の位置を表す
+  std::uint64_t m_timestamp_offset = 0;
 };
 
 }  // namespace hisui::muxer
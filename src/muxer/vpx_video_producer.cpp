@@ -1,58 +1,323 @@
 #include "muxer/vpx_video_producer.hpp"
 
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
+#include <vector>
 
 #include <boost/rational.hpp>
+#include <progresscpp/ProgressBar.hpp>
 
+#include "archive_item.hpp"
 #include "config.hpp"
+#include "constants.hpp"
+#include "frame_queue.hpp"
 #include "metadata.hpp"
 #include "muxer/video_producer.hpp"
+#include "util/memory.hpp"
+#include "util/trace.hpp"
+#include "video/adaptive_grid_composer.hpp"
 #include "video/basic_sequencer.hpp"
 #include "video/buffer_vpx_encoder.hpp"
 #include "video/composer.hpp"
 #include "video/grid_composer.hpp"
+#include "video/ladder_encoder.hpp"
 #include "video/parallel_grid_composer.hpp"
+#include "video/participant_composer.hpp"
 #include "video/sequencer.hpp"
 #include "video/vpx.hpp"
+#include "video/yuv.hpp"
 
 namespace hisui::muxer {
 
-VPXVideoProducer::VPXVideoProducer(const hisui::Config& t_config,
-                                   const VPXVideoProducerParameters& params)
-    : VideoProducer({.show_progress_bar = t_config.show_progress_bar}) {
-  m_sequencer = std::make_shared<hisui::video::BasicSequencer>(params.archives);
+namespace {
 
-  const auto scaling_width = t_config.scaling_width != 0
-                                 ? t_config.scaling_width
-                                 : m_sequencer->getMaxWidth();
-  const auto scaling_height = t_config.scaling_height != 0
-                                  ? t_config.scaling_height
-                                  : m_sequencer->getMaxHeight();
+struct Components {
+  std::shared_ptr<hisui::video::Sequencer> sequencer;
+  std::shared_ptr<hisui::video::Composer> composer;
+  std::shared_ptr<hisui::video::Encoder> encoder;
+};
 
-  switch (t_config.video_composer) {
+std::shared_ptr<hisui::video::Composer> make_grid_composer(
+    const hisui::Config& config,
+    const hisui::video::Sequencer& sequencer,
+    const std::size_t size) {
+  const auto scaling_width = config.scaling_width != 0
+                                 ? config.scaling_width
+                                 : sequencer.getMaxWidth();
+  const auto scaling_height = config.scaling_height != 0
+                                  ? config.scaling_height
+                                  : sequencer.getMaxHeight();
+
+  switch (config.video_composer) {
     case hisui::config::VideoComposer::Grid:
-      m_composer = std::make_shared<hisui::video::GridComposer>(
-          scaling_width, scaling_height, m_sequencer->getSize(),
-          t_config.max_columns, t_config.video_scaler,
-          t_config.libyuv_filter_mode);
-      break;
+      return std::make_shared<hisui::video::GridComposer>(
+          scaling_width, scaling_height, size, config.max_columns,
+          config.video_scaler, config.libyuv_filter_mode);
     case hisui::config::VideoComposer::ParallelGrid:
-      m_composer = std::make_shared<hisui::video::ParallelGridComposer>(
-          scaling_width, scaling_height, m_sequencer->getSize(),
-          t_config.max_columns, t_config.video_scaler,
-          t_config.libyuv_filter_mode);
-      break;
+      return std::make_shared<hisui::video::ParallelGridComposer>(
+          scaling_width, scaling_height, size, config.max_columns,
+          config.video_scaler, config.libyuv_filter_mode,
+          config.getVideoComposeThreads());
+    case hisui::config::VideoComposer::Auto:
+      return std::make_shared<hisui::video::AdaptiveGridComposer>(
+          scaling_width, scaling_height, size, config.max_columns,
+          config.video_scaler, config.libyuv_filter_mode,
+          config.getVideoComposeThreads());
   }
+  throw std::logic_error("config.video_composer is invalid");
+}
+
+Components create_components(const hisui::Config& config,
+                             const std::vector<hisui::ArchiveItem>& archives,
+                             const std::uint64_t timescale,
+                             hisui::FrameQueue* buffer) {
+  Components components;
+  components.sequencer = std::make_shared<hisui::video::BasicSequencer>(
+      archives, config.video_decode_threads, config.getVideoWarmUpTime());
+  components.composer = make_grid_composer(config, *components.sequencer,
+                                           components.sequencer->getSize());
 
-  hisui::video::VPXEncoderConfig vpx_config(m_composer->getWidth(),
-                                            m_composer->getHeight(), t_config);
+  hisui::video::VPXEncoderConfig vpx_config(components.composer->getWidth(),
+                                            components.composer->getHeight(),
+                                            config);
+  components.encoder = std::make_shared<hisui::video::BufferVPXEncoder>(
+      buffer, vpx_config, timescale);
 
-  m_encoder = std::make_shared<hisui::video::BufferVPXEncoder>(
-      &m_buffer, vpx_config, params.timescale);
+  return components;
+}
+
+}  // namespace
+
+VPXVideoProducer::VPXVideoProducer(const hisui::Config& t_config,
+                                   const VPXVideoProducerParameters& params)
+    : VideoProducer({.show_progress_bar = t_config.show_progress_bar,
+                     .buffer_capacity = t_config.frame_buffer_capacity,
+                     .pipeline_depth = t_config.video_pipeline_depth,
+                     .encode_segments = t_config.video_encode_segments,
+                     .part_index = t_config.video_part_index,
+                     .part_count = t_config.video_part_count,
+                     .variable_frame_rate =
+                         t_config.video_variable_frame_rate}),
+      m_config(t_config),
+      m_archives(params.archives),
+      m_timescale(params.timescale) {
+  const auto components = create_components(m_config, m_archives,
+                                             m_timescale, &m_buffer);
+  m_sequencer = components.sequencer;
+  m_composer = components.composer;
+  m_encoder = components.encoder;
 
   m_duration = params.duration;
   m_frame_rate = t_config.out_video_frame_rate;
+
+  if (!std::empty(m_config.video_ladder_heights)) {
+    setUpLadder();
+  }
+  if (m_config.participant_outputs) {
+    setUpParticipants();
+  }
+}
+
+void VPXVideoProducer::setUpLadder() {
+  const std::uint32_t width = m_composer->getWidth();
+  const std::uint32_t height = m_composer->getHeight();
+  std::vector<hisui::video::LadderRendition> ladder_renditions;
+  for (const auto ladder_height : m_config.video_ladder_heights) {
+    if (ladder_height >= height) {
+      throw std::invalid_argument(
+          fmt::format("--video-ladder height must be less than {}: {}", height,
+                      ladder_height));
+    }
+    // 縦横比を保ち, 幅と高さは偶数にする
+    const std::uint32_t h = ladder_height & ~1U;
+    const auto w = static_cast<std::uint32_t>(
+                       static_cast<std::uint64_t>(width) * h / height) &
+                   ~1U;
+    if (w == 0 || h == 0) {
+      throw std::invalid_argument(
+          fmt::format("--video-ladder height is too small: {}", ladder_height));
+    }
+
+    // ビットレートは画素数に比例させる
+    hisui::Config config = m_config;
+    config.out_video_bit_rate = std::max(
+        1U, static_cast<std::uint32_t>(
+                static_cast<std::uint64_t>(m_config.out_video_bit_rate) * w *
+                h / (static_cast<std::uint64_t>(width) * height)));
+
+    m_rendition_buffers.push_back(std::make_unique<hisui::FrameQueue>());
+    auto buffer = m_rendition_buffers.back().get();
+    ladder_renditions.push_back(
+        {.width = w,
+         .height = h,
+         .encoder = std::make_shared<hisui::video::BufferVPXEncoder>(
+             buffer, hisui::video::VPXEncoderConfig(w, h, config),
+             m_timescale)});
+    m_renditions.push_back({.width = w, .height = h, .buffer = buffer});
+  }
+  m_encoder = std::make_shared<hisui::video::LadderEncoder>(
+      m_encoder, width, height, ladder_renditions, m_config.libyuv_filter_mode);
+}
+
+void VPXVideoProducer::setUpParticipants() {
+  const auto size = m_sequencer->getSize();
+  if (size == 0) {
+    return;
+  }
+  const auto width = m_config.scaling_width != 0 ? m_config.scaling_width
+                                                 : m_sequencer->getMaxWidth();
+  const auto height = m_config.scaling_height != 0
+                          ? m_config.scaling_height
+                          : m_sequencer->getMaxHeight();
+
+  // 合成結果のビットレートを参加者の数で分け合う
+  hisui::Config config = m_config;
+  config.out_video_bit_rate = std::max(
+      1U, static_cast<std::uint32_t>(m_config.out_video_bit_rate / size));
+
+  std::vector<std::shared_ptr<hisui::video::Encoder>> encoders;
+  for (std::size_t i = 0; i < size; ++i) {
+    m_rendition_buffers.push_back(std::make_unique<hisui::FrameQueue>());
+    auto buffer = m_rendition_buffers.back().get();
+    encoders.push_back(std::make_shared<hisui::video::BufferVPXEncoder>(
+        buffer, hisui::video::VPXEncoderConfig(width, height, config),
+        m_timescale));
+    m_renditions.push_back({.width = width,
+                            .height = height,
+                            .buffer = buffer,
+                            .connection_id = m_sequencer->getConnectionID(i)});
+  }
+  m_participant_composer = std::make_shared<hisui::video::ParticipantComposer>(
+      m_composer, width, height, encoders, m_config.video_scaler,
+      m_config.libyuv_filter_mode);
+  m_composer = m_participant_composer;
+}
+
+void VPXVideoProducer::closeRenditionBuffers() {
+  for (auto& b : m_rendition_buffers) {
+    b->close();
+  }
+}
+
+std::vector<VideoRendition> VPXVideoProducer::getRenditions() const {
+  return m_renditions;
+}
+
+void VPXVideoProducer::produce() {
+  if (isFinished()) {
+    return;
+  }
+
+  if (m_config.adaptive_grid) {
+    produceAdaptiveGrid();
+    return;
+  }
+
+  if (!std::empty(m_renditions)) {
+    try {
+      produceFrames(m_composer->getWidth() * m_composer->getHeight() * 3 >> 1,
+                    makeComposeFunction(m_sequencer, m_composer));
+      if (m_participant_composer) {
+        m_participant_composer->flush();
+      }
+    } catch (...) {
+      closeRenditionBuffers();
+      throw;
+    }
+    closeRenditionBuffers();
+    return;
+  }
+
+  produceSegments(
+      m_composer->getWidth() * m_composer->getHeight() * 3 >> 1, m_timescale,
+      makeComposeFunction(m_sequencer, m_composer),
+      [this](hisui::FrameQueue* buffer) {
+        const auto components =
+            create_components(m_config, m_archives, m_timescale, buffer);
+        return EncodingSegment{
+            .encoder = components.encoder,
+            .compose = makeComposeFunction(components.sequencer,
+                                           components.composer)};
+      });
+}
+
+// 合成するたびに画像の大きさとビットレートが変わりうるので, パイプラインを使わずに
+// 合成した順にエンコードする
+void VPXVideoProducer::produceAdaptiveGrid() {
+  HISUI_TRACE_SCOPE("VPXVideoProducer::produceAdaptiveGrid");
+  try {
+    const auto size = m_sequencer->getSize();
+    // 表示中の source の数ごとの composer. 必要になった時に作る
+    std::vector<std::shared_ptr<hisui::video::Composer>> composers(size + 1);
+    std::vector<std::shared_ptr<hisui::video::YUVImage>> yuvs(size);
+    std::vector<std::shared_ptr<hisui::video::YUVImage>> active_yuvs;
+    std::vector<unsigned char> raw_image;
+    std::size_t last_number_of_active_sources = 0;
+
+    const std::uint64_t max_time = getMaxTime();
+    progresscpp::ProgressBar progress_bar(max_time, 60);
+    const std::uint64_t step = hisui::Constants::NANO_SECOND *
+                               m_frame_rate.denominator() /
+                               m_frame_rate.numerator();
+    for (std::uint64_t t = 0; t < max_time; t += step) {
+      m_sequencer->getYUVs(&yuvs, m_start_time + t);
+      active_yuvs.clear();
+      std::copy_if(std::begin(yuvs), std::end(yuvs),
+                   std::back_inserter(active_yuvs),
+                   [](const auto& yuv) { return yuv != nullptr; });
+      // 誰も表示されていない間は 1 つ分の黒い画像にする
+      const auto n = std::max<std::size_t>(std::size(active_yuvs), 1);
+      active_yuvs.resize(n);
+
+      auto& composer = composers[n];
+      if (!composer) {
+        composer = make_grid_composer(m_config, *m_sequencer, n);
+      }
+      if (n != last_number_of_active_sources) {
+        spdlog::debug("adaptive grid: {} sources in {}x{} at {}", n,
+                      composer->getWidth(), composer->getHeight(), t);
+        last_number_of_active_sources = n;
+      }
+
+      hisui::util::resize_with_huge_pages(
+          &raw_image, composer->getWidth() * composer->getHeight() * 3 >> 1);
+      composer->compose(&raw_image, active_yuvs);
+      // ビットレートは表示中の source の数に比例させる
+      m_encoder->setResolutionAndBitrate(
+          composer->getWidth(), composer->getHeight(),
+          std::max(1U, static_cast<std::uint32_t>(
+                           static_cast<std::uint64_t>(
+                               m_config.out_video_bit_rate) *
+                           n / size)));
+      m_encoder->outputImage(raw_image);
+
+      m_progress_ns = t;
+      if (m_show_progress_bar) {
+        progress_bar.setTicks(t);
+        progress_bar.display();
+      }
+    }
+
+    m_encoder->flush();
+    m_buffer.close();
+
+    if (m_show_progress_bar) {
+      progress_bar.setTicks(max_time);
+      progress_bar.done();
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("VideoProducer::produce() failed: what={}", e.what());
+    m_buffer.close();
+    throw;
+  }
 }
 
 }  // namespace hisui::muxer
@@ -1,19 +1,27 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "archive_item.hpp"
+#include "config.hpp"
 #include "constants.hpp"
+#include "frame_queue.hpp"
 #include "muxer/video_producer.hpp"
 
 namespace hisui {
 
-class Config;
 class Metadata;
 
 }  // namespace hisui
 
+namespace hisui::video {
+
+class ParticipantComposer;
+
+}  // namespace hisui::video
+
 namespace hisui::muxer {
 
 struct VPXVideoProducerParameters {
@@ -25,6 +33,23 @@ struct VPXVideoProducerParameters {
 class VPXVideoProducer : public VideoProducer {
  public:
   VPXVideoProducer(const hisui::Config&, const VPXVideoProducerParameters&);
+
+  void produce() override;
+  std::vector<VideoRendition> getRenditions() const override;
+
+ private:
+  void setUpLadder();
+  void setUpParticipants();
+  void closeRenditionBuffers();
+  // 表示中の source だけを並べた grid を合成し, 大きさとビットレートを切り替えながらエンコードする
+  void produceAdaptiveGrid();
+
+  const hisui::Config m_config;
+  const std::vector<hisui::ArchiveItem> m_archives;
+  const std::uint64_t m_timescale;
+  std::vector<std::unique_ptr<hisui::FrameQueue>> m_rendition_buffers;
+  std::vector<VideoRendition> m_renditions;
+  std::shared_ptr<hisui::video::ParticipantComposer> m_participant_composer;
 };
 
 }  // namespace hisui::muxer
@@ -0,0 +1,151 @@
+#include "preflight.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "metadata.hpp"
+#include "util/file.hpp"
+#include "util/thread_pool.hpp"
+#include "video/decoder.hpp"
+#include "video/decoder_factory.hpp"
+#include "webm/input/audio_context.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace hisui {
+
+namespace {
+
+// 例外を投げれば壊れている
+void check_archive(const std::string& path) {
+  auto video = std::make_shared<hisui::webm::input::VideoContext>(path);
+  const bool has_video = video->init();
+  hisui::webm::input::AudioContext audio(path);
+  const bool has_audio = audio.init();
+  if (!has_video && !has_audio) {
+    throw std::runtime_error("no supported audio or video track");
+  }
+
+  // Index は音声と映像で共有するので, どちらかを末尾まで辿れば全ての Block を調べられる.
+  // フレームは読まないので, デコードにかかる時間に比べて短く済む
+  if (has_video) {
+    video->seekToKeyFrame(std::numeric_limits<std::int64_t>::max());
+  } else {
+    audio.seekToKeyFrame(std::numeric_limits<std::int64_t>::max());
+  }
+  if (!has_video) {
+    return;
+  }
+
+  // 辿った Context は末尾に進んでいるので, 開き直して先頭からデコードする
+  video = std::make_shared<hisui::webm::input::VideoContext>(path);
+  video->init();
+  const auto first_timestamp = video->peekNextTimestamp();
+  if (!first_timestamp) {
+    return;
+  }
+  auto decoder = hisui::video::DecoderFactory::create(video);
+  decoder->getImage(static_cast<std::uint64_t>(*first_timestamp));
+}
+
+}  // namespace
+
+std::vector<BrokenArchive> find_broken_archives(
+    const hisui::Config& config,
+    const std::vector<hisui::ArchiveItem>& archives) {
+  // 同じファイルを複数の archive が参照することがあるので 1 度だけ調べる
+  std::vector<std::string> paths;
+  std::set<std::string> seen;
+  for (const auto& archive : archives) {
+    auto path = archive.getPath().string();
+    if (hisui::util::is_url(path) ||
+        hisui::util::get_extension(archive.getPath()) != ".webm") {
+      spdlog::debug("preflight: skipped {}", path);
+      continue;
+    }
+    if (seen.insert(path).second) {
+      paths.push_back(std::move(path));
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::optional<std::string>> errors(std::size(paths));
+  const auto jobs =
+      std::max<std::size_t>(1, std::min<std::size_t>(config.getJobThreads(),
+                                                     std::size(paths)));
+  hisui::util::ThreadPool thread_pool(jobs - 1);
+  thread_pool.parallelFor(std::size(paths), [&](const std::size_t i) {
+    try {
+      check_archive(paths[i]);
+    } catch (const std::exception& e) {
+      errors[i] = e.what();
+    }
+  });
+
+  std::vector<BrokenArchive> broken;
+  for (std::size_t i = 0; i < std::size(paths); ++i) {
+    if (errors[i]) {
+      broken.push_back({.path = paths[i], .error = *errors[i]});
+    }
+  }
+  spdlog::info(
+      "preflight: checked {} files in {} ms, {} broken", std::size(paths),
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count(),
+      std::size(broken));
+  return broken;
+}
+
+hisui::MetadataSet run_preflight(const hisui::Config& config,
+                                 const hisui::MetadataSet& metadata_set) {
+  // 書き込み中の録画は末尾まで辿れないので調べない
+  if (config.preflight == hisui::config::Preflight::None || config.live) {
+    return metadata_set;
+  }
+  const auto broken =
+      find_broken_archives(config, metadata_set.getArchiveItems());
+  if (std::empty(broken)) {
+    return metadata_set;
+  }
+
+  for (const auto& b : broken) {
+    spdlog::error("broken archive: file={} error={}", b.path, b.error);
+  }
+  if (config.preflight == hisui::config::Preflight::Check) {
+    std::string paths;
+    for (const auto& b : broken) {
+      paths += (std::empty(paths) ? "" : ", ") + b.path;
+    }
+    throw std::runtime_error(fmt::format("broken archives: {}", paths));
+  }
+
+  std::set<std::string> excluded;
+  for (const auto& b : broken) {
+    excluded.insert(b.path);
+  }
+  auto checked = metadata_set;
+  checked.removeArchives(excluded);
+  if (std::empty(checked.getNormalArchives())) {
+    throw std::runtime_error("all archives are broken");
+  }
+  spdlog::warn("preflight: excluded {} broken files", std::size(excluded));
+  return checked;
+}
+
+}  // namespace hisui
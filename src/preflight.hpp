@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "archive_item.hpp"
+#include "config.hpp"
+#include "metadata.hpp"
+
+namespace hisui {
+
+struct BrokenArchive {
+  std::string path;
+  std::string error;
+};
+
+// 合成を始める前に archives の WebM を並列に調べ, 壊れているものを返す.
+// 全てのフレームの位置と大きさを辿って構造を確かめ, 映像は最初のキーフレームをデコードしてみる
+std::vector<BrokenArchive> find_broken_archives(
+    const hisui::Config&,
+    const std::vector<hisui::ArchiveItem>&);
+
+// --preflight に従って metadata_set の録画を調べる.
+// check では壊れた録画があれば全てを挙げて std::runtime_error を投げ,
+// exclude では壊れた録画を除いた MetadataSet を返す
+hisui::MetadataSet run_preflight(const hisui::Config&,
+                                 const hisui::MetadataSet&);
+
+}  // namespace hisui
@@ -0,0 +1,56 @@
+#include "report/progress_writer.hpp"
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace hisui::report {
+
+ProgressWriter::ProgressWriter(const ProgressWriterParameters& params,
+                               const std::function<Progress()>& get_progress)
+    : m_interval(params.interval),
+      m_duration(params.duration),
+      m_get_progress(get_progress),
+      m_start_time(std::chrono::steady_clock::now()) {
+  m_thread = std::thread(&ProgressWriter::run, this);
+}
+
+ProgressWriter::~ProgressWriter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_stopped = true;
+  }
+  m_cv.notify_all();
+  m_thread.join();
+  write();
+}
+
+void ProgressWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_cv.wait_for(lock, m_interval, [this] { return m_is_stopped; })) {
+    write();
+  }
+}
+
+void ProgressWriter::write() {
+  const auto p = m_get_progress();
+  const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - m_start_time)
+                             .count();
+  fmt::print(stderr,
+             "{{\"elapsed\":{:.2f},\"media_time\":{:.2f},\"duration\":{:.2f},"
+             "\"progress\":{:.4f},\"realtime_factor\":{:.2f},"
+             "\"video_frames\":{},\"audio_frames\":{},"
+             "\"video_queue_size\":{},\"audio_queue_size\":{}}}\n",
+             elapsed, p.media_time, m_duration,
+             m_duration > 0 ? p.media_time / m_duration : 1.0,
+             elapsed > 0 ? p.media_time / elapsed : 0.0, p.video_frames,
+             p.audio_frames, p.video_queue_size, p.audio_queue_size);
+  std::fflush(stderr);
+}
+
+}  // namespace hisui::report
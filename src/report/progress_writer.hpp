@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace hisui::report {
+
+struct Progress {
+  // 合成とエンコードを終えた出力上の時刻 (秒)
+  const double media_time;
+  const std::uint64_t video_frames;
+  const std::uint64_t audio_frames;
+  const std::size_t video_queue_size;
+  const std::size_t audio_queue_size;
+};
+
+struct ProgressWriterParameters {
+  const double interval;  // 秒
+  const double duration;  // 出力の長さ (秒)
+};
+
+// 一定の間隔で進捗を 1 行の JSON として標準エラー出力に書き出す.
+// プログレスバーと違い, コンテナのログなどからプログラムで読み取れる
+class ProgressWriter {
+ public:
+  ProgressWriter(const ProgressWriterParameters&,
+                 const std::function<Progress()>&);
+  // 最後の進捗を書き出してからスレッドを止める
+  ~ProgressWriter();
+
+  ProgressWriter(const ProgressWriter&) = delete;
+  ProgressWriter& operator=(const ProgressWriter&) = delete;
+
+ private:
+  void run();
+  void write();
+
+  std::chrono::duration<double> m_interval;
+  double m_duration;
+  std::function<Progress()> m_get_progress;
+  std::chrono::steady_clock::time_point m_start_time;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_is_stopped = false;
+  std::thread m_thread;
+};
+
+}  // namespace hisui::report
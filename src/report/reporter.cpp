@@ -2,8 +2,19 @@
 
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -15,6 +26,8 @@
 #include <boost/json/value_from.hpp>
 
 #include "constants.hpp"
+#include "util/memory.hpp"
+#include "util/perf_counters.hpp"
 #include "version/version.hpp"
 
 namespace {
@@ -23,6 +36,15 @@ std::string second_to_string(double second) {
   return fmt::format("{:.2f}s", second);
 }
 
+std::uint64_t get_thread_cpu_ns() {
+  struct ::timespec ts;
+  if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
 }  // namespace
 
 namespace hisui::report {
@@ -33,8 +55,75 @@ bool operator==(ResolutionWithTimestamp const& left,
          left.height == right.height;
 }
 
-Reporter::Reporter() {
+StageTimer::StageTimer(const char* t_stage)
+    : m_stage(t_stage), m_enabled(Reporter::hasInstance()) {
+  if (m_enabled) {
+    m_start_time = std::chrono::steady_clock::now();
+    m_start_cpu_ns = get_thread_cpu_ns();
+    m_start_counters = hisui::util::PerfCounters::read();
+  }
+}
+
+StageTimer::~StageTimer() {
+  if (!m_enabled || !Reporter::hasInstance()) {
+    return;
+  }
+  const auto wall_ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - m_start_time)
+          .count());
+  const auto cpu_ns = get_thread_cpu_ns() - m_start_cpu_ns;
+  hisui::util::PerfCounterValues counters;
+  if (m_start_counters) {
+    if (const auto end_counters = hisui::util::PerfCounters::read()) {
+      counters = *end_counters - *m_start_counters;
+    }
+  }
+  Reporter::getInstance().addStageTime(m_stage, wall_ns, cpu_ns, counters);
+}
+
+DecodeTimer::DecodeTimer(DecoderCounters* t_counters,
+                         const std::size_t frame_size)
+    : m_counters(t_counters), m_frame_size(frame_size) {
+  if (m_counters) {
+    m_start_time = std::chrono::steady_clock::now();
+  }
+}
+
+DecodeTimer::~DecodeTimer() {
+  if (!m_counters) {
+    return;
+  }
+  const auto ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - m_start_time)
+          .count());
+  m_counters->decoded_frames.fetch_add(1, std::memory_order_relaxed);
+  m_counters->decode_ns.fetch_add(ns, std::memory_order_relaxed);
+  m_counters->read_bytes.fetch_add(m_frame_size, std::memory_order_relaxed);
+}
+
+ScaleTimer::ScaleTimer(DecoderCounters* t_counters) : m_counters(t_counters) {
+  if (m_counters) {
+    m_start_time = std::chrono::steady_clock::now();
+  }
+}
+
+ScaleTimer::~ScaleTimer() {
+  if (!m_counters) {
+    return;
+  }
+  const auto ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - m_start_time)
+          .count());
+  m_counters->scaled_frames.fetch_add(1, std::memory_order_relaxed);
+  m_counters->scale_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+Reporter::Reporter() : m_generation(++m_last_generation) {
   m_start_clock = std::clock();
+  m_start_time = std::chrono::steady_clock::now();
 }
 
 std::string Reporter::makeSuccessReport() {
@@ -79,10 +168,87 @@ std::string Reporter::makeReport() {
     }
   }
 
+  for (const auto& [path, counters] : m_decoder_counters) {
+    if (auto input = inputs.if_contains(path); input && input->is_object()) {
+      auto statistics = boost::json::value_from(*counters);
+      // 最初の解像度も video_resolution_changes に含まれる
+      if (const auto it = m_resolution_changes_map.find(path);
+          it != std::end(m_resolution_changes_map) && !std::empty(it->second)) {
+        statistics.as_object()["resolution_changes"] =
+            std::size(it->second) - 1;
+      }
+      input->as_object()["video_decoder_statistics"] = statistics;
+    }
+  }
+
   m_report["inputs"] = inputs;
   m_report["output"] = boost::json::value_from(m_output_info);
+  if (!std::empty(m_output_hashes)) {
+    m_report["output"].as_object()["hashes"] =
+        boost::json::value_from(m_output_hashes);
+  }
+  if (!std::empty(m_video_qualities)) {
+    m_report["output"].as_object()["video_quality"] =
+        boost::json::value_from(m_video_qualities);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!std::empty(m_degradation_changes)) {
+      m_report["degradation_changes"] =
+          boost::json::value_from(m_degradation_changes);
+    }
+  }
   m_report["execution_time"] = second_to_string(
       static_cast<double>(std::clock() - m_start_clock) / CLOCKS_PER_SEC);
+
+  // 処理時間の内訳. 複数のスレッドで並行する段階は, 合計が wall_time を超えることがある
+  const double wall_time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    m_start_time)
+          .count();
+  std::map<std::string, StageTime> stage_times;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& buffer : m_stage_time_buffers) {
+      std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+      for (const auto& [stage, st] : buffer->stage_times) {
+        auto& merged = stage_times[stage];
+        merged.wall_ns += st.wall_ns;
+        merged.cpu_ns += st.cpu_ns;
+        merged.calls += st.calls;
+        merged.counters += st.counters;
+      }
+    }
+  }
+  boost::json::object performance;
+  performance["wall_time"] = second_to_string(wall_time);
+  if (wall_time > 0) {
+    performance["realtime_factor"] =
+        fmt::format("{:.2f}", m_output_info.duration / wall_time);
+    if (stage_times.contains("video_encode")) {
+      performance["frames_per_second"] = fmt::format(
+          "{:.2f}",
+          static_cast<double>(stage_times.at("video_encode").calls) /
+              wall_time);
+    }
+  }
+  performance["stages"] = boost::json::value_from(stage_times);
+  performance["peak_queue_sizes"] = boost::json::value_from(m_peak_queue_sizes);
+  struct ::rusage usage;
+  if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+    // Linux では ru_maxrss の単位は KiB
+    performance["peak_rss_kib"] = usage.ru_maxrss;
+  }
+  const auto huge_pages = hisui::util::get_huge_page_statistics();
+  if (huge_pages.enabled) {
+    performance["huge_pages"] = {
+        {"mode", huge_pages.is_explicit ? "explicit" : "transparent"},
+        {"explicit_bytes", huge_pages.explicit_bytes},
+        {"transparent_advised_bytes", huge_pages.transparent_bytes},
+        {"anon_huge_page_bytes", huge_pages.anon_huge_page_bytes},
+    };
+  }
+  m_report["performance"] = performance;
   collectVersions();
 
   return boost::json::serialize(m_report);
@@ -124,23 +290,87 @@ void Reporter::close() {
 
 void Reporter::registerResolutionChange(const std::string& filename,
                                         const ResolutionWithTimestamp& rwt) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   m_resolution_changes_map[filename].push_back(rwt);
 }
 
 void Reporter::registerAudioDecoder(const std::string& filename,
                                     const AudioDecoderInfo& adi) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   m_audio_decoder_map.insert({filename, adi});
 }
 
 void Reporter::registerVideoDecoder(const std::string& filename,
                                     const VideoDecoderInfo& vdi) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   m_video_decoder_map.insert({filename, vdi});
 }
 
+Reporter::StageTimeBuffer* Reporter::getStageTimeBuffer() {
+  thread_local std::uint64_t generation = 0;
+  thread_local StageTimeBuffer* buffer = nullptr;
+  if (generation != m_generation) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stage_time_buffers.push_back(std::make_unique<StageTimeBuffer>());
+    buffer = m_stage_time_buffers.back().get();
+    generation = m_generation;
+  }
+  return buffer;
+}
+
+void Reporter::addStageTime(const std::string& stage,
+                            const std::uint64_t wall_ns,
+                            const std::uint64_t cpu_ns,
+                            const hisui::util::PerfCounterValues& counters) {
+  // 他のスレッドとは lock を取り合わない. 取り合うのは報告の時だけ
+  auto buffer = getStageTimeBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  auto& st = buffer->stage_times[stage];
+  st.wall_ns += wall_ns;
+  st.cpu_ns += cpu_ns;
+  ++st.calls;
+  st.counters += counters;
+}
+
+void Reporter::registerPeakQueueSize(const std::string& name,
+                                     const std::size_t size) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& peak = m_peak_queue_sizes[name];
+  peak = std::max(peak, size);
+}
+
+DecoderCounters* Reporter::getDecoderCounters(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& counters = m_decoder_counters[filename];
+  if (!counters) {
+    counters = std::make_unique<DecoderCounters>();
+  }
+  return counters.get();
+}
+
 void Reporter::registerOutput(const OutputInfo& output_info) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   m_output_info = output_info;
 }
 
+void Reporter::registerOutputHash(const std::string& file_path,
+                                  const std::string& algorithm,
+                                  const std::string& digest) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_output_hashes[file_path][algorithm] = digest;
+}
+
+void Reporter::registerVideoQuality(const std::string& name,
+                                    const VideoQuality& quality) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_video_qualities.insert_or_assign(name, quality);
+}
+
+void Reporter::registerDegradationChange(const DegradationChange& change) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_degradation_changes.push_back(change);
+}
+
 void tag_invoke(const boost::json::value_from_tag&,
                 boost::json::value& jv,  // NOLINT
                 const AudioDecoderInfo& adi) {
@@ -173,6 +403,69 @@ void tag_invoke(const boost::json::value_from_tag&,
   };
 }
 
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const DegradationChange& dc) {
+  jv = {
+      {"timestamp", second_to_string(static_cast<double>(dc.timestamp) /
+                                     Constants::NANO_SECOND)},
+      {"level", dc.level},
+      {"action", dc.action},
+      {"realtime_factor", fmt::format("{:.2f}", dc.realtime_factor)},
+  };
+  if (dc.action != "encoder_speed") {
+    jv.as_object()["priority"] = dc.priority;
+  }
+}
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const StageTime& st) {
+  jv = {
+      {"wall_time", second_to_string(static_cast<double>(st.wall_ns) /
+                                     Constants::NANO_SECOND)},
+      {"cpu_time", second_to_string(static_cast<double>(st.cpu_ns) /
+                                    Constants::NANO_SECOND)},
+      {"calls", st.calls},
+  };
+  if (st.counters.cycles == 0) {
+    return;
+  }
+  // IPC が低く cache_misses や dtlb_misses が多い段階はメモリーで律速している
+  auto& object = jv.as_object();
+  object["cycles"] = st.counters.cycles;
+  object["instructions"] = st.counters.instructions;
+  object["instructions_per_cycle"] = fmt::format(
+      "{:.2f}", static_cast<double>(st.counters.instructions) /
+                    static_cast<double>(st.counters.cycles));
+  object["cache_misses"] = st.counters.cache_misses;
+  object["dtlb_misses"] = st.counters.dtlb_misses;
+}
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const DecoderCounters& dc) {
+  const auto decoded_frames = dc.decoded_frames.load();
+  const auto decode_ns = dc.decode_ns.load();
+  jv = {
+      {"decoded_frames", decoded_frames},
+      {"dropped_frames", dc.dropped_frames.load()},
+      {"decode_time",
+       second_to_string(static_cast<double>(decode_ns) /
+                        Constants::NANO_SECOND)},
+      {"average_decode_time_ms",
+       fmt::format("{:.3f}", decoded_frames == 0
+                                 ? 0.0
+                                 : static_cast<double>(decode_ns) /
+                                       static_cast<double>(decoded_frames) /
+                                       1'000'000)},
+      {"read_bytes", dc.read_bytes.load()},
+      {"scaled_frames", dc.scaled_frames.load()},
+      {"scale_time", second_to_string(static_cast<double>(dc.scale_ns.load()) /
+                                      Constants::NANO_SECOND)},
+  };
+}
+
 void tag_invoke(const boost::json::value_from_tag&,
                 boost::json::value& jv,  // NOLINT
                 const OutputInfo& oi) {
@@ -185,4 +478,17 @@ void tag_invoke(const boost::json::value_from_tag&,
   };
 }
 
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const VideoQuality& vq) {
+  jv = {
+      {"frames", vq.frames},
+      {"psnr_y", fmt::format("{:.2f}", vq.psnr_y)},
+      {"psnr_u", fmt::format("{:.2f}", vq.psnr_u)},
+      {"psnr_v", fmt::format("{:.2f}", vq.psnr_v)},
+      {"psnr", fmt::format("{:.2f}", vq.psnr)},
+      {"ssim", fmt::format("{:.4f}", vq.ssim)},
+  };
+}
+
 }  // namespace hisui::report
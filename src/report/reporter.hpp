@@ -1,8 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <ctime>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -10,6 +16,8 @@
 #include <boost/json/object.hpp>
 #include <boost/json/value.hpp>
 
+#include "util/perf_counters.hpp"
+
 namespace hisui::report {
 
 struct AudioDecoderInfo {
@@ -56,6 +64,117 @@ void tag_invoke(const boost::json::value_from_tag&,
                 boost::json::value& jv,  // NOLINT
                 const OutputInfo& oi);
 
+// エンコードした結果をデコードして入力と比べた画質の, フレームごとの値の平均
+struct VideoQuality {
+  std::uint64_t frames;
+  double psnr_y;
+  double psnr_u;
+  double psnr_v;
+  double psnr;
+  double ssim;
+};
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const VideoQuality& vq);
+
+// 合成が間に合わずに品質を落とした, または戻した記録
+struct DegradationChange {
+  std::uint64_t timestamp;
+  // 適用している段階の数. 0 ならば品質を落としていない
+  std::size_t level;
+  // frame_rate, key_frames_only, encoder_speed のいずれか
+  std::string action;
+  // frame_rate と key_frames_only の場合に対象とした region の priority
+  std::int32_t priority;
+  // 変更を決めた時の実時間に対する処理速度
+  double realtime_factor;
+};
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const DegradationChange& dc);
+
+// 処理の段階ごとに合計した経過時間と CPU 時間.
+// PerfCounters が有効ならばハードウェアの計数も合計する
+struct StageTime {
+  std::uint64_t wall_ns = 0;
+  std::uint64_t cpu_ns = 0;
+  std::uint64_t calls = 0;
+  hisui::util::PerfCounterValues counters;
+};
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const StageTime& st);
+
+// 生存期間の経過時間と, そのスレッドの CPU 時間とハードウェアの計数を stage に加算する.
+// Reporter が開かれていなければ何もしない
+class StageTimer {
+ public:
+  explicit StageTimer(const char*);
+  ~StageTimer();
+
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+ private:
+  const char* m_stage;
+  bool m_enabled;
+  std::chrono::steady_clock::time_point m_start_time;
+  std::uint64_t m_start_cpu_ns = 0;
+  std::optional<hisui::util::PerfCounterValues> m_start_counters;
+};
+
+// 入力ごとのデコードの統計. デコードするスレッドが lock を取らずに加算する
+struct DecoderCounters {
+  // デコーダーに渡したフレームの数
+  std::atomic<std::uint64_t> decoded_frames = 0;
+  // 後続のフレームに上書きされて合成に使われなかったフレームの数.
+  // デコードせずに読み飛ばしたフレームも含む
+  std::atomic<std::uint64_t> dropped_frames = 0;
+  std::atomic<std::uint64_t> decode_ns = 0;
+  // デコーダーに渡したフレームの大きさの合計
+  std::atomic<std::uint64_t> read_bytes = 0;
+  // layout の cell に拡縮して書き込んだ時間. 複数の cell に表示する場合はその合計
+  std::atomic<std::uint64_t> scale_ns = 0;
+  std::atomic<std::uint64_t> scaled_frames = 0;
+};
+
+void tag_invoke(const boost::json::value_from_tag&,
+                boost::json::value& jv,  // NOLINT
+                const DecoderCounters& dc);
+
+// 生存期間の経過時間を 1 フレームのデコードの時間として counters に加算する.
+// counters が nullptr ならば何もしない
+class DecodeTimer {
+ public:
+  DecodeTimer(DecoderCounters*, const std::size_t frame_size);
+  ~DecodeTimer();
+
+  DecodeTimer(const DecodeTimer&) = delete;
+  DecodeTimer& operator=(const DecodeTimer&) = delete;
+
+ private:
+  DecoderCounters* m_counters;
+  std::size_t m_frame_size;
+  std::chrono::steady_clock::time_point m_start_time;
+};
+
+// DecodeTimer と同じく, 1 フレームの拡縮の時間として counters に加算する
+class ScaleTimer {
+ public:
+  explicit ScaleTimer(DecoderCounters*);
+  ~ScaleTimer();
+
+  ScaleTimer(const ScaleTimer&) = delete;
+  ScaleTimer& operator=(const ScaleTimer&) = delete;
+
+ private:
+  DecoderCounters* m_counters;
+  std::chrono::steady_clock::time_point m_start_time;
+};
+
 class Reporter {
  public:
   Reporter& operator=(const Reporter&) = delete;
@@ -64,11 +183,26 @@ class Reporter {
   std::string makeSuccessReport();
   std::string makeFailureReport(const std::string&);
   void registerOutput(const OutputInfo&);
+  // 出力ファイル, アルゴリズム, ハッシュ値
+  void registerOutputHash(const std::string&,
+                          const std::string&,
+                          const std::string&);
+  // エンコーダーの名前と画質
+  void registerVideoQuality(const std::string&, const VideoQuality&);
   void registerAudioDecoder(const std::string&, const AudioDecoderInfo&);
   void registerVideoDecoder(const std::string&, const VideoDecoderInfo&);
 
   void registerResolutionChange(const std::string&,
                                 const ResolutionWithTimestamp&);
+  void addStageTime(const std::string&,
+                    const std::uint64_t,
+                    const std::uint64_t,
+                    const hisui::util::PerfCounterValues& = {});
+  void registerDegradationChange(const DegradationChange&);
+  // 同じ名前で複数回登録した場合は最大値を残す
+  void registerPeakQueueSize(const std::string&, const std::size_t);
+  // 返り値は close() まで有効
+  DecoderCounters* getDecoderCounters(const std::string&);
 
   static void open();
   static bool hasInstance();
@@ -78,17 +212,38 @@ class Reporter {
  private:
   Reporter();
   ~Reporter() = default;
+  // 段階ごとの時間はスレッドごとに加算し, 報告の時にまとめる
+  struct StageTimeBuffer {
+    std::mutex mutex;
+    std::map<std::string, StageTime> stage_times;
+  };
+
   void collectVersions();
   std::string makeReport();
+  StageTimeBuffer* getStageTimeBuffer();
 
   inline static Reporter* m_reporter = nullptr;
+  inline static std::atomic<std::uint64_t> m_last_generation = 0;
+  // 開き直した Reporter を, スレッドが持つ StageTimeBuffer と見分けるための番号
+  const std::uint64_t m_generation;
   std::map<std::string, AudioDecoderInfo> m_audio_decoder_map;
   std::map<std::string, VideoDecoderInfo> m_video_decoder_map;
   std::map<std::string, std::vector<ResolutionWithTimestamp>>
       m_resolution_changes_map;
+  std::vector<std::unique_ptr<StageTimeBuffer>> m_stage_time_buffers;
+  std::map<std::string, std::size_t> m_peak_queue_sizes;
+  std::map<std::string, std::unique_ptr<DecoderCounters>> m_decoder_counters;
   OutputInfo m_output_info;
+  std::map<std::string, std::map<std::string, std::string>> m_output_hashes;
+  std::map<std::string, VideoQuality> m_video_qualities;
+  std::vector<DegradationChange> m_degradation_changes;
   boost::json::object m_report;
   std::clock_t m_start_clock;
+  std::chrono::steady_clock::time_point m_start_time;
+
+  // デコーダーは複数のスレッドから登録を行う.
+  // フレームごとに呼ばれるものは lock を取らない
+  std::mutex m_mutex;
 };
 
 }  // namespace hisui::report
@@ -0,0 +1,158 @@
+#include "result_cache.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "audio/packet_cache.hpp"
+#include "config.hpp"
+#include "metadata.hpp"
+#include "util/file.hpp"
+#include "util/output_hasher.hpp"
+#include "version/version.hpp"
+
+namespace hisui {
+
+namespace {
+
+std::string read_file(const std::filesystem::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    throw std::runtime_error("open failed: " + path.string());
+  }
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  return oss.str();
+}
+
+}  // namespace
+
+ResultCache::ResultCache(const hisui::Config& config,
+                         const hisui::MetadataSet& metadata_set) {
+  if (config.result_cache_directory == "" || config.isStdoutOutput() ||
+      config.isHLSOutput() || !std::empty(config.video_ladder_heights) ||
+      config.participant_outputs || config.participant_audio_outputs ||
+      config.out_audio_only_filename != "" || config.out_pcm_filename != "" ||
+      config.out_packet_ring_filename != "" || config.live ||
+      config.enabledReport()) {
+    return;
+  }
+  const auto archives_key =
+      hisui::audio::make_archives_key(metadata_set.getArchiveItems());
+  if (archives_key == "") {
+    return;
+  }
+
+  try {
+    std::string key = fmt::format(
+        "hisui={} libvpx={} libwebm={} svt-av1={} cpp-mp4={}\n",
+        hisui::version::get_hisui_version(),
+        hisui::version::get_libvpx_version(),
+        hisui::version::get_libwebm_version(),
+        hisui::version::get_svt_av1_version(),
+        hisui::version::get_cppmp4_version());
+    // --checkpoint-dir の part のように, オプションを経ずに設定される値
+    key += fmt::format("audio_only={} video_part={}/{}\n", config.audio_only,
+                       config.video_part_index, config.video_part_count);
+    key += config.result_cache_options;
+    key += archives_key;
+    key += read_file(config.in_metadata_filename);
+    for (const auto& filename : config.append_metadata_filenames) {
+      key += read_file(filename);
+    }
+    if (config.screen_capture_metadata_filename != "") {
+      key += read_file(config.screen_capture_metadata_filename);
+    }
+    m_key = std::move(key);
+  } catch (const std::exception& e) {
+    spdlog::warn("making result cache key failed: {}", e.what());
+    return;
+  }
+
+  m_out_path = config.getOutFilename();
+  m_out_hashes = config.out_hashes;
+  m_path = std::filesystem::path(config.result_cache_directory) /
+           fmt::format("result.{:016x}{}", std::hash<std::string>{}(m_key),
+                       m_out_path.extension().string());
+  m_key_path = m_path;
+  m_key_path += ".key";
+}
+
+bool ResultCache::isEnabled() const {
+  return m_key != "";
+}
+
+bool ResultCache::restore() const {
+  if (!isEnabled()) {
+    return false;
+  }
+  try {
+    std::error_code ec;
+    // ハッシュが衝突していても別の合成の出力を使わないよう, key 全体を比べる
+    if (std::filesystem::exists(m_path, ec) &&
+        std::filesystem::exists(m_key_path, ec) &&
+        read_file(m_key_path) == m_key) {
+      if (!std::filesystem::equivalent(m_path, m_out_path, ec)) {
+        std::filesystem::remove(m_out_path, ec);
+        hisui::util::clone_file(m_path, m_out_path);
+      }
+      spdlog::info("reusing composed output: {}", m_path.string());
+      // --out-hash は key に含めないので, 合成した場合と同じく出力から計算する
+      if (!std::empty(m_out_hashes)) {
+        hisui::util::OutputHasher(m_out_path.string(), m_out_hashes)
+            .hashFile();
+      }
+      return true;
+    }
+  } catch (const std::exception& e) {
+    spdlog::warn("restoring result cache failed: {}", e.what());
+  }
+  return false;
+}
+
+void ResultCache::save() const {
+  if (!isEnabled()) {
+    return;
+  }
+  // 同時に合成している他のプロセスが書きかけのファイルを読まないよう,
+  // 別の名前で用意してから置き換える
+  auto tmp_path = m_path;
+  tmp_path += fmt::format(".{}.tmp", ::getpid());
+  auto tmp_key_path = m_key_path;
+  tmp_key_path += fmt::format(".{}.tmp", ::getpid());
+  try {
+    std::filesystem::create_directories(m_path.parent_path());
+    hisui::util::clone_file(m_out_path, tmp_path);
+    {
+      std::ofstream ofs(tmp_key_path, std::ios::binary | std::ios::trunc);
+      ofs.write(std::data(m_key),
+                static_cast<std::streamsize>(std::size(m_key)));
+      if (!ofs) {
+        throw std::runtime_error("write failed: " + tmp_key_path.string());
+      }
+    }
+    // 置き換えている間に古い key で新しい出力を使わないよう, key を先に消す
+    std::filesystem::remove(m_key_path);
+    std::filesystem::rename(tmp_path, m_path);
+    std::filesystem::rename(tmp_key_path, m_key_path);
+    spdlog::debug("result cache saved: {}", m_path.string());
+  } catch (const std::exception& e) {
+    spdlog::warn("saving result cache failed: {}", e.what());
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+    std::filesystem::remove(tmp_key_path, ec);
+  }
+}
+
+}  // namespace hisui
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "metadata.hpp"
+
+namespace hisui {
+
+// --result-cache-dir に合成した出力を残し, 同じ合成を再び依頼された場合にそれを使う.
+// key は入力の録画ファイルの絶対パス, 大きさ, 更新日時と区間, メタデータの内容,
+// 出力に関わりうるオプションと hisui とライブラリのバージョンから作る
+class ResultCache {
+ public:
+  ResultCache(const hisui::Config&, const hisui::MetadataSet&);
+
+  // 標準出力や複数のファイルへの出力, URL の入力などでは使わない
+  bool isEnabled() const;
+  // 残した出力があれば出力ファイルにコピーして true を返す. --out-hash があればハッシュ値も出す.
+  // reflink できるファイルシステムではブロックを共有するが, 出力ファイルを書き換えても残した出力は変わらない
+  bool restore() const;
+  // 合成が成功した後に呼ぶ. 失敗しても合成の結果には関わらないので警告のみを出す
+  void save() const;
+
+ private:
+  std::string m_key;
+  std::filesystem::path m_out_path;
+  std::vector<std::string> m_out_hashes;
+  std::filesystem::path m_path;
+  std::filesystem::path m_key_path;
+};
+
+}  // namespace hisui
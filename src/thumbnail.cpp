@@ -0,0 +1,212 @@
+#include "thumbnail.hpp"
+
+#include <fmt/core.h>
+#include <libyuv/convert_from.h>
+#include <spdlog/spdlog.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "constants.hpp"
+#include "layout/composer.hpp"
+#include "layout/metadata.hpp"
+#include "layout/region.hpp"
+#include "metadata.hpp"
+#include "video/adaptive_grid_composer.hpp"
+#include "video/basic_sequencer.hpp"
+#include "video/composer.hpp"
+#include "video/grid_composer.hpp"
+#include "video/parallel_grid_composer.hpp"
+#include "video/yuv.hpp"
+
+namespace hisui {
+
+namespace {
+
+// ns の時刻のフレームを I420 で raw_image に合成する
+using ComposeFunction =
+    std::function<void(std::vector<unsigned char>*, const std::uint64_t)>;
+
+struct Thumbnailer {
+  std::uint32_t width;
+  std::uint32_t height;
+  ComposeFunction compose;
+};
+
+// VPXVideoProducer と同じく, 通常の録画を grid で並べる
+Thumbnailer make_metadata_thumbnailer(const hisui::Config& config) {
+  if (std::empty(config.in_metadata_filename)) {
+    throw std::runtime_error("-f,--in-metadata-file is required");
+  }
+  MetadataSet metadata_set(parse_metadata(
+      config.in_metadata_filename, config.append_metadata_filenames));
+  if (!config.screen_capture_metadata_filename.empty()) {
+    metadata_set.setPrefered(
+        parse_metadata(config.screen_capture_metadata_filename));
+  } else if (!config.screen_capture_connection_id.empty()) {
+    metadata_set.split(config.screen_capture_connection_id);
+  }
+  if (config.trim) {
+    metadata_set.trim();
+  }
+
+  auto sequencer = std::make_shared<hisui::video::BasicSequencer>(
+      metadata_set.getNormalArchives(), config.video_decode_threads);
+  const auto scaling_width = config.scaling_width != 0
+                                 ? config.scaling_width
+                                 : sequencer->getMaxWidth();
+  const auto scaling_height = config.scaling_height != 0
+                                  ? config.scaling_height
+                                  : sequencer->getMaxHeight();
+  std::shared_ptr<hisui::video::Composer> composer;
+  switch (config.video_composer) {
+    case hisui::config::VideoComposer::Grid:
+      composer = std::make_shared<hisui::video::GridComposer>(
+          scaling_width, scaling_height, sequencer->getSize(),
+          config.max_columns, config.video_scaler, config.libyuv_filter_mode);
+      break;
+    case hisui::config::VideoComposer::ParallelGrid:
+      composer = std::make_shared<hisui::video::ParallelGridComposer>(
+          scaling_width, scaling_height, sequencer->getSize(),
+          config.max_columns, config.video_scaler, config.libyuv_filter_mode,
+          config.getVideoComposeThreads());
+      break;
+    case hisui::config::VideoComposer::Auto:
+      composer = std::make_shared<hisui::video::AdaptiveGridComposer>(
+          scaling_width, scaling_height, sequencer->getSize(),
+          config.max_columns, config.video_scaler, config.libyuv_filter_mode,
+          config.getVideoComposeThreads());
+      break;
+  }
+
+  auto yuvs = std::make_shared<std::vector<std::shared_ptr<video::YUVImage>>>(
+      sequencer->getSize());
+  return {.width = composer->getWidth(),
+          .height = composer->getHeight(),
+          .compose = [sequencer, composer, yuvs](
+                         std::vector<unsigned char>* raw_image,
+                         const std::uint64_t t) {
+            sequencer->getYUVs(yuvs.get(), t);
+            composer->compose(raw_image, *yuvs);
+          }};
+}
+
+Thumbnailer make_layout_thumbnailer(hisui::Config* config) {
+  auto metadata = hisui::layout::parse_metadata(*config);
+  metadata.copyToConfig(config);
+
+  const auto regions = metadata.getRegions();
+  for (auto& r : regions) {
+    r->setEncodingInterval();
+  }
+  const auto resolution = metadata.getResolution();
+  auto composer = std::make_shared<hisui::layout::Composer>(
+      hisui::layout::ComposerParameters{
+          .regions = regions,
+          .resolution = resolution,
+          .number_of_threads = config->getVideoComposeThreads(),
+          .overlays = metadata.getOverlays()});
+  return {.width = resolution.width,
+          .height = resolution.height,
+          .compose = [composer](std::vector<unsigned char>* raw_image,
+                                const std::uint64_t t) {
+            composer->compose(raw_image, t);
+          }};
+}
+
+void write_image(const std::string& path,
+                 const std::vector<unsigned char>& raw_image,
+                 const std::uint32_t width,
+                 const std::uint32_t height,
+                 const hisui::Config& config) {
+  // エンコーダーに渡す画像と同じく, 色差の plane は幅と高さを切り上げて半分にする
+  const auto w = static_cast<int>(width);
+  const auto h = static_cast<int>(height);
+  const auto chroma_width = (width + 1) >> 1;
+  const auto chroma_size =
+      static_cast<std::size_t>(chroma_width) * ((height + 1) >> 1);
+  const auto* y = raw_image.data();
+  const auto* u = y + static_cast<std::size_t>(width) * height;
+  const auto* v = u + chroma_size;
+  std::vector<std::uint8_t> rgb(static_cast<std::size_t>(width) * height * 3);
+  // libyuv の RAW はメモリ上で R, G, B の順に並ぶ
+  if (libyuv::I420ToRAW(y, w, u, static_cast<int>(chroma_width), v,
+                        static_cast<int>(chroma_width), rgb.data(), w * 3, w,
+                        h) != 0) {
+    throw std::runtime_error(
+        fmt::format("libyuv::I420ToRAW() failed: {}x{}", width, height));
+  }
+
+  const auto ret =
+      config.thumbnail_format == hisui::config::ThumbnailFormat::PNG
+          ? ::stbi_write_png(path.c_str(), w, h, 3, rgb.data(), w * 3)
+          : ::stbi_write_jpg(path.c_str(), w, h, 3, rgb.data(),
+                             static_cast<int>(config.thumbnail_quality));
+  if (ret == 0) {
+    throw std::runtime_error(fmt::format("writing {} failed", path));
+  }
+}
+
+}  // namespace
+
+int write_thumbnails(const hisui::Config& t_config) {
+  auto config = t_config;
+  try {
+    const auto thumbnailer = std::empty(config.layout)
+                                 ? make_metadata_thumbnailer(config)
+                                 : make_layout_thumbnailer(&config);
+    if (thumbnailer.width == 0 || thumbnailer.height == 0) {
+      throw std::runtime_error("there is no video to compose");
+    }
+
+    std::filesystem::path base(config.out_filename);
+    if (base.empty()) {
+      base = std::empty(config.layout) ? config.in_metadata_filename
+                                       : config.layout;
+    }
+    const auto stem = (base.parent_path() / base.stem()).string();
+    const auto extension =
+        config.thumbnail_format == hisui::config::ThumbnailFormat::PNG ? "png"
+                                                                       : "jpg";
+
+    // source は先へのシークしかできないので, 時刻の順に合成する
+    auto times = config.thumbnail_times;
+    std::sort(std::begin(times), std::end(times));
+    times.erase(std::unique(std::begin(times), std::end(times)),
+                std::end(times));
+
+    std::vector<unsigned char> raw_image(
+        static_cast<std::size_t>(thumbnailer.width) * thumbnailer.height +
+        2 * static_cast<std::size_t>((thumbnailer.width + 1) >> 1) *
+            ((thumbnailer.height + 1) >> 1));
+    for (const auto time : times) {
+      const auto t = static_cast<std::uint64_t>(
+          std::llround(time * hisui::Constants::NANO_SECOND));
+      thumbnailer.compose(&raw_image, t);
+      const auto path = fmt::format("{}_{}.{}", stem,
+                                    std::llround(time * 1000), extension);
+      write_image(path, raw_image, thumbnailer.width, thumbnailer.height,
+                  config);
+      spdlog::info("wrote thumbnail: {}", path);
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("writing thumbnails failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace hisui
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "config.hpp"
+
+namespace hisui {
+
+// エンコードはせず, config.thumbnail_times の時刻のフレームのみを合成して画像に書き出す.
+// 各 source は時刻ごとに直前のキーフレームからデコードする
+int write_thumbnails(const hisui::Config&);
+
+}  // namespace hisui
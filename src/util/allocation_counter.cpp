@@ -0,0 +1,107 @@
+#include "util/allocation_counter.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+
+namespace hisui::util::allocation_counter {
+
+namespace {
+
+thread_local std::uint64_t t_count = 0;
+
+std::mutex g_mutex;
+// 区間の名前ごとに, 確保のあった区間の数
+std::map<const char*, std::uint64_t> g_reports;
+
+void* allocate(const std::size_t size) {
+  ++t_count;
+  // 0 byte の確保でも nullptr 以外を返す必要がある
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* allocate_aligned(const std::size_t size, const std::align_val_t align) {
+  ++t_count;
+  const auto alignment = static_cast<std::size_t>(align);
+  // aligned_alloc() は alignment の倍数の大きさしか受け付けない
+  const auto rounded =
+      ((size == 0 ? 1 : size) + alignment - 1) / alignment * alignment;
+  if (void* p = std::aligned_alloc(alignment, rounded)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+}  // namespace
+
+std::uint64_t get_count() {
+  return t_count;
+}
+
+void report(const char* name, const std::uint64_t count) {
+  std::uint64_t scopes = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    scopes = ++g_reports[name];
+  }
+  spdlog::debug("{} allocated {} times (scopes with allocations: {})", name,
+                count, scopes);
+}
+
+}  // namespace hisui::util::allocation_counter
+
+void* operator new(std::size_t size) {
+  return hisui::util::allocation_counter::allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+  return hisui::util::allocation_counter::allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  return hisui::util::allocation_counter::allocate_aligned(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return hisui::util::allocation_counter::allocate_aligned(size, align);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
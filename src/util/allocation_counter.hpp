@@ -0,0 +1,50 @@
+#pragma once
+
+// USE_ALLOCATION_COUNTER を有効にしてビルドした場合のみ, グローバルな operator new を
+// 置き換えてスレッドごとにヒープの確保を数える. Debug ビルドでは既定で有効になる.
+// HISUI_ALLOCATION_SCOPE() は区間内に呼び出し元のスレッドで確保した回数を数え,
+// 確保があれば debug でログに出す. 定常状態の合成で確保していないことを確かめるのに使う.
+// 無効な場合は何も生成しないので, 処理の中に残しておいてよい
+
+#ifdef USE_ALLOCATION_COUNTER
+
+#include <cstdint>
+
+namespace hisui::util::allocation_counter {
+
+// このスレッドでこれまでに operator new を呼んだ回数
+std::uint64_t get_count();
+// name は文字列リテラルなど, 終了するまで残るものを渡す
+void report(const char*, const std::uint64_t);
+
+class Scope {
+ public:
+  explicit Scope(const char* t_name) : m_name(t_name), m_begin(get_count()) {}
+  ~Scope() {
+    const auto count = get_count() - m_begin;
+    if (count != 0) {
+      report(m_name, count);
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  const char* m_name;
+  std::uint64_t m_begin;
+};
+
+}  // namespace hisui::util::allocation_counter
+
+#define HISUI_ALLOCATION_CONCAT_INNER(a, b) a##b
+#define HISUI_ALLOCATION_CONCAT(a, b) HISUI_ALLOCATION_CONCAT_INNER(a, b)
+#define HISUI_ALLOCATION_SCOPE(name)             \
+  const ::hisui::util::allocation_counter::Scope \
+      HISUI_ALLOCATION_CONCAT(hisui_allocation_, __LINE__)(name)
+
+#else
+
+#define HISUI_ALLOCATION_SCOPE(name) static_cast<void>(0)
+
+#endif
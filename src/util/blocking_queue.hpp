@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <utility>
+
+namespace hisui::util {
+
+// スレッド間で値を受け渡すキュー. close() 後は pop() が空になり次第値を返さなくなる
+template <typename T>
+class BlockingQueue {
+ public:
+  void push(T value) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.push(std::move(value));
+    }
+    m_cv.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_queue.empty() || m_is_closed; });
+    if (m_queue.empty()) {
+      return {};
+    }
+    T value = std::move(m_queue.front());
+    m_queue.pop();
+    return value;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_is_closed = true;
+    }
+    m_cv.notify_all();
+  }
+
+ private:
+  std::queue<T> m_queue;
+  bool m_is_closed = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+};
+
+}  // namespace hisui::util
@@ -0,0 +1,248 @@
+#include "util/cgroup.hpp"
+
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hisui::util {
+
+namespace {
+
+const std::filesystem::path CGROUP_ROOT = "/sys/fs/cgroup";
+// v1 でメモリを制限しない場合は, ページの大きさに切り下げた LONG_MAX が書かれている
+constexpr std::uint64_t CGROUP_V1_UNLIMITED_MEMORY = std::uint64_t{1} << 62;
+
+std::optional<std::string> read_first_line(const std::filesystem::path& path) {
+  std::ifstream ifs(path);
+  std::string line;
+  if (!ifs || !std::getline(ifs, line)) {
+    return {};
+  }
+  return line;
+}
+
+std::optional<std::uint64_t> parse_uint64(const std::string& s) {
+  // std::stoull() は負の値も読んでしまう
+  if (s.find('-') != std::string::npos) {
+    return {};
+  }
+  try {
+    std::size_t pos = 0;
+    const auto value = std::stoull(s, &pos);
+    if (s.find_first_not_of(" \t\n", pos) != std::string::npos) {
+      return {};
+    }
+    return value;
+  } catch (const std::exception&) {
+    return {};
+  }
+}
+
+// /proc/self/cgroup の行 "hierarchy-ID:controller-list:cgroup-path"
+struct CgroupEntry {
+  std::string controllers;
+  std::string path;
+};
+
+std::vector<CgroupEntry> read_proc_self_cgroup() {
+  std::vector<CgroupEntry> entries;
+  std::ifstream ifs("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    const auto first = line.find(':');
+    const auto second = line.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+      continue;
+    }
+    entries.push_back(
+        {.controllers = line.substr(first + 1, second - first - 1),
+         .path = line.substr(second + 1)});
+  }
+  return entries;
+}
+
+bool has_controller(const std::string& controllers, const std::string& name) {
+  std::istringstream is(controllers);
+  std::string controller;
+  while (std::getline(is, controller, ',')) {
+    if (controller == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// root の下の path から root までの各 cgroup について f を呼ぶ.
+// コンテナの中では path がそのまま見えないことがあるので, 見えない cgroup は飛ばす
+void for_each_ancestor(
+    const std::filesystem::path& root,
+    const std::string& path,
+    const std::function<void(const std::filesystem::path&)>& f) {
+  auto relative =
+      std::filesystem::path(path).relative_path().lexically_normal();
+  while (true) {
+    const auto dir =
+        relative.empty() || relative == "." ? root : root / relative;
+    std::error_code ec;
+    if (std::filesystem::is_directory(dir, ec)) {
+      f(dir);
+    }
+    if (dir == root) {
+      break;
+    }
+    relative = relative.parent_path();
+  }
+}
+
+template <class T>
+void update_min(std::optional<T>* current, const std::optional<T>& value) {
+  if (value && (!*current || *value < **current)) {
+    *current = value;
+  }
+}
+
+// v1 の階層は /sys/fs/cgroup/cpu,cpuacct や /sys/fs/cgroup/memory のように,
+// controller の名前の一覧かその一つの名前で置かれる
+std::optional<std::filesystem::path> find_v1_root(
+    const std::string& controllers) {
+  std::vector<std::string> names = {controllers};
+  std::istringstream is(controllers);
+  std::string name;
+  while (std::getline(is, name, ',')) {
+    names.push_back(name);
+  }
+  for (const auto& n : names) {
+    std::error_code ec;
+    if (std::filesystem::is_directory(CGROUP_ROOT / n, ec)) {
+      return CGROUP_ROOT / n;
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+std::optional<double> parse_cgroup_v2_cpu_max(const std::string& s) {
+  std::istringstream is(s);
+  std::string quota;
+  std::string period;
+  if (!(is >> quota) || quota == "max") {
+    return {};
+  }
+  const auto q = parse_uint64(quota);
+  // period を省いた場合の既定値は 100000
+  const auto p = (is >> period) ? parse_uint64(period) : 100000;
+  if (!q || !p || *p == 0) {
+    return {};
+  }
+  return static_cast<double>(*q) / static_cast<double>(*p);
+}
+
+std::optional<double> parse_cgroup_v1_cpu_quota(const std::string& quota,
+                                                const std::string& period) {
+  const auto q = parse_uint64(quota);
+  const auto p = parse_uint64(period);
+  // 制限が無い場合の -1 は parse_uint64() で読めない
+  if (!q || !p || *q == 0 || *p == 0) {
+    return {};
+  }
+  return static_cast<double>(*q) / static_cast<double>(*p);
+}
+
+std::optional<std::uint64_t> parse_cgroup_memory_limit(const std::string& s) {
+  const auto value = parse_uint64(s);
+  if (!value || *value >= CGROUP_V1_UNLIMITED_MEMORY) {
+    return {};
+  }
+  return value;
+}
+
+CgroupLimits read_cgroup_limits() {
+  CgroupLimits limits;
+  for (const auto& entry : read_proc_self_cgroup()) {
+    if (std::empty(entry.controllers)) {
+      // v2 の unified hierarchy
+      std::error_code ec;
+      if (!std::filesystem::exists(CGROUP_ROOT / "cgroup.controllers", ec)) {
+        continue;
+      }
+      for_each_ancestor(CGROUP_ROOT, entry.path,
+                        [&limits](const std::filesystem::path& dir) {
+                          if (const auto s = read_first_line(dir / "cpu.max")) {
+                            update_min(&limits.cpus,
+                                       parse_cgroup_v2_cpu_max(*s));
+                          }
+                          if (const auto s =
+                                  read_first_line(dir / "memory.max")) {
+                            update_min(&limits.memory,
+                                       parse_cgroup_memory_limit(*s));
+                          }
+                        });
+      continue;
+    }
+    const bool has_cpu = has_controller(entry.controllers, "cpu");
+    const bool has_memory = has_controller(entry.controllers, "memory");
+    if (!has_cpu && !has_memory) {
+      continue;
+    }
+    const auto root = find_v1_root(entry.controllers);
+    if (!root) {
+      continue;
+    }
+    for_each_ancestor(
+        *root, entry.path,
+        [&limits, has_cpu, has_memory](const std::filesystem::path& dir) {
+          if (has_cpu) {
+            const auto quota = read_first_line(dir / "cpu.cfs_quota_us");
+            const auto period = read_first_line(dir / "cpu.cfs_period_us");
+            if (quota && period) {
+              update_min(&limits.cpus,
+                         parse_cgroup_v1_cpu_quota(*quota, *period));
+            }
+          }
+          if (has_memory) {
+            if (const auto s = read_first_line(dir / "memory.limit_in_bytes")) {
+              update_min(&limits.memory, parse_cgroup_memory_limit(*s));
+            }
+          }
+        });
+  }
+  return limits;
+}
+
+const CgroupLimits& get_cgroup_limits() {
+  static const CgroupLimits limits = [] {
+    const auto l = read_cgroup_limits();
+    spdlog::debug("cgroup limits: cpus={} memory={}",
+                  l.cpus ? std::to_string(*l.cpus) : "unlimited",
+                  l.memory ? std::to_string(*l.memory) : "unlimited");
+    return l;
+  }();
+  return limits;
+}
+
+std::uint32_t get_number_of_usable_cpus() {
+  std::uint32_t cpus = std::thread::hardware_concurrency();
+  ::cpu_set_t cpu_set;
+  if (::sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+    cpus = static_cast<std::uint32_t>(CPU_COUNT(&cpu_set));
+  }
+  if (const auto quota = get_cgroup_limits().cpus) {
+    cpus = std::min(cpus, static_cast<std::uint32_t>(std::ceil(*quota)));
+  }
+  return std::max(1U, cpus);
+}
+
+}  // namespace hisui::util
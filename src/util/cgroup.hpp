@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace hisui::util {
+
+// cgroup で制限された CPU とメモリ. 制限されていなければ値を持たない
+struct CgroupLimits {
+  // CPU の quota を period で割った値. 1.5 ならば 1.5 CPU 分
+  std::optional<double> cpus;
+  // バイト
+  std::optional<std::uint64_t> memory;
+};
+
+// /proc/self/cgroup が指す cgroup v2 または v1 の階層を先祖まで辿り, 最も厳しい制限を返す
+CgroupLimits read_cgroup_limits();
+// 初めて呼ばれた時に read_cgroup_limits() を読み, 以降はそれを返す
+const CgroupLimits& get_cgroup_limits();
+
+// 呼び出したスレッドが動ける CPU の数と, CPU の quota を切り上げた値の小さい方. 少なくとも 1
+std::uint32_t get_number_of_usable_cpus();
+
+// cgroup v2 の cpu.max ("max 100000" や "150000 100000") を読む
+std::optional<double> parse_cgroup_v2_cpu_max(const std::string&);
+// cgroup v1 の cpu.cfs_quota_us と cpu.cfs_period_us を読む. quota が -1 ならば制限なし
+std::optional<double> parse_cgroup_v1_cpu_quota(const std::string& quota,
+                                                const std::string& period);
+// cgroup v2 の memory.max か v1 の memory.limit_in_bytes を読む.
+// "max" や, v1 で制限が無い場合の巨大な値は制限なしとする
+std::optional<std::uint64_t> parse_cgroup_memory_limit(const std::string&);
+
+}  // namespace hisui::util
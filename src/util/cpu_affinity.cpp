@@ -0,0 +1,164 @@
+#include "util/cpu_affinity.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hisui::util {
+
+ThreadAffinityScope::ThreadAffinityScope(
+    const std::vector<std::uint32_t>& cpus) {
+  if (std::empty(cpus)) {
+    return;
+  }
+  if (auto err = ::pthread_getaffinity_np(::pthread_self(), sizeof(m_original),
+                                          &m_original);
+      err != 0) {
+    spdlog::warn("pthread_getaffinity_np() failed: {}", std::strerror(err));
+    return;
+  }
+  ::cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const auto cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  if (auto err =
+          ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+      err != 0) {
+    spdlog::warn("pthread_setaffinity_np() failed: {}", std::strerror(err));
+    return;
+  }
+  m_is_set = true;
+}
+
+ThreadAffinityScope::~ThreadAffinityScope() {
+  if (m_is_set) {
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(m_original),
+                             &m_original);
+  }
+}
+
+std::vector<std::uint32_t> parse_cpu_list(const std::string& list) {
+  std::vector<std::uint32_t> cpus;
+  std::istringstream is(list);
+  std::string range;
+  while (std::getline(is, range, ',')) {
+    range.erase(
+        std::remove_if(std::begin(range), std::end(range),
+                       [](const unsigned char c) { return std::isspace(c); }),
+        std::end(range));
+    if (std::empty(range)) {
+      continue;
+    }
+    try {
+      const auto hyphen = range.find('-');
+      const auto first =
+          static_cast<std::uint32_t>(std::stoul(range.substr(0, hyphen)));
+      const auto last = hyphen == std::string::npos
+                            ? first
+                            : static_cast<std::uint32_t>(
+                                  std::stoul(range.substr(hyphen + 1)));
+      for (auto cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::logic_error&) {
+      throw std::invalid_argument("invalid cpu list: " + list);
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::uint32_t> get_available_cpus_by_numa_node() {
+  ::cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (auto err =
+          ::pthread_getaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+      err != 0) {
+    spdlog::warn("pthread_getaffinity_np() failed: {}", std::strerror(err));
+    return {};
+  }
+
+  // node の番号順に, その node の CPU を並べる
+  std::vector<std::pair<std::uint32_t, std::vector<std::uint32_t>>> nodes;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(
+           "/sys/devices/system/node", ec)) {
+    const auto name = entry.path().filename().string();
+    if (name.rfind("node", 0) != 0 || std::size(name) == 4 ||
+        !std::all_of(std::begin(name) + 4, std::end(name),
+                     [](const unsigned char c) { return std::isdigit(c); })) {
+      continue;
+    }
+    std::ifstream ifs(entry.path() / "cpulist");
+    std::string list;
+    if (!std::getline(ifs, list)) {
+      continue;
+    }
+    try {
+      nodes.emplace_back(
+          static_cast<std::uint32_t>(std::stoul(name.substr(4))),
+          parse_cpu_list(list));
+    } catch (const std::exception& e) {
+      spdlog::debug("reading {} failed: {}", entry.path().string(), e.what());
+    }
+  }
+  std::sort(std::begin(nodes), std::end(nodes),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  std::vector<std::uint32_t> cpus;
+  std::vector<bool> is_added(CPU_SETSIZE);
+  for (const auto& [node, node_cpus] : nodes) {
+    for (const auto cpu : node_cpus) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &cpu_set) && !is_added[cpu]) {
+        cpus.push_back(cpu);
+        is_added[cpu] = true;
+      }
+    }
+  }
+  // NUMA の情報が無い CPU は最後に並べる
+  for (std::uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpu_set) && !is_added[cpu]) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::vector<std::uint32_t>> split_cpus(
+    const std::vector<std::uint32_t>& cpus,
+    const std::size_t number_of_sets) {
+  std::vector<std::vector<std::uint32_t>> sets;
+  if (std::empty(cpus)) {
+    return sets;
+  }
+  const auto number_of_cpus = std::size(cpus);
+  for (std::size_t k = 0; k < number_of_sets; ++k) {
+    if (number_of_cpus < number_of_sets) {
+      sets.push_back({cpus[k % number_of_cpus]});
+      continue;
+    }
+    sets.emplace_back(
+        std::begin(cpus) +
+            static_cast<std::ptrdiff_t>(k * number_of_cpus / number_of_sets),
+        std::begin(cpus) + static_cast<std::ptrdiff_t>((k + 1) *
+                                                       number_of_cpus /
+                                                       number_of_sets));
+  }
+  return sets;
+}
+
+}  // namespace hisui::util
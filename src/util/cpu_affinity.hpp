@@ -0,0 +1,40 @@
+#pragma once
+
+#include <sched.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hisui::util {
+
+// 生存中は呼び出したスレッドを cpus でのみ動かす. cpus が空ならば何もしない.
+// その間に作られたスレッドは affinity を引き継ぐので, codec の内部のスレッドも cpus で動く
+class ThreadAffinityScope {
+ public:
+  explicit ThreadAffinityScope(const std::vector<std::uint32_t>& cpus);
+  ~ThreadAffinityScope();
+
+  ThreadAffinityScope(const ThreadAffinityScope&) = delete;
+  ThreadAffinityScope& operator=(const ThreadAffinityScope&) = delete;
+
+ private:
+  ::cpu_set_t m_original;
+  bool m_is_set = false;
+};
+
+// "0-3,8,10-11" の形式の CPU の一覧を読む
+std::vector<std::uint32_t> parse_cpu_list(const std::string&);
+
+// 呼び出したスレッドが動ける CPU を, NUMA node ごとにまとめて並べる.
+// 先頭から区切って使えば, 区切りごとの CPU が少ない node に収まる
+std::vector<std::uint32_t> get_available_cpus_by_numa_node();
+
+// cpus を先頭から順に number_of_sets 組に分ける.
+// CPU が組の数より少ない場合は 1 つずつを共有する
+std::vector<std::vector<std::uint32_t>> split_cpus(
+    const std::vector<std::uint32_t>& cpus,
+    const std::size_t number_of_sets);
+
+}  // namespace hisui::util
@@ -0,0 +1,24 @@
+#pragma once
+
+// USE_CPU_DISPATCH を有効にした x86_64 のビルドでは, ホットループを持つ関数を
+// AVX2 と AVX-512 向けにも作り, 起動時に動いている CPU に合わせて選ぶ (ifunc).
+// -march で AVX2 を有効にしたビルドや aarch64 (NEON は常に使える) では何もしない
+#if defined(USE_CPU_DISPATCH) && defined(__x86_64__) && !defined(__AVX2__)
+#define HISUI_CPU_DISPATCH_X86 1
+#define HISUI_TARGET_CLONES \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define HISUI_TARGET_CLONES
+#endif
+
+namespace hisui::util {
+
+#if defined(HISUI_CPU_DISPATCH_X86)
+// 組み込み関数で書いた処理を AVX2 の版に切り替えるか
+inline bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+}  // namespace hisui::util
@@ -1,15 +1,29 @@
 #include "util/file.hpp"
 
+#include <fcntl.h>
 #include <fmt/core.h>
 #include <glob.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "util/wildcard.hpp"
 
 namespace hisui::util {
 
-FindFileResult find_file(const std::string& filename) {
+FindFileResult find_file(const std::string& filename,
+                         const std::filesystem::path& base_directory) {
+  if (is_url(filename)) {
+    return {.found = true, .path = filename};
+  }
   auto path = std::filesystem::path(filename);
   if (path.is_absolute()) {
     if (!std::filesystem::exists(path)) {
@@ -18,10 +32,14 @@ FindFileResult find_file(const std::string& filename) {
     }
     return {.found = true, .path = path};
   }
-  if (std::filesystem::exists(path)) {
-    return {.found = true, .path = std::filesystem::absolute(path)};
+  // 並列に探すことがあるので, カレントディレクトリは変えずにパスを組み立てる
+  const auto base = std::filesystem::absolute(
+      std::empty(base_directory) ? std::filesystem::current_path()
+                                 : base_directory);
+  if (std::filesystem::exists(base / path)) {
+    return {.found = true, .path = base / path};
   }
-  path = std::filesystem::absolute(path.filename());
+  path = base / path.filename();
   if (std::filesystem::exists(path)) {
     return {.found = true, .path = path};
   }
@@ -29,6 +47,23 @@ FindFileResult find_file(const std::string& filename) {
           .message = fmt::format("does not exist path({})", filename)};
 }
 
+bool is_url(const std::string& s) {
+  return s.starts_with("http://") || s.starts_with("https://") ||
+         s.starts_with("memory://");
+}
+
+std::string remove_url_query(const std::string& url) {
+  return url.substr(0, url.find_first_of("?#"));
+}
+
+std::string get_extension(const std::filesystem::path& path) {
+  const auto s = path.string();
+  if (is_url(s)) {
+    return std::filesystem::path(remove_url_query(s)).extension().string();
+  }
+  return path.extension().string();
+}
+
 std::vector<std::string> glob(const std::string& pattern) {
   ::glob_t globbuf;
   std::vector<std::string> filenames;
@@ -50,4 +85,66 @@ std::vector<std::string> glob(const std::string& pattern) {
   return filenames;
 }
 
+void clone_file(const std::filesystem::path& from,
+                const std::filesystem::path& to) {
+  const int from_fd = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (from_fd >= 0) {
+    const int to_fd =
+        ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const bool cloned = to_fd >= 0 && ::ioctl(to_fd, FICLONE, from_fd) == 0;
+    if (to_fd >= 0) {
+      ::close(to_fd);
+    }
+    ::close(from_fd);
+    if (cloned) {
+      return;
+    }
+  }
+  // 別のファイルシステムや reflink に対応しないファイルシステムではコピーする
+  std::filesystem::copy_file(from, to,
+                             std::filesystem::copy_options::overwrite_existing);
+}
+
+std::vector<std::string> DirectoryGlob::glob(const std::string& pattern) {
+  const auto slash = pattern.find_last_of('/');
+  const auto prefix =
+      slash == std::string::npos ? std::string() : pattern.substr(0, slash + 1);
+  const auto name_pattern = pattern.substr(std::size(prefix));
+  if (pattern.find_first_of("?[\\") != std::string::npos ||
+      prefix.find('*') != std::string::npos) {
+    return hisui::util::glob(pattern);
+  }
+
+  const WildcardPattern compiled(name_pattern);
+  // glob() と同じく, パターンが . で始まらなければ隠しファイルは含めない
+  const bool include_hidden = name_pattern.starts_with('.');
+  std::vector<std::string> filenames;
+  for (const auto& name : getListing(std::empty(prefix) ? "." : prefix)) {
+    if ((include_hidden || !name.starts_with('.')) && compiled.match(name)) {
+      filenames.push_back(prefix + name);
+    }
+  }
+  return filenames;
+}
+
+const std::vector<std::string>& DirectoryGlob::getListing(
+    const std::string& directory) {
+  if (const auto it = m_listings.find(directory); it != std::end(m_listings)) {
+    return it->second;
+  }
+  // directory_iterator は . と .. を返さないが, glob() は .* に一致させる
+  std::vector<std::string> names = {".", ".."};
+  // 読めないディレクトリは glob() と同じく, 一致するものが無いとする
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(directory, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    names.push_back(it->path().filename().string());
+  }
+  if (ec) {
+    names.clear();
+  }
+  std::sort(std::begin(names), std::end(names));
+  return m_listings.emplace(directory, std::move(names)).first->second;
+}
+
 }  // namespace hisui::util
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -12,8 +13,42 @@ struct FindFileResult {
   std::string message;
 };
 
-FindFileResult find_file(const std::string&);
+// 相対パスは base_directory から, 空ならカレントディレクトリから探す.
+// URL の場合は確かめずに見つかったものとする
+FindFileResult find_file(const std::string&,
+                         const std::filesystem::path& base_directory = {});
+
+// http:// か https:// で始まるか. 組み込んで使う場合の memory:// もローカルのファイルでは
+// ないので URL として扱う
+bool is_url(const std::string&);
+// URL の ? 以降を除く
+std::string remove_url_query(const std::string&);
+// 拡張子. 署名付き URL などのクエリは除いて調べる
+std::string get_extension(const std::filesystem::path&);
 
 std::vector<std::string> glob(const std::string&);
 
+// from を to にコピーする. 対応するファイルシステムでは FICLONE で reflink し,
+// 同じブロックを共有しても一方を書き換えたときに他方は変わらない
+void clone_file(const std::filesystem::path& from,
+                const std::filesystem::path& to);
+
+// ファイル名の部分だけに '*' を含むパターンを, ディレクトリごとに一度だけ読んだ
+// 一覧から解決する. 結果は glob() と同じ. それ以外のパターンは glob() に任せる
+class DirectoryGlob {
+ public:
+  std::vector<std::string> glob(const std::string&);
+
+// from を to にコピーする. 対応するファイルシステムでは FICLONE で reflink し,
+// 同じブロックを共有しても一方を書き換えたときに他方は変わらない
+void clone_file(const std::filesystem::path& from,
+                const std::filesystem::path& to);
+
+ private:
+  // ディレクトリごとの, 名前順に並べたファイル名
+  std::map<std::string, std::vector<std::string>> m_listings;
+
+  const std::vector<std::string>& getListing(const std::string&);
+};
+
 }  // namespace hisui::util
@@ -0,0 +1,63 @@
+#include "util/interval_index.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "util/interval.hpp"
+
+namespace hisui::util {
+
+IntervalIndex::IntervalIndex(const std::vector<Interval>& intervals)
+    : m_intervals(intervals) {
+  // 空の区間はどの範囲にも掛からない
+  for (std::size_t i = 0; i < std::size(m_intervals); ++i) {
+    if (m_intervals[i].getLower() < m_intervals[i].getUpper()) {
+      m_order_by_lower.push_back(i);
+    }
+  }
+  std::stable_sort(std::begin(m_order_by_lower), std::end(m_order_by_lower),
+                   [this](const std::size_t a, const std::size_t b) {
+                     return m_intervals[a].getLower() <
+                            m_intervals[b].getLower();
+                   });
+}
+
+void IntervalIndex::find(std::vector<std::size_t>* active,
+                         const std::uint64_t lower,
+                         const std::uint64_t upper) {
+  // 時間が戻った場合は最初からやり直す
+  if (lower < m_last_lower) {
+    reset();
+  }
+  m_last_lower = lower;
+
+  while (m_next < std::size(m_order_by_lower) &&
+         m_intervals[m_order_by_lower[m_next]].getLower() < upper) {
+    const auto index = m_order_by_lower[m_next++];
+    m_started.insert(std::upper_bound(std::begin(m_started),
+                                      std::end(m_started), index),
+                     index);
+  }
+
+  // lower は減らないので, 終わった区間が再び掛かることはない
+  std::erase_if(m_started, [this, lower](const std::size_t index) {
+    return m_intervals[index].getUpper() <= lower;
+  });
+
+  active->clear();
+  std::copy_if(std::begin(m_started), std::end(m_started),
+               std::back_inserter(*active),
+               [this, upper](const std::size_t index) {
+                 return m_intervals[index].getLower() < upper;
+               });
+}
+
+void IntervalIndex::reset() {
+  m_next = 0;
+  m_started.clear();
+}
+
+}  // namespace hisui::util
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/interval.hpp"
+
+namespace hisui::util {
+
+// 区間の集合のうち, 問い合わせた範囲に掛かるものを求める.
+// 問い合わせの開始位置が前回以上である間は, 前回の結果から差分だけを更新する
+class IntervalIndex {
+ public:
+  explicit IntervalIndex(const std::vector<Interval>&);
+
+  // [lower, upper) に掛かる区間の index を昇順で active に入れる
+  void find(std::vector<std::size_t>* active,
+            const std::uint64_t lower,
+            const std::uint64_t upper);
+
+ private:
+  std::vector<Interval> m_intervals;
+  // 開始位置の昇順に並べた区間の index
+  std::vector<std::size_t> m_order_by_lower;
+  std::size_t m_next = 0;
+  // 開始済みで, まだ終わっていない区間の index. 昇順に保つ
+  std::vector<std::size_t> m_started;
+  std::uint64_t m_last_lower = 0;
+
+  void reset();
+};
+
+}  // namespace hisui::util
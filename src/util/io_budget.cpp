@@ -0,0 +1,133 @@
+#include "util/io_budget.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace hisui::util {
+
+namespace {
+
+// 制限より速く読める期間. 短い間の偏りは待たずに読ませる
+constexpr std::int64_t BURST_NS = 100'000'000;
+
+static_assert(std::atomic_ref<std::int64_t>::is_always_lock_free);
+
+// 次に読み込める時刻 (ns) を進めて帯域を分け合う. 時刻は CLOCK_MONOTONIC で,
+// ホストのプロセス全体で共通なので, 共有メモリに置いても比べられる
+class Bucket {
+ public:
+  void setLimit(const std::uint64_t bytes_per_second, std::int64_t* next) {
+    m_bytes_per_second = bytes_per_second;
+    m_next = next;
+  }
+
+  // 待つべき時間 (ns) を返す
+  std::int64_t reserve(const std::size_t size, const std::int64_t now) const {
+    if (m_bytes_per_second == 0) {
+      return 0;
+    }
+    const auto cost = static_cast<std::int64_t>(
+        static_cast<double>(size) * 1e9 /
+        static_cast<double>(m_bytes_per_second));
+    std::atomic_ref<std::int64_t> next(*m_next);
+    auto expected = next.load(std::memory_order_relaxed);
+    std::int64_t start;
+    do {
+      start = std::max(now, expected);
+    } while (!next.compare_exchange_weak(expected, start + cost,
+                                          std::memory_order_relaxed));
+    return start + cost - BURST_NS - now;
+  }
+
+ private:
+  std::uint64_t m_bytes_per_second = 0;
+  std::int64_t* m_next = nullptr;
+};
+
+alignas(std::atomic_ref<std::int64_t>::required_alignment) std::int64_t
+    process_next = 0;
+Bucket process_bucket;
+Bucket host_bucket;
+
+std::int64_t* map_host_state(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("opening {} failed: {}", path,
+                                         std::strerror(errno)));
+  }
+  struct ::stat st;
+  // 他のプロセスが同時に伸ばしても大きさは同じになる
+  if (::fstat(fd, &st) == -1 ||
+      (static_cast<std::size_t>(st.st_size) < sizeof(std::int64_t) &&
+       ::ftruncate(fd, sizeof(std::int64_t)) == -1)) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error(fmt::format("resizing {} failed: {}", path,
+                                         std::strerror(error)));
+  }
+  void* data = ::mmap(nullptr, sizeof(std::int64_t), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  const int error = errno;
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(fmt::format("mmap() failed: file_path={} error={}",
+                                         path, std::strerror(error)));
+  }
+  return static_cast<std::int64_t*>(data);
+}
+
+}  // namespace
+
+void ReadBandwidth::setProcessLimit(const std::uint64_t bytes_per_second) {
+  process_bucket.setLimit(bytes_per_second, &process_next);
+}
+
+void ReadBandwidth::setHostLimit(const std::uint64_t bytes_per_second,
+                                 const std::string& path) {
+  if (bytes_per_second == 0) {
+    host_bucket.setLimit(0, nullptr);
+    return;
+  }
+  host_bucket.setLimit(bytes_per_second, map_host_state(path));
+}
+
+void ReadBandwidth::acquire(const std::size_t size) {
+  const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                       .count();
+  const auto wait = std::max(process_bucket.reserve(size, now),
+                             host_bucket.reserve(size, now));
+  if (wait > 0) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+  }
+}
+
+void set_io_priority(const IOPriorityClass io_class, const int level) {
+  // glibc には ioprio_set() の wrapper が無い. 定数は linux/ioprio.h と同じ
+  constexpr int IOPRIO_WHO_PROCESS = 1;
+  constexpr int IOPRIO_CLASS_SHIFT = 13;
+  const int priority =
+      (static_cast<int>(io_class) << IOPRIO_CLASS_SHIFT) |
+      (io_class == IOPriorityClass::BestEffort ? std::clamp(level, 0, 7) : 0);
+  if (::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority) == -1) {
+    throw std::runtime_error(
+        fmt::format("ioprio_set() failed: {}", std::strerror(errno)));
+  }
+}
+
+}  // namespace hisui::util
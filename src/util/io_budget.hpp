@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hisui::util {
+
+// 入力の読み込みの帯域を, このプロセスと, 同じファイルを共有するホストのプロセス全体で制限する.
+// 共有ストレージから多くの合成が同時に読む際に, ストレージを飽和させないためのもの
+class ReadBandwidth {
+ public:
+  // bytes/s. 0 ならば制限しない. 読み込みを始める前に設定しておく
+  static void setProcessLimit(const std::uint64_t);
+  // path のファイルを mmap() して, 同じ path を指定したプロセスの合計を制限する
+  static void setHostLimit(const std::uint64_t, const std::string& path);
+  // size バイトを読む前に呼び, 制限を超えないよう待つ
+  static void acquire(const std::size_t size);
+};
+
+// ioprio_set(2) の class
+enum struct IOPriorityClass {
+  BestEffort = 2,
+  Idle = 3,
+};
+
+// 呼び出したスレッドの I/O の優先度を設定する. level は BestEffort の 0 (高) から 7 (低).
+// 以降に作られたスレッドは優先度を引き継ぐので, 他のスレッドを作る前に呼ぶ
+void set_io_priority(const IOPriorityClass, const int level);
+
+}  // namespace hisui::util
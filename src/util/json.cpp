@@ -2,7 +2,10 @@
 
 #include <fmt/core.h>
 
+#include <cstddef>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
 #include <string>
 
@@ -11,94 +14,139 @@
 #include <boost/json/object.hpp>
 #include <boost/json/parse.hpp>
 #include <boost/json/src.hpp>  // https://github.com/boostorg/json#header-only
+#include <boost/json/stream_parser.hpp>
 #include <boost/json/string.hpp>
 #include <boost/json/system_error.hpp>
 #include <boost/json/value.hpp>
 
 namespace hisui::util {
 
-boost::json::string get_string_from_json_object(boost::json::object o,
+namespace {
+
+constexpr std::size_t READ_SIZE = 64 * 1024;
+
+bool is_null_or_missing(const boost::json::value* v) {
+  return v == nullptr || v->is_null();
+}
+
+double to_double(const boost::json::value& v, const std::string& key) {
+  boost::json::error_code ec;
+  auto value = v.to_number<double>(ec);
+  if (ec) {
+    throw std::runtime_error(
+        fmt::format("{} to_number<double>() failed: {}", key, ec.message()));
+  }
+  return value;
+}
+
+}  // namespace
+
+boost::json::value parse_json_file(const std::filesystem::path& path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is.is_open()) {
+    throw std::runtime_error(
+        fmt::format("failed to open json file: {}", path.string()));
+  }
+  boost::json::stream_parser parser;
+  boost::json::error_code ec;
+  std::string buffer(READ_SIZE, '\0');
+  while (is) {
+    is.read(std::data(buffer), static_cast<std::streamsize>(READ_SIZE));
+    const auto n = static_cast<std::size_t>(is.gcount());
+    if (n == 0) {
+      break;
+    }
+    parser.write(std::data(buffer), n, ec);
+    if (ec) {
+      break;
+    }
+  }
+  if (!ec) {
+    parser.finish(ec);
+  }
+  if (ec) {
+    throw std::runtime_error(
+        fmt::format("failed to parse json file: file={} message={}",
+                    path.string(), ec.message()));
+  }
+  return parser.release();
+}
+
+boost::json::string get_string_from_json_object(const boost::json::object& o,
                                                 const std::string& key) {
-  if (o[key].is_string()) {
-    return o[key].as_string();
+  if (const auto v = o.if_contains(key); v != nullptr && v->is_string()) {
+    return v->as_string();
   }
   throw std::runtime_error(fmt::format("{} is not string", key));
 }
 
 boost::json::string get_string_from_json_object_with_default(
-    boost::json::object o,
+    const boost::json::object& o,
     const std::string& key,
     const std::string& s) {
-  if (!o.contains(key) || o[key].is_null()) {
+  const auto v = o.if_contains(key);
+  if (is_null_or_missing(v)) {
     boost::json::string js(s);
     return js;
   }
-  if (o[key].is_string()) {
-    return o[key].as_string();
+  if (v->is_string()) {
+    return v->as_string();
   }
   throw std::runtime_error(fmt::format("{} is not string", key));
 }
 
-double get_double_from_json_object(boost::json::object o,
+double get_double_from_json_object(const boost::json::object& o,
                                    const std::string& key) {
-  if (o[key].is_number()) {
-    boost::json::error_code ec;
-    auto value = o[key].to_number<double>(ec);
-    if (ec) {
-      throw std::runtime_error(
-          fmt::format("{} to_number<double>() failed: {}", key, ec.message()));
-    }
-    return value;
+  if (const auto v = o.if_contains(key); v != nullptr && v->is_number()) {
+    return to_double(*v, key);
   }
   throw std::runtime_error(fmt::format("{} is not number", key));
 }
 
-double get_double_from_json_object_with_default(boost::json::object o,
+double get_double_from_json_object_with_default(const boost::json::object& o,
                                                 const std::string& key,
                                                 const double d) {
-  if (!o.contains(key) || o[key].is_null()) {
+  const auto v = o.if_contains(key);
+  if (is_null_or_missing(v)) {
     return d;
   }
-  if (o[key].is_number()) {
-    boost::json::error_code ec;
-    auto value = o[key].to_number<double>(ec);
-    if (ec) {
-      throw std::runtime_error(
-          fmt::format("{} to_number<double>() failed: {}", key, ec.message()));
-    }
-    return value;
+  if (v->is_number()) {
+    return to_double(*v, key);
   }
   throw std::runtime_error(fmt::format("{} is not number", key));
 }
 
-bool get_bool_from_json_object(boost::json::object o, const std::string& key) {
-  if (o[key].is_bool()) {
-    return o[key].as_bool();
+bool get_bool_from_json_object(const boost::json::object& o,
+                               const std::string& key) {
+  if (const auto v = o.if_contains(key); v != nullptr && v->is_bool()) {
+    return v->as_bool();
   }
   throw std::runtime_error(fmt::format("{} is not bool", key));
 }
 
-bool get_bool_from_json_object_with_default(boost::json::object o,
+bool get_bool_from_json_object_with_default(const boost::json::object& o,
                                             const std::string& key,
                                             const bool b) {
-  if (!o.contains(key) || o[key].is_null()) {
+  const auto v = o.if_contains(key);
+  if (is_null_or_missing(v)) {
     return b;
   }
-  if (o[key].is_bool()) {
-    return o[key].as_bool();
+  if (v->is_bool()) {
+    return v->as_bool();
   }
   throw std::runtime_error(fmt::format("{} is not bool", key));
 }
 
 boost::json::array get_array_from_json_object_with_default(
-    boost::json::object o,
+    const boost::json::object& o,
     const std::string& key,
     const boost::json::array& a) {
-  if (!o.contains(key) || o[key].is_null()) {
+  const auto v = o.if_contains(key);
+  if (is_null_or_missing(v)) {
     return a;
   }
-  if (o[key].is_array()) {
-    return o[key].as_array();
+  if (v->is_array()) {
+    return v->as_array();
   }
   throw std::runtime_error(fmt::format("{} is not array", key));
 }
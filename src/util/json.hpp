@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
 #include <string>
 
 #include <boost/json/array.hpp>
@@ -10,27 +11,31 @@
 
 namespace hisui::util {
 
-boost::json::string get_string_from_json_object(boost::json::object o,
+// ファイルを一度に読み込まず, 少しずつ stream_parser に渡して解析する
+boost::json::value parse_json_file(const std::filesystem::path&);
+
+boost::json::string get_string_from_json_object(const boost::json::object& o,
                                                 const std::string& key);
 boost::json::string get_string_from_json_object_with_default(
-    boost::json::object o,
+    const boost::json::object& o,
     const std::string& key,
     const std::string& d);
 
-double get_double_from_json_object(boost::json::object o,
+double get_double_from_json_object(const boost::json::object& o,
                                    const std::string& key);
 
-double get_double_from_json_object_with_default(boost::json::object o,
+double get_double_from_json_object_with_default(const boost::json::object& o,
                                                 const std::string& key,
                                                 const double);
 
-bool get_bool_from_json_object(boost::json::object o, const std::string& key);
-bool get_bool_from_json_object_with_default(boost::json::object o,
+bool get_bool_from_json_object(const boost::json::object& o,
+                               const std::string& key);
+bool get_bool_from_json_object_with_default(const boost::json::object& o,
                                             const std::string& key,
                                             const bool);
 
 boost::json::array get_array_from_json_object_with_default(
-    boost::json::object o,
+    const boost::json::object& o,
     const std::string& key,
     const boost::json::array&);
 }  // namespace hisui::util
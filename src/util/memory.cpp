@@ -0,0 +1,155 @@
+#include "util/memory.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace hisui::util {
+
+namespace {
+
+// x86_64 と aarch64 (4 KiB ページ) の huge page の大きさ
+constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+std::atomic<bool> huge_pages_enabled = false;
+std::atomic<bool> huge_pages_explicit = false;
+std::atomic<std::uint64_t> explicit_bytes = 0;
+std::atomic<std::uint64_t> transparent_bytes = 0;
+
+std::size_t align_up(const std::size_t value, const std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// [data, data + size) に含まれる huge page の境界に揃った範囲を madvise() する
+void advise_transparent_huge_pages(void* data, const std::size_t size) {
+  const auto begin =
+      align_up(reinterpret_cast<std::uintptr_t>(data), HUGE_PAGE_SIZE);
+  const auto end = (reinterpret_cast<std::uintptr_t>(data) + size) /
+                   HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  if (begin >= end) {
+    return;
+  }
+  if (::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) ==
+      0) {
+    transparent_bytes += end - begin;
+  }
+}
+
+// huge page の境界に揃えるため, 余分に mmap() して前後を切り捨てる
+std::uint8_t* map_aligned(const std::size_t size) {
+  const auto mapped_size = size + HUGE_PAGE_SIZE;
+  void* mapped = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  const auto address = reinterpret_cast<std::uintptr_t>(mapped);
+  const auto begin = align_up(address, HUGE_PAGE_SIZE);
+  if (begin > address) {
+    ::munmap(mapped, begin - address);
+  }
+  const auto end = begin + size;
+  if (address + mapped_size > end) {
+    ::munmap(reinterpret_cast<void*>(end), address + mapped_size - end);
+  }
+  return reinterpret_cast<std::uint8_t*>(begin);
+}
+
+}  // namespace
+
+std::uint64_t get_resident_memory_size() {
+  // getrusage() はピークしか返さないので /proc から読む
+  std::ifstream statm("/proc/self/statm");
+  std::uint64_t size = 0;
+  std::uint64_t resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  const auto page_size = ::sysconf(_SC_PAGESIZE);
+  if (page_size <= 0) {
+    return 0;
+  }
+  return resident * static_cast<std::uint64_t>(page_size);
+}
+
+void enable_huge_pages(const bool is_explicit) {
+  huge_pages_explicit = is_explicit;
+  huge_pages_enabled = true;
+}
+
+ImageBuffer allocate_image_buffer(const std::size_t size,
+                                  const std::size_t alignment) {
+  if (!huge_pages_enabled || size < HUGE_PAGE_SIZE) {
+    return {.data = static_cast<std::uint8_t*>(
+                ::operator new[](size, std::align_val_t{alignment})),
+            .size = size,
+            .is_mapped = false};
+  }
+  const auto mapped_size = align_up(size, HUGE_PAGE_SIZE);
+  if (huge_pages_explicit) {
+    void* mapped = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapped != MAP_FAILED) {
+      explicit_bytes += mapped_size;
+      return {.data = static_cast<std::uint8_t*>(mapped),
+              .size = mapped_size,
+              .is_mapped = true};
+    }
+  }
+  auto data = map_aligned(mapped_size);
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  advise_transparent_huge_pages(data, mapped_size);
+  return {.data = data, .size = mapped_size, .is_mapped = true};
+}
+
+void free_image_buffer(const ImageBuffer& buffer,
+                       const std::size_t alignment) {
+  if (buffer.data == nullptr) {
+    return;
+  }
+  if (buffer.is_mapped) {
+    ::munmap(buffer.data, buffer.size);
+    return;
+  }
+  ::operator delete[](buffer.data, std::align_val_t{alignment});
+}
+
+void resize_with_huge_pages(std::vector<unsigned char>* buffer,
+                            const std::size_t size) {
+  // resize() で 0 を書き込む前に設定しないと, 通常のページが割り当てられてしまう
+  if (huge_pages_enabled && size >= HUGE_PAGE_SIZE &&
+      buffer->capacity() < size) {
+    buffer->reserve(size);
+    advise_transparent_huge_pages(buffer->data(), buffer->capacity());
+  }
+  buffer->resize(size);
+}
+
+HugePageStatistics get_huge_page_statistics() {
+  HugePageStatistics statistics{.enabled = huge_pages_enabled,
+                                .is_explicit = huge_pages_explicit,
+                                .explicit_bytes = explicit_bytes,
+                                .transparent_bytes = transparent_bytes};
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string key;
+  std::uint64_t value = 0;
+  std::string unit;
+  while (smaps >> key) {
+    if (key == "AnonHugePages:" && smaps >> value >> unit) {
+      statistics.anon_huge_page_bytes = value * 1024;
+      break;
+    }
+  }
+  return statistics;
+}
+
+}  // namespace hisui::util
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace hisui::util {
+
+// 現在の常駐メモリのサイズ (バイト). 取得できなければ 0
+std::uint64_t get_resident_memory_size();
+
+// 以降に確保する大きな画像の領域に huge page を使う. 合成を始める前に呼ぶ.
+// is_explicit ならば hugetlbfs に予約された huge page から確保し,
+// 足りなければ transparent huge page にする
+void enable_huge_pages(const bool is_explicit);
+
+struct ImageBuffer {
+  std::uint8_t* data = nullptr;
+  std::size_t size = 0;
+  // mmap() で確保したか. そうでなければ operator new[]() で確保している
+  bool is_mapped = false;
+};
+
+// 少なくとも size バイトの, alignment バイトの境界に揃った領域を確保する.
+// huge page が有効で size が huge page 以上ならば huge page を使う
+ImageBuffer allocate_image_buffer(const std::size_t size,
+                                  const std::size_t alignment);
+void free_image_buffer(const ImageBuffer&, const std::size_t alignment);
+
+// buffer を size にする. 確保した領域に書き込む前に transparent huge page を使うよう設定する
+void resize_with_huge_pages(std::vector<unsigned char>* buffer,
+                            const std::size_t size);
+
+struct HugePageStatistics {
+  bool enabled = false;
+  bool is_explicit = false;
+  // hugetlbfs から確保できたバイト数
+  std::uint64_t explicit_bytes = 0;
+  // transparent huge page を使うよう madvise() したバイト数
+  std::uint64_t transparent_bytes = 0;
+  // カーネルが実際に huge page を割り当てている匿名メモリのバイト数
+  std::uint64_t anon_huge_page_bytes = 0;
+};
+
+HugePageStatistics get_huge_page_statistics();
+
+}  // namespace hisui::util
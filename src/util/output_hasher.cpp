@@ -0,0 +1,151 @@
+#include "util/output_hasher.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "report/reporter.hpp"
+#include "util/sha2.hpp"
+
+namespace hisui::util {
+
+namespace {
+
+constexpr std::size_t READ_SIZE = 1024 * 1024;
+
+SHA2Type get_sha2_type(const std::string& algorithm) {
+  if (algorithm == "sha224") {
+    return SHA2Type::SHA224;
+  }
+  if (algorithm == "sha256") {
+    return SHA2Type::SHA256;
+  }
+  throw std::invalid_argument(
+      fmt::format("unsupported hash algorithm: {}", algorithm));
+}
+
+}  // namespace
+
+OutputHasher::OutputHasher(const std::string& t_file_path,
+                           const std::vector<std::string>& t_algorithms)
+    : m_file_path(t_file_path), m_algorithms(t_algorithms) {
+  for (const auto& algorithm : m_algorithms) {
+    m_hashes.emplace_back(get_sha2_type(algorithm));
+  }
+}
+
+void OutputHasher::update(const std::int64_t offset,
+                          const void* data,
+                          const std::size_t size) {
+  if (!m_is_sequential) {
+    return;
+  }
+  if (offset != m_size) {
+    // 書き換えた後の内容は, 全て書き終えるまで分からない
+    m_is_sequential = false;
+    return;
+  }
+  for (auto& hash : m_hashes) {
+    hash.update(data, size);
+  }
+  m_size += static_cast<std::int64_t>(size);
+}
+
+void OutputHasher::finish() {
+  if (!m_is_sequential) {
+    spdlog::debug("{} was rewritten, reading it again to hash", m_file_path);
+    m_hashes.clear();
+    for (const auto& algorithm : m_algorithms) {
+      m_hashes.emplace_back(get_sha2_type(algorithm));
+    }
+    std::ifstream ifs(m_file_path, std::ios::binary);
+    if (!ifs) {
+      throw std::runtime_error(
+          fmt::format("opening {} failed", m_file_path));
+    }
+    std::vector<char> buffer(READ_SIZE);
+    while (ifs) {
+      ifs.read(std::data(buffer), static_cast<std::streamsize>(READ_SIZE));
+      const auto n = static_cast<std::size_t>(ifs.gcount());
+      for (auto& hash : m_hashes) {
+        hash.update(std::data(buffer), n);
+      }
+    }
+    if (!ifs.eof()) {
+      throw std::runtime_error(
+          fmt::format("reading {} failed", m_file_path));
+    }
+  }
+
+  for (std::size_t i = 0; i < std::size(m_algorithms); ++i) {
+    const auto digest = m_hashes[i].finalize();
+    spdlog::info("{}: {} {}", m_algorithms[i], digest, m_file_path);
+    if (hisui::report::Reporter::hasInstance()) {
+      hisui::report::Reporter::getInstance().registerOutputHash(
+          m_file_path, m_algorithms[i], digest);
+    }
+  }
+}
+
+void OutputHasher::hashFile() {
+  m_is_sequential = false;
+  finish();
+}
+
+HashingStreambuf::HashingStreambuf(std::streambuf* t_dst,
+                                   OutputHasher* t_hasher)
+    : m_dst(t_dst), m_hasher(t_hasher) {}
+
+std::streamsize HashingStreambuf::xsputn(const char_type* s,
+                                         const std::streamsize n) {
+  const auto written = m_dst->sputn(s, n);
+  if (written > 0) {
+    m_hasher->update(m_position, s, static_cast<std::size_t>(written));
+    m_position += written;
+  }
+  return written;
+}
+
+HashingStreambuf::int_type HashingStreambuf::overflow(const int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof())) {
+    return traits_type::not_eof(c);
+  }
+  const auto ch = traits_type::to_char_type(c);
+  return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+HashingStreambuf::pos_type HashingStreambuf::seekoff(
+    const off_type off,
+    const std::ios_base::seekdir dir,
+    const std::ios_base::openmode which) {
+  const auto pos = m_dst->pubseekoff(off, dir, which);
+  if (pos != pos_type(off_type(-1))) {
+    m_position = static_cast<std::int64_t>(pos);
+  }
+  return pos;
+}
+
+HashingStreambuf::pos_type HashingStreambuf::seekpos(
+    const pos_type pos,
+    const std::ios_base::openmode which) {
+  const auto result = m_dst->pubseekpos(pos, which);
+  if (result != pos_type(off_type(-1))) {
+    m_position = static_cast<std::int64_t>(result);
+  }
+  return result;
+}
+
+int HashingStreambuf::sync() {
+  return m_dst->pubsync();
+}
+
+}  // namespace hisui::util
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "util/sha2.hpp"
+
+namespace hisui::util {
+
+// 出力ファイルに書き込むデータから, 書き込みと同時に --out-hash のハッシュ値を計算する.
+// 先頭から順に書かれた分だけを計算し, 書いた部分を後から書き換えた場合は
+// finish() でファイルを読み直して計算する
+class OutputHasher {
+ public:
+  OutputHasher(const std::string&, const std::vector<std::string>&);
+
+  // offset の位置に書き込んだデータを渡す
+  void update(const std::int64_t, const void*, const std::size_t);
+  // ファイルを閉じた後に呼び, ハッシュ値をログと Reporter に出す
+  void finish();
+  // update() を経ずに作ったファイルを読んで, finish() と同じくハッシュ値を出す
+  void hashFile();
+
+ private:
+  std::string m_file_path;
+  std::vector<std::string> m_algorithms;
+  std::vector<SHA2> m_hashes;
+  std::int64_t m_size = 0;
+  bool m_is_sequential = true;
+};
+
+// 書き込みをそのまま dst に渡し, 書き込んだ位置とデータを OutputHasher に渡す.
+// 自身はバッファを持たない
+class HashingStreambuf : public std::streambuf {
+ public:
+  HashingStreambuf(std::streambuf*, OutputHasher*);
+
+ protected:
+  std::streamsize xsputn(const char_type*, std::streamsize) override;
+  int_type overflow(int_type) override;
+  pos_type seekoff(off_type,
+                   std::ios_base::seekdir,
+                   std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+  int sync() override;
+
+ private:
+  std::streambuf* m_dst;
+  OutputHasher* m_hasher;
+  std::int64_t m_position = 0;
+};
+
+}  // namespace hisui::util
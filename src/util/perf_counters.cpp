@@ -0,0 +1,150 @@
+#include "util/perf_counters.hpp"
+
+#include <linux/perf_event.h>
+#include <spdlog/spdlog.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+namespace hisui::util {
+
+namespace {
+
+std::atomic<bool> is_enabled = false;
+std::atomic<bool> has_warned = false;
+
+struct Event {
+  const std::uint32_t type;
+  const std::uint64_t config;
+};
+
+// PerfCounterValues のメンバーと同じ順に並べる. 先頭を group の leader にする
+constexpr std::array<Event, 4> EVENTS = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+}};
+
+int open_event(const Event& event, const int group_fd) {
+  ::perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  // perf_event_paranoid が 2 の環境でも特権なしで開けるよう, user 空間のみを数える
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+  return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1,
+                                    group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+// 1 つのスレッドの計数. 同じ group にして, 全ての計数を同じ区間で数える
+class ThreadCounters {
+ public:
+  ThreadCounters() {
+    m_fds.fill(-1);
+    m_fds[0] = open_event(EVENTS[0], -1);
+    if (m_fds[0] == -1) {
+      if (!has_warned.exchange(true)) {
+        // EACCES ならば kernel.perf_event_paranoid, ENOENT ならば PMU の有無を確かめる
+        spdlog::warn("perf_event_open() failed: {}", std::strerror(errno));
+      }
+      return;
+    }
+    ::ioctl(m_fds[0], PERF_EVENT_IOC_ID, &m_ids[0]);
+    // 仮想マシンなどで数えられない計数は 0 のままにする
+    for (std::size_t i = 1; i < std::size(EVENTS); ++i) {
+      m_fds[i] = open_event(EVENTS[i], m_fds[0]);
+      if (m_fds[i] != -1) {
+        ::ioctl(m_fds[i], PERF_EVENT_IOC_ID, &m_ids[i]);
+      }
+    }
+  }
+
+  ~ThreadCounters() {
+    for (const auto fd : m_fds) {
+      if (fd != -1) {
+        ::close(fd);
+      }
+    }
+  }
+
+  ThreadCounters(const ThreadCounters&) = delete;
+  ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+  std::optional<PerfCounterValues> read() const {
+    if (m_fds[0] == -1) {
+      return {};
+    }
+    // PERF_FORMAT_GROUP | PERF_FORMAT_ID: nr, {value, id} * nr
+    std::array<std::uint64_t, 1 + 2 * std::size(EVENTS)> buffer;
+    if (::read(m_fds[0], buffer.data(), sizeof(buffer)) == -1) {
+      return {};
+    }
+    std::array<std::uint64_t, std::size(EVENTS)> values = {};
+    for (std::size_t i = 0; i < buffer[0] && i < std::size(EVENTS); ++i) {
+      for (std::size_t j = 0; j < std::size(EVENTS); ++j) {
+        if (m_fds[j] != -1 && m_ids[j] == buffer[2 + 2 * i]) {
+          values[j] = buffer[1 + 2 * i];
+        }
+      }
+    }
+    return PerfCounterValues{.cycles = values[0],
+                             .instructions = values[1],
+                             .cache_misses = values[2],
+                             .dtlb_misses = values[3]};
+  }
+
+ private:
+  std::array<int, std::size(EVENTS)> m_fds;
+  std::array<std::uint64_t, std::size(EVENTS)> m_ids = {};
+};
+
+}  // namespace
+
+PerfCounterValues operator-(const PerfCounterValues& left,
+                            const PerfCounterValues& right) {
+  return {.cycles = left.cycles - right.cycles,
+          .instructions = left.instructions - right.instructions,
+          .cache_misses = left.cache_misses - right.cache_misses,
+          .dtlb_misses = left.dtlb_misses - right.dtlb_misses};
+}
+
+PerfCounterValues& operator+=(PerfCounterValues& left,
+                              const PerfCounterValues& right) {
+  left.cycles += right.cycles;
+  left.instructions += right.instructions;
+  left.cache_misses += right.cache_misses;
+  left.dtlb_misses += right.dtlb_misses;
+  return left;
+}
+
+void PerfCounters::enable() {
+  is_enabled = true;
+}
+
+bool PerfCounters::isEnabled() {
+  return is_enabled.load(std::memory_order_relaxed);
+}
+
+std::optional<PerfCounterValues> PerfCounters::read() {
+  if (!isEnabled()) {
+    return {};
+  }
+  thread_local const ThreadCounters counters;
+  return counters.read();
+}
+
+}  // namespace hisui::util
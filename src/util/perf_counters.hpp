@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+namespace hisui::util {
+
+// perf_event_open(2) で数えた, 1 つのスレッドのハードウェアの計数.
+// 開けなかった計数は 0 のままにする
+struct PerfCounterValues {
+  std::uint64_t cycles = 0;
+  std::uint64_t instructions = 0;
+  std::uint64_t cache_misses = 0;
+  std::uint64_t dtlb_misses = 0;
+};
+
+PerfCounterValues operator-(const PerfCounterValues&,
+                            const PerfCounterValues&);
+PerfCounterValues& operator+=(PerfCounterValues&, const PerfCounterValues&);
+
+// 合成の処理が, メモリーの帯域と演算のどちらで律速しているかを調べるためのもの.
+// 計数はスレッドごとに開き, 最初に read() を呼んだスレッドで開く
+class PerfCounters {
+ public:
+  // 以降に read() を呼んだスレッドで数え始める
+  static void enable();
+  static bool isEnabled();
+  // 呼び出したスレッドのこれまでの計数. 無効か, cycles を開けなかった場合は空
+  static std::optional<PerfCounterValues> read();
+};
+
+}  // namespace hisui::util
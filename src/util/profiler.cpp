@@ -0,0 +1,257 @@
+#include "util/profiler.hpp"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fmt/core.h>
+#include <signal.h>
+#include <spdlog/spdlog.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace hisui::util::profiler {
+
+namespace {
+
+constexpr std::size_t MAX_DEPTH = 48;
+// 99 Hz で 8 コアを使い切っても 40 秒ほど記録できる. 溢れた分は数だけ数える
+constexpr std::size_t MAX_SAMPLES = 1 << 15;
+// シグナルハンドラーと __restore_rt の分
+constexpr int SKIPPED_FRAMES = 2;
+
+struct Sample {
+  std::atomic<bool> is_ready = false;
+  pid_t tid = 0;
+  int depth = 0;
+  std::array<void*, MAX_DEPTH> frames = {};
+};
+
+// シグナルハンドラーからはロックを取らずに, 空いている要素を 1 つ確保して書き込む
+std::atomic<Sample*> g_samples = nullptr;
+std::atomic<std::size_t> g_number_of_samples = 0;
+std::atomic<std::size_t> g_number_of_dropped_samples = 0;
+std::atomic<bool> g_is_sampling = false;
+std::atomic<bool> g_has_session = false;
+
+void handle_sigprof(int) {
+  if (!g_is_sampling.load(std::memory_order_relaxed)) {
+    return;
+  }
+  auto* samples = g_samples.load(std::memory_order_acquire);
+  if (samples == nullptr) {
+    return;
+  }
+  const auto saved_errno = errno;
+  const auto index = g_number_of_samples.fetch_add(1);
+  if (index >= MAX_SAMPLES) {
+    g_number_of_dropped_samples.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    auto& sample = samples[index];
+    sample.tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    sample.depth =
+        ::backtrace(sample.frames.data(), static_cast<int>(MAX_DEPTH));
+    sample.is_ready.store(true, std::memory_order_release);
+  }
+  errno = saved_errno;
+}
+
+void handle_sigusr2(int) {
+  g_is_sampling.store(!g_is_sampling.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+}
+
+void set_timer(const std::uint32_t frequency) {
+  ::itimerval timer = {};
+  if (frequency != 0) {
+    const auto interval = 1000000 / frequency;
+    timer.it_interval.tv_sec = static_cast<::time_t>(interval / 1000000);
+    timer.it_interval.tv_usec = static_cast<::suseconds_t>(interval % 1000000);
+    timer.it_value = timer.it_interval;
+  }
+  if (::setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    throw std::runtime_error(
+        fmt::format("setitimer() failed: errno={}", errno));
+  }
+}
+
+void set_signal_handler(const int signal, void (*handler)(int)) {
+  struct ::sigaction action = {};
+  action.sa_handler = handler;
+  // 採取のたびにシステムコールが EINTR で失敗しないようにする
+  action.sa_flags = SA_RESTART;
+  ::sigemptyset(&action.sa_mask);
+  if (::sigaction(signal, &action, nullptr) != 0) {
+    throw std::runtime_error(
+        fmt::format("sigaction({}) failed: errno={}", signal, errno));
+  }
+}
+
+std::string get_thread_name(const pid_t tid) {
+  std::ifstream ifs(fmt::format("/proc/self/task/{}/comm", tid));
+  std::string name;
+  if (ifs && std::getline(ifs, name) && !std::empty(name)) {
+    return fmt::format("{}-{}", name, tid);
+  }
+  // 終了したスレッド
+  return fmt::format("thread-{}", tid);
+}
+
+// 関数名が得られない場合は addr2line で引けるように, モジュールとその中の位置を返す
+std::string symbolize(void* address) {
+  ::Dl_info info = {};
+  if (::dladdr(address, &info) == 0) {
+    return fmt::format("{}", address);
+  }
+  if (info.dli_sname != nullptr) {
+    int status = 0;
+    std::unique_ptr<char, decltype(&std::free)> demangled(
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status),
+        &std::free);
+    return status == 0 && demangled ? demangled.get() : info.dli_sname;
+  }
+  const auto module = info.dli_fname != nullptr
+                          ? std::filesystem::path(info.dli_fname)
+                                .filename()
+                                .string()
+                          : std::string("unknown");
+  return fmt::format("{}+{:#x}", module,
+                     reinterpret_cast<std::uintptr_t>(address) -
+                         reinterpret_cast<std::uintptr_t>(info.dli_fbase));
+}
+
+void dump(const std::string& filename, Sample* samples) {
+  const auto number_of_samples =
+      std::min(g_number_of_samples.load(), MAX_SAMPLES);
+  std::unordered_map<void*, std::string> symbols;
+  std::unordered_map<pid_t, std::string> thread_names;
+  std::map<std::string, std::size_t> stacks;
+  for (std::size_t i = 0; i < number_of_samples; ++i) {
+    const auto& sample = samples[i];
+    if (!sample.is_ready.load(std::memory_order_acquire)) {
+      continue;
+    }
+    auto [it, is_inserted] = thread_names.try_emplace(sample.tid);
+    if (is_inserted) {
+      it->second = get_thread_name(sample.tid);
+    }
+    // folded stack は根元から ; で区切って並べる. 関数名の ; は区切りと区別できないので置き換える
+    std::string stack = it->second;
+    for (int d = sample.depth - 1; d >= SKIPPED_FRAMES; --d) {
+      auto* frame = sample.frames[static_cast<std::size_t>(d)];
+      auto [symbol, is_new] = symbols.try_emplace(frame);
+      if (is_new) {
+        symbol->second = symbolize(frame);
+        std::replace(std::begin(symbol->second), std::end(symbol->second),
+                     ';', ':');
+      }
+      stack += ';';
+      stack += symbol->second;
+    }
+    ++stacks[stack];
+  }
+
+  std::ofstream ofs(filename, std::ios_base::trunc);
+  for (const auto& [stack, count] : stacks) {
+    ofs << stack << ' ' << count << '\n';
+  }
+  if (!ofs) {
+    spdlog::error("writing profile failed: {}", filename);
+    return;
+  }
+  spdlog::info("profile: file={} samples={} dropped={}", filename,
+               number_of_samples, g_number_of_dropped_samples.load());
+}
+
+}  // namespace
+
+Session::Session(const SessionParameters& params)
+    : m_filename(params.filename) {
+  if (m_filename == "") {
+    return;
+  }
+  if (g_has_session.exchange(true)) {
+    spdlog::warn("profiler is already running. {} is not written",
+                 m_filename);
+    return;
+  }
+
+  // backtrace() は最初の呼び出しでライブラリを読み込むので, シグナルハンドラーの外で済ませる
+  std::array<void*, 1> frames;
+  ::backtrace(frames.data(), 1);
+
+  // 止めた後も届いたシグナルの処理が残っているかもしれないので, 領域は解放せずに使い回す
+  static auto* const samples = new Sample[MAX_SAMPLES];
+  for (std::size_t i = 0; i < MAX_SAMPLES; ++i) {
+    samples[i].is_ready = false;
+  }
+  g_number_of_samples = 0;
+  g_number_of_dropped_samples = 0;
+  g_samples.store(samples, std::memory_order_release);
+  // 採取できなくても合成は続ける
+  try {
+    set_signal_handler(SIGPROF, handle_sigprof);
+    if (params.on_signal) {
+      set_signal_handler(SIGUSR2, handle_sigusr2);
+      spdlog::info(
+          "profiler: send SIGUSR2 to pid {} to start or stop sampling",
+          ::getpid());
+    } else {
+      g_is_sampling = true;
+    }
+    set_timer(params.frequency);
+  } catch (const std::exception& e) {
+    spdlog::error("starting profiler failed: {}", e.what());
+    g_is_sampling = false;
+    g_samples = nullptr;
+    g_has_session = false;
+    return;
+  }
+  m_is_started = true;
+}
+
+Session::~Session() {
+  if (!m_is_started) {
+    return;
+  }
+  g_is_sampling = false;
+  try {
+    set_timer(0);
+  } catch (const std::exception& e) {
+    spdlog::error("{}", e.what());
+  }
+  // 止める前に届いたシグナルの処理が書き込み中かもしれないので, is_ready が立ったものだけを読む
+  auto* samples = g_samples.exchange(nullptr);
+  dump(m_filename, samples);
+  g_has_session = false;
+}
+
+std::string get_job_filename(const std::string& filename,
+                             const std::size_t index) {
+  if (filename == "") {
+    return "";
+  }
+  const std::filesystem::path path(filename);
+  return (path.parent_path() /
+          fmt::format("{}_{}{}", path.stem().string(), index,
+                      path.extension().string()))
+      .string();
+}
+
+}  // namespace hisui::util::profiler
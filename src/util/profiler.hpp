@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hisui::util::profiler {
+
+struct SessionParameters {
+  const std::string& filename;
+  const std::uint32_t frequency = 99;
+  // true ならば SIGUSR2 を受け取るたびに採取を始めたり止めたりする
+  const bool on_signal = false;
+};
+
+// filename が空でなければ, SIGPROF で全スレッドのスタックを CPU 時間に比例して採取し,
+// 破棄する際に flamegraph.pl などで読める folded stack の形式で書き出す.
+// 同時に 1 つのみ作れる
+class Session {
+ public:
+  explicit Session(const SessionParameters&);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+ private:
+  std::string m_filename;
+  bool m_is_started = false;
+};
+
+// --batch の job ごとの出力ファイル名. filename が空ならば空を返す
+std::string get_job_filename(const std::string& filename,
+                             const std::size_t index);
+
+}  // namespace hisui::util::profiler
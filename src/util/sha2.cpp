@@ -0,0 +1,139 @@
+#include "util/sha2.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace hisui::util {
+
+namespace {
+
+constexpr std::array<std::uint32_t, 64> K = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr std::array<std::uint32_t, 8> SHA224_INITIAL_STATE = {
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+    0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4};
+
+constexpr std::array<std::uint32_t, 8> SHA256_INITIAL_STATE = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+constexpr std::uint32_t rotr(const std::uint32_t x, const int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+}  // namespace
+
+SHA2::SHA2(const SHA2Type t_type)
+    : m_type(t_type),
+      m_state(t_type == SHA2Type::SHA224 ? SHA224_INITIAL_STATE
+                                         : SHA256_INITIAL_STATE) {}
+
+void SHA2::update(const void* data, const std::size_t size) {
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  auto remaining = size;
+  m_total_size += size;
+  if (m_block_size > 0) {
+    const auto n = std::min(remaining, std::size(m_block) - m_block_size);
+    std::memcpy(std::data(m_block) + m_block_size, p, n);
+    m_block_size += n;
+    p += n;
+    remaining -= n;
+    if (m_block_size < std::size(m_block)) {
+      return;
+    }
+    transform(std::data(m_block));
+    m_block_size = 0;
+  }
+  // 溜めずに済む分は与えられたデータから直接計算する
+  while (remaining >= std::size(m_block)) {
+    transform(p);
+    p += std::size(m_block);
+    remaining -= std::size(m_block);
+  }
+  std::memcpy(std::data(m_block), p, remaining);
+  m_block_size = remaining;
+}
+
+std::string SHA2::finalize() {
+  const auto bit_size = m_total_size * 8;
+  m_block[m_block_size++] = 0x80;
+  if (m_block_size > 56) {
+    std::fill(std::begin(m_block) + static_cast<std::ptrdiff_t>(m_block_size),
+              std::end(m_block), 0);
+    transform(std::data(m_block));
+    m_block_size = 0;
+  }
+  std::fill(std::begin(m_block) + static_cast<std::ptrdiff_t>(m_block_size),
+            std::begin(m_block) + 56, 0);
+  for (std::size_t i = 0; i < 8; ++i) {
+    m_block[56 + i] = static_cast<std::uint8_t>(bit_size >> (56 - 8 * i));
+  }
+  transform(std::data(m_block));
+
+  const std::size_t words = m_type == SHA2Type::SHA224 ? 7 : 8;
+  std::string digest;
+  for (std::size_t i = 0; i < words; ++i) {
+    digest += fmt::format("{:08x}", m_state[i]);
+  }
+  return digest;
+}
+
+void SHA2::transform(const std::uint8_t* block) {
+  std::array<std::uint32_t, 64> w;
+  for (std::size_t i = 0; i < 16; ++i) {
+    w[i] = static_cast<std::uint32_t>(block[i * 4]) << 24 |
+           static_cast<std::uint32_t>(block[i * 4 + 1]) << 16 |
+           static_cast<std::uint32_t>(block[i * 4 + 2]) << 8 |
+           static_cast<std::uint32_t>(block[i * 4 + 3]);
+  }
+  for (std::size_t i = 16; i < 64; ++i) {
+    const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  auto [a, b, c, d, e, f, g, h] = m_state;
+  for (std::size_t i = 0; i < 64; ++i) {
+    const auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    const auto ch = (e & f) ^ (~e & g);
+    const auto t1 = h + s1 + ch + K[i] + w[i];
+    const auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    const auto maj = (a & b) ^ (a & c) ^ (b & c);
+    const auto t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  m_state[0] += a;
+  m_state[1] += b;
+  m_state[2] += c;
+  m_state[3] += d;
+  m_state[4] += e;
+  m_state[5] += f;
+  m_state[6] += g;
+  m_state[7] += h;
+}
+
+}  // namespace hisui::util
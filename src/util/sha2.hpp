@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hisui::util {
+
+enum class SHA2Type {
+  SHA224,
+  SHA256,
+};
+
+// SHA-224 と SHA-256 を少しずつ与えたデータから計算する
+class SHA2 {
+ public:
+  explicit SHA2(const SHA2Type);
+
+  void update(const void*, const std::size_t);
+  // 16 進数の小文字で返す. 呼んだ後は update() できない
+  std::string finalize();
+
+ private:
+  SHA2Type m_type;
+  std::array<std::uint32_t, 8> m_state;
+  std::array<std::uint8_t, 64> m_block;
+  std::size_t m_block_size = 0;
+  std::uint64_t m_total_size = 0;
+
+  void transform(const std::uint8_t*);
+};
+
+}  // namespace hisui::util
@@ -0,0 +1,126 @@
+#include "util/thread_pool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "util/cgroup.hpp"
+
+namespace hisui::util {
+
+ThreadPool::ThreadPool(const std::size_t number_of_workers) {
+  m_workers.reserve(number_of_workers);
+  for (std::size_t i = 0; i < number_of_workers; ++i) {
+    m_workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_stopped = true;
+  }
+  m_cv_task.notify_all();
+  for (auto& w : m_workers) {
+    w.join();
+  }
+}
+
+void ThreadPool::parallelFor(
+    const std::size_t size,
+    const std::function<void(const std::size_t)>& task) {
+  if (size == 0) {
+    return;
+  }
+  if (std::empty(m_workers) || size == 1) {
+    for (std::size_t i = 0; i < size; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  Job job{.task = &task, .size = size, .remaining = size};
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_jobs.push_back(&job);
+  m_cv_task.notify_all();
+
+  // 呼び出し元は自分の job のみを処理する. 他の job を手伝うと, その分戻るのが遅れる
+  while (job.next < job.size) {
+    runTask(&job, &lock);
+  }
+  m_cv_done.wait(lock, [&job] { return job.remaining == 0; });
+  if (job.exception) {
+    std::rethrow_exception(job.exception);
+  }
+}
+
+std::size_t ThreadPool::getNumberOfWorkers() const {
+  return std::size(m_workers);
+}
+
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cv_task.wait(lock,
+                   [this] { return m_is_stopped || !std::empty(m_jobs); });
+    if (m_is_stopped) {
+      return;
+    }
+    runTask(m_jobs.front(), &lock);
+  }
+}
+
+void ThreadPool::runTask(Job* job, std::unique_lock<std::mutex>* lock) {
+  const auto index = job->next++;
+  if (job->next == job->size) {
+    m_jobs.erase(std::find(std::begin(m_jobs), std::end(m_jobs), job));
+  }
+  lock->unlock();
+
+  std::exception_ptr exception;
+  try {
+    (*job->task)(index);
+  } catch (...) {
+    exception = std::current_exception();
+  }
+
+  lock->lock();
+  if (exception && !job->exception) {
+    job->exception = exception;
+  }
+  if (--job->remaining == 0) {
+    m_cv_done.notify_all();
+  }
+}
+
+std::shared_ptr<ThreadPool> get_shared_thread_pool(
+    const std::size_t number_of_workers) {
+  static std::mutex mutex;
+  static std::map<std::size_t, std::weak_ptr<ThreadPool>> pools;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& pool = pools[number_of_workers];
+  if (auto p = pool.lock()) {
+    return p;
+  }
+  auto p = std::make_shared<ThreadPool>(number_of_workers);
+  pool = p;
+  return p;
+}
+
+void parallel_for(const std::size_t size,
+                  const std::function<void(const std::size_t)>& task) {
+  const std::size_t number_of_threads = std::min<std::size_t>(
+      size, get_number_of_usable_cpus());
+  // 呼び出し元のスレッドも処理に加わるので, ワーカーは 1 つ少なくてよい
+  ThreadPool thread_pool(number_of_threads > 0 ? number_of_threads - 1 : 0);
+  thread_pool.parallelFor(size, task);
+}
+
+}  // namespace hisui::util
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hisui::util {
+
+// 常駐するワーカースレッドで処理を分担する.
+// parallelFor() の呼び出し元スレッドも処理に加わる.
+// 複数のスレッドから同時に, また task の中から入れ子にも parallelFor() を呼べる.
+// 空いたワーカーは待っている処理のうち最も古いものを手伝う
+class ThreadPool {
+ public:
+  explicit ThreadPool(const std::size_t number_of_workers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // [0, size) の各 index について task(index) を実行し, すべて終わるまで待つ.
+  // task が例外を投げた場合は最初の例外を再送出する
+  void parallelFor(const std::size_t size,
+                   const std::function<void(const std::size_t)>& task);
+
+  std::size_t getNumberOfWorkers() const;
+
+ private:
+  struct Job {
+    const std::function<void(const std::size_t)>* task;
+    std::size_t size;
+    std::size_t next = 0;
+    std::size_t remaining;
+    std::exception_ptr exception = nullptr;
+  };
+
+  void work();
+  // m_mutex を取った状態で呼び, job の index を 1 つ処理する
+  void runTask(Job*, std::unique_lock<std::mutex>*);
+
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv_task;
+  std::condition_variable m_cv_done;
+
+  // まだ処理を始めていない index が残っている job. 古い順に並べる.
+  // 同時に並ぶ job は少なく, parallelFor() のたびに確保しないよう vector で持つ
+  std::vector<Job*> m_jobs;
+  bool m_is_stopped = false;
+};
+
+// 同じ number_of_workers に対しては, 使われている間は同じ ThreadPool を返す.
+// --video-encode-segments のように合成が同時に進む場合に,
+// それぞれが別にスレッドを作って CPU の数より多くならないようにする
+std::shared_ptr<ThreadPool> get_shared_thread_pool(
+    const std::size_t number_of_workers);
+
+// 一度きりの処理のために一時的な ThreadPool を作り, [0, size) を並列に処理する.
+// 起動時のファイルの解析などに使う
+void parallel_for(const std::size_t size,
+                  const std::function<void(const std::size_t)>& task);
+
+}  // namespace hisui::util
@@ -0,0 +1,125 @@
+#include "util/trace.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hisui::util::trace {
+
+namespace {
+
+// スレッドごとに記録できるイベントの数. 溢れた場合は古いものから上書きする
+constexpr std::size_t RING_SIZE = 1 << 15;
+
+struct Event {
+  const char* name;
+  std::uint64_t begin;
+  std::uint64_t end;
+};
+
+// 書き込むのは持ち主のスレッドだけなので, 記録の際にロックは取らない
+struct ThreadBuffer {
+  std::vector<Event> events = std::vector<Event>(RING_SIZE);
+  std::atomic<std::uint64_t> count = 0;
+  std::size_t thread_id = 0;
+};
+
+std::atomic<bool> g_is_enabled = false;
+std::mutex g_mutex;
+// スレッドが終了した後も書き出せるよう, ここでも保持する
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+
+ThreadBuffer* get_thread_buffer() {
+  thread_local const std::shared_ptr<ThreadBuffer> buffer = [] {
+    auto b = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> lock(g_mutex);
+    b->thread_id = std::size(g_buffers) + 1;
+    g_buffers.push_back(b);
+    return b;
+  }();
+  return buffer.get();
+}
+
+void dump(const std::string& filename) {
+  std::FILE* fp = std::fopen(filename.c_str(), "w");
+  if (fp == nullptr) {
+    spdlog::error("Unable to open: {}", filename);
+    return;
+  }
+  const auto pid = ::getpid();
+  fmt::print(fp, "{{\"traceEvents\":[");
+  bool is_first = true;
+  std::size_t number_of_events = 0;
+  std::lock_guard<std::mutex> lock(g_mutex);
+  for (const auto& b : g_buffers) {
+    const auto count = b->count.load(std::memory_order_acquire);
+    for (auto i = count - std::min<std::uint64_t>(count, RING_SIZE);
+         i < count; ++i) {
+      const auto& e = b->events[i % RING_SIZE];
+      fmt::print(fp,
+                 "{}\n{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},"
+                 "\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                 is_first ? "" : ",", e.name,
+                 static_cast<double>(e.begin) / 1000,
+                 static_cast<double>(e.end - e.begin) / 1000, pid,
+                 b->thread_id);
+      is_first = false;
+      ++number_of_events;
+    }
+  }
+  fmt::print(fp, "\n]}}\n");
+  if (std::fclose(fp) != 0) {
+    spdlog::error("writing trace failed: {}", filename);
+    return;
+  }
+  spdlog::info("trace: file={} events={}", filename, number_of_events);
+}
+
+}  // namespace
+
+bool isEnabled() {
+  return g_is_enabled.load(std::memory_order_relaxed);
+}
+
+std::uint64_t now() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+void record(const char* name,
+            const std::uint64_t begin,
+            const std::uint64_t end) {
+  auto* b = get_thread_buffer();
+  const auto count = b->count.load(std::memory_order_relaxed);
+  b->events[count % RING_SIZE] = {.name = name, .begin = begin, .end = end};
+  b->count.store(count + 1, std::memory_order_release);
+}
+
+Session::Session(const std::string& t_filename) : m_filename(t_filename) {
+  if (m_filename != "") {
+    g_is_enabled = true;
+  }
+}
+
+Session::~Session() {
+  if (m_filename == "") {
+    return;
+  }
+  g_is_enabled = false;
+  dump(m_filename);
+}
+
+}  // namespace hisui::util::trace
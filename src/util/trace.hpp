@@ -0,0 +1,62 @@
+#pragma once
+
+// USE_TRACE を有効にしてビルドした場合のみ HISUI_TRACE_SCOPE() で区間を記録する.
+// 無効な場合は何も生成しないので, 処理の中に残しておいてよい
+
+#ifdef USE_TRACE
+
+#include <cstdint>
+#include <string>
+
+namespace hisui::util::trace {
+
+bool isEnabled();
+std::uint64_t now();
+// name は文字列リテラルなど, 書き出すまで残るものを渡す
+void record(const char*, const std::uint64_t, const std::uint64_t);
+
+// filename が空でなければ記録を始め, 破棄する際に Chrome の trace event format
+// (chrome://tracing や Perfetto で開ける JSON) で書き出す
+class Session {
+ public:
+  explicit Session(const std::string&);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+ private:
+  std::string m_filename;
+};
+
+class Scope {
+ public:
+  explicit Scope(const char* t_name)
+      : m_name(t_name), m_begin(isEnabled() ? now() : 0) {}
+  ~Scope() {
+    if (m_begin != 0) {
+      record(m_name, m_begin, now());
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  const char* m_name;
+  std::uint64_t m_begin;
+};
+
+}  // namespace hisui::util::trace
+
+#define HISUI_TRACE_CONCAT_INNER(a, b) a##b
+#define HISUI_TRACE_CONCAT(a, b) HISUI_TRACE_CONCAT_INNER(a, b)
+#define HISUI_TRACE_SCOPE(name)                                      \
+  const ::hisui::util::trace::Scope HISUI_TRACE_CONCAT(hisui_trace_, \
+                                                       __LINE__)(name)
+
+#else
+
+#define HISUI_TRACE_SCOPE(name) static_cast<void>(0)
+
+#endif
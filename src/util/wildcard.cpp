@@ -1,46 +1,50 @@
 #include "util/wildcard.hpp"
 
-// based on https://github.com/richsalz/wildmat
+#include <cstddef>
+#include <string>
+#include <string_view>
 
-namespace {
+namespace hisui::util {
 
-bool match(const char* text, const char* p) {
-  for (; *p; text++, p++) {
-    if (*text == '\0' && *p != '*') {
-      return false;
-    }
-    switch (*p) {
-      case '*':
-        while (*++p == '*') {
-          continue;
-        }
-        if (*p == '\0') {
-          return true;
-        }
-        while (*text) {
-          if (match(text++, p)) {
-            return true;
-          }
-        }
-        return false;
-      default:
-        if (*text != *p) {
-          return false;
-        }
+bool wildcard_match(const WildcardMatchParameters& params) {
+  return WildcardPattern(params.pattern).match(params.text);
+}
+
+WildcardPattern::WildcardPattern(const std::string& pattern) {
+  std::size_t begin = 0;
+  while (true) {
+    const auto end = pattern.find('*', begin);
+    if (end == std::string::npos) {
+      m_segments.push_back(pattern.substr(begin));
+      break;
     }
+    m_segments.push_back(pattern.substr(begin, end - begin));
+    begin = end + 1;
   }
-  return *text == '\0';
 }
 
-}  // namespace
-
-namespace hisui::util {
-
-bool wildcard_match(const WildcardMatchParameters& params) {
-  if (params.pattern == "*") {
-    return true;
+bool WildcardPattern::match(const std::string_view text) const {
+  const auto& first = m_segments.front();
+  if (std::size(m_segments) == 1) {
+    return text == first;
+  }
+  const auto& last = m_segments.back();
+  if (std::size(text) < std::size(first) + std::size(last) ||
+      !text.starts_with(first) || !text.ends_with(last)) {
+    return false;
+  }
+  // 先頭と末尾の間で, 残りの断片をそれぞれ最も左で見つければよい
+  auto rest = text.substr(std::size(first),
+                          std::size(text) - std::size(first) - std::size(last));
+  for (std::size_t i = 1; i + 1 < std::size(m_segments); ++i) {
+    const auto& segment = m_segments[i];
+    const auto pos = rest.find(segment);
+    if (pos == std::string_view::npos) {
+      return false;
+    }
+    rest.remove_prefix(pos + std::size(segment));
   }
-  return match(params.text.c_str(), params.pattern.c_str());
+  return true;
 }
 
 }  // namespace hisui::util
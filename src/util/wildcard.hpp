@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace hisui::util {
 
@@ -11,4 +13,17 @@ struct WildcardMatchParameters {
 
 bool wildcard_match(const WildcardMatchParameters&);
 
+// '*' だけを特別扱いするパターン. '*' で区切った断片に分けておくことで,
+// 同じパターンで多くの文字列を調べる時に毎回パターンを解析せず, 再帰もしない
+class WildcardPattern {
+ public:
+  explicit WildcardPattern(const std::string&);
+
+  bool match(const std::string_view) const;
+
+ private:
+  // '*' が無い場合は 1 つ
+  std::vector<std::string> m_segments;
+};
+
 }  // namespace hisui::util
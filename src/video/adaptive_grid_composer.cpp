@@ -0,0 +1,103 @@
+#include "video/adaptive_grid_composer.hpp"
+
+#include <libyuv/scale.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "config.hpp"
+#include "video/grid_composer.hpp"
+#include "video/parallel_grid_composer.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+// composer ごとに測るフレームの数
+constexpr std::size_t MEASURED_FRAMES = 15;
+
+// 1 つ増減するたびに測り直さないよう, 2 倍以上かつ 2 つ以上変わった場合のみ測り直す
+bool is_changed_significantly(const std::size_t a, const std::size_t b) {
+  const auto [lower, upper] = std::minmax(a, b);
+  return upper >= 2 * lower && upper - lower >= 2;
+}
+
+}  // namespace
+
+AdaptiveGridComposer::AdaptiveGridComposer(
+    const std::uint32_t single_width,
+    const std::uint32_t single_height,
+    const std::size_t size,
+    const std::size_t column,
+    const hisui::config::VideoScaler& scaler_type,
+    const libyuv::FilterMode filter_mode,
+    const std::size_t threads) {
+  m_composers[0] =
+      std::make_unique<GridComposer>(single_width, single_height, size,
+                                     column, scaler_type, filter_mode);
+  if (threads > 1 && size > 1) {
+    m_composers[1] = std::make_unique<ParallelGridComposer>(
+        single_width, single_height, size, column, scaler_type, filter_mode,
+        threads);
+  } else {
+    // 並列化できないので測らない
+    m_selected = m_composers[0].get();
+  }
+  m_width = m_composers[0]->getWidth();
+  m_height = m_composers[0]->getHeight();
+}
+
+void AdaptiveGridComposer::compose(
+    std::vector<unsigned char>* composed,
+    const std::vector<std::shared_ptr<YUVImage>>& images) {
+  const auto number_of_sources = static_cast<std::size_t>(
+      std::count_if(std::begin(images), std::end(images),
+                    [](const auto& image) { return image != nullptr; }));
+  if (m_selected != nullptr && m_composers[1] &&
+      is_changed_significantly(number_of_sources, m_measured_sources)) {
+    spdlog::debug("AdaptiveGridComposer: sources changed from {} to {}",
+                  m_measured_sources, number_of_sources);
+    m_selected = nullptr;
+    m_number_of_measured_frames = 0;
+    m_elapsed = {};
+  }
+  if (m_selected != nullptr) {
+    m_selected->compose(composed, images);
+    return;
+  }
+  // 黒いフレームの合成は速さの比較にならない
+  if (number_of_sources == 0) {
+    m_composers[0]->compose(composed, images);
+    return;
+  }
+
+  const auto index = m_number_of_measured_frames % 2;
+  const auto start = std::chrono::steady_clock::now();
+  m_composers[index]->compose(composed, images);
+  m_elapsed[index] += std::chrono::steady_clock::now() - start;
+  if (++m_number_of_measured_frames < 2 * MEASURED_FRAMES) {
+    return;
+  }
+
+  const std::size_t selected = m_elapsed[1] < m_elapsed[0] ? 1 : 0;
+  m_selected = m_composers[selected].get();
+  m_measured_sources = number_of_sources;
+  spdlog::debug(
+      "AdaptiveGridComposer: selected {}: sources={} grid={}us "
+      "parallel_grid={}us",
+      selected == 1 ? "parallel-grid" : "grid", number_of_sources,
+      std::chrono::duration_cast<std::chrono::microseconds>(m_elapsed[0])
+              .count() /
+          static_cast<long>(MEASURED_FRAMES),
+      std::chrono::duration_cast<std::chrono::microseconds>(m_elapsed[1])
+              .count() /
+          static_cast<long>(MEASURED_FRAMES));
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <libyuv/scale.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "config.hpp"
+#include "video/composer.hpp"
+
+namespace hisui::video {
+
+class YUVImage;
+
+// GridComposer と ParallelGridComposer で交互に合成して時間を測り, 速い方を使う.
+// 表示中の source の数が大きく変わったら測り直す
+class AdaptiveGridComposer : public Composer {
+ public:
+  AdaptiveGridComposer(const std::uint32_t,
+                       const std::uint32_t,
+                       const std::size_t,
+                       const std::size_t,
+                       const hisui::config::VideoScaler&,
+                       const libyuv::FilterMode,
+                       const std::size_t threads = 0);
+
+  void compose(std::vector<unsigned char>*,
+               const std::vector<std::shared_ptr<YUVImage>>&) override;
+
+ private:
+  // 0: GridComposer, 1: ParallelGridComposer
+  std::array<std::unique_ptr<Composer>, 2> m_composers;
+  std::array<std::chrono::steady_clock::duration, 2> m_elapsed = {};
+  std::size_t m_number_of_measured_frames = 0;
+  // 測り終えるまでは nullptr
+  Composer* m_selected = nullptr;
+  // 測り終えた時の表示中の source の数
+  std::size_t m_measured_sources = 0;
+};
+
+}  // namespace hisui::video
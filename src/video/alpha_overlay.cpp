@@ -0,0 +1,275 @@
+#include "video/alpha_overlay.hpp"
+
+// AVX2 の版も作るので, SSE2 のみの emmintrin.h ではなく immintrin.h を使う
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/cpu_dispatch.hpp"
+#include "video/yuv.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+// x / 255 を丸めたもの. x <= 255 * 255 で正確
+inline std::uint32_t divide_by_255(const std::uint32_t x) {
+  const std::uint32_t t = x + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+#if defined(HISUI_CPU_DISPATCH_X86)
+// blend_premultiplied() の SSE2 の処理を 32 画素ずつ行い, 処理した数を返す.
+// unpack と pack は 128 bit の lane ごとに対応するので, 並びは変わらない
+__attribute__((target("avx2"))) std::size_t blend_premultiplied_avx2(
+    std::uint8_t* dst,
+    const std::uint8_t* premultiplied,
+    const std::uint8_t* transparency,
+    const std::size_t size) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi16(128);
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i d =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i p = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(premultiplied + i));
+    const __m256i a = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(transparency + i));
+    __m256i lo = _mm256_add_epi16(
+        _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero),
+                           _mm256_unpacklo_epi8(a, zero)),
+        half);
+    __m256i hi = _mm256_add_epi16(
+        _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero),
+                           _mm256_unpackhi_epi8(a, zero)),
+        half);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), p));
+  }
+  return i;
+}
+#endif
+
+}  // namespace
+
+void blend_premultiplied(std::uint8_t* dst,
+                         const std::uint8_t* premultiplied,
+                         const std::uint8_t* transparency,
+                         const std::size_t size) {
+  std::size_t i = 0;
+#if defined(HISUI_CPU_DISPATCH_X86)
+  if (hisui::util::has_avx2()) {
+    i = blend_premultiplied_avx2(dst, premultiplied, transparency, size);
+  }
+#endif
+  // divide_by_255() と同じ計算を 16 bit で行う
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  for (; i + 16 <= size; i += 16) {
+    const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    const __m128i p =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(premultiplied + i));
+    const __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(transparency + i));
+    __m128i lo = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero)),
+        half);
+    __m128i hi = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero)),
+        half);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_adds_epu8(_mm_packus_epi16(lo, hi), p));
+  }
+#elif defined(__ARM_NEON)
+  const uint16x8_t half = vdupq_n_u16(128);
+  for (; i + 8 <= size; i += 8) {
+    const uint16x8_t t = vaddq_u16(
+        vmull_u8(vld1_u8(dst + i), vld1_u8(transparency + i)), half);
+    const uint8x8_t r = vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+    vst1_u8(dst + i, vqadd_u8(r, vld1_u8(premultiplied + i)));
+  }
+#endif
+  for (; i < size; ++i) {
+    dst[i] = static_cast<std::uint8_t>(std::min<std::uint32_t>(
+        premultiplied[i] + divide_by_255(static_cast<std::uint32_t>(dst[i]) *
+                                         transparency[i]),
+        255));
+  }
+}
+
+AlphaOverlay::AlphaOverlay(const std::array<const std::uint8_t*, 3>& planes,
+                           const std::array<std::uint32_t, 3>& strides,
+                           const std::uint8_t* alpha,
+                           const std::uint32_t alpha_stride,
+                           const std::uint32_t width,
+                           const std::uint32_t height)
+    : m_width(width), m_height(height) {
+  for_each_i420_plane([&](const auto i420_plane) {
+    using I420 = decltype(i420_plane);
+    const auto p = I420::index;
+    auto& plane = m_planes[p];
+    plane.width = I420::ceil(width);
+    plane.height = I420::ceil(height);
+    const auto size = static_cast<std::size_t>(plane.width) * plane.height;
+    plane.premultiplied.resize(size);
+    plane.transparency.resize(size);
+
+    for (std::uint32_t y = 0; y < plane.height; ++y) {
+      std::uint32_t x_begin = 0;
+      bool in_span = false;
+      for (std::uint32_t x = 0; x < plane.width; ++x) {
+        std::uint32_t a;
+        if constexpr (I420::shift == 0) {
+          a = alpha[y * alpha_stride + x];
+        } else {
+          // 幅や高さが奇数の場合は, 画像の内側の画素だけの平均とする
+          const auto x0 = 2 * x;
+          const auto y0 = 2 * y;
+          const auto x1 = std::min(x0 + 1, width - 1);
+          const auto y1 = std::min(y0 + 1, height - 1);
+          a = (static_cast<std::uint32_t>(alpha[y0 * alpha_stride + x0]) +
+               alpha[y0 * alpha_stride + x1] + alpha[y1 * alpha_stride + x0] +
+               alpha[y1 * alpha_stride + x1] + 2) >>
+              2;
+        }
+        const auto i = static_cast<std::size_t>(y) * plane.width + x;
+        plane.premultiplied[i] = static_cast<std::uint8_t>(
+            divide_by_255(planes[p][y * strides[p] + x] * a));
+        plane.transparency[i] = static_cast<std::uint8_t>(255 - a);
+
+        if (a != 0 && !in_span) {
+          x_begin = x;
+          in_span = true;
+        } else if (a == 0 && in_span) {
+          plane.spans.push_back({.y = y, .x_begin = x_begin, .x_end = x});
+          in_span = false;
+        }
+      }
+      if (in_span) {
+        plane.spans.push_back(
+            {.y = y, .x_begin = x_begin, .x_end = plane.width});
+      }
+    }
+  });
+
+  // U と V の alpha は同じなので, 区間は色差のものを 2 倍にすればよい
+  const auto& u = m_planes[1];
+  const auto& v = m_planes[2];
+  m_uv_plane.width = u.width * 2;
+  m_uv_plane.height = u.height;
+  const auto uv_size = std::size(u.premultiplied) * 2;
+  m_uv_plane.premultiplied.resize(uv_size);
+  m_uv_plane.transparency.resize(uv_size);
+  for (std::size_t i = 0; i < std::size(u.premultiplied); ++i) {
+    m_uv_plane.premultiplied[2 * i] = u.premultiplied[i];
+    m_uv_plane.premultiplied[2 * i + 1] = v.premultiplied[i];
+    m_uv_plane.transparency[2 * i] = u.transparency[i];
+    m_uv_plane.transparency[2 * i + 1] = v.transparency[i];
+  }
+  for (const auto& span : u.spans) {
+    m_uv_plane.spans.push_back({.y = span.y,
+                                .x_begin = span.x_begin * 2,
+                                .x_end = span.x_end * 2});
+  }
+}
+
+void AlphaOverlay::blendPlane(const Plane& plane,
+                              unsigned char* dst,
+                              const std::uint32_t stride,
+                              const std::uint32_t width,
+                              const std::uint32_t height,
+                              const std::uint32_t x,
+                              const std::uint32_t y,
+                              const std::uint32_t row_begin,
+                              const std::uint32_t row_end) {
+  if (x >= width) {
+    return;
+  }
+  const auto end = std::min(height, row_end);
+  for (const auto& span : plane.spans) {
+    if (y + span.y >= end) {
+      break;
+    }
+    if (y + span.y < row_begin) {
+      continue;
+    }
+    const auto x_end = std::min(span.x_end, width - x);
+    if (span.x_begin >= x_end) {
+      continue;
+    }
+    const auto offset =
+        static_cast<std::size_t>(span.y) * plane.width + span.x_begin;
+    blend_premultiplied(
+        dst + static_cast<std::size_t>(y + span.y) * stride + x + span.x_begin,
+        plane.premultiplied.data() + offset,
+        plane.transparency.data() + offset, x_end - span.x_begin);
+  }
+}
+
+void AlphaOverlay::blend(const std::array<unsigned char*, 3>& planes,
+                         const std::uint32_t base_width,
+                         const std::uint32_t base_height,
+                         const std::uint32_t x,
+                         const std::uint32_t y,
+                         const std::uint32_t row_begin,
+                         const std::uint32_t row_end) const {
+  for_each_i420_plane([&](const auto i420_plane) {
+    using I420 = decltype(i420_plane);
+    const auto width = I420::floor(base_width);
+    blendPlane(m_planes[I420::index], planes[I420::index], width, width,
+               I420::floor(base_height), I420::floor(x), I420::floor(y),
+               I420::floor(row_begin),
+               I420::ceil(std::min(row_end, base_height)));
+  });
+}
+
+void AlphaOverlay::blendNV12(unsigned char* y_plane,
+                             unsigned char* uv_plane,
+                             const std::uint32_t base_width,
+                             const std::uint32_t base_height,
+                             const std::uint32_t x,
+                             const std::uint32_t y,
+                             const std::uint32_t row_begin,
+                             const std::uint32_t row_end) const {
+  using Chroma = I420Plane<1>;
+  blendPlane(m_planes[0], y_plane, base_width, base_width, base_height, x, y,
+             row_begin, row_end);
+  blendPlane(m_uv_plane, uv_plane, base_width, Chroma::floor(base_width) * 2,
+             Chroma::floor(base_height), Chroma::floor(x) * 2,
+             Chroma::floor(y), Chroma::floor(row_begin),
+             Chroma::ceil(std::min(row_end, base_height)));
+}
+
+std::uint32_t AlphaOverlay::getWidth() const {
+  return m_width;
+}
+
+std::uint32_t AlphaOverlay::getHeight() const {
+  return m_height;
+}
+
+std::size_t AlphaOverlay::getNumberOfBlendedPixels() const {
+  std::size_t n = 0;
+  for (const auto& plane : m_planes) {
+    for (const auto& span : plane.spans) {
+      n += span.x_end - span.x_begin;
+    }
+  }
+  return n;
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace hisui::video {
+
+// i < size について dst[i] = premultiplied[i] + dst[i] * transparency[i] / 255
+// とする. 255 での除算は丸めて行う
+void blend_premultiplied(std::uint8_t* dst,
+                         const std::uint8_t* premultiplied,
+                         const std::uint8_t* transparency,
+                         const std::size_t size);
+
+// 透過のある画像を I420 の画像に重ねる.
+// 不透明度を掛けた YUV と透過度 (255 - alpha) を plane ごとに予め求めておき,
+// 透明でない画素の行ごとの区間だけを合成する
+class AlphaOverlay {
+ public:
+  // I420 の各 plane と, 輝度と同じ解像度の alpha から作る.
+  // 色差の alpha は対応する輝度の 2x2 画素の平均とする
+  AlphaOverlay(const std::array<const std::uint8_t*, 3>& planes,
+               const std::array<std::uint32_t, 3>& strides,
+               const std::uint8_t* alpha,
+               const std::uint32_t alpha_stride,
+               const std::uint32_t width,
+               const std::uint32_t height);
+
+  // stride == 幅の I420 の planes の (x, y) に重ねる. はみ出す部分は捨てる.
+  // 輝度の行 [row_begin, row_end) と, それに対応する色差の行だけに書き込む.
+  // row_begin は偶数とする
+  void blend(const std::array<unsigned char*, 3>& planes,
+             const std::uint32_t base_width,
+             const std::uint32_t base_height,
+             const std::uint32_t x,
+             const std::uint32_t y,
+             const std::uint32_t row_begin = 0,
+             const std::uint32_t row_end =
+                 std::numeric_limits<std::uint32_t>::max()) const;
+  // blend() の NV12 版. uv_plane の stride は base_width とする
+  void blendNV12(unsigned char* y_plane,
+                 unsigned char* uv_plane,
+                 const std::uint32_t base_width,
+                 const std::uint32_t base_height,
+                 const std::uint32_t x,
+                 const std::uint32_t y,
+                 const std::uint32_t row_begin = 0,
+                 const std::uint32_t row_end =
+                     std::numeric_limits<std::uint32_t>::max()) const;
+
+  std::uint32_t getWidth() const;
+  std::uint32_t getHeight() const;
+  // 合成する画素の数. 3 plane の合計
+  std::size_t getNumberOfBlendedPixels() const;
+
+ private:
+  struct Span {
+    std::uint32_t y;
+    std::uint32_t x_begin;
+    std::uint32_t x_end;
+  };
+
+  struct Plane {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::vector<std::uint8_t> premultiplied = {};
+    std::vector<std::uint8_t> transparency = {};
+    // 透明でない画素の区間. y, x_begin の順に並ぶ
+    std::vector<Span> spans = {};
+  };
+
+  std::uint32_t m_width;
+  std::uint32_t m_height;
+  std::array<Plane, 3> m_planes;
+  // U と V を交互に並べた色差. 幅はバイト単位
+  Plane m_uv_plane;
+
+  static void blendPlane(const Plane&,
+                         unsigned char*,
+                         const std::uint32_t stride,
+                         const std::uint32_t width,
+                         const std::uint32_t height,
+                         const std::uint32_t x,
+                         const std::uint32_t y,
+                         const std::uint32_t row_begin,
+                         const std::uint32_t row_end);
+};
+
+}  // namespace hisui::video
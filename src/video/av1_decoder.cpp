@@ -19,7 +19,8 @@ namespace hisui::video {
 
 void set_config(::EbSvtAv1DecConfiguration* config,
                 std::uint32_t width,
-                std::uint32_t height) {
+                std::uint32_t height,
+                std::uint32_t threads) {
   config->operating_point = -1;
   config->output_all_layers = 0;
   config->skip_film_grain = 0;
@@ -38,7 +39,7 @@ void set_config(::EbSvtAv1DecConfiguration* config,
   config->active_channel_count = 1;
   config->stat_report = 0;
 
-  config->threads = 1;
+  config->threads = threads;
   config->num_p_frames = 1;
 }
 
@@ -63,8 +64,8 @@ int set_picture_buffer(::EbSvtIOFormat* pic_buffer,
   return 0;
 }
 
-void update_yuv_image_by_av1_buffer(std::shared_ptr<YUVImage> yuv_image,
-                                    const ::EbSvtIOFormat* buffer) {
+void wrap_yuv_image_by_av1_buffer(std::shared_ptr<YUVImage> yuv_image,
+                                  const ::EbSvtIOFormat* buffer) {
   const auto bytes_per_sample = (buffer->bit_depth == ::EB_EIGHT_BIT) ? 1 : 2;
   if (bytes_per_sample == 2) {
     throw std::runtime_error("bytes_per_sample == 2 is not suppoted");
@@ -74,33 +75,14 @@ void update_yuv_image_by_av1_buffer(std::shared_ptr<YUVImage> yuv_image,
         fmt::format("only EB_YUV420 format is suppoted: {}",
                     static_cast<std::int32_t>(buffer->color_fmt)));
   }
-  auto* buf = buffer->luma;
-  auto s = buffer->y_stride;
-  auto w = buffer->width;
-  auto h = buffer->height;
-
-  yuv_image->setWidthAndHeight(w, h);
-
-  for (std::uint32_t y = 0; y < h; ++y) {
-    std::copy_n(buf + y * s, w, yuv_image->yuv[0] + y * w);
-  }
-
-  buf = buffer->cb;
-  s = buffer->cb_stride;
-  w = (w + 1) >> 1;
-  h = (h + 1) >> 1;
-  for (std::uint32_t y = 0; y < h; ++y) {
-    std::copy_n(buf + y * s, w, yuv_image->yuv[1] + y * w);
-  }
-
-  buf = buffer->cr;
-  s = buffer->cr_stride;
-  for (std::uint32_t y = 0; y < h; ++y) {
-    std::copy_n(buf + y * s, w, yuv_image->yuv[2] + y * w);
-  }
+  // 次の svt_av1_dec_get_picture() まで書き換わらないのでコピーせずに参照する
+  yuv_image->wrap({buffer->luma, buffer->cb, buffer->cr},
+                  {buffer->y_stride, buffer->cb_stride, buffer->cr_stride},
+                  buffer->width, buffer->height);
 }
 
-AV1Decoder::AV1Decoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
+AV1Decoder::AV1Decoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm,
+                       const std::uint32_t threads)
     : Decoder(t_webm) {
   ::EbSvtAv1DecConfiguration config;
   void* app_data = nullptr;
@@ -110,7 +92,7 @@ AV1Decoder::AV1Decoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
         fmt::format("::svt_av1_dec_init_handle() failed: {}",
                     static_cast<std::uint32_t>(err)));
   }
-  set_config(&config, m_width, m_height);
+  set_config(&config, m_width, m_height, threads);
 
   if (auto err = ::svt_av1_dec_set_parameter(m_handle, &config);
       err != ::EB_ErrorNone) {
@@ -200,7 +182,7 @@ AV1Decoder::~AV1Decoder() {
   }
 }
 
-const std::shared_ptr<YUVImage> AV1Decoder::getImage(
+const std::shared_ptr<YUVImage>& AV1Decoder::getImage(
     const std::uint64_t timestamp) {
   // 非対応 WebM or 時間超過
   if (!m_webm || m_is_time_over) {
@@ -229,11 +211,17 @@ void AV1Decoder::updateAV1ImageByTimestamp(const std::uint64_t timestamp) {
   if (m_finished_webm) {
     return;
   }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
 
   do {
     m_current_timestamp = m_next_timestamp;
     if (m_webm->readFrame()) {
-      spdlog::trace("webm->getBufferSize(): {}", m_webm->getBufferSize());
+      SPDLOG_TRACE("webm->getBufferSize(): {}", m_webm->getBufferSize());
+      if (!isDisplayed(timestamp)) {
+        countDroppedFrame();
+      }
+      hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
       if (auto err = ::svt_av1_dec_frame(m_handle, m_webm->getBuffer(),
                                          m_webm->getBufferSize(), 0);
           err != ::EB_ErrorNone) {
@@ -255,7 +243,8 @@ void AV1Decoder::updateAV1ImageByTimestamp(const std::uint64_t timestamp) {
           }
         }
 
-        update_yuv_image_by_av1_buffer(m_current_yuv_image, buffer);
+        wrap_yuv_image_by_av1_buffer(m_current_yuv_image, buffer);
+        m_current_yuv_image->setTimestamp(m_current_timestamp);
       }
       m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
     } else {
@@ -21,11 +21,12 @@ class YUVImage;
 
 class AV1Decoder : public Decoder {
  public:
-  explicit AV1Decoder(std::shared_ptr<hisui::webm::input::VideoContext>);
+  explicit AV1Decoder(std::shared_ptr<hisui::webm::input::VideoContext>,
+                      const std::uint32_t threads = 1);
 
   ~AV1Decoder();
 
-  const std::shared_ptr<YUVImage> getImage(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
 
  private:
   std::uint64_t m_current_timestamp = 0;
@@ -18,8 +18,9 @@
 
 namespace hisui::video {
 
-BasicSequencer::BasicSequencer(
-    const std::vector<hisui::ArchiveItem>& archives) {
+BasicSequencer::BasicSequencer(const std::vector<hisui::ArchiveItem>& archives,
+                               const std::size_t decode_threads,
+                               const std::uint64_t warm_up_time) {
   auto result = make_sequence(archives);
 
   m_sequence = result.sequence;
@@ -32,24 +33,14 @@ BasicSequencer::BasicSequencer(
   spdlog::debug("m_max_width x m_max_height: {} x {}", m_max_width,
                 m_max_height);
 
-  m_black_yuv_image = create_black_yuv_image(m_max_width, m_max_height);
+  setUpTimelines(warm_up_time);
+  setUpThreadPool(decode_threads);
 }  // namespace hisui::video
 
 SequencerGetYUVsResult BasicSequencer::getYUVs(
     std::vector<std::shared_ptr<YUVImage>>* yuvs,
     const std::uint64_t timestamp) {
-  std::size_t i = 0;
-  for (const auto& p : m_sequence) {
-    const auto it = std::find_if(
-        std::begin(*p.second), std::end(*p.second),
-        [timestamp](const auto& s) { return s.second.isIn(timestamp); });
-    if (it == std::end(*p.second)) {
-      (*yuvs)[i] = m_black_yuv_image;
-    } else {
-      (*yuvs)[i] = it->first->getYUV(it->second.getSubstructLower(timestamp));
-    }
-    ++i;
-  }
+  getYUVsOfSequence(yuvs, timestamp);
   return {};
 }
 
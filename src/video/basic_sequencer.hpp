@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -18,13 +19,13 @@ class YUVImage;
 
 class BasicSequencer : public Sequencer {
  public:
-  explicit BasicSequencer(const std::vector<hisui::ArchiveItem>&);
+  // warm_up_time は SourceTimeline と同じ
+  explicit BasicSequencer(const std::vector<hisui::ArchiveItem>&,
+                          const std::size_t decode_threads = 1,
+                          const std::uint64_t warm_up_time = 0);
 
   SequencerGetYUVsResult getYUVs(std::vector<std::shared_ptr<YUVImage>>*,
                                  const std::uint64_t) override;
-
- private:
-  std::shared_ptr<YUVImage> m_black_yuv_image;
 };
 
 }  // namespace hisui::video
@@ -9,16 +9,60 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 #include <boost/rational.hpp>
 
 #include "config.hpp"
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
+#include "util/cpu_affinity.hpp"
 
 namespace hisui::video {
 
+namespace {
+
+// svt_av1_enc_get_packet() は送り終えるまではブロックしないので, この間隔で受け取る
+constexpr std::chrono::milliseconds RECEIVE_INTERVAL(2);
+
+std::int32_t get_av1_preset(const hisui::Config& config) {
+  switch (config.encode_speed) {
+    case hisui::config::EncodeSpeed::Manual:
+      return config.svt_av1_preset;
+    case hisui::config::EncodeSpeed::Quality:
+      return 8;
+    case hisui::config::EncodeSpeed::Fast:
+      return 12;
+    default:
+      // SVT-AV1 は途中で preset を変えられないので adaptive も balanced とする
+      return 10;
+  }
+}
+
+// 2 を底とするタイルの数の対数. 指定がなく 3840 を超える大きさの場合は,
+// タイルを並列にエンコードできるよう 1 つのタイルが 2048 以下になるまで分ける
+std::uint32_t get_av1_tile_log2(const std::uint32_t length,
+                                const std::uint32_t configured,
+                                const std::uint32_t max_log2) {
+  if (configured != 0 || length <= 3840) {
+    return configured;
+  }
+  std::uint32_t log2 = 0;
+  while (log2 < max_log2 && (length >> log2) > 2048) {
+    ++log2;
+  }
+  return log2;
+}
+
+}  // namespace
+
 AV1EncoderConfig::AV1EncoderConfig(const std::uint32_t t_width,
                                    const std::uint32_t t_height,
                                    const hisui::Config& config)
@@ -26,12 +70,27 @@ AV1EncoderConfig::AV1EncoderConfig(const std::uint32_t t_width,
       height(t_height),
       fps(config.out_video_frame_rate),
       fourcc(config.out_video_codec),
-      bitrate(config.out_video_bit_rate) {}
-
-BufferAV1Encoder::BufferAV1Encoder(std::queue<hisui::Frame>* t_buffer,
+      bitrate(config.out_video_bit_rate),
+      preset(get_av1_preset(config)),
+      logical_processors(!std::empty(config.svt_av1_cpus)
+                             ? static_cast<std::uint32_t>(
+                                   std::size(config.svt_av1_cpus))
+                             : config.job_threads),
+      tile_rows(get_av1_tile_log2(t_height, config.svt_av1_tile_rows, 6)),
+      tile_columns(
+          get_av1_tile_log2(t_width, config.svt_av1_tile_columns, 4)),
+      lookahead(config.svt_av1_lookahead),
+      cpus(config.svt_av1_cpus),
+      is_async(config.av1_async_encode),
+      keyframe_interval(config.getVideoKeyframeInterval()) {}
+
+BufferAV1Encoder::BufferAV1Encoder(hisui::FrameQueue* t_buffer,
                                    const AV1EncoderConfig& config,
                                    const std::uint64_t t_timescale)
-    : m_buffer(t_buffer), m_timescale(t_timescale) {
+    : m_buffer(t_buffer),
+      m_timescale(t_timescale),
+      m_key_frames(config.keyframe_interval),
+      m_is_async(config.is_async) {
   m_width = config.width;
   m_height = config.height;
   m_fps = config.fps;
@@ -46,9 +105,24 @@ BufferAV1Encoder::BufferAV1Encoder(std::queue<hisui::Frame>* t_buffer,
         fmt::format("::svt_av1_enc_init_handle() failed: {}",
                     static_cast<std::uint32_t>(err)));
   }
+  m_av1_enc_config.enc_mode = static_cast<std::int8_t>(config.preset);
+  m_av1_enc_config.logical_processors = config.logical_processors;
+  m_av1_enc_config.tile_rows = static_cast<std::int32_t>(config.tile_rows);
+  m_av1_enc_config.tile_columns =
+      static_cast<std::int32_t>(config.tile_columns);
+  if (config.lookahead >= 0) {
+    m_av1_enc_config.look_ahead_distance =
+        static_cast<std::uint32_t>(config.lookahead);
+  }
   m_av1_enc_config.rate_control_mode = ::SVT_AV1_RC_MODE_CBR;
   m_av1_enc_config.target_bit_rate = m_bitrate * 1000;
-  m_av1_enc_config.force_key_frames = false;
+  // outputImage() で pic_type に EB_AV1_KEY_PICTURE を指定できるようにする
+  m_av1_enc_config.force_key_frames = true;
+  if (config.keyframe_interval != 0) {
+    // intra_period_length はキーフレームの間のフレーム数
+    m_av1_enc_config.intra_period_length =
+        static_cast<std::int32_t>(config.keyframe_interval) - 1;
+  }
   m_av1_enc_config.source_width = m_width;
   m_av1_enc_config.source_height = m_height;
   m_av1_enc_config.frame_rate_numerator =
@@ -67,9 +141,12 @@ BufferAV1Encoder::BufferAV1Encoder(std::queue<hisui::Frame>* t_buffer,
                     static_cast<std::uint32_t>(err)));
   }
 
-  if (auto err = ::svt_av1_enc_init(m_handle); err != ::EB_ErrorNone) {
-    throw std::runtime_error(fmt::format("svt_av1_enc_init() failed: {}",
-                                         static_cast<std::uint32_t>(err)));
+  {
+    hisui::util::ThreadAffinityScope affinity(config.cpus);
+    if (auto err = ::svt_av1_enc_init(m_handle); err != ::EB_ErrorNone) {
+      throw std::runtime_error(fmt::format("svt_av1_enc_init() failed: {}",
+                                           static_cast<std::uint32_t>(err)));
+    }
   }
 
   m_input_buffer = new ::EbBufferHeaderType();
@@ -82,10 +159,10 @@ BufferAV1Encoder::BufferAV1Encoder(std::queue<hisui::Frame>* t_buffer,
 
   ::EbSvtIOFormat* buffer =
       reinterpret_cast<::EbSvtIOFormat*>(m_input_buffer->p_buffer);
-  auto luma_size = m_width * m_height;
-  buffer->luma = new std::uint8_t[luma_size];
-  buffer->cb = new std::uint8_t[luma_size >> 2];
-  buffer->cr = new std::uint8_t[luma_size >> 2];
+  // 各 plane は outputImage() で合成結果を直接指す
+  buffer->luma = nullptr;
+  buffer->cb = nullptr;
+  buffer->cr = nullptr;
 
   ::EbBufferHeaderType* stream_header = nullptr;
   if (auto err = ::svt_av1_enc_stream_header(m_handle, &stream_header);
@@ -101,20 +178,34 @@ BufferAV1Encoder::BufferAV1Encoder(std::queue<hisui::Frame>* t_buffer,
   ::svt_av1_enc_stream_header_release(stream_header);
 
   spdlog::debug("AV1 extra_data: [{:02x}]", fmt::join(m_extra_data, ", "));
+
+  if (m_is_async) {
+    startReceiving();
+  }
 }
 
 void BufferAV1Encoder::outputImage(const std::vector<unsigned char>& yuv) {
+  const auto luma_size = m_width * m_height;
+  if (std::size(yuv) < (luma_size * 3 >> 1)) {
+    throw std::invalid_argument(
+        fmt::format("yuv is too small: size={} width={} height={}",
+                    std::size(yuv), m_width, m_height));
+  }
+  rethrowReceivingError();
   ::EbSvtIOFormat* buffer =
       reinterpret_cast<::EbSvtIOFormat*>(m_input_buffer->p_buffer);
-  const auto luma_size = m_width * m_height;
-  std::copy_n(std::begin(yuv), luma_size, buffer->luma);
-  std::copy_n(std::begin(yuv) + luma_size, luma_size >> 2, buffer->cb);
-  std::copy_n(std::begin(yuv) + luma_size + (luma_size >> 2), luma_size >> 2,
-              buffer->cr);
+  // svt_av1_enc_send_picture() は入力をコピーするので合成結果を直接渡す.
+  // 戻った後は yuv を参照しないので, 送る側で入力の buffer を使い回せる
+  auto data = const_cast<unsigned char*>(std::data(yuv));
+  buffer->luma = data;
+  buffer->cb = data + luma_size;
+  buffer->cr = data + luma_size + (luma_size >> 2);
   m_input_buffer->flags = 0;
   m_input_buffer->p_app_private = nullptr;
   m_input_buffer->pts = m_frame;
-  m_input_buffer->pic_type = ::EB_AV1_INVALID_PICTURE;
+  m_input_buffer->pic_type = m_key_frames.next(m_frame)
+                                 ? ::EB_AV1_KEY_PICTURE
+                                 : ::EB_AV1_INVALID_PICTURE;
   m_input_buffer->metadata = nullptr;
   buffer->y_stride = m_width;
   buffer->cb_stride = m_width >> 1;
@@ -129,11 +220,13 @@ void BufferAV1Encoder::outputImage(const std::vector<unsigned char>& yuv) {
                     static_cast<std::uint32_t>(err)));
   }
 
-  outputFrame(m_frame++, 0);
+  ++m_frame;
+  if (!m_is_async) {
+    outputFrame(0);
+  }
 }
 
-void BufferAV1Encoder::outputFrame(const std::int64_t frame_index,
-                                   const std::uint8_t done_sending_pics) {
+void BufferAV1Encoder::outputFrame(const std::uint8_t done_sending_pics) {
   ::EbBufferHeaderType* output_buf = nullptr;
 
   while (true) {
@@ -149,8 +242,9 @@ void BufferAV1Encoder::outputFrame(const std::int64_t frame_index,
     const std::uint64_t timestamp =
         static_cast<std::uint64_t>(output_buf->pts) * m_timescale *
         m_fps.denominator() / m_fps.numerator();
-    std::uint8_t* data = new std::uint8_t[output_buf->n_filled_len];
-    std::copy_n(output_buf->p_buffer, output_buf->n_filled_len, data);
+    auto data =
+        FrameBufferPool::getInstance().acquire(output_buf->n_filled_len);
+    std::copy_n(output_buf->p_buffer, output_buf->n_filled_len, data.get());
     m_buffer->push(hisui::Frame{
         .timestamp = timestamp,
         .data = data,
@@ -162,15 +256,73 @@ void BufferAV1Encoder::outputFrame(const std::int64_t frame_index,
 
     ::svt_av1_enc_release_out_buffer(&output_buf);
 
-    if (m_frame > 0 && m_frame % 100 == 0 && frame_index > 0) {
-      spdlog::trace("AV1: frame index: {}", m_frame);
-      spdlog::trace("AV1: average bitrate (kbps): {}",
-                    m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
-                        static_cast<std::uint64_t>(m_frame) / 1024);
+    ++m_number_of_packets;
+    if (m_number_of_packets % 100 == 0) {
+      SPDLOG_TRACE("AV1: number of packets: {}", m_number_of_packets);
+      SPDLOG_TRACE(
+          "AV1: average bitrate (kbps): {}",
+          m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
+              static_cast<std::uint64_t>(m_number_of_packets) / 1024);
     }
   }
 }
 
+void BufferAV1Encoder::startReceiving() {
+  m_is_sending_done = false;
+  m_is_stopped = false;
+  m_thread = std::thread(&BufferAV1Encoder::receive, this);
+}
+
+void BufferAV1Encoder::receive() {
+  try {
+    while (true) {
+      bool is_sending_done;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_for(lock, RECEIVE_INTERVAL, [this] {
+          return m_is_sending_done || m_is_stopped;
+        });
+        if (m_is_stopped) {
+          return;
+        }
+        is_sending_done = m_is_sending_done;
+      }
+      // 送り終えた後はすべての packet を受け取るまでブロックする
+      outputFrame(is_sending_done ? 1 : 0);
+      if (is_sending_done) {
+        return;
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exception = std::current_exception();
+  }
+}
+
+// is_sending_done ならば残りの packet を受け取ってから, そうでなければすぐに止める
+void BufferAV1Encoder::stopReceiving(const bool is_sending_done) {
+  if (!m_thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (is_sending_done) {
+      m_is_sending_done = true;
+    } else {
+      m_is_stopped = true;
+    }
+  }
+  m_cv.notify_one();
+  m_thread.join();
+}
+
+void BufferAV1Encoder::rethrowReceivingError() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_exception) {
+    std::rethrow_exception(m_exception);
+  }
+}
+
 void BufferAV1Encoder::flush() {
   ::EbBufferHeaderType input_buffer;
   input_buffer.n_alloc_len = 0;
@@ -188,10 +340,17 @@ void BufferAV1Encoder::flush() {
                     static_cast<std::uint32_t>(err)));
   }
 
-  outputFrame(m_frame, 1);
+  if (m_is_async) {
+    stopReceiving(true);
+    rethrowReceivingError();
+  } else {
+    outputFrame(1);
+  }
 }
 
 BufferAV1Encoder::~BufferAV1Encoder() {
+  // flush() されずに破棄される場合は EOS を送っていないので, 受け取りを待たない
+  stopReceiving(false);
   if (m_frame > 0) {
     spdlog::debug("AV1Encoder: number of frames: {}", m_frame);
     spdlog::debug("AV1Encoder: final average bitrate (kbps): {}",
@@ -200,17 +359,6 @@ BufferAV1Encoder::~BufferAV1Encoder() {
   }
   if (m_input_buffer) {
     if (m_input_buffer->p_buffer) {
-      ::EbSvtIOFormat* buffer =
-          reinterpret_cast<::EbSvtIOFormat*>(m_input_buffer->p_buffer);
-      if (buffer->luma) {
-        delete[] buffer->luma;
-      }
-      if (buffer->cb) {
-        delete[] buffer->cb;
-      }
-      if (buffer->cr) {
-        delete[] buffer->cr;
-      }
       ::free(m_input_buffer->p_buffer);
     }
     delete m_input_buffer;
@@ -226,6 +374,10 @@ BufferAV1Encoder::~BufferAV1Encoder() {
   }
 }
 
+void BufferAV1Encoder::forceKeyFrame() {
+  m_key_frames.forceKeyFrame();
+}
+
 std::uint32_t BufferAV1Encoder::getFourcc() const {
   return m_fourcc;
 }
@@ -252,22 +404,9 @@ void BufferAV1Encoder::setResolutionAndBitrate(const std::uint32_t width,
         fmt::format("::svt_av1_enc_set_parameter() failed: {}",
                     static_cast<std::uint32_t>(err)));
   }
-
-  ::EbSvtIOFormat* buffer =
-      reinterpret_cast<::EbSvtIOFormat*>(m_input_buffer->p_buffer);
-  if (buffer->luma) {
-    delete[] buffer->luma;
-  }
-  if (buffer->cb) {
-    delete[] buffer->cb;
-  }
-  if (buffer->cr) {
-    delete[] buffer->cr;
+  if (m_is_async) {
+    startReceiving();
   }
-  auto luma_size = sizeof(std::uint8_t) * m_width * m_height;
-  buffer->luma = new std::uint8_t[luma_size];
-  buffer->cb = new std::uint8_t[luma_size >> 2];
-  buffer->cr = new std::uint8_t[luma_size >> 2];
 }
 
 const std::vector<std::uint8_t>& BufferAV1Encoder::getExtraData() const {
@@ -6,8 +6,11 @@
 #include <vpx/vpx_encoder.h>
 #include <vpx/vpx_image.h>
 
+#include <condition_variable>
 #include <cstdint>
-#include <queue>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <boost/cstdint.hpp>
@@ -15,11 +18,13 @@
 
 #include "constants.hpp"
 #include "video/encoder.hpp"
+#include "video/key_frame_scheduler.hpp"
 
 namespace hisui {
 
 class Config;
 struct Frame;
+class FrameQueue;
 
 }  // namespace hisui
 
@@ -35,26 +40,42 @@ class AV1EncoderConfig {
   const boost::rational<std::uint64_t> fps;
   const std::uint32_t fourcc;
   const std::uint32_t bitrate;
+  // SVT-AV1 の preset (enc_mode)
+  const std::int32_t preset;
+  // 0 の場合は SVT-AV1 がすべての CPU を使う
+  const std::uint32_t logical_processors;
+  const std::uint32_t tile_rows;
+  const std::uint32_t tile_columns;
+  // 負の場合は SVT-AV1 のデフォルトを使う
+  const std::int32_t lookahead;
+  // 空でなければ SVT-AV1 のスレッドをこれらの CPU でのみ動かす
+  const std::vector<std::uint32_t> cpus;
+  // svt_av1_enc_get_packet() を別スレッドで呼び, 送る側を待たせない
+  const bool is_async;
+  // 0 の場合はエンコーダーに任せる
+  const std::uint32_t keyframe_interval;
 };
 
 class BufferAV1Encoder : public Encoder {
  public:
   BufferAV1Encoder(
-      std::queue<hisui::Frame>*,
+      hisui::FrameQueue*,
       const AV1EncoderConfig& config,
       const std::uint64_t timescale = hisui::Constants::NANO_SECOND);
   ~BufferAV1Encoder();
 
   void outputImage(const std::vector<unsigned char>&) override;
   void flush() override;
+  void forceKeyFrame() override;
   std::uint32_t getFourcc() const override;
   void setResolutionAndBitrate(const std::uint32_t,
                                const std::uint32_t,
                                const std::uint32_t) override;
+  bool isResolutionChangeable() const override { return true; }
   const std::vector<std::uint8_t>& getExtraData() const override;
 
  private:
-  std::queue<hisui::Frame>* m_buffer;
+  hisui::FrameQueue* m_buffer;
   std::uint32_t m_width;
   std::uint32_t m_height;
   std::uint32_t m_bitrate;
@@ -67,8 +88,23 @@ class BufferAV1Encoder : public Encoder {
   ::EbBufferHeaderType* m_input_buffer;
   ::EbSvtAv1EncConfiguration m_av1_enc_config;
   std::vector<std::uint8_t> m_extra_data = {};
+  std::int64_t m_number_of_packets = 0;
+  KeyFrameScheduler m_key_frames;
 
-  void outputFrame(const std::int64_t, const std::uint8_t);
+  // is_async の場合に packet を受け取るスレッド
+  const bool m_is_async;
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_is_sending_done = false;
+  bool m_is_stopped = false;
+  std::exception_ptr m_exception = nullptr;
+
+  void outputFrame(const std::uint8_t);
+  void startReceiving();
+  void receive();
+  void stopReceiving(const bool);
+  void rethrowReceivingError();
 };
 
 }  // namespace hisui::video
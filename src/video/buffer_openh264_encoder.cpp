@@ -15,6 +15,8 @@
 
 #include "constants.hpp"
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
 #include "video/openh264.hpp"
 #include "video/openh264_handler.hpp"
 
@@ -23,10 +25,12 @@ namespace hisui::video {
 class OpenH264EncoderConfig;
 
 BufferOpenH264Encoder::BufferOpenH264Encoder(
-    std::queue<hisui::Frame>* t_buffer,
+    hisui::FrameQueue* t_buffer,
     const OpenH264EncoderConfig& config,
     const std::uint64_t t_timescale)
-    : m_buffer(t_buffer), m_timescale(t_timescale) {
+    : m_buffer(t_buffer),
+      m_timescale(t_timescale),
+      m_key_frames(config.keyframe_interval) {
   m_width = config.width;
   m_height = config.height;
   m_fps = config.fps;
@@ -59,8 +63,19 @@ BufferOpenH264Encoder::BufferOpenH264Encoder(
   param.iPicHeight = static_cast<int>(m_height);
   param.iTargetBitrate = 1000 * static_cast<int>(m_bitrate);
   param.iMultipleThreadIdc = config.threads;
+  // OpenH264 はスライス単位でしかスレッドを使わないので, スライスに分割する.
+  // uiSliceNum が 0 の場合は OpenH264 が CPU のコア数から決める
+  const std::uint16_t slices =
+      config.slices == 0 ? config.threads : config.slices;
+  if (slices != 1) {
+    param.sSpatialLayers[0].sSliceArgument.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+    param.sSpatialLayers[0].sSliceArgument.uiSliceNum = slices;
+  }
   param.iMinQp = config.min_qp;
   param.iMaxQp = config.max_qp;
+  if (config.keyframe_interval != 0) {
+    param.uiIntraPeriod = config.keyframe_interval;
+  }
   if (const auto ret = m_encoder->InitializeExt(&param)) {
     throw std::runtime_error(fmt::format(
         "OpenH264 Encoder Initialize() failed: error_code={}", ret));
@@ -83,18 +98,33 @@ BufferOpenH264Encoder::BufferOpenH264Encoder(
 }
 
 void BufferOpenH264Encoder::outputImage(const std::vector<unsigned char>& yuv) {
-  auto data_size = m_width * m_height * 3 >> 1;
-  std::uint8_t* data = new std::uint8_t[data_size];
-  std::copy_n(std::begin(yuv), data_size, data);
-
+  if (std::size(yuv) < (m_width * m_height * 3 >> 1)) {
+    throw std::invalid_argument(
+        fmt::format("yuv is too small: size={} width={} height={}",
+                    std::size(yuv), m_width, m_height));
+  }
+  // EncodeFrame() は入力を読むだけなので, 合成結果をそのまま渡す
+  auto data = const_cast<unsigned char*>(std::data(yuv));
   m_pic.pData[0] = data;
   m_pic.pData[1] = data + m_width * m_height;
   m_pic.pData[2] = data + m_width * m_height + ((m_width * m_height) >> 2);
+  if (m_key_frames.next(m_frame) && m_frame > 0) {
+    m_encoder->ForceIntraFrame(true);
+  }
   encodeFrame();
-  delete[] data;
   ++m_frame;
 }
 
+bool BufferOpenH264Encoder::skipImage() {
+  // pts に間が空くだけなので, 次のフレームが直前のフレームの表示を延ばす
+  ++m_frame;
+  return true;
+}
+
+void BufferOpenH264Encoder::forceKeyFrame() {
+  m_key_frames.forceKeyFrame();
+}
+
 void BufferOpenH264Encoder::flush() {}
 
 BufferOpenH264Encoder::~BufferOpenH264Encoder() {
@@ -125,25 +155,30 @@ bool BufferOpenH264Encoder::encodeFrame() {
     return false;
   }
 
-  std::vector<std::uint8_t> layer_data;
-  for (auto layer = 0; layer < info.iLayerNum; ++layer) {
-    std::size_t data_size = 0;
-    const auto& layer_bs_info = info.sLayerInfo[layer];
-
-    auto nal_index = layer_bs_info.iNalCount - 1;
-    do {
-      data_size +=
+  const auto get_layer_size = [](const ::SLayerBSInfo& layer_bs_info) {
+    std::size_t layer_size = 0;
+    for (auto nal_index = 0; nal_index < layer_bs_info.iNalCount;
+         ++nal_index) {
+      layer_size +=
           static_cast<std::size_t>(layer_bs_info.pNalLengthInByte[nal_index]);
-      --nal_index;
-    } while (nal_index >= 0);
+    }
+    return layer_size;
+  };
 
-    std::copy_n(&layer_bs_info.pBsBuf[layer], data_size,
-                back_inserter(layer_data));
+  // 先に全レイヤーのサイズを求めて, 出力先へ一度だけコピーする
+  std::size_t data_size = 0;
+  for (auto layer = 0; layer < info.iLayerNum; ++layer) {
+    data_size += get_layer_size(info.sLayerInfo[layer]);
+  }
+  auto data = FrameBufferPool::getInstance().acquire(data_size);
+  std::size_t offset = 0;
+  for (auto layer = 0; layer < info.iLayerNum; ++layer) {
+    const auto& layer_bs_info = info.sLayerInfo[layer];
+    const auto layer_size = get_layer_size(layer_bs_info);
+    std::copy_n(layer_bs_info.pBsBuf, layer_size, data.get() + offset);
+    offset += layer_size;
   }
 
-  auto data_size = layer_data.size();
-  std::uint8_t* data = new std::uint8_t[data_size];
-  std::copy_n(std::begin(layer_data), data_size, data);
   m_buffer->push(hisui::Frame{.timestamp = pts_ns,
                               .data = data,
                               .data_size = data_size,
@@ -152,10 +187,10 @@ bool BufferOpenH264Encoder::encodeFrame() {
   m_sum_of_bits += data_size * 8;
 
   if (m_frame > 0 && m_frame % 100 == 0) {
-    spdlog::trace("OpenH264Encoder: frame index: {}", m_frame);
-    spdlog::trace("OpenH264Encoder: average bitrate (kbps): {}",
-                  m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
-                      static_cast<std::uint64_t>(m_frame) / 1024);
+    SPDLOG_TRACE("OpenH264Encoder: frame index: {}", m_frame);
+    SPDLOG_TRACE("OpenH264Encoder: average bitrate (kbps): {}",
+                 m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
+                     static_cast<std::uint64_t>(m_frame) / 1024);
   }
 
   return true;
@@ -165,11 +200,27 @@ std::uint32_t BufferOpenH264Encoder::getFourcc() const {
   return hisui::Constants::H264_FOURCC;
 }
 
-void BufferOpenH264Encoder::setResolutionAndBitrate(const std::uint32_t,
-                                                    const std::uint32_t,
-                                                    const std::uint32_t) {
-  throw std::runtime_error(
-      "BufferOpenH264Encoder::setResolutionAndBitrate is not implemented");
+void BufferOpenH264Encoder::setResolutionAndBitrate(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::uint32_t bitrate) {
+  if (m_width != width || m_height != height) {
+    throw std::logic_error(
+        "BufferOpenH264Encoder does not support resolution change");
+  }
+  if (m_bitrate == bitrate) {
+    return;
+  }
+  spdlog::debug("bitrate: {}", bitrate);
+  // 初期化し直さずに次のフレームからレート制御の目標を変える
+  ::SBitrateInfo info = {.iLayer = SPATIAL_LAYER_ALL,
+                         .iBitrate = 1000 * static_cast<int>(bitrate)};
+  if (const auto ret = m_encoder->SetOption(ENCODER_OPTION_BITRATE, &info)) {
+    throw std::runtime_error(fmt::format(
+        "OpenH264 SetOption(ENCODER_OPTION_BITRATE) failed: error_code={}",
+        ret));
+  }
+  m_bitrate = bitrate;
 }
 
 }  // namespace hisui::video
@@ -2,7 +2,6 @@
 
 #include <codec/api/wels/codec_app_def.h>
 
-#include <queue>
 #include <vector>
 
 #include <boost/cstdint.hpp>
@@ -10,12 +9,14 @@
 
 #include "constants.hpp"
 #include "video/encoder.hpp"
+#include "video/key_frame_scheduler.hpp"
 #include "video/openh264.hpp"
 
 class ISVCEncoder;
 
 namespace hisui {
 
+class FrameQueue;
 struct Frame;
 
 }
@@ -25,13 +26,15 @@ namespace hisui::video {
 class BufferOpenH264Encoder : public Encoder {
  public:
   BufferOpenH264Encoder(
-      std::queue<hisui::Frame>*,
+      hisui::FrameQueue*,
       const OpenH264EncoderConfig&,
       const std::uint64_t timescale = hisui::Constants::NANO_SECOND);
   ~BufferOpenH264Encoder();
 
   void outputImage(const std::vector<unsigned char>&) override;
   void flush() override;
+  bool skipImage() override;
+  void forceKeyFrame() override;
   std::uint32_t getFourcc() const override;
   void setResolutionAndBitrate(const std::uint32_t,
                                const std::uint32_t,
@@ -39,7 +42,7 @@ class BufferOpenH264Encoder : public Encoder {
 
  private:
   ::ISVCEncoder* m_encoder = nullptr;
-  std::queue<hisui::Frame>* m_buffer;
+  hisui::FrameQueue* m_buffer;
   std::uint32_t m_width;
   std::uint32_t m_height;
   std::uint32_t m_bitrate;
@@ -48,6 +51,7 @@ class BufferOpenH264Encoder : public Encoder {
   std::uint64_t m_sum_of_bits = 0;
   const std::uint64_t m_timescale;
   ::SSourcePicture m_pic = {};
+  KeyFrameScheduler m_key_frames;
 
   bool encodeFrame();
 };
@@ -4,44 +4,235 @@
 #include <fmt/core.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
+#include <vpx/vp8cx.h>
 #include <vpx/vpx_codec.h>
+#include <vpx/vpx_decoder.h>
 #include <vpx/vpx_encoder.h>
 #include <vpx/vpx_image.h>
 
 #include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
+#include <utility>
 
 #include <boost/rational.hpp>
 
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
 #include "video/vpx.hpp"
 
 namespace hisui::video {
 
-BufferVPXEncoder::BufferVPXEncoder(std::queue<hisui::Frame>* t_buffer,
+BufferVPXEncoder::BufferVPXEncoder(hisui::FrameQueue* t_buffer,
                                    const VPXEncoderConfig& config,
                                    const std::uint64_t t_timescale)
-    : m_buffer(t_buffer), m_timescale(t_timescale) {
-  m_width = config.width;
-  m_height = config.height;
+    : m_buffer(t_buffer),
+      m_config(config),
+      m_key_frames(config.keyframe_interval),
+      m_timescale(t_timescale),
+      m_deadline(config.deadline),
+      m_lag_in_frames(config.lag_in_frames),
+      m_cpu_used(config.cpu_used),
+      m_min_cpu_used(config.min_cpu_used),
+      m_max_cpu_used(config.max_cpu_used),
+      m_realtime_factor(config.realtime_factor),
+      m_speed_check_time(std::chrono::steady_clock::now()),
+      m_use_active_map(config.active_map && config.lag_in_frames == 0) {
   m_fps = config.fps;
   m_fourcc = config.fourcc;
-  m_bitrate = config.bitrate;
-  if (!::vpx_img_alloc(&m_raw_vpx_image, VPX_IMG_FMT_I420, m_width, m_height,
-                       0)) {
-    throw std::runtime_error("vpx_img_alloc() failed");
+
+  m_instance = createInstance(config.width, config.height, config.bitrate);
+
+  if (config.measure_quality) {
+    create_vpx_codec_ctx_t_for_decoding(&m_quality_decoder, m_fourcc,
+                                        config.threads);
+    m_quality_meter = std::make_unique<QualityMeter>(
+        fmt::format("{}x{}", config.width, config.height));
+  }
+}
+
+BufferVPXEncoder::Instance* BufferVPXEncoder::createInstance(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::uint32_t bitrate) {
+  auto instance = std::make_unique<Instance>();
+  instance->width = width;
+  instance->height = height;
+  instance->bitrate = bitrate;
+  instance->is_screen_content = m_is_screen_content;
+  create_vpx_codec_ctx_t_for_encoding(
+      &instance->codec, &instance->cfg,
+      VPXEncoderConfig(m_config, width, height, bitrate));
+  if (m_cpu_used != m_config.cpu_used) {
+    ::vpx_codec_control(&instance->codec, VP8E_SET_CPUUSED, m_cpu_used);
+  }
+  if (instance->is_screen_content) {
+    setContentTuning(instance.get());
+  }
+  m_instances.push_back(std::move(instance));
+  return m_instances.back().get();
+}
+
+// 画面の内容は動きが少なく, 文字などの輪郭がはっきりしているので,
+// それに合わせた予測やレート制御を使わせる
+void BufferVPXEncoder::setContentTuning(Instance* instance) {
+  spdlog::debug("VPXEncoder: screen content: {}",
+                instance->is_screen_content);
+  if (m_fourcc == hisui::Constants::VP9_FOURCC) {
+    ::vpx_codec_control(&instance->codec, VP9E_SET_TUNE_CONTENT,
+                        instance->is_screen_content ? VP9E_CONTENT_SCREEN
+                                                    : VP9E_CONTENT_DEFAULT);
+  } else {
+    ::vpx_codec_control(&instance->codec, VP8E_SET_SCREEN_CONTENT_MODE,
+                        instance->is_screen_content ? 1U : 0U);
   }
+}
 
-  create_vpx_codec_ctx_t_for_encoding(&m_codec, &m_cfg, config);
+void BufferVPXEncoder::setScreenContent(const bool is_screen_content) {
+  m_is_screen_content = is_screen_content;
 }
 
 void BufferVPXEncoder::outputImage(const std::vector<unsigned char>& yuv) {
-  update_vpx_image_by_yuv_data(&m_raw_vpx_image, yuv);
-  encodeFrame(&m_codec, &m_raw_vpx_image, m_frame++, 0);
+  const auto width = m_instance->width;
+  const auto height = m_instance->height;
+  if (std::size(yuv) < (width * height * 3 >> 1)) {
+    throw std::invalid_argument(
+        fmt::format("yuv is too small: size={} width={} height={}",
+                    std::size(yuv), width, height));
+  }
+  // libvpx はエンコード時に入力をコピーするので合成結果を直接参照する
+  if (!::vpx_img_wrap(&m_raw_vpx_image, VPX_IMG_FMT_I420, width, height, 1,
+                      const_cast<unsigned char*>(std::data(yuv)))) {
+    throw std::runtime_error("vpx_img_wrap() failed");
+  }
+  const bool is_key_frame = m_key_frames.next(m_frame);
+  if (m_quality_meter) {
+    m_quality_meter->addSource(m_frame, yuv, width, height);
+  }
+  if (m_use_active_map) {
+    setActiveMap(yuv, is_key_frame);
+  }
+  encodeFrame(&m_instance->codec, &m_raw_vpx_image, m_frame++,
+              is_key_frame ? VPX_EFLAG_FORCE_KF : 0);
+  m_instance->has_encoded = true;
+  adjustSpeed();
+}
+
+// 合成結果は静止した部分が多いので, 直前にエンコードした画像から変わらない macroblock は
+// エンコーダーに参照フレームからそのまま写させる
+void BufferVPXEncoder::setActiveMap(const std::vector<unsigned char>& yuv,
+                                    const bool is_key_frame) {
+  const auto width = m_instance->width;
+  const auto height = m_instance->height;
+  const auto number_of_changed = update_vpx_active_map(
+      &m_active_map, &m_previous_image, yuv, width, height);
+  // キーフレームと全体が変わったフレームでは使わない
+  const bool is_enabled =
+      !is_key_frame && number_of_changed < std::size(m_active_map);
+  if (!is_enabled && !m_instance->is_active_map_enabled) {
+    return;
+  }
+  ::vpx_active_map_t active_map{
+      .active_map = is_enabled ? std::data(m_active_map) : nullptr,
+      .rows = (height + 15) >> 4,
+      .cols = (width + 15) >> 4,
+  };
+  const auto ret = ::vpx_codec_control(&m_instance->codec, VP8E_SET_ACTIVEMAP,
+                                       &active_map);
+  if (ret != VPX_CODEC_OK) {
+    throw std::runtime_error(
+        fmt::format("vpx_codec_control(VP8E_SET_ACTIVEMAP) failed: {}",
+                    ::vpx_codec_err_to_string(ret)));
+  }
+  m_instance->is_active_map_enabled = is_enabled;
+}
+
+// 1 秒分のフレームごとに, 経過時間に対する映像の長さの比を m_realtime_factor と
+// 比べて cpu_used を 1 ずつ動かす. 行き来しないよう下げる条件には幅を持たせる
+void BufferVPXEncoder::adjustSpeed() {
+  if (const bool is_boosted = m_is_speed_boost_requested.load();
+      is_boosted != m_is_speed_boosted) {
+    applySpeedBoost(is_boosted);
+  }
+  if (m_realtime_factor <= 0 || m_is_speed_boosted) {
+    return;
+  }
+  const auto frames = static_cast<std::uint64_t>(m_frame - m_speed_check_frame);
+  if (frames * m_fps.denominator() < m_fps.numerator()) {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed =
+      std::chrono::duration<double>(now - m_speed_check_time).count();
+  m_speed_check_time = now;
+  m_speed_check_frame = m_frame;
+  if (elapsed <= 0) {
+    return;
+  }
+  const double media_time = static_cast<double>(frames * m_fps.denominator()) /
+                            static_cast<double>(m_fps.numerator());
+  const double factor = media_time / elapsed;
+
+  auto cpu_used = m_cpu_used;
+  if (factor < m_realtime_factor) {
+    cpu_used = std::min(cpu_used + 1, m_max_cpu_used);
+  } else if (factor > m_realtime_factor * 1.5) {
+    cpu_used = std::max(cpu_used - 1, m_min_cpu_used);
+  }
+  if (cpu_used == m_cpu_used) {
+    return;
+  }
+  setCpuUsed(cpu_used);
+  spdlog::debug("VPXEncoder: realtime factor={:.2f}, cpu_used={}", factor,
+                m_cpu_used);
+}
+
+// 合成するスレッドから呼ばれうるので, 次にエンコードした後に反映する
+bool BufferVPXEncoder::setSpeedBoost(const bool is_boosted) {
+  m_is_speed_boost_requested = is_boosted;
+  return true;
+}
+
+void BufferVPXEncoder::applySpeedBoost(const bool is_boosted) {
+  m_is_speed_boosted = is_boosted;
+  if (is_boosted) {
+    m_cpu_used_before_boost = m_cpu_used;
+    // VPX_DL_GOOD_QUALITY では 5 を超えても速くならない
+    setCpuUsed(m_deadline == VPX_DL_GOOD_QUALITY             ? 5
+               : m_fourcc == hisui::Constants::VP9_FOURCC ? 9
+                                                            : 16);
+  } else {
+    setCpuUsed(m_cpu_used_before_boost);
+  }
+  // 戻した後の adjustSpeed() が, 速くしていた間の経過時間を使わないようにする
+  m_speed_check_time = std::chrono::steady_clock::now();
+  m_speed_check_frame = m_frame;
+  spdlog::debug("VPXEncoder: speed boost={}, cpu_used={}", is_boosted,
+                m_cpu_used);
+}
+
+void BufferVPXEncoder::setCpuUsed(const std::int32_t cpu_used) {
+  m_cpu_used = cpu_used;
+  for (auto& instance : m_instances) {
+    ::vpx_codec_control(&instance->codec, VP8E_SET_CPUUSED, m_cpu_used);
+  }
+}
+
+bool BufferVPXEncoder::skipImage() {
+  // pts に間が空くだけなので, 次のフレームが直前のフレームの表示を延ばす
+  ++m_frame;
+  return true;
+}
+
+void BufferVPXEncoder::forceKeyFrame() {
+  m_key_frames.forceKeyFrame();
 }
 
 void BufferVPXEncoder::flush() {
-  while (encodeFrame(&m_codec, nullptr, -1, 0)) {
+  while (encodeFrame(&m_instance->codec, nullptr, -1, 0)) {
   }
 }
 
@@ -52,8 +243,13 @@ BufferVPXEncoder::~BufferVPXEncoder() {
                   m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
                       static_cast<std::uint64_t>(m_frame) / 1024);
   }
-  ::vpx_img_free(&m_raw_vpx_image);
-  ::vpx_codec_destroy(&m_codec);
+  for (auto& instance : m_instances) {
+    ::vpx_codec_destroy(&instance->codec);
+  }
+  if (m_quality_meter) {
+    m_quality_meter->report();
+    ::vpx_codec_destroy(&m_quality_decoder);
+  }
 }
 
 bool BufferVPXEncoder::encodeFrame(::vpx_codec_ctx_t* codec,
@@ -61,7 +257,7 @@ bool BufferVPXEncoder::encodeFrame(::vpx_codec_ctx_t* codec,
                                    const int frame_index,
                                    const int flags) {
   const ::vpx_codec_err_t ret =
-      ::vpx_codec_encode(codec, img, frame_index, 1, flags, VPX_DL_REALTIME);
+      ::vpx_codec_encode(codec, img, frame_index, 1, flags, m_deadline);
   if (ret != VPX_CODEC_OK) {
     throw std::runtime_error(fmt::format("Failed to encode frame: error='{}'",
                                          ::vpx_codec_err_to_string(ret)));
@@ -78,8 +274,8 @@ bool BufferVPXEncoder::encodeFrame(::vpx_codec_ctx_t* codec,
           static_cast<std::uint64_t>(pkt->data.frame.pts) * m_timescale *
           m_fps.denominator() / m_fps.numerator();
       const std::uint8_t* buf = static_cast<std::uint8_t*>(pkt->data.frame.buf);
-      std::uint8_t* data = new std::uint8_t[pkt->data.frame.sz];
-      std::copy_n(buf, pkt->data.frame.sz, data);
+      auto data = FrameBufferPool::getInstance().acquire(pkt->data.frame.sz);
+      std::copy_n(buf, pkt->data.frame.sz, data.get());
       m_buffer->push(hisui::Frame{
           .timestamp = pts_ns,
           .data = data,
@@ -87,12 +283,15 @@ bool BufferVPXEncoder::encodeFrame(::vpx_codec_ctx_t* codec,
           .is_key = (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0});
 
       m_sum_of_bits += pkt->data.frame.sz * 8;
+      if (m_quality_meter) {
+        measureQuality(pkt);
+      }
 
       if (m_frame > 0 && m_frame % 100 == 0 && frame_index > 0) {
-        spdlog::trace("VPXEncoder: frame index: {}", m_frame);
-        spdlog::trace("VPXEncoder: average bitrate (kbps): {}",
-                      m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
-                          static_cast<std::uint64_t>(m_frame) / 1024);
+        SPDLOG_TRACE("VPXEncoder: frame index: {}", m_frame);
+        SPDLOG_TRACE("VPXEncoder: average bitrate (kbps): {}",
+                     m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
+                         static_cast<std::uint64_t>(m_frame) / 1024);
       }
     }
   }
@@ -100,6 +299,28 @@ bool BufferVPXEncoder::encodeFrame(::vpx_codec_ctx_t* codec,
   return got_pkts;
 }
 
+// 出力の順にデコードするので, 解像度を切り替えた場合もキーフレームからデコードできる
+void BufferVPXEncoder::measureQuality(const ::vpx_codec_cx_pkt_t* pkt) {
+  const auto ret = ::vpx_codec_decode(
+      &m_quality_decoder, static_cast<const std::uint8_t*>(pkt->data.frame.buf),
+      static_cast<unsigned int>(pkt->data.frame.sz), nullptr, 0);
+  if (ret != VPX_CODEC_OK) {
+    throw std::runtime_error(fmt::format("Failed to decode frame: error='{}'",
+                                         ::vpx_codec_err_to_string(ret)));
+  }
+  ::vpx_codec_iter_t iter = nullptr;
+  // 表示しない alt-ref フレームは画像を返さない
+  while (const auto img = ::vpx_codec_get_frame(&m_quality_decoder, &iter)) {
+    const unsigned char* const planes[3] = {img->planes[VPX_PLANE_Y],
+                                            img->planes[VPX_PLANE_U],
+                                            img->planes[VPX_PLANE_V]};
+    const int strides[3] = {img->stride[VPX_PLANE_Y], img->stride[VPX_PLANE_U],
+                            img->stride[VPX_PLANE_V]};
+    m_quality_meter->measure(pkt->data.frame.pts, planes, strides, img->d_w,
+                             img->d_h);
+  }
+}
+
 std::uint32_t BufferVPXEncoder::getFourcc() const {
   return m_fourcc;
 }
@@ -107,29 +328,48 @@ std::uint32_t BufferVPXEncoder::getFourcc() const {
 void BufferVPXEncoder::setResolutionAndBitrate(const std::uint32_t width,
                                                const std::uint32_t height,
                                                const std::uint32_t bitrate) {
-  if (m_width == width && m_height == height && m_bitrate == bitrate) {
+  if (m_instance->width == width && m_instance->height == height &&
+      m_instance->bitrate == bitrate &&
+      m_instance->is_screen_content == m_is_screen_content) {
     return;
   }
-  flush();
   spdlog::debug("width: {}, height: {}", width, height);
-  m_width = width;
-  m_height = height;
-  m_cfg.g_w = width;
-  m_cfg.g_h = height;
-  m_cfg.rc_target_bitrate = bitrate;
-  m_cfg.g_lag_in_frames = 0;
-  auto res = ::vpx_codec_enc_config_set(&m_codec, &m_cfg);
-  if (res != VPX_CODEC_OK) {
-    throw std::runtime_error(
-        fmt::format("vpx_codec_enc_config_set() failed: {}",
-                    ::vpx_codec_err_to_string(res)));
-  }
 
-  ::vpx_img_free(&m_raw_vpx_image);
-  if (!::vpx_img_alloc(&m_raw_vpx_image, VPX_IMG_FMT_I420, m_width, m_height,
-                       0)) {
-    throw std::runtime_error("vpx_img_alloc() failed");
+  // まだエンコードしていなければ設定し直すだけでよい
+  if (!m_instance->has_encoded) {
+    m_instance->width = width;
+    m_instance->height = height;
+    m_instance->bitrate = bitrate;
+    m_instance->cfg.g_w = width;
+    m_instance->cfg.g_h = height;
+    m_instance->cfg.rc_target_bitrate = bitrate;
+    m_instance->cfg.g_lag_in_frames = m_lag_in_frames;
+    auto res = ::vpx_codec_enc_config_set(&m_instance->codec, &m_instance->cfg);
+    if (res != VPX_CODEC_OK) {
+      throw std::runtime_error(
+          fmt::format("vpx_codec_enc_config_set() failed: {}",
+                      ::vpx_codec_err_to_string(res)));
+    }
+    if (m_instance->is_screen_content != m_is_screen_content) {
+      m_instance->is_screen_content = m_is_screen_content;
+      setContentTuning(m_instance);
+    }
+    return;
   }
+
+  // 出力するフレームの順序を保つため, 切り替える前のエンコーダーに残っているフレームは出し切る
+  flush();
+  const auto it = std::find_if(
+      std::begin(m_instances), std::end(m_instances), [&](const auto& i) {
+        return i->width == width && i->height == height &&
+               i->bitrate == bitrate &&
+               i->is_screen_content == m_is_screen_content;
+      });
+  m_instance = it == std::end(m_instances)
+                   ? createInstance(width, height, bitrate)
+                   : it->get();
+  // 切り替えたエンコーダーの参照フレームは直前に出力したフレームと異なる
+  m_key_frames.forceKeyFrame();
 }
 
 }  // namespace hisui::video
@@ -4,8 +4,10 @@
 #include <vpx/vpx_encoder.h>
 #include <vpx/vpx_image.h>
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <queue>
+#include <memory>
 #include <vector>
 
 #include <boost/cstdint.hpp>
@@ -13,46 +15,99 @@
 
 #include "constants.hpp"
 #include "video/encoder.hpp"
+#include "video/key_frame_scheduler.hpp"
+#include "video/quality_meter.hpp"
+#include "video/vpx.hpp"
 
 namespace hisui {
 
+class FrameQueue;
 struct Frame;
 
 }
 
 namespace hisui::video {
 
-class VPXEncoderConfig;
-
 class BufferVPXEncoder : public Encoder {
  public:
   BufferVPXEncoder(
-      std::queue<hisui::Frame>*,
+      hisui::FrameQueue*,
       const VPXEncoderConfig&,
       const std::uint64_t timescale = hisui::Constants::NANO_SECOND);
   ~BufferVPXEncoder();
 
   void outputImage(const std::vector<unsigned char>&) override;
   void flush() override;
+  bool skipImage() override;
+  void forceKeyFrame() override;
   std::uint32_t getFourcc() const override;
   void setResolutionAndBitrate(const std::uint32_t,
                                const std::uint32_t,
                                const std::uint32_t) override;
+  bool isResolutionChangeable() const override { return true; }
+  void setScreenContent(const bool) override;
+  bool setSpeedBoost(const bool) override;
 
  private:
-  std::queue<hisui::Frame>* m_buffer;
-  std::uint32_t m_width;
-  std::uint32_t m_height;
-  std::uint32_t m_bitrate;
+  // 解像度, ビットレート, 画面向けの設定かどうかごとのエンコーダー.
+  // 画面共有の有無で切り替えるたびに設定し直さずに済むよう, 使ったものは残しておく
+  struct Instance {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t bitrate;
+    bool is_screen_content;
+    ::vpx_codec_ctx_t codec;
+    ::vpx_codec_enc_cfg_t cfg;
+    bool has_encoded = false;
+    bool is_active_map_enabled = false;
+  };
+
+  hisui::FrameQueue* m_buffer;
+  const VPXEncoderConfig m_config;
+  std::vector<std::unique_ptr<Instance>> m_instances;
+  Instance* m_instance;
   boost::rational<std::uint64_t> m_fps;
   std::uint32_t m_fourcc;
   int m_frame = 0;
-  ::vpx_codec_ctx_t m_codec;
-  ::vpx_codec_enc_cfg_t m_cfg;
+  KeyFrameScheduler m_key_frames;
   ::vpx_image_t m_raw_vpx_image;
   std::uint64_t m_sum_of_bits = 0;
   const std::uint64_t m_timescale;
+  const unsigned long m_deadline;
+  const std::uint32_t m_lag_in_frames;
+
+  std::int32_t m_cpu_used;
+  const std::int32_t m_min_cpu_used;
+  const std::int32_t m_max_cpu_used;
+  const double m_realtime_factor;
+  std::chrono::steady_clock::time_point m_speed_check_time;
+  int m_speed_check_frame = 0;
+  // setSpeedBoost() している間は adjustSpeed() で cpu_used を動かさない
+  bool m_is_speed_boosted = false;
+  std::atomic<bool> m_is_speed_boost_requested = false;
+  std::int32_t m_cpu_used_before_boost = 0;
+
+  const bool m_use_active_map;
+  // 最後にエンコードした画像. 変わらない macroblock を求めるために使う
+  std::vector<unsigned char> m_previous_image;
+  std::vector<unsigned char> m_active_map;
+
+  // measure_quality の場合のみ使う
+  std::unique_ptr<QualityMeter> m_quality_meter;
+  ::vpx_codec_ctx_t m_quality_decoder;
+
+  // 次のフレームを画面向けの設定でエンコードする
+  bool m_is_screen_content = false;
 
+  Instance* createInstance(const std::uint32_t,
+                           const std::uint32_t,
+                           const std::uint32_t);
+  void setContentTuning(Instance*);
+  void adjustSpeed();
+  void setCpuUsed(const std::int32_t);
+  void applySpeedBoost(const bool);
+  void setActiveMap(const std::vector<unsigned char>&, const bool);
+  void measureQuality(const ::vpx_codec_cx_pkt_t*);
   bool encodeFrame(::vpx_codec_ctx_t*, ::vpx_image_t*, const int, const int);
 };
 
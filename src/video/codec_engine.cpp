@@ -2,17 +2,27 @@
 
 #include <fmt/core.h>
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
 #include "constants.hpp"
 #include "video/openh264_handler.hpp"
 
+#ifdef USE_NVDEC
+#include "video/nvdec_decoder.hpp"
+#endif
+
 #ifdef USE_ONEVPL
+#include "video/vpl_decoder.hpp"
 #include "video/vpl_encoder.hpp"
 #include "video/vpl_session.hpp"
 #endif
 
+#ifdef USE_VAAPI
+#include "video/vaapi_h264_encoder.hpp"
+#endif
+
 namespace hisui::video {
 
 void printEngine(const std::string& name,
@@ -25,6 +35,32 @@ void printEngine(const std::string& name,
   std::cout << std::endl;
 }
 
+// --video-decoder-engine の既定値 Auto では, 対応していればハードウェアデコーダーを使う
+void printHardwareDecoder([[maybe_unused]] const std::uint32_t fourcc,
+                          [[maybe_unused]] bool* is_default) {
+#ifdef USE_ONEVPL
+  if (VPLSession::hasInstance() && VPLDecoder::isSupported(fourcc)) {
+    printEngine("Intel oneVPL", "intel", *is_default);
+    *is_default = false;
+  }
+#endif
+#ifdef USE_NVDEC
+  if (NVDECDecoder::isSupported(fourcc)) {
+    printEngine("NVIDIA NVDEC", "nvidia", *is_default);
+    *is_default = false;
+  }
+#endif
+}
+
+// --video-encoder-engine に Auto か Hardware を指定すると使う
+void printHardwareEncoder([[maybe_unused]] const std::uint32_t fourcc) {
+#ifdef USE_ONEVPL
+  if (VPLSession::hasInstance() && VPLEncoder::isSupported(fourcc)) {
+    printEngine("Intel oneVPL", "intel", false);
+  }
+#endif
+}
+
 void showCodecEngines() {
   std::cout << "VP8:" << std::endl;
   std::cout << "  Encoder:" << std::endl;
@@ -35,6 +71,7 @@ void showCodecEngines() {
   std::cout << "  Decoder:" << std::endl;
   {
     bool is_default = true;
+    printHardwareDecoder(hisui::Constants::VP8_FOURCC, &is_default);
     printEngine("libvpx", "software", is_default);
   }
 
@@ -43,10 +80,12 @@ void showCodecEngines() {
   {
     bool is_default = true;
     printEngine("libvpx", "software", is_default);
+    printHardwareEncoder(hisui::Constants::VP9_FOURCC);
   }
   std::cout << "  Decoder:" << std::endl;
   {
     bool is_default = true;
+    printHardwareDecoder(hisui::Constants::VP9_FOURCC, &is_default);
     printEngine("libvpx", "software", is_default);
   }
 
@@ -55,11 +94,17 @@ void showCodecEngines() {
   {
     bool is_default = true;
     printEngine("SVT-AV1", "software", is_default);
+    printHardwareEncoder(hisui::Constants::AV1_FOURCC);
   }
   std::cout << "  Decoder:" << std::endl;
   {
     bool is_default = true;
+    printHardwareDecoder(hisui::Constants::AV1_FOURCC, &is_default);
     printEngine("SVT-AV1", "software", is_default);
+#ifdef USE_DAV1D
+    // --av1-decoder dav1d で使う
+    printEngine("dav1d", "software", false);
+#endif
   }
 
   std::cout << "H264:" << std::endl;
@@ -72,6 +117,12 @@ void showCodecEngines() {
       printEngine("Intel oneVPL", "intel", is_default);
       is_default = false;
     }
+#endif
+#ifdef USE_VAAPI
+    if (VAAPIH264Encoder::isSupported()) {
+      printEngine("VA-API", "vaapi", is_default);
+      is_default = false;
+    }
 #endif
     if (OpenH264Handler::hasInstance()) {
       printEngine("OpenH264", "software", is_default);
@@ -80,6 +131,7 @@ void showCodecEngines() {
   std::cout << "  Decoder:" << std::endl;
   {
     bool is_default = true;
+    printHardwareDecoder(hisui::Constants::H264_FOURCC, &is_default);
     if (OpenH264Handler::hasInstance()) {
       printEngine("OpenH264", "software", is_default);
     }
@@ -0,0 +1,137 @@
+#include "video/codec_probe.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "version/version.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+std::mutex probe_mutex;
+std::string cache_file;
+bool is_cache_loaded = false;
+std::map<std::string, bool> probe_results;
+
+// ドライバーやライブラリを入れ替えた場合に古い結果を使わないよう,
+// ホスト名とバージョンが一致する場合だけ使う
+std::string make_cache_header() {
+  char hostname[256] = {};
+  ::gethostname(hostname, sizeof(hostname) - 1);
+  return fmt::format("hisui={} onevpl={} host={}",
+                     hisui::version::get_hisui_version(),
+                     hisui::version::get_onevpl_version(), hostname);
+}
+
+void load_cache() {
+  is_cache_loaded = true;
+  if (std::empty(cache_file)) {
+    return;
+  }
+  std::ifstream is(cache_file);
+  std::string header;
+  if (!std::getline(is, header)) {
+    return;
+  }
+  if (header != make_cache_header()) {
+    spdlog::debug("codec probe cache is outdated: {}", cache_file);
+    return;
+  }
+  std::string name;
+  int result;
+  while (is >> name >> result) {
+    probe_results.emplace(name, result != 0);
+  }
+  spdlog::debug("codec probe cache loaded: {}", cache_file);
+}
+
+void save_cache() {
+  if (std::empty(cache_file)) {
+    return;
+  }
+  // 同時に起動した他のプロセスが書きかけのファイルを読まないよう,
+  // 別の名前で書いてから置き換える
+  const std::filesystem::path cache_path(cache_file);
+  auto tmp_path = cache_path;
+  tmp_path += fmt::format(".{}.tmp", ::getpid());
+  try {
+    if (cache_path.has_parent_path()) {
+      std::filesystem::create_directories(cache_path.parent_path());
+    }
+    {
+      std::ofstream os(tmp_path, std::ios::trunc);
+      os << make_cache_header() << '\n';
+      for (const auto& [name, result] : probe_results) {
+        os << name << ' ' << (result ? 1 : 0) << '\n';
+      }
+      if (!os) {
+        throw std::runtime_error(
+            fmt::format("writing {} failed", tmp_path.string()));
+      }
+    }
+    std::filesystem::rename(tmp_path, cache_path);
+  } catch (const std::exception& e) {
+    spdlog::warn("saving codec probe cache failed: {}", e.what());
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+  }
+}
+
+}  // namespace
+
+void set_codec_probe_cache_file(const std::string& path) {
+  std::lock_guard<std::mutex> lock(probe_mutex);
+  cache_file = path;
+  is_cache_loaded = false;
+  probe_results.clear();
+}
+
+std::optional<bool> find_codec_probe_result(const std::string& name) {
+  std::lock_guard<std::mutex> lock(probe_mutex);
+  if (!is_cache_loaded) {
+    load_cache();
+  }
+  if (const auto it = probe_results.find(name);
+      it != std::end(probe_results)) {
+    return it->second;
+  }
+  return {};
+}
+
+void save_codec_probe_result(const std::string& name, const bool result) {
+  std::lock_guard<std::mutex> lock(probe_mutex);
+  if (!is_cache_loaded) {
+    load_cache();
+  }
+  if (const auto it = probe_results.find(name);
+      it != std::end(probe_results) && it->second == result) {
+    return;
+  }
+  probe_results[name] = result;
+  save_cache();
+}
+
+bool probe_codec(const std::string& name, const std::function<bool()>& probe) {
+  if (const auto result = find_codec_probe_result(name)) {
+    spdlog::debug("codec probe cached: {}={}", name, result.value());
+    return result.value();
+  }
+  const auto result = probe();
+  spdlog::debug("codec probed: {}={}", name, result);
+  save_codec_probe_result(name, result);
+  return result;
+}
+
+}  // namespace hisui::video
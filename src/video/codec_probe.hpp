@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+namespace hisui::video {
+
+// ハードウェアのコーデックを調べた結果を path に保存し, 同じホストで次に起動した時に使う.
+// 空ならばプロセスの中だけで覚える
+void set_codec_probe_cache_file(const std::string& path);
+
+std::optional<bool> find_codec_probe_result(const std::string& name);
+void save_codec_probe_result(const std::string& name, const bool result);
+
+// name の結果が無ければ probe() で調べて保存する.
+// probe() は lock を取らずに呼ぶので, 同時に呼ばれると重複して調べることがある
+bool probe_codec(const std::string& name, const std::function<bool()>& probe);
+
+}  // namespace hisui::video
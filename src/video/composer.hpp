@@ -11,6 +11,7 @@ class YUVImage;
 class Composer {
  public:
   virtual ~Composer() = default;
+  // images の nullptr の channel は黒く塗る
   virtual void compose(std::vector<unsigned char>*,
                        const std::vector<std::shared_ptr<YUVImage>>&) = 0;
 
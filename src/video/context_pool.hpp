@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+namespace hisui::video {
+
+// デコーダーの context を設定ごとに使い回す.
+// 接続し直した録画は前の録画を release() した後に開くので, 前の録画の context を使える.
+// release() する側は, 次の録画のデコードに影響しないよう状態を戻しておく
+template <typename Key, typename Context>
+class ContextPool {
+ public:
+  explicit ContextPool(void (*t_destroy)(Context*),
+                       const std::size_t t_max_idle_contexts = 2)
+      : m_destroy(t_destroy), m_max_idle_contexts(t_max_idle_contexts) {}
+
+  ~ContextPool() {
+    for (auto& [key, context] : m_idle_contexts) {
+      m_destroy(context);
+    }
+  }
+
+  ContextPool(const ContextPool&) = delete;
+  ContextPool& operator=(const ContextPool&) = delete;
+
+  // 使える context が無ければ nullptr を返す
+  Context* acquire(const Key& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_idle_contexts.find(key);
+    if (it == std::end(m_idle_contexts)) {
+      return nullptr;
+    }
+    auto* context = it->second;
+    m_idle_contexts.erase(it);
+    return context;
+  }
+
+  void release(const Key& key, Context* context) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_idle_contexts.count(key) < m_max_idle_contexts) {
+        m_idle_contexts.emplace(key, context);
+        return;
+      }
+    }
+    m_destroy(context);
+  }
+
+ private:
+  void (*m_destroy)(Context*);
+  const std::size_t m_max_idle_contexts;
+  std::multimap<Key, Context*> m_idle_contexts;
+  std::mutex m_mutex;
+};
+
+}  // namespace hisui::video
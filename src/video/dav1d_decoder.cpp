@@ -0,0 +1,200 @@
+#include "video/dav1d_decoder.hpp"
+
+#include <dav1d/dav1d.h>
+#include <fmt/core.h>
+#include <libyuv/planar_functions.h>
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include "report/reporter.hpp"
+#include "video/context_pool.hpp"
+#include "video/yuv.hpp"
+#include "video/yuv_image_pool.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+void copy_dav1d_picture(YUVImage* yuv_image, const ::Dav1dPicture& picture) {
+  libyuv::I420Copy(static_cast<const std::uint8_t*>(picture.data[0]),
+                   static_cast<int>(picture.stride[0]),
+                   static_cast<const std::uint8_t*>(picture.data[1]),
+                   static_cast<int>(picture.stride[1]),
+                   static_cast<const std::uint8_t*>(picture.data[2]),
+                   static_cast<int>(picture.stride[1]), yuv_image->yuv[0],
+                   static_cast<int>(yuv_image->getStride(0)),
+                   yuv_image->yuv[1],
+                   static_cast<int>(yuv_image->getStride(1)),
+                   yuv_image->yuv[2],
+                   static_cast<int>(yuv_image->getStride(2)), picture.p.w,
+                   picture.p.h);
+}
+
+void destroy_dav1d_context(::Dav1dContext* context) {
+  ::dav1d_close(&context);
+}
+
+// 前の録画のフレームと参照は dav1d_flush() で捨ててから使い回す
+ContextPool<std::uint32_t, ::Dav1dContext>& get_context_pool() {
+  static ContextPool<std::uint32_t, ::Dav1dContext> pool(destroy_dav1d_context);
+  return pool;
+}
+
+}  // namespace
+
+Dav1dDecoder::Dav1dDecoder(
+    std::shared_ptr<hisui::webm::input::VideoContext> t_webm,
+    const std::uint32_t threads)
+    : Decoder(t_webm),
+      m_threads(threads),
+      m_context(get_context_pool().acquire(threads)) {
+  if (m_context == nullptr) {
+    ::Dav1dSettings settings;
+    ::dav1d_default_settings(&settings);
+    settings.n_threads = static_cast<int>(threads);
+    // フレームを遅延させると getImage() の時刻までに画像が出てこないので,
+    // フレーム間では並列化せず, タイルとループフィルタの並列化だけを使う
+    settings.max_frame_delay = 1;
+    if (const auto err = ::dav1d_open(&m_context, &settings); err < 0) {
+      throw std::runtime_error(fmt::format("::dav1d_open() failed: {}", err));
+    }
+  }
+
+  m_current_yuv_image =
+      std::shared_ptr<YUVImage>(create_black_yuv_image(m_width, m_height));
+  m_next_yuv_image = m_current_yuv_image;
+
+  if (hisui::report::Reporter::hasInstance()) {
+    m_report_enabled = true;
+
+    hisui::report::Reporter::getInstance().registerVideoDecoder(
+        m_webm->getFilePath(),
+        {.codec = "av1", .duration = m_webm->getDuration()});
+
+    hisui::report::Reporter::getInstance().registerResolutionChange(
+        m_webm->getFilePath(),
+        {.timestamp = 0, .width = m_width, .height = m_height});
+  }
+
+  updateImageByTimestamp(0);
+}
+
+Dav1dDecoder::~Dav1dDecoder() {
+  if (m_context) {
+    // デコードに失敗した後の状態も dav1d_flush() で戻る
+    ::dav1d_flush(m_context);
+    get_context_pool().release(m_threads, m_context);
+  }
+}
+
+const std::shared_ptr<YUVImage>& Dav1dDecoder::getImage(
+    const std::uint64_t timestamp) {
+  // 非対応 WebM or 時間超過
+  if (!m_webm || m_is_time_over) {
+    return m_black_yuv_image;
+  }
+  // 時間超過した
+  if (m_duration <= timestamp) {
+    m_is_time_over = true;
+    return m_black_yuv_image;
+  }
+  updateImage(timestamp);
+  return m_current_yuv_image;
+}
+
+void Dav1dDecoder::updateImage(const std::uint64_t timestamp) {
+  // 次のブロックに逹していない
+  if (timestamp < m_next_timestamp) {
+    return;
+  }
+  // 次以降のブロックに逹した
+  updateImageByTimestamp(timestamp);
+}
+
+void Dav1dDecoder::updateImageByTimestamp(const std::uint64_t timestamp) {
+  if (m_finished_webm) {
+    return;
+  }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
+
+  do {
+    if (m_report_enabled) {
+      if (m_current_yuv_image->getWidth(0) != m_next_yuv_image->getWidth(0) ||
+          m_current_yuv_image->getHeight(0) != m_next_yuv_image->getHeight(0)) {
+        hisui::report::Reporter::getInstance().registerResolutionChange(
+            m_webm->getFilePath(), {.timestamp = m_next_timestamp,
+                                    .width = m_next_yuv_image->getWidth(0),
+                                    .height = m_next_yuv_image->getHeight(0)});
+      }
+    }
+    m_current_yuv_image = m_next_yuv_image;
+    m_current_timestamp = m_next_timestamp;
+    if (m_webm->readFrame()) {
+      m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
+      decodeFrame(timestamp);
+    } else {
+      // m_duration までは m_current_image を出すので webm を読み終えても m_current_image を維持する
+      m_finished_webm = true;
+      m_next_timestamp = std::numeric_limits<std::uint64_t>::max();
+      return;
+    }
+  } while (timestamp >= m_next_timestamp);
+}
+
+void Dav1dDecoder::decodeFrame(const std::uint64_t timestamp) {
+  ::Dav1dData data{};
+  auto buffer = ::dav1d_data_create(&data, m_webm->getBufferSize());
+  if (buffer == nullptr) {
+    throw std::runtime_error("::dav1d_data_create() failed");
+  }
+  std::memcpy(buffer, m_webm->getBuffer(), m_webm->getBufferSize());
+
+  hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
+  // 出力待ちの画像があると送れないので, 送り終えるまで画像を取り出す
+  do {
+    if (const auto err = ::dav1d_send_data(m_context, &data);
+        err < 0 && err != DAV1D_ERR(EAGAIN)) {
+      ::dav1d_data_unref(&data);
+      throw std::runtime_error(
+          fmt::format("::dav1d_send_data() failed: {}", err));
+    }
+
+    ::Dav1dPicture picture{};
+    const auto err = ::dav1d_get_picture(m_context, &picture);
+    if (err == DAV1D_ERR(EAGAIN)) {
+      continue;
+    }
+    if (err < 0) {
+      ::dav1d_data_unref(&data);
+      throw std::runtime_error(
+          fmt::format("::dav1d_get_picture() failed: {}", err));
+    }
+    if (picture.p.layout != ::DAV1D_PIXEL_LAYOUT_I420 || picture.p.bpc != 8) {
+      const auto layout = static_cast<int>(picture.p.layout);
+      const auto bpc = picture.p.bpc;
+      ::dav1d_picture_unref(&picture);
+      ::dav1d_data_unref(&data);
+      throw std::runtime_error(fmt::format(
+          "only 8 bit I420 is supported: layout={} bpc={}", layout, bpc));
+    }
+    if (isDisplayed(timestamp)) {
+      m_next_yuv_image = YUVImagePool::getInstance().acquire(
+          static_cast<std::uint32_t>(picture.p.w),
+          static_cast<std::uint32_t>(picture.p.h));
+      copy_dav1d_picture(m_next_yuv_image.get(), picture);
+      m_next_yuv_image->setTimestamp(m_next_timestamp);
+    } else {
+      countDroppedFrame();
+    }
+    ::dav1d_picture_unref(&picture);
+  } while (data.sz > 0);
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "video/decoder.hpp"
+
+struct Dav1dContext;
+
+namespace hisui::webm::input {
+
+class VideoContext;
+
+}
+
+namespace hisui::video {
+
+class YUVImage;
+
+class Dav1dDecoder : public Decoder {
+ public:
+  explicit Dav1dDecoder(std::shared_ptr<hisui::webm::input::VideoContext>,
+                        const std::uint32_t threads = 1);
+  ~Dav1dDecoder();
+
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
+
+ private:
+  const std::uint32_t m_threads;
+  ::Dav1dContext* m_context = nullptr;
+  std::uint64_t m_current_timestamp = 0;
+  std::uint64_t m_next_timestamp = 0;
+  std::shared_ptr<YUVImage> m_current_yuv_image = nullptr;
+  std::shared_ptr<YUVImage> m_next_yuv_image = nullptr;
+  bool m_report_enabled = false;
+
+  void updateImage(const std::uint64_t);
+
+  void updateImageByTimestamp(const std::uint64_t);
+  // 読んだフレームを復号し, 表示されうる画像だけ m_next_yuv_image にコピーする
+  void decodeFrame(const std::uint64_t);
+};
+
+}  // namespace hisui::video
@@ -1,5 +1,8 @@
 #include "video/decoder.hpp"
 
+#include <atomic>
+
+#include "report/reporter.hpp"
 #include "video/yuv.hpp"
 #include "webm/input/video_context.hpp"
 
@@ -10,7 +13,11 @@ Decoder::Decoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
   m_width = m_webm->getWidth();
   m_height = m_webm->getHeight();
   m_duration = static_cast<std::uint64_t>(m_webm->getDuration());
-  m_black_yuv_image = create_black_yuv_image(m_width, m_height);
+  m_black_yuv_image = get_shared_black_yuv_image(m_width, m_height);
+  if (hisui::report::Reporter::hasInstance()) {
+    m_counters = hisui::report::Reporter::getInstance().getDecoderCounters(
+        m_webm->getFilePath());
+  }
 }
 
 std::uint32_t Decoder::getWidth() const {
@@ -20,4 +27,19 @@ std::uint32_t Decoder::getHeight() const {
   return m_height;
 }
 
+bool Decoder::isDisplayed(const std::uint64_t timestamp) const {
+  if (static_cast<std::uint64_t>(m_webm->getTimestamp()) > timestamp) {
+    return true;
+  }
+  const auto next_timestamp = m_webm->peekNextTimestamp();
+  return !next_timestamp.has_value() ||
+         static_cast<std::uint64_t>(next_timestamp.value()) > timestamp;
+}
+
+void Decoder::countDroppedFrame() {
+  if (m_counters) {
+    m_counters->dropped_frames.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 }  // namespace hisui::video
@@ -3,6 +3,10 @@
 #include <cstdint>
 #include <memory>
 
+namespace hisui::report {
+struct DecoderCounters;
+}
+
 namespace hisui::webm::input {
 class VideoContext;
 }
@@ -16,7 +20,9 @@ class Decoder {
   explicit Decoder(std::shared_ptr<hisui::webm::input::VideoContext>);
 
   virtual ~Decoder() = default;
-  virtual const std::shared_ptr<YUVImage> getImage(const std::uint64_t) = 0;
+  virtual const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) = 0;
+  // 出力を表示する大きさ. 縮小して表示する場合に画質を落としてデコードを軽くできる
+  virtual void setDisplaySize(const std::uint32_t, const std::uint32_t) {}
 
   std::uint32_t getWidth() const;
   std::uint32_t getHeight() const;
@@ -29,6 +35,13 @@ class Decoder {
   std::uint32_t m_width;
   std::uint32_t m_height;
   std::shared_ptr<YUVImage> m_black_yuv_image;
+  // Reporter が開かれていなければ nullptr
+  hisui::report::DecoderCounters* m_counters = nullptr;
+
+  // 直前に読んだフレームが, timestamp までに後続のフレームに上書きされずに
+  // 表示されうるかを返す. 表示されないフレームは復号だけしてコピーしない
+  bool isDisplayed(const std::uint64_t timestamp) const;
+  void countDroppedFrame();
 };
 
 }  // namespace hisui::video
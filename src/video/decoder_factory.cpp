@@ -1,7 +1,15 @@
 #include "video/decoder_factory.hpp"
 
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 
 #include "config.hpp"
 #include "constants.hpp"
@@ -11,32 +19,210 @@
 #include "video/vpx_decoder.hpp"
 #include "webm/input/video_context.hpp"
 
+#ifdef USE_DAV1D
+#include "video/dav1d_decoder.hpp"
+#endif
+
+#ifdef USE_NVDEC
+#include "video/nvdec_decoder.hpp"
+#endif
+
 #ifdef USE_ONEVPL
+#include "video/vpl_decoder.hpp"
 #include "video/vpl_session.hpp"
 #endif
 
 namespace hisui::video {
 
+namespace {
+
+// 大きな入力ほどデコードに時間がかかるので, 解像度に応じてスレッドを割り当てる
+std::uint32_t calc_decoder_threads(const std::uint32_t width,
+                                   const std::uint32_t height,
+                                   const std::uint32_t max_threads) {
+  const std::uint64_t pixels = static_cast<std::uint64_t>(width) * height;
+  std::uint32_t threads = 1;
+  if (pixels > 1920 * 1080) {
+    threads = 8;
+  } else if (pixels > 1280 * 720) {
+    threads = 4;
+  } else if (pixels > 640 * 480) {
+    threads = 2;
+  }
+  return std::min(threads, max_threads);
+}
+
+#if defined(USE_ONEVPL) || defined(USE_NVDEC)
+// VPLDecoder は source ごとにセッションを複製し, NVDECDecoder は source ごとにデコーダーを作る.
+// デバイスのメモリを使い切らないように, 同時に使う数は --max-hardware-decoders までにする
+std::atomic<std::uint32_t> number_of_hardware_decoders = 0;
+
+bool acquire_hardware_decoder(const std::uint32_t max_hardware_decoders) {
+  auto n = number_of_hardware_decoders.load();
+  while (n < max_hardware_decoders) {
+    if (number_of_hardware_decoders.compare_exchange_weak(n, n + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void release_hardware_decoder() {
+  --number_of_hardware_decoders;
+}
+
+// 両方が対応していれば oneVPL を使う
+bool is_hardware_decoder_supported(const std::uint32_t fourcc) {
+#ifdef USE_ONEVPL
+  if (VPLDecoder::isSupported(fourcc)) {
+    return true;
+  }
+#endif
+#ifdef USE_NVDEC
+  if (NVDECDecoder::isSupported(fourcc)) {
+    return true;
+  }
+#endif
+  return false;
+}
+
+Decoder* new_hardware_decoder(
+    std::shared_ptr<hisui::webm::input::VideoContext> webm) {
+  const auto fourcc = webm->getFourcc();
+#ifdef USE_ONEVPL
+  if (VPLDecoder::isSupported(fourcc)) {
+    return new VPLDecoder(webm);
+  }
+#endif
+#ifdef USE_NVDEC
+  if (NVDECDecoder::isSupported(fourcc)) {
+    return new NVDECDecoder(webm);
+  }
+#endif
+  throw std::runtime_error(
+      fmt::format("hardware decoder does not support: fourcc={:x}", fourcc));
+}
+#endif
+
+}  // namespace
+
 void DecoderFactory::setup(const hisui::Config& config) {
   auto factory = new DecoderFactory(config);
   m_instance = std::unique_ptr<DecoderFactory>(factory);
 }
 
 DecoderFactory::DecoderFactory(const hisui::Config& t_config)
-    : m_config(t_config) {}
+    : m_config(t_config) {
+#ifdef USE_ONEVPL
+  if (m_config.video_decoder_engine == hisui::config::DecoderEngine::Software) {
+    return;
+  }
+  if (m_config.video_decoder_engine == hisui::config::DecoderEngine::Hardware) {
+#ifndef USE_NVDEC
+    if (!VPLSession::hasInstance()) {
+      throw std::runtime_error("VPL session is not available");
+    }
+#endif
+    return;
+  }
+  // 入力を開くまでの間に, 別のスレッドでセッションを開いておく
+  VPLSession::openAsync();
+#endif
+}
+
+bool DecoderFactory::isHardwareDecoderEnabled(
+    [[maybe_unused]] const std::uint32_t fourcc) {
+#if defined(USE_ONEVPL) || defined(USE_NVDEC)
+  if (!m_instance || m_instance->m_config.video_decoder_engine ==
+                         hisui::config::DecoderEngine::Software) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(m_instance->m_hardware_support_mutex);
+  auto [it, inserted] = m_instance->m_hardware_support.try_emplace(fourcc);
+  if (inserted) {
+    it->second = is_hardware_decoder_supported(fourcc);
+    spdlog::debug("hardware decoder: fourcc={:x} supported={}", fourcc,
+                  it->second);
+  }
+  return it->second;
+#else
+  return false;
+#endif
+}
+
+std::shared_ptr<hisui::video::Decoder> DecoderFactory::createHardwareDecoder(
+    [[maybe_unused]] std::shared_ptr<hisui::webm::input::VideoContext> webm) {
+#if defined(USE_ONEVPL) || defined(USE_NVDEC)
+  if (!m_instance || m_instance->m_config.video_decoder_engine ==
+                         hisui::config::DecoderEngine::Software) {
+    return nullptr;
+  }
+  const auto fourcc = webm->getFourcc();
+  if (!isHardwareDecoderEnabled(fourcc)) {
+    if (m_instance->m_config.video_decoder_engine ==
+        hisui::config::DecoderEngine::Hardware) {
+      throw std::runtime_error(fmt::format(
+          "hardware decoder does not support: fourcc={:x}", fourcc));
+    }
+    return nullptr;
+  }
+  // 使用中であれば, この source はソフトウェアでデコードする
+  if (!acquire_hardware_decoder(
+          m_instance->m_config.max_hardware_decoders)) {
+    spdlog::debug("hardware decoder is in use: file_path={}",
+                  webm->getFilePath());
+    return nullptr;
+  }
+  try {
+    return std::shared_ptr<Decoder>(new_hardware_decoder(webm),
+                                    [](Decoder* d) {
+                                      delete d;
+                                      release_hardware_decoder();
+                                    });
+  } catch (const std::exception& e) {
+    release_hardware_decoder();
+    spdlog::warn("hardware decoder failed, use software decoder: {}",
+                 e.what());
+    return nullptr;
+  }
+#else
+  return nullptr;
+#endif
+}
 
 std::shared_ptr<hisui::video::Decoder> DecoderFactory::create(
     std::shared_ptr<hisui::webm::input::VideoContext> webm) {
+  static const hisui::Config default_config;
+  const auto& config = m_instance ? m_instance->m_config : default_config;
+  const auto threads =
+      config.video_threads_per_decoder > 0
+          ? config.video_threads_per_decoder
+          : calc_decoder_threads(webm->getWidth(), webm->getHeight(),
+                                 config.getJobThreads());
+
+  if (auto decoder = createHardwareDecoder(webm)) {
+    return decoder;
+  }
+
   auto fourcc = webm->getFourcc();
   switch (fourcc) {
     case hisui::Constants::VP8_FOURCC: /* fall through */
     case hisui::Constants::VP9_FOURCC:
-      return std::make_shared<VPXDecoder>(webm);
+      return std::make_shared<VPXDecoder>(
+          webm, threads, config.libvp9_decoder_row_mt == 1,
+          config.libvp9_decoder_skip_loop_filter == 1);
     case hisui::Constants::AV1_FOURCC:
-      return std::make_shared<AV1Decoder>(webm);
+#ifdef USE_DAV1D
+      if (config.av1_decoder == hisui::config::AV1Decoder::Dav1d) {
+        return std::make_shared<Dav1dDecoder>(webm, threads);
+      }
+#endif
+      return std::make_shared<AV1Decoder>(webm, threads);
     case hisui::Constants::H264_FOURCC:
       if (OpenH264Handler::hasInstance()) {
-        return std::make_shared<OpenH264Decoder>(webm);
+        return std::make_shared<OpenH264Decoder>(
+            webm, config.openh264_decoder_threads,
+            config.openh264_decode_ahead);
       }
       throw std::runtime_error("H.264 decoder is unavailable");
     default:
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 
 #include "config.hpp"
 #include "video/decoder.hpp"
@@ -24,12 +26,22 @@ class DecoderFactory {
   static std::shared_ptr<hisui::video::Decoder> create(
       std::shared_ptr<hisui::webm::input::VideoContext>);
   static void setup(const hisui::Config&);
+  // setup() した config でハードウェアデコーダーを使う codec であれば true
+  static bool isHardwareDecoderEnabled(const std::uint32_t);
 
  private:
   explicit DecoderFactory(const hisui::Config&);
 
+  // 使えなければ nullptr を返す
+  static std::shared_ptr<hisui::video::Decoder> createHardwareDecoder(
+      std::shared_ptr<hisui::webm::input::VideoContext>);
+
   inline static std::unique_ptr<DecoderFactory> m_instance = nullptr;
   hisui::Config m_config;
+  // codec ごとのハードウェアデコーダーの対応. 調べるにはデコーダーを作る必要があるので
+  // 入力にある codec だけを, 初めて使う時に 1 度だけ調べる
+  std::map<std::uint32_t, bool> m_hardware_support;
+  std::mutex m_hardware_support_mutex;
 };
 
 }  // namespace hisui::video
@@ -11,9 +11,24 @@ class Encoder {
   virtual ~Encoder() = default;
   virtual void outputImage(const std::vector<unsigned char>&) = 0;
   virtual void flush() = 0;
+  // 直前の画像と同じ画像の代わりに呼ぶ. フレームを出力せずに時刻だけを
+  // 進められる場合は true を返す. false の場合は呼び出し側が outputImage() する
+  virtual bool skipImage() { return false; }
+  // 次に outputImage() する画像をキーフレームにする.
+  // エンコーダーを通さずにフレームを出力した後, 参照フレームを使わせないために呼ぶ
+  virtual void forceKeyFrame() {}
   virtual void setResolutionAndBitrate(const std::uint32_t,
                                        const std::uint32_t,
                                        const std::uint32_t) {}
+  // setResolutionAndBitrate() で解像度を変えられる場合は true を返す.
+  // false の場合は解像度を変えずにビットレートを変えるためだけに呼ぶ
+  virtual bool isResolutionChangeable() const { return false; }
+  // 次に outputImage() する画像が画面共有のような画面の内容かどうかを伝える.
+  // setResolutionAndBitrate() の前に呼ぶ
+  virtual void setScreenContent(const bool) {}
+  // 処理が出力に追いつかない間, 画質を下げてでも最も速い設定でエンコードさせる.
+  // 速くできない場合は false を返す
+  virtual bool setSpeedBoost(const bool) { return false; }
 
   virtual std::uint32_t getFourcc() const = 0;
   virtual const std::vector<std::uint8_t>& getExtraData() const {
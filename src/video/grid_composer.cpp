@@ -3,6 +3,7 @@
 #include <libyuv/scale.h>
 
 #include <algorithm>
+#include <array>
 
 #include "video/preserve_aspect_ratio_scaler.hpp"
 #include "video/scaler.hpp"
@@ -37,14 +38,11 @@ GridComposer::GridComposer(const std::uint32_t t_single_width,
         break;
     }
   }
-  m_scaled_images.resize(m_size);
-  m_srcs.resize(m_size);
+  m_black_yuv_image =
+      get_shared_black_yuv_image(m_single_width, m_single_height);
   m_plane_sizes[0] = m_width * m_height;
   m_plane_sizes[1] = (m_plane_sizes[0] + 3) >> 2;
   m_plane_sizes[2] = m_plane_sizes[1];
-  m_planes[0] = new unsigned char[m_plane_sizes[0]];
-  m_planes[1] = new unsigned char[m_plane_sizes[1]];
-  m_planes[2] = new unsigned char[m_plane_sizes[2]];
 
   m_single_plane_widths[0] = m_single_width;
   m_single_plane_widths[1] = (m_single_width + 1) >> 1;
@@ -55,32 +53,48 @@ GridComposer::GridComposer(const std::uint32_t t_single_width,
   m_plane_default_values[0] = 0;
   m_plane_default_values[1] = 128;
   m_plane_default_values[2] = 128;
-}
-
-GridComposer::~GridComposer() {
   for (std::size_t p = 0; p < 3; ++p) {
-    delete[] m_planes[p];
+    m_cell_strides[p] =
+        static_cast<std::uint32_t>(m_column) * m_single_plane_widths[p];
   }
 }
 
+GridComposer::~GridComposer() = default;
+
 void GridComposer::compose(
     std::vector<unsigned char>* composed,
     const std::vector<std::shared_ptr<YUVImage>>& images) {
+  const std::array<unsigned char*, 3> planes = {
+      composed->data(), composed->data() + m_plane_sizes[0],
+      composed->data() + m_plane_sizes[0] + m_plane_sizes[1]};
+
+  // 変わった source は canvas の区画に直接拡縮し, 変わらない source は前回の拡縮結果を書き込む
   for (std::size_t i = 0; i < m_size; ++i) {
-    m_scaled_images[i] = m_scalers[i]->scale(images[i]);
+    if (images[i]) {
+      std::array<std::uint8_t*, 3> cell;
+      for (std::size_t p = 0; p < 3; ++p) {
+        cell[p] = get_yuv_plane_grid_cell(planes[p], m_column, i,
+                                          m_single_plane_widths[p],
+                                          m_single_plane_heights[p]);
+      }
+      m_scalers[i]->scaleOrCopyInto(images[i], cell, m_cell_strides);
+      continue;
+    }
+    // source のない間は拡縮用の画像を持たない
+    m_scalers[i]->release();
+    for (std::size_t p = 0; p < 3; ++p) {
+      copy_yuv_plane_to_grid(planes[p], m_column,
+                             m_black_yuv_image->yuv[p], i,
+                             m_single_plane_widths[p],
+                             m_single_plane_heights[p]);
+    }
   }
 
-  auto base = 0;
   for (std::size_t p = 0; p < 3; ++p) {
-    for (std::size_t i = 0; i < m_size; ++i) {
-      m_srcs[i] = m_scaled_images[i]->yuv[p];
-    }
-    merge_yuv_planes_from_top_left(m_planes[p], m_plane_sizes[p], m_column,
-                                   m_srcs, m_size, m_single_plane_widths[p],
-                                   m_single_plane_heights[p],
-                                   m_plane_default_values[p]);
-    std::copy_n(m_planes[p], m_plane_sizes[p], composed->data() + base);
-    base += m_plane_sizes[p];
+    fill_yuv_plane_outside_grid(planes[p], m_plane_sizes[p], m_column, m_size,
+                                m_single_plane_widths[p],
+                                m_single_plane_heights[p],
+                                m_plane_default_values[p]);
   }
 }
 
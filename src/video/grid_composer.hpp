@@ -24,7 +24,6 @@ class GridComposer : public Composer {
                const std::size_t,
                const hisui::config::VideoScaler&,
                const libyuv::FilterMode);
-
   ~GridComposer();
 
   void compose(std::vector<unsigned char>*,
@@ -36,13 +35,14 @@ class GridComposer : public Composer {
   std::size_t m_size;
   std::size_t m_column;
   std::size_t m_row;
-  std::array<unsigned char*, 3> m_planes;
   std::array<std::size_t, 3> m_plane_sizes;
   std::array<std::uint32_t, 3> m_single_plane_widths;
   std::array<std::uint32_t, 3> m_single_plane_heights;
   std::array<unsigned char, 3> m_plane_default_values;
-  std::vector<std::shared_ptr<YUVImage>> m_scaled_images;
-  std::vector<const unsigned char*> m_srcs;
+  // canvas の各区画の stride
+  std::array<std::uint32_t, 3> m_cell_strides;
+  // images に nullptr が渡された channel に使う
+  std::shared_ptr<YUVImage> m_black_yuv_image;
 
   // Scaler::scale() は内部buffer を返すことがあるので, Source 分用意する
   std::vector<std::unique_ptr<Scaler>> m_scalers;
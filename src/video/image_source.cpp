@@ -26,11 +26,12 @@ ImageSource::ImageSource(const std::string& file_path) {
 
   m_yuv_image = std::make_shared<YUVImage>(m_width, m_height);
 
-  const int width2 = (m_width + 1) >> 1;
   const auto ret = libyuv::ABGRToI420(
       reinterpret_cast<const std::uint8_t*>(data), width * 4,
-      m_yuv_image->yuv[0], static_cast<int>(m_width), m_yuv_image->yuv[1],
-      width2, m_yuv_image->yuv[2], width2, width, height);
+      m_yuv_image->yuv[0], static_cast<int>(m_yuv_image->getStride(0)),
+      m_yuv_image->yuv[1], static_cast<int>(m_yuv_image->getStride(1)),
+      m_yuv_image->yuv[2], static_cast<int>(m_yuv_image->getStride(2)), width,
+      height);
   stbi_image_free(data);
 
   if (ret != 0) {
@@ -39,7 +40,7 @@ ImageSource::ImageSource(const std::string& file_path) {
   }
 }
 
-const std::shared_ptr<YUVImage> ImageSource::getYUV(const std::uint64_t) {
+const std::shared_ptr<YUVImage>& ImageSource::getYUV(const std::uint64_t) {
   return m_yuv_image;
 }
 
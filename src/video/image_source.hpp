@@ -13,7 +13,7 @@ class YUVImage;
 class ImageSource : public Source {
  public:
   explicit ImageSource(const std::string&);
-  const std::shared_ptr<YUVImage> getYUV(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getYUV(const std::uint64_t) override;
   std::uint32_t getWidth() const override;
   std::uint32_t getHeight() const override;
 
@@ -0,0 +1,27 @@
+#include "video/key_frame_scheduler.hpp"
+
+#include <cstdint>
+
+namespace hisui::video {
+
+KeyFrameScheduler::KeyFrameScheduler(const std::uint32_t t_interval)
+    : m_interval(t_interval) {}
+
+void KeyFrameScheduler::forceKeyFrame() {
+  m_is_forced = true;
+}
+
+bool KeyFrameScheduler::next(const std::int64_t frame) {
+  bool is_key_frame = m_is_forced || !m_last_key_frame.has_value();
+  if (!is_key_frame && m_interval != 0) {
+    const auto interval = static_cast<std::int64_t>(m_interval);
+    is_key_frame = frame / interval != m_last_key_frame.value() / interval;
+  }
+  if (is_key_frame) {
+    m_is_forced = false;
+    m_last_key_frame = frame;
+  }
+  return is_key_frame;
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+namespace hisui::video {
+
+// エンコーダーがキーフレームにする画像を決める.
+// 画像の番号は skipImage() した画像も数えるので, フレームを省いても
+// キーフレームは出力の時刻で interval 枚ごとの区切りに揃う
+class KeyFrameScheduler {
+ public:
+  // interval が 0 の場合は, 最初の画像と forceKeyFrame() した画像だけを
+  // キーフレームにする. それ以外はエンコーダーに任せる
+  explicit KeyFrameScheduler(const std::uint32_t t_interval = 0);
+
+  void forceKeyFrame();
+  // frame 番目の画像をキーフレームにする場合は true を返し,
+  // キーフレームを出力したものとして記録する
+  bool next(const std::int64_t);
+
+ private:
+  const std::uint32_t m_interval;
+  bool m_is_forced = false;
+  std::optional<std::int64_t> m_last_key_frame;
+};
+
+}  // namespace hisui::video
@@ -0,0 +1,130 @@
+#include "video/ladder_encoder.hpp"
+
+#include <fmt/core.h>
+#include <libyuv/scale.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "util/thread_pool.hpp"
+#include "video/encoder.hpp"
+
+namespace hisui::video {
+
+LadderEncoder::LadderEncoder(std::shared_ptr<Encoder> t_encoder,
+                             const std::uint32_t t_width,
+                             const std::uint32_t t_height,
+                             const std::vector<LadderRendition>& t_renditions,
+                             const libyuv::FilterMode t_filter_mode)
+    : m_encoder(t_encoder),
+      m_width(t_width),
+      m_height(t_height),
+      m_renditions(t_renditions),
+      m_filter_mode(t_filter_mode),
+      m_thread_pool(std::size(t_renditions)) {
+  for (const auto& r : m_renditions) {
+    m_images.emplace_back(r.width * r.height * 3 >> 1);
+  }
+}
+
+void LadderEncoder::outputImage(const std::vector<unsigned char>& yuv) {
+  if (std::size(yuv) < (m_width * m_height * 3 >> 1)) {
+    throw std::invalid_argument(
+        fmt::format("yuv is too small: size={} width={} height={}",
+                    std::size(yuv), m_width, m_height));
+  }
+  // 0 番目は元の解像度のエンコード. 縮小とエンコードは rendition ごとに並列に行う
+  m_thread_pool.parallelFor(
+      std::size(m_renditions) + 1, [this, &yuv](const std::size_t index) {
+        if (index == 0) {
+          m_encoder->outputImage(yuv);
+          return;
+        }
+        scale(yuv, index - 1);
+        m_renditions[index - 1].encoder->outputImage(m_images[index - 1]);
+      });
+}
+
+void LadderEncoder::flush() {
+  m_thread_pool.parallelFor(std::size(m_renditions) + 1,
+                            [this](const std::size_t index) {
+                              if (index == 0) {
+                                m_encoder->flush();
+                              } else {
+                                m_renditions[index - 1].encoder->flush();
+                              }
+                            });
+}
+
+bool LadderEncoder::skipImage() {
+  if (!m_encoder->skipImage()) {
+    return false;
+  }
+  // 省略できない rendition には直前の縮小結果を渡して, 時刻を揃える
+  for (std::size_t i = 0; i < std::size(m_renditions); ++i) {
+    if (!m_renditions[i].encoder->skipImage()) {
+      m_renditions[i].encoder->outputImage(m_images[i]);
+    }
+  }
+  return true;
+}
+
+void LadderEncoder::forceKeyFrame() {
+  m_encoder->forceKeyFrame();
+  for (auto& rendition : m_renditions) {
+    rendition.encoder->forceKeyFrame();
+  }
+}
+
+void LadderEncoder::setResolutionAndBitrate(const std::uint32_t width,
+                                            const std::uint32_t height,
+                                            const std::uint32_t bitrate) {
+  if (m_width != width || m_height != height) {
+    throw std::logic_error("LadderEncoder does not support resolution change");
+  }
+  m_encoder->setResolutionAndBitrate(width, height, bitrate);
+}
+
+// rendition は同じ内容を縮小したものなので同じ設定にする
+void LadderEncoder::setScreenContent(const bool is_screen_content) {
+  m_encoder->setScreenContent(is_screen_content);
+  for (auto& rendition : m_renditions) {
+    rendition.encoder->setScreenContent(is_screen_content);
+  }
+}
+
+std::uint32_t LadderEncoder::getFourcc() const {
+  return m_encoder->getFourcc();
+}
+
+void LadderEncoder::scale(const std::vector<unsigned char>& yuv,
+                          const std::size_t index) {
+  const auto& r = m_renditions[index];
+  auto& dst = m_images[index];
+  const auto src_y_size = m_width * m_height;
+  const auto src_uv_width = (m_width + 1) >> 1;
+  const auto src_uv_size = src_uv_width * ((m_height + 1) >> 1);
+  const auto dst_y_size = r.width * r.height;
+  const auto dst_uv_width = (r.width + 1) >> 1;
+  const auto dst_uv_size = dst_uv_width * ((r.height + 1) >> 1);
+
+  const int ret = libyuv::I420Scale(
+      std::data(yuv), static_cast<int>(m_width), std::data(yuv) + src_y_size,
+      static_cast<int>(src_uv_width),
+      std::data(yuv) + src_y_size + src_uv_size,
+      static_cast<int>(src_uv_width), static_cast<int>(m_width),
+      static_cast<int>(m_height), std::data(dst), static_cast<int>(r.width),
+      std::data(dst) + dst_y_size, static_cast<int>(dst_uv_width),
+      std::data(dst) + dst_y_size + dst_uv_size,
+      static_cast<int>(dst_uv_width), static_cast<int>(r.width),
+      static_cast<int>(r.height), m_filter_mode);
+  if (ret != 0) {
+    throw std::runtime_error(
+        fmt::format("I420Scale() failed: error_code={}", ret));
+  }
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <libyuv/scale.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "util/thread_pool.hpp"
+#include "video/encoder.hpp"
+
+namespace hisui::video {
+
+struct LadderRendition {
+  const std::uint32_t width;
+  const std::uint32_t height;
+  const std::shared_ptr<Encoder> encoder;
+};
+
+// 合成した画像を encoder に渡し, 同じ画像を縮小して各 rendition の encoder にも渡す.
+// すべての encoder に同じ順で画像を渡すので, キーフレームの間隔を固定すれば位置が揃う
+class LadderEncoder : public Encoder {
+ public:
+  LadderEncoder(std::shared_ptr<Encoder>,
+                const std::uint32_t,
+                const std::uint32_t,
+                const std::vector<LadderRendition>&,
+                const libyuv::FilterMode);
+
+  void outputImage(const std::vector<unsigned char>&) override;
+  void flush() override;
+  bool skipImage() override;
+  void forceKeyFrame() override;
+  void setResolutionAndBitrate(const std::uint32_t,
+                               const std::uint32_t,
+                               const std::uint32_t) override;
+  void setScreenContent(const bool) override;
+  std::uint32_t getFourcc() const override;
+
+ private:
+  void scale(const std::vector<unsigned char>&, const std::size_t);
+
+  std::shared_ptr<Encoder> m_encoder;
+  std::uint32_t m_width;
+  std::uint32_t m_height;
+  std::vector<LadderRendition> m_renditions;
+  // rendition ごとの直前の縮小結果
+  std::vector<std::vector<unsigned char>> m_images;
+  libyuv::FilterMode m_filter_mode;
+  hisui::util::ThreadPool m_thread_pool;
+};
+
+}  // namespace hisui::video
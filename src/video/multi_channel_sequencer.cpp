@@ -12,6 +12,7 @@
 #include <utility>
 
 #include "util/interval.hpp"
+#include "util/trace.hpp"
 #include "video/sequencer.hpp"
 #include "video/source.hpp"
 #include "video/yuv.hpp"
@@ -20,7 +21,9 @@ namespace hisui::video {
 
 MultiChannelSequencer::MultiChannelSequencer(
     const std::vector<hisui::ArchiveItem>& normal_archives,
-    const std::vector<hisui::ArchiveItem>& preferred_archives) {
+    const std::vector<hisui::ArchiveItem>& preferred_archives,
+    const std::size_t decode_threads,
+    const std::uint64_t warm_up_time) {
   auto normal_result = make_sequence(normal_archives);
 
   m_sequence = normal_result.sequence;
@@ -32,40 +35,30 @@ MultiChannelSequencer::MultiChannelSequencer(
   spdlog::debug("m_max_width x m_max_height: {} x {}", m_max_width,
                 m_max_height);
 
-  m_black_yuv_image = create_black_yuv_image(m_max_width, m_max_height);
-
   auto preferred_result = make_sequence(preferred_archives);
 
   m_preferred_sequence = preferred_result.sequence;
+  m_preferred_timelines =
+      make_source_timelines(m_preferred_sequence, warm_up_time);
+
+  setUpTimelines(warm_up_time);
+  setUpThreadPool(decode_threads);
 }  // namespace hisui::video
 
 SequencerGetYUVsResult MultiChannelSequencer::getYUVs(
     std::vector<std::shared_ptr<YUVImage>>* yuvs,
     const std::uint64_t timestamp) {
-  for (const auto& p : m_preferred_sequence) {
-    const auto it = std::find_if(
-        std::begin(*p.second), std::end(*p.second),
-        [timestamp](const auto& s) { return s.second.isIn(timestamp); });
-    if (it != std::end(*p.second)) {
-      spdlog::debug("preferred");
-      (*yuvs)[0] = it->first->getYUV(it->second.getSubstructLower(timestamp));
+  HISUI_TRACE_SCOPE("MultiChannelSequencer::getYUVs");
+  for (auto& timeline : m_preferred_timelines) {
+    const auto* source = timeline.find(timestamp);
+    if (source != nullptr) {
+      (*yuvs)[0] =
+          source->first->getYUV(source->second.getSubstructLower(timestamp));
       return {.is_preferred_stream = true};
     }
   }
 
-  spdlog::debug("normal");
-  std::size_t i = 0;
-  for (const auto& p : m_sequence) {
-    const auto it = std::find_if(
-        std::begin(*p.second), std::end(*p.second),
-        [timestamp](const auto& s) { return s.second.isIn(timestamp); });
-    if (it == std::end(*p.second)) {
-      (*yuvs)[i] = m_black_yuv_image;
-    } else {
-      (*yuvs)[i] = it->first->getYUV(it->second.getSubstructLower(timestamp));
-    }
-    ++i;
-  }
+  getYUVsOfSequence(yuvs, timestamp);
   return {.is_preferred_stream = false};
 }
 
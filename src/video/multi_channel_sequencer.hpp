@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -20,17 +21,19 @@ class YUVImage;
 
 class MultiChannelSequencer : public Sequencer {
  public:
-  explicit MultiChannelSequencer(const std::vector<hisui::ArchiveItem>&,
-                                 const std::vector<hisui::ArchiveItem>&);
+  MultiChannelSequencer(const std::vector<hisui::ArchiveItem>&,
+                        const std::vector<hisui::ArchiveItem>&,
+                        const std::size_t decode_threads = 1,
+                        const std::uint64_t warm_up_time = 0);
 
   SequencerGetYUVsResult getYUVs(std::vector<std::shared_ptr<YUVImage>>*,
                                  const std::uint64_t) override;
 
  private:
-  std::shared_ptr<YUVImage> m_black_yuv_image;
   std::vector<
       std::pair<std::string, std::shared_ptr<std::vector<SourceAndInterval>>>>
       m_preferred_sequence;
+  std::vector<SourceTimeline> m_preferred_timelines;
 };
 
 }  // namespace hisui::video
@@ -0,0 +1,383 @@
+#include "video/nvdec_decoder.hpp"
+
+#include <cuda.h>
+#include <cuviddec.h>
+#include <fmt/core.h>
+#include <libyuv/convert.h>
+#include <nvcuvid.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "constants.hpp"
+#include "report/reporter.hpp"
+#include "video/codec_probe.hpp"
+#include "video/yuv.hpp"
+#include "video/yuv_image_pool.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+// 他のデコーダーと同じ名前で報告する
+const char* get_codec_name(const std::uint32_t fourcc) {
+  switch (fourcc) {
+    case hisui::Constants::VP8_FOURCC:
+      return "vp8";
+    case hisui::Constants::VP9_FOURCC:
+      return "vp9";
+    case hisui::Constants::AV1_FOURCC:
+      return "av1";
+    default:
+      return "H.264";
+  }
+}
+
+::cudaVideoCodec get_cuvid_codec(const std::uint32_t fourcc) {
+  switch (fourcc) {
+    case hisui::Constants::VP8_FOURCC:
+      return ::cudaVideoCodec_VP8;
+    case hisui::Constants::VP9_FOURCC:
+      return ::cudaVideoCodec_VP9;
+    case hisui::Constants::AV1_FOURCC:
+      return ::cudaVideoCodec_AV1;
+    case hisui::Constants::H264_FOURCC:
+      return ::cudaVideoCodec_H264;
+    default:
+      throw std::invalid_argument(fmt::format("unknown fourcc: {}", fourcc));
+  }
+}
+
+void check_cu(const ::CUresult result, const char* name) {
+  if (result == ::CUDA_SUCCESS) {
+    return;
+  }
+  const char* error_name = nullptr;
+  ::cuGetErrorName(result, &error_name);
+  throw std::runtime_error(fmt::format(
+      "{} failed: {}", name,
+      error_name ? error_name : std::to_string(static_cast<int>(result))));
+}
+
+// 全ての NVDECDecoder で 1 つ目のデバイスのプライマリコンテキストを使う.
+// 終了するまで使うので解放しない
+::CUcontext get_cuda_context() {
+  static const ::CUcontext context = [] {
+    check_cu(::cuInit(0), "cuInit()");
+    ::CUdevice device;
+    check_cu(::cuDeviceGet(&device, 0), "cuDeviceGet()");
+    ::CUcontext c;
+    check_cu(::cuDevicePrimaryCtxRetain(&c, device),
+             "cuDevicePrimaryCtxRetain()");
+    return c;
+  }();
+  return context;
+}
+
+// CUDA の API を呼ぶ間だけ, このスレッドでコンテキストを使う
+class CUDAContextScope {
+ public:
+  CUDAContextScope() {
+    check_cu(::cuCtxPushCurrent(get_cuda_context()), "cuCtxPushCurrent()");
+  }
+  ~CUDAContextScope() {
+    ::CUcontext context;
+    ::cuCtxPopCurrent(&context);
+  }
+
+  CUDAContextScope(const CUDAContextScope&) = delete;
+  CUDAContextScope& operator=(const CUDAContextScope&) = delete;
+};
+
+}  // namespace
+
+NVDECDecoder::NVDECDecoder(
+    std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
+    : Decoder(t_webm), m_fourcc(t_webm->getFourcc()) {
+  check_cu(::cuvidCtxLockCreate(&m_lock, get_cuda_context()),
+           "cuvidCtxLockCreate()");
+
+  ::CUVIDPARSERPARAMS params{};
+  params.CodecType = get_cuvid_codec(m_fourcc);
+  // handleSequence() の戻り値で増やす
+  params.ulMaxNumDecodeSurfaces = 1;
+  // 読んだフレームをすぐに出力させ, getImage() の時刻に間に合わせる
+  params.ulMaxDisplayDelay = 0;
+  params.pUserData = this;
+  params.pfnSequenceCallback = [](void* user, ::CUVIDEOFORMAT* format) {
+    return static_cast<NVDECDecoder*>(user)->handleSequence(format);
+  };
+  params.pfnDecodePicture = [](void* user, ::CUVIDPICPARAMS* picture) {
+    return static_cast<NVDECDecoder*>(user)->handleDecode(picture);
+  };
+  params.pfnDisplayPicture = [](void* user, ::CUVIDPARSERDISPINFO* info) {
+    return static_cast<NVDECDecoder*>(user)->handleDisplay(info);
+  };
+  if (const auto result = ::cuvidCreateVideoParser(&m_parser, &params);
+      result != ::CUDA_SUCCESS) {
+    ::cuvidCtxLockDestroy(m_lock);
+    check_cu(result, "cuvidCreateVideoParser()");
+  }
+
+  m_current_yuv_image =
+      std::shared_ptr<YUVImage>(create_black_yuv_image(m_width, m_height));
+  m_next_yuv_image = m_current_yuv_image;
+
+  if (hisui::report::Reporter::hasInstance()) {
+    m_report_enabled = true;
+
+    hisui::report::Reporter::getInstance().registerVideoDecoder(
+        m_webm->getFilePath(),
+        {.codec = get_codec_name(m_fourcc),
+         .duration = m_webm->getDuration()});
+
+    hisui::report::Reporter::getInstance().registerResolutionChange(
+        m_webm->getFilePath(),
+        {.timestamp = 0, .width = m_width, .height = m_height});
+  }
+}
+
+NVDECDecoder::~NVDECDecoder() {
+  try {
+    CUDAContextScope scope;
+    ::cuvidDestroyVideoParser(m_parser);
+    if (m_decoder) {
+      ::cuvidDestroyDecoder(m_decoder);
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("destroying NVDEC decoder failed: {}", e.what());
+  }
+  ::cuvidCtxLockDestroy(m_lock);
+}
+
+const std::shared_ptr<YUVImage>& NVDECDecoder::getImage(
+    const std::uint64_t timestamp) {
+  if (!m_webm || m_is_time_over) {
+    return m_black_yuv_image;
+  }
+  // 時間超過した
+  if (m_duration <= timestamp) {
+    m_is_time_over = true;
+    return m_black_yuv_image;
+  }
+  updateImage(timestamp);
+  return m_current_yuv_image;
+}
+
+void NVDECDecoder::updateImage(const std::uint64_t timestamp) {
+  // 次のブロックに逹していない
+  if (timestamp < m_next_timestamp) {
+    return;
+  }
+  // 次以降のブロックに逹した
+  updateImageByTimestamp(timestamp);
+}
+
+void NVDECDecoder::updateImageByTimestamp(const std::uint64_t timestamp) {
+  if (m_finished_webm) {
+    return;
+  }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
+
+  do {
+    if (m_report_enabled) {
+      if (m_current_yuv_image->getWidth(0) != m_next_yuv_image->getWidth(0) ||
+          m_current_yuv_image->getHeight(0) != m_next_yuv_image->getHeight(0)) {
+        hisui::report::Reporter::getInstance().registerResolutionChange(
+            m_webm->getFilePath(), {.timestamp = m_next_timestamp,
+                                    .width = m_next_yuv_image->getWidth(0),
+                                    .height = m_next_yuv_image->getHeight(0)});
+      }
+    }
+    m_current_yuv_image = m_next_yuv_image;
+    m_current_timestamp = m_next_timestamp;
+    if (m_webm->readFrame()) {
+      m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
+      m_is_displayed = isDisplayed(timestamp);
+      if (!m_is_displayed) {
+        countDroppedFrame();
+      }
+      decode();
+    } else {
+      // m_duration までは m_current_image を出すので webm を読み終えても m_current_image を維持する
+      m_finished_webm = true;
+      m_next_timestamp = std::numeric_limits<std::uint64_t>::max();
+      return;
+    }
+  } while (timestamp >= m_next_timestamp);
+}
+
+void NVDECDecoder::decode() {
+  hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
+  ::CUVIDSOURCEDATAPACKET packet{};
+  // 1 つのブロックは 1 つのフレームなので, 次のフレームを待たずにデコードさせる
+  packet.flags = static_cast<unsigned long>(::CUVID_PKT_TIMESTAMP |
+                                            ::CUVID_PKT_ENDOFPICTURE);
+  packet.payload_size = static_cast<unsigned long>(m_webm->getBufferSize());
+  packet.payload = m_webm->getBuffer();
+  packet.timestamp = static_cast<::CUvideotimestamp>(m_next_timestamp);
+
+  CUDAContextScope scope;
+  const auto result = ::cuvidParseVideoData(m_parser, &packet);
+  if (m_error != "") {
+    throw std::runtime_error(fmt::format(
+        "NVDEC decoding failed: file_path={} error={}", m_webm->getFilePath(),
+        m_error));
+  }
+  check_cu(result, "cuvidParseVideoData()");
+}
+
+int NVDECDecoder::handleSequence(::CUVIDEOFORMAT* format) {
+  if (format->chroma_format != ::cudaVideoChromaFormat_420 ||
+      format->bit_depth_luma_minus8 != 0) {
+    m_error = fmt::format(
+        "only 8 bit 4:2:0 is supported: chroma_format={} bit_depth={}",
+        static_cast<int>(format->chroma_format),
+        format->bit_depth_luma_minus8 + 8);
+    return 0;
+  }
+  const auto width = static_cast<std::uint32_t>(format->display_area.right -
+                                                format->display_area.left);
+  const auto height = static_cast<std::uint32_t>(format->display_area.bottom -
+                                                 format->display_area.top);
+  // 参照に使う枠に加えて, 出力を map している間に次のフレームをデコードする枠を持つ
+  const int number_of_surfaces = format->min_num_decode_surfaces + 2;
+  if (m_decoder) {
+    if (width == m_width && height == m_height) {
+      return number_of_surfaces;
+    }
+    // 解像度が変わるのはキーフレームなので, 作り直しても参照は失われない
+    ::cuvidDestroyDecoder(m_decoder);
+    m_decoder = nullptr;
+  }
+
+  ::CUVIDDECODECREATEINFO info{};
+  info.CodecType = format->codec;
+  info.ChromaFormat = format->chroma_format;
+  info.OutputFormat = ::cudaVideoSurfaceFormat_NV12;
+  info.bitDepthMinus8 = format->bit_depth_luma_minus8;
+  info.DeinterlaceMode = ::cudaVideoDeinterlaceMode_Weave;
+  info.ulWidth = format->coded_width;
+  info.ulHeight = format->coded_height;
+  info.ulMaxWidth = format->coded_width;
+  info.ulMaxHeight = format->coded_height;
+  info.ulNumDecodeSurfaces = static_cast<unsigned long>(number_of_surfaces);
+  info.ulNumOutputSurfaces = 1;
+  info.ulCreationFlags = ::cudaVideoCreate_PreferCUVID;
+  info.vidLock = m_lock;
+  info.display_area.left = static_cast<short>(format->display_area.left);
+  info.display_area.top = static_cast<short>(format->display_area.top);
+  info.display_area.right = static_cast<short>(format->display_area.right);
+  info.display_area.bottom = static_cast<short>(format->display_area.bottom);
+  info.ulTargetWidth = width;
+  info.ulTargetHeight = height;
+  if (const auto result = ::cuvidCreateDecoder(&m_decoder, &info);
+      result != ::CUDA_SUCCESS) {
+    m_error = fmt::format("cuvidCreateDecoder() failed: width={} height={} "
+                          "result={}",
+                          width, height, static_cast<int>(result));
+    return 0;
+  }
+  m_width = width;
+  m_height = height;
+  return number_of_surfaces;
+}
+
+int NVDECDecoder::handleDecode(::CUVIDPICPARAMS* picture) {
+  if (const auto result = ::cuvidDecodePicture(m_decoder, picture);
+      result != ::CUDA_SUCCESS) {
+    m_error = fmt::format("cuvidDecodePicture() failed: result={}",
+                          static_cast<int>(result));
+    return 0;
+  }
+  return 1;
+}
+
+int NVDECDecoder::handleDisplay(::CUVIDPARSERDISPINFO* display_info) {
+  // 参照フレームとしてデバイス側で復号済みなので, 表示されないなら変換しない
+  if (display_info == nullptr || !m_is_displayed) {
+    return 1;
+  }
+  ::CUVIDPROCPARAMS proc_params{};
+  proc_params.progressive_frame = display_info->progressive_frame;
+  proc_params.top_field_first = display_info->top_field_first;
+  unsigned long long device_ptr = 0;
+  unsigned int pitch = 0;
+  if (const auto result =
+          ::cuvidMapVideoFrame64(m_decoder, display_info->picture_index,
+                                 &device_ptr, &pitch, &proc_params);
+      result != ::CUDA_SUCCESS) {
+    m_error = fmt::format("cuvidMapVideoFrame64() failed: result={}",
+                          static_cast<int>(result));
+    return 0;
+  }
+
+  // 色差は輝度の ulTargetHeight 行の後に続き, 幅を 2 の倍数に揃えた行に U と V が交互に並ぶ
+  const auto nv12_stride = (m_width + 1) & ~1u;
+  const auto chroma_height = (m_height + 1) >> 1;
+  m_nv12.resize(static_cast<std::size_t>(nv12_stride) *
+                (m_height + chroma_height));
+  ::CUDA_MEMCPY2D copy{};
+  copy.srcMemoryType = ::CU_MEMORYTYPE_DEVICE;
+  copy.srcDevice = device_ptr;
+  copy.srcPitch = pitch;
+  copy.dstMemoryType = ::CU_MEMORYTYPE_HOST;
+  copy.dstHost = m_nv12.data();
+  copy.dstPitch = nv12_stride;
+  copy.WidthInBytes = m_width;
+  copy.Height = m_height;
+  auto result = ::cuMemcpy2D(&copy);
+  if (result == ::CUDA_SUCCESS) {
+    copy.srcDevice = device_ptr +
+                     static_cast<unsigned long long>(pitch) * m_height;
+    copy.dstHost = m_nv12.data() + nv12_stride * m_height;
+    copy.WidthInBytes = nv12_stride;
+    copy.Height = chroma_height;
+    result = ::cuMemcpy2D(&copy);
+  }
+  ::cuvidUnmapVideoFrame64(m_decoder, device_ptr);
+  if (result != ::CUDA_SUCCESS) {
+    m_error =
+        fmt::format("cuMemcpy2D() failed: result={}", static_cast<int>(result));
+    return 0;
+  }
+
+  m_next_yuv_image = YUVImagePool::getInstance().acquire(m_width, m_height);
+  libyuv::NV12ToI420(m_nv12.data(), static_cast<int>(nv12_stride),
+                     m_nv12.data() + nv12_stride * m_height,
+                     static_cast<int>(nv12_stride), m_next_yuv_image->yuv[0],
+                     static_cast<int>(m_next_yuv_image->getStride(0)),
+                     m_next_yuv_image->yuv[1],
+                     static_cast<int>(m_next_yuv_image->getStride(1)),
+                     m_next_yuv_image->yuv[2],
+                     static_cast<int>(m_next_yuv_image->getStride(2)),
+                     static_cast<int>(m_width), static_cast<int>(m_height));
+  m_next_yuv_image->setTimestamp(m_next_timestamp);
+  return 1;
+}
+
+bool NVDECDecoder::isSupported(const std::uint32_t fourcc) {
+  return probe_codec(fmt::format("nvdec_decoder_{:x}", fourcc), [fourcc] {
+    try {
+      ::CUVIDDECODECAPS caps{};
+      caps.eCodecType = get_cuvid_codec(fourcc);
+      caps.eChromaFormat = ::cudaVideoChromaFormat_420;
+      caps.nBitDepthMinus8 = 0;
+      CUDAContextScope scope;
+      return ::cuvidGetDecoderCaps(&caps) == ::CUDA_SUCCESS &&
+             caps.bIsSupported != 0;
+    } catch (const std::exception& e) {
+      spdlog::debug("NVDEC is not available: {}", e.what());
+      return false;
+    }
+  });
+}
+
+}  // namespace hisui::video
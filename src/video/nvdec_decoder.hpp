@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cuda.h>
+#include <nvcuvid.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "video/decoder.hpp"
+
+namespace hisui::webm::input {
+
+class VideoContext;
+
+}
+
+namespace hisui::video {
+
+class YUVImage;
+
+// NVIDIA の NVDEC でデコードする. ビットストリームの解析は cuvid の parser に任せる.
+// デコードした NV12 の画像はシステムメモリの I420 の YUVImage にコピーする.
+// 合成は CPU で行うので, 画像を CUDA のメモリのまま渡すことはしない
+class NVDECDecoder : public Decoder {
+ public:
+  explicit NVDECDecoder(std::shared_ptr<hisui::webm::input::VideoContext>);
+  ~NVDECDecoder();
+
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
+
+  // CUDA のデバイスがあり, fourcc の 8 bit の 4:2:0 のデコードに対応していれば true
+  static bool isSupported(const std::uint32_t fourcc);
+
+ private:
+  std::uint32_t m_fourcc;
+  ::CUvideoctxlock m_lock = nullptr;
+  ::CUvideoparser m_parser = nullptr;
+  ::CUvideodecoder m_decoder = nullptr;
+  std::uint64_t m_current_timestamp = 0;
+  std::uint64_t m_next_timestamp = 0;
+  std::shared_ptr<YUVImage> m_current_yuv_image = nullptr;
+  std::shared_ptr<YUVImage> m_next_yuv_image = nullptr;
+  bool m_report_enabled = false;
+  // 読んだフレームを m_next_yuv_image にコピーするか
+  bool m_is_displayed = false;
+  std::vector<unsigned char> m_nv12;
+  // callback の中では例外を投げられないので, 失敗を覚えて後で投げる
+  std::string m_error;
+
+  void updateImage(const std::uint64_t);
+  void updateImageByTimestamp(const std::uint64_t);
+  void decode();
+
+  int handleSequence(::CUVIDEOFORMAT*);
+  int handleDecode(::CUVIDPICPARAMS*);
+  int handleDisplay(::CUVIDPARSERDISPINFO*);
+};
+
+}  // namespace hisui::video
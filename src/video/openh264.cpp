@@ -30,7 +30,7 @@ void update_yuv_image_by_openh264_buffer_info(
 
   for (std::size_t i = 0; i < height0; ++i) {
     std::copy_n(buffer_info.pDst[0] + i * stride0, width0,
-                yuv_image->yuv[0] + i * width0);
+                yuv_image->yuv[0] + i * yuv_image->getStride(0));
   }
   const auto width1 = (width0 + 1) >> 1;
   const auto height1 = (height0 + 1) >> 1;
@@ -38,9 +38,9 @@ void update_yuv_image_by_openh264_buffer_info(
       static_cast<std::uint32_t>(buffer_info.UsrData.sSystemBuffer.iStride[1]);
   for (std::size_t i = 0; i < height1; ++i) {
     std::copy_n(buffer_info.pDst[1] + i * stride1, width1,
-                yuv_image->yuv[1] + i * width1);
+                yuv_image->yuv[1] + i * yuv_image->getStride(1));
     std::copy_n(buffer_info.pDst[2] + i * stride1, width1,
-                yuv_image->yuv[2] + i * width1);
+                yuv_image->yuv[2] + i * yuv_image->getStride(2));
   }
 }
 
@@ -52,9 +52,11 @@ OpenH264EncoderConfig::OpenH264EncoderConfig(const std::uint32_t t_width,
       fps(config.out_video_frame_rate),
       bitrate(config.out_video_bit_rate),
       threads(config.openh264_threads),
+      slices(config.openh264_slices),
       min_qp(config.openh264_min_qp),
       max_qp(config.openh264_max_qp),
       profile(config.openh264_profile),
-      level(config.openh264_level) {}
+      level(config.openh264_level),
+      keyframe_interval(config.getVideoKeyframeInterval()) {}
 
 }  // namespace hisui::video
@@ -29,10 +29,13 @@ class OpenH264EncoderConfig {
   const boost::rational<std::uint64_t> fps;
   const std::uint32_t bitrate;
   const std::uint16_t threads;
+  const std::uint16_t slices;
   const std::int32_t min_qp;
   const std::int32_t max_qp;
   const ::EProfileIdc profile = ::PRO_BASELINE;
   const ::ELevelIdc level = ::LEVEL_3_1;
+  // 0 の場合はエンコーダーに任せる
+  const std::uint32_t keyframe_interval;
 };
 
 }  // namespace hisui::video
@@ -8,27 +8,41 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <future>
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 
 #include "report/reporter.hpp"
 #include "video/openh264.hpp"
 #include "video/openh264_handler.hpp"
 #include "video/yuv.hpp"
+#include "video/yuv_image_pool.hpp"
 #include "webm/input/video_context.hpp"
 
 namespace hisui::video {
 
 OpenH264Decoder::OpenH264Decoder(
-    std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
-    : Decoder(t_webm) {
+    std::shared_ptr<hisui::webm::input::VideoContext> t_webm,
+    const std::uint32_t threads,
+    const std::size_t t_decode_ahead)
+    : Decoder(t_webm), m_decode_ahead(t_decode_ahead) {
   const auto create_decoder_ret =
       OpenH264Handler::getInstance().createDecoder(&m_decoder);
   if (create_decoder_ret != 0 || m_decoder == nullptr) {
     throw std::runtime_error(fmt::format(
         "OpenH264 createDecoder() failed: error_code={}", create_decoder_ret));
   }
+  // Initialize() より前に設定する必要がある
+  if (threads > 0) {
+    int number_of_threads = static_cast<int>(threads);
+    if (m_decoder->SetOption(::DECODER_OPTION_NUM_OF_THREADS,
+                             &number_of_threads) != 0) {
+      spdlog::warn(
+          "OpenH264 decoder does not support DECODER_OPTION_NUM_OF_THREADS");
+    }
+  }
   ::SDecodingParam param;
   param.pFileNameRestructed = nullptr;
   param.uiCpuLoad = 100;  // openh264 のソースをみると利用していないようだ
@@ -63,9 +77,29 @@ OpenH264Decoder::OpenH264Decoder(
   m_tmp_yuv[0] = nullptr;
   m_tmp_yuv[1] = nullptr;
   m_tmp_yuv[2] = nullptr;
+
+  if (m_decode_ahead > 0 && m_webm) {
+    for (std::size_t i = 0; i < m_decode_ahead; ++i) {
+      m_free_slots.push(true);
+    }
+    m_decoding = std::async(std::launch::async, [this] {
+      try {
+        decodeAhead();
+      } catch (...) {
+        m_decoded_images.close();
+        throw;
+      }
+      m_decoded_images.close();
+    });
+  }
 }
 
 OpenH264Decoder::~OpenH264Decoder() {
+  // デコードしているスレッドが m_decoder を使い終えるまで待つ
+  m_free_slots.close();
+  if (m_decoding.valid()) {
+    m_decoding.wait();
+  }
   if (m_decoder) {
     m_decoder->Uninitialize();
     OpenH264Handler::getInstance().destroyDecoder(m_decoder);
@@ -73,7 +107,7 @@ OpenH264Decoder::~OpenH264Decoder() {
   m_decoder = nullptr;
 }
 
-const std::shared_ptr<YUVImage> OpenH264Decoder::getImage(
+const std::shared_ptr<YUVImage>& OpenH264Decoder::getImage(
     const std::uint64_t timestamp) {
   // 非対応 WebM or 時間超過
   if (!m_webm || m_is_time_over) {
@@ -89,6 +123,10 @@ const std::shared_ptr<YUVImage> OpenH264Decoder::getImage(
 }
 
 void OpenH264Decoder::updateImage(const std::uint64_t timestamp) {
+  if (m_decode_ahead > 0) {
+    updateImageFromDecodedImages(timestamp);
+    return;
+  }
   // 次のブロックに逹っしていない
   if (timestamp < m_next_timestamp) {
     return;
@@ -101,6 +139,8 @@ void OpenH264Decoder::updateImageByTimestamp(const std::uint64_t timestamp) {
   if (m_finished_webm) {
     return;
   }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
 
   do {
     if (m_report_enabled) {
@@ -115,23 +155,14 @@ void OpenH264Decoder::updateImageByTimestamp(const std::uint64_t timestamp) {
     m_current_yuv_image = m_next_yuv_image;
     m_current_timestamp = m_next_timestamp;
     if (m_webm->readFrame()) {
-      ::SBufferInfo buffer_info;
-      const auto ret = m_decoder->DecodeFrameNoDelay(
-          m_webm->getBuffer(), static_cast<int>(m_webm->getBufferSize()),
-          m_tmp_yuv, &buffer_info);
-      if (ret != 0) {
-        spdlog::error(
-            "OpenH264Decoder DecodeFrameNoDelay failed: error_code={}",
-            static_cast<std::uint32_t>(ret));
-        throw std::runtime_error(
-            fmt::format("m_decoder->DecodeFrameNoDelay() failed: error_code={}",
-                        static_cast<std::uint32_t>(ret)));
-      }
       m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
-      if (buffer_info.iBufferStatus == 1) {
-        m_next_yuv_image = std::make_shared<YUVImage>(m_width, m_height);
-        update_yuv_image_by_openh264_buffer_info(m_next_yuv_image.get(),
-                                                 buffer_info);
+      const bool is_displayed = isDisplayed(timestamp);
+      if (!is_displayed) {
+        countDroppedFrame();
+      }
+      if (auto image = decodeFrame(is_displayed)) {
+        m_next_yuv_image = std::move(image);
+        m_next_yuv_image->setTimestamp(m_next_timestamp);
       }
     } else {
       // m_duration までは m_current_image を出すので webm を読み終えても m_current_image を維持する
@@ -142,4 +173,104 @@ void OpenH264Decoder::updateImageByTimestamp(const std::uint64_t timestamp) {
   } while (timestamp >= m_next_timestamp);
 }
 
+void OpenH264Decoder::updateImageFromDecodedImages(
+    const std::uint64_t timestamp) {
+  if (m_finished_webm) {
+    return;
+  }
+  if (timestamp > m_requested_timestamp.load()) {
+    m_requested_timestamp = timestamp;
+  }
+
+  while (true) {
+    if (!m_pending_image.has_value()) {
+      m_pending_image = m_decoded_images.pop();
+      if (!m_pending_image.has_value()) {
+        // m_duration までは m_current_image を出すので webm を読み終えても m_current_image を維持する
+        m_finished_webm = true;
+        // デコードしているスレッドの例外はここで投げ直す
+        m_decoding.get();
+        return;
+      }
+      m_free_slots.push(true);
+    }
+    if (m_pending_image->timestamp > timestamp) {
+      return;
+    }
+
+    auto& image = m_pending_image->image;
+    if (m_report_enabled) {
+      if (m_current_yuv_image->getWidth(0) != image->getWidth(0) ||
+          m_current_yuv_image->getHeight(0) != image->getHeight(0)) {
+        hisui::report::Reporter::getInstance().registerResolutionChange(
+            m_webm->getFilePath(), {.timestamp = m_pending_image->timestamp,
+                                    .width = image->getWidth(0),
+                                    .height = image->getHeight(0)});
+      }
+    }
+    m_current_yuv_image = std::move(image);
+    m_current_timestamp = m_pending_image->timestamp;
+    m_pending_image.reset();
+  }
+}
+
+std::shared_ptr<YUVImage> OpenH264Decoder::decodeFrame(const bool copy) {
+  ::SBufferInfo buffer_info;
+  const auto ret = [&] {
+    hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
+    return m_decoder->DecodeFrameNoDelay(
+        m_webm->getBuffer(), static_cast<int>(m_webm->getBufferSize()),
+        m_tmp_yuv, &buffer_info);
+  }();
+  if (ret != 0) {
+    spdlog::error("OpenH264Decoder DecodeFrameNoDelay failed: error_code={}",
+                  static_cast<std::uint32_t>(ret));
+    throw std::runtime_error(
+        fmt::format("m_decoder->DecodeFrameNoDelay() failed: error_code={}",
+                    static_cast<std::uint32_t>(ret)));
+  }
+  if (buffer_info.iBufferStatus != 1 || !copy) {
+    return nullptr;
+  }
+  auto image = YUVImagePool::getInstance().acquire(m_width, m_height);
+  update_yuv_image_by_openh264_buffer_info(image.get(), buffer_info);
+  return image;
+}
+
+// 別のスレッドで呼ばれる. m_webm と m_decoder はこのスレッドだけが使う
+void OpenH264Decoder::decodeAhead() {
+  std::uint64_t sought_timestamp = 0;
+  while (true) {
+    const auto requested_timestamp = m_requested_timestamp.load();
+    if (requested_timestamp > sought_timestamp) {
+      m_webm->seekToKeyFrame(static_cast<std::int64_t>(requested_timestamp));
+      sought_timestamp = requested_timestamp;
+    }
+    if (!m_webm->readFrame()) {
+      return;
+    }
+    const auto frame_timestamp =
+        static_cast<std::uint64_t>(m_webm->getTimestamp());
+    // 次のフレームも要求された時刻までにあれば, このフレームは表示されない
+    const auto next_timestamp = m_webm->peekNextTimestamp();
+    const bool is_displayed =
+        !next_timestamp.has_value() ||
+        static_cast<std::uint64_t>(next_timestamp.value()) >
+            m_requested_timestamp.load();
+    if (!is_displayed) {
+      countDroppedFrame();
+    }
+    auto image = decodeFrame(is_displayed);
+    if (!image) {
+      continue;
+    }
+    image->setTimestamp(frame_timestamp);
+    if (!m_free_slots.pop().has_value()) {
+      return;
+    }
+    m_decoded_images.push(
+        {.timestamp = frame_timestamp, .image = std::move(image)});
+  }
+}
+
 }  // namespace hisui::video
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <future>
 #include <memory>
+#include <optional>
 
+#include "util/blocking_queue.hpp"
 #include "video/decoder.hpp"
 
 class ISVCDecoder;
@@ -17,12 +22,16 @@ namespace hisui::video {
 
 class YUVImage;
 
+// decode_ahead > 0 の場合は別のスレッドでデコードし,
+// デコード済みの画像を decode_ahead 枚まで先行させる
 class OpenH264Decoder : public Decoder {
  public:
-  explicit OpenH264Decoder(std::shared_ptr<hisui::webm::input::VideoContext>);
+  explicit OpenH264Decoder(std::shared_ptr<hisui::webm::input::VideoContext>,
+                           const std::uint32_t threads = 0,
+                           const std::size_t decode_ahead = 0);
   ~OpenH264Decoder();
 
-  const std::shared_ptr<YUVImage> getImage(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
 
  private:
   ::ISVCDecoder* m_decoder = nullptr;
@@ -33,9 +42,27 @@ class OpenH264Decoder : public Decoder {
   std::uint8_t* m_tmp_yuv[3];
   bool m_report_enabled = false;
 
+  struct DecodedImage {
+    std::uint64_t timestamp;
+    std::shared_ptr<YUVImage> image;
+  };
+  const std::size_t m_decode_ahead;
+  hisui::util::BlockingQueue<DecodedImage> m_decoded_images;
+  // m_decoded_images に置ける残りの枚数分の要素を持つ
+  hisui::util::BlockingQueue<bool> m_free_slots;
+  // m_decoded_images から取り出したが, まだ表示する時刻になっていない画像
+  std::optional<DecodedImage> m_pending_image;
+  // trim などで先に飛んだ場合にデコードするスレッドも飛ばせるよう, 要求された時刻を置く
+  std::atomic<std::uint64_t> m_requested_timestamp = 0;
+  std::future<void> m_decoding;
+
   void updateImage(const std::uint64_t);
 
   void updateImageByTimestamp(const std::uint64_t);
+  void updateImageFromDecodedImages(const std::uint64_t);
+  // 読んだフレームを復号する. 画像が出力され, 引数が true ならば複製を返す
+  std::shared_ptr<YUVImage> decodeFrame(const bool);
+  void decodeAhead();
 };
 
 }  // namespace hisui::video
@@ -1,8 +1,12 @@
 #include "video/openh264_handler.hpp"
 
 #include <dlfcn.h>
+#include <spdlog/spdlog.h>
 
+#include <exception>
+#include <mutex>
 #include <stdexcept>
+#include <string>
 
 namespace hisui::video {
 
@@ -12,7 +16,21 @@ void OpenH264Handler::open(const std::string& openh264_path) {
   }
 }
 
+void OpenH264Handler::setLibraryPath(const std::string& openh264_path) {
+  m_library_path = openh264_path;
+}
+
 bool OpenH264Handler::hasInstance() {
+  std::call_once(m_open_flag, [] {
+    if (m_handler || std::empty(m_library_path)) {
+      return;
+    }
+    try {
+      open(m_library_path);
+    } catch (const std::exception& e) {
+      spdlog::warn("failed to open openh264 library: {}", e.what());
+    }
+  });
   return m_handler != nullptr;
 }
 
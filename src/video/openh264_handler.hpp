@@ -2,6 +2,7 @@
 
 #include <codec/api/wels/codec_app_def.h>
 
+#include <mutex>
 #include <string>
 
 class ISVCDecoder;
@@ -28,6 +29,8 @@ class OpenH264Handler {
   GetCodecVersoinFunc getCodecVersion = nullptr;
 
   static void open(const std::string&);
+  // path を覚えておき, 初めて hasInstance() が呼ばれた時に読み込む
+  static void setLibraryPath(const std::string&);
   static bool hasInstance();
   static OpenH264Handler& getInstance();
   static void close();
@@ -35,6 +38,8 @@ class OpenH264Handler {
  private:
   void* m_openh264_handle = nullptr;
   inline static OpenH264Handler* m_handler = nullptr;
+  inline static std::string m_library_path;
+  inline static std::once_flag m_open_flag;
 
   explicit OpenH264Handler(const std::string&);
   ~OpenH264Handler();
@@ -4,9 +4,10 @@
 #include <libyuv/scale.h>
 
 #include <algorithm>
-#include <future>
-#include <system_error>
+#include <array>
 
+#include "util/cgroup.hpp"
+#include "util/thread_pool.hpp"
 #include "video/preserve_aspect_ratio_scaler.hpp"
 #include "video/scaler.hpp"
 #include "video/simple_scaler.hpp"
@@ -20,7 +21,8 @@ ParallelGridComposer::ParallelGridComposer(
     const std::size_t t_size,
     const std::size_t t_colomn,
     const hisui::config::VideoScaler& scaler_type,
-    const libyuv::FilterMode filter_mode)
+    const libyuv::FilterMode filter_mode,
+    const std::size_t threads)
     : m_single_width(t_single_width),
       m_single_height(t_single_height),
       m_size(t_size),
@@ -41,16 +43,11 @@ ParallelGridComposer::ParallelGridComposer(
         break;
     }
   }
-  m_scaled_images.resize(m_size);
-  m_srcs[0].resize(m_size);
-  m_srcs[1].resize(m_size);
-  m_srcs[2].resize(m_size);
+  m_black_yuv_image =
+      get_shared_black_yuv_image(m_single_width, m_single_height);
   m_plane_sizes[0] = m_width * m_height;
   m_plane_sizes[1] = (m_plane_sizes[0] + 3) >> 2;
   m_plane_sizes[2] = m_plane_sizes[1];
-  m_planes[0] = new unsigned char[m_plane_sizes[0]];
-  m_planes[1] = new unsigned char[m_plane_sizes[1]];
-  m_planes[2] = new unsigned char[m_plane_sizes[2]];
 
   m_single_plane_widths[0] = m_single_width;
   m_single_plane_widths[1] = (m_single_width + 1) >> 1;
@@ -61,62 +58,59 @@ ParallelGridComposer::ParallelGridComposer(
   m_plane_default_values[0] = 0;
   m_plane_default_values[1] = 128;
   m_plane_default_values[2] = 128;
-}
-
-ParallelGridComposer::~ParallelGridComposer() {
   for (std::size_t p = 0; p < 3; ++p) {
-    delete[] m_planes[p];
+    m_cell_strides[p] =
+        static_cast<std::uint32_t>(m_column) * m_single_plane_widths[p];
   }
+
+  const std::size_t number_of_threads =
+      threads != 0 ? threads : hisui::util::get_number_of_usable_cpus();
+
+  m_thread_pool = hisui::util::get_shared_thread_pool(number_of_threads - 1);
 }
 
+ParallelGridComposer::~ParallelGridComposer() = default;
+
 void ParallelGridComposer::compose(
     std::vector<unsigned char>* composed,
     const std::vector<std::shared_ptr<YUVImage>>& images) {
-  for (std::size_t i = 0; i < m_size; ++i) {
-    m_scaled_images[i] = m_scalers[i]->scale(images[i]);
-  }
-
-  auto future0 = std::async(std::launch::async, [this, composed] {
-    for (std::size_t i = 0; i < m_size; ++i) {
-      m_srcs[0][i] = m_scaled_images[i]->yuv[0];
-    }
-    merge_yuv_planes_from_top_left(m_planes[0], m_plane_sizes[0], m_column,
-                                   m_srcs[0], m_size, m_single_plane_widths[0],
-                                   m_single_plane_heights[0],
-                                   m_plane_default_values[0]);
-
-    std::copy_n(m_planes[0], m_plane_sizes[0], composed->data());
-  });
-
-  auto future1 = std::async(std::launch::async, [this, composed] {
-    for (std::size_t i = 0; i < m_size; ++i) {
-      m_srcs[1][i] = m_scaled_images[i]->yuv[1];
-    }
-    merge_yuv_planes_from_top_left(m_planes[1], m_plane_sizes[1], m_column,
-                                   m_srcs[1], m_size, m_single_plane_widths[1],
-                                   m_single_plane_heights[1],
-                                   m_plane_default_values[1]);
-
-    std::copy_n(m_planes[1], m_plane_sizes[1],
-                composed->data() + m_plane_sizes[0]);
-  });
-
-  auto future2 = std::async(std::launch::async, [this, composed] {
-    for (std::size_t i = 0; i < m_size; ++i) {
-      m_srcs[2][i] = m_scaled_images[i]->yuv[2];
-    }
-    merge_yuv_planes_from_top_left(m_planes[2], m_plane_sizes[2], m_column,
-                                   m_srcs[2], m_size, m_single_plane_widths[2],
-                                   m_single_plane_heights[2],
-                                   m_plane_default_values[2]);
-
-    std::copy_n(m_planes[2], m_plane_sizes[2],
-                composed->data() + m_plane_sizes[0] + m_plane_sizes[1]);
-  });
-
-  future0.get();
-  future1.get();
-  future2.get();
+  const std::array<unsigned char*, 3> planes = {
+      composed->data(), composed->data() + m_plane_sizes[0],
+      composed->data() + m_plane_sizes[0] + m_plane_sizes[1]};
+
+  // source ごとに区画へ直接拡縮するか, 前回の拡縮結果を書き込む.
+  // 書き込む範囲は source ごとに重ならない.
+  // 最後の index では source で埋まらない部分を塗る
+  m_thread_pool->parallelFor(
+      m_size + 1, [this, &planes, &images](const std::size_t i) {
+        if (i == m_size) {
+          for (std::size_t p = 0; p < 3; ++p) {
+            fill_yuv_plane_outside_grid(
+                planes[p], m_plane_sizes[p], m_column, m_size,
+                m_single_plane_widths[p], m_single_plane_heights[p],
+                m_plane_default_values[p]);
+          }
+          return;
+        }
+        if (images[i]) {
+          std::array<std::uint8_t*, 3> cell;
+          for (std::size_t p = 0; p < 3; ++p) {
+            cell[p] = get_yuv_plane_grid_cell(planes[p], m_column, i,
+                                              m_single_plane_widths[p],
+                                              m_single_plane_heights[p]);
+          }
+          m_scalers[i]->scaleOrCopyInto(images[i], cell, m_cell_strides);
+          return;
+        }
+        // source のない間は拡縮用の画像を持たない
+        m_scalers[i]->release();
+        for (std::size_t p = 0; p < 3; ++p) {
+          copy_yuv_plane_to_grid(planes[p], m_column,
+                                 m_black_yuv_image->yuv[p], i,
+                                 m_single_plane_widths[p],
+                                 m_single_plane_heights[p]);
+        }
+      });
 }
 
 }  // namespace hisui::video
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "config.hpp"
+#include "util/thread_pool.hpp"
 #include "video/composer.hpp"
 
 namespace hisui::video {
@@ -23,8 +24,8 @@ class ParallelGridComposer : public Composer {
                        const std::size_t,
                        const std::size_t,
                        const hisui::config::VideoScaler&,
-                       const libyuv::FilterMode);
-
+                       const libyuv::FilterMode,
+                       const std::size_t threads = 0);
   ~ParallelGridComposer();
 
   void compose(std::vector<unsigned char>*,
@@ -36,13 +37,15 @@ class ParallelGridComposer : public Composer {
   std::size_t m_size;
   std::size_t m_column;
   std::size_t m_row;
-  std::array<unsigned char*, 3> m_planes;
   std::array<std::size_t, 3> m_plane_sizes;
   std::array<std::uint32_t, 3> m_single_plane_widths;
   std::array<std::uint32_t, 3> m_single_plane_heights;
   std::array<unsigned char, 3> m_plane_default_values;
-  std::vector<std::shared_ptr<YUVImage>> m_scaled_images;
-  std::array<std::vector<const unsigned char*>, 3> m_srcs;
+  // canvas の各区画の stride
+  std::array<std::uint32_t, 3> m_cell_strides;
+  // images に nullptr が渡された channel に使う
+  std::shared_ptr<YUVImage> m_black_yuv_image;
+  std::shared_ptr<hisui::util::ThreadPool> m_thread_pool;
 
   // Scaler::scale() は内部buffer を返すことがあるので, Source 分用意する
   std::vector<std::unique_ptr<Scaler>> m_scalers;
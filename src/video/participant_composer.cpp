@@ -0,0 +1,76 @@
+#include "video/participant_composer.hpp"
+
+#include <fmt/core.h>
+#include <libyuv/scale.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "config.hpp"
+#include "util/thread_pool.hpp"
+#include "video/composer.hpp"
+#include "video/encoder.hpp"
+#include "video/grid_composer.hpp"
+
+namespace hisui::video {
+
+ParticipantComposer::ParticipantComposer(
+    std::shared_ptr<Composer> t_composer,
+    const std::uint32_t single_width,
+    const std::uint32_t single_height,
+    const std::vector<std::shared_ptr<Encoder>>& t_encoders,
+    const hisui::config::VideoScaler& scaler_type,
+    const libyuv::FilterMode filter_mode)
+    : m_composer(t_composer),
+      m_encoders(t_encoders),
+      m_thread_pool(std::size(t_encoders)) {
+  if (single_width == 0 || single_height == 0) {
+    throw std::invalid_argument(fmt::format(
+        "participant size is invalid: {}x{}", single_width, single_height));
+  }
+  m_width = m_composer->getWidth();
+  m_height = m_composer->getHeight();
+  for (std::size_t i = 0; i < std::size(m_encoders); ++i) {
+    m_participant_composers.push_back(std::make_unique<GridComposer>(
+        single_width, single_height, 1, 1, scaler_type, filter_mode));
+    m_participant_images.emplace_back(1);
+    m_raw_images.emplace_back(single_width * single_height * 3 >> 1);
+  }
+}
+
+void ParticipantComposer::compose(
+    std::vector<unsigned char>* raw_image,
+    const std::vector<std::shared_ptr<YUVImage>>& images) {
+  if (std::size(images) != std::size(m_encoders)) {
+    throw std::invalid_argument(
+        fmt::format("images size is invalid: expected={} actual={}",
+                    std::size(m_encoders), std::size(images)));
+  }
+  // 0 番目は合成. channel ごとの拡縮とエンコードは並列に行う
+  m_thread_pool.parallelFor(
+      std::size(m_encoders) + 1,
+      [this, raw_image, &images](const std::size_t index) {
+        if (index == 0) {
+          m_composer->compose(raw_image, images);
+          return;
+        }
+        const auto i = index - 1;
+        m_participant_images[i][0] = images[i];
+        m_participant_composers[i]->compose(&m_raw_images[i],
+                                            m_participant_images[i]);
+        // 次の合成まで画像を持ち続けないようにする
+        m_participant_images[i][0].reset();
+        m_encoders[i]->outputImage(m_raw_images[i]);
+      });
+}
+
+void ParticipantComposer::flush() {
+  m_thread_pool.parallelFor(
+      std::size(m_encoders),
+      [this](const std::size_t index) { m_encoders[index]->flush(); });
+}
+
+}  // namespace hisui::video
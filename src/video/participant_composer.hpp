@@ -0,0 +1,45 @@
+#pragma once
+
+#include <libyuv/scale.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "config.hpp"
+#include "util/thread_pool.hpp"
+#include "video/composer.hpp"
+
+namespace hisui::video {
+
+class Encoder;
+class YUVImage;
+
+// composer で合成し, 同じ画像を channel ごとに 1 区画の大きさへ拡縮して
+// channel ごとの encoder にも渡す. デコードは合成と共有する.
+// 表示されていない間は黒い画像を渡すので, どの出力も合成結果と同じ長さになる
+class ParticipantComposer : public Composer {
+ public:
+  ParticipantComposer(std::shared_ptr<Composer>,
+                      const std::uint32_t,
+                      const std::uint32_t,
+                      const std::vector<std::shared_ptr<Encoder>>&,
+                      const hisui::config::VideoScaler&,
+                      const libyuv::FilterMode);
+
+  void compose(std::vector<unsigned char>*,
+               const std::vector<std::shared_ptr<YUVImage>>&) override;
+  void flush();
+
+ private:
+  std::shared_ptr<Composer> m_composer;
+  std::vector<std::shared_ptr<Encoder>> m_encoders;
+  // channel ごとの 1 区画だけの composer と, その入力と出力
+  std::vector<std::unique_ptr<Composer>> m_participant_composers;
+  std::vector<std::vector<std::shared_ptr<YUVImage>>> m_participant_images;
+  std::vector<std::vector<unsigned char>> m_raw_images;
+  hisui::util::ThreadPool m_thread_pool;
+};
+
+}  // namespace hisui::video
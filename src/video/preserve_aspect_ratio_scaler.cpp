@@ -1,6 +1,7 @@
 #include "video/preserve_aspect_ratio_scaler.hpp"
 
 #include <bits/exception.h>
+#include <libyuv/planar_functions.h>
 #include <spdlog/fmt/bundled/format.h>
 #include <spdlog/spdlog.h>
 
@@ -21,158 +22,120 @@ PreserveAspectRatioScaler::PreserveAspectRatioScaler(
     const std::uint32_t t_width,
     const std::uint32_t t_height,
     const libyuv::FilterMode t_filter_mode)
-    : Scaler(t_width, t_height), m_filter_mode(t_filter_mode) {
-  m_intermediate = std::make_shared<YUVImage>(m_width, m_height);
-}
+    : Scaler(t_width, t_height), m_filter_mode(t_filter_mode) {}
 
-const std::shared_ptr<YUVImage> PreserveAspectRatioScaler::scale(
-    const std::shared_ptr<YUVImage> src) {
-  const auto src_width = src->getWidth(0);
-  const auto src_height = src->getHeight(0);
+const std::shared_ptr<YUVImage> PreserveAspectRatioScaler::scaleImage(
+    const std::shared_ptr<YUVImage>& src) {
+  allocate();
+  if (src->getWidth(0) == m_width && src->getHeight(0) == m_height) {
+    return passThrough(src);
+  }
+  return scaleIntoScaled(src);
+}
 
-  if (src_width == m_width && src_height == m_height) {
-    return src;
+void PreserveAspectRatioScaler::updateLayout(const std::uint32_t src_width,
+                                             const std::uint32_t src_height) {
+  if (m_layout.src_width == src_width && m_layout.src_height == src_height) {
+    return;
   }
 
   boost::rational<std::uint32_t> width_ratio(m_width, src_width);
   boost::rational<std::uint32_t> height_ratio(m_height, src_height);
 
-  if (width_ratio == height_ratio) {
-    return simpleScale(src);
-  }
-
+  // 余白のある方向は 4 の倍数に揃える. 揃えて余白がなくなる場合は単純に拡縮する
+  std::uint32_t width = m_width;
+  std::uint32_t height = m_height;
   if (width_ratio > height_ratio) {
-    return marginInWidthScale(src, src_width, height_ratio);
-  }
-  return marginInHeightScale(src, src_height, width_ratio);
-}  // namespace hisui::video
-
-const std::shared_ptr<YUVImage> PreserveAspectRatioScaler::marginInHeightScale(
-    const std::shared_ptr<YUVImage> src,
-    const std::uint32_t src_height,
-    const boost::rational<std::uint32_t>& width_ratio) {
-  const std::uint32_t intermediate_height =
-      ((boost::rational_cast<std::uint32_t>(width_ratio * src_height) + 3) >> 2)
-      << 2;
-  if (intermediate_height >= m_height) {
-    return simpleScale(src);
+    width = std::min(
+        ((boost::rational_cast<std::uint32_t>(height_ratio * src_width) + 3) >>
+         2) << 2,
+        m_width);
+  } else if (width_ratio < height_ratio) {
+    height = std::min(
+        ((boost::rational_cast<std::uint32_t>(width_ratio * src_height) + 3) >>
+         2) << 2,
+        m_height);
   }
 
-  spdlog::trace("marginInHeightScale: {}x{}", m_width, intermediate_height);
-
-  m_intermediate->setWidthAndHeight(m_width, intermediate_height);
-
-  const int ret = libyuv::I420Scale(
-      src->yuv[0], static_cast<int>(src->getWidth(0)), src->yuv[1],
-      static_cast<int>(src->getWidth(1)), src->yuv[2],
-      static_cast<int>(src->getWidth(2)), static_cast<int>(src->getWidth(0)),
-      static_cast<int>(src->getHeight(0)), m_intermediate->yuv[0],
-      static_cast<int>(m_intermediate->getWidth(0)), m_intermediate->yuv[1],
-      static_cast<int>(m_intermediate->getWidth(1)), m_intermediate->yuv[2],
-      static_cast<int>(m_intermediate->getWidth(2)),
-      static_cast<int>(m_intermediate->getWidth(0)),
-      static_cast<int>(m_intermediate->getHeight(0)), m_filter_mode);
-
-  if (ret != 0) {
-    throw std::runtime_error(
-        fmt::format("I420Scale() failed: error_code={}", ret));
+  // 揃えたことで 1/2, 1/4 からわずかにずれる場合はちょうどの大きさにする.
+  // libyuv はちょうど 1/2, 1/4 の縮小を専用の SIMD の処理で行う.
+  // 余白の中央に置いた時に輝度と色差の位置がずれないよう, 4 の倍数の場合に限る
+  for (const std::uint32_t k : {2u, 4u}) {
+    const auto exact_width = src_width / k;
+    const auto exact_height = src_height / k;
+    if (src_width % (4 * k) == 0 && src_height % (4 * k) == 0 &&
+        exact_width <= m_width && exact_height <= m_height &&
+        exact_width + 4 > width && width + 4 > exact_width &&
+        exact_height + 4 > height && height + 4 > exact_height) {
+      width = exact_width;
+      height = exact_height;
+      break;
+    }
   }
 
-  m_scaled->setBlack();
-
-  std::copy_n(m_intermediate->yuv[0],
-              m_intermediate->getWidth(0) * m_intermediate->getHeight(0),
-              m_scaled->yuv[0] + ((m_height - intermediate_height) >> 1) *
-                                     m_intermediate->getWidth(0));
-
-  std::copy_n(m_intermediate->yuv[1],
-              m_intermediate->getWidth(1) * m_intermediate->getHeight(1),
-              m_scaled->yuv[1] + ((m_height - intermediate_height) >> 2) *
-                                     m_intermediate->getWidth(1));
-
-  std::copy_n(m_intermediate->yuv[2],
-              m_intermediate->getWidth(2) * m_intermediate->getHeight(2),
-              m_scaled->yuv[2] + ((m_height - intermediate_height) >> 2) *
-                                     m_intermediate->getWidth(2));
-  return m_scaled;
+  m_layout.src_width = src_width;
+  m_layout.src_height = src_height;
+  m_layout.has_margin = width != m_width || height != m_height;
+  for_each_i420_plane([&](const auto plane) {
+    using Plane = decltype(plane);
+    const auto p = Plane::index;
+    m_layout.scaled_widths[p] = Plane::ceil(width);
+    m_layout.scaled_heights[p] = Plane::ceil(height);
+    m_layout.xs[p] = (Plane::ceil(m_width) - m_layout.scaled_widths[p]) >> 1;
+    m_layout.ys[p] = (Plane::ceil(m_height) - m_layout.scaled_heights[p]) >> 1;
+  });
+
+  spdlog::trace("PreserveAspectRatioScaler: {}x{} to {}x{} in {}x{}",
+                src_width, src_height, width, height, m_width, m_height);
 }
 
-const std::shared_ptr<YUVImage> PreserveAspectRatioScaler::marginInWidthScale(
-    const std::shared_ptr<YUVImage> src,
-    const std::uint32_t src_width,
-    const boost::rational<std::uint32_t>& height_ratio) {
-  const std::uint32_t intermediate_width =
-      ((boost::rational_cast<std::uint32_t>(height_ratio * src_width) + 3) >> 2)
-      << 2;
-  if (intermediate_width >= m_width) {
-    return simpleScale(src);
-  }
-
-  spdlog::trace("marginInWidthScale: {}x{}", intermediate_width, m_height);
-
-  m_intermediate->setWidthAndHeight(intermediate_width, m_height);
-
-  const int ret = libyuv::I420Scale(
-      src->yuv[0], static_cast<int>(src->getWidth(0)), src->yuv[1],
-      static_cast<int>(src->getWidth(1)), src->yuv[2],
-      static_cast<int>(src->getWidth(2)), static_cast<int>(src->getWidth(0)),
-      static_cast<int>(src->getHeight(0)), m_intermediate->yuv[0],
-      static_cast<int>(m_intermediate->getWidth(0)), m_intermediate->yuv[1],
-      static_cast<int>(m_intermediate->getWidth(1)), m_intermediate->yuv[2],
-      static_cast<int>(m_intermediate->getWidth(2)),
-      static_cast<int>(m_intermediate->getWidth(0)),
-      static_cast<int>(m_intermediate->getHeight(0)), m_filter_mode);
-
-  if (ret != 0) {
-    throw std::runtime_error(
-        fmt::format("I420Scale() failed: error_code={}", ret));
-  }
-
-  m_scaled->setBlack();
-
-  for (std::uint32_t h = 0, m = m_intermediate->getHeight(0); h < m; ++h) {
-    std::copy_n(
-        m_intermediate->yuv[0] + h * intermediate_width, intermediate_width,
-        m_scaled->yuv[0] + m_width * h + ((m_width - intermediate_width) >> 1));
-  }
+void PreserveAspectRatioScaler::scaleInto(
+    const YUVImageView& src,
+    const std::array<std::uint8_t*, 3>& planes,
+    const std::array<std::uint32_t, 3>& strides) {
+  const auto src_width = src.width;
+  const auto src_height = src.height;
 
-  const auto m_width2 = m_scaled->getWidth(1);
-  const auto intermediate_width2 = intermediate_width >> 1;
-  for (std::uint32_t h = 0, m = m_intermediate->getHeight(1); h < m; ++h) {
-    std::copy_n(m_intermediate->yuv[1] + h * intermediate_width2,
-                intermediate_width2,
-                m_scaled->yuv[1] + m_width2 * h +
-                    ((m_width2 - intermediate_width2) >> 1));
-  }
-
-  for (std::uint32_t h = 0, m = m_intermediate->getHeight(2); h < m; ++h) {
-    std::copy_n(m_intermediate->yuv[2] + h * intermediate_width2,
-                intermediate_width2,
-                m_scaled->yuv[2] + m_width2 * h +
-                    ((m_width2 - intermediate_width2) >> 1));
+  if (src_width == m_width && src_height == m_height) {
+    copyInto(src, planes, strides);
+    return;
   }
 
-  return m_scaled;
-}
+  updateLayout(src_width, src_height);
+
+  std::array<std::uint8_t*, 3> scaled_planes;
+  for_each_i420_plane([&](const auto plane) {
+    using Plane = decltype(plane);
+    const auto p = Plane::index;
+    const auto x = m_layout.xs[p];
+    const auto y = m_layout.ys[p];
+    scaled_planes[p] = planes[p] + y * strides[p] + x;
+    if (m_layout.has_margin) {
+      fill_yuv_plane_outside_rectangles(
+          planes[p], strides[p], Plane::ceil(m_width), Plane::ceil(m_height),
+          {{.x = x,
+            .y = y,
+            .width = m_layout.scaled_widths[p],
+            .height = m_layout.scaled_heights[p]}},
+          Plane::default_value);
+    }
+  });
 
-const std::shared_ptr<YUVImage> PreserveAspectRatioScaler::simpleScale(
-    const std::shared_ptr<YUVImage> src) {
   const int ret = libyuv::I420Scale(
-      src->yuv[0], static_cast<int>(src->getWidth(0)), src->yuv[1],
-      static_cast<int>(src->getWidth(1)), src->yuv[2],
-      static_cast<int>(src->getWidth(2)), static_cast<int>(src->getWidth(0)),
-      static_cast<int>(src->getHeight(0)), m_scaled->yuv[0],
-      static_cast<int>(m_scaled->getWidth(0)), m_scaled->yuv[1],
-      static_cast<int>(m_scaled->getWidth(1)), m_scaled->yuv[2],
-      static_cast<int>(m_scaled->getWidth(2)),
-      static_cast<int>(m_scaled->getWidth(0)),
-      static_cast<int>(m_scaled->getHeight(0)), m_filter_mode);
+      src.planes[0], static_cast<int>(src.strides[0]), src.planes[1],
+      static_cast<int>(src.strides[1]), src.planes[2],
+      static_cast<int>(src.strides[2]), static_cast<int>(src_width),
+      static_cast<int>(src_height), scaled_planes[0],
+      static_cast<int>(strides[0]), scaled_planes[1],
+      static_cast<int>(strides[1]), scaled_planes[2],
+      static_cast<int>(strides[2]),
+      static_cast<int>(m_layout.scaled_widths[0]),
+      static_cast<int>(m_layout.scaled_heights[0]), m_filter_mode);
 
   if (ret != 0) {
     throw std::runtime_error(
         fmt::format("I420Scale() failed: error_code={}", ret));
   }
-  return m_scaled;
 }
 
 }  // namespace hisui::video
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <memory>
 
@@ -7,38 +8,41 @@
 
 #include "video/scaler.hpp"
 
-namespace boost {
-
-template <typename IntType>
-class rational;
-
-}
-
 namespace hisui::video {
 
 class YUVImage;
+struct YUVImageView;
 
 class PreserveAspectRatioScaler : public Scaler {
  public:
   PreserveAspectRatioScaler(const std::uint32_t,
                             const std::uint32_t,
                             const libyuv::FilterMode);
-  const std::shared_ptr<YUVImage> scale(
-      const std::shared_ptr<YUVImage>) override;
+  // 縦横比を保って拡縮した画像を矩形の中央に置き, 余白だけを黒く塗る
+  void scaleInto(const YUVImageView&,
+                 const std::array<std::uint8_t*, 3>&,
+                 const std::array<std::uint32_t, 3>&) override;
+
+ protected:
+  const std::shared_ptr<YUVImage> scaleImage(
+      const std::shared_ptr<YUVImage>&) override;
 
  private:
   const libyuv::FilterMode m_filter_mode;
-  std::shared_ptr<YUVImage> m_intermediate;
-
-  const std::shared_ptr<YUVImage> simpleScale(const std::shared_ptr<YUVImage>);
-  const std::shared_ptr<YUVImage> marginInHeightScale(
-      const std::shared_ptr<YUVImage>,
-      const std::uint32_t,
-      const boost::rational<std::uint32_t>&);
-  const std::shared_ptr<YUVImage> marginInWidthScale(
-      const std::shared_ptr<YUVImage>,
-      const std::uint32_t,
-      const boost::rational<std::uint32_t>&);
+
+  // 元の解像度ごとの配置. 解像度が変わった時だけ求め直す
+  struct Layout {
+    std::uint32_t src_width = 0;
+    std::uint32_t src_height = 0;
+    std::array<std::uint32_t, 3> xs = {};
+    std::array<std::uint32_t, 3> ys = {};
+    std::array<std::uint32_t, 3> scaled_widths = {};
+    std::array<std::uint32_t, 3> scaled_heights = {};
+    bool has_margin = false;
+  };
+  Layout m_layout;
+
+  void updateLayout(const std::uint32_t, const std::uint32_t);
 };
 
 }  // namespace hisui::video
@@ -0,0 +1,94 @@
+#include "video/quality_meter.hpp"
+
+#include <libyuv/compare.h>
+#include <spdlog/spdlog.h>
+
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "report/reporter.hpp"
+
+namespace hisui::video {
+
+QualityMeter::QualityMeter(const std::string& t_name) : m_name(t_name) {}
+
+void QualityMeter::addSource(const std::int64_t frame,
+                             const std::vector<unsigned char>& yuv,
+                             const std::uint32_t width,
+                             const std::uint32_t height) {
+  const auto size = (width * height * 3) >> 1;
+  m_sources[frame] = Source{
+      .width = width,
+      .height = height,
+      .yuv = std::vector<unsigned char>(std::begin(yuv),
+                                        std::begin(yuv) + size),
+  };
+}
+
+void QualityMeter::measure(const std::int64_t frame,
+                           const unsigned char* const planes[3],
+                           const int strides[3],
+                           const std::uint32_t width,
+                           const std::uint32_t height) {
+  const auto it = m_sources.find(frame);
+  if (it == std::end(m_sources)) {
+    return;
+  }
+  const auto source = std::move(it->second);
+  m_sources.erase(std::begin(m_sources), std::next(it));
+  // 解像度を切り替えた直後は大きさが合わないことがある
+  if (source.width != width || source.height != height) {
+    return;
+  }
+
+  const int w = static_cast<int>(width);
+  const int h = static_cast<int>(height);
+  const int uv_w = (w + 1) >> 1;
+  const int uv_h = (h + 1) >> 1;
+  const unsigned char* src[3] = {std::data(source.yuv),
+                                 std::data(source.yuv) + w * h,
+                                 std::data(source.yuv) + w * h + uv_w * uv_h};
+  const int src_strides[3] = {w, uv_w, uv_w};
+  for (int i = 0; i < 3; ++i) {
+    m_sum_of_psnr[i] += libyuv::CalcFramePsnr(
+        src[i], src_strides[i], planes[i], strides[i], i == 0 ? w : uv_w,
+        i == 0 ? h : uv_h);
+  }
+  m_sum_of_psnr_all += libyuv::I420Psnr(
+      src[0], src_strides[0], src[1], src_strides[1], src[2], src_strides[2],
+      planes[0], strides[0], planes[1], strides[1], planes[2], strides[2], w,
+      h);
+  m_sum_of_ssim += libyuv::I420Ssim(
+      src[0], src_strides[0], src[1], src_strides[1], src[2], src_strides[2],
+      planes[0], strides[0], planes[1], strides[1], planes[2], strides[2], w,
+      h);
+  ++m_frames;
+}
+
+void QualityMeter::report() const {
+  if (m_frames == 0) {
+    return;
+  }
+  const auto frames = static_cast<double>(m_frames);
+  const hisui::report::VideoQuality quality{
+      .frames = m_frames,
+      .psnr_y = m_sum_of_psnr[0] / frames,
+      .psnr_u = m_sum_of_psnr[1] / frames,
+      .psnr_v = m_sum_of_psnr[2] / frames,
+      .psnr = m_sum_of_psnr_all / frames,
+      .ssim = m_sum_of_ssim / frames,
+  };
+  spdlog::info(
+      "video quality {}: frames={} psnr={:.2f} psnr_y={:.2f} psnr_u={:.2f} "
+      "psnr_v={:.2f} ssim={:.4f}",
+      m_name, quality.frames, quality.psnr, quality.psnr_y, quality.psnr_u,
+      quality.psnr_v, quality.ssim);
+  if (hisui::report::Reporter::hasInstance()) {
+    hisui::report::Reporter::getInstance().registerVideoQuality(m_name,
+                                                                quality);
+  }
+}
+
+}  // namespace hisui::video
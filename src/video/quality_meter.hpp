@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hisui::video {
+
+// エンコーダーに渡した合成結果と, その出力をデコードした画像を比べて PSNR と SSIM を集計する.
+// 速度の設定を変えた場合の画質の違いを, 実際の合成で確かめるためのもの
+class QualityMeter {
+ public:
+  explicit QualityMeter(const std::string&);
+
+  // frame 番目の画像としてエンコーダーに渡した I420 の画像を残す
+  void addSource(const std::int64_t frame,
+                 const std::vector<unsigned char>& yuv,
+                 const std::uint32_t width,
+                 const std::uint32_t height);
+  // frame 番目の画像をデコードした I420 の画像を, 残した画像と比べる.
+  // それまでに残した画像は出力されなかったものとして捨てる
+  void measure(const std::int64_t frame,
+               const unsigned char* const planes[3],
+               const int strides[3],
+               const std::uint32_t width,
+               const std::uint32_t height);
+  // 集計をログに出し, Reporter が開かれていれば登録する
+  void report() const;
+
+ private:
+  struct Source {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::vector<unsigned char> yuv;
+  };
+
+  std::string m_name;
+  std::map<std::int64_t, Source> m_sources;
+  std::uint64_t m_frames = 0;
+  double m_sum_of_psnr[3] = {0, 0, 0};
+  double m_sum_of_psnr_all = 0;
+  double m_sum_of_ssim = 0;
+};
+
+}  // namespace hisui::video
@@ -1,12 +1,80 @@
 #include "video/scaler.hpp"
 
+#include <libyuv/planar_functions.h>
+
 #include "video/yuv.hpp"
 
 namespace hisui::video {
 
 Scaler::Scaler(const std::uint32_t t_width, const std::uint32_t t_height)
-    : m_width(t_width), m_height(t_height) {
-  m_scaled = std::make_shared<YUVImage>(m_width, m_height);
+    : m_width(t_width), m_height(t_height) {}
+
+const std::shared_ptr<YUVImage> Scaler::scale(
+    const std::shared_ptr<YUVImage>& src) {
+  if (m_last_scaled && m_last_src_generation == src->getGeneration()) {
+    return m_last_scaled;
+  }
+  m_last_scaled = scaleImage(src);
+  if (m_last_scaled != src) {
+    m_last_scaled->updateGeneration();
+  }
+  m_last_src_generation = src->getGeneration();
+  return m_last_scaled;
+}
+
+void Scaler::scaleOrCopyInto(const std::shared_ptr<YUVImage>& src,
+                             const std::array<std::uint8_t*, 3>& planes,
+                             const std::array<std::uint32_t, 3>& strides) {
+  const auto generation = src->getGeneration();
+  const bool is_cached = m_last_scaled && m_last_src_generation == generation;
+  // 入力が合成のたびに変わる場合は, 拡縮した画像を書き込んで読み直す分を省ける
+  if (!is_cached && m_last_direct_generation != generation) {
+    scaleInto(src->getView(), planes, strides);
+    m_last_direct_generation = generation;
+    return;
+  }
+  copyInto(scale(src)->getView(), planes, strides);
+}
+
+void Scaler::release() {
+  m_scaled = nullptr;
+  m_last_src_generation = 0;
+  m_last_scaled = nullptr;
+  m_last_direct_generation = 0;
+}
+
+void Scaler::allocate() {
+  if (!m_scaled) {
+    m_scaled = std::make_shared<YUVImage>(m_width, m_height);
+  }
+}
+
+const std::shared_ptr<YUVImage> Scaler::passThrough(
+    const std::shared_ptr<YUVImage>& src) {
+  if (src->isPacked()) {
+    return src;
+  }
+  return scaleIntoScaled(src);
+}
+
+const std::shared_ptr<YUVImage> Scaler::scaleIntoScaled(
+    const std::shared_ptr<YUVImage>& src) {
+  scaleInto(src->getView(), m_scaled->yuv,
+            {m_scaled->getStride(0), m_scaled->getStride(1),
+             m_scaled->getStride(2)});
+  return m_scaled;
+}
+
+void Scaler::copyInto(const YUVImageView& src,
+                      const std::array<std::uint8_t*, 3>& planes,
+                      const std::array<std::uint32_t, 3>& strides) {
+  libyuv::I420Copy(src.planes[0], static_cast<int>(src.strides[0]),
+                   src.planes[1], static_cast<int>(src.strides[1]),
+                   src.planes[2], static_cast<int>(src.strides[2]),
+                   planes[0], static_cast<int>(strides[0]), planes[1],
+                   static_cast<int>(strides[1]), planes[2],
+                   static_cast<int>(strides[2]), static_cast<int>(m_width),
+                   static_cast<int>(m_height));
 }
 
 }  // namespace hisui::video
@@ -1,24 +1,62 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <memory>
 
 namespace hisui::video {
 
 class YUVImage;
+struct YUVImageView;
 
 class Scaler {
  public:
   Scaler(const std::uint32_t t_width, const std::uint32_t t_height);
   virtual ~Scaler() = default;
 
-  virtual const std::shared_ptr<YUVImage> scale(
-      const std::shared_ptr<YUVImage> src) = 0;
+  // src の世代が前回と同じならば, 拡縮せずに前回の結果を返す
+  const std::shared_ptr<YUVImage> scale(const std::shared_ptr<YUVImage>& src);
+  // scaleInto() に加え, src の世代が変わらない間は scale() の結果を使い回す.
+  // 新しい src は途中の画像を経由せずに直接拡縮し, 同じ src で再び呼ばれた時に
+  // 使い回すための m_scaled を作る. 書き込む矩形の内容は呼び出しごとに書き直す
+  void scaleOrCopyInto(const std::shared_ptr<YUVImage>& src,
+                       const std::array<std::uint8_t*, 3>& planes,
+                       const std::array<std::uint32_t, 3>& strides);
+  // 拡縮に使う画像を解放する. 次の scale() で作り直す
+  virtual void release();
+  // src を拡縮して, 呼び出し側の画像の中の矩形に直接書き込む.
+  // planes と strides は矩形の左上を指す. 途中の画像を経由しないので, 各画素には 1 度しか書かない
+  virtual void scaleInto(const YUVImageView& src,
+                         const std::array<std::uint8_t*, 3>& planes,
+                         const std::array<std::uint32_t, 3>& strides) = 0;
 
  protected:
+  virtual const std::shared_ptr<YUVImage> scaleImage(
+      const std::shared_ptr<YUVImage>& src) = 0;
+  virtual void allocate();
+
+  // 拡縮が不要な場合に使う. 合成側は stride == 幅を前提にしているので,
+  // デコーダーの出力を参照している場合のみ m_scaled に詰めてコピーする
+  const std::shared_ptr<YUVImage> passThrough(
+      const std::shared_ptr<YUVImage>& src);
+  // 拡縮後の m_scaled を返す
+  const std::shared_ptr<YUVImage> scaleIntoScaled(
+      const std::shared_ptr<YUVImage>& src);
+  // 拡縮が不要な場合の scaleInto()
+  void copyInto(const YUVImageView& src,
+                const std::array<std::uint8_t*, 3>& planes,
+                const std::array<std::uint32_t, 3>& strides);
+
   std::shared_ptr<YUVImage> m_scaled;
   std::uint32_t m_width;
   std::uint32_t m_height;
+
+ private:
+  // 世代はプロセス内で一意なので, プールで使い回された画像とも区別できる
+  std::uint64_t m_last_src_generation = 0;
+  std::shared_ptr<YUVImage> m_last_scaled;
+  // scaleOrCopyInto() で最後に直接拡縮した src の世代
+  std::uint64_t m_last_direct_generation = 0;
 };
 
 }  // namespace hisui::video
@@ -8,18 +8,104 @@
 #include <cmath>
 #include <cstdint>
 #include <filesystem>
+#include <future>
 #include <iterator>
+#include <memory>
 #include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "constants.hpp"
 #include "metadata.hpp"
+#include "util/file.hpp"
 #include "util/interval.hpp"
+#include "util/interval_index.hpp"
+#include "util/thread_pool.hpp"
 #include "video/image_source.hpp"
 #include "video/source.hpp"
 #include "video/webm_source.hpp"
 
 namespace hisui::video {
 
+namespace {
+
+std::vector<hisui::util::Interval> get_intervals(
+    const std::vector<SourceAndInterval>& sources) {
+  std::vector<hisui::util::Interval> intervals;
+  for (const auto& s : sources) {
+    intervals.push_back(s.second);
+  }
+  return intervals;
+}
+
+}  // namespace
+
+SourceTimeline::SourceTimeline(
+    const std::shared_ptr<std::vector<SourceAndInterval>>& sources,
+    const std::uint64_t warm_up_time)
+    : m_sources(sources),
+      m_index(get_intervals(*sources)),
+      m_warm_up_time(warm_up_time),
+      m_upcoming_index(get_intervals(*sources)),
+      m_is_warmed_up(std::size(*sources)),
+      m_tasks(std::size(*sources)) {}
+
+const SourceAndInterval* SourceTimeline::find(const std::uint64_t timestamp) {
+  m_index.find(&m_active, timestamp, timestamp + 1);
+  const auto contains = [](const std::vector<std::size_t>& v,
+                           const std::size_t i) {
+    return std::find(std::begin(v), std::end(v), i) != std::end(v);
+  };
+  for (const auto i : m_previous_active) {
+    if (contains(m_active, i)) {
+      continue;
+    }
+    auto* source = (*m_sources)[i].first.get();
+    if (m_warm_up_time == 0) {
+      source->release();
+    } else {
+      // デコーダーの破棄で合成を止めない
+      wait(i);
+      m_tasks[i] = std::async(std::launch::async,
+                              [source] { source->release(); });
+    }
+  }
+  // 区間の始まった source は, warmUp() が終わっていなければ待つ
+  for (const auto i : m_active) {
+    if (!contains(m_previous_active, i)) {
+      wait(i);
+    }
+  }
+  m_previous_active = m_active;
+
+  if (m_warm_up_time > 0) {
+    m_upcoming_index.find(&m_upcoming, timestamp + 1,
+                          timestamp + 1 + m_warm_up_time);
+    for (const auto i : m_upcoming) {
+      if (m_is_warmed_up[i] || contains(m_active, i)) {
+        continue;
+      }
+      m_is_warmed_up[i] = true;
+      auto* source = (*m_sources)[i].first.get();
+      m_tasks[i] =
+          std::async(std::launch::async, [source] { source->warmUp(); });
+    }
+  }
+
+  if (std::empty(m_active)) {
+    return nullptr;
+  }
+  return &(*m_sources)[m_active[0]];
+}
+
+void SourceTimeline::wait(const std::size_t i) {
+  if (m_tasks[i].valid()) {
+    // warmUp() の例外は getYUV() で起きた場合と同じく呼び出し元に伝える
+    m_tasks[i].get();
+  }
+}
+
 std::uint32_t Sequencer::getMaxWidth() const {
   return m_max_width;
 }
@@ -32,6 +118,44 @@ std::size_t Sequencer::getSize() const {
   return m_size;
 }
 
+const std::string& Sequencer::getConnectionID(const std::size_t index) const {
+  return m_sequence.at(index).first;
+}
+
+void Sequencer::setUpThreadPool(const std::size_t decode_threads) {
+  // 呼び出し元のスレッドもデコードを行うので, ワーカーは 1 つ少なくてよい
+  if (decode_threads > 1 && m_size > 1) {
+    m_thread_pool = std::make_unique<hisui::util::ThreadPool>(
+        std::min(decode_threads, m_size) - 1);
+  }
+}
+
+void Sequencer::setUpTimelines(const std::uint64_t warm_up_time) {
+  m_timelines = make_source_timelines(m_sequence, warm_up_time);
+}
+
+void Sequencer::getYUVsOfSequence(
+    std::vector<std::shared_ptr<YUVImage>>* yuvs,
+    const std::uint64_t timestamp) {
+  auto get_yuv = [this, yuvs, timestamp](const std::size_t i) {
+    const auto* source = m_timelines[i].find(timestamp);
+    if (source == nullptr) {
+      (*yuvs)[i] = nullptr;
+    } else {
+      (*yuvs)[i] =
+          source->first->getYUV(source->second.getSubstructLower(timestamp));
+    }
+  };
+
+  if (m_thread_pool) {
+    m_thread_pool->parallelFor(std::size(m_sequence), get_yuv);
+  } else {
+    for (std::size_t i = 0; i < std::size(m_sequence); ++i) {
+      get_yuv(i);
+    }
+  }
+}
+
 MakeSequenceResult make_sequence(
     const std::vector<hisui::ArchiveItem>& archives) {
   MakeSequenceResult result;
@@ -41,20 +165,29 @@ MakeSequenceResult make_sequence(
 
   const std::set<std::string> image_extensions({".png", ".jpg", ".jpeg"});
 
-  for (const auto& archive : archives) {
-    Source* source;
-    const auto& path = archive.getPath();
-    const auto extension = path.extension();
+  // WebM の解析とデコーダーの生成には時間がかかるので, ソースは並列に作る
+  std::vector<std::unique_ptr<Source>> sources(std::size(archives));
+  auto create_source = [&archives, &sources,
+                        &image_extensions](const std::size_t i) {
+    const auto& path = archives[i].getPath();
+    const auto extension = hisui::util::get_extension(path);
     if (extension == ".webm") {
-      source = new WebMSource(path.string());
+      sources[i] = std::make_unique<WebMSource>(path.string());
     } else if (image_extensions.contains(extension)) {
-      source = new ImageSource(path.string());
+      sources[i] = std::make_unique<ImageSource>(path.string());
     } else {
       spdlog::info("unsupported video source: {}", path.string());
+    }
+  };
+  hisui::util::parallel_for(std::size(archives), create_source);
+
+  for (std::size_t i = 0; i < std::size(archives); ++i) {
+    if (!sources[i]) {
       continue;
     }
-    const auto width = source->getWidth();
-    const auto height = source->getHeight();
+    const auto& archive = archives[i];
+    const auto width = sources[i]->getWidth();
+    const auto height = sources[i]->getHeight();
     if (width > max_width) {
       max_width = width;
     }
@@ -75,7 +208,7 @@ MakeSequenceResult make_sequence(
     } else {
       v = (*it).second;
     }
-    v->push_back({std::unique_ptr<Source>(source),
+    v->push_back({std::move(sources[i]),
                   hisui::util::Interval(static_cast<std::uint64_t>(std::floor(
                                             archive.getStartTimeOffset() *
                                             hisui::Constants::NANO_SECOND)),
@@ -87,4 +220,17 @@ MakeSequenceResult make_sequence(
   return result;
 }
 
+std::vector<SourceTimeline> make_source_timelines(
+    const std::vector<
+        std::pair<std::string,
+                  std::shared_ptr<std::vector<SourceAndInterval>>>>&
+        sequence,
+    const std::uint64_t warm_up_time) {
+  std::vector<SourceTimeline> timelines;
+  for (const auto& s : sequence) {
+    timelines.emplace_back(s.second, warm_up_time);
+  }
+  return timelines;
+}
+
 }  // namespace hisui::video
@@ -2,12 +2,15 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "util/interval.hpp"
+#include "util/interval_index.hpp"
+#include "util/thread_pool.hpp"
 
 namespace hisui {
 
@@ -23,6 +26,36 @@ class YUVImage;
 using SourceAndInterval =
     std::pair<std::unique_ptr<Source>, hisui::util::Interval>;
 
+// 1 つの channel の source から, 時刻を含む区間のものを引く.
+// 時刻が進む間は, 区間の開始と終了だけを追って引く.
+// warm_up_time (ns) が 0 でなければ, その時間の先までに始まる source を別のスレッドで
+// warmUp() し, 区間を外れた source の release() も別のスレッドで行う
+class SourceTimeline {
+ public:
+  explicit SourceTimeline(
+      const std::shared_ptr<std::vector<SourceAndInterval>>&,
+      const std::uint64_t warm_up_time = 0);
+
+  // timestamp を含む区間のうち, 最初に追加された source. なければ nullptr.
+  // 区間を外れた source は release() する
+  const SourceAndInterval* find(const std::uint64_t timestamp);
+
+ private:
+  std::shared_ptr<std::vector<SourceAndInterval>> m_sources;
+  hisui::util::IntervalIndex m_index;
+  std::vector<std::size_t> m_active;
+  std::vector<std::size_t> m_previous_active;
+
+  std::uint64_t m_warm_up_time;
+  hisui::util::IntervalIndex m_upcoming_index;
+  std::vector<std::size_t> m_upcoming;
+  std::vector<bool> m_is_warmed_up;
+  // source ごとに, 別のスレッドで行っている warmUp() か release()
+  std::vector<std::future<void>> m_tasks;
+
+  void wait(const std::size_t);
+};
+
 struct SequencerGetYUVsResult {
   const bool is_preferred_stream = false;
 };
@@ -38,14 +71,26 @@ class Sequencer {
   std::uint32_t getMaxWidth() const;
   std::uint32_t getMaxHeight() const;
   std::size_t getSize() const;
+  // getYUVs() が返す i 番目の channel の connection_id
+  const std::string& getConnectionID(const std::size_t) const;
 
  protected:
+  void setUpThreadPool(const std::size_t);
+  // warm_up_time は SourceTimeline と同じ
+  void setUpTimelines(const std::uint64_t warm_up_time = 0);
+  // 時刻を含む source がない channel には nullptr を入れる
+  void getYUVsOfSequence(std::vector<std::shared_ptr<YUVImage>>*,
+                         const std::uint64_t);
+
   std::vector<
       std::pair<std::string, std::shared_ptr<std::vector<SourceAndInterval>>>>
       m_sequence;
+  // m_sequence の channel ごと
+  std::vector<SourceTimeline> m_timelines;
   std::uint32_t m_max_width;
   std::uint32_t m_max_height;
   std::size_t m_size;
+  std::unique_ptr<hisui::util::ThreadPool> m_thread_pool;
 };
 
 struct MakeSequenceResult {
@@ -58,4 +103,10 @@ struct MakeSequenceResult {
 
 MakeSequenceResult make_sequence(const std::vector<hisui::ArchiveItem>&);
 
+std::vector<SourceTimeline> make_source_timelines(
+    const std::vector<
+        std::pair<std::string,
+                  std::shared_ptr<std::vector<SourceAndInterval>>>>&,
+    const std::uint64_t warm_up_time = 0);
+
 }  // namespace hisui::video
@@ -0,0 +1,321 @@
+#include "video/shared_frame_cache.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "video/yuv.hpp"
+
+namespace hisui::video {
+
+// 共有メモリに置くので, 全てのメンバーを std::atomic_ref で読み書きする
+struct alignas(64) SharedFrameCacheSlot {
+  // 下位 2 bit が状態, 残りは STATE_READY ならば参照カウント,
+  // STATE_WRITING ならば書き込んでいるプロセスの pid
+  std::uint64_t word;
+  std::uint64_t key;
+  std::uint64_t last_used;
+  std::uint64_t timestamp;
+  std::uint64_t width;
+  std::uint64_t height;
+};
+
+namespace {
+
+// 形式を変えた場合は値を変え, 古い形式のファイルを誤って使わないようにする
+constexpr std::uint64_t MAGIC = 0x6869737569666331;  // "hisuifc1"
+// ファイルを作ったプロセスが header を書いている間の magic
+constexpr std::uint64_t MAGIC_INITIALIZING = 1;
+
+constexpr std::uint64_t STATE_EMPTY = 0;
+constexpr std::uint64_t STATE_WRITING = 1;
+constexpr std::uint64_t STATE_READY = 2;
+constexpr std::uint64_t STATE_MASK = 3;
+constexpr std::uint64_t REFERENCE = 4;
+
+struct alignas(64) Header {
+  std::uint64_t magic;
+  // slot を使うたびに増やし, 最も長く使われていない slot を選ぶのに使う
+  std::uint64_t tick;
+  // ファイルを作ったプロセスが決めた配置. 他のプロセスは同じ配置でなければ使わない
+  std::uint64_t number_of_slots;
+  std::uint64_t slot_data_size;
+};
+
+static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+
+std::atomic_ref<std::uint64_t> ref(std::uint64_t* value) {
+  return std::atomic_ref<std::uint64_t>(*value);
+}
+
+std::uint64_t mix(std::uint64_t x) {
+  // splitmix64 の finalizer
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  x ^= x >> 31;
+  return x;
+}
+
+std::size_t get_frame_size(const std::uint32_t width,
+                           const std::uint32_t height) {
+  const std::size_t chroma = ((width + 1) >> 1) * ((height + 1) >> 1);
+  return static_cast<std::size_t>(width) * height + 2 * chroma;
+}
+
+// 書き込み中に強制終了したプロセスの slot を空きに戻すために使う.
+// pid が再利用されていれば戻せないが, 他の slot を使えば済む
+bool is_process_alive(const std::uint64_t pid) {
+  return ::kill(static_cast<::pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+std::unique_ptr<SharedFrameCache> instance;
+
+}  // namespace
+
+SharedFrameCache::SharedFrameCache(const std::string& path,
+                                   const std::size_t size)
+    : m_size(size) {
+  const auto slot_size = sizeof(SharedFrameCacheSlot) + SLOT_DATA_SIZE;
+  if (size < sizeof(Header) + WAYS * slot_size) {
+    throw std::invalid_argument(
+        fmt::format("shared frame cache is too small: size={}", size));
+  }
+  m_number_of_slots = (size - sizeof(Header)) / slot_size / WAYS * WAYS;
+
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("opening {} failed: {}", path,
+                                         std::strerror(errno)));
+  }
+  struct ::stat st;
+  // 伸ばした部分は 0 で埋まり, 全ての slot が空の状態になる
+  if (::fstat(fd, &st) == -1 ||
+      (static_cast<std::size_t>(st.st_size) < size &&
+       ::ftruncate(fd, static_cast<off_t>(size)) == -1)) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error(fmt::format("resizing {} failed: {}", path,
+                                         std::strerror(error)));
+  }
+  void* data =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(fmt::format("mmap() failed: file_path={} error={}",
+                                         path, std::strerror(error)));
+  }
+  m_data = static_cast<unsigned char*>(data);
+
+  auto* header = reinterpret_cast<Header*>(m_data);
+  std::uint64_t magic = 0;
+  if (ref(&header->magic).compare_exchange_strong(magic, MAGIC_INITIALIZING,
+                                                  std::memory_order_acquire)) {
+    ref(&header->number_of_slots)
+        .store(m_number_of_slots, std::memory_order_relaxed);
+    ref(&header->slot_data_size)
+        .store(SLOT_DATA_SIZE, std::memory_order_relaxed);
+    ref(&header->magic).store(MAGIC, std::memory_order_release);
+    magic = MAGIC;
+  }
+  // 作ったプロセスが header を書き終えるのを待つ
+  for (int i = 0; magic == MAGIC_INITIALIZING && i < 1000; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    magic = ref(&header->magic).load(std::memory_order_acquire);
+  }
+  if (magic != MAGIC) {
+    ::munmap(m_data, m_size);
+    throw std::runtime_error(
+        fmt::format("{} is not a shared frame cache of this version", path));
+  }
+  // 配置が異なると他のプロセスの画素を slot として読み書きしてしまう
+  const auto number_of_slots =
+      ref(&header->number_of_slots).load(std::memory_order_relaxed);
+  const auto slot_data_size =
+      ref(&header->slot_data_size).load(std::memory_order_relaxed);
+  if (number_of_slots != m_number_of_slots ||
+      slot_data_size != SLOT_DATA_SIZE) {
+    ::munmap(m_data, m_size);
+    throw std::runtime_error(fmt::format(
+        "{} was created with another --shared-frame-cache-size: "
+        "number_of_slots={} slot_data_size={} expected_number_of_slots={}",
+        path, number_of_slots, slot_data_size, m_number_of_slots));
+  }
+  m_slots = reinterpret_cast<SharedFrameCacheSlot*>(m_data + sizeof(Header));
+  m_slot_data = m_data + sizeof(Header) +
+                m_number_of_slots * sizeof(SharedFrameCacheSlot);
+}
+
+SharedFrameCache::~SharedFrameCache() {
+  ::munmap(m_data, m_size);
+}
+
+void SharedFrameCache::setUp(const std::string& path, const std::size_t size) {
+  if (size == 0) {
+    instance = nullptr;
+    return;
+  }
+  instance = std::make_unique<SharedFrameCache>(path, size);
+}
+
+SharedFrameCache* SharedFrameCache::getInstance() {
+  return instance.get();
+}
+
+std::uint64_t SharedFrameCache::makeKey(const std::uint64_t file_key,
+                                        const std::uint64_t timestamp,
+                                        const bool is_downscaled,
+                                        const bool key_frames_only) {
+  const std::uint64_t flags =
+      (is_downscaled ? 1 : 0) | (key_frames_only ? 2 : 0);
+  return mix(mix(file_key ^ mix(timestamp)) ^ flags);
+}
+
+std::uint64_t SharedFrameCache::tick() {
+  auto* header = reinterpret_cast<Header*>(m_data);
+  return ref(&header->tick).fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+bool SharedFrameCache::find(const std::uint64_t key,
+                            std::shared_ptr<YUVImage>* image) {
+  const auto set = key % (m_number_of_slots / WAYS) * WAYS;
+  for (std::size_t w = 0; w < WAYS; ++w) {
+    auto& slot = m_slots[set + w];
+    auto word = ref(&slot.word).load(std::memory_order_acquire);
+    if ((word & STATE_MASK) != STATE_READY ||
+        ref(&slot.key).load(std::memory_order_relaxed) != key) {
+      continue;
+    }
+    // 参照している間は追い出されない
+    if (!ref(&slot.word).compare_exchange_strong(word, word + REFERENCE,
+                                                 std::memory_order_acquire)) {
+      continue;
+    }
+    // 確かめてから参照するまでの間に, 別のフレームに置き換えられた場合がある
+    if (ref(&slot.key).load(std::memory_order_relaxed) != key) {
+      ref(&slot.word).fetch_sub(REFERENCE, std::memory_order_release);
+      continue;
+    }
+    const auto timestamp = ref(&slot.timestamp).load(std::memory_order_relaxed);
+    const auto width = static_cast<std::uint32_t>(
+        ref(&slot.width).load(std::memory_order_relaxed));
+    const auto height = static_cast<std::uint32_t>(
+        ref(&slot.height).load(std::memory_order_relaxed));
+    if (!*image) {
+      *image = std::make_shared<YUVImage>(width, height);
+    } else if ((*image)->getTimestamp() == timestamp &&
+               (*image)->checkWidthAndHeight(width, height)) {
+      ref(&slot.last_used).store(tick(), std::memory_order_relaxed);
+      ref(&slot.word).fetch_sub(REFERENCE, std::memory_order_release);
+      return true;
+    } else {
+      (*image)->setWidthAndHeight(width, height);
+    }
+    const auto* src = m_slot_data + (set + w) * SLOT_DATA_SIZE;
+    for (int p = 0; p < 3; ++p) {
+      const auto plane_width = (*image)->getWidth(p);
+      auto* dst = (*image)->yuv[static_cast<std::size_t>(p)];
+      for (std::uint32_t y = 0; y < (*image)->getHeight(p); ++y) {
+        std::memcpy(dst + y * (*image)->getStride(p), src, plane_width);
+        src += plane_width;
+      }
+    }
+    (*image)->setTimestamp(timestamp);
+    ref(&slot.last_used).store(tick(), std::memory_order_relaxed);
+    ref(&slot.word).fetch_sub(REFERENCE, std::memory_order_release);
+    return true;
+  }
+  return false;
+}
+
+void SharedFrameCache::insert(const std::uint64_t key, const YUVImage& image) {
+  const auto width = image.getWidth(0);
+  const auto height = image.getHeight(0);
+  if (get_frame_size(width, height) > SLOT_DATA_SIZE) {
+    return;
+  }
+  const auto set = key % (m_number_of_slots / WAYS) * WAYS;
+  SharedFrameCacheSlot* victim = nullptr;
+  std::uint64_t victim_word = 0;
+  std::uint64_t victim_last_used = 0;
+  for (std::size_t w = 0; w < WAYS; ++w) {
+    auto& slot = m_slots[set + w];
+    auto word = ref(&slot.word).load(std::memory_order_acquire);
+    auto state = word & STATE_MASK;
+    if (state == STATE_READY &&
+        ref(&slot.key).load(std::memory_order_relaxed) == key) {
+      return;
+    }
+    if (state == STATE_WRITING && !is_process_alive(word >> 2) &&
+        ref(&slot.word).compare_exchange_strong(word, STATE_EMPTY,
+                                                std::memory_order_acquire)) {
+      word = STATE_EMPTY;
+      state = STATE_EMPTY;
+    }
+    // 参照されている slot と書き込み中の slot は追い出さない
+    if (word != STATE_EMPTY && word != STATE_READY) {
+      continue;
+    }
+    // 空いた slot があればそれを使い, 無ければ最も長く使われていないものを追い出す
+    if (state == STATE_EMPTY) {
+      victim = &slot;
+      victim_word = word;
+      break;
+    }
+    const auto last_used =
+        ref(&slot.last_used).load(std::memory_order_relaxed);
+    if (victim == nullptr || last_used < victim_last_used) {
+      victim = &slot;
+      victim_word = word;
+      victim_last_used = last_used;
+    }
+  }
+  // 他のプロセスが先に使った場合は置かずに諦める
+  const auto writing =
+      STATE_WRITING | static_cast<std::uint64_t>(::getpid()) << 2;
+  if (victim == nullptr ||
+      !ref(&victim->word).compare_exchange_strong(victim_word, writing,
+                                                  std::memory_order_acquire)) {
+    return;
+  }
+
+  ref(&victim->key).store(key, std::memory_order_relaxed);
+  ref(&victim->timestamp)
+      .store(image.getTimestamp(), std::memory_order_relaxed);
+  ref(&victim->width).store(width, std::memory_order_relaxed);
+  ref(&victim->height).store(height, std::memory_order_relaxed);
+  ref(&victim->last_used).store(tick(), std::memory_order_relaxed);
+  auto* dst = m_slot_data +
+              static_cast<std::size_t>(victim - m_slots) * SLOT_DATA_SIZE;
+  for (int p = 0; p < 3; ++p) {
+    const auto plane_width = image.getWidth(p);
+    const auto* src = image.yuv[static_cast<std::size_t>(p)];
+    for (std::uint32_t y = 0; y < image.getHeight(p); ++y) {
+      std::memcpy(dst, src + y * image.getStride(p), plane_width);
+      dst += plane_width;
+    }
+  }
+  ref(&victim->word).store(STATE_READY, std::memory_order_release);
+}
+
+std::size_t SharedFrameCache::getNumberOfSlots() const {
+  return m_number_of_slots;
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace hisui::video {
+
+class YUVImage;
+
+struct SharedFrameCacheSlot;
+
+// 同じホストで同じ入力を合成する複数のプロセスが, デコードしたフレームを共有するためのキャッシュ.
+// 話者表示と一覧表示のように 1 つの録画から複数のレイアウトを同時に合成する場合に,
+// 後から合成するプロセスはキャッシュにあるフレームをデコードせずに使う.
+// ファイルを mmap() して固定の大きさの slot に分け, key のハッシュで決まる WAYS 個の slot から引く.
+// slot は参照カウントを持ち, 参照されていない slot のうち最も長く使われていないものを追い出す.
+// slot の数はファイルを作ったプロセスが決めてファイルに書き, 異なる大きさを指定したプロセスは開けない
+class SharedFrameCache {
+ public:
+  // 1 つの key を置ける slot の数
+  static constexpr std::size_t WAYS = 8;
+  // 1 つの slot に置ける I420 の大きさ. これより大きいフレームは置かない
+  static constexpr std::size_t SLOT_DATA_SIZE = 1920 * 1088 * 3 / 2;
+
+  // path のファイルを size バイトに伸ばして mmap() する.
+  // 既にあるファイルが異なる size で作られていれば std::runtime_error を投げる
+  SharedFrameCache(const std::string& path, const std::size_t size);
+  ~SharedFrameCache();
+
+  SharedFrameCache(const SharedFrameCache&) = delete;
+  SharedFrameCache& operator=(const SharedFrameCache&) = delete;
+
+  // size が 0 ならば使わない. 合成を始める前に呼ぶ
+  static void setUp(const std::string& path, const std::size_t size);
+  // setUp() していなければ nullptr を返す
+  static SharedFrameCache* getInstance();
+
+  // 入力のファイルを表す key に, デコードの結果を変えうる条件を加えた key を作る.
+  // is_downscaled は縮小して表示するためにデコードを軽くしうるか
+  static std::uint64_t makeKey(const std::uint64_t file_key,
+                               const std::uint64_t timestamp,
+                               const bool is_downscaled,
+                               const bool key_frames_only);
+
+  // 見つかれば image に写して true を返す. image が空ならば作る.
+  // image が既に同じフレームを持っていれば写さない
+  bool find(const std::uint64_t key, std::shared_ptr<YUVImage>* image);
+  // 既に同じ key があるか, 空けられる slot が無ければ何もしない
+  void insert(const std::uint64_t key, const YUVImage& image);
+
+  std::size_t getNumberOfSlots() const;
+
+ private:
+  std::size_t m_size;
+  unsigned char* m_data = nullptr;
+  SharedFrameCacheSlot* m_slots = nullptr;
+  unsigned char* m_slot_data = nullptr;
+  std::size_t m_number_of_slots = 0;
+
+  std::uint64_t tick();
+};
+
+}  // namespace hisui::video
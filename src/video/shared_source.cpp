@@ -0,0 +1,57 @@
+#include "video/shared_source.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace hisui::video {
+
+SharedSource::SharedSource(const std::shared_ptr<Source>& t_source)
+    : m_source(t_source) {}
+
+const std::shared_ptr<YUVImage>& SharedSource::getYUV(
+    const std::uint64_t timestamp) {
+  // 他の consumer が次の画像に差し替えても参照が切れないよう, スレッドごとに保持する
+  thread_local std::shared_ptr<YUVImage> yuv_image;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  yuv_image = m_source->getYUV(timestamp);
+  return yuv_image;
+}
+
+std::uint32_t SharedSource::getWidth() const {
+  return m_source->getWidth();
+}
+
+std::uint32_t SharedSource::getHeight() const {
+  return m_source->getHeight();
+}
+
+// 同じファイルの source は同じ区間を持つので, 1 つの consumer が区間を過ぎれば
+// 他の consumer も getYUV() しない
+void SharedSource::release() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_source->release();
+}
+
+void SharedSource::warmUp() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_source->warmUp();
+}
+
+void SharedSource::setDisplaySize(const std::uint32_t width,
+                                  const std::uint32_t height) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_source->setDisplaySize(width, height);
+}
+
+void SharedSource::setKeyFramesOnly(const bool key_frames_only) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_source->setKeyFramesOnly(key_frames_only);
+}
+
+void SharedSource::setDegradedKeyFramesOnly(const bool key_frames_only) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_source->setDegradedKeyFramesOnly(key_frames_only);
+}
+
+}  // namespace hisui::video
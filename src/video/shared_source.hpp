@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "video/source.hpp"
+
+namespace hisui::video {
+
+class YUVImage;
+
+// 同じファイルを参照する複数の region や cell で 1 つの source (デコーダー) を使う.
+// cell は並列に描画されるので, source の呼び出しを排他する
+class SharedSource : public Source {
+ public:
+  explicit SharedSource(const std::shared_ptr<Source>&);
+  const std::shared_ptr<YUVImage>& getYUV(const std::uint64_t) override;
+  std::uint32_t getWidth() const override;
+  std::uint32_t getHeight() const override;
+  void release() override;
+  void warmUp() override;
+  void setDisplaySize(const std::uint32_t, const std::uint32_t) override;
+  void setKeyFramesOnly(const bool) override;
+  void setDegradedKeyFramesOnly(const bool) override;
+
+ private:
+  std::shared_ptr<Source> m_source;
+  std::mutex m_mutex;
+};
+
+}  // namespace hisui::video
@@ -15,27 +15,35 @@ SimpleScaler::SimpleScaler(const std::uint32_t t_width,
                            const libyuv::FilterMode t_filter_mode)
     : Scaler(t_width, t_height), m_filter_mode(t_filter_mode) {}
 
-const std::shared_ptr<YUVImage> SimpleScaler::scale(
-    const std::shared_ptr<YUVImage> src) {
+const std::shared_ptr<YUVImage> SimpleScaler::scaleImage(
+    const std::shared_ptr<YUVImage>& src) {
+  allocate();
   if (src->getWidth(0) == m_width && src->getHeight(0) == m_height) {
-    return src;
+    return passThrough(src);
+  }
+  return scaleIntoScaled(src);
+}
+
+void SimpleScaler::scaleInto(const YUVImageView& src,
+                             const std::array<std::uint8_t*, 3>& planes,
+                             const std::array<std::uint32_t, 3>& strides) {
+  if (src.width == m_width && src.height == m_height) {
+    copyInto(src, planes, strides);
+    return;
   }
   const int ret = libyuv::I420Scale(
-      src->yuv[0], static_cast<int>(src->getWidth(0)), src->yuv[1],
-      static_cast<int>(src->getWidth(1)), src->yuv[2],
-      static_cast<int>(src->getWidth(2)), static_cast<int>(src->getWidth(0)),
-      static_cast<int>(src->getHeight(0)), m_scaled->yuv[0],
-      static_cast<int>(m_scaled->getWidth(0)), m_scaled->yuv[1],
-      static_cast<int>(m_scaled->getWidth(1)), m_scaled->yuv[2],
-      static_cast<int>(m_scaled->getWidth(2)),
-      static_cast<int>(m_scaled->getWidth(0)),
-      static_cast<int>(m_scaled->getHeight(0)), m_filter_mode);
+      src.planes[0], static_cast<int>(src.strides[0]), src.planes[1],
+      static_cast<int>(src.strides[1]), src.planes[2],
+      static_cast<int>(src.strides[2]), static_cast<int>(src.width),
+      static_cast<int>(src.height), planes[0],
+      static_cast<int>(strides[0]), planes[1], static_cast<int>(strides[1]),
+      planes[2], static_cast<int>(strides[2]), static_cast<int>(m_width),
+      static_cast<int>(m_height), m_filter_mode);
 
   if (ret != 0) {
     throw std::runtime_error(
         fmt::format("I420Scale() failed: error_code={}", ret));
   }
-  return m_scaled;
 }
 
 }  // namespace hisui::video
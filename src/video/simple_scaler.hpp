@@ -2,6 +2,7 @@
 
 #include <libyuv/scale.h>
 
+#include <array>
 #include <cstdint>
 #include <memory>
 
@@ -10,16 +11,22 @@
 namespace hisui::video {
 
 class YUVImage;
+struct YUVImageView;
 
 class SimpleScaler : public Scaler {
  public:
   SimpleScaler(const std::uint32_t,
                const std::uint32_t,
                const libyuv::FilterMode);
-  const std::shared_ptr<YUVImage> scale(
-      const std::shared_ptr<YUVImage> src) override;
+  void scaleInto(const YUVImageView&,
+                 const std::array<std::uint8_t*, 3>&,
+                 const std::array<std::uint32_t, 3>&) override;
 
   const libyuv::FilterMode m_filter_mode;
+
+ protected:
+  const std::shared_ptr<YUVImage> scaleImage(
+      const std::shared_ptr<YUVImage>& src) override;
 };
 
 }  // namespace hisui::video
@@ -10,9 +10,23 @@ class YUVImage;
 class Source {
  public:
   virtual ~Source() = default;
-  virtual const std::shared_ptr<YUVImage> getYUV(const std::uint64_t) = 0;
+  virtual const std::shared_ptr<YUVImage>& getYUV(const std::uint64_t) = 0;
   virtual std::uint32_t getWidth() const = 0;
   virtual std::uint32_t getHeight() const = 0;
+  // 次に getYUV() するまで不要なデコーダーなどを解放する
+  virtual void release() {}
+  // 区間の始まる前に別のスレッドから呼び, ファイルを開いて最初のフレームをデコードしておく.
+  // getYUV() や release() と同時には呼ばない
+  virtual void warmUp() {}
+  // 表示する大きさを伝える. 縮小して表示する場合にデコードを軽くするために使う.
+  // 複数回呼ばれた場合は最も大きいものを使う
+  virtual void setDisplaySize(const std::uint32_t, const std::uint32_t) {}
+  // 小さく表示して動きが目立たないので, キーフレームのみをデコードしてよいかを伝える.
+  // 複数回呼ばれた場合は, 全てで許された場合のみキーフレームのみをデコードする
+  virtual void setKeyFramesOnly(const bool) {}
+  // 処理が出力に追いつかない間だけ, setKeyFramesOnly() によらずキーフレームのみをデコードさせる.
+  // setKeyFramesOnly() と違い途中で戻せる. 戻した後は次のキーフレームから全てをデコードする
+  virtual void setDegradedKeyFramesOnly(const bool) {}
 };
 
 }  // namespace hisui::video
@@ -0,0 +1,494 @@
+#include "video/vaapi_h264_encoder.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <libyuv/convert_from.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+#include <va/va.h>
+#include <va/va_drm.h>
+#include <va/va_enc_h264.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "config.hpp"
+#include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
+#include "video/codec_probe.hpp"
+
+namespace hisui::video {
+
+namespace {
+
+constexpr int RENDER_NODE_START_INDEX = 128;
+constexpr int MAX_RENDER_NODES = 16;
+
+// frame_num と pic_order_cnt_lsb はどちらも 16 bit にする
+constexpr std::uint32_t LOG2_MAX_FRAME_NUM_MINUS4 = 12;
+constexpr std::uint32_t LOG2_MAX_PIC_ORDER_CNT_LSB_MINUS4 = 12;
+
+constexpr std::uint8_t SLICE_TYPE_P = 0;
+constexpr std::uint8_t SLICE_TYPE_I = 2;
+
+void check_va(const ::VAStatus status, const char* name) {
+  if (status != VA_STATUS_SUCCESS) {
+    throw std::runtime_error(
+        fmt::format("{} failed: {}", name, ::vaErrorStr(status)));
+  }
+}
+
+void log_va_info(void*, const char* message) {
+  spdlog::debug("libva: {}", message);
+}
+
+struct Device {
+  int fd;
+  ::VADisplay display;
+  ::VAProfile profile;
+  ::VAEntrypoint entrypoint;
+};
+
+// Main を優先し, 無ければ Constrained Baseline を使う.
+// 通常の entrypoint が無い GPU もあるので, その場合は LowPower の方を使う
+bool find_h264_encoder(::VADisplay display,
+                       ::VAProfile* profile,
+                       ::VAEntrypoint* entrypoint) {
+  std::vector<::VAEntrypoint> entrypoints(
+      static_cast<std::size_t>(::vaMaxNumEntrypoints(display)));
+  for (const auto p :
+       {::VAProfileH264Main, ::VAProfileH264ConstrainedBaseline}) {
+    int n = 0;
+    if (::vaQueryConfigEntrypoints(display, p, entrypoints.data(), &n) !=
+        VA_STATUS_SUCCESS) {
+      continue;
+    }
+    const auto end = std::begin(entrypoints) + n;
+    for (const auto e : {::VAEntrypointEncSlice, ::VAEntrypointEncSliceLP}) {
+      if (std::find(std::begin(entrypoints), end, e) != end) {
+        *profile = p;
+        *entrypoint = e;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// oneVPL 向けの CreateDRMLibVA() は Intel の GPU しか開かないので, ドライバーを問わずに探す
+std::optional<Device> open_device() {
+  for (int i = 0; i < MAX_RENDER_NODES; ++i) {
+    const auto path =
+        fmt::format("/dev/dri/renderD{}", RENDER_NODE_START_INDEX + i);
+    const int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+      continue;
+    }
+    Device device{.fd = fd,
+                  .display = ::vaGetDisplayDRM(fd),
+                  .profile = ::VAProfileNone,
+                  .entrypoint = ::VAEntrypointEncSlice};
+    if (device.display) {
+      ::vaSetInfoCallback(device.display, log_va_info, nullptr);
+      int major_version = 0;
+      int minor_version = 0;
+      if (::vaInitialize(device.display, &major_version, &minor_version) ==
+              VA_STATUS_SUCCESS &&
+          find_h264_encoder(device.display, &device.profile,
+                            &device.entrypoint)) {
+        spdlog::debug("VA-API H.264 encoder: device={} driver={}", path,
+                      ::vaQueryVendorString(device.display));
+        return device;
+      }
+      ::vaTerminate(device.display);
+    }
+    ::close(fd);
+  }
+  return std::nullopt;
+}
+
+::VAPictureH264 make_invalid_picture() {
+  ::VAPictureH264 picture;
+  std::memset(&picture, 0, sizeof(picture));
+  picture.picture_id = VA_INVALID_SURFACE;
+  picture.flags = VA_PICTURE_H264_INVALID;
+  return picture;
+}
+
+}  // namespace
+
+VAAPIH264EncoderConfig::VAAPIH264EncoderConfig(const std::uint32_t t_width,
+                                               const std::uint32_t t_height,
+                                               const hisui::Config& config)
+    : width(t_width),
+      height(t_height),
+      fps(config.out_video_frame_rate),
+      target_bit_rate(config.out_video_bit_rate * 1000),
+      keyframe_interval(config.getVideoKeyframeInterval()) {}
+
+bool VAAPIH264Encoder::isSupported() {
+  return probe_codec(fmt::format("vaapi_encoder_{:x}",
+                                 hisui::Constants::H264_FOURCC),
+                     [] {
+                       auto device = open_device();
+                       if (!device) {
+                         return false;
+                       }
+                       ::vaTerminate(device->display);
+                       ::close(device->fd);
+                       return true;
+                     });
+}
+
+VAAPIH264Encoder::VAAPIH264Encoder(hisui::FrameQueue* t_buffer,
+                                   const VAAPIH264EncoderConfig& t_config,
+                                   const std::uint64_t t_timescale)
+    : m_width(t_config.width),
+      m_height(t_config.height),
+      m_width_in_mbs((t_config.width + 15) / 16),
+      m_height_in_mbs((t_config.height + 15) / 16),
+      m_bitrate(t_config.target_bit_rate),
+      m_fps(t_config.fps),
+      m_keyframe_interval(t_config.keyframe_interval),
+      m_buffer(t_buffer),
+      m_timescale(t_timescale),
+      m_key_frames(t_config.keyframe_interval),
+      m_last_picture(make_invalid_picture()) {
+  auto device = open_device();
+  if (!device) {
+    throw std::runtime_error("VA-API H.264 encoder is not found");
+  }
+  m_fd = device->fd;
+  m_display = device->display;
+  m_profile = device->profile;
+
+  try {
+    ::VAConfigAttrib attribs[2];
+    attribs[0].type = ::VAConfigAttribRTFormat;
+    attribs[1].type = ::VAConfigAttribRateControl;
+    check_va(::vaGetConfigAttributes(m_display, m_profile, device->entrypoint,
+                                     attribs, 2),
+             "vaGetConfigAttributes()");
+    if ((attribs[0].value & VA_RT_FORMAT_YUV420) == 0) {
+      throw std::runtime_error("VA-API H.264 encoder does not support YUV420");
+    }
+    // oneVPL の場合と同じく VBR を優先する
+    if ((attribs[1].value & VA_RC_VBR) != 0) {
+      m_rate_control = VA_RC_VBR;
+    } else if ((attribs[1].value & VA_RC_CBR) != 0) {
+      m_rate_control = VA_RC_CBR;
+    } else {
+      m_rate_control = VA_RC_CQP;
+    }
+    attribs[0].value = VA_RT_FORMAT_YUV420;
+    attribs[1].value = m_rate_control;
+    check_va(::vaCreateConfig(m_display, m_profile, device->entrypoint,
+                              attribs, 2, &m_config),
+             "vaCreateConfig()");
+
+    const auto aligned_width = m_width_in_mbs * 16;
+    const auto aligned_height = m_height_in_mbs * 16;
+    std::array<::VASurfaceID, 3> surfaces;
+    check_va(::vaCreateSurfaces(m_display, VA_RT_FORMAT_YUV420, aligned_width,
+                                aligned_height, surfaces.data(),
+                                std::size(surfaces), nullptr, 0),
+             "vaCreateSurfaces()");
+    m_input_surface = surfaces[0];
+    m_reference_surfaces = {surfaces[1], surfaces[2]};
+    check_va(::vaCreateContext(
+                 m_display, m_config, static_cast<int>(aligned_width),
+                 static_cast<int>(aligned_height), VA_PROGRESSIVE,
+                 surfaces.data(), static_cast<int>(std::size(surfaces)),
+                 &m_context),
+             "vaCreateContext()");
+    // 圧縮前の NV12 の画像より大きくなることはないとみなす
+    check_va(::vaCreateBuffer(m_display, m_context, ::VAEncCodedBufferType,
+                              aligned_width * aligned_height * 3 / 2, 1,
+                              nullptr, &m_coded_buffer),
+             "vaCreateBuffer()");
+  } catch (...) {
+    release();
+    throw;
+  }
+  spdlog::debug("VAAPIH264Encoder: profile={} rate_control={:x}",
+                ::vaProfileStr(m_profile), m_rate_control);
+}
+
+VAAPIH264Encoder::~VAAPIH264Encoder() {
+  if (m_frame > 0) {
+    spdlog::debug("VAAPIH264Encoder: number of frames: {}", m_frame);
+    spdlog::debug("VAAPIH264Encoder: final average bitrate (kbps): {}",
+                  m_sum_of_bits * m_fps.numerator() / m_fps.denominator() /
+                      m_frame / 1024);
+  }
+  release();
+}
+
+void VAAPIH264Encoder::release() {
+  if (m_coded_buffer != VA_INVALID_ID) {
+    ::vaDestroyBuffer(m_display, m_coded_buffer);
+  }
+  if (m_context != VA_INVALID_ID) {
+    ::vaDestroyContext(m_display, m_context);
+  }
+  if (m_input_surface != VA_INVALID_SURFACE) {
+    std::array<::VASurfaceID, 3> surfaces = {
+        m_input_surface, m_reference_surfaces[0], m_reference_surfaces[1]};
+    ::vaDestroySurfaces(m_display, surfaces.data(),
+                        static_cast<int>(std::size(surfaces)));
+  }
+  if (m_config != VA_INVALID_ID) {
+    ::vaDestroyConfig(m_display, m_config);
+  }
+  ::vaTerminate(m_display);
+  ::close(m_fd);
+}
+
+void VAAPIH264Encoder::outputImage(const std::vector<unsigned char>& yuv) {
+  uploadImage(yuv);
+  encodeFrame(m_key_frames.next(static_cast<std::int64_t>(m_frame)));
+  ++m_frame;
+}
+
+void VAAPIH264Encoder::forceKeyFrame() {
+  m_key_frames.forceKeyFrame();
+}
+
+// 1 フレームずつ同期してエンコードするので, エンコーダー内に残るフレームはない
+void VAAPIH264Encoder::flush() {}
+
+std::uint32_t VAAPIH264Encoder::getFourcc() const {
+  return hisui::Constants::H264_FOURCC;
+}
+
+void VAAPIH264Encoder::uploadImage(const std::vector<unsigned char>& yuv) {
+  ::VAImage image;
+  check_va(::vaDeriveImage(m_display, m_input_surface, &image),
+           "vaDeriveImage()");
+  void* p = nullptr;
+  auto status = ::vaMapBuffer(m_display, image.buf, &p);
+  if (status == VA_STATUS_SUCCESS) {
+    if (image.format.fourcc == VA_FOURCC_NV12) {
+      auto data = static_cast<std::uint8_t*>(p);
+      const auto yuv_data = yuv.data();
+      libyuv::I420ToNV12(
+          yuv_data, static_cast<int>(m_width), yuv_data + m_width * m_height,
+          static_cast<int>(m_width >> 1),
+          yuv_data + m_width * m_height + ((m_width * m_height) >> 2),
+          static_cast<int>(m_width >> 1), data + image.offsets[0],
+          static_cast<int>(image.pitches[0]), data + image.offsets[1],
+          static_cast<int>(image.pitches[1]), static_cast<int>(m_width),
+          static_cast<int>(m_height));
+    }
+    ::vaUnmapBuffer(m_display, image.buf);
+  }
+  ::vaDestroyImage(m_display, image.image_id);
+  check_va(status, "vaMapBuffer()");
+  if (image.format.fourcc != VA_FOURCC_NV12) {
+    throw std::runtime_error(
+        fmt::format("unsupported VA-API surface format: fourcc={:x}",
+                    image.format.fourcc));
+  }
+}
+
+void VAAPIH264Encoder::encodeFrame(const bool is_key_frame) {
+  if (is_key_frame) {
+    if (m_frame > 0) {
+      ++m_idr_pic_id;
+    }
+    m_frame_in_gop = 0;
+    m_last_picture = make_invalid_picture();
+  }
+  renderParameters(is_key_frame);
+  outputCodedBuffer(is_key_frame);
+
+  m_last_picture.picture_id = m_reference_surfaces[m_current_reference];
+  m_last_picture.frame_idx = m_frame_in_gop;
+  m_last_picture.flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+  m_last_picture.TopFieldOrderCnt =
+      static_cast<std::int32_t>(m_frame_in_gop * 2);
+  m_last_picture.BottomFieldOrderCnt = m_last_picture.TopFieldOrderCnt;
+  m_current_reference ^= 1;
+  ++m_frame_in_gop;
+}
+
+void VAAPIH264Encoder::renderParameters(const bool is_key_frame) {
+  std::vector<::VABufferID> buffers;
+  auto create_buffer = [this, &buffers](const ::VABufferType type,
+                                        const std::size_t size, void* data) {
+    ::VABufferID id;
+    check_va(::vaCreateBuffer(m_display, m_context, type,
+                              static_cast<unsigned int>(size), 1, data, &id),
+             "vaCreateBuffer()");
+    buffers.push_back(id);
+  };
+  auto destroy_buffers = [this, &buffers] {
+    for (const auto id : buffers) {
+      ::vaDestroyBuffer(m_display, id);
+    }
+  };
+
+  const auto frame_num = static_cast<std::uint16_t>(m_frame_in_gop);
+  const auto poc = static_cast<std::int32_t>(m_frame_in_gop * 2);
+
+  try {
+    if (is_key_frame) {
+      ::VAEncSequenceParameterBufferH264 seq;
+      std::memset(&seq, 0, sizeof(seq));
+      seq.seq_parameter_set_id = 0;
+      // 8192 マクロブロックを超える 1080p より大きい解像度は 5.1 にする
+      seq.level_idc = m_width_in_mbs * m_height_in_mbs > 8192 ? 51 : 41;
+      // フレームの種類は下の picture パラメーターで決めるので, レート制御の参考にだけ使われる
+      seq.intra_period = m_keyframe_interval;
+      seq.intra_idr_period = m_keyframe_interval;
+      seq.ip_period = 1;
+      seq.bits_per_second = m_bitrate;
+      seq.max_num_ref_frames = 1;
+      seq.picture_width_in_mbs = static_cast<std::uint16_t>(m_width_in_mbs);
+      seq.picture_height_in_mbs = static_cast<std::uint16_t>(m_height_in_mbs);
+      seq.seq_fields.bits.chroma_format_idc = 1;
+      seq.seq_fields.bits.frame_mbs_only_flag = 1;
+      seq.seq_fields.bits.direct_8x8_inference_flag = 1;
+      seq.seq_fields.bits.log2_max_frame_num_minus4 = LOG2_MAX_FRAME_NUM_MINUS4;
+      seq.seq_fields.bits.pic_order_cnt_type = 0;
+      seq.seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 =
+          LOG2_MAX_PIC_ORDER_CNT_LSB_MINUS4;
+      if (m_width_in_mbs * 16 != m_width || m_height_in_mbs * 16 != m_height) {
+        // 4:2:0 なので 2 ピクセル単位で指定する
+        seq.frame_cropping_flag = 1;
+        seq.frame_crop_right_offset = (m_width_in_mbs * 16 - m_width) / 2;
+        seq.frame_crop_bottom_offset = (m_height_in_mbs * 16 - m_height) / 2;
+      }
+      seq.vui_parameters_present_flag = 1;
+      seq.vui_fields.bits.timing_info_present_flag = 1;
+      seq.num_units_in_tick = static_cast<std::uint32_t>(m_fps.denominator());
+      seq.time_scale = static_cast<std::uint32_t>(m_fps.numerator() * 2);
+      create_buffer(::VAEncSequenceParameterBufferType, sizeof(seq), &seq);
+
+      if (m_rate_control != VA_RC_CQP) {
+        std::vector<std::uint8_t> misc(
+            sizeof(::VAEncMiscParameterBuffer) +
+            sizeof(::VAEncMiscParameterRateControl));
+        auto header =
+            reinterpret_cast<::VAEncMiscParameterBuffer*>(misc.data());
+        header->type = ::VAEncMiscParameterTypeRateControl;
+        auto rc = reinterpret_cast<::VAEncMiscParameterRateControl*>(
+            header->data);
+        rc->bits_per_second = m_bitrate;
+        rc->target_percentage = 100;
+        rc->window_size = 1000;
+        create_buffer(::VAEncMiscParameterBufferType, std::size(misc),
+                      misc.data());
+      }
+
+      std::vector<std::uint8_t> misc(sizeof(::VAEncMiscParameterBuffer) +
+                                     sizeof(::VAEncMiscParameterFrameRate));
+      auto header = reinterpret_cast<::VAEncMiscParameterBuffer*>(misc.data());
+      header->type = ::VAEncMiscParameterTypeFrameRate;
+      auto frame_rate =
+          reinterpret_cast<::VAEncMiscParameterFrameRate*>(header->data);
+      // 下位 16 bit が分子, 上位 16 bit が分母
+      frame_rate->framerate =
+          static_cast<std::uint32_t>((m_fps.denominator() << 16) |
+                                     (m_fps.numerator() & 0xffff));
+      create_buffer(::VAEncMiscParameterBufferType, std::size(misc),
+                    misc.data());
+    }
+
+    ::VAEncPictureParameterBufferH264 pic;
+    std::memset(&pic, 0, sizeof(pic));
+    pic.CurrPic.picture_id = m_reference_surfaces[m_current_reference];
+    pic.CurrPic.frame_idx = frame_num;
+    pic.CurrPic.TopFieldOrderCnt = poc;
+    pic.CurrPic.BottomFieldOrderCnt = poc;
+    for (auto& reference : pic.ReferenceFrames) {
+      reference = make_invalid_picture();
+    }
+    if (!is_key_frame) {
+      pic.ReferenceFrames[0] = m_last_picture;
+    }
+    pic.coded_buf = m_coded_buffer;
+    pic.pic_parameter_set_id = 0;
+    pic.seq_parameter_set_id = 0;
+    pic.frame_num = frame_num;
+    pic.pic_init_qp = 26;
+    pic.num_ref_idx_l0_active_minus1 = 0;
+    pic.pic_fields.bits.idr_pic_flag = is_key_frame ? 1 : 0;
+    pic.pic_fields.bits.reference_pic_flag = 1;
+    pic.pic_fields.bits.entropy_coding_mode_flag =
+        m_profile == ::VAProfileH264ConstrainedBaseline ? 0 : 1;
+    pic.pic_fields.bits.deblocking_filter_control_present_flag = 1;
+    create_buffer(::VAEncPictureParameterBufferType, sizeof(pic), &pic);
+
+    ::VAEncSliceParameterBufferH264 slice;
+    std::memset(&slice, 0, sizeof(slice));
+    slice.macroblock_address = 0;
+    slice.num_macroblocks = m_width_in_mbs * m_height_in_mbs;
+    slice.macroblock_info = VA_INVALID_ID;
+    slice.slice_type = is_key_frame ? SLICE_TYPE_I : SLICE_TYPE_P;
+    slice.pic_parameter_set_id = 0;
+    slice.idr_pic_id = m_idr_pic_id;
+    slice.pic_order_cnt_lsb = static_cast<std::uint16_t>(poc);
+    for (auto& reference : slice.RefPicList0) {
+      reference = make_invalid_picture();
+    }
+    for (auto& reference : slice.RefPicList1) {
+      reference = make_invalid_picture();
+    }
+    if (!is_key_frame) {
+      slice.RefPicList0[0] = m_last_picture;
+    }
+    create_buffer(::VAEncSliceParameterBufferType, sizeof(slice), &slice);
+
+    auto status = ::vaBeginPicture(m_display, m_context, m_input_surface);
+    if (status == VA_STATUS_SUCCESS) {
+      status = ::vaRenderPicture(m_display, m_context, buffers.data(),
+                                 static_cast<int>(std::size(buffers)));
+      // 失敗した場合も EndPicture で終える
+      const auto end_status = ::vaEndPicture(m_display, m_context);
+      if (status == VA_STATUS_SUCCESS) {
+        status = end_status;
+      }
+    }
+    check_va(status, "vaRenderPicture()");
+  } catch (...) {
+    destroy_buffers();
+    throw;
+  }
+  destroy_buffers();
+}
+
+void VAAPIH264Encoder::outputCodedBuffer(const bool is_key_frame) {
+  check_va(::vaSyncSurface(m_display, m_input_surface), "vaSyncSurface()");
+
+  void* p = nullptr;
+  check_va(::vaMapBuffer(m_display, m_coded_buffer, &p), "vaMapBuffer()");
+  std::size_t data_size = 0;
+  for (auto segment = static_cast<::VACodedBufferSegment*>(p); segment;
+       segment = static_cast<::VACodedBufferSegment*>(segment->next)) {
+    data_size += segment->size;
+  }
+  auto data = FrameBufferPool::getInstance().acquire(data_size);
+  std::size_t offset = 0;
+  for (auto segment = static_cast<::VACodedBufferSegment*>(p); segment;
+       segment = static_cast<::VACodedBufferSegment*>(segment->next)) {
+    std::memcpy(data.get() + offset, segment->buf, segment->size);
+    offset += segment->size;
+  }
+  ::vaUnmapBuffer(m_display, m_coded_buffer);
+
+  m_sum_of_bits += data_size * 8;
+  const std::uint64_t pts_ns =
+      m_frame * m_timescale * m_fps.denominator() / m_fps.numerator();
+  m_buffer->push(hisui::Frame{.timestamp = pts_ns,
+                              .data = data,
+                              .data_size = data_size,
+                              .is_key = is_key_frame});
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <va/va.h>
+#include <va/va_enc_h264.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <boost/rational.hpp>
+
+#include "constants.hpp"
+#include "video/encoder.hpp"
+#include "video/key_frame_scheduler.hpp"
+
+namespace hisui {
+
+class Config;
+class FrameQueue;
+
+}  // namespace hisui
+
+namespace hisui::video {
+
+class VAAPIH264EncoderConfig {
+ public:
+  VAAPIH264EncoderConfig(const std::uint32_t,
+                         const std::uint32_t,
+                         const hisui::Config&);
+  const std::uint32_t width;
+  const std::uint32_t height;
+  const boost::rational<std::uint64_t> fps;
+  const std::uint32_t target_bit_rate;
+  // 0 の場合は最初のフレームだけをキーフレームにする
+  const std::uint32_t keyframe_interval;
+};
+
+// oneVPL を使わずに VA-API で H.264 にエンコードする. AMD の GPU のように oneVPL のランタイムが無いホスト向け.
+// SPS/PPS はドライバーに作らせ, B フレームを使わずに 1 フレームずつ同期してエンコードする
+class VAAPIH264Encoder : public Encoder {
+ public:
+  VAAPIH264Encoder(
+      hisui::FrameQueue*,
+      const VAAPIH264EncoderConfig&,
+      const std::uint64_t t_timescale = hisui::Constants::NANO_SECOND);
+  ~VAAPIH264Encoder();
+
+  // H.264 のエンコードに対応した /dev/dri/renderD* があれば true
+  static bool isSupported();
+
+  void outputImage(const std::vector<unsigned char>&) override;
+  void forceKeyFrame() override;
+  void flush() override;
+  std::uint32_t getFourcc() const override;
+
+ private:
+  std::uint32_t m_width;
+  std::uint32_t m_height;
+  std::uint32_t m_width_in_mbs;
+  std::uint32_t m_height_in_mbs;
+  std::uint32_t m_bitrate;
+  boost::rational<std::uint64_t> m_fps;
+  std::uint32_t m_keyframe_interval;
+  hisui::FrameQueue* m_buffer;
+  const std::uint64_t m_timescale;
+  std::uint64_t m_frame = 0;
+  std::uint64_t m_sum_of_bits = 0;
+  KeyFrameScheduler m_key_frames;
+
+  int m_fd = -1;
+  ::VADisplay m_display = nullptr;
+  ::VAProfile m_profile;
+  std::uint32_t m_rate_control;
+  ::VAConfigID m_config = VA_INVALID_ID;
+  ::VAContextID m_context = VA_INVALID_ID;
+  ::VASurfaceID m_input_surface = VA_INVALID_SURFACE;
+  // 再構成画像. 直前のフレームだけを参照するので 2 枚を交互に使う
+  std::array<::VASurfaceID, 2> m_reference_surfaces = {VA_INVALID_SURFACE,
+                                                       VA_INVALID_SURFACE};
+  ::VABufferID m_coded_buffer = VA_INVALID_ID;
+
+  // IDR からのフレーム数. frame_num と POC はこれから作る
+  std::uint32_t m_frame_in_gop = 0;
+  std::uint16_t m_idr_pic_id = 0;
+  std::size_t m_current_reference = 0;
+  ::VAPictureH264 m_last_picture;
+
+  void uploadImage(const std::vector<unsigned char>&);
+  void encodeFrame(const bool is_key_frame);
+  void renderParameters(const bool is_key_frame);
+  void outputCodedBuffer(const bool is_key_frame);
+  void release();
+};
+
+}  // namespace hisui::video
@@ -0,0 +1,160 @@
+#include "video/vp8_header.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hisui::video {
+
+namespace {
+
+// RFC 6386 7.3 のブール復号器
+class BoolDecoder {
+ public:
+  BoolDecoder(const unsigned char* t_data, const std::size_t t_size)
+      : m_data(t_data), m_size(t_size) {
+    m_value = (static_cast<std::uint32_t>(nextByte()) << 8) | nextByte();
+  }
+
+  bool readBool(const std::uint32_t probability) {
+    const std::uint32_t split = 1 + (((m_range - 1) * probability) >> 8);
+    const std::uint32_t big_split = split << 8;
+    bool ret;
+    if (m_value >= big_split) {
+      ret = true;
+      m_range -= split;
+      m_value -= big_split;
+    } else {
+      ret = false;
+      m_range = split;
+    }
+    while (m_range < 128) {
+      m_value <<= 1;
+      m_range <<= 1;
+      if (++m_bit_count == 8) {
+        m_bit_count = 0;
+        m_value |= nextByte();
+      }
+    }
+    return ret;
+  }
+
+  bool readFlag() { return readBool(128); }
+
+  std::uint32_t readLiteral(const int bits) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < bits; ++i) {
+      value = (value << 1) | (readFlag() ? 1U : 0U);
+    }
+    return value;
+  }
+
+  // 符号付きの値の大きさと符号を読み飛ばす
+  void skipSigned(const int bits) {
+    readLiteral(bits);
+    readFlag();
+  }
+
+  // フラグが立っていれば大きさと符号が続く値を読み飛ばす
+  void skipOptionalSigned(const int bits) {
+    if (readFlag()) {
+      skipSigned(bits);
+    }
+  }
+
+ private:
+  // 終端を超えた分は 0 として読む
+  std::uint32_t nextByte() {
+    return m_position < m_size ? m_data[m_position++] : 0;
+  }
+
+  const unsigned char* m_data;
+  std::size_t m_size;
+  std::size_t m_position = 0;
+  std::uint32_t m_value;
+  std::uint32_t m_range = 255;
+  int m_bit_count = 0;
+};
+
+}  // namespace
+
+bool is_droppable_vp8_frame(const unsigned char* data, const std::size_t size) {
+  // RFC 6386 9.1: 3 バイトのフレームタグ. キーフレームは常に参照される
+  if (size < 3) {
+    return false;
+  }
+  const std::uint32_t tag = static_cast<std::uint32_t>(data[0]) |
+                            (static_cast<std::uint32_t>(data[1]) << 8) |
+                            (static_cast<std::uint32_t>(data[2]) << 16);
+  const bool is_key_frame = (tag & 1) == 0;
+  const std::size_t first_partition_size = (tag >> 5) & 0x7FFFF;
+  if (is_key_frame || first_partition_size > size - 3) {
+    return false;
+  }
+
+  // RFC 6386 9.3 - 9.8, 19.2: インターフレームのフレームヘッダー
+  BoolDecoder decoder(data + 3, first_partition_size);
+
+  // segmentation の map と feature は後続のフレームに引き継がれる
+  if (decoder.readFlag()) {
+    const bool update_mb_segmentation_map = decoder.readFlag();
+    const bool update_segment_feature_data = decoder.readFlag();
+    if (update_mb_segmentation_map || update_segment_feature_data) {
+      return false;
+    }
+  }
+
+  decoder.readLiteral(1);  // filter_type
+  decoder.readLiteral(6);  // loop_filter_level
+  decoder.readLiteral(3);  // sharpness_level
+
+  // loop filter の delta も後続のフレームに引き継がれる
+  if (decoder.readFlag() && decoder.readFlag()) {
+    return false;
+  }
+
+  decoder.readLiteral(2);  // log2_nbr_of_dct_partitions
+
+  decoder.readLiteral(7);  // y_ac_qi
+  for (int i = 0; i < 5; ++i) {
+    decoder.skipOptionalSigned(4);
+  }
+
+  const bool refresh_golden_frame = decoder.readFlag();
+  const bool refresh_alternate_frame = decoder.readFlag();
+  std::uint32_t copy_buffer_to_golden = 0;
+  if (!refresh_golden_frame) {
+    copy_buffer_to_golden = decoder.readLiteral(2);
+  }
+  std::uint32_t copy_buffer_to_alternate = 0;
+  if (!refresh_alternate_frame) {
+    copy_buffer_to_alternate = decoder.readLiteral(2);
+  }
+  decoder.readFlag();  // sign_bias_golden
+  decoder.readFlag();  // sign_bias_alternate
+  const bool refresh_entropy_probs = decoder.readFlag();
+  const bool refresh_last = decoder.readFlag();
+
+  return !refresh_golden_frame && !refresh_alternate_frame &&
+         copy_buffer_to_golden == 0 && copy_buffer_to_alternate == 0 &&
+         !refresh_entropy_probs && !refresh_last;
+}
+
+bool get_vp8_key_frame_size(const unsigned char* data,
+                            const std::size_t size,
+                            std::uint32_t* width,
+                            std::uint32_t* height) {
+  // RFC 6386 9.1: フレームタグ, 開始コード, 14 bit の幅と高さ
+  if (size < 10 || (data[0] & 1) != 0 || data[3] != 0x9d || data[4] != 0x01 ||
+      data[5] != 0x2a) {
+    return false;
+  }
+  *width = (static_cast<std::uint32_t>(data[6]) |
+            (static_cast<std::uint32_t>(data[7]) << 8)) &
+           0x3fff;
+  *height = (static_cast<std::uint32_t>(data[8]) |
+             (static_cast<std::uint32_t>(data[9]) << 8)) &
+            0x3fff;
+  return true;
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hisui::video {
+
+// VP8 のフレームヘッダーを読み, 参照フレームやエントロピー符号の状態などの
+// デコーダーの状態を一切更新しないフレームであれば true を返す.
+// そのようなフレームは復号しなくても後続のフレームの復号結果が変わらない
+bool is_droppable_vp8_frame(const unsigned char*, const std::size_t);
+
+// VP8 のキーフレームであれば, フレームヘッダーの幅と高さを返す
+bool get_vp8_key_frame_size(const unsigned char*,
+                            const std::size_t,
+                            std::uint32_t*,
+                            std::uint32_t*);
+
+}  // namespace hisui::video
@@ -0,0 +1,98 @@
+#include "video/vp9_header.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hisui::video {
+
+namespace {
+
+// 上位ビットから読む. 範囲外は 0 として読み, isOverrun() で判定する
+class BitReader {
+ public:
+  BitReader(const unsigned char* t_data, const std::size_t t_size)
+      : m_data(t_data), m_size(t_size) {}
+
+  std::uint32_t read(const int bits) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < bits; ++i) {
+      std::uint32_t bit = 0;
+      if (m_position < m_size * 8) {
+        bit = (m_data[m_position >> 3] >> (7 - (m_position & 7))) & 1;
+      }
+      ++m_position;
+      value = (value << 1) | bit;
+    }
+    return value;
+  }
+
+  bool isOverrun() const { return m_position > m_size * 8; }
+
+ private:
+  const unsigned char* m_data;
+  std::size_t m_size;
+  std::size_t m_position = 0;
+};
+
+constexpr std::uint32_t CS_RGB = 7;
+
+}  // namespace
+
+bool get_vp9_key_frame_size(const unsigned char* data,
+                            const std::size_t size,
+                            std::uint32_t* profile,
+                            std::uint32_t* width,
+                            std::uint32_t* height) {
+  // VP9 Bitstream Specification 6.2: uncompressed_header()
+  BitReader reader(data, size);
+  if (reader.read(2) != 2) {  // frame_marker
+    return false;
+  }
+  const std::uint32_t profile_low_bit = reader.read(1);
+  const std::uint32_t profile_high_bit = reader.read(1);
+  const std::uint32_t p = (profile_high_bit << 1) | profile_low_bit;
+  if (p == 3) {
+    reader.read(1);  // reserved_zero
+  }
+  if (reader.read(1) != 0) {  // show_existing_frame
+    return false;
+  }
+  if (reader.read(1) != 0) {  // frame_type: KEY_FRAME は 0
+    return false;
+  }
+  reader.read(1);  // show_frame
+  reader.read(1);  // error_resilient_mode
+  if (reader.read(8) != 0x49 || reader.read(8) != 0x83 ||
+      reader.read(8) != 0x42) {
+    return false;
+  }
+
+  // 6.2.2: color_config()
+  if (p >= 2) {
+    reader.read(1);  // ten_or_twelve_bit
+  }
+  const std::uint32_t color_space = reader.read(3);
+  if (color_space != CS_RGB) {
+    reader.read(1);  // color_range
+    if (p == 1 || p == 3) {
+      reader.read(1);  // subsampling_x
+      reader.read(1);  // subsampling_y
+      reader.read(1);  // reserved_zero
+    }
+  } else if (p == 1 || p == 3) {
+    reader.read(1);  // reserved_zero
+  }
+
+  // 6.2.3: frame_size()
+  const std::uint32_t w = reader.read(16) + 1;
+  const std::uint32_t h = reader.read(16) + 1;
+  if (reader.isOverrun()) {
+    return false;
+  }
+  *profile = p;
+  *width = w;
+  *height = h;
+  return true;
+}
+
+}  // namespace hisui::video
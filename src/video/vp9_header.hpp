@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hisui::video {
+
+// VP9 のキーフレームであれば, uncompressed header のプロファイルと幅と高さを返す.
+// superframe の場合は先頭のフレームのヘッダーを読む
+bool get_vp9_key_frame_size(const unsigned char*,
+                            const std::size_t,
+                            std::uint32_t*,
+                            std::uint32_t*,
+                            std::uint32_t*);
+
+}  // namespace hisui::video
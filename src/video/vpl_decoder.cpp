@@ -7,21 +7,52 @@
 #include <vpl/mfxstructures.h>
 #include <vpl/mfxvp8.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <stdexcept>
+#include <thread>
 
+#include "constants.hpp"
 #include "report/reporter.hpp"
+#include "video/codec_probe.hpp"
 #include "video/vpl.hpp"
 #include "video/vpl_session.hpp"
 #include "video/yuv.hpp"
+#include "video/yuv_image_pool.hpp"
 #include "webm/input/video_context.hpp"
 
 namespace hisui::video {
 
+namespace {
+
+// 他のデコーダーと同じ名前で報告する
+const char* get_codec_name(const std::uint32_t fourcc) {
+  switch (fourcc) {
+    case hisui::Constants::VP8_FOURCC:
+      return "vp8";
+    case hisui::Constants::VP9_FOURCC:
+      return "vp9";
+    case hisui::Constants::AV1_FOURCC:
+      return "av1";
+    default:
+      return "H.264";
+  }
+}
+
+}  // namespace
+
 bool VPLDecoder::initVpl() {
-  m_decoder = createDecoder(m_fourcc, {{4096, 4096}, {2048, 2048}});
+  if (!hisui::video::VPLSession::hasInstance()) {
+    throw std::runtime_error("VPL session is not opened");
+  }
+  m_session = hisui::video::VPLSession::getInstance().cloneSession();
+  m_decoder = createDecoder(m_session.get(), m_fourcc,
+                            {{4096, 4096}, {2048, 2048}});
   if (!m_decoder) {
     throw std::runtime_error(
         fmt::format("createDecoder() failed: fourcc={}", m_fourcc));
@@ -100,7 +131,8 @@ VPLDecoder::VPLDecoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
 
     hisui::report::Reporter::getInstance().registerVideoDecoder(
         m_webm->getFilePath(),
-        {.codec = "H.264", .duration = m_webm->getDuration()});
+        {.codec = get_codec_name(m_fourcc),
+         .duration = m_webm->getDuration()});
 
     hisui::report::Reporter::getInstance().registerResolutionChange(
         m_webm->getFilePath(),
@@ -112,7 +144,7 @@ VPLDecoder::~VPLDecoder() {
   releaseVpl();
 }
 
-const std::shared_ptr<YUVImage> VPLDecoder::getImage(
+const std::shared_ptr<YUVImage>& VPLDecoder::getImage(
     const std::uint64_t timestamp) {
   if (!m_webm || m_is_time_over) {
     return m_black_yuv_image;
@@ -139,6 +171,8 @@ void VPLDecoder::updateImageByTimestamp(const std::uint64_t timestamp) {
   if (m_finished_webm) {
     return;
   }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
 
   do {
     if (m_report_enabled) {
@@ -153,8 +187,12 @@ void VPLDecoder::updateImageByTimestamp(const std::uint64_t timestamp) {
     m_current_yuv_image = m_next_yuv_image;
     m_current_timestamp = m_next_timestamp;
     if (m_webm->readFrame()) {
-      decode();
       m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
+      const bool is_displayed = isDisplayed(timestamp);
+      if (!is_displayed) {
+        countDroppedFrame();
+      }
+      decode(is_displayed);
     } else {
       // m_duration までは m_current_image を出すので webm を読み終えても m_current_image を維持する
       m_finished_webm = true;
@@ -164,7 +202,8 @@ void VPLDecoder::updateImageByTimestamp(const std::uint64_t timestamp) {
   } while (timestamp >= m_next_timestamp);
 }
 
-void VPLDecoder::decode() {
+void VPLDecoder::decode(const bool is_displayed) {
+  hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
   auto buffer_size = m_webm->getBufferSize();
 
   if (m_bitstream.MaxLength < m_bitstream.DataLength + buffer_size) {
@@ -253,36 +292,42 @@ void VPLDecoder::decode() {
     }
   }
 
-  sts = ::MFXVideoCORE_SyncOperation(
-      hisui::video::VPLSession::getInstance().getSession(), syncp, 600000);
+  sts = ::MFXVideoCORE_SyncOperation(m_session.get(), syncp, 600000);
   if (sts != MFX_ERR_NONE) {
     throw std::runtime_error(
         fmt::format("MFXVideoCORE_SyncOperation() failed: sts={}",
                     static_cast<std::int32_t>(sts)));
   }
 
-  m_next_yuv_image = std::make_shared<YUVImage>(m_width, m_height);
+  if (!is_displayed) {
+    // 参照フレームとしてデバイス側で復号済みなので, 表示されないなら変換しない
+    return;
+  }
+
+  m_next_yuv_image = YUVImagePool::getInstance().acquire(m_width, m_height);
   // NV12 から I420 に変換
-  libyuv::NV12ToI420(out_surface->Data.Y, out_surface->Data.Pitch,
-                     out_surface->Data.UV, out_surface->Data.Pitch,
-                     m_next_yuv_image->yuv[0], static_cast<int>(m_width),
-                     m_next_yuv_image->yuv[1], (m_width + 1) >> 1,
-                     m_next_yuv_image->yuv[2], (m_width + 1) >> 1,
-                     static_cast<int>(m_width), static_cast<int>(m_height));
+  libyuv::NV12ToI420(
+      out_surface->Data.Y, out_surface->Data.Pitch, out_surface->Data.UV,
+      out_surface->Data.Pitch, m_next_yuv_image->yuv[0],
+      static_cast<int>(m_next_yuv_image->getStride(0)),
+      m_next_yuv_image->yuv[1],
+      static_cast<int>(m_next_yuv_image->getStride(1)),
+      m_next_yuv_image->yuv[2],
+      static_cast<int>(m_next_yuv_image->getStride(2)),
+      static_cast<int>(m_width), static_cast<int>(m_height));
+  m_next_yuv_image->setTimestamp(
+      static_cast<std::uint64_t>(m_webm->getTimestamp()));
 
   return;
 }
 
 std::unique_ptr<::MFXVideoDECODE> VPLDecoder::createDecoder(
+    const ::mfxSession session,
     const std::uint32_t fourcc,
     const std::vector<std::pair<std::uint32_t, std::uint32_t>> sizes) {
-  if (!hisui::video::VPLSession::hasInstance()) {
-    throw std::runtime_error("VPL session is not opened");
-  }
   for (auto size : sizes) {
-    auto decoder =
-        createDecoderInternal(hisui::video::VPLSession::getInstance(),
-                              ToMfxCodec(fourcc), size.first, size.second);
+    auto decoder = createDecoderInternal(session, ToMfxCodec(fourcc),
+                                         size.first, size.second);
     if (decoder) {
       return decoder;
     }
@@ -291,12 +336,11 @@ std::unique_ptr<::MFXVideoDECODE> VPLDecoder::createDecoder(
 }
 
 std::unique_ptr<::MFXVideoDECODE> VPLDecoder::createDecoderInternal(
-    const VPLSession& session,
+    const ::mfxSession session,
     ::mfxU32 codec,
     std::uint32_t width,
     std::uint32_t height) {
-  std::unique_ptr<MFXVideoDECODE> decoder(
-      new MFXVideoDECODE(session.getSession()));
+  std::unique_ptr<MFXVideoDECODE> decoder(new MFXVideoDECODE(session));
 
   ::mfxStatus sts = MFX_ERR_NONE;
 
@@ -370,9 +414,11 @@ std::unique_ptr<::MFXVideoDECODE> VPLDecoder::createDecoderInternal(
 }
 
 bool VPLDecoder::isSupported(const std::uint32_t fourcc) {
-  auto decoder = createDecoder(fourcc, {{4096, 4096}, {2048, 2048}});
-
-  return decoder != nullptr;
+  return probe_codec(fmt::format("vpl_decoder_{:x}", fourcc), [fourcc] {
+    return VPLSession::hasInstance() &&
+           createDecoder(VPLSession::getInstance().getSession(), fourcc,
+                         {{4096, 4096}, {2048, 2048}}) != nullptr;
+  });
 }
 
 }  // namespace hisui::video
@@ -22,16 +22,20 @@ namespace hisui::video {
 
 class YUVImage;
 
+// デコードした NV12 のサーフェスはシステムメモリの I420 の YUVImage にコピーする.
+// 合成は CPU で行うので, サーフェスをビデオメモリのまま渡すことはしない
 class VPLDecoder : public Decoder {
  public:
   explicit VPLDecoder(std::shared_ptr<hisui::webm::input::VideoContext>);
   ~VPLDecoder();
 
-  const std::shared_ptr<YUVImage> getImage(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
 
   static bool isSupported(const std::uint32_t fourcc);
 
  private:
+  // m_decoder より後に閉じる
+  UniqueVPLSession m_session;
   std::unique_ptr<MFXVideoDECODE> m_decoder;
   std::uint32_t m_fourcc;
   std::uint64_t m_current_timestamp = 0;
@@ -46,11 +50,12 @@ class VPLDecoder : public Decoder {
   ::mfxBitstream m_bitstream;
 
   static std::unique_ptr<::MFXVideoDECODE> createDecoder(
+      const ::mfxSession session,
       const ::mfxU32 codec,
       const std::vector<std::pair<std::uint32_t, std::uint32_t>> sizes);
 
   static std::unique_ptr<::MFXVideoDECODE> createDecoderInternal(
-      const VPLSession& session,
+      const ::mfxSession session,
       const ::mfxU32 codec,
       const std::uint32_t width,
       const std::uint32_t height);
@@ -59,7 +64,7 @@ class VPLDecoder : public Decoder {
   void releaseVpl();
   void updateImage(const std::uint64_t);
   void updateImageByTimestamp(const std::uint64_t);
-  void decode();
+  void decode(const bool);
 };
 
 }  // namespace hisui::video
@@ -1,34 +1,140 @@
 #include "video/vpl_encoder.hpp"
 
+#include <fmt/core.h>
+#include <fmt/format.h>
 #include <libyuv/convert_from.h>
+#include <libyuv/planar_functions.h>
 #include <spdlog/spdlog.h>
 #include <vpl/mfxvp8.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <video/vpl.hpp>
 
 #include "config.hpp"
 #include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+#include "frame_queue.hpp"
+#include "video/codec_probe.hpp"
 
 namespace hisui::video {
 
+namespace {
+
+::mfxU16 to_mfx_low_power(const hisui::config::VPLLowPower low_power) {
+  switch (low_power) {
+    case hisui::config::VPLLowPower::On:
+      return MFX_CODINGOPTION_ON;
+    case hisui::config::VPLLowPower::Off:
+      return MFX_CODINGOPTION_OFF;
+    case hisui::config::VPLLowPower::Auto:
+      break;
+  }
+  return MFX_CODINGOPTION_UNKNOWN;
+}
+
+::mfxU16 to_mfx_rate_control(const hisui::config::VPLRateControl rc) {
+  switch (rc) {
+    case hisui::config::VPLRateControl::CBR:
+      return MFX_RATECONTROL_CBR;
+    case hisui::config::VPLRateControl::CQP:
+      return MFX_RATECONTROL_CQP;
+    case hisui::config::VPLRateControl::VBR:
+      break;
+  }
+  return MFX_RATECONTROL_VBR;
+}
+
+void set_rate_control(::mfxVideoParam* param,
+                      const ::mfxU16 method,
+                      const std::uint32_t target_bit_rate,
+                      const std::uint32_t max_bit_rate) {
+  param->mfx.RateControlMethod = method;
+  if (method == MFX_RATECONTROL_CQP) {
+    // VP9 と AV1 の QP は 0-255 なので, H.264 の 0-51 の値を拡げて使う
+    const ::mfxU16 scale = param->mfx.CodecId == MFX_CODEC_AVC ? 1 : 5;
+    param->mfx.QPI = static_cast<::mfxU16>(25 * scale);
+    param->mfx.QPP = static_cast<::mfxU16>(33 * scale);
+    param->mfx.QPB = static_cast<::mfxU16>(40 * scale);
+    return;
+  }
+  // TargetKbps と MaxKbps は 16 bit なので, 収まらなければ BRCParamMultiplier で割る
+  const std::uint32_t target_kbps = target_bit_rate / 1000;
+  const std::uint32_t max_kbps = std::max(target_kbps, max_bit_rate / 1000);
+  const std::uint32_t multiplier = max_kbps / 65536 + 1;
+  param->mfx.BRCParamMultiplier = static_cast<::mfxU16>(multiplier);
+  param->mfx.TargetKbps = static_cast<::mfxU16>(target_kbps / multiplier);
+  param->mfx.MaxKbps = static_cast<::mfxU16>(max_kbps / multiplier);
+}
+
+// AV1 の 1 フレーム分の OBU の列から Sequence Header OBU を取り出す
+std::vector<std::uint8_t> find_sequence_header_obu(const std::uint8_t* data,
+                                                   const std::size_t size) {
+  std::size_t offset = 0;
+  while (offset < size) {
+    const auto header = data[offset];
+    std::size_t payload = offset + ((header & 0x04) ? 2 : 1);
+    if ((header & 0x02) == 0) {
+      // obu_size が無い OBU は最後まで続く
+      break;
+    }
+    std::uint64_t obu_size = 0;
+    for (std::size_t i = 0; payload < size; ++i) {
+      const auto b = data[payload++];
+      obu_size |= static_cast<std::uint64_t>(b & 0x7f) << (i * 7);
+      if ((b & 0x80) == 0) {
+        break;
+      }
+    }
+    const auto end = payload + obu_size;
+    if (end > size) {
+      break;
+    }
+    if (((header >> 3) & 0xf) == 1) {
+      return std::vector<std::uint8_t>(data + offset, data + end);
+    }
+    offset = end;
+  }
+  throw std::runtime_error("AV1 sequence header OBU is not found");
+}
+
+const char* get_codec_name(const ::mfxU32 codec) {
+  return codec == MFX_CODEC_VP8   ? "MFX_CODEC_VP8"
+         : codec == MFX_CODEC_VP9 ? "MFX_CODEC_VP9"
+         : codec == MFX_CODEC_AV1 ? "MFX_CODEC_AV1"
+         : codec == MFX_CODEC_AVC ? "MFX_CODEC_AVC"
+                                  : "MFX_CODEC_UNKNOWN";
+}
+
+}  // namespace
+
 VPLEncoderConfig::VPLEncoderConfig(const std::uint32_t t_width,
                                    const std::uint32_t t_height,
-                                   const hisui::Config& config)
+                                   const hisui::Config& config,
+                                   const bool t_nv12_input)
     : width(t_width),
       height(t_height),
       fps(config.out_video_frame_rate),
       target_bit_rate(config.out_video_bit_rate * 1000),
-      max_bit_rate(config.out_video_bit_rate * 1000) {}
+      max_bit_rate(config.out_video_bit_rate * 1000),
+      nv12_input(t_nv12_input),
+      keyframe_interval(config.getVideoKeyframeInterval()),
+      target_usage(static_cast<::mfxU16>(config.vpl_target_usage)),
+      low_power(to_mfx_low_power(config.vpl_low_power)),
+      async_depth(static_cast<::mfxU16>(config.vpl_async_depth)),
+      rate_control_method(to_mfx_rate_control(config.vpl_rate_control)) {}
 
 std::unique_ptr<MFXVideoENCODE> VPLEncoder::createEncoder(
     const ::mfxU32 codec,
-    const std::uint32_t width,
-    const std::uint32_t height,
-    const boost::rational<std::uint64_t> frame_rate,
-    const std::uint32_t target_bit_rate,
-    const std::uint32_t max_bit_rate,
+    const VPLEncoderConfig& config,
     const bool init) {
   if (!hisui::video::VPLSession::hasInstance()) {
     throw std::runtime_error("VPL session is not opened");
@@ -51,38 +157,40 @@ std::unique_ptr<MFXVideoENCODE> VPLEncoder::createEncoder(
   } else if (codec == MFX_CODEC_AV1) {
     // param.mfx.CodecProfile = MFX_PROFILE_AV1_MAIN;
   }
-  param.mfx.TargetUsage = MFX_TARGETUSAGE_BALANCED;
-  // param.mfx.BRCParamMultiplier = 1;
+  param.mfx.TargetUsage = config.target_usage;
+  param.mfx.LowPower = config.low_power;
   // param.mfx.InitialDelayInKB = target_kbps;
-  param.mfx.TargetKbps = static_cast<std::uint16_t>(target_bit_rate);
-  param.mfx.MaxKbps = static_cast<std::uint16_t>(max_bit_rate);
-  param.mfx.RateControlMethod = MFX_RATECONTROL_VBR;
+  set_rate_control(&param, config.rate_control_method, config.target_bit_rate,
+                   config.max_bit_rate);
   // param.mfx.NumSlice = 1;
   // param.mfx.NumRefFrame = 1;
   param.mfx.FrameInfo.FrameRateExtN =
-      static_cast<std::uint32_t>(frame_rate.numerator());
+      static_cast<std::uint32_t>(config.fps.numerator());
   param.mfx.FrameInfo.FrameRateExtD =
-      static_cast<std::uint32_t>(frame_rate.denominator());
+      static_cast<std::uint32_t>(config.fps.denominator());
   param.mfx.FrameInfo.FourCC = MFX_FOURCC_NV12;
   param.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
   param.mfx.FrameInfo.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
   param.mfx.FrameInfo.CropX = 0;
   param.mfx.FrameInfo.CropY = 0;
-  param.mfx.FrameInfo.CropW = static_cast<std::uint16_t>(width);
-  param.mfx.FrameInfo.CropH = static_cast<std::uint16_t>(height);
+  param.mfx.FrameInfo.CropW = static_cast<std::uint16_t>(config.width);
+  param.mfx.FrameInfo.CropH = static_cast<std::uint16_t>(config.height);
   // Width must be a multiple of 16
   // Height must be a multiple of 16 in case of frame picture and a multiple of 32 in case of field picture
   param.mfx.FrameInfo.Width =
-      (static_cast<std::uint16_t>(width) + 15) / 16 * 16;
+      (static_cast<std::uint16_t>(config.width) + 15) / 16 * 16;
   param.mfx.FrameInfo.Height =
-      (static_cast<std::uint16_t>(height) + 15) / 16 * 16;
+      (static_cast<std::uint16_t>(config.height) + 15) / 16 * 16;
 
   // param.mfx.GopOptFlag = MFX_GOP_STRICT | MFX_GOP_CLOSED;
   // param.mfx.IdrInterval = codec_settings->H264().keyFrameInterval;
   // param.mfx.IdrInterval = 0;
+  if (config.keyframe_interval != 0) {
+    param.mfx.GopPicSize = static_cast<std::uint16_t>(config.keyframe_interval);
+  }
   param.mfx.GopRefDist = 1;
   // param.mfx.EncodedOrder = 0;
-  param.AsyncDepth = 1;
+  param.AsyncDepth = config.async_depth;
   param.IOPattern =
       MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
@@ -125,33 +233,53 @@ std::unique_ptr<MFXVideoENCODE> VPLEncoder::createEncoder(
   std::unique_ptr<::MFXVideoENCODE> encoder(
       new MFXVideoENCODE(hisui::video::VPLSession::getInstance().getSession()));
 
-  ::mfxVideoParam bk_param;
-  memcpy(&bk_param, &param, sizeof(bk_param));
-  sts = encoder->Query(&param, &param);
-  if (sts < 0) {
-    memcpy(&param, &bk_param, sizeof(bk_param));
-
-    // 失敗したら LowPower ON にした状態でもう一度確認する
-    param.mfx.LowPower = MFX_CODINGOPTION_ON;
-    if (codec == MFX_CODEC_AVC) {
-      param.mfx.RateControlMethod = MFX_RATECONTROL_CQP;
-      param.mfx.QPI = 25;
-      param.mfx.QPP = 33;
-      param.mfx.QPB = 40;
-      // param.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
-    }
-    memcpy(&bk_param, &param, sizeof(bk_param));
-    sts = encoder->Query(&param, &param);
+  // 指定された設定をランタイムが拒否した場合は, 次の順に設定を変えて試す.
+  // LowPower を切り替え, 既定の TargetUsage と VBR に戻し,
+  // 最後は LowPower を有効にした CQP にする
+  std::vector<::mfxVideoParam> candidates = {param};
+  candidates.push_back(param);
+  candidates.back().mfx.LowPower = param.mfx.LowPower == MFX_CODINGOPTION_ON
+                                       ? MFX_CODINGOPTION_UNKNOWN
+                                       : MFX_CODINGOPTION_ON;
+  candidates.push_back(param);
+  candidates.back().mfx.TargetUsage = MFX_TARGETUSAGE_BALANCED;
+  candidates.back().mfx.LowPower = MFX_CODINGOPTION_UNKNOWN;
+  set_rate_control(&candidates.back(), MFX_RATECONTROL_VBR,
+                   config.target_bit_rate, config.max_bit_rate);
+  candidates.push_back(candidates.back());
+  candidates.back().mfx.LowPower = MFX_CODINGOPTION_ON;
+  if (codec == MFX_CODEC_AVC) {
+    set_rate_control(&candidates.back(), MFX_RATECONTROL_CQP, 0, 0);
+  }
+
+  bool is_found = false;
+  for (std::size_t i = 0; i < std::size(candidates); ++i) {
+    auto& candidate = candidates[i];
+    sts = encoder->Query(&candidate, &candidate);
     if (sts < 0) {
-      const char* codec_str = codec == MFX_CODEC_VP8   ? "MFX_CODEC_VP8"
-                              : codec == MFX_CODEC_VP9 ? "MFX_CODEC_VP9"
-                              : codec == MFX_CODEC_AV1 ? "MFX_CODEC_AV1"
-                              : codec == MFX_CODEC_AVC ? "MFX_CODEC_AVC"
-                                                       : "MFX_CODEC_UNKNOWN";
-      spdlog::debug("Unsupported encoder codec: codec={}, sts={}", codec_str,
-                    static_cast<std::int32_t>(sts));
-      return nullptr;
+      spdlog::debug(
+          "encoder params rejected: codec={} sts={} target_usage={} "
+          "low_power={} rate_control={}",
+          get_codec_name(codec), static_cast<std::int32_t>(sts),
+          candidate.mfx.TargetUsage, candidate.mfx.LowPower,
+          candidate.mfx.RateControlMethod);
+      continue;
     }
+    if (i != 0 && init) {
+      spdlog::info(
+          "VPLEncoder: falling back to target_usage={} low_power={} "
+          "rate_control={}",
+          candidate.mfx.TargetUsage, candidate.mfx.LowPower,
+          candidate.mfx.RateControlMethod);
+    }
+    param = candidate;
+    is_found = true;
+    break;
+  }
+  if (!is_found) {
+    spdlog::debug("Unsupported encoder codec: codec={}, sts={}",
+                  get_codec_name(codec), static_cast<std::int32_t>(sts));
+    return nullptr;
   }
 
   // #define F(NAME)                                              \
@@ -219,27 +347,108 @@ std::unique_ptr<MFXVideoENCODE> VPLEncoder::createEncoder(
   return encoder;
 }
 
+// MP4 と WebM の track には最初のフレームを出力する前に Sequence Header が要るので,
+// 同じ設定の別のエンコーダーで黒い 1 フレームをエンコードして取り出す
+std::vector<std::uint8_t> VPLEncoder::encodeSequenceHeader(
+    const VPLEncoderConfig& config) {
+  auto encoder = createEncoder(MFX_CODEC_AV1, config, true);
+  if (!encoder) {
+    throw std::runtime_error("createEncoder() failed:");
+  }
+  ::mfxVideoParam param;
+  memset(&param, 0, sizeof(param));
+  if (const auto sts = encoder->GetVideoParam(&param); sts != MFX_ERR_NONE) {
+    throw std::runtime_error(fmt::format("GetVideoParam() failed: sts={}",
+                                         static_cast<std::int32_t>(sts)));
+  }
+
+  const std::size_t width = (param.mfx.FrameInfo.Width + 31U) / 32 * 32;
+  const std::size_t height = (param.mfx.FrameInfo.Height + 31U) / 32 * 32;
+  std::vector<std::uint8_t> surface_buffer(width * height * 3 / 2, 128);
+  std::fill_n(std::begin(surface_buffer), width * height, 0);
+  ::mfxFrameSurface1 surface;
+  memset(&surface, 0, sizeof(surface));
+  surface.Info = param.mfx.FrameInfo;
+  surface.Data.Y = surface_buffer.data();
+  surface.Data.U = surface_buffer.data() + width * height;
+  surface.Data.V = surface_buffer.data() + width * height + 1;
+  surface.Data.Pitch = static_cast<std::uint16_t>(width);
+
+  std::vector<std::uint8_t> bitstream_buffer(
+      std::max<std::size_t>(1, param.mfx.BRCParamMultiplier) *
+      param.mfx.BufferSizeInKB * 1000);
+  ::mfxBitstream bitstream;
+  memset(&bitstream, 0, sizeof(bitstream));
+  bitstream.MaxLength = static_cast<std::uint32_t>(bitstream_buffer.size());
+  bitstream.Data = bitstream_buffer.data();
+
+  ::mfxSyncPoint syncp = nullptr;
+  ::mfxFrameSurface1* input = &surface;
+  while (syncp == nullptr) {
+    const auto sts =
+        encoder->EncodeFrameAsync(nullptr, input, &bitstream, &syncp);
+    if (sts == MFX_WRN_DEVICE_BUSY) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } else if (sts == MFX_ERR_MORE_DATA && input != nullptr) {
+      // 入力が溜まるまで出力しないエンコーダーなので, flush して取り出す
+      input = nullptr;
+    } else if (sts != MFX_ERR_NONE) {
+      throw std::runtime_error(fmt::format("EncodeFrameAsync() failed: sts={}",
+                                           static_cast<std::int32_t>(sts)));
+    }
+  }
+  const auto sts = ::MFXVideoCORE_SyncOperation(
+      hisui::video::VPLSession::getInstance().getSession(), syncp, 600000);
+  if (sts != MFX_ERR_NONE) {
+    throw std::runtime_error(
+        fmt::format("MFXVideoCORE_SyncOperation() failed: sts={}",
+                    static_cast<std::int32_t>(sts)));
+  }
+  encoder->Close();
+
+  auto extra_data = find_sequence_header_obu(
+      bitstream.Data + bitstream.DataOffset, bitstream.DataLength);
+  spdlog::debug("AV1 extra_data: [{:02x}]", fmt::join(extra_data, ", "));
+  return extra_data;
+}
+
+// 指定された設定が拒否されても既定の設定を試すので, コーデックに対応しているかは
+// 設定に依らない. 既定の設定で 1 度だけ調べる
 bool VPLEncoder::isSupported(const std::uint32_t fourcc) {
-  auto encoder =
-      createEncoder(ToMfxCodec(fourcc), 1920, 1080, 30, 10, 20, false);
-  return encoder != nullptr;
+  return probe_codec(fmt::format("vpl_encoder_{:x}", fourcc), [fourcc] {
+    hisui::Config config;
+    config.out_video_frame_rate = 30;
+    config.out_video_bit_rate = 1000;
+    return VPLSession::hasInstance() &&
+           createEncoder(ToMfxCodec(fourcc),
+                         VPLEncoderConfig(1920, 1080, config),
+                         false) != nullptr;
+  });
 }
 
 VPLEncoder::VPLEncoder(const std::uint32_t t_fourcc,
-                       std::queue<hisui::Frame>* t_buffer,
+                       hisui::FrameQueue* t_buffer,
                        const VPLEncoderConfig& t_config,
                        const std::uint64_t t_timescale)
-    : m_fourcc(t_fourcc), m_buffer(t_buffer), m_timescale(t_timescale) {
+    : m_fourcc(t_fourcc),
+      m_nv12_input(t_config.nv12_input),
+      m_buffer(t_buffer),
+      m_timescale(t_timescale),
+      m_key_frames(t_config.keyframe_interval) {
   m_width = t_config.width;
   m_height = t_config.height;
   m_fps = t_config.fps;
   m_bitrate = t_config.target_bit_rate;
-  m_encoder = createEncoder(
-      ToMfxCodec(m_fourcc), t_config.width, t_config.height, t_config.fps,
-      t_config.target_bit_rate, t_config.max_bit_rate, true);
+  m_encoder = createEncoder(ToMfxCodec(m_fourcc), t_config, true);
   if (!m_encoder) {
     throw std::runtime_error("createEncoder() failed:");
   }
+  if (m_fourcc == hisui::Constants::AV1_FOURCC) {
+    m_extra_data = encodeSequenceHeader(t_config);
+  }
+  memset(&m_key_frame_ctrl, 0, sizeof(m_key_frame_ctrl));
+  m_key_frame_ctrl.FrameType =
+      MFX_FRAMETYPE_I | MFX_FRAMETYPE_IDR | MFX_FRAMETYPE_REF;
   initVPL();
 }
 
@@ -280,12 +489,19 @@ void VPLEncoder::initVPL() {
 
   m_frame_info = param.mfx.FrameInfo;
 
-  // 出力ビットストリームの初期化
-  m_bitstream_buffer.resize(param.mfx.BufferSizeInKB * 1000);
-
-  memset(&m_bitstream, 0, sizeof(m_bitstream));
-  m_bitstream.MaxLength = static_cast<std::uint32_t>(m_bitstream_buffer.size());
-  m_bitstream.Data = m_bitstream_buffer.data();
+  // 投入できるフレーム数分の出力ビットストリームの初期化
+  m_tasks.clear();
+  m_tasks.resize(std::max<std::size_t>(1, param.AsyncDepth));
+  for (auto& task : m_tasks) {
+    task.bitstream_buffer.resize(param.mfx.BufferSizeInKB * 1000);
+    memset(&task.bitstream, 0, sizeof(task.bitstream));
+    task.bitstream.MaxLength =
+        static_cast<std::uint32_t>(task.bitstream_buffer.size());
+    task.bitstream.Data = task.bitstream_buffer.data();
+    task.syncp = nullptr;
+  }
+  m_first_task = 0;
+  m_number_of_pending_tasks = 0;
 
   // 必要な枚数分の入力サーフェスを作る
   {
@@ -319,87 +535,217 @@ void VPLEncoder::releaseVPL() {
 }
 
 void VPLEncoder::outputImage(const std::vector<unsigned char>& yuv) {
-  encodeFrame(yuv);
+  auto surface = acquireSurface();
+
+  auto yuv_data = yuv.data();
+
+  if (m_nv12_input) {
+    // サーフェスの stride が異なるのでコピーだけは必要
+    libyuv::CopyPlane(yuv_data, static_cast<int>(m_width), surface->Data.Y,
+                      surface->Data.Pitch, static_cast<int>(m_width),
+                      static_cast<int>(m_height));
+    libyuv::CopyPlane(yuv_data + m_width * m_height, static_cast<int>(m_width),
+                      surface->Data.U, surface->Data.Pitch,
+                      static_cast<int>(m_width),
+                      static_cast<int>((m_height + 1) >> 1));
+  } else {
+    // I420 から NV12 に変換
+    libyuv::I420ToNV12(
+        yuv_data, static_cast<int>(m_width), yuv_data + m_width * m_height,
+        m_width >> 1,
+        yuv_data + m_width * m_height + ((m_width * m_height) >> 2),
+        m_width >> 1, surface->Data.Y, surface->Data.Pitch, surface->Data.U,
+        surface->Data.Pitch, static_cast<int>(m_width),
+        static_cast<int>(m_height));
+  }
+  // 出力されるビットストリームにそのまま引き継がれるので, フレーム番号を入れておく
+  surface->Data.TimeStamp = static_cast<::mfxU64>(m_frame);
+
+  encodeFrame(surface, m_key_frames.next(m_frame));
   ++m_frame;
 }
 
-void VPLEncoder::encodeFrame(const std::vector<unsigned char>& yuv) {
-  // 使ってない入力サーフェスを取り出す
-  auto surface =
-      std::find_if(m_surfaces.begin(), m_surfaces.end(),
-                   [](const ::mfxFrameSurface1& s) { return !s.Data.Locked; });
-  if (surface == m_surfaces.end()) {
-    throw std::runtime_error("unlocked surface is not found");
-  }
+bool VPLEncoder::skipImage() {
+  // NV12 への変換もエンコードもせず, 直前のフレームの表示を延ばす
+  ++m_frame;
+  return true;
+}
 
-  auto yuv_data = yuv.data();
+void VPLEncoder::forceKeyFrame() {
+  m_key_frames.forceKeyFrame();
+}
 
-  // I420 から NV12 に変換
-  libyuv::I420ToNV12(
-      yuv_data, static_cast<int>(m_width), yuv_data + m_width * m_height,
-      m_width >> 1, yuv_data + m_width * m_height + ((m_width * m_height) >> 2),
-      m_width >> 1, surface->Data.Y, surface->Data.Pitch, surface->Data.U,
-      surface->Data.Pitch, static_cast<int>(m_width),
-      static_cast<int>(m_height));
-
-  ::mfxStatus sts;
-
-  ::mfxEncodeCtrl ctrl;
-  memset(&ctrl, 0, sizeof(ctrl));
-  ctrl.FrameType = MFX_FRAMETYPE_UNKNOWN;
-
-  // NV12 をハードウェアエンコード
-  ::mfxSyncPoint syncp;
-  sts = m_encoder->EncodeFrameAsync(&ctrl, &*surface, &m_bitstream, &syncp);
-  // alloc_request_.NumFrameSuggested が 1 の場合は MFX_ERR_MORE_DATA は発生しない
-  if (sts == MFX_ERR_MORE_DATA) {
-    // もっと入力が必要なので出直す
-    return;
+// エンコーダーがロックしていない入力サーフェスを返す.
+// 全てロックされている場合は古いフレームから同期して空くのを待つ
+::mfxFrameSurface1* VPLEncoder::acquireSurface() {
+  while (true) {
+    auto surface = std::find_if(
+        std::begin(m_surfaces), std::end(m_surfaces),
+        [](const ::mfxFrameSurface1& s) { return !s.Data.Locked; });
+    if (surface != std::end(m_surfaces)) {
+      return &*surface;
+    }
+    if (m_number_of_pending_tasks == 0) {
+      throw std::runtime_error("unlocked surface is not found");
+    }
+    syncFirstTask();
   }
-  if (sts != MFX_ERR_NONE) {
-    throw std::runtime_error(fmt::format("EncodeFrameAsync() failed: sts={}",
-                                         static_cast<std::int32_t>(sts)));
+}
+
+// 次に投入する Task を返す. 空きがなければ最も古い Task の完了を待つ
+VPLEncoder::Task& VPLEncoder::acquireTask() {
+  if (m_number_of_pending_tasks == std::size(m_tasks)) {
+    syncFirstTask();
   }
+  return m_tasks[(m_first_task + m_number_of_pending_tasks) %
+                 std::size(m_tasks)];
+}
 
-  sts = ::MFXVideoCORE_SyncOperation(
-      hisui::video::VPLSession::getInstance().getSession(), syncp, 600000);
+// surface を投入する. nullptr の場合はエンコーダー内に残っているフレームを
+// MFX_ERR_MORE_DATA が返るまで取り出す. 同期は Task が足りなくなるか flush まで待たない
+void VPLEncoder::encodeFrame(::mfxFrameSurface1* surface,
+                             const bool is_key_frame) {
+  while (true) {
+    auto& task = acquireTask();
+    ::mfxStatus sts;
+    while (true) {
+      sts = m_encoder->EncodeFrameAsync(
+          is_key_frame ? &m_key_frame_ctrl : nullptr, surface,
+          &task.bitstream, &task.syncp);
+      if (sts != MFX_WRN_DEVICE_BUSY) {
+        break;
+      }
+      // デバイスが詰まっているので, 終わったフレームを取り出してからやり直す
+      if (m_number_of_pending_tasks > 0) {
+        syncFirstTask();
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    if (sts == MFX_ERR_MORE_DATA) {
+      // 入力が溜まるまで出力されない, あるいは flush でこれ以上出力がない
+      return;
+    }
+    if (sts != MFX_ERR_NONE) {
+      throw std::runtime_error(fmt::format("EncodeFrameAsync() failed: sts={}",
+                                           static_cast<std::int32_t>(sts)));
+    }
+    if (!task.syncp) {
+      return;
+    }
+    ++m_number_of_pending_tasks;
+    if (surface != nullptr) {
+      return;
+    }
+  }
+}
+
+void VPLEncoder::syncFirstTask() {
+  auto& task = m_tasks[m_first_task];
+  m_first_task = (m_first_task + 1) % std::size(m_tasks);
+  --m_number_of_pending_tasks;
+
+  const auto sts = ::MFXVideoCORE_SyncOperation(
+      hisui::video::VPLSession::getInstance().getSession(), task.syncp,
+      600000);
+  task.syncp = nullptr;
   if (sts != MFX_ERR_NONE) {
     throw std::runtime_error(
         fmt::format("MFXVideoCORE_SyncOperation() failed: sts={}",
                     static_cast<std::int32_t>(sts)));
   }
 
-  {
-    std::uint8_t* p = m_bitstream.Data + m_bitstream.DataOffset;
-    std::uint32_t data_size = m_bitstream.DataLength;
-    m_bitstream.DataLength = 0;
-
-    std::uint8_t* data = new std::uint8_t[data_size];
-    std::copy_n(p, data_size, data);
-    m_sum_of_bits += data_size * 8;
-    const std::uint64_t pts_ns = static_cast<std::uint64_t>(m_frame) *
-                                 m_timescale * m_fps.denominator() /
-                                 m_fps.numerator();
-    m_buffer->push(
-        hisui::Frame{.timestamp = pts_ns,
-                     .data = data,
-                     .data_size = data_size,
-                     .is_key = m_bitstream.FrameType == MFX_FRAMETYPE_IDR ||
-                               m_bitstream.FrameType == MFX_FRAMETYPE_I});
-  }
+  std::uint8_t* p = task.bitstream.Data + task.bitstream.DataOffset;
+  std::uint32_t data_size = task.bitstream.DataLength;
+  task.bitstream.DataOffset = 0;
+  task.bitstream.DataLength = 0;
+
+  auto data = FrameBufferPool::getInstance().acquire(data_size);
+  std::copy_n(p, data_size, data.get());
+  m_sum_of_bits += data_size * 8;
+  const auto frame = static_cast<std::uint64_t>(task.bitstream.TimeStamp);
+  const std::uint64_t pts_ns =
+      frame * m_timescale * m_fps.denominator() / m_fps.numerator();
+  m_buffer->push(
+      hisui::Frame{.timestamp = pts_ns,
+                   .data = data,
+                   .data_size = data_size,
+                   .is_key = (task.bitstream.FrameType &
+                              (MFX_FRAMETYPE_IDR | MFX_FRAMETYPE_I)) != 0});
 }
 
-void VPLEncoder::flush() {}
+void VPLEncoder::flush() {
+  // エンコーダー内に残っているフレームを出し切ってから, 投入済みのものを全て同期する
+  encodeFrame(nullptr);
+  while (m_number_of_pending_tasks > 0) {
+    syncFirstTask();
+  }
+}
 
 std::uint32_t VPLEncoder::getFourcc() const {
   return m_fourcc;
 }
 
-void VPLEncoder::setResolutionAndBitrate(const std::uint32_t,
-                                         const std::uint32_t,
-                                         const std::uint32_t) {
-  throw std::runtime_error(
-      "VPLEncoder::setResolutionAndBitrate is not implemented");
+const std::vector<std::uint8_t>& VPLEncoder::getExtraData() const {
+  if (m_fourcc != hisui::Constants::AV1_FOURCC) {
+    throw std::logic_error("VPLEncoder::getExtraData() should not be called");
+  }
+  return m_extra_data;
+}
+
+void VPLEncoder::setResolutionAndBitrate(const std::uint32_t width,
+                                         const std::uint32_t height,
+                                         const std::uint32_t bitrate) {
+  if (m_width != width || m_height != height) {
+    throw std::logic_error("VPLEncoder does not support resolution change");
+  }
+  // m_bitrate は bps, bitrate は kbps
+  if (m_bitrate == bitrate * 1000) {
+    return;
+  }
+  spdlog::debug("bitrate: {}", bitrate);
+
+  ::mfxVideoParam param;
+  memset(&param, 0, sizeof(param));
+  if (const auto sts = m_encoder->GetVideoParam(&param); sts != MFX_ERR_NONE) {
+    throw std::runtime_error(fmt::format("GetVideoParam() failed: sts={}",
+                                         static_cast<std::int32_t>(sts)));
+  }
+  if (param.mfx.RateControlMethod == MFX_RATECONTROL_CQP) {
+    // QP を固定しているのでビットレートは使わない
+    m_bitrate = bitrate * 1000;
+    return;
+  }
+  // Reset() はエンコーダー内のフレームを捨てるので先に出し切る.
+  // 入力サーフェスと Task は解像度が変わらないので作り直さずに使う
+  flush();
+  const std::uint32_t multiplier =
+      std::max<std::uint32_t>(1, param.mfx.BRCParamMultiplier);
+  param.mfx.TargetKbps = static_cast<std::uint16_t>(bitrate / multiplier);
+  param.mfx.MaxKbps = std::max(param.mfx.MaxKbps, param.mfx.TargetKbps);
+  if (const auto sts = m_encoder->Reset(&param); sts < MFX_ERR_NONE) {
+    throw std::runtime_error(fmt::format("Reset() failed: sts={}",
+                                         static_cast<std::int32_t>(sts)));
+  }
+  m_bitrate = bitrate * 1000;
+}
+
+bool use_vpl_encoder(const hisui::Config& config, const std::uint32_t fourcc) {
+  if ((fourcc != hisui::Constants::VP9_FOURCC &&
+       fourcc != hisui::Constants::AV1_FOURCC) ||
+      config.video_encoder_engine == hisui::config::EncoderEngine::Software) {
+    return false;
+  }
+  if (VPLSession::hasInstance() && VPLEncoder::isSupported(fourcc)) {
+    spdlog::debug("use VPLEncoder: fourcc={:x}", fourcc);
+    return true;
+  }
+  if (config.video_encoder_engine == hisui::config::EncoderEngine::Hardware) {
+    throw std::runtime_error(fmt::format(
+        "oneVPL {} encoder is not supported",
+        fourcc == hisui::Constants::VP9_FOURCC ? "VP9" : "AV1"));
+  }
+  return false;
 }
 
 }  // namespace hisui::video
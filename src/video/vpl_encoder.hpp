@@ -3,21 +3,23 @@
 #include <vpl/mfxdefs.h>
 #include <vpl/mfxvideo++.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
-#include <queue>
 #include <vector>
 
 #include <boost/rational.hpp>
 
 #include "constants.hpp"
 #include "video/encoder.hpp"
+#include "video/key_frame_scheduler.hpp"
 #include "video/vpl_session.hpp"
 
 namespace hisui {
 
 class Config;
 struct Frame;
+class FrameQueue;
 
 }  // namespace hisui
 
@@ -27,26 +29,40 @@ class VPLEncoderConfig {
  public:
   VPLEncoderConfig(const std::uint32_t,
                    const std::uint32_t,
-                   const hisui::Config&);
+                   const hisui::Config&,
+                   const bool t_nv12_input = false);
   const std::uint32_t width;
   const std::uint32_t height;
   const boost::rational<std::uint64_t> fps;
   const std::uint32_t target_bit_rate;
   const std::uint32_t max_bit_rate;
+  // outputImage() に I420 でなく NV12 の画像を渡す
+  const bool nv12_input;
+  // 0 の場合はエンコーダーに任せる
+  const std::uint32_t keyframe_interval;
+  // 以降は mfxVideoParam にそのまま渡す値. ランタイムが拒否した場合は他の値を試す
+  const ::mfxU16 target_usage;
+  const ::mfxU16 low_power;
+  const ::mfxU16 async_depth;
+  const ::mfxU16 rate_control_method;
 };
 
+// 合成した I420 の画像を NV12 に変換してからエンコードする
 class VPLEncoder : public Encoder {
  public:
   VPLEncoder(const std::uint32_t,
-             std::queue<hisui::Frame>*,
+             hisui::FrameQueue*,
              const VPLEncoderConfig&,
              const std::uint64_t t_timescale = hisui::Constants::NANO_SECOND);
   ~VPLEncoder();
   static bool isSupported(const std::uint32_t fourcc);
 
   void outputImage(const std::vector<unsigned char>&) override;
+  bool skipImage() override;
+  void forceKeyFrame() override;
   void flush() override;
   std::uint32_t getFourcc() const override;
+  const std::vector<std::uint8_t>& getExtraData() const override;
   void setResolutionAndBitrate(const std::uint32_t,
                                const std::uint32_t,
                                const std::uint32_t) override;
@@ -56,33 +72,53 @@ class VPLEncoder : public Encoder {
   std::uint32_t m_height;
   std::uint32_t m_bitrate;
   std::uint32_t m_fourcc;
-  std::queue<hisui::Frame>* m_buffer;
+  bool m_nv12_input;
+  hisui::FrameQueue* m_buffer;
   const std::uint64_t m_timescale;
   int m_frame = 0;
   boost::rational<std::uint64_t> m_fps;
   std::uint64_t m_sum_of_bits = 0;
   std::vector<std::uint8_t> m_surface_buffer;
   std::vector<::mfxFrameSurface1> m_surfaces;
+  KeyFrameScheduler m_key_frames;
+  // キーフレームにするフレームを EncodeFrameAsync() に渡す時に使う.
+  // エンコードが終わるまで参照されるので, メンバーに置いておく
+  ::mfxEncodeCtrl m_key_frame_ctrl;
+
+  // エンコード中のフレームの出力先. 投入した順に m_tasks を循環して使う
+  struct Task {
+    std::vector<std::uint8_t> bitstream_buffer;
+    ::mfxBitstream bitstream;
+    ::mfxSyncPoint syncp;
+  };
 
   std::unique_ptr<::MFXVideoENCODE> m_encoder;
   ::mfxU32 m_codec;
   ::mfxFrameAllocRequest m_alloc_request;
-  std::vector<std::uint8_t> m_bitstream_buffer;
-  ::mfxBitstream m_bitstream;
+  std::vector<Task> m_tasks;
+  std::size_t m_first_task = 0;
+  std::size_t m_number_of_pending_tasks = 0;
   ::mfxFrameInfo m_frame_info;
+  // AV1 の Sequence Header OBU
+  std::vector<std::uint8_t> m_extra_data;
 
   void initVPL();
   void releaseVPL();
-  void encodeFrame(const std::vector<unsigned char>&);
+  void encodeFrame(::mfxFrameSurface1*, const bool is_key_frame = false);
+  ::mfxFrameSurface1* acquireSurface();
+  Task& acquireTask();
+  void syncFirstTask();
 
   static std::unique_ptr<MFXVideoENCODE> createEncoder(
       const ::mfxU32 codec,
-      const std::uint32_t width,
-      const std::uint32_t height,
-      const boost::rational<std::uint64_t> frame_rate,
-      const std::uint32_t target_bit_rate,
-      const std::uint32_t max_bit_rate,
+      const VPLEncoderConfig&,
       const bool init);
+  static std::vector<std::uint8_t> encodeSequenceHeader(
+      const VPLEncoderConfig&);
 };
 
+// --video-encoder-engine に従い, fourcc の VP9 か AV1 を VPLEncoder でエンコードするかを返す.
+// Hardware が指定されていて oneVPL が対応していなければ std::runtime_error を投げる
+bool use_vpl_encoder(const hisui::Config&, const std::uint32_t fourcc);
+
 }  // namespace hisui::video
@@ -5,8 +5,13 @@
 #include <vpl/mfxdispatcher.h>
 #include <vpl/mfxvideo.h>
 
+#include <exception>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
 
+#include "video/codec_probe.hpp"
 #include "video/vaapi_utils_drm.h"
 
 namespace hisui::video {
@@ -19,14 +24,40 @@ VPLSession::~VPLSession() {
 }
 
 bool VPLSession::hasInstance() {
+  std::call_once(m_open_flag, [] {
+    if (m_instance) {
+      return;
+    }
+    // 開けないホストでは, 次に起動した時に MFXLoad() から省く
+    if (!find_codec_probe_result("vpl_session").value_or(true)) {
+      spdlog::debug("VPL session is unavailable on this host");
+      return;
+    }
+    try {
+      open();
+    } catch (const std::exception& e) {
+      spdlog::debug("failed to open VPL session: {}", e.what());
+    }
+    save_codec_probe_result("vpl_session", m_instance != nullptr);
+  });
   return m_instance != nullptr;
 }
 
+void VPLSession::openAsync() {
+  if (m_opening.valid()) {
+    return;
+  }
+  m_opening = std::async(std::launch::async, [] { hasInstance(); });
+}
+
 VPLSession& VPLSession::getInstance() {
   return *m_instance;
 }
 
 void VPLSession::close() {
+  if (m_opening.valid()) {
+    m_opening.wait();
+  }
   delete m_instance;
   m_instance = nullptr;
 }
@@ -92,4 +123,23 @@ void VPLSession::open() {
   return m_session;
 }
 
+UniqueVPLSession VPLSession::cloneSession() const {
+  ::mfxSession session = nullptr;
+  auto sts = ::MFXCloneSession(m_session, &session);
+  if (sts != MFX_ERR_NONE) {
+    throw std::runtime_error(fmt::format("MFXCloneSession() failed: {}",
+                                         static_cast<std::int32_t>(sts)));
+  }
+  UniqueVPLSession clone(session);
+  // 複製したセッションはデバイスのハンドルを引き継がない
+  sts = ::MFXVideoCORE_SetHandle(
+      clone.get(), static_cast<::mfxHandleType>(MFX_HANDLE_VA_DISPLAY),
+      m_libva->GetVADisplay());
+  if (sts != MFX_ERR_NONE) {
+    throw std::runtime_error(fmt::format("MFXVideoCORE_SetHandle() failed: {}",
+                                         static_cast<std::int32_t>(sts)));
+  }
+  return clone;
+}
+
 }  // namespace hisui::video
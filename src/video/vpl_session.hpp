@@ -5,7 +5,10 @@
 #include <vpl/mfxvideo.h>
 
 #include <cstdint>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <type_traits>
 
 #include "constants.hpp"
 #include "video/decoder.hpp"
@@ -14,6 +17,13 @@
 
 namespace hisui::video {
 
+struct VPLSessionCloser {
+  void operator()(::mfxSession session) const { ::MFXClose(session); }
+};
+
+using UniqueVPLSession =
+    std::unique_ptr<std::remove_pointer_t<::mfxSession>, VPLSessionCloser>;
+
 class VPLSession {
  public:
   VPLSession(const VPLSession&) = delete;
@@ -21,13 +31,21 @@ class VPLSession {
   VPLSession(VPLSession&&) = delete;
   VPLSession& operator=(VPLSession&&) = delete;
   static VPLSession& getInstance();
+  // 初めて呼ばれた時にセッションを開く. 開けなければ false を返す
   static bool hasInstance();
   static void open();
+  // 別のスレッドでセッションを開き始める. hasInstance() は開き終えるまで待つ
+  static void openAsync();
   static void close();
   ::mfxSession getSession() const;
+  // 同じデバイスを使う別のセッションを作る. MFXVideoCORE_SyncOperation() は
+  // セッションごとに待つので, デコーダーごとに使えば他のデコーダーやエンコーダーを待たない
+  UniqueVPLSession cloneSession() const;
 
  private:
   inline static VPLSession* m_instance = nullptr;
+  inline static std::once_flag m_open_flag;
+  inline static std::future<void> m_opening;
 
   VPLSession();
   ~VPLSession();
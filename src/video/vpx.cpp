@@ -26,9 +26,95 @@
 
 namespace hisui::video {
 
+namespace {
+
+bool is_offline(const hisui::Config& config) {
+  return config.encode_profile == hisui::config::EncodeProfile::Offline;
+}
+
+VPXSpeedSettings get_vpx_speed_settings(const std::uint32_t width,
+                                        const std::uint32_t height,
+                                        const hisui::Config& config) {
+  if (config.encode_speed == hisui::config::EncodeSpeed::Manual) {
+    return {.cpu_used = config.libvpx_cpu_used,
+            .threads = config.libvpx_threads,
+            .tile_columns = config.libvp9_tile_columns,
+            .row_mt = config.libvp9_row_mt,
+            .min_cpu_used = config.libvpx_cpu_used,
+            .max_cpu_used = config.libvpx_cpu_used};
+  }
+
+  // deadline ごとに意味のある範囲. VP9 は VPX_DL_REALTIME では 5 未満を 5 として扱い,
+  // VPX_DL_GOOD_QUALITY では VP8/VP9 ともに 5 を超えても速くならない
+  const bool is_vp9 = config.out_video_codec == hisui::config::VP9;
+  const std::int32_t min_cpu_used = is_offline(config) ? 1 : is_vp9 ? 5 : 4;
+  const std::int32_t max_cpu_used = is_offline(config) ? 5 : is_vp9 ? 9 : 16;
+  std::int32_t cpu_used = (min_cpu_used + max_cpu_used) / 2;
+  switch (config.encode_speed) {
+    case hisui::config::EncodeSpeed::Quality:
+      cpu_used = min_cpu_used;
+      break;
+    case hisui::config::EncodeSpeed::Fast:
+      cpu_used = max_cpu_used;
+      break;
+    default:
+      break;
+  }
+
+  const std::uint64_t pixels = static_cast<std::uint64_t>(width) * height;
+  std::uint32_t threads = 2;
+  if (pixels > 3840 * 2160) {
+    threads = 32;
+  } else if (pixels > 1920 * 1080) {
+    threads = 16;
+  } else if (pixels > 1280 * 720) {
+    threads = 8;
+  } else if (pixels > 640 * 480) {
+    threads = 4;
+  }
+  if (!config.deterministic) {
+    threads = std::min(threads, config.getJobThreads());
+  }
+
+  // VP9 のタイルの幅は 256 以上必要なので, 出力の幅に収まる最大の数にする
+  std::uint32_t tile_columns = 0;
+  while (tile_columns < 6 && (width >> (tile_columns + 1)) >= 256) {
+    ++tile_columns;
+  }
+
+  return {.cpu_used = cpu_used,
+          .threads = threads,
+          .tile_columns = tile_columns,
+          .row_mt = 1,
+          .min_cpu_used = min_cpu_used,
+          .max_cpu_used = max_cpu_used};
+}
+
+// VP8 は VPX_DL_REALTIME で cpu_used が 0 以上の場合, エンコードにかかった時間から
+// 速度を選び直すので, 同じ入力でも出力が変わる. 負の値にするとその絶対値の速度に固定される
+std::int32_t get_vpx_cpu_used(const std::int32_t cpu_used,
+                              const hisui::Config& config) {
+  if (!config.deterministic || is_offline(config) ||
+      config.out_video_codec != hisui::config::VP8 || cpu_used < 0) {
+    return cpu_used;
+  }
+  return -std::max(cpu_used, 1);
+}
+
+}  // namespace
+
 VPXEncoderConfig::VPXEncoderConfig(const std::uint32_t t_width,
                                    const std::uint32_t t_height,
                                    const hisui::Config& config)
+    : VPXEncoderConfig(t_width,
+                       t_height,
+                       config,
+                       get_vpx_speed_settings(t_width, t_height, config)) {}
+
+VPXEncoderConfig::VPXEncoderConfig(const std::uint32_t t_width,
+                                   const std::uint32_t t_height,
+                                   const hisui::Config& config,
+                                   const VPXSpeedSettings& speed)
     : width(t_width),
       height(t_height),
       fps(config.out_video_frame_rate),
@@ -37,11 +123,50 @@ VPXEncoderConfig::VPXEncoderConfig(const std::uint32_t t_width,
       cq_level(config.libvpx_cq_level),
       min_q(config.libvpx_min_q),
       max_q(config.libvpx_max_q),
-      threads(config.libvpx_threads),
+      threads(speed.threads),
       frame_parallel(config.libvp9_frame_parallel),
-      cpu_used(config.libvpx_cpu_used),
-      tile_columns(config.libvp9_tile_columns),
-      row_mt(config.libvp9_row_mt) {}
+      cpu_used(get_vpx_cpu_used(speed.cpu_used, config)),
+      tile_columns(speed.tile_columns),
+      row_mt(speed.row_mt),
+      min_cpu_used(speed.min_cpu_used),
+      max_cpu_used(speed.max_cpu_used),
+      realtime_factor(config.encode_speed ==
+                              hisui::config::EncodeSpeed::Adaptive
+                          ? config.encode_realtime_factor
+                          : 0),
+      deadline(is_offline(config) ? VPX_DL_GOOD_QUALITY : VPX_DL_REALTIME),
+      lag_in_frames(is_offline(config) ? 25 : 0),
+      auto_alt_ref(is_offline(config) ? 1 : 0),
+      keyframe_interval(config.getVideoKeyframeInterval()),
+      active_map(config.libvpx_active_map && !is_offline(config)),
+      measure_quality(config.measure_video_quality) {}
+
+VPXEncoderConfig::VPXEncoderConfig(const VPXEncoderConfig& config,
+                                   const std::uint32_t t_width,
+                                   const std::uint32_t t_height,
+                                   const std::uint32_t t_bitrate)
+    : width(t_width),
+      height(t_height),
+      fps(config.fps),
+      fourcc(config.fourcc),
+      bitrate(t_bitrate),
+      cq_level(config.cq_level),
+      min_q(config.min_q),
+      max_q(config.max_q),
+      threads(config.threads),
+      frame_parallel(config.frame_parallel),
+      cpu_used(config.cpu_used),
+      tile_columns(config.tile_columns),
+      row_mt(config.row_mt),
+      min_cpu_used(config.min_cpu_used),
+      max_cpu_used(config.max_cpu_used),
+      realtime_factor(config.realtime_factor),
+      deadline(config.deadline),
+      lag_in_frames(config.lag_in_frames),
+      auto_alt_ref(config.auto_alt_ref),
+      keyframe_interval(config.keyframe_interval),
+      active_map(config.active_map),
+      measure_quality(config.measure_quality) {}
 
 void update_yuv_image_by_vpx_image(std::shared_ptr<YUVImage> yuv_image,
                                    const vpx_image_t* vpx_image) {
@@ -60,14 +185,27 @@ void update_yuv_image_by_vpx_image(std::shared_ptr<YUVImage> yuv_image,
     const std::uint32_t h = get_vpx_image_plane_height(vpx_image, plane);
     const std::uint32_t s =
         static_cast<std::uint32_t>(vpx_image->stride[plane]);
+    const std::uint32_t d = yuv_image->getStride(static_cast<int>(i));
 
     for (std::uint32_t y = 0; y < h; ++y) {
       std::copy_n(vpx_image->planes[plane] + y * s, w,
-                  yuv_image->yuv[i] + y * w);
+                  yuv_image->yuv[i] + y * d);
     }
   }
 }
 
+void wrap_yuv_image_by_vpx_image(std::shared_ptr<YUVImage> yuv_image,
+                                 const vpx_image_t* vpx_image) {
+  yuv_image->wrap(
+      {vpx_image->planes[VPX_PLANE_Y], vpx_image->planes[VPX_PLANE_U],
+       vpx_image->planes[VPX_PLANE_V]},
+      {static_cast<std::uint32_t>(vpx_image->stride[VPX_PLANE_Y]),
+       static_cast<std::uint32_t>(vpx_image->stride[VPX_PLANE_U]),
+       static_cast<std::uint32_t>(vpx_image->stride[VPX_PLANE_V])},
+      get_vpx_image_plane_width(vpx_image, VPX_PLANE_Y),
+      get_vpx_image_plane_height(vpx_image, VPX_PLANE_Y));
+}
+
 ::vpx_codec_iface_t* get_vpx_decode_codec_iface_by_fourcc(
     const std::uint32_t fourcc) {
   switch (fourcc) {
@@ -157,6 +295,12 @@ void create_vpx_codec_ctx_t_for_encoding(::vpx_codec_ctx_t* codec,
                 vpx_codec_iface_name(dx_algo));
   spdlog::debug("target_bitrate={} cq_level={} min_q={}, max_q={}",
                 config.bitrate, config.cq_level, config.min_q, config.max_q);
+  spdlog::debug("threads={} cpu_used={} tile_columns={} row_mt={}",
+                config.threads, config.cpu_used, config.tile_columns,
+                config.row_mt);
+  spdlog::debug("deadline={} lag_in_frames={} auto_alt_ref={}",
+                config.deadline, config.lag_in_frames, config.auto_alt_ref);
+  spdlog::debug("keyframe_interval={}", config.keyframe_interval);
 
   cfg->g_w = config.width;
   cfg->g_h = config.height;
@@ -168,6 +312,13 @@ void create_vpx_codec_ctx_t_for_encoding(::vpx_codec_ctx_t* codec,
   cfg->rc_max_quantizer = config.max_q;
 
   cfg->g_threads = config.threads;
+  cfg->g_lag_in_frames = config.lag_in_frames;
+  if (config.keyframe_interval != 0) {
+    // 入力の内容によらず同じ位置にキーフレームを置く
+    cfg->kf_mode = VPX_KF_AUTO;
+    cfg->kf_min_dist = config.keyframe_interval;
+    cfg->kf_max_dist = config.keyframe_interval;
+  }
 
   if (::vpx_codec_enc_init(codec, dx_algo, cfg, 0)) {
     throw std::runtime_error("vpx_codec_enc_init() failed");
@@ -175,6 +326,7 @@ void create_vpx_codec_ctx_t_for_encoding(::vpx_codec_ctx_t* codec,
 
   ::vpx_codec_control(codec, VP8E_SET_CQ_LEVEL, config.cq_level);
   ::vpx_codec_control(codec, VP8E_SET_CPUUSED, config.cpu_used);
+  ::vpx_codec_control(codec, VP8E_SET_ENABLEAUTOALTREF, config.auto_alt_ref);
   if (config.fourcc == hisui::config::OutVideoCodec::VP9) {
     ::vpx_codec_control(codec, VP9E_SET_FRAME_PARALLEL_DECODING,
                         config.frame_parallel);
@@ -185,16 +337,103 @@ void create_vpx_codec_ctx_t_for_encoding(::vpx_codec_ctx_t* codec,
 }
 
 void create_vpx_codec_ctx_t_for_decoding(::vpx_codec_ctx_t* codec,
-                                         const std::uint32_t fourcc) {
+                                         const std::uint32_t fourcc,
+                                         const std::uint32_t threads,
+                                         const bool row_mt) {
   const auto dx_algo = get_vpx_decode_codec_iface_by_fourcc(fourcc);
 
   if (!dx_algo) {
     throw std::runtime_error("get_vpx_decode_codec_iface_by_fourcc() failed");
   }
 
-  if (::vpx_codec_dec_init(codec, dx_algo, nullptr, 0)) {
+  ::vpx_codec_dec_cfg_t cfg = {.threads = threads, .w = 0, .h = 0};
+  if (::vpx_codec_dec_init(codec, dx_algo, &cfg, 0)) {
     throw std::runtime_error("vpx_codec_dec_init() failed");
   }
+
+  if (fourcc == hisui::Constants::VP9_FOURCC && row_mt && threads > 1) {
+    if (::vpx_codec_control(codec, VP9D_SET_ROW_MT, 1)) {
+      throw std::runtime_error("vpx_codec_control(VP9D_SET_ROW_MT) failed");
+    }
+  }
+}
+
+std::size_t update_vpx_active_map(std::vector<unsigned char>* active_map,
+                                  std::vector<unsigned char>* previous,
+                                  const std::vector<unsigned char>& current,
+                                  const std::uint32_t width,
+                                  const std::uint32_t height) {
+  const std::size_t cols = (width + 15) >> 4;
+  const std::size_t rows = (height + 15) >> 4;
+  const std::size_t chroma_width = (width + 1) >> 1;
+  const std::size_t chroma_height = (height + 1) >> 1;
+  const std::size_t luma_size = static_cast<std::size_t>(width) * height;
+  const std::size_t chroma_size = chroma_width * chroma_height;
+  const std::size_t image_size = luma_size + 2 * chroma_size;
+
+  if (std::size(*previous) != image_size) {
+    previous->assign(std::begin(current),
+                     std::begin(current) +
+                         static_cast<std::ptrdiff_t>(image_size));
+    active_map->assign(rows * cols, 1);
+    return rows * cols;
+  }
+  active_map->resize(rows * cols);
+
+  // 1 つの plane の中の macroblock の範囲を比べる
+  const auto is_block_changed = [&](const std::size_t offset,
+                                    const std::size_t stride,
+                                    const std::size_t plane_height,
+                                    const std::size_t x, const std::size_t y,
+                                    const std::size_t block_size) {
+    const auto block_width = std::min(block_size, stride - x);
+    const auto y_end = std::min(y + block_size, plane_height);
+    bool is_changed = false;
+    for (auto row = y; row < y_end && !is_changed; ++row) {
+      const auto begin = std::begin(current) +
+                         static_cast<std::ptrdiff_t>(offset + row * stride + x);
+      is_changed = !std::equal(
+          begin, begin + static_cast<std::ptrdiff_t>(block_width),
+          std::begin(*previous) +
+              static_cast<std::ptrdiff_t>(offset + row * stride + x));
+    }
+    return is_changed;
+  };
+  const auto copy_block = [&](const std::size_t offset,
+                              const std::size_t stride,
+                              const std::size_t plane_height,
+                              const std::size_t x, const std::size_t y,
+                              const std::size_t block_size) {
+    const auto block_width = std::min(block_size, stride - x);
+    const auto y_end = std::min(y + block_size, plane_height);
+    for (auto row = y; row < y_end; ++row) {
+      const auto position =
+          static_cast<std::ptrdiff_t>(offset + row * stride + x);
+      std::copy_n(std::begin(current) + position, block_width,
+                  std::begin(*previous) + position);
+    }
+  };
+
+  std::size_t number_of_changed = 0;
+  for (std::size_t r = 0; r < rows; ++r) {
+    for (std::size_t c = 0; c < cols; ++c) {
+      const bool is_changed =
+          is_block_changed(0, width, height, c << 4, r << 4, 16) ||
+          is_block_changed(luma_size, chroma_width, chroma_height, c << 3,
+                           r << 3, 8) ||
+          is_block_changed(luma_size + chroma_size, chroma_width,
+                           chroma_height, c << 3, r << 3, 8);
+      (*active_map)[r * cols + c] = is_changed ? 1 : 0;
+      if (is_changed) {
+        copy_block(0, width, height, c << 4, r << 4, 16);
+        copy_block(luma_size, chroma_width, chroma_height, c << 3, r << 3, 8);
+        copy_block(luma_size + chroma_size, chroma_width, chroma_height,
+                   c << 3, r << 3, 8);
+        ++number_of_changed;
+      }
+    }
+  }
+  return number_of_changed;
 }
 
 }  // namespace hisui::video
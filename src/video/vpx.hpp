@@ -4,6 +4,7 @@
 #include <vpx/vpx_encoder.h>
 #include <vpx/vpx_image.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -21,11 +22,27 @@ namespace hisui::video {
 
 class YUVImage;
 
+// --encode-speed から決まる libvpx の速度に関する設定
+struct VPXSpeedSettings {
+  const std::int32_t cpu_used;
+  const std::uint32_t threads;
+  const std::uint32_t tile_columns;
+  const std::uint32_t row_mt;
+  // adaptive の場合に cpu_used を動かす範囲
+  const std::int32_t min_cpu_used;
+  const std::int32_t max_cpu_used;
+};
+
 class VPXEncoderConfig {
  public:
   VPXEncoderConfig(const std::uint32_t,
                    const std::uint32_t,
                    const hisui::Config&);
+  // 解像度とビットレートだけを変えた設定
+  VPXEncoderConfig(const VPXEncoderConfig&,
+                   const std::uint32_t,
+                   const std::uint32_t,
+                   const std::uint32_t);
   const std::uint32_t width;
   const std::uint32_t height;
   const boost::rational<std::uint64_t> fps;
@@ -39,10 +56,32 @@ class VPXEncoderConfig {
   const std::int32_t cpu_used;
   const std::uint32_t tile_columns;
   const std::uint32_t row_mt;
+  const std::int32_t min_cpu_used;
+  const std::int32_t max_cpu_used;
+  // 0 の場合は cpu_used を変えない
+  const double realtime_factor;
+  const unsigned long deadline;
+  const std::uint32_t lag_in_frames;
+  const std::uint32_t auto_alt_ref;
+  // 0 の場合はエンコーダーに任せる
+  const std::uint32_t keyframe_interval;
+  // lag_in_frames が 0 の場合のみ有効
+  const bool active_map;
+  // 出力をデコードして画質を集計する
+  const bool measure_quality;
+
+ private:
+  VPXEncoderConfig(const std::uint32_t,
+                   const std::uint32_t,
+                   const hisui::Config&,
+                   const VPXSpeedSettings&);
 };
 
 void update_yuv_image_by_vpx_image(std::shared_ptr<YUVImage>,
                                    const ::vpx_image_t*);
+// vpx_image の plane をコピーせずに参照させる
+void wrap_yuv_image_by_vpx_image(std::shared_ptr<YUVImage>,
+                                 const ::vpx_image_t*);
 
 vpx_codec_iface_t* get_vpx_decode_codec_iface_by_fourcc(const std::uint32_t);
 vpx_codec_iface_t* get_vpx_encode_codec_iface_by_fourcc(const std::uint32_t);
@@ -59,7 +98,20 @@ void create_vpx_codec_ctx_t_for_encoding(::vpx_codec_ctx_t*,
                                          ::vpx_codec_enc_cfg_t*,
                                          const VPXEncoderConfig&);
 
+// I420 の current を 16x16 の macroblock ごとに previous と比べ, 変わった macroblock を
+// 1, 変わらない macroblock を 0 として active_map に行順に書く. previous の変わった部分は
+// current で更新する. previous の大きさが合わない場合は全て変わったものとする.
+// 変わった macroblock の数を返す
+std::size_t update_vpx_active_map(std::vector<unsigned char>* active_map,
+                                  std::vector<unsigned char>* previous,
+                                  const std::vector<unsigned char>& current,
+                                  const std::uint32_t width,
+                                  const std::uint32_t height);
+
+// row_mt は VP9 の場合のみ有効
 void create_vpx_codec_ctx_t_for_decoding(::vpx_codec_ctx_t*,
-                                         const std::uint32_t);
+                                         const std::uint32_t,
+                                         const std::uint32_t threads = 1,
+                                         const bool row_mt = false);
 
 }  // namespace hisui::video
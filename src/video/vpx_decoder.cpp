@@ -4,6 +4,7 @@
 #include <fmt/core.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
+#include <vpx/vp8dx.h>
 #include <vpx/vpx_codec.h>
 #include <vpx/vpx_decoder.h>
 #include <vpx/vpx_image.h>
@@ -11,18 +12,54 @@
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <tuple>
 
 #include "constants.hpp"
 #include "report/reporter.hpp"
+#include "video/context_pool.hpp"
+#include "video/vp8_header.hpp"
 #include "video/vpx.hpp"
 #include "video/yuv.hpp"
 #include "webm/input/video_context.hpp"
 
 namespace hisui::video {
 
-VPXDecoder::VPXDecoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm)
-    : Decoder(t_webm) {
-  create_vpx_codec_ctx_t_for_decoding(&m_codec, m_webm->getFourcc());
+namespace {
+
+void destroy_vpx_codec_ctx(::vpx_codec_ctx_t* codec) {
+  ::vpx_codec_destroy(codec);
+  delete codec;
+}
+
+using VPXContextPool =
+    ContextPool<std::tuple<std::uint32_t, std::uint32_t, bool>,
+                ::vpx_codec_ctx_t>;
+
+// VP8, VP9 はキーフレームで参照フレームを全て置き換えるので, 録画の先頭から
+// デコードすれば前の録画の状態は残らない
+VPXContextPool& get_context_pool() {
+  static VPXContextPool pool(destroy_vpx_codec_ctx);
+  return pool;
+}
+
+}  // namespace
+
+VPXDecoder::VPXDecoder(std::shared_ptr<hisui::webm::input::VideoContext> t_webm,
+                       const std::uint32_t threads,
+                       const bool row_mt,
+                       const bool skip_loop_filter_when_downscaled)
+    : Decoder(t_webm),
+      m_context_key(m_webm->getFourcc(), threads, row_mt),
+      m_codec(get_context_pool().acquire(m_context_key)),
+      m_skip_loop_filter_when_downscaled(
+          skip_loop_filter_when_downscaled &&
+          m_webm->getFourcc() == hisui::Constants::VP9_FOURCC) {
+  if (m_codec == nullptr) {
+    auto codec = std::make_unique<::vpx_codec_ctx_t>();
+    create_vpx_codec_ctx_t_for_decoding(codec.get(), m_webm->getFourcc(),
+                                        threads, row_mt);
+    m_codec = codec.release();
+  }
 
   m_current_yuv_image = std::make_shared<YUVImage>(m_width, m_height);
 
@@ -52,10 +89,18 @@ VPXDecoder::~VPXDecoder() {
   if (m_current_vpx_image) {
     ::vpx_img_free(m_current_vpx_image);
   }
-  ::vpx_codec_destroy(&m_codec);
+  if (m_is_loop_filter_skipped &&
+      ::vpx_codec_control(m_codec, VP9_SET_SKIP_LOOP_FILTER, 0)) {
+    m_is_codec_failed = true;
+  }
+  if (m_is_codec_failed) {
+    destroy_vpx_codec_ctx(m_codec);
+  } else {
+    get_context_pool().release(m_context_key, m_codec);
+  }
 }
 
-const std::shared_ptr<YUVImage> VPXDecoder::getImage(
+const std::shared_ptr<YUVImage>& VPXDecoder::getImage(
     const std::uint64_t timestamp) {
   // 非対応 WebM or 時間超過
   if (!m_webm || m_is_time_over) {
@@ -66,12 +111,38 @@ const std::shared_ptr<YUVImage> VPXDecoder::getImage(
     m_is_time_over = true;
     return m_black_yuv_image;
   }
-  // 極端におおきな fps にはしないと思うので m_current_yuv_image への変換は毎回やってよいと考えている
   updateVPXImage(timestamp);
-  update_yuv_image_by_vpx_image(m_current_yuv_image, m_current_vpx_image);
+  // デコード結果が変わった時だけ参照し直す. 参照先は次のデコードまで有効
+  if (m_is_current_vpx_image_updated) {
+    wrap_yuv_image_by_vpx_image(m_current_yuv_image, m_current_vpx_image);
+    m_current_yuv_image->setTimestamp(m_current_timestamp);
+    m_is_current_vpx_image_updated = false;
+  }
   return m_current_yuv_image;
 }
 
+void VPXDecoder::setDisplaySize(const std::uint32_t width,
+                                const std::uint32_t height) {
+  if (!m_skip_loop_filter_when_downscaled) {
+    return;
+  }
+  // 参照フレームにもフィルターがかからないため画質は劣化していくが,
+  // 縦横とも半分以下に縮小して表示する場合は目立ちにくい
+  const bool skip = 2 * width <= m_width && 2 * height <= m_height;
+  if (skip == m_is_loop_filter_skipped) {
+    return;
+  }
+  if (::vpx_codec_control(m_codec, VP9_SET_SKIP_LOOP_FILTER, skip ? 1 : 0)) {
+    spdlog::warn("vpx_codec_control(VP9_SET_SKIP_LOOP_FILTER) failed: {}",
+                 m_webm->getFilePath());
+    m_skip_loop_filter_when_downscaled = false;
+    return;
+  }
+  spdlog::debug("VPXDecoder: skip_loop_filter={} file_path={}", skip,
+                m_webm->getFilePath());
+  m_is_loop_filter_skipped = skip;
+}
+
 void VPXDecoder::updateVPXImage(const std::uint64_t timestamp) {
   // 次のブロックに逹っしていない
   if (timestamp < m_next_timestamp) {
@@ -85,6 +156,8 @@ void VPXDecoder::updateVPXImageByTimestamp(const std::uint64_t timestamp) {
   if (m_finished_webm) {
     return;
   }
+  // trim などで先に飛んだ場合, 間のフレームは表示されないので復号しない
+  m_webm->seekToKeyFrame(static_cast<std::int64_t>(timestamp));
 
   do {
     ::vpx_codec_iter_t codec_iter = nullptr;
@@ -104,23 +177,30 @@ void VPXDecoder::updateVPXImageByTimestamp(const std::uint64_t timestamp) {
       ::vpx_img_free(m_current_vpx_image);
     }
     m_current_vpx_image = m_next_vpx_image;
+    m_is_current_vpx_image_updated = true;
     m_current_timestamp = m_next_timestamp;
-    if (m_webm->readFrame()) {
-      spdlog::trace("webm->getBufferSize(): {}", m_webm->getBufferSize());
+    if (readFrame(timestamp)) {
+      SPDLOG_TRACE("webm->getBufferSize(): {}", m_webm->getBufferSize());
+      if (!isDisplayed(timestamp)) {
+        countDroppedFrame();
+      }
+      hisui::report::DecodeTimer timer(m_counters, m_webm->getBufferSize());
       const auto ret = ::vpx_codec_decode(
-          &m_codec, m_webm->getBuffer(),
+          m_codec, m_webm->getBuffer(),
           static_cast<unsigned int>(m_webm->getBufferSize()), nullptr, 0);
       if (ret != VPX_CODEC_OK) {
+        m_is_codec_failed = true;
         spdlog::warn("vpx_codec_decode() failed: error_code={}", ret);
-        const char* detail = ::vpx_codec_error_detail(&m_codec);
+        const char* detail = ::vpx_codec_error_detail(m_codec);
         if (detail != nullptr) {
           spdlog::warn("vpx_codec_decode() error detail: {}", detail);
         }
         throw std::runtime_error(
             fmt::format("vpx_codec_decode() failed: error_code={}", ret));
       }
-      m_next_vpx_image = ::vpx_codec_get_frame(&m_codec, &codec_iter);
+      m_next_vpx_image = ::vpx_codec_get_frame(m_codec, &codec_iter);
       if (!m_next_vpx_image) {
+        m_is_codec_failed = true;
         throw std::runtime_error("vpx_codec_get_frame() failed");
       }
       m_next_timestamp = static_cast<std::uint64_t>(m_webm->getTimestamp());
@@ -137,4 +217,22 @@ void VPXDecoder::updateVPXImageByTimestamp(const std::uint64_t timestamp) {
   } while (timestamp >= m_next_timestamp);
 }
 
+// timestamp までに後続のフレームに上書きされて表示されないフレームのうち,
+// 後続のフレームの復号に影響しないものは復号せずに読み飛ばす
+bool VPXDecoder::readFrame(const std::uint64_t timestamp) {
+  while (m_webm->readFrame()) {
+    if (m_webm->getFourcc() != hisui::Constants::VP8_FOURCC ||
+        static_cast<std::uint64_t>(m_webm->getTimestamp()) > timestamp ||
+        !is_droppable_vp8_frame(m_webm->getBuffer(),
+                                m_webm->getBufferSize())) {
+      return true;
+    }
+    if (isDisplayed(timestamp)) {
+      return true;
+    }
+    countDroppedFrame();
+  }
+  return false;
+}
+
 }  // namespace hisui::video
@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <tuple>
 
 #include "video/decoder.hpp"
 
@@ -20,22 +21,36 @@ class YUVImage;
 
 class VPXDecoder : public Decoder {
  public:
-  explicit VPXDecoder(std::shared_ptr<hisui::webm::input::VideoContext>);
+  explicit VPXDecoder(std::shared_ptr<hisui::webm::input::VideoContext>,
+                      const std::uint32_t threads = 1,
+                      const bool row_mt = false,
+                      const bool skip_loop_filter_when_downscaled = false);
 
   ~VPXDecoder();
 
-  const std::shared_ptr<YUVImage> getImage(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getImage(const std::uint64_t) override;
+  void setDisplaySize(const std::uint32_t, const std::uint32_t) override;
 
  private:
-  ::vpx_codec_ctx_t m_codec;
+  // fourcc, threads, row_mt. 同じ設定のデコーダーと context を使い回す
+  using ContextKey = std::tuple<std::uint32_t, std::uint32_t, bool>;
+
+  const ContextKey m_context_key;
+  ::vpx_codec_ctx_t* m_codec;
+  // デコードに失敗した context は使い回さない
+  bool m_is_codec_failed = false;
   std::uint64_t m_current_timestamp = 0;
   std::uint64_t m_next_timestamp = 0;
   ::vpx_image_t* m_current_vpx_image = nullptr;
   ::vpx_image_t* m_next_vpx_image = nullptr;
   std::shared_ptr<YUVImage> m_current_yuv_image = nullptr;
+  bool m_is_current_vpx_image_updated = true;
   bool m_report_enabled = false;
+  bool m_skip_loop_filter_when_downscaled;
+  bool m_is_loop_filter_skipped = false;
 
   void updateVPXImage(const std::uint64_t);
+  bool readFrame(const std::uint64_t);
 
   void updateCurrentYUVImage();
 
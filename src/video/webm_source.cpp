@@ -5,55 +5,195 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <system_error>
 
 #include "constants.hpp"
+#include "util/file.hpp"
+#include "util/trace.hpp"
+#include "version/version.hpp"
 #include "video/av1_decoder.hpp"
 #include "video/decoder.hpp"
 #include "video/decoder_factory.hpp"
 #include "video/openh264_decoder.hpp"
 #include "video/openh264_handler.hpp"
+#include "video/shared_frame_cache.hpp"
 #include "video/vpx_decoder.hpp"
 #include "video/yuv.hpp"
 #include "webm/input/video_context.hpp"
 
 namespace hisui::video {
 
-WebMSource::WebMSource(const std::string& t_file_path) {
-  m_webm = std::make_shared<hisui::webm::input::VideoContext>(t_file_path);
-  if (!m_webm->init()) {
+namespace {
+
+// 内容が変わったかを確かめられない URL や名前付きパイプでは 0 を返し, キャッシュを使わない
+std::uint64_t make_frame_cache_key(const std::string& file_path) {
+  if (hisui::util::is_url(file_path)) {
+    return 0;
+  }
+  const auto absolute_path = std::filesystem::absolute(file_path);
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(absolute_path, ec)) {
+    return 0;
+  }
+  const auto size = std::filesystem::file_size(absolute_path, ec);
+  if (ec) {
+    return 0;
+  }
+  const auto mtime = std::filesystem::last_write_time(absolute_path, ec);
+  if (ec) {
+    return 0;
+  }
+  // デコーダーが変わればデコードの結果も変わりうる
+  const auto key = std::hash<std::string>{}(fmt::format(
+      "{} size={} mtime={} hisui={}", absolute_path.string(), size,
+      mtime.time_since_epoch().count(), hisui::version::get_hisui_version()));
+  return key == 0 ? 1 : key;
+}
+
+}  // namespace
+
+WebMSource::WebMSource(const std::string& t_file_path)
+    : m_file_path(t_file_path) {
+  // ここではヘッダーから解像度を得るだけにし, デコーダーは最初の getYUV() で作る
+  hisui::webm::input::VideoContext webm(m_file_path);
+  if (!webm.init()) {
     spdlog::info(
         "VideoContext initialization failed. no video track, invalid video "
         "track or unsupported codec: file_path={}",
         t_file_path);
 
-    m_webm = nullptr;
     m_width = 320;
     m_height = 240;
-    m_black_yuv_image = create_black_yuv_image(m_width, m_height);
+    m_black_yuv_image = get_shared_black_yuv_image(m_width, m_height);
     return;
   }
 
-  m_width = m_webm->getWidth();
-  m_height = m_webm->getHeight();
+  m_has_video = true;
+  m_width = webm.getWidth();
+  m_height = webm.getHeight();
 
   spdlog::trace("WebMSource: file_path={}, width={}, height={}", t_file_path,
                 m_width, m_height);
 
-  m_duration = static_cast<std::uint64_t>(m_webm->getDuration());
-  m_black_yuv_image = create_black_yuv_image(m_width, m_height);
+  m_duration = static_cast<std::uint64_t>(webm.getDuration());
 
-  m_decoder = hisui::video::DecoderFactory::create(m_webm);
+  if (SharedFrameCache::getInstance() != nullptr) {
+    m_frame_cache_key = make_frame_cache_key(m_file_path);
+  }
 }
 
-const std::shared_ptr<YUVImage> WebMSource::getYUV(
+const std::shared_ptr<YUVImage>& WebMSource::getYUV(
     const std::uint64_t timestamp) {
-  if (!m_decoder) {
+  if (!m_has_video) {
     return m_black_yuv_image;
   }
+  if (m_frame_cache_key != 0) {
+    return getYUVFromFrameCache(timestamp);
+  }
+  if (!m_decoder) {
+    open();
+  }
+  HISUI_TRACE_SCOPE("Decoder::getImage");
   return m_decoder->getImage(timestamp);
 }
 
+// 他のプロセスが既にデコードしたフレームがあればそれを使い, 無ければデコードして置く.
+// デコーダーは前回デコードした位置から続けるので, キャッシュから得た分は後でまとめてデコードする
+const std::shared_ptr<YUVImage>& WebMSource::getYUVFromFrameCache(
+    const std::uint64_t timestamp) {
+  auto* cache = SharedFrameCache::getInstance();
+  const bool is_downscaled = m_display_width != 0 &&
+                             2 * m_display_width <= m_width &&
+                             2 * m_display_height <= m_height;
+  const auto key = SharedFrameCache::makeKey(m_frame_cache_key, timestamp,
+                                             is_downscaled, isKeyFramesOnly());
+  if (cache->find(key, &m_cached_image)) {
+    return m_cached_image;
+  }
+  if (!m_decoder) {
+    open();
+  }
+  HISUI_TRACE_SCOPE("Decoder::getImage");
+  const auto& image = m_decoder->getImage(timestamp);
+  if (image) {
+    cache->insert(key, *image);
+  }
+  return image;
+}
+
+void WebMSource::release() {
+  if (m_decoder) {
+    spdlog::trace("WebMSource: release decoder: file_path={}", m_file_path);
+  }
+  m_decoder = nullptr;
+  m_webm = nullptr;
+}
+
+void WebMSource::warmUp() {
+  if (!m_has_video) {
+    return;
+  }
+  if (!m_decoder) {
+    open();
+  }
+  m_decoder->getImage(0);
+}
+
+void WebMSource::setDisplaySize(const std::uint32_t width,
+                                const std::uint32_t height) {
+  m_display_width = std::max(m_display_width, width);
+  m_display_height = std::max(m_display_height, height);
+  if (m_decoder) {
+    m_decoder->setDisplaySize(m_display_width, m_display_height);
+  }
+}
+
+void WebMSource::setKeyFramesOnly(const bool key_frames_only) {
+  m_is_key_frames_only = key_frames_only && m_is_key_frames_only.value_or(true);
+  if (m_webm) {
+    m_webm->setKeyFramesOnly(isKeyFramesOnly());
+  }
+}
+
+void WebMSource::setDegradedKeyFramesOnly(const bool key_frames_only) {
+  m_is_degraded_key_frames_only = key_frames_only;
+  if (m_webm) {
+    m_webm->setKeyFramesOnly(isKeyFramesOnly());
+  }
+}
+
+bool WebMSource::isKeyFramesOnly() const {
+  return m_is_always_key_frames_only || m_is_degraded_key_frames_only ||
+         m_is_key_frames_only.value_or(false);
+}
+
+void WebMSource::setAlwaysKeyFramesOnly(const bool key_frames_only) {
+  m_is_always_key_frames_only = key_frames_only;
+}
+
+void WebMSource::open() {
+  HISUI_TRACE_SCOPE("WebMSource::open");
+  m_webm = std::make_shared<hisui::webm::input::VideoContext>(m_file_path);
+  if (!m_webm->init()) {
+    throw std::runtime_error(
+        fmt::format("failed to reopen video track: file_path={}", m_file_path));
+  }
+  if (isKeyFramesOnly()) {
+    m_webm->setKeyFramesOnly(true);
+  }
+  m_decoder = hisui::video::DecoderFactory::create(m_webm);
+  if (m_display_width != 0 && m_display_height != 0) {
+    m_decoder->setDisplaySize(m_display_width, m_display_height);
+  }
+}
+
 std::uint32_t WebMSource::getWidth() const {
   return m_width;
 }
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include "video/source.hpp"
@@ -20,19 +21,45 @@ class YUVImage;
 class WebMSource : public Source {
  public:
   explicit WebMSource(const std::string&);
-  const std::shared_ptr<YUVImage> getYUV(const std::uint64_t) override;
+  const std::shared_ptr<YUVImage>& getYUV(const std::uint64_t) override;
   std::uint32_t getWidth() const override;
   std::uint32_t getHeight() const override;
+  void release() override;
+  void warmUp() override;
+  void setDisplaySize(const std::uint32_t, const std::uint32_t) override;
+  void setKeyFramesOnly(const bool) override;
+  void setDegradedKeyFramesOnly(const bool) override;
+
+  // true ならば, setKeyFramesOnly() によらず全ての WebMSource でキーフレームのみをデコードする
+  static void setAlwaysKeyFramesOnly(const bool);
 
  private:
+  std::string m_file_path;
+  bool m_has_video = false;
   std::shared_ptr<hisui::webm::input::VideoContext> m_webm;
   std::shared_ptr<hisui::video::Decoder> m_decoder;
   std::shared_ptr<YUVImage> m_black_yuv_image;
   std::uint32_t m_width;
   std::uint32_t m_height;
   std::uint64_t m_duration;
+  // 0 ならば表示する大きさは分からない
+  std::uint32_t m_display_width = 0;
+  std::uint32_t m_display_height = 0;
+  // 空ならばまだ setKeyFramesOnly() が呼ばれていない
+  std::optional<bool> m_is_key_frames_only;
+  bool m_is_degraded_key_frames_only = false;
+
+  inline static bool m_is_always_key_frames_only = false;
+
+  // SharedFrameCache でこのファイルを表す key. 0 ならば使わない
+  std::uint64_t m_frame_cache_key = 0;
+  // SharedFrameCache から写したフレーム
+  std::shared_ptr<YUVImage> m_cached_image;
 
   void readFrame();
+  void open();
+  bool isKeyFramesOnly() const;
+  const std::shared_ptr<YUVImage>& getYUVFromFrameCache(const std::uint64_t);
 };
 
 }  // namespace hisui::video
@@ -1,21 +1,126 @@
 #include "video/yuv.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "util/cpu_dispatch.hpp"
 
 namespace hisui::video {
 
-YUVImage::YUVImage(const std::uint32_t t_width, const std::uint32_t t_height)
-    : m_width(t_width), m_height(t_height) {
-  yuv[0] = new std::uint8_t[getWidth(0) * getHeight(0)];
-  yuv[1] = new std::uint8_t[getWidth(1) * getHeight(1)];
-  yuv[2] = new std::uint8_t[getWidth(2) * getHeight(2)];
+namespace {
+
+std::size_t align_up(const std::size_t value, const std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::uint64_t next_generation() {
+  static std::atomic<std::uint64_t> generation = 0;
+  return ++generation;
+}
+
+// rectangles のいずれにも覆われていない部分を, 行の区間ごとに
+// f(y_begin, y_end, x_begin, x_end) で渡す
+template <class F>
+void for_each_gap_outside_rectangles(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles,
+    const F& f) {
+  // 覆っている rectangle の組が変わる y で区切り, 区間ごとに覆われない範囲を求める
+  std::vector<std::uint32_t> boundaries{0, height};
+  for (const auto& r : rectangles) {
+    boundaries.push_back(std::min(r.y, height));
+    boundaries.push_back(std::min(r.y + r.height, height));
+  }
+  std::sort(std::begin(boundaries), std::end(boundaries));
+  boundaries.erase(std::unique(std::begin(boundaries), std::end(boundaries)),
+                   std::end(boundaries));
+
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> covered;
+  for (std::size_t b = 0; b + 1 < std::size(boundaries); ++b) {
+    const auto y_begin = boundaries[b];
+    const auto y_end = boundaries[b + 1];
+
+    covered.clear();
+    for (const auto& r : rectangles) {
+      if (r.y <= y_begin && y_begin < r.y + r.height && r.x < width) {
+        covered.emplace_back(r.x, std::min(r.x + r.width, width));
+      }
+    }
+    std::sort(std::begin(covered), std::end(covered));
+
+    std::uint32_t x = 0;
+    for (const auto& [x_begin, x_end] : covered) {
+      if (x < x_begin) {
+        f(y_begin, y_end, x, x_begin);
+      }
+      x = std::max(x, x_end);
+    }
+    if (x < width) {
+      f(y_begin, y_end, x, width);
+    }
+  }
+}
+
+HISUI_TARGET_CLONES
+void interleave_uv(unsigned char* dst,
+                   const unsigned char* u,
+                   const unsigned char* v,
+                   const std::uint32_t width) {
+  for (std::uint32_t x = 0; x < width; ++x) {
+    dst[2 * x] = u[x];
+    dst[2 * x + 1] = v[x];
+  }
+}
+
+}  // namespace
+
+YUVImage::YUVImage(const std::uint32_t t_width,
+                   const std::uint32_t t_height,
+                   const std::uint32_t t_stride_alignment)
+    : m_width(t_width),
+      m_height(t_height),
+      m_stride_alignment(t_stride_alignment),
+      m_generation(next_generation()) {
+  if (m_stride_alignment == 0) {
+    throw std::invalid_argument("stride_alignment must be greater than 0");
+  }
+  layoutPlanes();
 }
 
 YUVImage::~YUVImage() {
-  delete[] yuv[0];
-  delete[] yuv[1];
-  delete[] yuv[2];
+  hisui::util::free_image_buffer(m_buffer, YUV_IMAGE_ALIGNMENT);
+}
+
+void YUVImage::layoutPlanes() {
+  std::array<std::size_t, 3> offsets;
+  std::size_t size = 0;
+  for (std::size_t p = 0; p < 3; ++p) {
+    const auto plane = static_cast<int>(p);
+    m_strides[p] = static_cast<std::uint32_t>(
+        align_up(getWidth(plane), m_stride_alignment));
+    offsets[p] = size;
+    size += align_up(static_cast<std::size_t>(m_strides[p]) * getHeight(plane),
+                     YUV_IMAGE_ALIGNMENT);
+  }
+
+  if (size > m_buffer.size) {
+    hisui::util::free_image_buffer(m_buffer, YUV_IMAGE_ALIGNMENT);
+    m_buffer = {};
+    m_buffer = hisui::util::allocate_image_buffer(size, YUV_IMAGE_ALIGNMENT);
+  }
+
+  for (std::size_t p = 0; p < 3; ++p) {
+    yuv[p] = m_buffer.data + offsets[p];
+  }
 }
 
 bool YUVImage::checkWidthAndHeight(const std::uint32_t t_width,
@@ -25,22 +130,44 @@ bool YUVImage::checkWidthAndHeight(const std::uint32_t t_width,
 
 void YUVImage::setWidthAndHeight(const std::uint32_t t_width,
                                  const std::uint32_t t_height) {
-  if (checkWidthAndHeight(t_width, t_height)) {
-    return;
-  }
-  if (t_width * t_height == m_width * m_height) {
-    m_width = t_width;
-    m_height = t_height;
+  if (!m_is_wrapped && checkWidthAndHeight(t_width, t_height)) {
     return;
   }
   m_width = t_width;
   m_height = t_height;
-  delete[] yuv[0];
-  delete[] yuv[1];
-  delete[] yuv[2];
-  yuv[0] = new std::uint8_t[getWidth(0) * getHeight(0)];
-  yuv[1] = new std::uint8_t[getWidth(1) * getHeight(1)];
-  yuv[2] = new std::uint8_t[getWidth(2) * getHeight(2)];
+  m_is_wrapped = false;
+  layoutPlanes();
+  updateGeneration();
+}
+
+void YUVImage::wrap(const std::array<std::uint8_t*, 3>& planes,
+                    const std::array<std::uint32_t, 3>& strides,
+                    const std::uint32_t t_width,
+                    const std::uint32_t t_height) {
+  m_width = t_width;
+  m_height = t_height;
+  for (std::size_t p = 0; p < 3; ++p) {
+    if (strides[p] < getWidth(static_cast<int>(p))) {
+      throw std::invalid_argument("stride is smaller than width");
+    }
+  }
+  yuv = planes;
+  m_strides = strides;
+  m_is_wrapped = true;
+  updateGeneration();
+}
+
+bool YUVImage::isWrapped() const {
+  return m_is_wrapped;
+}
+
+bool YUVImage::isPacked() const {
+  for (std::size_t p = 0; p < 3; ++p) {
+    if (m_strides[p] != getWidth(static_cast<int>(p))) {
+      return false;
+    }
+  }
+  return true;
 }
 
 std::uint32_t YUVImage::getWidth(const int plane) const {
@@ -57,13 +184,48 @@ std::uint32_t YUVImage::getHeight(const int plane) const {
   return (m_height + 1) >> 1;
 }
 
+std::uint32_t YUVImage::getStride(const int plane) const {
+  return m_strides[static_cast<std::size_t>(plane)];
+}
+
+std::size_t YUVImage::getCapacity() const {
+  return m_buffer.size;
+}
+
+YUVImageView YUVImage::getView() const {
+  return {.planes = {yuv[0], yuv[1], yuv[2]},
+          .strides = m_strides,
+          .width = m_width,
+          .height = m_height,
+          .generation = m_generation};
+}
+
+void YUVImage::setTimestamp(const std::uint64_t t_timestamp) {
+  m_timestamp = t_timestamp;
+  updateGeneration();
+}
+
+std::uint64_t YUVImage::getTimestamp() const {
+  return m_timestamp;
+}
+
+std::uint64_t YUVImage::getGeneration() const {
+  return m_generation;
+}
+
+void YUVImage::updateGeneration() {
+  m_generation = next_generation();
+}
+
 void YUVImage::setBlack() {
-  for (std::size_t i = 0; i < 3; ++i) {
-    std::fill(
-        yuv[i],
-        yuv[i] + getWidth(static_cast<int>(i)) * getHeight(static_cast<int>(i)),
-        i == 0 ? 0 : 128);
-  }
+  for_each_i420_plane([this](const auto plane) {
+    using Plane = decltype(plane);
+    constexpr auto p = static_cast<int>(Plane::index);
+    std::fill_n(yuv[Plane::index],
+                static_cast<std::size_t>(getStride(p)) * getHeight(p),
+                Plane::default_value);
+  });
+  updateGeneration();
 }
 
 std::shared_ptr<YUVImage> create_black_yuv_image(const std::uint32_t width,
@@ -73,6 +235,25 @@ std::shared_ptr<YUVImage> create_black_yuv_image(const std::uint32_t width,
   return image;
 }
 
+std::shared_ptr<YUVImage> get_shared_black_yuv_image(
+    const std::uint32_t width,
+    const std::uint32_t height) {
+  static std::mutex mutex;
+  // 使われなくなった画像は解放する
+  static std::map<std::pair<std::uint32_t, std::uint32_t>,
+                  std::weak_ptr<YUVImage>>
+      images;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& cached = images[{width, height}];
+  if (auto image = cached.lock()) {
+    return image;
+  }
+  auto image = create_black_yuv_image(width, height);
+  cached = image;
+  return image;
+}
+
 void merge_yuv_planes_from_top_left(
     unsigned char* merged,
     const std::size_t merged_size,
@@ -82,19 +263,210 @@ void merge_yuv_planes_from_top_left(
     const std::uint32_t src_width,
     const std::uint32_t src_height,
     const unsigned char default_value) {
-  std::fill_n(merged, merged_size, default_value);
-
   for (std::size_t i = 0; i < number_of_srcs; ++i) {
-    const auto c = i % column;
-    const auto r = i / column;
+    copy_yuv_plane_to_grid(merged, column, srcs[i], i, src_width, src_height);
+  }
+  fill_yuv_plane_outside_grid(merged, merged_size, column, number_of_srcs,
+                              src_width, src_height, default_value);
+}
+
+void merge_yuv_plane_rows_from_top_left(
+    unsigned char* merged,
+    const std::size_t column,
+    const std::vector<const unsigned char*>& srcs,
+    const std::size_t number_of_srcs,
+    const std::uint32_t src_width,
+    const std::uint32_t src_height,
+    const unsigned char default_value,
+    const std::uint32_t y_begin,
+    const std::uint32_t y_end) {
+  const std::size_t merged_width = column * src_width;
+  for (std::uint32_t y = y_begin; y < y_end; ++y) {
+    const auto r = y / src_height;
+    const auto src_y = y % src_height;
+    auto dst = merged + y * merged_width;
+    for (std::size_t c = 0; c < column; ++c) {
+      const auto i = r * column + c;
+      if (i < number_of_srcs) {
+        std::copy_n(srcs[i] + src_y * src_width, src_width, dst);
+      } else {
+        std::fill_n(dst, src_width, default_value);
+      }
+      dst += src_width;
+    }
+  }
+}
+
+void copy_yuv_plane_to_grid(unsigned char* merged,
+                            const std::size_t column,
+                            const unsigned char* src,
+                            const std::size_t index,
+                            const std::uint32_t src_width,
+                            const std::uint32_t src_height) {
+  const std::size_t merged_width = column * src_width;
+  const std::size_t row_size = merged_width * src_height;
+  const auto c = index % column;
+  const auto r = index / column;
+  for (std::uint32_t y = 0; y < src_height; ++y) {
+    std::copy_n(src + y * src_width, src_width,
+                merged + r * row_size + c * src_width + y * merged_width);
+  }
+}
+
+unsigned char* get_yuv_plane_grid_cell(unsigned char* merged,
+                                       const std::size_t column,
+                                       const std::size_t index,
+                                       const std::uint32_t src_width,
+                                       const std::uint32_t src_height) {
+  const std::size_t merged_width = column * src_width;
+  return merged + (index / column) * merged_width * src_height +
+         (index % column) * src_width;
+}
+
+void fill_yuv_plane_outside_grid(unsigned char* merged,
+                                 const std::size_t merged_size,
+                                 const std::size_t column,
+                                 const std::size_t number_of_srcs,
+                                 const std::uint32_t src_width,
+                                 const std::uint32_t src_height,
+                                 const unsigned char default_value) {
+  const std::size_t merged_width = column * src_width;
+  const std::size_t row_size = merged_width * src_height;
+  const auto filled_columns = number_of_srcs % column;
+  const auto filled_rows = number_of_srcs / column;
+  std::size_t filled_size = filled_rows * row_size;
+  if (filled_columns != 0) {
+    const auto base = merged + filled_size + filled_columns * src_width;
+    const auto width = (column - filled_columns) * src_width;
     for (std::uint32_t y = 0; y < src_height; ++y) {
-      std::copy_n(srcs[i] + y * src_width, src_width,
-                  merged + r * src_width * src_height * column + c * src_width +
-                      y * column * src_width);
+      std::fill_n(base + y * merged_width, width, default_value);
     }
+    filled_size += row_size;
+  }
+  if (filled_size < merged_size) {
+    std::fill_n(merged + filled_size, merged_size - filled_size,
+                default_value);
   }
 }
 
+void fill_yuv_plane_outside_rectangles(
+    unsigned char* plane,
+    const std::uint32_t stride,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles,
+    const unsigned char value) {
+  for_each_gap_outside_rectangles(
+      width, height, rectangles,
+      [plane, stride, value](const std::uint32_t y_begin,
+                             const std::uint32_t y_end,
+                             const std::uint32_t x_begin,
+                             const std::uint32_t x_end) {
+        for (std::uint32_t y = y_begin; y < y_end; ++y) {
+          std::fill_n(plane + static_cast<std::size_t>(y) * stride + x_begin,
+                      x_end - x_begin, value);
+        }
+      });
+}
+
+bool is_covered_by_rectangles(const std::uint32_t width,
+                              const std::uint32_t height,
+                              const std::vector<PlaneRectangle>& rectangles) {
+  bool is_covered = true;
+  for_each_gap_outside_rectangles(
+      width, height, rectangles,
+      [&is_covered](const std::uint32_t, const std::uint32_t,
+                    const std::uint32_t, const std::uint32_t) {
+        is_covered = false;
+      });
+  return is_covered;
+}
+
+std::vector<PlaneRectangle> get_rectangles_outside(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles) {
+  std::vector<PlaneRectangle> outside;
+  for_each_gap_outside_rectangles(
+      width, height, rectangles,
+      [&outside](const std::uint32_t y_begin, const std::uint32_t y_end,
+                 const std::uint32_t x_begin, const std::uint32_t x_end) {
+        outside.push_back({.x = x_begin,
+                           .y = y_begin,
+                           .width = x_end - x_begin,
+                           .height = y_end - y_begin});
+      });
+  return outside;
+}
+
+std::vector<PlaneRectangle> clip_rectangles(
+    const std::vector<PlaneRectangle>& rectangles,
+    const PlaneRectangle& area) {
+  std::vector<PlaneRectangle> clipped;
+  for (const auto& r : rectangles) {
+    const auto x_begin = std::max(r.x, area.x);
+    const auto y_begin = std::max(r.y, area.y);
+    const auto x_end = std::min(r.x + r.width, area.x + area.width);
+    const auto y_end = std::min(r.y + r.height, area.y + area.height);
+    if (x_begin < x_end && y_begin < y_end) {
+      clipped.push_back({.x = x_begin - area.x,
+                         .y = y_begin - area.y,
+                         .width = x_end - x_begin,
+                         .height = y_end - y_begin});
+    }
+  }
+  return clipped;
+}
+
+void fill_yuv_planes_outside_rectangles(
+    const std::array<unsigned char*, 3>& planes,
+    const std::array<std::size_t, 3>& plane_sizes,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles,
+    const std::array<unsigned char, 3>& values) {
+  std::vector<PlaneRectangle> chroma_rectangles;
+  chroma_rectangles.reserve(std::size(rectangles));
+  for (const auto& r : rectangles) {
+    chroma_rectangles.push_back(I420Plane<1>::floor(r));
+  }
+
+  for_each_i420_plane([&](const auto plane) {
+    using Plane = decltype(plane);
+    const auto p = Plane::index;
+    const auto plane_width = Plane::floor(width);
+    const auto plane_height = Plane::floor(height);
+    fill_yuv_plane_outside_rectangles(
+        planes[p], plane_width, plane_width, plane_height,
+        p == 0 ? rectangles : chroma_rectangles, values[p]);
+    // 幅や高さが奇数の場合に残る末尾
+    const auto filled = static_cast<std::size_t>(plane_width) * plane_height;
+    if (filled < plane_sizes[p]) {
+      std::fill_n(planes[p] + filled, plane_sizes[p] - filled, values[p]);
+    }
+  });
+}
+
+void overlay_yuv_plane_outside_rectangles(
+    unsigned char* overlayed,
+    const unsigned char* src,
+    const std::uint32_t base_width,
+    const std::uint32_t src_x,
+    const std::uint32_t src_y,
+    const std::uint32_t src_width,
+    const std::uint32_t src_height,
+    const std::vector<PlaneRectangle>& rectangles) {
+  for_each_gap_outside_rectangles(
+      src_width, src_height, rectangles,
+      [=](const std::uint32_t y_begin, const std::uint32_t y_end,
+          const std::uint32_t x_begin, const std::uint32_t x_end) {
+        for (std::uint32_t y = y_begin; y < y_end; ++y) {
+          std::copy_n(src + y * src_width + x_begin, x_end - x_begin,
+                      overlayed + (src_y + y) * base_width + src_x + x_begin);
+        }
+      });
+}
+
 void overlay_yuv_planes(unsigned char* overlayed,
                         const unsigned char* src,
                         const std::uint32_t base_width,
@@ -108,4 +480,71 @@ void overlay_yuv_planes(unsigned char* overlayed,
   }
 }
 
+void fill_nv12_planes_outside_rectangles(
+    unsigned char* y_plane,
+    unsigned char* uv_plane,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles) {
+  // 色差は U と V を 1 組として, バイト単位の座標で塗る
+  std::vector<PlaneRectangle> uv_rectangles;
+  uv_rectangles.reserve(std::size(rectangles));
+  for (const auto& r : rectangles) {
+    const auto c = I420Plane<1>::floor(r);
+    uv_rectangles.push_back(
+        {.x = c.x * 2, .y = c.y, .width = c.width * 2, .height = c.height});
+  }
+  const auto uv_width = I420Plane<1>::floor(width) * 2;
+  const auto uv_height = I420Plane<1>::floor(height);
+
+  fill_yuv_plane_outside_rectangles(y_plane, width, width, height, rectangles,
+                                    I420Plane<0>::default_value);
+  fill_yuv_plane_outside_rectangles(uv_plane, width, uv_width, uv_height,
+                                    uv_rectangles,
+                                    I420Plane<1>::default_value);
+  // 高さが奇数の場合に残る末尾
+  const auto uv_size = static_cast<std::size_t>(width) *
+                       I420Plane<1>::ceil(height);
+  const auto filled = static_cast<std::size_t>(width) * uv_height;
+  std::fill_n(uv_plane + filled, uv_size - filled,
+              I420Plane<1>::default_value);
+}
+
+void overlay_uv_planes(unsigned char* uv_plane,
+                       const unsigned char* src_u,
+                       const unsigned char* src_v,
+                       const std::uint32_t base_width,
+                       const std::uint32_t src_x,
+                       const std::uint32_t src_y,
+                       const std::uint32_t src_width,
+                       const std::uint32_t src_height) {
+  for (std::uint32_t y = 0; y < src_height; ++y) {
+    interleave_uv(uv_plane + (src_y + y) * base_width + src_x * 2,
+                  src_u + y * src_width, src_v + y * src_width, src_width);
+  }
+}
+
+void overlay_uv_plane_outside_rectangles(
+    unsigned char* uv_plane,
+    const unsigned char* src_u,
+    const unsigned char* src_v,
+    const std::uint32_t base_width,
+    const std::uint32_t src_x,
+    const std::uint32_t src_y,
+    const std::uint32_t src_width,
+    const std::uint32_t src_height,
+    const std::vector<PlaneRectangle>& rectangles) {
+  for_each_gap_outside_rectangles(
+      src_width, src_height, rectangles,
+      [=](const std::uint32_t y_begin, const std::uint32_t y_end,
+          const std::uint32_t x_begin, const std::uint32_t x_end) {
+        for (std::uint32_t y = y_begin; y < y_end; ++y) {
+          interleave_uv(
+              uv_plane + (src_y + y) * base_width + (src_x + x_begin) * 2,
+              src_u + y * src_width + x_begin, src_v + y * src_width + x_begin,
+              x_end - x_begin);
+        }
+      });
+}
+
 }  // namespace hisui::video
@@ -6,31 +6,89 @@
 #include <memory>
 #include <vector>
 
+#include "util/memory.hpp"
+
 namespace hisui::video {
 
+// 各 plane の先頭アドレスはこの値に揃える
+inline constexpr std::size_t YUV_IMAGE_ALIGNMENT = 64;
+
+// 所有権を持たない I420 の画像の参照. 参照先の YUVImage が次に更新されるまで有効.
+// 合成のたびに shared_ptr を複製しないよう, 描画の経路ではこれを渡す
+struct YUVImageView {
+  std::array<const std::uint8_t*, 3> planes;
+  std::array<std::uint32_t, 3> strides;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint64_t generation;
+};
+
+// 3 つの plane は 1 つのメモリブロックに確保する.
+// stride_alignment が 1 ならば stride は plane の幅と等しい
 class YUVImage {
  public:
   std::array<std::uint8_t*, 3> yuv;
 
-  YUVImage(const std::uint32_t, const std::uint32_t);
+  YUVImage(const std::uint32_t,
+           const std::uint32_t,
+           const std::uint32_t stride_alignment = 1);
   ~YUVImage();
 
+  YUVImage(const YUVImage&) = delete;
+  YUVImage& operator=(const YUVImage&) = delete;
+
   bool checkWidthAndHeight(const std::uint32_t, const std::uint32_t) const;
+  // 確保済みの領域に収まる場合は再確保しない. wrap() 中ならば自前の領域に戻る
   void setWidthAndHeight(const std::uint32_t, const std::uint32_t);
 
+  // コピーせずに外部の plane を参照する. 参照先の寿命は呼び出し側で保証する
+  void wrap(const std::array<std::uint8_t*, 3>& planes,
+            const std::array<std::uint32_t, 3>& strides,
+            const std::uint32_t width,
+            const std::uint32_t height);
+  bool isWrapped() const;
+  // すべての plane で stride が幅と等しい
+  bool isPacked() const;
+
+  // デコーダーが内容を更新した時のフレームのタイムスタンプ. 世代も更新する
+  void setTimestamp(const std::uint64_t);
+  std::uint64_t getTimestamp() const;
+
+  // 内容が変わるたびに更新する, プロセス内で一意な値.
+  // 合成側はこの値が変わらなければ内容も変わっていないとみなして処理を省く
+  std::uint64_t getGeneration() const;
+  // yuv を直接書き換えた場合に呼ぶ
+  void updateGeneration();
+
   std::uint32_t getWidth(const int) const;
   std::uint32_t getHeight(const int) const;
+  std::uint32_t getStride(const int) const;
+  std::size_t getCapacity() const;
+  YUVImageView getView() const;
 
   void setBlack();
 
  private:
+  void layoutPlanes();
+
   std::uint32_t m_width;
   std::uint32_t m_height;
+  const std::uint32_t m_stride_alignment;
+  std::array<std::uint32_t, 3> m_strides;
+  hisui::util::ImageBuffer m_buffer;
+  bool m_is_wrapped = false;
+  std::uint64_t m_timestamp = 0;
+  std::uint64_t m_generation;
 };
 
 std::shared_ptr<YUVImage> create_black_yuv_image(const std::uint32_t,
                                                  const std::uint32_t);
 
+// 解像度ごとに 1 つの黒い画像をプロセス内で共有する.
+// 返した画像は複数のスレッドから参照されるので, 内容やタイムスタンプを変更しないこと
+std::shared_ptr<YUVImage> get_shared_black_yuv_image(const std::uint32_t,
+                                                     const std::uint32_t);
+
 void merge_yuv_planes_from_top_left(unsigned char*,
                                     const std::size_t,
                                     const std::size_t,
@@ -40,6 +98,120 @@ void merge_yuv_planes_from_top_left(unsigned char*,
                                     const std::uint32_t,
                                     const unsigned char);
 
+// merge_yuv_planes_from_top_left() の結果のうち [y_begin, y_end) 行のみを書き込む
+void merge_yuv_plane_rows_from_top_left(
+    unsigned char*,
+    const std::size_t,
+    const std::vector<const unsigned char*>&,
+    const std::size_t,
+    const std::uint32_t,
+    const std::uint32_t,
+    const unsigned char,
+    const std::uint32_t y_begin,
+    const std::uint32_t y_end);
+
+// merge_yuv_planes_from_top_left() で index 番目の src を書き込む部分だけを書き込む.
+// index ごとに書き込む範囲は重ならない
+void copy_yuv_plane_to_grid(unsigned char*,
+                            const std::size_t,
+                            const unsigned char*,
+                            const std::size_t index,
+                            const std::uint32_t,
+                            const std::uint32_t);
+
+// copy_yuv_plane_to_grid() で index 番目の src を書き込む矩形の左上.
+// 矩形の stride は column * src_width
+unsigned char* get_yuv_plane_grid_cell(unsigned char*,
+                                       const std::size_t,
+                                       const std::size_t index,
+                                       const std::uint32_t,
+                                       const std::uint32_t);
+
+// merge_yuv_planes_from_top_left() で srcs が埋めない部分だけを塗る
+void fill_yuv_plane_outside_grid(unsigned char*,
+                                 const std::size_t,
+                                 const std::size_t,
+                                 const std::size_t,
+                                 const std::uint32_t,
+                                 const std::uint32_t,
+                                 const unsigned char);
+
+struct PlaneRectangle {
+  const std::uint32_t x;
+  const std::uint32_t y;
+  const std::uint32_t width;
+  const std::uint32_t height;
+};
+
+// I420 の plane ごとの定数. 色差の plane は縦横とも輝度の 1/2 に間引かれる.
+// for_each_i420_plane() と組み合わせ, plane ごとの分岐をコンパイル時に解決する
+template <std::size_t P>
+struct I420Plane {
+  static_assert(P < 3);
+  static constexpr std::size_t index = P;
+  static constexpr std::uint32_t shift = P == 0 ? 0 : 1;
+  static constexpr unsigned char default_value = P == 0 ? 0 : 128;
+
+  // 輝度の座標や長さを, この plane のものに切り捨てて変換する
+  static constexpr std::uint32_t floor(const std::uint32_t v) {
+    return v >> shift;
+  }
+  // 輝度の長さを, 端の画素も含むようにこの plane のものに変換する
+  static constexpr std::uint32_t ceil(const std::uint32_t v) {
+    return (v + (1u << shift) - 1) >> shift;
+  }
+  static constexpr PlaneRectangle floor(const PlaneRectangle& r) {
+    return {.x = floor(r.x),
+            .y = floor(r.y),
+            .width = floor(r.width),
+            .height = floor(r.height)};
+  }
+};
+
+// Y, U, V の順に f(I420Plane<P>{}) を呼ぶ
+template <class F>
+constexpr void for_each_i420_plane(F&& f) {
+  f(I420Plane<0>{});
+  f(I420Plane<1>{});
+  f(I420Plane<2>{});
+}
+
+// rectangles のいずれにも覆われていない部分だけを value で塗る.
+// 後から rectangles に描画する場合に, 同じ領域へ 2 度書き込むのを避けるために使う
+void fill_yuv_plane_outside_rectangles(
+    unsigned char* plane,
+    const std::uint32_t stride,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles,
+    const unsigned char value);
+
+// 幅 width, 高さ height の範囲が rectangles で覆われているか
+bool is_covered_by_rectangles(const std::uint32_t width,
+                              const std::uint32_t height,
+                              const std::vector<PlaneRectangle>& rectangles);
+
+// rectangles のいずれにも覆われていない部分を, 重ならない矩形に分けて返す
+std::vector<PlaneRectangle> get_rectangles_outside(
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles);
+
+// rectangles のうち area に重なる部分を, area の左上を原点とする座標で返す
+std::vector<PlaneRectangle> clip_rectangles(
+    const std::vector<PlaneRectangle>& rectangles,
+    const PlaneRectangle& area);
+
+// stride == 幅の I420 の 3 plane について fill_yuv_plane_outside_rectangles() を行う.
+// rectangles は輝度の座標で, 色差は overlay_yuv_planes() と同じく半分にして扱う
+void fill_yuv_planes_outside_rectangles(
+    const std::array<unsigned char*, 3>& planes,
+    const std::array<std::size_t, 3>& plane_sizes,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles,
+    const std::array<unsigned char, 3>& values);
+
 void overlay_yuv_planes(unsigned char* overlayed,
                         const unsigned char* src,
                         const std::uint32_t base_width,
@@ -48,4 +220,51 @@ void overlay_yuv_planes(unsigned char* overlayed,
                         const std::uint32_t src_width,
                         const std::uint32_t src_height);
 
+// overlay_yuv_planes() と同じだが, src の座標で表した rectangles
+// に覆われる部分は書き込まない
+void overlay_yuv_plane_outside_rectangles(
+    unsigned char* overlayed,
+    const unsigned char* src,
+    const std::uint32_t base_width,
+    const std::uint32_t src_x,
+    const std::uint32_t src_y,
+    const std::uint32_t src_width,
+    const std::uint32_t src_height,
+    const std::vector<PlaneRectangle>& rectangles);
+
+// 以下は NV12 の画像に書き込む. 色差は U と V を交互に並べた 1 つの plane で,
+// 輝度の幅を base_width とすると stride は base_width とする.
+// 座標や大きさは I420 の色差 plane のもので表す
+
+// fill_yuv_planes_outside_rectangles() の NV12 版. 各 plane を黒く塗る
+void fill_nv12_planes_outside_rectangles(
+    unsigned char* y_plane,
+    unsigned char* uv_plane,
+    const std::uint32_t width,
+    const std::uint32_t height,
+    const std::vector<PlaneRectangle>& rectangles);
+
+// I420 の色差の src_u, src_v を並べて uv_plane に重ねる
+void overlay_uv_planes(unsigned char* uv_plane,
+                       const unsigned char* src_u,
+                       const unsigned char* src_v,
+                       const std::uint32_t base_width,
+                       const std::uint32_t src_x,
+                       const std::uint32_t src_y,
+                       const std::uint32_t src_width,
+                       const std::uint32_t src_height);
+
+// overlay_uv_planes() と同じだが, src の座標で表した rectangles
+// に覆われる部分は書き込まない
+void overlay_uv_plane_outside_rectangles(
+    unsigned char* uv_plane,
+    const unsigned char* src_u,
+    const unsigned char* src_v,
+    const std::uint32_t base_width,
+    const std::uint32_t src_x,
+    const std::uint32_t src_y,
+    const std::uint32_t src_width,
+    const std::uint32_t src_height,
+    const std::vector<PlaneRectangle>& rectangles);
+
 }  // namespace hisui::video
@@ -0,0 +1,72 @@
+#include "video/yuv_image_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+#include "video/yuv.hpp"
+
+namespace hisui::video {
+
+YUVImagePool::YUVImagePool(const std::size_t t_max_free_images)
+    : m_storage(std::make_shared<Storage>()) {
+  m_storage->max_free_images = t_max_free_images;
+}
+
+std::shared_ptr<YUVImage> YUVImagePool::acquire(const std::uint32_t width,
+                                                const std::uint32_t height) {
+  std::unique_ptr<YUVImage> image;
+  {
+    std::lock_guard<std::mutex> lock(m_storage->mutex);
+    auto& free_images = m_storage->free_images;
+    if (!std::empty(free_images)) {
+      // 最も大きな領域を持つものを選び, 再確保をなるべく避ける
+      auto it = std::max_element(
+          std::begin(free_images), std::end(free_images),
+          [](const auto& a, const auto& b) {
+            return a->getCapacity() < b->getCapacity();
+          });
+      image = std::move(*it);
+      free_images.erase(it);
+    }
+  }
+
+  if (image) {
+    image->setWidthAndHeight(width, height);
+    image->setTimestamp(0);
+  } else {
+    image = std::make_unique<YUVImage>(width, height);
+  }
+
+  std::weak_ptr<Storage> storage = m_storage;
+  return std::shared_ptr<YUVImage>(
+      image.release(), [storage](YUVImage* p) { release(storage, p); });
+}
+
+std::size_t YUVImagePool::getNumberOfFreeImages() const {
+  std::lock_guard<std::mutex> lock(m_storage->mutex);
+  return std::size(m_storage->free_images);
+}
+
+YUVImagePool& YUVImagePool::getInstance() {
+  static YUVImagePool pool;
+  return pool;
+}
+
+void YUVImagePool::release(const std::weak_ptr<Storage>& weak_storage,
+                           YUVImage* image) {
+  std::unique_ptr<YUVImage> owned(image);
+  // プールが先に破棄されていればそのまま解放する
+  auto storage = weak_storage.lock();
+  if (!storage) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(storage->mutex);
+  if (std::size(storage->free_images) < storage->max_free_images) {
+    storage->free_images.push_back(std::move(owned));
+  }
+}
+
+}  // namespace hisui::video
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hisui::video {
+
+class YUVImage;
+
+// 使い終わった YUVImage を回収して再利用する.
+// acquire() で得た YUVImage は参照がなくなるとプールに戻る
+class YUVImagePool {
+ public:
+  explicit YUVImagePool(const std::size_t t_max_free_images = 16);
+
+  YUVImagePool(const YUVImagePool&) = delete;
+  YUVImagePool& operator=(const YUVImagePool&) = delete;
+
+  std::shared_ptr<YUVImage> acquire(const std::uint32_t,
+                                    const std::uint32_t);
+  std::size_t getNumberOfFreeImages() const;
+
+  // デコーダー間で共有するプール
+  static YUVImagePool& getInstance();
+
+ private:
+  struct Storage {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<YUVImage>> free_images;
+    std::size_t max_free_images;
+  };
+
+  static void release(const std::weak_ptr<Storage>&, YUVImage*);
+
+  std::shared_ptr<Storage> m_storage;
+};
+
+}  // namespace hisui::video
@@ -0,0 +1,144 @@
+#include "webm/concat.hpp"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "webm/input/audio_context.hpp"
+#include "webm/input/video_context.hpp"
+#include "webm/output/context.hpp"
+
+namespace hisui::webm {
+
+namespace {
+
+// 入力ごとの映像を順に読む. 次の part に移る際に pts が戻っていないかを確かめる
+class VideoReader {
+ public:
+  explicit VideoReader(
+      std::vector<std::unique_ptr<hisui::webm::input::VideoContext>>* t_parts)
+      : m_parts(t_parts) {}
+
+  bool readFrame() {
+    while (m_index < std::size(*m_parts)) {
+      auto& part = (*m_parts)[m_index];
+      if (part->readFrame()) {
+        if (m_is_first_frame && !part->isKeyFrame()) {
+          throw std::runtime_error(fmt::format(
+              "part does not start with a key frame: {}", part->getFilePath()));
+        }
+        if (m_last_timestamp.has_value() &&
+            part->getTimestamp() < m_last_timestamp.value()) {
+          throw std::runtime_error(
+              fmt::format("parts overlap or are out of order: {}",
+                          part->getFilePath()));
+        }
+        m_is_first_frame = false;
+        m_last_timestamp = part->getTimestamp();
+        return true;
+      }
+      ++m_index;
+      m_is_first_frame = true;
+    }
+    return false;
+  }
+
+  const hisui::webm::input::VideoContext& current() const {
+    return *(*m_parts)[m_index];
+  }
+
+ private:
+  std::vector<std::unique_ptr<hisui::webm::input::VideoContext>>* m_parts;
+  std::size_t m_index = 0;
+  bool m_is_first_frame = true;
+  std::optional<std::int64_t> m_last_timestamp;
+};
+
+}  // namespace
+
+void concat(const std::vector<std::string>& input_filenames,
+            const std::string& out_filename,
+            const std::vector<std::string>& hashes) {
+  std::vector<std::unique_ptr<hisui::webm::input::VideoContext>> parts;
+  std::unique_ptr<hisui::webm::input::AudioContext> audio;
+  for (const auto& filename : input_filenames) {
+    auto video = std::make_unique<hisui::webm::input::VideoContext>(filename);
+    if (video->init()) {
+      if (!std::empty(parts) &&
+          (video->getFourcc() != parts[0]->getFourcc() ||
+           video->getWidth() != parts[0]->getWidth() ||
+           video->getHeight() != parts[0]->getHeight())) {
+        throw std::runtime_error(fmt::format(
+            "video codec or resolution differs from the first part: {}",
+            filename));
+      }
+      parts.push_back(std::move(video));
+      continue;
+    }
+    auto audio_context =
+        std::make_unique<hisui::webm::input::AudioContext>(filename);
+    if (!audio_context->init() ||
+        audio_context->getCodec() != hisui::webm::input::AudioCodec::Opus) {
+      throw std::runtime_error(
+          fmt::format("neither video nor Opus audio is found: {}", filename));
+    }
+    if (audio) {
+      throw std::runtime_error("--concat accepts only one audio-only file");
+    }
+    audio = std::move(audio_context);
+  }
+  if (std::empty(parts)) {
+    throw std::runtime_error("--concat requires at least one video part");
+  }
+  spdlog::debug("concat: parts={} audio={}", std::size(parts),
+                audio ? audio->getFilePath() : "none");
+
+  hisui::webm::output::Context context(out_filename, {.hashes = hashes});
+  context.init();
+
+  const auto fourcc = parts[0]->getFourcc();
+  if (fourcc == hisui::Constants::AV1_FOURCC) {
+    const std::array<std::uint8_t, 4> private_data{0x81, 0x00, 0x06, 0x00};
+    context.setVideoTrack(parts[0]->getWidth(), parts[0]->getHeight(), fourcc,
+                          private_data.data(), std::size(private_data));
+  } else {
+    context.setVideoTrack(parts[0]->getWidth(), parts[0]->getHeight(), fourcc,
+                          nullptr, 0);
+  }
+  // 音声は 1 回で合成したものなので, pre-skip は先頭の 1 回分だけでよい
+  if (audio) {
+    const auto& private_data = audio->getCodecPrivate();
+    context.setAudioTrack(audio->getCodecDelay(), private_data.data(),
+                          std::size(private_data));
+  }
+
+  VideoReader video(&parts);
+  bool has_video = video.readFrame();
+  bool has_audio = audio && audio->readFrame();
+  while (has_video || has_audio) {
+    if (has_video && (!has_audio || video.current().getTimestamp() <=
+                                        audio->getTimestamp())) {
+      const auto& part = video.current();
+      context.addVideoFrame(part.getBuffer(), part.getBufferSize(),
+                            static_cast<std::uint64_t>(part.getTimestamp()),
+                            part.isKeyFrame());
+      has_video = video.readFrame();
+    } else {
+      context.addAudioFrame(audio->getBuffer(), audio->getBufferSize(),
+                            static_cast<std::uint64_t>(audio->getTimestamp()));
+      has_audio = audio->readFrame();
+    }
+  }
+}
+
+}  // namespace hisui::webm
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace hisui::webm {
+
+// --video-part-count で書き出した映像のみの part と --audio-only で書き出した音声を,
+// 再エンコードせずに 1 つの WebM に結合する.
+// part の pts はタイムライン全体の先頭を 0 としているので, そのまま並べればよい.
+// hashes は出力のハッシュ値のアルゴリズム
+void concat(const std::vector<std::string>&,
+            const std::string&,
+            const std::vector<std::string>& hashes = {});
+
+}  // namespace hisui::webm
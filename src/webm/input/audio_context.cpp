@@ -1,16 +1,16 @@
 #include "webm/input/audio_context.hpp"
 
 #include <bits/exception.h>
-#include <mkvparser/mkvparser.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
 #include <cstddef>
-#include <cstdio>
 #include <cstring>
 #include <stdexcept>
+#include <vector>
 
 #include "webm/input/context.hpp"
+#include "webm/input/index.hpp"
 
 namespace hisui::webm::input {
 
@@ -27,55 +27,43 @@ void AudioContext::reset() {
   m_bit_depth = 0;
   m_sampling_rate = 0.0;
   m_codec = AudioCodec::None;
+  m_codec_delay = 0;
+  m_codec_private.clear();
 }
 
 bool AudioContext::init() {
-  m_file = std::fopen(m_file_path.c_str(), "rb");
-  if (m_file == nullptr) {
-    throw std::runtime_error("Unable to open: " + m_file_path);
-  }
-
-  initReaderAndSegment(m_file);
-
-  const mkvparser::Tracks* const tracks = m_segment->GetTracks();
-  const mkvparser::AudioTrack* audio_track = nullptr;
-  for (std::uint64_t i = 0, m = tracks->GetTracksCount(); i < m; ++i) {
-    const mkvparser::Track* const track = tracks->GetTrackByIndex(i);
-    if (track != nullptr && track->GetType() == mkvparser::Track::kAudio) {
-      audio_track = static_cast<const mkvparser::AudioTrack*>(track);
-      m_track_index = static_cast<int>(track->GetNumber());
-      break;
-    }
-  }
+  initDemuxer();
 
-  if (audio_track == nullptr || audio_track->GetCodecId() == nullptr) {
+  const auto audio_track = selectTrack(TrackType::Audio);
+  if (!audio_track || std::empty(audio_track->codec_id)) {
     spdlog::info("audio track not found");
     return false;
   }
 
-  if (!std::strncmp(audio_track->GetCodecId(), "A_OPUS", 6)) {
+  const auto& codec_private = audio_track->codec_private;
+  if (!std::strncmp(audio_track->codec_id.c_str(), "A_OPUS", 6)) {
     m_codec = AudioCodec::Opus;
     // WebM 側に Channels が入っていない場合があるので, Opus のヘッダーから
     // Channels を取得する
-    std::size_t private_size;
-    const unsigned char* const private_data =
-        audio_track->GetCodecPrivate(private_size);
-    if (private_size >= 10 &&
-        !std::strncmp(reinterpret_cast<const char*>(private_data), "OpusHead",
-                      8)) {
-      m_channels = private_data[9];
+    if (std::size(codec_private) >= 10 &&
+        !std::strncmp(reinterpret_cast<const char*>(std::data(codec_private)),
+                      "OpusHead", 8)) {
+      m_channels = codec_private[9];
     } else {
-      m_channels = static_cast<int>(audio_track->GetChannels());
+      m_channels = static_cast<int>(audio_track->channels);
     }
   } else {
-    spdlog::info("unsuppoted codec: codec_id={}", audio_track->GetCodecId());
+    spdlog::info("unsuppoted codec: codec_id={}", audio_track->codec_id);
     return false;
   }
 
-  m_bit_depth = static_cast<std::uint64_t>(audio_track->GetBitDepth());
-  m_sampling_rate = audio_track->GetSamplingRate();
+  m_codec_private = codec_private;
+  m_codec_delay = audio_track->codec_delay;
 
-  m_cluster = m_segment->GetFirst();
+  m_bit_depth = audio_track->bit_depth;
+  m_sampling_rate = audio_track->sampling_rate;
+
+  rewind();
 
   return true;
 }
@@ -96,4 +84,12 @@ AudioCodec AudioContext::getCodec() const {
   return m_codec;
 }
 
+std::uint64_t AudioContext::getCodecDelay() const {
+  return m_codec_delay;
+}
+
+const std::vector<std::uint8_t>& AudioContext::getCodecPrivate() const {
+  return m_codec_private;
+}
+
 }  // namespace hisui::webm::input
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "webm/input/context.hpp"
 
@@ -23,12 +24,16 @@ class AudioContext : public Context {
   std::uint64_t getBitDepth() const;
   double getSamplingRate() const;
   AudioCodec getCodec() const;
+  std::uint64_t getCodecDelay() const;
+  const std::vector<std::uint8_t>& getCodecPrivate() const;
 
  private:
   int m_channels = 0;
   std::uint64_t m_bit_depth = 0;
   double m_sampling_rate = 0.0;
   AudioCodec m_codec = AudioCodec::None;
+  std::uint64_t m_codec_delay = 0;
+  std::vector<std::uint8_t> m_codec_private;
 };
 
 }  // namespace hisui::webm::input
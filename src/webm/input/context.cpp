@@ -1,121 +1,44 @@
 #include "webm/input/context.hpp"
 
 #include <fmt/core.h>
-#include <mkvparser/mkvparser.h>
-#include <mkvparser/mkvreader.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 
+#include "webm/input/demuxer.hpp"
+#include "webm/input/index.hpp"
+
 namespace hisui::webm::input {
 
 void Context::reset() {
-  if (m_reader != nullptr) {
-    delete m_reader;
-  }
-  if (m_segment != nullptr) {
-    delete m_segment;
-  }
-  if (m_buffer != nullptr) {
-    delete[] m_buffer;
-  }
-  m_reader = nullptr;
-  m_segment = nullptr;
+  m_demuxer = nullptr;
   m_buffer = nullptr;
   m_buffer_size = 0;
-  m_cluster = nullptr;
-  m_block_entry = nullptr;
-  m_block = nullptr;
-  m_block_frame_index = 0;
+  m_frame_index = 0;
   m_reached_eos = false;
   m_timestamp_ns = 0;
-  m_track_index = 0;
+  m_track_number = 0;
   m_is_key_frame = false;
-  if (m_file) {
-    std::fclose(m_file);
-    m_file = nullptr;
-  }
 }
 
-void Context::initReaderAndSegment(std::FILE* file) {
-  m_reader = new mkvparser::MkvReader(file);
+void Context::initDemuxer() {
+  m_demuxer = Demuxer::open(m_file_path);
   m_reached_eos = false;
-
-  mkvparser::EBMLHeader header;
-  long long pos = 0; /* NOLINT */
-  const auto parse_ret = header.Parse(m_reader, pos);
-  if (parse_ret < 0) {
-    reset();
-    throw std::runtime_error(
-        fmt::format("WebM header.Parse() failed: error_code={}", parse_ret));
-  }
-
-  const auto create_instance_ret =
-      mkvparser::Segment::CreateInstance(m_reader, pos, m_segment);
-  if (create_instance_ret != 0) {
-    reset();
-    throw std::runtime_error(fmt::format(
-        "WebM mkvparser::Segment::CreateInstance() failed: error_code={}",
-        create_instance_ret));
-  }
-  const auto segument_load_ret = m_segment->Load();
-  if (segument_load_ret < 0) {
-    reset();
-    throw std::runtime_error(fmt::format(
-        "WebM m_segment->Load() failed: error_code={}", segument_load_ret));
-  }
 }
 
-bool Context::moveNextBlock() {
-  if (m_cluster == nullptr) {
-    throw std::runtime_error("m_cluster is null. should be initialized");
+std::optional<TrackInfo> Context::selectTrack(const TrackType type) {
+  auto track = m_demuxer->findTrack(type);
+  if (track) {
+    m_track_number = track->number;
   }
-
-  bool block_entry_eos = false;
-  do {
-    std::int64_t status = 0;
-    bool get_new_block = false;
-    if (m_block_entry == nullptr && !block_entry_eos) {
-      status = m_cluster->GetFirst(m_block_entry);
-      get_new_block = true;
-    } else if (block_entry_eos || m_block_entry->EOS()) {
-      m_cluster = m_segment->GetNext(m_cluster);
-      if (m_cluster == nullptr || m_cluster->EOS()) {
-        m_buffer_size = 0;
-        m_reached_eos = true;
-        return false;
-      }
-      status = m_cluster->GetFirst(m_block_entry);
-      block_entry_eos = false;
-      get_new_block = true;
-    } else if (m_block == nullptr ||
-               m_block_frame_index == m_block->GetFrameCount() ||
-               m_block->GetTrackNumber() != m_track_index) {
-      status = m_cluster->GetNext(m_block_entry, m_block_entry);
-      if (m_block_entry == nullptr || m_block_entry->EOS()) {
-        block_entry_eos = true;
-        continue;
-      }
-      get_new_block = true;
-    }
-    if (status || m_block_entry == nullptr) {
-      throw std::runtime_error("cannot get BlockEntry");
-    }
-    if (get_new_block) {
-      m_block = m_block_entry->GetBlock();
-      if (m_block == nullptr) {
-        throw std::runtime_error("cannot get Block");
-      }
-      m_block_frame_index = 0;
-    }
-  } while (block_entry_eos || m_block->GetTrackNumber() != m_track_index);
-  return true;
+  return track;
 }
 
-void Context::rewindCluster() {
-  m_cluster = m_segment->GetFirst();
-  m_block = nullptr;
-  m_block_entry = nullptr;
-  m_block_frame_index = 0;
+void Context::rewind() {
+  m_frame_index = 0;
   m_reached_eos = false;
 }
 
@@ -132,36 +55,86 @@ bool Context::readFrame() {
     return false;
   }
 
-  if (!moveNextBlock()) {
+  std::lock_guard<std::mutex> lock(m_demuxer->getMutex());
+  auto frame = m_demuxer->getFrame(m_track_number, m_frame_index);
+  // 読み飛ばすフレームは位置だけを辿る
+  if (m_is_key_frames_only || m_is_waiting_key_frame) {
+    while (frame && !(frame->is_key && frame->is_first_in_block)) {
+      ++m_frame_index;
+      frame = m_demuxer->getFrame(m_track_number, m_frame_index);
+    }
+  }
+  if (!frame) {
+    m_buffer_size = 0;
+    m_reached_eos = true;
+    return false;
+  }
+  ++m_frame_index;
+  // フレームはコピーせず mapping を直接参照する
+  m_buffer = m_demuxer->getData(frame->pos, frame->size);
+  if (m_buffer == nullptr) {
+    throw std::runtime_error(fmt::format(
+        "frame is out of file: pos={} len={}", frame->pos, frame->size));
+  }
+  m_buffer_size = frame->size;
+  // デコード中にディスクを待たないよう, この先のフレームを読み込ませておく
+  m_demuxer->prefetch(frame->pos);
+  m_timestamp_ns = frame->timestamp_ns;
+  m_is_key_frame = frame->is_key;
+  if (m_is_key_frame) {
+    m_is_waiting_key_frame = false;
+  }
+  return true;
+}
+
+void Context::setKeyFramesOnly(const bool key_frames_only) {
+  if (m_is_key_frames_only && !key_frames_only) {
+    m_is_waiting_key_frame = true;
+  }
+  m_is_key_frames_only = key_frames_only;
+}
+
+bool Context::seekToKeyFrame(const std::int64_t timestamp_ns) {
+  if (m_reached_eos || m_demuxer == nullptr) {
     return false;
   }
 
-  const mkvparser::Block::Frame& frame = m_block->GetFrame(m_block_frame_index);
-  ++m_block_frame_index;
-  std::size_t frame_len = static_cast<std::size_t>(frame.len);
-  if (frame_len > m_buffer_size) {
-    if (m_buffer != nullptr) {
-      delete[] m_buffer;
+  std::optional<std::size_t> key_frame;
+  std::lock_guard<std::mutex> lock(m_demuxer->getMutex());
+  // フレームの位置だけを辿り, フレームは読まない
+  for (auto i = m_frame_index;; ++i) {
+    const auto frame = m_demuxer->getFrame(m_track_number, i);
+    if (!frame || frame->timestamp_ns > timestamp_ns) {
+      break;
+    }
+    if (frame->is_key && frame->is_first_in_block) {
+      key_frame = i;
     }
-    m_buffer = new unsigned char[frame_len];
   }
-  m_buffer_size = frame_len;
-  m_timestamp_ns = m_block->GetTime(m_cluster);
-  m_is_key_frame = m_block->IsKey();
-
-  const auto status = frame.Read(m_reader, m_buffer);
-  if (status != 0) {
-    throw std::runtime_error(
-        fmt::format("Frame::Read() failed: status={}", status));
+
+  if (key_frame) {
+    m_frame_index = *key_frame;
   }
-  return true;
+  return key_frame.has_value();
+}
+
+std::optional<std::int64_t> Context::peekNextTimestamp() {
+  if (m_reached_eos || m_demuxer == nullptr) {
+    return {};
+  }
+
+  std::lock_guard<std::mutex> lock(m_demuxer->getMutex());
+  if (const auto frame = m_demuxer->getFrame(m_track_number, m_frame_index)) {
+    return frame->timestamp_ns;
+  }
+  return {};
 }
 
 std::size_t Context::getBufferSize() const {
   return m_buffer_size;
 }
 
-unsigned char* Context::getBuffer() {
+const unsigned char* Context::getBuffer() const {
   return m_buffer;
 }
 
@@ -170,7 +143,11 @@ std::int64_t Context::getTimestamp() const {
 }
 
 std::int64_t Context::getDuration() const {
-  return m_segment->GetDuration();
+  return m_demuxer->getDuration();
+}
+
+bool Context::isKeyFrame() const {
+  return m_is_key_frame;
 }
 
 std::string Context::getFilePath() const {
@@ -2,21 +2,16 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <cstdio>
+#include <memory>
+#include <optional>
 #include <string>
 
-namespace mkvparser {
-
-class Block;
-class BlockEntry;
-class Cluster;
-class MkvReader;
-class Segment;
-
-}  // namespace mkvparser
+#include "webm/input/index.hpp"
 
 namespace hisui::webm::input {
 
+class Demuxer;
+
 class Context {
  public:
   explicit Context(const std::string&);
@@ -24,34 +19,44 @@ class Context {
 
   virtual bool init() = 0;
   std::size_t getBufferSize() const;
-  unsigned char* getBuffer();
+  const unsigned char* getBuffer() const;
   std::string getFilePath() const;
   std::int64_t getTimestamp() const;
   std::int64_t getDuration() const;
+  bool isKeyFrame() const;
   bool readFrame();
+  // 次に読むフレームから timestamp までの間にキーフレームがあれば,
+  // 最後のキーフレームの直前まで読み飛ばして true を返す.
+  // デコーダーはそのキーフレームから復号すればよく, 途中のフレームを復号しなくて済む
+  bool seekToKeyFrame(const std::int64_t);
+  // 次に readFrame() で読むフレームの timestamp を返す. 読み終えていれば空
+  std::optional<std::int64_t> peekNextTimestamp();
+  // true ならば readFrame() でキーフレームのみを読み, 他は読み飛ばす.
+  // false に戻しても, 読み飛ばしたフレームを参照するフレームを復号しないよう次のキーフレームまでは読み飛ばす
+  void setKeyFramesOnly(const bool);
 
  protected:
-  mkvparser::Segment* m_segment = nullptr;
-  const mkvparser::Cluster* m_cluster = nullptr;
-  int m_track_index = 0;
+  std::uint64_t m_track_number = 0;
   std::string m_file_path;
-  std::FILE* m_file = nullptr;
 
   void reset();
-  void initReaderAndSegment(std::FILE*);
-  bool moveNextBlock();
-  void rewindCluster();
+  void initDemuxer();
+  // type の最初のトラックを読むトラックにする. 無ければ空
+  std::optional<TrackInfo> selectTrack(const TrackType);
+  void rewind();
 
  private:
-  mkvparser::MkvReader* m_reader = nullptr;
-  unsigned char* m_buffer = nullptr;
-  const mkvparser::BlockEntry* m_block_entry = nullptr;
-  const mkvparser::Block* m_block = nullptr;
-  int m_block_frame_index = 0;
+  std::shared_ptr<Demuxer> m_demuxer;
+  // Demuxer の Index の, 次に読むフレームの番号
+  std::size_t m_frame_index = 0;
+  // m_demuxer の mapping 内のフレームを指す
+  const unsigned char* m_buffer = nullptr;
   bool m_reached_eos = false;
   std::size_t m_buffer_size = 0;
   std::int64_t m_timestamp_ns = 0;
   bool m_is_key_frame = false;
+  bool m_is_key_frames_only = false;
+  bool m_is_waiting_key_frame = false;
 };
 
 }  // namespace hisui::webm::input
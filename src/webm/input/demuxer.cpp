@@ -0,0 +1,330 @@
+#include "webm/input/demuxer.hpp"
+
+#include <fmt/core.h>
+#include <mkvparser/mkvparser.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/file.hpp"
+#include "webm/input/index.hpp"
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+// 全ての Demuxer で先読みする量の合計の目安
+constexpr std::size_t PREFETCH_BUDGET = 64 * 1024 * 1024;
+constexpr std::size_t MIN_PREFETCH_SIZE = 1024 * 1024;
+
+std::atomic<std::size_t> number_of_demuxers = 0;
+
+std::string index_cache_directory;
+
+std::chrono::milliseconds live_idle_timeout{0};
+// 書き込み中のファイルの大きさを調べる間隔
+constexpr std::chrono::milliseconds LIVE_POLL_INTERVAL{100};
+
+}  // namespace
+
+Demuxer::Demuxer(const std::string& t_file_path)
+    : m_file_path(t_file_path),
+      m_is_following((live_idle_timeout.count() > 0 &&
+                      !hisui::util::is_url(t_file_path)) ||
+                     Reader::isStream(t_file_path)),
+      m_reader(Reader::open(m_file_path, m_is_following)) {
+  if (m_is_following) {
+    // ファイルが変わり続けるので Index のキャッシュは使わない
+    parseSegment();
+    m_index = std::make_unique<Index>(m_segment.get());
+    ++number_of_demuxers;
+    return;
+  }
+  std::optional<Index> index;
+  if (!std::empty(index_cache_directory) &&
+      !std::empty(m_reader->getVersion())) {
+    index = Index::load(index_cache_directory, m_file_path,
+                        m_reader->getSize(), m_reader->getVersion());
+  }
+  if (index) {
+    m_index = std::make_unique<Index>(std::move(*index));
+  } else {
+    parseSegment();
+    m_index = std::make_unique<Index>(m_segment.get());
+    // Cluster は Index が Segment の先頭から辿って読むので, トラックの情報を読んだら要らない
+    m_next_cluster_pos = m_segment->m_start;
+    const auto size = static_cast<std::int64_t>(m_reader->getSize());
+    m_segment_end =
+        m_segment->m_size >= 0
+            ? std::min<std::int64_t>(m_segment->m_start + m_segment->m_size,
+                                     size)
+            : size;
+    m_segment = nullptr;
+    if (!std::empty(index_cache_directory)) {
+      // 保存するために全ての Block を辿る. 次からはこの解析を省ける
+      while (m_next_cluster_pos) {
+        indexNextCluster();
+      }
+    }
+  }
+  ++number_of_demuxers;
+}
+
+void Demuxer::parseSegment() {
+  while (true) {
+    try {
+      loadSegment();
+      return;
+    } catch (const std::runtime_error&) {
+      // 書き込み中のファイルは, ヘッダーが書かれるまで待って読み直す
+      if (!m_is_following || !waitForData()) {
+        throw;
+      }
+    }
+  }
+}
+
+void Demuxer::loadSegment() {
+  mkvparser::EBMLHeader header;
+  long long pos = 0; /* NOLINT */
+  const auto parse_ret = header.Parse(m_reader.get(), pos);
+  // 正の値はデータが足りないことを表す
+  if (parse_ret < 0 || (m_is_following && parse_ret > 0)) {
+    throw std::runtime_error(
+        fmt::format("WebM header.Parse() failed: error_code={}", parse_ret));
+  }
+
+  mkvparser::Segment* segment = nullptr;
+  const auto create_instance_ret =
+      mkvparser::Segment::CreateInstance(m_reader.get(), pos, segment);
+  m_segment.reset(segment);
+  if (create_instance_ret != 0) {
+    throw std::runtime_error(fmt::format(
+        "WebM mkvparser::Segment::CreateInstance() failed: error_code={}",
+        create_instance_ret));
+  }
+  // mkvparser にはヘッダーだけを読ませる. Cluster は Index::addClusterFrames() で読み,
+  // 書き込み中の場合は書かれるごとに followNextCluster() で読む
+  if (const auto ret = m_segment->ParseHeaders(); ret != 0) {
+    throw std::runtime_error(fmt::format(
+        "WebM m_segment->ParseHeaders() failed: error_code={}", ret));
+  }
+}
+
+Demuxer::~Demuxer() {
+  --number_of_demuxers;
+}
+
+std::shared_ptr<Demuxer> Demuxer::open(const std::string& file_path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<Demuxer>> demuxers;
+  // 開いている途中のファイル. 同じファイルを開く他のスレッドはこれを待つ
+  static std::map<std::string, std::shared_future<std::shared_ptr<Demuxer>>>
+      opening_demuxers;
+  // パイプは開き直せないので, 一度開いたら終了するまで残す
+  static std::vector<std::shared_ptr<Demuxer>> stream_demuxers;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for (auto it = std::begin(demuxers); it != std::end(demuxers);) {
+    if (it->second.expired()) {
+      it = demuxers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (auto it = demuxers.find(file_path); it != std::end(demuxers)) {
+    if (auto demuxer = it->second.lock()) {
+      return demuxer;
+    }
+  }
+  if (auto it = opening_demuxers.find(file_path);
+      it != std::end(opening_demuxers)) {
+    const auto future = it->second;
+    lock.unlock();
+    return future.get();
+  }
+  std::promise<std::shared_ptr<Demuxer>> promise;
+  opening_demuxers.emplace(file_path, promise.get_future().share());
+  // 解析に時間がかかるので, 他のファイルを開くのを妨げないよう lock の外で開く
+  lock.unlock();
+
+  std::shared_ptr<Demuxer> demuxer;
+  try {
+    demuxer = std::make_shared<Demuxer>(file_path);
+  } catch (...) {
+    lock.lock();
+    opening_demuxers.erase(file_path);
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  lock.lock();
+  demuxers[file_path] = demuxer;
+  opening_demuxers.erase(file_path);
+  if (Reader::isStream(file_path)) {
+    stream_demuxers.push_back(demuxer);
+  }
+  promise.set_value(demuxer);
+  return demuxer;
+}
+
+void Demuxer::setIndexCacheDirectory(const std::string& directory) {
+  index_cache_directory = directory;
+}
+
+void Demuxer::setLiveIdleTimeout(const std::chrono::milliseconds timeout) {
+  live_idle_timeout = timeout;
+}
+
+std::int64_t Demuxer::getDuration() const {
+  if (m_is_following) {
+    return std::numeric_limits<std::int64_t>::max();
+  }
+  return m_index->getDuration();
+}
+
+std::optional<TrackInfo> Demuxer::findTrack(const TrackType type) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (const auto track = m_index->findTrack(type)) {
+    return track->info;
+  }
+  return {};
+}
+
+std::optional<IndexedFrame> Demuxer::getFrame(const std::uint64_t track_number,
+                                              const std::size_t i) {
+  const auto frames = m_index->getFrames(track_number);
+  if (frames == nullptr) {
+    return {};
+  }
+  while (i >= std::size(*frames) && (m_is_following || m_next_cluster_pos)) {
+    if (m_is_following) {
+      followNextCluster();
+    } else {
+      indexNextCluster();
+    }
+  }
+  if (i >= std::size(*frames)) {
+    return {};
+  }
+  return (*frames)[i];
+}
+
+void Demuxer::indexNextCluster() {
+  m_next_cluster_pos = m_index->addClusterFrames(
+      [this](const std::int64_t pos, const std::size_t len) {
+        return m_reader->getData(pos, len);
+      },
+      *m_next_cluster_pos, m_segment_end);
+  if (m_next_cluster_pos) {
+    return;
+  }
+  if (!std::empty(index_cache_directory) &&
+      !std::empty(m_reader->getVersion())) {
+    m_index->save(index_cache_directory, m_file_path, m_reader->getSize(),
+                  m_reader->getVersion());
+  }
+}
+
+void Demuxer::followNextCluster() {
+  while (true) {
+    long long pos = 0;  // NOLINT
+    long len = 0;       // NOLINT
+    const auto count = m_segment->GetCount();
+    const auto ret = m_segment->LoadCluster(pos, len);
+    if (ret < 0 && ret != mkvparser::E_BUFFER_NOT_FULL) {
+      throw std::runtime_error(
+          fmt::format("WebM LoadCluster() failed: error_code={}", ret));
+    }
+    if (m_segment->GetCount() > count) {
+      // 次の Cluster が書かれ始めたので, その前の Cluster は書き終えている
+      const auto cluster = m_next_cluster;
+      m_next_cluster = m_segment->GetLast();
+      if (cluster != nullptr) {
+        m_index->addFrames(cluster);
+        return;
+      }
+      continue;
+    }
+    if (ret == 1 || !waitForData()) {
+      finishFollowing();
+      return;
+    }
+  }
+}
+
+void Demuxer::finishFollowing() {
+  spdlog::debug("finished following: {}", m_file_path);
+  m_reader->finish();
+  m_is_following = false;
+  // 全体の大きさが分かったので, 最後の Cluster も読み切れる
+  for (auto cluster = m_next_cluster; cluster != nullptr && !cluster->EOS();
+       cluster = m_segment->GetNext(cluster)) {
+    m_index->addFrames(cluster);
+  }
+  m_next_cluster = nullptr;
+  m_segment = nullptr;
+  m_index->updateDurationByFrames();
+}
+
+bool Demuxer::waitForData() {
+  const auto start = std::chrono::steady_clock::now();
+  while (!m_reader->refresh()) {
+    // パイプは書き手が閉じるまで待つ. --live の場合のみ live_idle_timeout で打ち切る
+    if (m_reader->isEnded() ||
+        (live_idle_timeout.count() > 0 &&
+         std::chrono::steady_clock::now() - start >= live_idle_timeout)) {
+      return false;
+    }
+    std::this_thread::sleep_for(LIVE_POLL_INTERVAL);
+  }
+  return true;
+}
+
+const unsigned char* Demuxer::getData(const std::int64_t pos,
+                                      const std::size_t len) const {
+  return m_reader->getData(pos, len);
+}
+
+void Demuxer::prefetch(const std::int64_t pos) {
+  if (pos < 0) {
+    return;
+  }
+  // 予算を開いている Demuxer で分け合う
+  const std::size_t n = std::max<std::size_t>(number_of_demuxers, 1);
+  const std::size_t size = std::max(MIN_PREFETCH_SIZE, PREFETCH_BUDGET / n);
+  const auto begin = static_cast<std::size_t>(pos);
+  // 先読み済みの範囲を半分読み進めるごとにまとめて先読みさせる
+  if (begin + size / 2 < m_prefetched_end ||
+      m_prefetched_end >= m_reader->getSize()) {
+    return;
+  }
+  const auto prefetch_begin = std::max(begin, m_prefetched_end);
+  m_prefetched_end = begin + size;
+  m_reader->prefetch(static_cast<std::int64_t>(prefetch_begin),
+                     m_prefetched_end - prefetch_begin);
+}
+
+std::mutex& Demuxer::getMutex() {
+  return m_mutex;
+}
+
+}  // namespace hisui::webm::input
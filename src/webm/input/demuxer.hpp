@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "webm/input/index.hpp"
+
+namespace mkvparser {
+
+class Cluster;
+class Segment;
+
+}  // namespace mkvparser
+
+namespace hisui::webm::input {
+
+class Reader;
+
+// WebM ファイルの mapping と, フレームの位置の Index を保持する.
+// 同じファイルの AudioContext と VideoContext で共有し, 解析を一度で済ませる.
+// Index は Cluster を読み進めるごとに作る. 解析した Block は残さないので,
+// ファイルが長くてもフレームの位置の一覧の分しかメモリを使わない.
+// 書き込み中のファイルは mkvparser の Segment で辿り, 書き終えたら破棄する
+class Demuxer {
+ public:
+  explicit Demuxer(const std::string&);
+  ~Demuxer();
+
+  Demuxer(const Demuxer&) = delete;
+  Demuxer& operator=(const Demuxer&) = delete;
+
+  // 同じファイルの Demuxer が使われていればそれを返す
+  static std::shared_ptr<Demuxer> open(const std::string&);
+  // 空でなければ, このディレクトリに Index を保存し次からはそれを読む.
+  // Demuxer を開く前に設定しておく
+  static void setIndexCacheDirectory(const std::string&);
+  // 0 より大きければ, 書き込み中のファイルとして開き, ファイルの末尾に達しても
+  // 追記を待って読み進める. この時間の間追記されなければ書き終えたとみなす.
+  // Demuxer を開く前に設定しておく
+  static void setLiveIdleTimeout(const std::chrono::milliseconds);
+
+  // 書き込み中は分からないので std::numeric_limits<std::int64_t>::max() を返す
+  std::int64_t getDuration() const;
+  // type の最初のトラックの情報. 無ければ空
+  std::optional<TrackInfo> findTrack(const TrackType);
+  // トラックの i 番目のフレーム. 無ければ空.
+  // 必要なら Index を作り進める. getMutex() のロックを取った状態で呼ぶ
+  std::optional<IndexedFrame> getFrame(const std::uint64_t, const std::size_t);
+  const unsigned char* getData(const std::int64_t, const std::size_t) const;
+  // pos から先を先読みさせる. getMutex() のロックを取った状態で呼ぶ
+  void prefetch(const std::int64_t);
+
+  // Index は Context がフレームを読み進める時に作るため, 共有する Context は
+  // フレームを辿る間このロックを取る
+  std::mutex& getMutex();
+
+ private:
+  std::string m_file_path;
+  // 書き込み中のファイルを読んでいる. 書き終えたとみなすと false になる
+  std::atomic<bool> m_is_following;
+  std::unique_ptr<Reader> m_reader;
+  // m_reader を参照するので m_reader より先に破棄されるよう後に宣言する
+  std::unique_ptr<mkvparser::Segment> m_segment;
+  // 書き込み中のファイルで, 読み込んだが書き終えたか分からない最後の Cluster
+  const mkvparser::Cluster* m_next_cluster = nullptr;
+  // 次に Index に加える Cluster を探す位置. Index を作り終えていれば空
+  std::optional<std::int64_t> m_next_cluster_pos;
+  std::int64_t m_segment_end = 0;
+  std::unique_ptr<Index> m_index;
+  std::mutex m_mutex;
+  std::size_t m_prefetched_end = 0;
+
+  void parseSegment();
+  void loadSegment();
+  void indexNextCluster();
+  // 書き込み中のファイルで, 次の Cluster が書かれ始めるまで待ち,
+  // 書き終えた Cluster を Index に加える
+  void followNextCluster();
+  void finishFollowing();
+  // 追記されるまで待つ. live_idle_timeout の間追記されなければ false を返す
+  bool waitForData();
+};
+
+}  // namespace hisui::webm::input
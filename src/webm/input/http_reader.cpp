@@ -0,0 +1,583 @@
+#include "webm/input/http_reader.hpp"
+
+#include <fmt/core.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/io_budget.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+constexpr std::size_t BLOCK_SIZE = 256 * 1024;
+// prefetch() で 1 回のリクエストにまとめるブロックの数
+constexpr std::size_t MAX_REQUEST_BLOCKS = 16;
+constexpr std::size_t NUMBER_OF_PREFETCH_THREADS = 2;
+constexpr std::size_t MAX_HEADER_SIZE = 64 * 1024;
+constexpr int MAX_ATTEMPTS = 3;
+constexpr int TIMEOUT_SECONDS = 30;
+
+std::string to_lower(std::string s) {
+  std::transform(std::begin(s), std::end(s), std::begin(s), [](const char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  return s;
+}
+
+std::string trim(const std::string& s) {
+  const auto begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+bool is_digits(const std::string& s) {
+  return !std::empty(s) && std::all_of(std::begin(s), std::end(s), [](char c) {
+           return std::isdigit(static_cast<unsigned char>(c)) != 0;
+         });
+}
+
+}  // namespace
+
+Url parse_url(const std::string& url) {
+  const std::string scheme = "http://";
+  if (url.starts_with("https://")) {
+    throw std::runtime_error(
+        fmt::format("https is not supported. use http endpoint: {}", url));
+  }
+  if (!url.starts_with(scheme)) {
+    throw std::runtime_error(fmt::format("invalid url: {}", url));
+  }
+
+  const auto rest = url.substr(std::size(scheme));
+  const auto authority_end = rest.find_first_of("/?#");
+  const auto authority = rest.substr(0, authority_end);
+  Url result{.host = "", .port = "80", .target = "/"};
+  if (authority_end != std::string::npos) {
+    result.target = rest.substr(authority_end, rest.find('#') - authority_end);
+    if (result.target.front() != '/') {
+      result.target = "/" + result.target;
+    }
+  }
+  if (authority.find('@') != std::string::npos) {
+    throw std::runtime_error(
+        fmt::format("user information in url is not supported: {}", url));
+  }
+
+  std::string port;
+  if (authority.starts_with("[")) {
+    const auto bracket = authority.find(']');
+    if (bracket == std::string::npos) {
+      throw std::runtime_error(fmt::format("invalid url: {}", url));
+    }
+    result.host = authority.substr(1, bracket - 1);
+    if (bracket + 1 < std::size(authority)) {
+      if (authority[bracket + 1] != ':') {
+        throw std::runtime_error(fmt::format("invalid url: {}", url));
+      }
+      port = authority.substr(bracket + 2);
+    }
+  } else {
+    const auto colon = authority.rfind(':');
+    result.host = authority.substr(0, colon);
+    if (colon != std::string::npos) {
+      port = authority.substr(colon + 1);
+    }
+  }
+  if (!std::empty(port)) {
+    result.port = port;
+  }
+  if (std::empty(result.host) || std::empty(result.port)) {
+    throw std::runtime_error(fmt::format("invalid url: {}", url));
+  }
+  return result;
+}
+
+std::string make_range_request(const Url& url,
+                               const std::uint64_t begin,
+                               const std::uint64_t end) {
+  const auto host = url.host.find(':') == std::string::npos
+                        ? url.host
+                        : fmt::format("[{}]", url.host);
+  return fmt::format(
+      "GET {} HTTP/1.1\r\nHost: {}{}\r\nRange: bytes={}-{}\r\n"
+      "User-Agent: hisui\r\n\r\n",
+      url.target, host, url.port == "80" ? "" : ":" + url.port, begin,
+      end - 1);
+}
+
+ContentRange parse_content_range(const std::string& value) {
+  const auto invalid = [&value]() {
+    return std::runtime_error(
+        fmt::format("unexpected Content-Range: {}", value));
+  };
+  const std::string unit = "bytes ";
+  const auto slash = value.find('/');
+  if (!value.starts_with(unit) || slash == std::string::npos) {
+    throw invalid();
+  }
+  const auto range = value.substr(std::size(unit), slash - std::size(unit));
+  const auto complete_length = value.substr(slash + 1);
+  if (!is_digits(complete_length)) {
+    throw invalid();
+  }
+  ContentRange result{.is_satisfied = range != "*",
+                      .first = 0,
+                      .last = 0,
+                      .complete_length = std::stoull(complete_length)};
+  if (!result.is_satisfied) {
+    return result;
+  }
+  const auto hyphen = range.find('-');
+  if (hyphen == std::string::npos || !is_digits(range.substr(0, hyphen)) ||
+      !is_digits(range.substr(hyphen + 1))) {
+    throw invalid();
+  }
+  result.first = std::stoull(range.substr(0, hyphen));
+  result.last = std::stoull(range.substr(hyphen + 1));
+  if (result.first > result.last || result.last >= result.complete_length) {
+    throw invalid();
+  }
+  return result;
+}
+
+RangeResponse parse_range_response(const std::string& header,
+                                   const std::uint64_t begin,
+                                   const std::uint64_t end) {
+  std::map<std::string, std::string> fields;
+  std::size_t line_begin = header.find("\r\n");
+  const auto status_line = header.substr(0, line_begin);
+  while (line_begin != std::string::npos) {
+    line_begin += 2;
+    const auto line_end = header.find("\r\n", line_begin);
+    const auto line = header.substr(line_begin, line_end - line_begin);
+    if (const auto colon = line.find(':'); colon != std::string::npos) {
+      fields[to_lower(line.substr(0, colon))] = trim(line.substr(colon + 1));
+    }
+    line_begin = line_end;
+  }
+
+  const auto status_begin = status_line.find(' ');
+  const auto status = status_begin == std::string::npos
+                          ? std::string()
+                          : status_line.substr(status_begin + 1, 3);
+  RangeResponse response{
+      .file_size = 0,
+      .version = fields.contains("etag") ? fields["etag"]
+                                         : fields["last-modified"],
+      .body_size = 0,
+      .is_connection_close = to_lower(fields["connection"]) == "close"};
+  if (status == "416" && fields.contains("content-range")) {
+    const auto content_range = parse_content_range(fields["content-range"]);
+    if (content_range.complete_length == 0) {
+      return response;
+    }
+  }
+  if (status == "200" && fields.contains("content-length") &&
+      fields["content-length"] == "0") {
+    return response;
+  }
+  if (status != "206") {
+    throw std::runtime_error(
+        fmt::format("unexpected HTTP response: {}", status_line));
+  }
+  if (fields.contains("transfer-encoding")) {
+    throw std::runtime_error("Transfer-Encoding is not supported");
+  }
+  const auto size = end - begin;
+  if (!fields.contains("content-length") ||
+      !is_digits(fields["content-length"]) ||
+      std::stoull(fields["content-length"]) != size) {
+    throw std::runtime_error(
+        fmt::format("unexpected Content-Length: expected={}", size));
+  }
+  const auto content_range = parse_content_range(fields["content-range"]);
+  if (!content_range.is_satisfied || content_range.first != begin ||
+      content_range.last != end - 1) {
+    throw std::runtime_error(fmt::format(
+        "unexpected Content-Range: {} expected={}-{}",
+        fields["content-range"], begin, end - 1));
+  }
+  response.file_size = content_range.complete_length;
+  response.body_size = size;
+  return response;
+}
+
+// keep-alive で Range リクエストを繰り返す HTTP/1.1 の接続
+class HttpConnection {
+ public:
+  explicit HttpConnection(const Url& t_url) : m_url(t_url) {}
+  ~HttpConnection() { close(); }
+
+  HttpConnection(const HttpConnection&) = delete;
+  HttpConnection& operator=(const HttpConnection&) = delete;
+
+  // [begin, end) を data に読む. 失敗したら接続し直して MAX_ATTEMPTS 回まで試す
+  RangeResponse getRange(const std::uint64_t begin,
+                         const std::uint64_t end,
+                         unsigned char* data) {
+    for (int attempt = 1;; ++attempt) {
+      try {
+        if (m_fd == -1) {
+          connect();
+        }
+        return request(begin, end, data);
+      } catch (const std::exception& e) {
+        close();
+        if (attempt == MAX_ATTEMPTS) {
+          throw;
+        }
+        spdlog::debug("HTTP request failed. retrying: host={} error={}",
+                      m_url.host, e.what());
+      }
+    }
+  }
+
+ private:
+  Url m_url;
+  int m_fd = -1;
+  // ヘッダーに続けて受け取った本文
+  std::string m_pending;
+
+  void connect() {
+    ::addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    ::addrinfo* addresses = nullptr;
+    if (const auto ret = ::getaddrinfo(m_url.host.c_str(), m_url.port.c_str(),
+                                       &hints, &addresses);
+        ret != 0) {
+      throw std::runtime_error(
+          fmt::format("getaddrinfo() failed: host={} error={}", m_url.host,
+                      ::gai_strerror(ret)));
+    }
+    int error = 0;
+    for (auto a = addresses; a != nullptr; a = a->ai_next) {
+      const int fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd == -1) {
+        error = errno;
+        continue;
+      }
+      if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+        m_fd = fd;
+        break;
+      }
+      error = errno;
+      ::close(fd);
+    }
+    ::freeaddrinfo(addresses);
+    if (m_fd == -1) {
+      throw std::runtime_error(fmt::format("connect() failed: host={} error={}",
+                                           m_url.host, std::strerror(error)));
+    }
+
+    const ::timeval timeout{.tv_sec = TIMEOUT_SECONDS, .tv_usec = 0};
+    ::setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    const int one = 1;
+    ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  void close() {
+    if (m_fd != -1) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+    m_pending.clear();
+  }
+
+  void send(const std::string& s) {
+    std::size_t sent = 0;
+    while (sent < std::size(s)) {
+      const auto ret =
+          ::send(m_fd, std::data(s) + sent, std::size(s) - sent, MSG_NOSIGNAL);
+      if (ret == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(
+            fmt::format("send() failed: error={}", std::strerror(errno)));
+      }
+      sent += static_cast<std::size_t>(ret);
+    }
+  }
+
+  std::size_t receive(char* buffer, const std::size_t size) {
+    for (;;) {
+      const auto ret = ::recv(m_fd, buffer, size, 0);
+      if (ret == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(
+            fmt::format("recv() failed: error={}", std::strerror(errno)));
+      }
+      if (ret == 0) {
+        throw std::runtime_error("connection is closed by peer");
+      }
+      return static_cast<std::size_t>(ret);
+    }
+  }
+
+  std::string readHeader() {
+    char buffer[16 * 1024];
+    for (;;) {
+      if (const auto end = m_pending.find("\r\n\r\n");
+          end != std::string::npos) {
+        auto header = m_pending.substr(0, end);
+        m_pending.erase(0, end + 4);
+        return header;
+      }
+      if (std::size(m_pending) > MAX_HEADER_SIZE) {
+        throw std::runtime_error("HTTP response header is too large");
+      }
+      m_pending.append(buffer, receive(buffer, sizeof(buffer)));
+    }
+  }
+
+  void readBody(unsigned char* data, const std::size_t size) {
+    const auto pending = std::min(size, std::size(m_pending));
+    std::memcpy(data, std::data(m_pending), pending);
+    m_pending.erase(0, pending);
+    for (std::size_t n = pending; n < size;) {
+      n += receive(reinterpret_cast<char*>(data + n), size - n);
+    }
+  }
+
+  RangeResponse request(const std::uint64_t begin,
+                        const std::uint64_t end,
+                        unsigned char* data) {
+    send(make_range_request(m_url, begin, end));
+    const auto response = parse_range_response(readHeader(), begin, end);
+    if (response.file_size == 0) {
+      // 応答の本文は読まずに接続を閉じる
+      close();
+      return response;
+    }
+    readBody(data, response.body_size);
+    if (response.is_connection_close) {
+      close();
+    }
+    return response;
+  }
+};
+
+HttpReader::HttpReader(const std::string& t_url)
+    : m_url(t_url),
+      m_parsed_url(parse_url(m_url)),
+      m_connection(std::make_unique<HttpConnection>(m_parsed_url)) {
+  // 大きさと版を得るため先頭の 1 バイトだけ取得する
+  unsigned char first_byte;
+  const auto response = m_connection->getRange(0, 1, &first_byte);
+  m_size = response.file_size;
+  m_version = response.version;
+  if (m_size == 0) {
+    throw std::runtime_error(
+        fmt::format("remote file is empty: url={}", m_url));
+  }
+
+  // 取得したブロックだけが実際にメモリを使う
+  void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(fmt::format("mmap() failed: url={} error={}",
+                                         m_url, std::strerror(errno)));
+  }
+  m_data = static_cast<unsigned char*>(data);
+  m_blocks.resize((m_size + BLOCK_SIZE - 1) / BLOCK_SIZE, BlockState::Missing);
+
+  for (std::size_t i = 0; i < NUMBER_OF_PREFETCH_THREADS; ++i) {
+    m_threads.emplace_back(&HttpReader::work, this);
+  }
+  spdlog::debug("HttpReader: url={} size={} version={}", m_url, m_size,
+                m_version);
+}
+
+HttpReader::~HttpReader() {
+  m_requests.close();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_size);
+  }
+}
+
+int HttpReader::Read(long long pos, long len, unsigned char* buf) {  // NOLINT
+  if (len < 0) {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  try {
+    const auto data = getData(pos, static_cast<std::size_t>(len));
+    if (data == nullptr) {
+      return -1;
+    }
+    std::memcpy(buf, data, static_cast<std::size_t>(len));
+  } catch (const std::exception& e) {
+    // mkvparser を例外が通らないようにする
+    spdlog::error("HttpReader::Read() failed: url={} error={}", m_url,
+                  e.what());
+    return -1;
+  }
+  return 0;
+}
+
+int HttpReader::Length(long long* total, long long* available) {  // NOLINT
+  if (total != nullptr) {
+    *total = static_cast<std::int64_t>(m_size);
+  }
+  if (available != nullptr) {
+    *available = static_cast<std::int64_t>(m_size);
+  }
+  return 0;
+}
+
+const unsigned char* HttpReader::getData(const std::int64_t pos,
+                                         const std::size_t len) const {
+  if (pos < 0 || static_cast<std::size_t>(pos) >= m_size ||
+      len > m_size - static_cast<std::size_t>(pos)) {
+    return nullptr;
+  }
+  if (len == 0) {
+    return m_data + pos;
+  }
+  const auto first = static_cast<std::size_t>(pos) / BLOCK_SIZE;
+  const auto last = (static_cast<std::size_t>(pos) + len - 1) / BLOCK_SIZE + 1;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    auto missing = first;
+    bool is_ready = true;
+    for (; missing < last && m_blocks[missing] != BlockState::Missing;
+         ++missing) {
+      is_ready = is_ready && m_blocks[missing] == BlockState::Ready;
+    }
+    if (missing == last) {
+      if (is_ready) {
+        return m_data + pos;
+      }
+      // prefetch() で取得中のブロックを待つ
+      m_cv.wait(lock);
+      continue;
+    }
+
+    BlockRange range{missing, missing};
+    while (range.second < last &&
+           m_blocks[range.second] == BlockState::Missing) {
+      m_blocks[range.second++] = BlockState::Fetching;
+    }
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      std::lock_guard<std::mutex> connection_lock(m_connection_mutex);
+      fetch(m_connection.get(), range);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    setBlockStates(range, error ? BlockState::Missing : BlockState::Ready);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void HttpReader::prefetch(const std::int64_t pos, const std::size_t len) const {
+  if (pos < 0 || static_cast<std::size_t>(pos) >= m_size || len == 0) {
+    return;
+  }
+  const auto first = static_cast<std::size_t>(pos) / BLOCK_SIZE;
+  const auto last = std::min(
+      std::size(m_blocks),
+      (static_cast<std::size_t>(pos) + len - 1) / BLOCK_SIZE + 1);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto i = first; i < last;) {
+    if (m_blocks[i] != BlockState::Missing) {
+      ++i;
+      continue;
+    }
+    BlockRange range{i, i};
+    while (range.second < last &&
+           m_blocks[range.second] == BlockState::Missing &&
+           range.second - range.first < MAX_REQUEST_BLOCKS) {
+      m_blocks[range.second++] = BlockState::Fetching;
+    }
+    m_requests.push(range);
+    i = range.second;
+  }
+}
+
+std::size_t HttpReader::getSize() const {
+  return m_size;
+}
+
+std::string HttpReader::getVersion() const {
+  return m_version;
+}
+
+void HttpReader::fetch(HttpConnection* connection,
+                       const BlockRange& range) const {
+  const auto begin = range.first * BLOCK_SIZE;
+  const auto end = std::min(range.second * BLOCK_SIZE, m_size);
+  hisui::util::ReadBandwidth::acquire(end - begin);
+  const auto response = connection->getRange(begin, end, m_data + begin);
+  // 別の版のデータが混ざらないようにする
+  if (response.version != m_version || response.file_size != m_size) {
+    throw std::runtime_error(
+        fmt::format("file is modified while reading: url={}", m_url));
+  }
+}
+
+void HttpReader::work() const {
+  HttpConnection connection(m_parsed_url);
+  while (auto range = m_requests.pop()) {
+    auto state = BlockState::Ready;
+    try {
+      fetch(&connection, *range);
+    } catch (const std::exception& e) {
+      // getData() で取得し直させる
+      spdlog::debug("prefetch failed: url={} error={}", m_url, e.what());
+      state = BlockState::Missing;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    setBlockStates(*range, state);
+  }
+}
+
+void HttpReader::setBlockStates(const BlockRange& range,
+                                const BlockState state) const {
+  for (auto i = range.first; i < range.second; ++i) {
+    m_blocks[i] = state;
+  }
+  m_cv.notify_all();
+}
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/blocking_queue.hpp"
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+class HttpConnection;
+
+struct Url {
+  std::string host;
+  std::string port;
+  // パスとクエリ
+  std::string target;
+};
+
+// http://host[:port]/path?query を分解する
+Url parse_url(const std::string&);
+
+// [begin, end) を要求する GET リクエスト
+std::string make_range_request(const Url&,
+                               const std::uint64_t begin,
+                               const std::uint64_t end);
+
+struct ContentRange {
+  // 416 の応答の "bytes */complete-length" の場合は false で, first と last は 0
+  bool is_satisfied;
+  std::uint64_t first;
+  // 範囲の最後のバイトの位置
+  std::uint64_t last;
+  std::uint64_t complete_length;
+};
+
+// Content-Range の値を解析する. complete-length が "*" の場合も std::runtime_error を投げる
+ContentRange parse_content_range(const std::string&);
+
+struct RangeResponse {
+  std::uint64_t file_size;
+  // ETag か Last-Modified
+  std::string version;
+  // ヘッダーに続く, 要求した範囲のデータの大きさ
+  std::uint64_t body_size;
+  bool is_connection_close;
+};
+
+// make_range_request() の応答のヘッダー (空行の前まで) を解析する.
+// 大きさが 0 のファイルは 416 (bytes */0) か, Range を無視した 200 (Content-Length: 0) で
+// 返るので, file_size を 0 とする. それ以外で要求した範囲が返らなければ std::runtime_error を投げる
+RangeResponse parse_range_response(const std::string& header,
+                                   const std::uint64_t begin,
+                                   const std::uint64_t end);
+
+// HTTP の Range リクエストで, オブジェクトストレージなどのファイルを読む.
+// 読んだブロックはファイルと同じ大きさの匿名 mapping に置いておき,
+// getData() で参照されるブロックか, prefetch() されたブロックだけを取得する.
+// TLS には対応しないので, https の場合は署名付き URL を http のエンドポイントで使うか,
+// プロキシを挟む
+class HttpReader : public Reader {
+ public:
+  explicit HttpReader(const std::string&);
+  ~HttpReader() override;
+
+  HttpReader(const HttpReader&) = delete;
+  HttpReader& operator=(const HttpReader&) = delete;
+
+  int Read(long long, long, unsigned char*) override;  // NOLINT
+  int Length(long long*, long long*) override;         // NOLINT
+
+  // 取得していないブロックはここで取得し, 終わるまで待つ
+  const unsigned char* getData(const std::int64_t,
+                               const std::size_t) const override;
+  // 取得していないブロックを別のスレッドで並列に取得させる
+  void prefetch(const std::int64_t, const std::size_t) const override;
+  std::size_t getSize() const override;
+  // ETag か Last-Modified
+  std::string getVersion() const override;
+
+ private:
+  enum struct BlockState : std::uint8_t {
+    Missing,
+    Fetching,
+    Ready,
+  };
+  // [first, last) のブロック
+  using BlockRange = std::pair<std::size_t, std::size_t>;
+
+  std::string m_url;
+  Url m_parsed_url;
+  std::size_t m_size = 0;
+  std::string m_version;
+  unsigned char* m_data = nullptr;
+
+  // 以下は取得したブロックのキャッシュなので const のメソッドからも更新する
+  mutable std::mutex m_mutex;
+  mutable std::condition_variable m_cv;
+  mutable std::vector<BlockState> m_blocks;
+  mutable std::mutex m_connection_mutex;
+  // getData() から取得する時に使う
+  mutable std::unique_ptr<HttpConnection> m_connection;
+  mutable hisui::util::BlockingQueue<BlockRange> m_requests;
+  std::vector<std::thread> m_threads;
+
+  void fetch(HttpConnection*, const BlockRange&) const;
+  void work() const;
+  // m_mutex のロックを取った状態で呼ぶ
+  void setBlockStates(const BlockRange&, const BlockState) const;
+};
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,610 @@
+#include "webm/input/index.hpp"
+
+#include <fmt/core.h>
+#include <mkvparser/mkvparser.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/file.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+constexpr char MAGIC[8] = {'H', 'I', 'S', 'U', 'I', 'I', 'D', 'X'};
+// 書式を変えたら上げる
+constexpr std::uint32_t VERSION = 2;
+// 壊れたファイルで巨大な領域を確保しないための上限
+constexpr std::uint64_t MAX_ELEMENTS = 1 << 28;
+
+// 別のディレクトリの同じ名前のファイルと衝突しないよう,
+// 絶対パスのハッシュを付ける. URL の場合は署名などが変わってもよいようクエリを除く
+std::filesystem::path get_cache_path(const std::string& cache_directory,
+                                     const std::string& file_path) {
+  const auto path =
+      hisui::util::is_url(file_path)
+          ? std::filesystem::path(hisui::util::remove_url_query(file_path))
+          : std::filesystem::absolute(file_path);
+  return std::filesystem::path(cache_directory) /
+         fmt::format("{}.{:016x}.index", path.filename().string(),
+                     std::hash<std::string>{}(path.string()));
+}
+
+// キャッシュは作ったマシンでしか読まないので, バイト順はそのままでよい
+template <typename T>
+void write_value(std::ostream& os, const T& value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_value(std::istream& is) {
+  T value{};
+  is.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+std::uint64_t read_size(std::istream& is) {
+  const auto size = read_value<std::uint64_t>(is);
+  if (size > MAX_ELEMENTS) {
+    is.setstate(std::ios::failbit);
+    return 0;
+  }
+  return size;
+}
+
+void write_bytes(std::ostream& os, const void* data, const std::size_t size) {
+  write_value<std::uint64_t>(os, size);
+  os.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+void write_string(std::ostream& os, const std::string& s) {
+  write_bytes(os, std::data(s), std::size(s));
+}
+
+std::string read_string(std::istream& is) {
+  std::string s(read_size(is), '\0');
+  is.read(std::data(s), static_cast<std::streamsize>(std::size(s)));
+  return s;
+}
+
+constexpr std::uint64_t CLUSTER_ID = 0x1F43B675;
+constexpr std::uint64_t TIMECODE_ID = 0xE7;
+constexpr std::uint64_t SIMPLE_BLOCK_ID = 0xA3;
+constexpr std::uint64_t BLOCK_GROUP_ID = 0xA0;
+constexpr std::uint64_t BLOCK_ID = 0xA1;
+constexpr std::uint64_t REFERENCE_BLOCK_ID = 0xFB;
+// Segment の直下の要素の ID は 4 バイトなので, 先頭のビットを残した値はこれ以上になる
+constexpr std::uint64_t MIN_LEVEL1_ID = 0x10000000;
+// ID (4 バイトまで) と大きさ (8 バイトまで)
+constexpr std::size_t MAX_ELEMENT_HEADER_SIZE = 12;
+
+// メモリ上の EBML を先頭から読む. 範囲を超える場合は std::runtime_error を投げる
+class EBMLCursor {
+ public:
+  EBMLCursor(const unsigned char* t_data, const std::size_t t_size)
+      : m_data(t_data), m_size(t_size) {}
+
+  bool isEnd() const { return m_offset >= m_size; }
+  std::size_t getOffset() const { return m_offset; }
+  std::size_t getRemaining() const { return m_size - m_offset; }
+  const unsigned char* getData() const { return m_data + m_offset; }
+
+  std::uint8_t readByte() {
+    check(1);
+    return m_data[m_offset++];
+  }
+
+  // 先頭のビットで長さを表す可変長整数. ID は keep_marker で長さを表すビットも残す.
+  // 値のビットが全て 1 の場合は is_unknown を true にする
+  std::uint64_t readVInt(const bool keep_marker = false,
+                         bool* is_unknown = nullptr,
+                         std::size_t* length = nullptr) {
+    const std::uint8_t first = readByte();
+    if (first == 0) {
+      throw std::runtime_error("invalid EBML variable size integer");
+    }
+    std::size_t n = 1;
+    while ((first & (0x80 >> (n - 1))) == 0) {
+      ++n;
+    }
+    const std::uint8_t mask = static_cast<std::uint8_t>(0xFF >> n);
+    std::uint64_t value = keep_marker ? first : (first & mask);
+    bool all_ones = (first & mask) == mask;
+    check(n - 1);
+    for (std::size_t i = 1; i < n; ++i) {
+      const auto b = m_data[m_offset++];
+      value = (value << 8) | b;
+      all_ones = all_ones && b == 0xFF;
+    }
+    if (is_unknown != nullptr) {
+      *is_unknown = all_ones;
+    }
+    if (length != nullptr) {
+      *length = n;
+    }
+    return value;
+  }
+
+  std::uint64_t readUInt(const std::size_t n) {
+    check(n);
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      value = (value << 8) | m_data[m_offset++];
+    }
+    return value;
+  }
+
+  // n バイトを読み飛ばし, その範囲を読む EBMLCursor を返す
+  EBMLCursor take(const std::uint64_t n) {
+    check(n);
+    EBMLCursor cursor(m_data + m_offset, static_cast<std::size_t>(n));
+    m_offset += static_cast<std::size_t>(n);
+    return cursor;
+  }
+
+ private:
+  const unsigned char* m_data;
+  std::size_t m_size;
+  std::size_t m_offset = 0;
+
+  void check(const std::uint64_t n) const {
+    if (n > m_size - m_offset) {
+      throw std::runtime_error("WebM element is truncated");
+    }
+  }
+};
+
+}  // namespace
+
+TrackInfo make_track_info(const mkvparser::Track& track) {
+  TrackInfo info{.number = static_cast<std::uint64_t>(track.GetNumber())};
+  if (track.GetCodecId() != nullptr) {
+    info.codec_id = track.GetCodecId();
+  }
+  if (track.GetCodecNameAsUTF8() != nullptr) {
+    info.codec_name = track.GetCodecNameAsUTF8();
+  }
+  std::size_t private_size = 0;
+  const unsigned char* const private_data =
+      track.GetCodecPrivate(private_size);
+  if (private_data != nullptr) {
+    info.codec_private.assign(private_data, private_data + private_size);
+  }
+  info.codec_delay = track.GetCodecDelay();
+
+  if (track.GetType() == mkvparser::Track::kVideo) {
+    const auto& video = static_cast<const mkvparser::VideoTrack&>(track);
+    info.type = TrackType::Video;
+    info.width = static_cast<std::uint64_t>(video.GetWidth());
+    info.height = static_cast<std::uint64_t>(video.GetHeight());
+  } else if (track.GetType() == mkvparser::Track::kAudio) {
+    const auto& audio = static_cast<const mkvparser::AudioTrack&>(track);
+    info.type = TrackType::Audio;
+    info.channels = static_cast<std::uint64_t>(audio.GetChannels());
+    info.bit_depth = static_cast<std::uint64_t>(audio.GetBitDepth());
+    info.sampling_rate = audio.GetSamplingRate();
+  }
+  return info;
+}
+
+Index::Index(const mkvparser::Segment* segment)
+    : m_duration(segment->GetDuration()),
+      m_timecode_scale(segment->GetInfo()->GetTimeCodeScale()) {
+  const mkvparser::Tracks* const tracks = segment->GetTracks();
+  for (std::uint64_t i = 0, m = tracks->GetTracksCount(); i < m; ++i) {
+    const mkvparser::Track* const track = tracks->GetTrackByIndex(i);
+    if (track != nullptr) {
+      m_tracks.push_back({.info = make_track_info(*track), .frames = {}});
+    }
+  }
+}
+
+Index::Index(const std::vector<TrackInfo>& tracks,
+             const std::int64_t duration,
+             const std::int64_t timecode_scale)
+    : m_duration(duration), m_timecode_scale(timecode_scale) {
+  for (const auto& info : tracks) {
+    m_tracks.push_back({.info = info, .frames = {}});
+  }
+}
+
+IndexedTrack* Index::findTrackByNumber(IndexedTrack* hint,
+                                       const std::uint64_t track_number) {
+  if (hint != nullptr && hint->info.number == track_number) {
+    return hint;
+  }
+  const auto it = std::find_if(
+      std::begin(m_tracks), std::end(m_tracks),
+      [&](const auto& t) { return t.info.number == track_number; });
+  return it == std::end(m_tracks) ? nullptr : &*it;
+}
+
+void Index::addFrames(const mkvparser::Cluster* cluster) {
+  const mkvparser::BlockEntry* block_entry = nullptr;
+  if (cluster->GetFirst(block_entry)) {
+    throw std::runtime_error("cannot get BlockEntry");
+  }
+  IndexedTrack* track = nullptr;
+  while (block_entry != nullptr && !block_entry->EOS()) {
+    const mkvparser::Block* const block = block_entry->GetBlock();
+    if (block == nullptr) {
+      throw std::runtime_error("cannot get Block");
+    }
+    track = findTrackByNumber(
+        track, static_cast<std::uint64_t>(block->GetTrackNumber()));
+    if (track != nullptr) {
+      const auto timestamp_ns = block->GetTime(cluster);
+      for (int i = 0; i < block->GetFrameCount(); ++i) {
+        const auto& frame = block->GetFrame(i);
+        track->frames.push_back({.pos = frame.pos,
+                                 .size = static_cast<std::uint32_t>(frame.len),
+                                 .timestamp_ns = timestamp_ns,
+                                 .is_key = block->IsKey(),
+                                 .is_first_in_block = i == 0});
+      }
+    }
+    if (cluster->GetNext(block_entry, block_entry)) {
+      throw std::runtime_error("cannot get BlockEntry");
+    }
+  }
+}
+
+std::optional<std::int64_t> Index::addClusterFrames(
+    const DataGetter& get_data,
+    std::int64_t pos,
+    const std::int64_t end) {
+  while (pos < end) {
+    const auto header_size = static_cast<std::size_t>(
+        std::min<std::int64_t>(MAX_ELEMENT_HEADER_SIZE, end - pos));
+    const auto header = get_data(pos, header_size);
+    if (header == nullptr) {
+      throw std::runtime_error(
+          fmt::format("WebM element is out of file: pos={}", pos));
+    }
+    EBMLCursor cursor(header, header_size);
+    const auto id = cursor.readVInt(true);
+    bool is_unknown_size = false;
+    const auto size = cursor.readVInt(false, &is_unknown_size);
+    const auto data_pos = pos + static_cast<std::int64_t>(cursor.getOffset());
+    if (id != CLUSTER_ID) {
+      // Cues などは使わないので読み飛ばす
+      if (is_unknown_size) {
+        throw std::runtime_error(
+            fmt::format("WebM element size is unknown: id={:x}", id));
+      }
+      pos = data_pos + static_cast<std::int64_t>(size);
+      continue;
+    }
+    // 途中で切れたファイルは, 残っている範囲だけを読む
+    const auto cluster_size =
+        is_unknown_size ? end - data_pos
+                        : std::min(static_cast<std::int64_t>(size),
+                                   end - data_pos);
+    if (cluster_size <= 0) {
+      return {};
+    }
+    const auto data =
+        get_data(data_pos, static_cast<std::size_t>(cluster_size));
+    if (data == nullptr) {
+      throw std::runtime_error(
+          fmt::format("WebM Cluster is out of file: pos={}", data_pos));
+    }
+    return data_pos +
+           static_cast<std::int64_t>(addClusterBlocks(
+               data, static_cast<std::size_t>(cluster_size), data_pos,
+               is_unknown_size));
+  }
+  return {};
+}
+
+std::size_t Index::addClusterBlocks(const unsigned char* data,
+                                    const std::size_t size,
+                                    const std::int64_t pos,
+                                    const bool is_unknown_size) {
+  EBMLCursor cursor(data, size);
+  std::int64_t timecode = 0;
+  IndexedTrack* track = nullptr;
+  while (!cursor.isEnd()) {
+    const auto offset = cursor.getOffset();
+    const auto id = cursor.readVInt(true);
+    if (is_unknown_size && id >= MIN_LEVEL1_ID) {
+      return offset;
+    }
+    const auto child_size = cursor.readVInt();
+    const auto child_pos = pos + static_cast<std::int64_t>(cursor.getOffset());
+    auto child = cursor.take(child_size);
+    switch (id) {
+      case TIMECODE_ID:
+        timecode = static_cast<std::int64_t>(
+            child.readUInt(child.getRemaining()));
+        break;
+      case SIMPLE_BLOCK_ID:
+        addBlockFrames(child.getData(), child.getRemaining(), child_pos,
+                       timecode, std::nullopt, &track);
+        break;
+      case BLOCK_GROUP_ID: {
+        // ReferenceBlock が無ければキーフレーム
+        std::optional<EBMLCursor> block;
+        std::int64_t block_pos = 0;
+        bool has_reference_block = false;
+        while (!child.isEnd()) {
+          const auto group_id = child.readVInt(true);
+          const auto group_size = child.readVInt();
+          const auto group_pos =
+              child_pos + static_cast<std::int64_t>(child.getOffset());
+          auto element = child.take(group_size);
+          if (group_id == BLOCK_ID) {
+            block = element;
+            block_pos = group_pos;
+          } else if (group_id == REFERENCE_BLOCK_ID) {
+            has_reference_block = true;
+          }
+        }
+        if (block) {
+          addBlockFrames(block->getData(), block->getRemaining(), block_pos,
+                         timecode, !has_reference_block, &track);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return cursor.getOffset();
+}
+
+void Index::addBlockFrames(const unsigned char* data,
+                           const std::size_t size,
+                           const std::int64_t pos,
+                           const std::int64_t cluster_timecode,
+                           const std::optional<bool>& is_key,
+                           IndexedTrack** track) {
+  EBMLCursor cursor(data, size);
+  const auto track_number = cursor.readVInt();
+  const auto relative_timecode =
+      static_cast<std::int16_t>(cursor.readUInt(2));
+  const auto flags = cursor.readByte();
+  *track = findTrackByNumber(*track, track_number);
+  if (*track == nullptr) {
+    return;
+  }
+  const auto timestamp_ns =
+      (cluster_timecode + relative_timecode) * m_timecode_scale;
+  const bool is_key_frame = is_key.value_or((flags & 0x80) != 0);
+  auto& frames = (*track)->frames;
+  const auto add_frame = [&](const std::size_t offset,
+                             const std::uint64_t frame_size,
+                             const bool is_first) {
+    frames.push_back({.pos = pos + static_cast<std::int64_t>(offset),
+                      .size = static_cast<std::uint32_t>(frame_size),
+                      .timestamp_ns = timestamp_ns,
+                      .is_key = is_key_frame,
+                      .is_first_in_block = is_first});
+  };
+
+  const auto lacing = (flags >> 1) & 3;
+  if (lacing == 0) {
+    add_frame(cursor.getOffset(), cursor.getRemaining(), true);
+    return;
+  }
+
+  // 最後のフレームの大きさは書かれていないので, 残りの大きさから求める
+  const std::size_t count = cursor.readByte() + 1U;
+  std::vector<std::uint64_t> sizes;
+  sizes.reserve(count);
+  if (lacing == 1) {
+    // Xiph: 255 が続く間は足し合わせる
+    for (std::size_t i = 0; i + 1 < count; ++i) {
+      std::uint64_t frame_size = 0;
+      std::uint8_t b = 0;
+      do {
+        b = cursor.readByte();
+        frame_size += b;
+      } while (b == 0xFF);
+      sizes.push_back(frame_size);
+    }
+  } else if (lacing == 3) {
+    // EBML: 2 番目からは前のフレームとの差を符号付きで書く
+    if (count > 1) {
+      sizes.push_back(cursor.readVInt());
+    }
+    for (std::size_t i = 1; i + 1 < count; ++i) {
+      std::size_t length = 0;
+      const auto raw = cursor.readVInt(false, nullptr, &length);
+      const auto bias = (std::int64_t{1} << (7 * length - 1)) - 1;
+      const auto frame_size = static_cast<std::int64_t>(sizes.back()) +
+                              static_cast<std::int64_t>(raw) - bias;
+      if (frame_size < 0) {
+        throw std::runtime_error("invalid EBML lacing");
+      }
+      sizes.push_back(static_cast<std::uint64_t>(frame_size));
+    }
+  } else {
+    // 固定長: 全て同じ大きさ
+    if (cursor.getRemaining() % count != 0) {
+      throw std::runtime_error("invalid fixed-size lacing");
+    }
+    sizes.assign(count - 1, cursor.getRemaining() / count);
+  }
+
+  std::uint64_t total = 0;
+  for (const auto frame_size : sizes) {
+    total += frame_size;
+  }
+  if (total > cursor.getRemaining()) {
+    throw std::runtime_error("WebM Block lacing is truncated");
+  }
+  sizes.push_back(cursor.getRemaining() - total);
+
+  std::size_t offset = cursor.getOffset();
+  for (std::size_t i = 0; i < std::size(sizes); ++i) {
+    add_frame(offset, sizes[i], i == 0);
+    offset += static_cast<std::size_t>(sizes[i]);
+  }
+}
+
+std::optional<Index> Index::load(const std::string& cache_directory,
+                                 const std::string& file_path,
+                                 const std::uint64_t file_size,
+                                 const std::string& file_version) {
+  const auto cache_path = get_cache_path(cache_directory, file_path);
+  std::ifstream is(cache_path, std::ios::binary);
+  if (!is) {
+    return {};
+  }
+
+  char magic[sizeof(MAGIC)];
+  is.read(magic, sizeof(magic));
+  if (!is || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      read_value<std::uint32_t>(is) != VERSION ||
+      read_value<std::uint64_t>(is) != file_size ||
+      read_string(is) != file_version) {
+    spdlog::debug("index cache is outdated: {}", cache_path.string());
+    return {};
+  }
+
+  Index index;
+  index.m_duration = read_value<std::int64_t>(is);
+  index.m_tracks.resize(read_size(is));
+  for (auto& track : index.m_tracks) {
+    auto& info = track.info;
+    info.number = read_value<std::uint64_t>(is);
+    info.type = read_value<TrackType>(is);
+    info.codec_id = read_string(is);
+    info.codec_name = read_string(is);
+    info.width = read_value<std::uint64_t>(is);
+    info.height = read_value<std::uint64_t>(is);
+    info.channels = read_value<std::uint64_t>(is);
+    info.bit_depth = read_value<std::uint64_t>(is);
+    info.sampling_rate = read_value<double>(is);
+    info.codec_delay = read_value<std::uint64_t>(is);
+    info.codec_private.resize(read_size(is));
+    is.read(reinterpret_cast<char*>(std::data(info.codec_private)),
+            static_cast<std::streamsize>(std::size(info.codec_private)));
+
+    track.frames.resize(read_size(is));
+    for (auto& frame : track.frames) {
+      frame.pos = read_value<std::int64_t>(is);
+      frame.size = read_value<std::uint32_t>(is);
+      frame.timestamp_ns = read_value<std::int64_t>(is);
+      const auto flags = read_value<std::uint8_t>(is);
+      frame.is_key = (flags & 1) != 0;
+      frame.is_first_in_block = (flags & 2) != 0;
+    }
+    if (!is) {
+      break;
+    }
+  }
+
+  if (!is) {
+    spdlog::warn("index cache is broken: {}", cache_path.string());
+    return {};
+  }
+  spdlog::debug("index cache loaded: {}", cache_path.string());
+  return index;
+}
+
+void Index::save(const std::string& cache_directory,
+                 const std::string& file_path,
+                 const std::uint64_t file_size,
+                 const std::string& file_version) const {
+  const auto cache_path = get_cache_path(cache_directory, file_path);
+  // 同時に合成している他のプロセスが書きかけのファイルを読まないよう,
+  // 別の名前で書いてから置き換える
+  auto tmp_path = cache_path;
+  tmp_path += fmt::format(".{}.tmp", ::getpid());
+  try {
+    std::filesystem::create_directories(cache_directory);
+    {
+      std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+      os.write(MAGIC, sizeof(MAGIC));
+      write_value(os, VERSION);
+      write_value(os, file_size);
+      write_string(os, file_version);
+      write_value(os, m_duration);
+      write_value<std::uint64_t>(os, std::size(m_tracks));
+      for (const auto& track : m_tracks) {
+        const auto& info = track.info;
+        write_value(os, info.number);
+        write_value(os, info.type);
+        write_string(os, info.codec_id);
+        write_string(os, info.codec_name);
+        write_value(os, info.width);
+        write_value(os, info.height);
+        write_value(os, info.channels);
+        write_value(os, info.bit_depth);
+        write_value(os, info.sampling_rate);
+        write_value(os, info.codec_delay);
+        write_bytes(os, std::data(info.codec_private),
+                    std::size(info.codec_private));
+
+        write_value<std::uint64_t>(os, std::size(track.frames));
+        for (const auto& frame : track.frames) {
+          write_value(os, frame.pos);
+          write_value(os, frame.size);
+          write_value(os, frame.timestamp_ns);
+          write_value(os, static_cast<std::uint8_t>(
+                              (frame.is_key ? 1 : 0) |
+                              (frame.is_first_in_block ? 2 : 0)));
+        }
+      }
+      os.close();
+      if (!os) {
+        throw std::runtime_error("write failed: " + tmp_path.string());
+      }
+    }
+    std::filesystem::rename(tmp_path, cache_path);
+    spdlog::debug("index cache saved: {}", cache_path.string());
+  } catch (const std::exception& e) {
+    spdlog::warn("saving index cache failed: {}", e.what());
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+  }
+}
+
+std::int64_t Index::getDuration() const {
+  return m_duration;
+}
+
+void Index::updateDurationByFrames() {
+  if (m_duration > 0) {
+    return;
+  }
+  for (const auto& track : m_tracks) {
+    if (!std::empty(track.frames)) {
+      m_duration = std::max(m_duration, track.frames.back().timestamp_ns);
+    }
+  }
+}
+
+const IndexedTrack* Index::findTrack(const TrackType type) const {
+  const auto it = std::find_if(
+      std::begin(m_tracks), std::end(m_tracks),
+      [type](const auto& track) { return track.info.type == type; });
+  return it == std::end(m_tracks) ? nullptr : &*it;
+}
+
+const std::vector<IndexedFrame>* Index::getFrames(
+    const std::uint64_t track_number) const {
+  const auto it = std::find_if(
+      std::begin(m_tracks), std::end(m_tracks),
+      [&](const auto& track) { return track.info.number == track_number; });
+  return it == std::end(m_tracks) ? nullptr : &it->frames;
+}
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mkvparser {
+
+class Cluster;
+class Segment;
+class Track;
+
+}  // namespace mkvparser
+
+namespace hisui::webm::input {
+
+enum struct TrackType {
+  Other,
+  Video,
+  Audio,
+};
+
+struct TrackInfo {
+  std::uint64_t number = 0;
+  TrackType type = TrackType::Other;
+  std::string codec_id = "";
+  std::string codec_name = "";
+  std::uint64_t width = 0;
+  std::uint64_t height = 0;
+  std::uint64_t channels = 0;
+  std::uint64_t bit_depth = 0;
+  double sampling_rate = 0.0;
+  std::uint64_t codec_delay = 0;
+  std::vector<std::uint8_t> codec_private = {};
+};
+
+TrackInfo make_track_info(const mkvparser::Track&);
+
+struct IndexedFrame {
+  std::int64_t pos;
+  std::uint32_t size;
+  std::int64_t timestamp_ns;
+  bool is_key;
+  // lacing された Block の途中のフレームからはデコードを始められない
+  bool is_first_in_block;
+};
+
+struct IndexedTrack {
+  TrackInfo info;
+  std::vector<IndexedFrame> frames;
+};
+
+// Reader::getData() と同じく pos から size バイトを返す. ファイルの外ならば nullptr
+using DataGetter =
+    std::function<const unsigned char*(const std::int64_t, const std::size_t)>;
+
+// WebM ファイルのトラックの情報と, トラックごとのフレームの位置の一覧.
+// ファイルに保存しておくことで, 次からは Segment を解析せずにフレームを読める
+class Index {
+ public:
+  // Segment のトラックの情報から作る. フレームは addFrames() で加える
+  explicit Index(const mkvparser::Segment*);
+  // トラックの情報と Segment の長さ (ns), Block の timecode の単位 (ns) から作る
+  Index(const std::vector<TrackInfo>&,
+        const std::int64_t duration,
+        const std::int64_t timecode_scale);
+
+  // Cluster の全ての Block のフレームを加える
+  void addFrames(const mkvparser::Cluster*);
+  // Segment の pos から end までの要素を辿り, 最初の Cluster の全ての Block のフレームを加える.
+  // mkvparser を通さずに解析して Block を残さないので, 長いファイルでもメモリは増えない.
+  // 次の要素の位置を返す. Cluster が無ければ空
+  std::optional<std::int64_t> addClusterFrames(const DataGetter&,
+                                               std::int64_t pos,
+                                               const std::int64_t end);
+
+  // cache_directory に保存された file_path の Index を読む.
+  // 無い場合や, 保存した時からファイルの大きさか版が変わっている場合は空
+  static std::optional<Index> load(const std::string& cache_directory,
+                                   const std::string& file_path,
+                                   const std::uint64_t file_size,
+                                   const std::string& file_version);
+  // 保存に失敗しても合成は続けられるので, 警告を出すだけにする
+  void save(const std::string& cache_directory,
+            const std::string& file_path,
+            const std::uint64_t file_size,
+            const std::string& file_version) const;
+
+  std::int64_t getDuration() const;
+  // Segment に長さが書かれていなければ, 最後のフレームの timestamp を長さにする.
+  // 書き込み中に開いたファイルは長さが書かれていない
+  void updateDurationByFrames();
+  // type の最初のトラックを返す. 無ければ nullptr
+  const IndexedTrack* findTrack(const TrackType) const;
+  // 番号が track_number のトラックのフレーム. 無ければ nullptr
+  const std::vector<IndexedFrame>* getFrames(const std::uint64_t) const;
+
+ private:
+  Index() = default;
+
+  std::int64_t m_duration = 0;
+  // Block の timecode の単位 (ns). 保存した Index では使わない
+  std::int64_t m_timecode_scale = 1000000;
+  std::vector<IndexedTrack> m_tracks;
+
+  // 番号が track_number のトラック. 同じトラックの Block が続くことが多いので, hint から調べる
+  IndexedTrack* findTrackByNumber(IndexedTrack* hint,
+                                  const std::uint64_t track_number);
+  // ファイルの pos にある Block の中身 (data, size) のフレームを加える.
+  // is_key が空の場合は SimpleBlock として flags から決める
+  void addBlockFrames(const unsigned char* data,
+                      const std::size_t size,
+                      const std::int64_t pos,
+                      const std::int64_t cluster_timecode,
+                      const std::optional<bool>& is_key,
+                      IndexedTrack** track);
+  // Cluster の中身の Block のフレームを加え, 読んだ大きさを返す.
+  // 大きさが分からない Cluster は次の Segment の要素の手前で止める
+  std::size_t addClusterBlocks(const unsigned char*,
+                               const std::size_t,
+                               const std::int64_t,
+                               const bool is_unknown_size);
+};
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,170 @@
+#include "webm/input/mapped_reader.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "util/io_budget.hpp"
+#include "webm/input/prefetcher.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+// 書き込み中のファイルを mmap する大きさ. 仮想アドレスを予約するだけで,
+// 読んだページの分しかメモリは使わない
+constexpr std::size_t FOLLOW_MAPPING_SIZE = std::size_t{1} << 36;
+
+}  // namespace
+
+MappedReader::MappedReader(const std::string& file_path, const bool follow)
+    : m_is_following(follow) {
+  const int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error("Unable to open: " + file_path);
+  }
+  struct ::stat st;
+  if (::fstat(fd, &st) == -1) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error(
+        fmt::format("fstat() failed: file_path={} error={}", file_path,
+                    std::strerror(error)));
+  }
+  m_size = static_cast<std::size_t>(st.st_size);
+  m_version = fmt::format("{}.{:09}", st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  const auto mapping_size = follow ? FOLLOW_MAPPING_SIZE : m_size.load();
+  if (mapping_size == 0) {
+    ::close(fd);
+    return;
+  }
+
+  // ファイルの末尾より先のページは, 追記されてから触れば読める.
+  // 追記を見えるようにするため follow の場合は MAP_SHARED にする
+  void* data = ::mmap(nullptr, mapping_size, PROT_READ,
+                      follow ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  const int error = errno;
+  if (follow && data != MAP_FAILED) {
+    m_fd = fd;
+  } else {
+    // mapping はファイルを閉じても有効
+    ::close(fd);
+  }
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(
+        fmt::format("mmap() failed: file_path={} error={}", file_path,
+                    std::strerror(error)));
+  }
+  // クラスタを先頭から順に読むので, 先読みを大きくしてもらう
+  ::madvise(data, mapping_size, MADV_SEQUENTIAL);
+  m_data = static_cast<const unsigned char*>(data);
+  m_mapping.reset(new Mapping{.data = m_data, .size = mapping_size});
+}
+
+MappedReader::Mapping::~Mapping() {
+  ::munmap(const_cast<unsigned char*>(data), size);
+}
+
+MappedReader::~MappedReader() {
+  if (m_fd != -1) {
+    ::close(m_fd);
+  }
+}
+
+int MappedReader::Read(long long pos, long len, unsigned char* buf) {  // NOLINT
+  if (len < 0) {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  const auto data = getData(pos, static_cast<std::size_t>(len));
+  if (data == nullptr) {
+    return -1;
+  }
+  std::memcpy(buf, data, static_cast<std::size_t>(len));
+  return 0;
+}
+
+int MappedReader::Length(long long* total, long long* available) {  // NOLINT
+  if (total != nullptr) {
+    // 書き込み中は全体の大きさが分からない
+    *total = m_is_following ? -1 : static_cast<std::int64_t>(m_size);
+  }
+  if (available != nullptr) {
+    *available = static_cast<std::int64_t>(m_size);
+  }
+  return 0;
+}
+
+const unsigned char* MappedReader::getData(const std::int64_t pos,
+                                           const std::size_t len) const {
+  const std::size_t size = m_size;
+  if (pos < 0 || static_cast<std::size_t>(pos) >= size ||
+      len > size - static_cast<std::size_t>(pos)) {
+    return nullptr;
+  }
+  return m_data + pos;
+}
+
+void MappedReader::prefetch(const std::int64_t pos,
+                            const std::size_t len) const {
+  const std::size_t size = m_size;
+  if (pos < 0 || static_cast<std::size_t>(pos) >= size || len == 0) {
+    return;
+  }
+  // madvise() の開始位置はページ境界に揃える必要がある
+  const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  const auto begin = static_cast<std::size_t>(pos) / page_size * page_size;
+  const auto end = std::min(size, static_cast<std::size_t>(pos) + len);
+  Prefetcher::submit([mapping = m_mapping, begin, end] {
+    // 先読みで読み込みを始める前に帯域を割り当てる
+    hisui::util::ReadBandwidth::acquire(end - begin);
+    ::madvise(const_cast<unsigned char*>(mapping->data) + begin, end - begin,
+              MADV_WILLNEED);
+  });
+}
+
+std::size_t MappedReader::getSize() const {
+  return m_size;
+}
+
+std::string MappedReader::getVersion() const {
+  return m_version;
+}
+
+bool MappedReader::refresh() {
+  if (!m_is_following || m_fd == -1) {
+    return false;
+  }
+  struct ::stat st;
+  if (::fstat(m_fd, &st) == -1) {
+    return false;
+  }
+  const auto size = std::min(static_cast<std::size_t>(st.st_size),
+                             m_mapping->size);
+  if (size <= m_size) {
+    return false;
+  }
+  m_size = size;
+  m_version = fmt::format("{}.{:09}", st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  return true;
+}
+
+void MappedReader::finish() {
+  refresh();
+  m_is_following = false;
+}
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+// ファイル全体を mmap して読む IMkvReader.
+// フレームごとの seek と read をなくし, getData() でフレームを直接参照できる.
+// follow の場合はファイルより大きな範囲を mmap しておき, 追記されても mapping を作り直さない.
+// そのため getData() が返したデータは追記された後も有効
+class MappedReader : public Reader {
+ public:
+  explicit MappedReader(const std::string&, const bool follow = false);
+  ~MappedReader() override;
+
+  MappedReader(const MappedReader&) = delete;
+  MappedReader& operator=(const MappedReader&) = delete;
+
+  int Read(long long, long, unsigned char*) override;  // NOLINT
+  int Length(long long*, long long*) override;         // NOLINT
+
+  const unsigned char* getData(const std::int64_t,
+                               const std::size_t) const override;
+  // OS に先読みさせる. Prefetcher のスレッドで処理する
+  void prefetch(const std::int64_t, const std::size_t) const override;
+  std::size_t getSize() const override;
+  // 更新日時
+  std::string getVersion() const override;
+  bool refresh() override;
+  void finish() override;
+
+ private:
+  // Prefetcher に渡した先読みの要求が処理されるまで munmap() しないように共有する
+  struct Mapping {
+    const unsigned char* data;
+    std::size_t size;
+    ~Mapping();
+  };
+
+  std::shared_ptr<const Mapping> m_mapping;
+  const unsigned char* m_data = nullptr;
+  // 読めるファイルの大きさ. follow の場合は refresh() で大きくなる
+  std::atomic<std::size_t> m_size = 0;
+  std::string m_version;
+  // follow の場合だけ, 大きさを調べ直すために開いておく
+  int m_fd = -1;
+  bool m_is_following = false;
+};
+
+}  // namespace hisui::webm::input
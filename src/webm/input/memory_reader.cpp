@@ -0,0 +1,93 @@
+#include "webm/input/memory_reader.hpp"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+constexpr char MEMORY_PATH_PREFIX[] = "memory://";
+
+}  // namespace
+
+MemoryReader::MemoryReader(const std::string& file_path) {
+  const auto name = file_path.substr(std::size(MEMORY_PATH_PREFIX) - 1);
+  std::lock_guard<std::mutex> lock(m_registry_mutex);
+  if (const auto it = m_registry.find(name); it != std::end(m_registry)) {
+    m_data = it->second;
+    return;
+  }
+  throw std::runtime_error(
+      fmt::format("memory input is not added: file_path={}", file_path));
+}
+
+int MemoryReader::Read(long long pos, long len, unsigned char* buf) {  // NOLINT
+  if (len < 0) {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  const auto data = getData(pos, static_cast<std::size_t>(len));
+  if (data == nullptr) {
+    return -1;
+  }
+  std::memcpy(buf, data, static_cast<std::size_t>(len));
+  return 0;
+}
+
+int MemoryReader::Length(long long* total, long long* available) {  // NOLINT
+  const auto size = static_cast<std::int64_t>(getSize());
+  if (total != nullptr) {
+    *total = size;
+  }
+  if (available != nullptr) {
+    *available = size;
+  }
+  return 0;
+}
+
+const unsigned char* MemoryReader::getData(const std::int64_t pos,
+                                           const std::size_t len) const {
+  const std::size_t size = getSize();
+  if (pos < 0 || static_cast<std::size_t>(pos) >= size ||
+      len > size - static_cast<std::size_t>(pos)) {
+    return nullptr;
+  }
+  return std::data(*m_data) + pos;
+}
+
+std::size_t MemoryReader::getSize() const {
+  return std::size(*m_data);
+}
+
+void MemoryReader::add(const std::string& name,
+                       std::shared_ptr<const Data> data) {
+  if (data == nullptr) {
+    throw std::invalid_argument("data must not be null");
+  }
+  std::lock_guard<std::mutex> lock(m_registry_mutex);
+  m_registry[name] = std::move(data);
+}
+
+void MemoryReader::remove(const std::string& name) {
+  std::lock_guard<std::mutex> lock(m_registry_mutex);
+  m_registry.erase(name);
+}
+
+bool MemoryReader::isMemoryPath(const std::string& file_path) {
+  return file_path.starts_with(MEMORY_PATH_PREFIX);
+}
+
+}  // namespace hisui::webm::input
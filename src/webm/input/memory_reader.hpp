@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+// add() で登録したメモリー上の WebM を読む IMkvReader.
+// hisui を組み込んで使う場合に, 録画をファイルに書かずに合成するためのもので,
+// 録画のパスを memory://<name> とすると name で登録したデータを読む
+class MemoryReader : public Reader {
+ public:
+  using Data = std::vector<unsigned char>;
+
+  explicit MemoryReader(const std::string&);
+
+  int Read(long long, long, unsigned char*) override;  // NOLINT
+  int Length(long long*, long long*) override;         // NOLINT
+
+  const unsigned char* getData(const std::int64_t,
+                               const std::size_t) const override;
+  void prefetch(const std::int64_t, const std::size_t) const override {}
+  std::size_t getSize() const override;
+  // 内容が変わったかを確かめられないので Index のキャッシュは使わない
+  std::string getVersion() const override { return ""; }
+
+  // 開いている MemoryReader は remove() した後もデータを持ち続ける
+  static void add(const std::string& name, std::shared_ptr<const Data>);
+  static void remove(const std::string& name);
+  static bool isMemoryPath(const std::string&);
+
+ private:
+  std::shared_ptr<const Data> m_data;
+
+  inline static std::mutex m_registry_mutex;
+  inline static std::map<std::string, std::shared_ptr<const Data>> m_registry;
+};
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,201 @@
+#include "webm/input/pipe_reader.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+// 受け取った WebM を置く匿名 mapping の大きさ. 仮想アドレスを予約するだけで,
+// 書き込んだページの分しかメモリは使わない
+constexpr std::size_t MAPPING_SIZE = std::size_t{1} << 36;
+constexpr std::size_t READ_SIZE = 256 * 1024;
+// 合成を終える際に読み込むスレッドが止まったかを調べる間隔 (ms)
+constexpr int POLL_TIMEOUT = 100;
+
+}  // namespace
+
+PipeReader::PipeReader(const std::string& file_path)
+    : m_file_path(file_path) {
+  void* data = ::mmap(nullptr, MAPPING_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error(
+        fmt::format("mmap() failed: file_path={} error={}", file_path,
+                    std::strerror(errno)));
+  }
+  m_data = static_cast<unsigned char*>(data);
+  m_thread = std::thread([this] { receive(); });
+}
+
+PipeReader::~PipeReader() {
+  m_is_stopped = true;
+  // 書き手が現れずに open() で止まっている読み込むスレッドを, 書き手として開いて起こす.
+  // スレッドがまだ open() に達していなければ開けないので, 開けるまで繰り返す
+  while (!m_is_opened) {
+    const int fd = ::open(m_file_path.c_str(), O_WRONLY | O_NONBLOCK);
+    if (fd != -1) {
+      ::close(fd);
+    } else if (errno != ENXIO) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT / 10));
+  }
+  m_thread.join();
+  ::munmap(m_data, MAPPING_SIZE);
+}
+
+int PipeReader::openFile() {
+  struct ::stat st;
+  if (::stat(m_file_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+      return -1;
+    }
+    ::sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (std::size(m_file_path) >= sizeof(address.sun_path)) {
+      ::close(fd);
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    std::strcpy(address.sun_path, m_file_path.c_str());
+    if (::connect(fd, reinterpret_cast<const ::sockaddr*>(&address),
+                  sizeof(address)) == -1) {
+      const int error = errno;
+      ::close(fd);
+      errno = error;
+      return -1;
+    }
+    return fd;
+  }
+  // 名前付きパイプは書き手が開くまで待つ
+  return ::open(m_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void PipeReader::receive() {
+  const int fd = openFile();
+  m_is_opened = true;
+  if (fd == -1) {
+    spdlog::error("opening {} failed: {}", m_file_path, std::strerror(errno));
+    m_is_ended = true;
+    return;
+  }
+  while (!m_is_stopped) {
+    ::pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    const int ret = ::poll(&pfd, 1, POLL_TIMEOUT);
+    if (ret == 0 || (ret == -1 && errno == EINTR)) {
+      continue;
+    }
+    if (ret == -1) {
+      spdlog::error("poll() failed: file_path={} error={}", m_file_path,
+                    std::strerror(errno));
+      break;
+    }
+    const std::size_t size = m_size.load(std::memory_order_relaxed);
+    if (size == MAPPING_SIZE) {
+      spdlog::error("{} is too large", m_file_path);
+      break;
+    }
+    const auto n =
+        ::read(fd, m_data + size, std::min(READ_SIZE, MAPPING_SIZE - size));
+    if (n == 0) {
+      break;
+    }
+    if (n == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      spdlog::error("read() failed: file_path={} error={}", m_file_path,
+                    std::strerror(errno));
+      break;
+    }
+    m_size.store(size + static_cast<std::size_t>(n),
+                 std::memory_order_release);
+  }
+  ::close(fd);
+  m_is_ended = true;
+}
+
+int PipeReader::Read(long long pos, long len, unsigned char* buf) {  // NOLINT
+  if (len < 0) {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  const auto data = getData(pos, static_cast<std::size_t>(len));
+  if (data == nullptr) {
+    return -1;
+  }
+  std::memcpy(buf, data, static_cast<std::size_t>(len));
+  return 0;
+}
+
+int PipeReader::Length(long long* total, long long* available) {  // NOLINT
+  if (total != nullptr) {
+    // 書き手が閉じるまでは全体の大きさが分からない
+    *total = m_is_finished ? static_cast<std::int64_t>(m_refreshed_size) : -1;
+  }
+  if (available != nullptr) {
+    *available = static_cast<std::int64_t>(m_refreshed_size);
+  }
+  return 0;
+}
+
+const unsigned char* PipeReader::getData(const std::int64_t pos,
+                                         const std::size_t len) const {
+  const std::size_t size = m_size.load(std::memory_order_acquire);
+  if (pos < 0 || static_cast<std::size_t>(pos) >= size ||
+      len > size - static_cast<std::size_t>(pos)) {
+    return nullptr;
+  }
+  return m_data + pos;
+}
+
+std::size_t PipeReader::getSize() const {
+  return m_refreshed_size;
+}
+
+bool PipeReader::refresh() {
+  if (m_is_finished) {
+    return false;
+  }
+  const std::size_t size = m_size.load(std::memory_order_acquire);
+  if (size <= m_refreshed_size) {
+    return false;
+  }
+  m_refreshed_size = size;
+  return true;
+}
+
+void PipeReader::finish() {
+  refresh();
+  m_is_finished = true;
+}
+
+bool PipeReader::isEnded() const {
+  return m_is_ended && m_size.load() == m_refreshed_size;
+}
+
+}  // namespace hisui::webm::input
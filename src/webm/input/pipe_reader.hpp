@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "webm/input/reader.hpp"
+
+namespace hisui::webm::input {
+
+// 名前付きパイプか Unix ドメインソケットに録画側が書き込む WebM を, 先頭から順に読む.
+// 録画をディスクに書かずに合成するためのもので, 書き手が閉じるまでを書き込み中のファイルとして扱う.
+// seek できないので, 届いたデータは大きな匿名 mapping に追記して残し, getData() で参照させる.
+// 読み込みは別のスレッドで行い, 合成が追いつかない間も書き手を待たせない
+class PipeReader : public Reader {
+ public:
+  explicit PipeReader(const std::string&);
+  ~PipeReader() override;
+
+  PipeReader(const PipeReader&) = delete;
+  PipeReader& operator=(const PipeReader&) = delete;
+
+  int Read(long long, long, unsigned char*) override;  // NOLINT
+  int Length(long long*, long long*) override;         // NOLINT
+
+  const unsigned char* getData(const std::int64_t,
+                               const std::size_t) const override;
+  void prefetch(const std::int64_t, const std::size_t) const override {}
+  std::size_t getSize() const override;
+  // 開き直せないので Index のキャッシュは使わない
+  std::string getVersion() const override { return ""; }
+  bool refresh() override;
+  void finish() override;
+  bool isEnded() const override;
+
+ private:
+  std::string m_file_path;
+  unsigned char* m_data = nullptr;
+  // 読み込むスレッドが書き込み終えた大きさ
+  std::atomic<std::size_t> m_size = 0;
+  // 前の refresh() の時の m_size
+  std::size_t m_refreshed_size = 0;
+  std::atomic<bool> m_is_ended = false;
+  std::atomic<bool> m_is_opened = false;
+  std::atomic<bool> m_is_stopped = false;
+  bool m_is_finished = false;
+  int m_fd = -1;
+  std::thread m_thread;
+
+  void receive();
+  int openFile();
+};
+
+}  // namespace hisui::webm::input
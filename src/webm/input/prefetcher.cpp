@@ -0,0 +1,64 @@
+#include "webm/input/prefetcher.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/blocking_queue.hpp"
+
+namespace hisui::webm::input {
+
+namespace {
+
+class Workers {
+ public:
+  explicit Workers(const std::size_t number_of_threads) {
+    m_threads.reserve(number_of_threads);
+    for (std::size_t i = 0; i < number_of_threads; ++i) {
+      m_threads.emplace_back([this] {
+        while (const auto task = m_tasks.pop()) {
+          (*task)();
+        }
+      });
+    }
+  }
+
+  ~Workers() {
+    m_tasks.close();
+    for (auto& t : m_threads) {
+      t.join();
+    }
+  }
+
+  Workers(const Workers&) = delete;
+  Workers& operator=(const Workers&) = delete;
+
+  void submit(std::function<void()> task) { m_tasks.push(std::move(task)); }
+
+ private:
+  hisui::util::BlockingQueue<std::function<void()>> m_tasks;
+  std::vector<std::thread> m_threads;
+};
+
+std::unique_ptr<Workers> workers;
+
+}  // namespace
+
+void Prefetcher::setNumberOfThreads(const std::size_t number_of_threads) {
+  workers = number_of_threads > 0
+                ? std::make_unique<Workers>(number_of_threads)
+                : nullptr;
+}
+
+void Prefetcher::submit(std::function<void()> task) {
+  if (workers) {
+    workers->submit(std::move(task));
+  } else {
+    task();
+  }
+}
+
+}  // namespace hisui::webm::input
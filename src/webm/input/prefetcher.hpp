@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace hisui::webm::input {
+
+// Reader の先読みの要求を, 全ての Reader で共有する専用のスレッドで処理する.
+// ネットワーク越しのファイルシステムでは先読みの要求自体が I/O を待つことがあるので,
+// デマックスやデコードのスレッドから外す
+class Prefetcher {
+ public:
+  // 0 ならば呼び出し元のスレッドで処理する. Demuxer を開く前に設定しておく
+  static void setNumberOfThreads(const std::size_t);
+  // task は要求した順に処理する. task が参照するものは task 自身が保持すること
+  static void submit(std::function<void()>);
+};
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,39 @@
+#include "webm/input/reader.hpp"
+
+#include <sys/stat.h>
+
+#include <memory>
+#include <string>
+
+#include "util/file.hpp"
+#include "webm/input/http_reader.hpp"
+#include "webm/input/mapped_reader.hpp"
+#include "webm/input/memory_reader.hpp"
+#include "webm/input/pipe_reader.hpp"
+
+namespace hisui::webm::input {
+
+std::unique_ptr<Reader> Reader::open(const std::string& file_path,
+                                     const bool follow) {
+  if (MemoryReader::isMemoryPath(file_path)) {
+    return std::make_unique<MemoryReader>(file_path);
+  }
+  if (hisui::util::is_url(file_path)) {
+    return std::make_unique<HttpReader>(file_path);
+  }
+  if (isStream(file_path)) {
+    return std::make_unique<PipeReader>(file_path);
+  }
+  return std::make_unique<MappedReader>(file_path, follow);
+}
+
+bool Reader::isStream(const std::string& file_path) {
+  if (hisui::util::is_url(file_path)) {
+    return false;
+  }
+  struct ::stat st;
+  return ::stat(file_path.c_str(), &st) == 0 &&
+         (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+}  // namespace hisui::webm::input
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <mkvparser/mkvparser.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace hisui::webm::input {
+
+// Demuxer が WebM ファイルを読む IMkvReader.
+// getData() でフレームをコピーせずに参照できる
+class Reader : public mkvparser::IMkvReader {
+ public:
+  // memory:// で始まる場合は MemoryReader, http:// で始まる場合は HttpReader, 名前付きパイプか Unix ドメインソケットの場合は
+  // PipeReader, それ以外は MappedReader を開く.
+  // follow ならば書き込み中のファイルとして開き, refresh() で追記された分も読めるようにする.
+  // HttpReader は follow に対応しない. PipeReader は常に follow として扱う
+  static std::unique_ptr<Reader> open(const std::string&,
+                                      const bool follow = false);
+  // 名前付きパイプか Unix ドメインソケットか. 開き直せず, 先頭から順にしか読めない
+  static bool isStream(const std::string&);
+
+  // [pos, pos + len) がファイルに収まっていなければ nullptr を返す.
+  // 返したデータは Reader を破棄するまで有効
+  virtual const unsigned char* getData(const std::int64_t,
+                                       const std::size_t) const = 0;
+  // [pos, pos + len) の読み込みを先行して始めさせる. 完了は待たない
+  virtual void prefetch(const std::int64_t, const std::size_t) const = 0;
+  virtual std::size_t getSize() const = 0;
+  // ファイルが変わると変わる文字列. Index のキャッシュが古いかを調べるのに使う.
+  // 空ならば確かめられないので Index のキャッシュは使わない
+  virtual std::string getVersion() const = 0;
+  // 追記された分を読めるようにし, 大きくなっていれば true を返す
+  virtual bool refresh() { return false; }
+  // 書き込みが終わったとみなし, 以降は Length() で全体の大きさを返す
+  virtual void finish() {}
+  // 書き手が閉じ, これ以上 refresh() で大きくならないことが分かっていれば true
+  virtual bool isEnded() const { return false; }
+};
+
+}  // namespace hisui::webm::input
@@ -1,17 +1,16 @@
 #include "webm/input/video_context.hpp"
 
 #include <bits/exception.h>
-#include <mkvparser/mkvparser.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
-#include <cstdio>
 #include <cstring>
 #include <stdexcept>
 #include <string>
 
 #include "constants.hpp"
 #include "webm/input/context.hpp"
+#include "webm/input/index.hpp"
 
 namespace hisui::webm::input {
 
@@ -28,34 +27,20 @@ void VideoContext::reset() {
 }
 
 bool VideoContext::init() {
-  m_file = std::fopen(m_file_path.c_str(), "rb");
-  if (m_file == nullptr) {
-    throw std::runtime_error("Unable to open: " + m_file_path);
-  }
-  initReaderAndSegment(m_file);
-
-  const mkvparser::Tracks* const tracks = m_segment->GetTracks();
-  const mkvparser::VideoTrack* video_track = nullptr;
-  for (std::uint64_t i = 0, m = tracks->GetTracksCount(); i < m; ++i) {
-    const mkvparser::Track* const track = tracks->GetTrackByIndex(i);
-    if (track != nullptr && track->GetType() == mkvparser::Track::kVideo) {
-      video_track = static_cast<const mkvparser::VideoTrack*>(track);
-      m_track_index = static_cast<int>(track->GetNumber());
-      break;
-    }
-  }
+  initDemuxer();
 
-  if (video_track == nullptr || video_track->GetCodecId() == nullptr) {
+  const auto video_track = selectTrack(TrackType::Video);
+  if (!video_track || std::empty(video_track->codec_id)) {
     spdlog::info("video track not found");
     return false;
   }
 
-  if (video_track->GetWidth() == 0 || video_track->GetHeight() == 0) {
+  if (video_track->width == 0 || video_track->height == 0) {
     spdlog::info("invalid video track");
     return false;
   }
 
-  const auto codec_id = video_track->GetCodecId();
+  const auto codec_id = video_track->codec_id.c_str();
 
   if (!std::strncmp(codec_id, "V_VP8", 5)) {
     m_fourcc = hisui::Constants::VP8_FOURCC;
@@ -66,20 +51,19 @@ bool VideoContext::init() {
   } else if (!std::strncmp(codec_id, "V_MPEG4/ISO/AVC", 15)) {
     m_fourcc = hisui::Constants::H264_FOURCC;
   } else {
-    if (video_track->GetCodecNameAsUTF8() == nullptr) {
-      spdlog::info("unsuppoted codec: codec_id={}", video_track->GetCodecId());
+    if (std::empty(video_track->codec_name)) {
+      spdlog::info("unsuppoted codec: codec_id={}", video_track->codec_id);
     } else {
       spdlog::info("unsuppoted codec: codec_id={}, codec_name={}",
-                   video_track->GetCodecId(),
-                   video_track->GetCodecNameAsUTF8());
+                   video_track->codec_id, video_track->codec_name);
     }
     return false;
   }
 
-  m_width = static_cast<std::uint32_t>(video_track->GetWidth());
-  m_height = static_cast<std::uint32_t>(video_track->GetHeight());
+  m_width = static_cast<std::uint32_t>(video_track->width);
+  m_height = static_cast<std::uint32_t>(video_track->height);
 
-  m_cluster = m_segment->GetFirst();
+  rewind();
 
   return true;
 }
@@ -0,0 +1,185 @@
+#include "webm/output/buffered_writer.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "report/reporter.hpp"
+#include "util/output_hasher.hpp"
+
+namespace hisui::webm::output {
+
+namespace {
+
+constexpr std::size_t BLOCK_SIZE = 4 * 1024 * 1024;
+// 書き込み待ちのブロックも含めて, これ以上のメモリは使わない
+constexpr std::size_t NUMBER_OF_BLOCKS = 4;
+
+}  // namespace
+
+BufferedWriter::BufferedWriter(const std::string& t_file_path,
+                               const std::vector<std::string>& hashes)
+    : m_file_path(t_file_path) {
+  if (m_file_path == "-") {
+    m_fd = STDOUT_FILENO;
+    m_owns_fd = false;
+  } else {
+    m_fd = ::open(m_file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd == -1) {
+      throw std::runtime_error("Unable to open: " + m_file_path);
+    }
+  }
+  // パイプや FIFO には先頭から順に書くしかない
+  struct ::stat st;
+  m_is_seekable = ::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode);
+  if (!std::empty(hashes)) {
+    m_hasher =
+        std::make_unique<hisui::util::OutputHasher>(m_file_path, hashes);
+  }
+  m_buffer.reserve(BLOCK_SIZE);
+  for (std::size_t i = 1; i < NUMBER_OF_BLOCKS; ++i) {
+    m_free_buffers.push({});
+  }
+  m_thread = std::thread(&BufferedWriter::work, this);
+}
+
+BufferedWriter::~BufferedWriter() {
+  if (m_fd != -1) {
+    try {
+      close();
+    } catch (...) {
+      // デストラクタからは例外を投げない
+    }
+  }
+}
+
+mkvmuxer::int32 BufferedWriter::Write(const void* buf,
+                                      const mkvmuxer::uint32 len) {
+  if (m_fd == -1 || hasError()) {
+    return -1;
+  }
+  const auto* p = static_cast<const std::uint8_t*>(buf);
+  std::size_t remaining = len;
+  while (remaining > 0) {
+    const auto n = std::min(remaining, BLOCK_SIZE - std::size(m_buffer));
+    m_buffer.insert(std::end(m_buffer), p, p + n);
+    p += n;
+    remaining -= n;
+    if (std::size(m_buffer) == BLOCK_SIZE) {
+      submit();
+    }
+  }
+  return 0;
+}
+
+mkvmuxer::int64 BufferedWriter::Position() const {
+  return m_buffer_offset + static_cast<std::int64_t>(std::size(m_buffer));
+}
+
+mkvmuxer::int32 BufferedWriter::Position(const mkvmuxer::int64 position) {
+  if (m_fd == -1 || !m_is_seekable || position < 0) {
+    return -1;
+  }
+  // pwrite() で位置を指定して書くので, 溜めた分を出して位置を付け替えればよい
+  submit();
+  m_buffer_offset = position;
+  return 0;
+}
+
+bool BufferedWriter::Seekable() const {
+  return m_is_seekable;
+}
+
+void BufferedWriter::ElementStartNotify(mkvmuxer::uint64, mkvmuxer::int64) {}
+
+void BufferedWriter::close() {
+  if (m_fd == -1) {
+    return;
+  }
+  submit();
+  m_blocks.close();
+  m_thread.join();
+  const int ret = m_owns_fd ? ::close(m_fd) : 0;
+  const int close_error = errno;
+  m_fd = -1;
+
+  if (hasError()) {
+    throw std::runtime_error(
+        fmt::format("write failed: file_path={} error={}", m_file_path,
+                    std::strerror(m_error)));
+  }
+  if (ret == -1) {
+    throw std::runtime_error(
+        fmt::format("close() failed: file_path={} error={}", m_file_path,
+                    std::strerror(close_error)));
+  }
+  if (m_hasher) {
+    m_hasher->finish();
+  }
+}
+
+void BufferedWriter::submit() {
+  if (std::empty(m_buffer)) {
+    return;
+  }
+  const auto size = static_cast<std::int64_t>(std::size(m_buffer));
+  m_blocks.push(Block{.offset = m_buffer_offset, .data = std::move(m_buffer)});
+  m_buffer_offset += size;
+
+  // 空きブロックが戻るまで待つことで, 使うメモリを抑える
+  m_buffer = std::move(*m_free_buffers.pop());
+  m_buffer.clear();
+  m_buffer.reserve(BLOCK_SIZE);
+}
+
+void BufferedWriter::work() {
+  while (auto block = m_blocks.pop()) {
+    hisui::report::StageTimer timer("file_write");
+    const auto* p = std::data(block->data);
+    std::size_t remaining = std::size(block->data);
+    auto offset = block->offset;
+    while (remaining > 0 && !hasError()) {
+      const auto ret = m_is_seekable ? ::pwrite(m_fd, p, remaining, offset)
+                                     : ::write(m_fd, p, remaining);
+      if (ret == -1) {
+        const int error = errno;
+        if (error == EINTR) {
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = error;
+        break;
+      }
+      p += ret;
+      remaining -= static_cast<std::size_t>(ret);
+      offset += ret;
+    }
+    if (m_hasher && remaining == 0) {
+      m_hasher->update(block->offset, std::data(block->data),
+                       std::size(block->data));
+    }
+    // 失敗していても, mux するスレッドが待ち続けないようにブロックは返す
+    m_free_buffers.push(std::move(block->data));
+  }
+}
+
+bool BufferedWriter::hasError() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_error != 0;
+}
+
+}  // namespace hisui::webm::output
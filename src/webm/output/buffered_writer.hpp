@@ -0,0 +1,68 @@
+#pragma once
+
+#include <mkvmuxer/mkvmuxer.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/blocking_queue.hpp"
+#include "util/output_hasher.hpp"
+
+namespace hisui::webm::output {
+
+// 大きなブロック単位でまとめて書き出す IMkvWriter.
+// 書き込みは専用のスレッドが pwrite() で行うので, mux するスレッドは
+// 遅いファイルシステムでもブロックの空きを待つとき以外は止まらない.
+// ファイル名に "-" を渡すと標準出力に書き出す. 通常のファイル以外には seek しない.
+// hashes を与えると, 書き込むスレッドで書き込んだブロックからハッシュ値を計算する
+class BufferedWriter : public mkvmuxer::IMkvWriter {
+ public:
+  explicit BufferedWriter(const std::string&,
+                          const std::vector<std::string>& hashes = {});
+  ~BufferedWriter() override;
+
+  BufferedWriter(const BufferedWriter&) = delete;
+  BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+  mkvmuxer::int32 Write(const void*, mkvmuxer::uint32) override;
+  mkvmuxer::int64 Position() const override;
+  mkvmuxer::int32 Position(mkvmuxer::int64) override;
+  bool Seekable() const override;
+  void ElementStartNotify(mkvmuxer::uint64, mkvmuxer::int64) override;
+
+  // 書き込みを終えてファイルを閉じる. 書き込みに失敗していれば例外を投げる
+  void close();
+
+ private:
+  struct Block {
+    std::int64_t offset;
+    std::vector<std::uint8_t> data;
+  };
+
+  void submit();
+  void work();
+  bool hasError();
+
+  std::string m_file_path;
+  int m_fd = -1;
+  bool m_owns_fd = true;
+  bool m_is_seekable = true;
+
+  std::vector<std::uint8_t> m_buffer;
+  std::int64_t m_buffer_offset = 0;
+
+  hisui::util::BlockingQueue<Block> m_blocks;
+  hisui::util::BlockingQueue<std::vector<std::uint8_t>> m_free_buffers;
+  std::thread m_thread;
+  std::unique_ptr<hisui::util::OutputHasher> m_hasher;
+
+  std::mutex m_mutex;
+  int m_error = 0;
+};
+
+}  // namespace hisui::webm::output
@@ -1,29 +1,41 @@
 #include "webm/output/context.hpp"
 
+#include <spdlog/spdlog.h>
+
+#include <exception>
 #include <stdexcept>
 #include <string>
 
 #include "fmt/core.h"
 #include "mkvmuxer/mkvmuxer.h"
-#include "mkvmuxer/mkvwriter.h"
 
 #include "constants.hpp"
+#include "webm/output/buffered_writer.hpp"
 
 namespace hisui::webm::output {
 
-Context::Context(const std::string& t_file_path) : m_file_path(t_file_path) {}
+Context::Context(const std::string& t_file_path,
+                 const ContextParameters& params)
+    : m_file_path(t_file_path), m_params(params) {}
 
 void Context::init() {
-  m_file = std::fopen(m_file_path.c_str(), "wb");
-  if (m_file == nullptr) {
-    throw std::runtime_error("Unable to open: " + m_file_path);
-  }
-
-  m_writer = new mkvmuxer::MkvWriter(m_file);
+  m_writer = new BufferedWriter(m_file_path, m_params.hashes);
   m_segment = new mkvmuxer::Segment();
   m_segment->Init(m_writer);
-  m_segment->set_mode(mkvmuxer::Segment::kFile);
-  m_segment->OutputCues(true);
+  if (m_writer->Seekable()) {
+    m_segment->set_mode(mkvmuxer::Segment::kFile);
+    m_segment->OutputCues(m_params.output_cues);
+  } else {
+    // サイズや Cues を後から書き戻せないので, ライブ形式で書き出す
+    m_segment->set_mode(mkvmuxer::Segment::kLive);
+  }
+  // Cues は cluster ごとに先頭のフレームを指すので, cluster を短くすると seek が速くなる
+  if (m_params.max_cluster_duration_ns > 0) {
+    m_segment->set_max_cluster_duration(m_params.max_cluster_duration_ns);
+  }
+  if (m_params.max_cluster_size > 0) {
+    m_segment->set_max_cluster_size(m_params.max_cluster_size);
+  }
   mkvmuxer::SegmentInfo* const info = m_segment->GetSegmentInfo();
   info->set_timecode_scale(1000000);
   info->set_writing_app(hisui::Constants::HISUI_APPLICATION_NAME.c_str());
@@ -35,11 +47,13 @@ Context::~Context() {
     delete m_segment;
   }
   if (m_writer) {
+    try {
+      m_writer->close();
+    } catch (const std::exception& e) {
+      spdlog::error("{}", e.what());
+    }
     delete m_writer;
   }
-  if (m_file) {
-    std::fclose(m_file);
-  }
 }
 
 void Context::setAudioTrack(const std::uint64_t codec_delay,
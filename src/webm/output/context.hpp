@@ -2,21 +2,32 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <cstdio>
 #include <string>
+#include <vector>
 
 namespace mkvmuxer {
 
-class MkvWriter;
 class Segment;
 
 }  // namespace mkvmuxer
 
 namespace hisui::webm::output {
 
+class BufferedWriter;
+
+struct ContextParameters {
+  // 0 ならば mkvmuxer に任せる. 映像のキーフレームでは常に cluster を分ける
+  const std::uint64_t max_cluster_duration_ns = 0;
+  const std::uint64_t max_cluster_size = 0;
+  // seek できる出力の場合のみ Cues を書く
+  const bool output_cues = true;
+  // 書き込みながら計算するハッシュ値のアルゴリズム
+  const std::vector<std::string> hashes = {};
+};
+
 class Context {
  public:
-  explicit Context(const std::string&);
+  explicit Context(const std::string&, const ContextParameters& = {});
   ~Context();
 
   void init();
@@ -39,9 +50,9 @@ class Context {
 
  private:
   std::string m_file_path;
-  std::FILE* m_file = nullptr;
-  mkvmuxer::MkvWriter* m_writer;
-  mkvmuxer::Segment* m_segment;
+  const ContextParameters m_params;
+  BufferedWriter* m_writer = nullptr;
+  mkvmuxer::Segment* m_segment = nullptr;
   const std::uint64_t m_video_track_number = 1;
   const std::uint64_t m_audio_track_number = 2;
 };
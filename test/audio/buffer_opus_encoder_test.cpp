@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "audio/buffer_opus_encoder.hpp"
+#include "audio/opus.hpp"
+#include "audio/opus_decoder.hpp"
+#include "constants.hpp"
+#include "frame.hpp"
+#include "frame_queue.hpp"
+
+namespace {
+
+// L, R に同じ値を並べた 440 Hz の sample
+std::vector<std::int16_t> make_sine(const std::uint32_t sample_rate,
+                                    const std::size_t number_of_samples) {
+  std::vector<std::int16_t> samples;
+  samples.reserve(number_of_samples * 2);
+  for (std::size_t i = 0; i < number_of_samples; ++i) {
+    const auto value = static_cast<std::int16_t>(
+        10000 * std::sin(2 * std::numbers::pi * 440 *
+                         static_cast<double>(i) / sample_rate));
+    samples.push_back(value);
+    samples.push_back(value);
+  }
+  return samples;
+}
+
+double rms(const std::vector<std::int16_t>& samples,
+           const std::size_t begin) {
+  double sum = 0;
+  for (std::size_t i = begin; i < std::size(samples); ++i) {
+    sum += static_cast<double>(samples[i]) * samples[i];
+  }
+  return std::sqrt(sum / static_cast<double>(std::size(samples) - begin));
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(buffer_opus_encoder)
+
+// --out-audio-sample-rate で 48 kHz 以外のままエンコードし, 同じ rate でデコードする
+BOOST_AUTO_TEST_CASE(encode_and_decode_at_sample_rate) {
+  for (const std::uint32_t sample_rate : {8000U, 16000U, 24000U, 48000U}) {
+    BOOST_TEST_CONTEXT("sample_rate=" << sample_rate) {
+      hisui::FrameQueue queue;
+      hisui::audio::BufferOpusEncoder encoder(
+          &queue, {.bit_rate = 64000, .sample_rate = sample_rate});
+      // pre-skip は rate によらず 48 kHz の sample 数で書く
+      BOOST_REQUIRE_EQUAL(312, encoder.getSkip());
+
+      // 1 秒分を半端な大きさに分けて渡す
+      const auto input = make_sine(sample_rate, sample_rate);
+      const std::size_t chunk = 333;
+      for (std::size_t i = 0; i < sample_rate; i += chunk) {
+        encoder.addSamples(std::data(input) + i * 2,
+                           std::min<std::size_t>(chunk, sample_rate - i));
+      }
+      encoder.flush();
+
+      hisui::audio::OpusDecoder decoder(2, sample_rate);
+      BOOST_REQUIRE_EQUAL(sample_rate / 1000 * 120 * 2,
+                          decoder.getMaxDecodedSize());
+      std::vector<std::int16_t> decoded;
+      std::vector<std::int16_t> buffer(decoder.getMaxDecodedSize());
+      std::uint64_t number_of_frames = 0;
+      while (const auto frame = queue.front()) {
+        BOOST_REQUIRE_EQUAL(number_of_frames * 20000000, frame->timestamp);
+        ++number_of_frames;
+        const auto size =
+            decoder.decode(frame->data.get(), frame->data_size,
+                           std::data(buffer), std::size(buffer));
+        // 20 ms 分
+        BOOST_REQUIRE_EQUAL(sample_rate / 50 * 2, size);
+        decoded.insert(std::end(decoded), std::begin(buffer),
+                       std::begin(buffer) + static_cast<std::ptrdiff_t>(size));
+        queue.pop();
+      }
+      BOOST_REQUIRE_EQUAL(50, number_of_frames);
+
+      // pre-skip の後は元の音量の sine が戻る. 10000 / sqrt(2) 程度になる
+      const auto skip =
+          static_cast<std::size_t>(encoder.getSkip()) * sample_rate /
+          hisui::Constants::PCM_SAMPLE_RATE * 2;
+      BOOST_REQUIRE_GT(rms(decoded, skip), 5000);
+      BOOST_REQUIRE_LT(rms(decoded, skip), 9000);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(private_data_sample_rate) {
+  const auto data =
+      hisui::audio::create_opus_private_data({.skip = 312,
+                                              .sample_rate = 16000});
+  BOOST_REQUIRE_EQUAL(312, data[10] | (data[11] << 8));
+  BOOST_REQUIRE_EQUAL(16000, data[12] | (data[13] << 8) | (data[14] << 16) |
+                                 (data[15] << 24));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
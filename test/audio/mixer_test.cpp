@@ -1,3 +1,6 @@
+#include <cstdint>
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 #include "audio/mixer.hpp"
@@ -20,4 +23,51 @@ BOOST_AUTO_TEST_CASE(mix_sample_toth) {
   BOOST_REQUIRE_EQUAL(-32768, hisui::audio::mix_sample_vttoth(-32767, -2));
 }
 
+BOOST_AUTO_TEST_CASE(mix_samples) {
+  const std::vector<std::int16_t> samples1 = {1, -1, 32767, -32767, -32767, 0};
+  const std::vector<std::int16_t> samples2 = {2, 2, 1, -1, -2, 5};
+
+  std::vector<std::int16_t> mixed = samples1;
+  hisui::audio::mix_samples_simple(mixed.data(), samples2.data(),
+                                   std::size(mixed));
+  for (std::size_t i = 0; i < std::size(mixed); ++i) {
+    BOOST_REQUIRE_EQUAL(
+        hisui::audio::mix_sample_simple(samples1[i], samples2[i]), mixed[i]);
+  }
+
+  mixed = samples1;
+  hisui::audio::mix_samples_vttoth(mixed.data(), samples2.data(),
+                                   std::size(mixed));
+  for (std::size_t i = 0; i < std::size(mixed); ++i) {
+    BOOST_REQUIRE_EQUAL(
+        hisui::audio::mix_sample_vttoth(samples1[i], samples2[i]), mixed[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(limit_samples) {
+  const std::vector<std::int16_t> samples1 = {1, -1, 24576, 32767, -32768, 0};
+  const std::vector<std::int16_t> samples2 = {2, 2, 0, 32767, -32768, 5};
+
+  std::vector<std::int32_t> bus(std::size(samples1));
+  hisui::audio::accumulate_samples(bus.data(), samples1.data(), std::size(bus));
+  hisui::audio::accumulate_samples(bus.data(), samples2.data(), std::size(bus));
+  std::vector<std::int16_t> mixed(std::size(bus));
+  hisui::audio::limit_samples(mixed.data(), bus.data(), std::size(bus));
+
+  BOOST_REQUIRE_EQUAL(3, mixed[0]);
+  BOOST_REQUIRE_EQUAL(1, mixed[1]);
+  BOOST_REQUIRE_EQUAL(24576, mixed[2]);
+  BOOST_REQUIRE_LT(mixed[2], mixed[3]);
+  BOOST_REQUIRE_EQUAL(-mixed[3], mixed[4]);
+  BOOST_REQUIRE_EQUAL(5, mixed[5]);
+
+  // 足す順序によらない
+  std::vector<std::int32_t> reversed(std::size(samples1));
+  hisui::audio::accumulate_samples(reversed.data(), samples2.data(),
+                                   std::size(reversed));
+  hisui::audio::accumulate_samples(reversed.data(), samples1.data(),
+                                   std::size(reversed));
+  BOOST_REQUIRE(bus == reversed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,229 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "archive_item.hpp"
+#include "audio/basic_sequencer.hpp"
+#include "audio/buffer_opus_encoder.hpp"
+#include "audio/webm_source.hpp"
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "webm/input/demuxer.hpp"
+#include "webm/input/index.hpp"
+#include "webm/input/mapped_reader.hpp"
+
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+// CELT のみ, fullband, mono で 1 フレームの TOC
+constexpr unsigned char TOC_20MS = 0xF8;
+constexpr unsigned char TOC_10MS = 0xF0;
+
+// 大きさは 8 バイトの可変長整数で書く
+Bytes element(const Bytes& id, const Bytes& data) {
+  Bytes bytes = id;
+  bytes.push_back(0x01);
+  for (int i = 6; i >= 0; --i) {
+    bytes.push_back(
+        static_cast<unsigned char>((std::size(data) >> (8 * i)) & 0xFF));
+  }
+  bytes.insert(std::end(bytes), std::begin(data), std::end(data));
+  return bytes;
+}
+
+struct Packet {
+  std::int16_t timestamp_ms;
+  Bytes data;
+};
+
+// DTX と区別されるよう 3 バイト以上にする
+Bytes make_packet(const unsigned char toc, const unsigned char n) {
+  return {toc, 0x55, n, 0xAA};
+}
+
+// packets を 1 つの Cluster に入れた WebM の Segment の中身を書き, 解析せずに
+// 開けるよう Index をキャッシュに保存しておく
+void write_webm(const std::filesystem::path& path,
+                const std::filesystem::path& cache_directory,
+                const std::vector<Packet>& packets) {
+  Bytes cluster = element({0xE7}, {0x00});
+  for (const auto& packet : packets) {
+    const auto tc = static_cast<std::uint16_t>(packet.timestamp_ms);
+    Bytes block = {0x81, static_cast<unsigned char>(tc >> 8),
+                   static_cast<unsigned char>(tc & 0xFF), 0x80};
+    block.insert(std::end(block), std::begin(packet.data),
+                 std::end(packet.data));
+    const auto simple_block = element({0xA3}, block);
+    cluster.insert(std::end(cluster), std::begin(simple_block),
+                   std::end(simple_block));
+  }
+  const auto segment = element({0x1F, 0x43, 0xB6, 0x75}, cluster);
+  {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(std::data(segment)),
+              static_cast<std::streamsize>(std::size(segment)));
+  }
+
+  const hisui::webm::input::TrackInfo track{
+      .number = 1,
+      .type = hisui::webm::input::TrackType::Audio,
+      .codec_id = "A_OPUS",
+      .channels = 1,
+      .sampling_rate = 48000.0};
+  hisui::webm::input::Index index({track}, 0, 1000000);
+  index.addClusterFrames(
+      [&segment](const std::int64_t pos, const std::size_t size) {
+        return static_cast<std::size_t>(pos) + size <= std::size(segment)
+                   ? std::data(segment) + pos
+                   : nullptr;
+      },
+      0, static_cast<std::int64_t>(std::size(segment)));
+  index.updateDurationByFrames();
+  const hisui::webm::input::MappedReader reader(path.string());
+  index.save(cache_directory.string(), path.string(), reader.getSize(),
+             reader.getVersion());
+}
+
+// 20 ms ごとの packet. start_ms から count 個
+std::vector<Packet> make_packets(const std::int16_t start_ms,
+                                 const unsigned char count) {
+  std::vector<Packet> packets;
+  for (unsigned char i = 0; i < count; ++i) {
+    packets.push_back(
+        {.timestamp_ms = static_cast<std::int16_t>(start_ms + 20 * i),
+         .data = make_packet(TOC_20MS, i)});
+  }
+  return packets;
+}
+
+Bytes to_bytes(const std::uint8_t* data, const std::size_t size) {
+  return Bytes(data, data + size);
+}
+
+struct Fixture {
+  Fixture()
+      : directory(std::filesystem::temp_directory_path() /
+                  "hisui_opus_passthrough_test") {
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    hisui::webm::input::Demuxer::setIndexCacheDirectory(
+        (directory / "cache").string());
+  }
+
+  ~Fixture() {
+    hisui::webm::input::Demuxer::setIndexCacheDirectory("");
+    std::filesystem::remove_all(directory);
+  }
+
+  const std::filesystem::path directory;
+};
+
+}  // namespace
+
+BOOST_FIXTURE_TEST_SUITE(opus_passthrough, Fixture)
+
+BOOST_AUTO_TEST_CASE(webm_source_passes_aligned_packets) {
+  const auto path = directory / "aligned.webm";
+  auto packets = make_packets(0, 3);
+  // 10 ms のフレームは出力の 20 ms のフレームに使えない
+  packets.push_back({.timestamp_ms = 60, .data = make_packet(TOC_10MS, 3)});
+  write_webm(path, directory / "cache", packets);
+
+  hisui::audio::WebMSource source(path.string());
+  const std::uint8_t* packet = nullptr;
+  std::size_t size = 0;
+  BOOST_REQUIRE(source.getPacket(&packet, &size, 0, 960));
+  BOOST_REQUIRE(to_bytes(packet, size) == packets[0].data);
+  BOOST_REQUIRE(source.getPacket(&packet, &size, 960, 960));
+  BOOST_REQUIRE(to_bytes(packet, size) == packets[1].data);
+
+  // 次のフレームは 1920 から始まるので, 半分以上ずれていれば使わない
+  BOOST_REQUIRE(!source.getPacket(&packet, &size, 2880, 960));
+  BOOST_REQUIRE(source.getPacket(&packet, &size, 1920 + 400, 960));
+  BOOST_REQUIRE(to_bytes(packet, size) == packets[2].data);
+
+  BOOST_REQUIRE(!source.getPacket(&packet, &size, 2880, 960));
+  // 読んでしまった 10 ms のフレームはデコードして使う
+  std::vector<std::int16_t> samples(480 * 2);
+  source.getSamples(std::data(samples), 2880, 480);
+  BOOST_REQUIRE(!source.getPacket(&packet, &size, 3360, 960));
+}
+
+BOOST_AUTO_TEST_CASE(webm_source_needs_48khz) {
+  const auto path = directory / "16khz.webm";
+  write_webm(path, directory / "cache", make_packets(0, 2));
+
+  hisui::audio::WebMSource source(path.string(), 16000);
+  const std::uint8_t* packet = nullptr;
+  std::size_t size = 0;
+  BOOST_REQUIRE(!source.getPacket(&packet, &size, 0, 320));
+}
+
+// 他の source と重なっている区間では, デコードしてミックスする
+BOOST_AUTO_TEST_CASE(sequencer_passes_only_one_active_source) {
+  const auto first = directory / "first.webm";
+  const auto second = directory / "second.webm";
+  write_webm(first, directory / "cache", make_packets(0, 50));
+  write_webm(second, directory / "cache", make_packets(0, 50));
+  const std::vector<hisui::ArchiveItem> archives = {
+      hisui::ArchiveItem(first, "first", 0.0, 1.0),
+      hisui::ArchiveItem(second, "second", 0.5, 1.5)};
+
+  hisui::audio::BasicSequencer sequencer(archives);
+  const std::uint8_t* packet = nullptr;
+  std::size_t size = 0;
+  BOOST_REQUIRE(sequencer.getPacket(&packet, &size, 0, 960));
+  BOOST_REQUIRE(to_bytes(packet, size) == make_packet(TOC_20MS, 0));
+  BOOST_REQUIRE(!sequencer.getPacket(&packet, &size, 24000, 960));
+  // second の区間の中の位置を渡す
+  std::vector<const std::int16_t*> blocks;
+  for (std::uint64_t p = 24000; p < 48000; p += 960) {
+    sequencer.getSamples(&blocks, p, 960);
+  }
+  BOOST_REQUIRE(sequencer.getPacket(&packet, &size, 48000, 960));
+  BOOST_REQUIRE(to_bytes(packet, size) == make_packet(TOC_20MS, 25));
+
+  // 並列にデコードする場合は使わない
+  hisui::audio::BasicSequencer parallel_sequencer(archives, 2);
+  BOOST_REQUIRE(!parallel_sequencer.getPacket(&packet, &size, 0, 960));
+}
+
+BOOST_AUTO_TEST_CASE(encoder_writes_packets_between_frames) {
+  hisui::FrameQueue queue;
+  hisui::audio::BufferOpusEncoder encoder(&queue, {.bit_rate = 64000});
+  const std::vector<std::int16_t> samples(960 * 2, 1000);
+  const auto packet = make_packet(TOC_20MS, 1);
+
+  encoder.addSamples(std::data(samples), 960);
+  encoder.addPacket(std::data(packet), std::size(packet));
+  encoder.addSamples(std::data(samples), 960);
+  BOOST_REQUIRE_EQUAL(3, queue.size());
+
+  // 出力のタイムスタンプは 20 ms ごとに続く
+  const std::vector<std::uint64_t> timestamps = {0, 20000000, 40000000};
+  for (std::size_t i = 0; i < std::size(timestamps); ++i) {
+    const auto frame = queue.front();
+    BOOST_REQUIRE(frame);
+    BOOST_REQUIRE_EQUAL(timestamps[i], frame->timestamp);
+    if (i == 1) {
+      BOOST_REQUIRE(to_bytes(frame->data.get(), frame->data_size) == packet);
+    }
+    queue.pop();
+  }
+
+  // フレームの途中には入れられない
+  encoder.addSamples(std::data(samples), 480);
+  BOOST_REQUIRE_THROW(encoder.addPacket(std::data(packet), std::size(packet)),
+                      std::logic_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
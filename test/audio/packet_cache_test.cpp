@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "archive_item.hpp"
+#include "audio/packet_cache.hpp"
+#include "frame.hpp"
+#include "frame_buffer_pool.hpp"
+
+namespace {
+
+std::filesystem::path make_directory(const std::string& name) {
+  const auto directory = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  return directory;
+}
+
+hisui::Frame make_frame(const std::uint64_t timestamp,
+                        const std::string& data,
+                        const bool is_key) {
+  auto buffer = hisui::FrameBufferPool::getInstance().acquire(
+      std::max<std::size_t>(std::size(data), 1));
+  std::memcpy(buffer.get(), std::data(data), std::size(data));
+  return hisui::Frame{.timestamp = timestamp,
+                      .data = buffer,
+                      .data_size = std::size(data),
+                      .is_key = is_key};
+}
+
+std::string frame_data(const hisui::Frame& frame) {
+  return std::string(reinterpret_cast<const char*>(frame.data.get()),
+                     frame.data_size);
+}
+
+void record_frames(const std::filesystem::path& directory,
+                   const std::string& key) {
+  hisui::audio::PacketCache cache(directory.string(), key);
+  cache.startRecording();
+  cache.record(make_frame(0, "first", true));
+  // 空のパケットも残す
+  cache.record(make_frame(20000000, "", true));
+  cache.record(make_frame(40000000, "third", false));
+  cache.commit();
+}
+
+std::size_t count_files(const std::filesystem::path& directory) {
+  return static_cast<std::size_t>(
+      std::distance(std::filesystem::directory_iterator(directory),
+                    std::filesystem::directory_iterator()));
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(packet_cache)
+
+BOOST_AUTO_TEST_CASE(round_trip) {
+  const auto directory = make_directory("hisui_packet_cache_round_trip");
+  const std::string key = "archives\nopus 48000 65536";
+  BOOST_REQUIRE(!hisui::audio::PacketCache(directory.string(), key).load());
+
+  record_frames(directory, key);
+  BOOST_REQUIRE_EQUAL(1, count_files(directory));
+
+  const auto frames =
+      hisui::audio::PacketCache(directory.string(), key).load();
+  BOOST_REQUIRE(frames);
+  BOOST_REQUIRE_EQUAL(3, std::size(*frames));
+  BOOST_REQUIRE_EQUAL(0, (*frames)[0].timestamp);
+  BOOST_REQUIRE_EQUAL("first", frame_data((*frames)[0]));
+  BOOST_REQUIRE((*frames)[0].is_key);
+  BOOST_REQUIRE_EQUAL(20000000, (*frames)[1].timestamp);
+  BOOST_REQUIRE_EQUAL(0, (*frames)[1].data_size);
+  BOOST_REQUIRE_EQUAL(40000000, (*frames)[2].timestamp);
+  BOOST_REQUIRE_EQUAL("third", frame_data((*frames)[2]));
+  BOOST_REQUIRE(!(*frames)[2].is_key);
+
+  // 設定が変われば別の key になり, 保存したパケットは使わない
+  BOOST_REQUIRE(!hisui::audio::PacketCache(directory.string(),
+                                           "archives\nopus 48000 32768")
+                     .load());
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(not_committed) {
+  const auto directory = make_directory("hisui_packet_cache_not_committed");
+  {
+    hisui::audio::PacketCache cache(directory.string(), "key");
+    cache.startRecording();
+    cache.record(make_frame(0, "first", true));
+    // 途中で合成に失敗した
+  }
+  BOOST_REQUIRE_EQUAL(0, count_files(directory));
+  BOOST_REQUIRE(!hisui::audio::PacketCache(directory.string(), "key").load());
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(broken) {
+  const auto directory = make_directory("hisui_packet_cache_broken");
+  record_frames(directory, "key");
+  const auto path = std::filesystem::directory_iterator(directory)->path();
+
+  // 末尾の終わりを表す tag が無い
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  BOOST_REQUIRE(!hisui::audio::PacketCache(directory.string(), "key").load());
+
+  // 書式の版が違う
+  record_frames(directory, "key");
+  {
+    std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(8);
+    fs.put(static_cast<char>(0x7F));
+  }
+  BOOST_REQUIRE(!hisui::audio::PacketCache(directory.string(), "key").load());
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(archives_key) {
+  const auto directory = make_directory("hisui_packet_cache_archives_key");
+  const auto path = directory / "input.webm";
+  {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs << "webm";
+  }
+  const std::vector<hisui::ArchiveItem> archives = {
+      hisui::ArchiveItem(path, "connection", 1.0, 2.0)};
+  const auto key = hisui::audio::make_archives_key(archives);
+  BOOST_REQUIRE(!std::empty(key));
+  BOOST_REQUIRE_EQUAL(key, hisui::audio::make_archives_key(archives));
+
+  // 区間が変わった
+  BOOST_REQUIRE_NE(key,
+                   hisui::audio::make_archives_key(
+                       {hisui::ArchiveItem(path, "connection", 1.0, 3.0)}));
+  // 入力ファイルが書き換えられた
+  std::filesystem::last_write_time(
+      path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+  BOOST_REQUIRE_NE(key, hisui::audio::make_archives_key(archives));
+
+  // 内容が変わったか確かめられない
+  BOOST_REQUIRE(std::empty(hisui::audio::make_archives_key(
+      {hisui::ArchiveItem("https://example.com/input.webm", "connection", 0.0,
+                          1.0)})));
+  BOOST_REQUIRE(std::empty(hisui::audio::make_archives_key(
+      {hisui::ArchiveItem(directory / "missing.webm", "connection", 0.0,
+                          1.0)})));
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "audio/pcm_writer.hpp"
+
+namespace {
+
+std::vector<char> read_file(const std::filesystem::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(ifs),
+          std::istreambuf_iterator<char>()};
+}
+
+std::uint32_t get_uint32(const std::vector<char>& data,
+                         const std::size_t offset) {
+  std::uint32_t value = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(
+                 data[offset + i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+std::vector<std::int16_t> get_samples(const std::vector<char>& data,
+                                      const std::size_t offset) {
+  std::vector<std::int16_t> samples;
+  for (std::size_t i = offset; i + 1 < std::size(data); i += 2) {
+    samples.push_back(static_cast<std::int16_t>(
+        static_cast<unsigned char>(data[i]) |
+        (static_cast<unsigned char>(data[i + 1]) << 8)));
+  }
+  return samples;
+}
+
+// 1 kHz と 12 kHz を足した 48 kHz の stereo の sample
+std::vector<std::int16_t> make_samples(const std::size_t n) {
+  std::vector<std::int16_t> samples;
+  for (std::size_t i = 0; i < n; ++i) {
+    const double t = static_cast<double>(i) / 48000;
+    const auto value = static_cast<std::int16_t>(
+        8000 * std::sin(2 * std::numbers::pi * 1000 * t) +
+        8000 * std::sin(2 * std::numbers::pi * 12000 * t));
+    samples.push_back(value);
+    samples.push_back(value);
+  }
+  return samples;
+}
+
+double get_rms(const std::vector<std::int16_t>& samples,
+               const std::size_t margin) {
+  double sum = 0;
+  for (std::size_t i = margin; i < std::size(samples) - margin; ++i) {
+    sum += static_cast<double>(samples[i]) * samples[i];
+  }
+  return std::sqrt(sum / static_cast<double>(std::size(samples) - 2 * margin));
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(pcm_writer)
+
+BOOST_AUTO_TEST_CASE(wav) {
+  const auto path = std::filesystem::temp_directory_path() /
+                    "hisui_pcm_writer_test.wav";
+  const auto samples = make_samples(48000);
+  {
+    hisui::audio::PCMWriter writer(path.string(), {});
+    for (std::size_t i = 0; i < 48000; i += 960) {
+      writer.addSamples(std::data(samples) + 2 * i, 960);
+    }
+    writer.flush();
+  }
+  const auto data = read_file(path);
+  std::filesystem::remove(path);
+
+  BOOST_REQUIRE_EQUAL(44 + 48000 * 4, std::size(data));
+  BOOST_REQUIRE_EQUAL("RIFF", std::string(std::data(data), 4));
+  BOOST_REQUIRE_EQUAL(36 + 48000 * 4, get_uint32(data, 4));
+  BOOST_REQUIRE_EQUAL(48000, get_uint32(data, 24));
+  BOOST_REQUIRE_EQUAL(48000 * 4, get_uint32(data, 40));
+  BOOST_REQUIRE(samples == get_samples(data, 44));
+}
+
+BOOST_AUTO_TEST_CASE(raw_decimated_mono) {
+  const auto path = std::filesystem::temp_directory_path() /
+                    "hisui_pcm_writer_test.pcm";
+  const auto samples = make_samples(48000);
+  {
+    hisui::audio::PCMWriter writer(
+        path.string(), {.out_sample_rate = 16000, .channels = 1, .wav = false});
+    for (std::size_t i = 0; i < 48000; i += 960) {
+      writer.addSamples(std::data(samples) + 2 * i, 960);
+    }
+    writer.flush();
+  }
+  const auto output = get_samples(read_file(path), 0);
+  std::filesystem::remove(path);
+
+  BOOST_REQUIRE_EQUAL(16000, std::size(output));
+  // 8 kHz を超える 12 kHz は取り除かれ, 1 kHz のみが残る
+  BOOST_REQUIRE_CLOSE(8000 / std::numbers::sqrt2, get_rms(output, 100), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_sample_rate) {
+  const auto path = std::filesystem::temp_directory_path() /
+                    "hisui_pcm_writer_test.wav";
+  BOOST_REQUIRE_THROW(
+      hisui::audio::PCMWriter(path.string(), {.out_sample_rate = 32000}),
+      std::invalid_argument);
+  std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+#!/usr/bin/env bash
+# 合成のベンチマーク用に, 合成の入力となる録画ファイルとメタデータ, レイアウトを生成する
+#
+# usage: generate_input.bash <output_dir> <codec> <participants> <duration> <resolution>
+#   codec: VP8, VP9, AV1, H264
+#   duration: 秒
+#   resolution: 640x480 のような 幅x高さ
+set -eu
+
+if [ $# -ne 5 ]; then
+  echo "usage: $0 <output_dir> <codec> <participants> <duration> <resolution>" >&2
+  exit 1
+fi
+
+OUTPUT_DIR=$1
+CODEC=$2
+PARTICIPANTS=$3
+DURATION=$4
+RESOLUTION=$5
+
+case "$CODEC" in
+  VP8 ) ENCODER="-c:v libvpx -deadline realtime -cpu-used 8" ;;
+  VP9 ) ENCODER="-c:v libvpx-vp9 -deadline realtime -cpu-used 8 -row-mt 1" ;;
+  AV1 ) ENCODER="-c:v libsvtav1 -preset 12" ;;
+  H264 ) ENCODER="-c:v libx264 -preset ultrafast -profile:v baseline" ;;
+  * )
+    echo "unsupported codec: $CODEC" >&2
+    exit 1
+    ;;
+esac
+
+mkdir -p "$OUTPUT_DIR"
+OUTPUT_DIR=$(cd "$OUTPUT_DIR" && pwd)
+
+# 1 人分の録画を生成し, 参加者ごとには同じファイルを参照させる.
+# 参加者ごとに内容が違っても, デコードと合成にかかる時間はほとんど変わらない
+ARCHIVE=$OUTPUT_DIR/archive.webm
+if [ ! -f "$ARCHIVE" ]; then
+  # H.264 は WebM の仕様にないため, Sora と同じく Matroska として書き出す
+  # shellcheck disable=SC2086
+  ffmpeg -hide_banner -loglevel error -y \
+    -f lavfi -i "testsrc2=size=${RESOLUTION}:rate=30:duration=${DURATION}" \
+    -f lavfi -i "sine=frequency=440:sample_rate=48000:duration=${DURATION}" \
+    $ENCODER -b:v 1M -g 300 -pix_fmt yuv420p \
+    -c:a libopus -b:a 64k -ac 2 \
+    -f matroska "$ARCHIVE.tmp"
+  mv "$ARCHIVE.tmp" "$ARCHIVE"
+fi
+
+# 参加者の半分は途中から参加して途中で退出させ, 同時に表示する数を変化させる
+archive_interval() {
+  local i=$1
+  if [ $((i % 2)) -eq 0 ]; then
+    echo "0 $DURATION"
+  else
+    echo "$((DURATION / 4)) $((DURATION * 3 / 4))"
+  fi
+}
+
+{
+  echo '{'
+  echo '  "recording_id": "benchmark",'
+  echo '  "created_at": 1617259968,'
+  echo '  "archives": ['
+  for i in $(seq 1 "$PARTICIPANTS"); do
+    read -r start stop <<< "$(archive_interval "$i")"
+    [ "$i" -eq 1 ] || echo '    },'
+    echo '    {'
+    echo "      \"connection_id\": \"$i\","
+    echo "      \"file_path\": \"$ARCHIVE\","
+    echo "      \"start_time_offset\": $start,"
+    echo "      \"stop_time_offset\": $stop"
+  done
+  echo '    }'
+  echo '  ]'
+  echo '}'
+} > "$OUTPUT_DIR/metadata.json"
+
+for i in $(seq 1 "$PARTICIPANTS"); do
+  read -r start stop <<< "$(archive_interval "$i")"
+  cat > "$OUTPUT_DIR/archive-$i.json" <<EOS
+{
+  "connection_id": "$i",
+  "file_path": "$ARCHIVE",
+  "filename": "archive.webm",
+  "start_time": $start,
+  "stop_time": $stop
+}
+EOS
+done
+
+cat > "$OUTPUT_DIR/layout.json" <<EOS
+{
+  "audio_sources": [ "archive-*.json" ],
+  "bitrate": 1000,
+  "format": "webm",
+  "resolution": "1280x720",
+  "trim": false,
+  "video_layout": {
+    "grid": {
+      "cells_excluded": [],
+      "height": 0,
+      "max_columns": 0,
+      "max_rows": 0,
+      "reuse": "show_oldest",
+      "video_sources": [ "archive-*.json" ],
+      "video_sources_excluded": [],
+      "width": 0,
+      "x_pos": 0,
+      "y_pos": 0,
+      "z_pos": 0
+    }
+  }
+}
+EOS
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+# 生成した入力を合成方法とコーデックの組み合わせごとに合成し, 結果を TSV で追記する
+#
+# usage: run.bash <hisui> <input_dir> <results_file> <output_codecs> <composers>
+#   output_codecs: "VP8 VP9 AV1" のような空白区切りの出力映像コーデック
+#   composers: "grid parallel-grid layout" のような空白区切りの合成方法.
+#              layout の場合は --layout で合成する
+# 入力の情報は generate_input.bash で生成した input_dir の名前から取る
+set -eu
+
+if [ $# -ne 5 ]; then
+  echo "usage: $0 <hisui> <input_dir> <results_file> <output_codecs> <composers>" >&2
+  exit 1
+fi
+
+# hisui には --openh264 などのオプションを含めてよい
+read -ra HISUI <<< "$1"
+INPUT_DIR=$2
+RESULTS_FILE=$3
+OUTPUT_CODECS=$4
+COMPOSERS=$5
+
+# input_dir は <codec>_<participants>_<duration>_<resolution>
+IFS=_ read -r INPUT_CODEC PARTICIPANTS DURATION RESOLUTION <<< "$(basename "$INPUT_DIR")"
+
+if [ ! -f "$RESULTS_FILE" ]; then
+  printf 'input_codec\tparticipants\tduration\tresolution\tcomposer\toutput_codec\twall_time\trealtime_factor\tpeak_rss_kib\toutput_size\n' > "$RESULTS_FILE"
+fi
+
+OUTPUT_FILE=$(mktemp --suffix=.webm)
+TIME_FILE=$(mktemp)
+trap 'rm -f "$OUTPUT_FILE" "$TIME_FILE"' EXIT
+
+for composer in $COMPOSERS; do
+  for codec in $OUTPUT_CODECS; do
+    echo "${INPUT_CODEC} participants=${PARTICIPANTS} duration=${DURATION} resolution=${RESOLUTION} composer=${composer} codec=${codec}" >&2
+    if [ "$composer" = layout ]; then
+      args=(--layout "$INPUT_DIR/layout.json")
+    else
+      args=(-f "$INPUT_DIR/metadata.json" --video-composer "$composer")
+    fi
+    /usr/bin/time -f '%e %M' -o "$TIME_FILE" \
+      "${HISUI[@]}" "${args[@]}" --out-file "$OUTPUT_FILE" \
+      --out-video-codec "$codec" --show-progress-bar false --log-level error
+    read -r wall_time peak_rss_kib < "$TIME_FILE"
+    realtime_factor=$(awk -v d="$DURATION" -v w="$wall_time" 'BEGIN { printf "%.2f", (w > 0 ? d / w : 0) }')
+    output_size=$(stat -c %s "$OUTPUT_FILE")
+    printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n' \
+      "$INPUT_CODEC" "$PARTICIPANTS" "$DURATION" "$RESOLUTION" "$composer" \
+      "$codec" "$wall_time" "$realtime_factor" "$peak_rss_kib" \
+      "$output_size" >> "$RESULTS_FILE"
+  done
+done
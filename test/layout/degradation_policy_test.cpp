@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "constants.hpp"
+#include "layout/degradation_policy.hpp"
+#include "layout/region.hpp"
+
+namespace {
+
+std::shared_ptr<hisui::layout::Region> make_region(
+    const std::int32_t priority) {
+  return std::make_shared<hisui::layout::Region>(
+      hisui::layout::RegionParameters{.name = "region",
+                                      .pos = {.x = 0, .y = 0},
+                                      .z_pos = 0,
+                                      .resolution = {.width = 320,
+                                                     .height = 240},
+                                      .max_columns = 0,
+                                      .max_rows = 0,
+                                      .reuse = hisui::layout::Reuse::None,
+                                      .priority = priority});
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(degradation_policy)
+
+BOOST_AUTO_TEST_CASE(build_steps) {
+  const std::vector<std::shared_ptr<hisui::layout::Region>> regions = {
+      make_region(1), make_region(0), make_region(2), make_region(0)};
+  hisui::layout::DegradationPolicy policy({
+      .regions = regions,
+      .target_realtime_factor = 1.0,
+      .set_encoder_speed_boost = [](const bool) { return true; },
+  });
+  const auto& steps = policy.getSteps();
+  // cell が無いので KeyFramesOnly は含まない. 最も高い priority 2 は対象としない
+  BOOST_REQUIRE_EQUAL(3, std::size(steps));
+  BOOST_CHECK(hisui::layout::DegradationAction::FrameRate == steps[0].action);
+  BOOST_CHECK_EQUAL(0, steps[0].priority);
+  BOOST_CHECK(hisui::layout::DegradationAction::FrameRate == steps[1].action);
+  BOOST_CHECK_EQUAL(1, steps[1].priority);
+  BOOST_CHECK(hisui::layout::DegradationAction::EncoderSpeed ==
+              steps[2].action);
+}
+
+BOOST_AUTO_TEST_CASE(update) {
+  const std::vector<std::shared_ptr<hisui::layout::Region>> regions = {
+      make_region(0), make_region(1)};
+  std::vector<bool> boosts;
+  hisui::layout::DegradationPolicy policy({
+      .regions = regions,
+      .target_realtime_factor = 1.0,
+      .set_encoder_speed_boost =
+          [&boosts](const bool is_boosted) {
+            boosts.push_back(is_boosted);
+            return true;
+          },
+  });
+  BOOST_REQUIRE_EQUAL(2, std::size(policy.getSteps()));
+
+  constexpr std::uint64_t s = hisui::Constants::NANO_SECOND;
+  auto now = std::chrono::steady_clock::now();
+  policy.update(0, now);
+  // 2 秒分を 4 秒かけて合成した
+  now += std::chrono::seconds(4);
+  policy.update(1 * s, now);
+  BOOST_CHECK_EQUAL(0, policy.getLevel());
+  policy.update(2 * s, now);
+  BOOST_CHECK_EQUAL(1, policy.getLevel());
+  BOOST_CHECK(std::empty(boosts));
+
+  now += std::chrono::seconds(4);
+  policy.update(4 * s, now);
+  BOOST_CHECK_EQUAL(2, policy.getLevel());
+  BOOST_REQUIRE_EQUAL(1, std::size(boosts));
+  BOOST_CHECK(boosts[0]);
+
+  // 以降の段階は無い
+  now += std::chrono::seconds(4);
+  policy.update(6 * s, now);
+  BOOST_CHECK_EQUAL(2, policy.getLevel());
+
+  // 目標を少し上回るだけでは戻さない
+  now += std::chrono::milliseconds(1600);
+  policy.update(8 * s, now);
+  BOOST_CHECK_EQUAL(2, policy.getLevel());
+
+  now += std::chrono::seconds(1);
+  policy.update(10 * s, now);
+  BOOST_CHECK_EQUAL(1, policy.getLevel());
+  BOOST_REQUIRE_EQUAL(2, std::size(boosts));
+  BOOST_CHECK(!boosts[1]);
+
+  now += std::chrono::seconds(1);
+  policy.update(12 * s, now);
+  BOOST_CHECK_EQUAL(0, policy.getLevel());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
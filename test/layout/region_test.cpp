@@ -238,20 +238,23 @@ BOOST_AUTO_TEST_CASE(set_video_source_to_cells_cell_2_reuse_none) {
           .resolution = {.width = 240, .height = 160},
       }));
 
-  hisui::layout::set_video_source_to_cells({.video_source = video_source0,
-                                            .reuse = hisui::layout::Reuse::None,
-                                            .cells = cells});
+  BOOST_REQUIRE(hisui::layout::set_video_source_to_cells(
+      {.video_source = video_source0,
+       .reuse = hisui::layout::Reuse::None,
+       .cells = cells}));
   BOOST_REQUIRE_EQUAL(30, cells[0]->getEndTime());
 
-  hisui::layout::set_video_source_to_cells({.video_source = video_source1,
-                                            .reuse = hisui::layout::Reuse::None,
-                                            .cells = cells});
+  BOOST_REQUIRE(hisui::layout::set_video_source_to_cells(
+      {.video_source = video_source1,
+       .reuse = hisui::layout::Reuse::None,
+       .cells = cells}));
   BOOST_REQUIRE_EQUAL(30, cells[0]->getEndTime());
   BOOST_REQUIRE_EQUAL(40, cells[1]->getEndTime());
 
-  hisui::layout::set_video_source_to_cells({.video_source = video_source2,
-                                            .reuse = hisui::layout::Reuse::None,
-                                            .cells = cells});
+  BOOST_REQUIRE(!hisui::layout::set_video_source_to_cells(
+      {.video_source = video_source2,
+       .reuse = hisui::layout::Reuse::None,
+       .cells = cells}));
   BOOST_REQUIRE_EQUAL(30, cells[0]->getEndTime());
   BOOST_REQUIRE_EQUAL(40, cells[1]->getEndTime());
 }
@@ -50,4 +50,45 @@ BOOST_AUTO_TEST_CASE(metadata_adjust_time_offsets) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(metadata_append) {
+  hisui::Metadata metadata({
+      {"dummy", "connection_id", 0, 10},
+      {"dummy", "connection_id", 5, 20},
+  });
+  metadata.append(hisui::Metadata({
+      {"dummy", "connection_id", 0, 30},
+      {"dummy", "connection_id", 2, 12},
+  }));
+  BOOST_REQUIRE_EQUAL(0, metadata.getMinStartTimeOffset());
+  BOOST_REQUIRE_CLOSE(50, metadata.getMaxStopTimeOffset(), 0.00001);
+  auto archives = metadata.getArchiveItems();
+  BOOST_REQUIRE_EQUAL(4, std::size(archives));
+  BOOST_REQUIRE_CLOSE(20, archives[2].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(50, archives[2].getStopTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(22, archives[3].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(32, archives[3].getStopTimeOffset(), 0.00001);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_set_trim) {
+  hisui::MetadataSet metadata_set(hisui::Metadata({
+      {"dummy", "connection_id", 5, 10},
+      {"dummy", "connection_id", 8, 12},
+      {"dummy", "connection_id", 20, 30},
+      {"dummy", "connection_id", 25, 28},
+  }));
+  metadata_set.trim();
+  // [0, 5) と [12, 20) を除く
+  BOOST_REQUIRE_CLOSE(17, metadata_set.getMaxStopTimeOffset(), 0.00001);
+  auto archives = metadata_set.getArchiveItems();
+  BOOST_REQUIRE_EQUAL(4, std::size(archives));
+  BOOST_REQUIRE_CLOSE(0, archives[0].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(5, archives[0].getStopTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(3, archives[1].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(7, archives[1].getStopTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(7, archives[2].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(17, archives[2].getStopTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(12, archives[3].getStartTimeOffset(), 0.00001);
+  BOOST_REQUIRE_CLOSE(15, archives[3].getStopTimeOffset(), 0.00001);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,415 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "constants.hpp"
+#include "muxer/fragmented_mp4.hpp"
+
+namespace {
+
+// 箱のヘッダーの後に続く sample entry の共通部分の大きさ
+constexpr std::size_t VISUAL_SAMPLE_ENTRY_SIZE = 8 + 78;
+constexpr std::size_t AUDIO_SAMPLE_ENTRY_SIZE = 8 + 28;
+
+std::uint16_t get_u16(const std::vector<std::uint8_t>& buffer,
+                      const std::size_t offset) {
+  return static_cast<std::uint16_t>((buffer.at(offset) << 8) |
+                                    buffer.at(offset + 1));
+}
+
+std::uint32_t get_u32(const std::vector<std::uint8_t>& buffer,
+                      const std::size_t offset) {
+  return (static_cast<std::uint32_t>(get_u16(buffer, offset)) << 16) |
+         get_u16(buffer, offset + 2);
+}
+
+std::uint64_t get_u64(const std::vector<std::uint8_t>& buffer,
+                      const std::size_t offset) {
+  return (static_cast<std::uint64_t>(get_u32(buffer, offset)) << 32) |
+         get_u32(buffer, offset + 4);
+}
+
+std::string get_type(const std::vector<std::uint8_t>& buffer,
+                     const std::size_t offset) {
+  return std::string(reinterpret_cast<const char*>(&buffer.at(offset + 4)), 4);
+}
+
+std::size_t get_end(const std::vector<std::uint8_t>& buffer,
+                    const std::size_t offset) {
+  return offset + get_u32(buffer, offset);
+}
+
+// [begin, end) に並んだ箱から type を探して, その先頭の位置を返す
+std::size_t find_box(const std::vector<std::uint8_t>& buffer,
+                     std::size_t begin,
+                     const std::size_t end,
+                     const std::string_view type) {
+  while (begin + 8 <= end) {
+    if (get_type(buffer, begin) == type) {
+      return begin;
+    }
+    const auto size = get_u32(buffer, begin);
+    if (size < 8) {
+      break;
+    }
+    begin += size;
+  }
+  throw std::runtime_error(std::string(type) + " is not found");
+}
+
+// 子の箱だけを持つ箱をたどる
+std::size_t find_box(const std::vector<std::uint8_t>& buffer,
+                     const std::initializer_list<std::string_view> path) {
+  std::size_t begin = 0;
+  std::size_t end = std::size(buffer);
+  std::size_t offset = 0;
+  for (const auto type : path) {
+    offset = find_box(buffer, begin, end, type);
+    begin = offset + 8;
+    end = get_end(buffer, offset);
+  }
+  return offset;
+}
+
+std::vector<std::uint8_t> make_key_frame(const std::uint8_t profile_idc) {
+  return {0, 0, 0, 1, 0x67, profile_idc, 0, 40, 0xac, 0x2b,  // SPS
+          0, 0, 0, 1, 0x68, 0xee, 0x3c, 0x80,                // PPS
+          0, 0, 1,    0x65, 0x88, 0x84, 0x00};               // IDR
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(fragmented_mp4)
+
+BOOST_AUTO_TEST_CASE(init_segment) {
+  const std::vector<hisui::muxer::FragmentedMP4Track> tracks{
+      {.track_id = 1,
+       .timescale = 48000,
+       .is_video = false,
+       .sample_entry = hisui::muxer::make_opus_sample_entry(312)},
+      {.track_id = 3,
+       .timescale = 90000,
+       .is_video = true,
+       .width = 1280,
+       .height = 720,
+       .sample_entry = hisui::muxer::make_vpx_sample_entry(
+           hisui::Constants::VP9_FOURCC, 1280, 720)},
+  };
+  const auto buffer =
+      hisui::muxer::make_fragmented_mp4_init_segment(tracks, 12345);
+
+  BOOST_REQUIRE_EQUAL("ftyp", get_type(buffer, 0));
+  BOOST_REQUIRE_EQUAL("iso6", get_type(buffer, 4));
+
+  const auto mvhd = find_box(buffer, {"moov", "mvhd"});
+  BOOST_REQUIRE_EQUAL(108, get_u32(buffer, mvhd));
+  BOOST_REQUIRE_EQUAL(0, get_u32(buffer, mvhd + 8));
+  BOOST_REQUIRE_EQUAL(1000, get_u32(buffer, mvhd + 20));
+  BOOST_REQUIRE_EQUAL(0, get_u32(buffer, mvhd + 24));
+  BOOST_REQUIRE_EQUAL(0x00010000, get_u32(buffer, mvhd + 28));
+  BOOST_REQUIRE_EQUAL(0x0100, get_u16(buffer, mvhd + 32));
+  // next_track_id は最も大きい track_id の次
+  BOOST_REQUIRE_EQUAL(4, get_u32(buffer, mvhd + 104));
+
+  const auto moov = find_box(buffer, {"moov"});
+  const auto audio_trak = find_box(buffer, moov + 8, get_end(buffer, moov),
+                                   "trak");
+  const auto video_trak =
+      find_box(buffer, get_end(buffer, audio_trak), get_end(buffer, moov),
+               "trak");
+  const auto audio_tkhd = find_box(buffer, audio_trak + 8,
+                                   get_end(buffer, audio_trak), "tkhd");
+  const auto video_tkhd = find_box(buffer, video_trak + 8,
+                                   get_end(buffer, video_trak), "tkhd");
+  for (const auto tkhd : {audio_tkhd, video_tkhd}) {
+    BOOST_REQUIRE_EQUAL(92, get_u32(buffer, tkhd));
+    // track_enabled | track_in_movie
+    BOOST_REQUIRE_EQUAL(0x00000003, get_u32(buffer, tkhd + 8));
+  }
+  BOOST_REQUIRE_EQUAL(1, get_u32(buffer, audio_tkhd + 20));
+  BOOST_REQUIRE_EQUAL(0x0100, get_u16(buffer, audio_tkhd + 44));
+  BOOST_REQUIRE_EQUAL(0, get_u32(buffer, audio_tkhd + 84));
+  BOOST_REQUIRE_EQUAL(3, get_u32(buffer, video_tkhd + 20));
+  BOOST_REQUIRE_EQUAL(0, get_u16(buffer, video_tkhd + 44));
+  BOOST_REQUIRE_EQUAL(1280U << 16, get_u32(buffer, video_tkhd + 84));
+  BOOST_REQUIRE_EQUAL(720U << 16, get_u32(buffer, video_tkhd + 88));
+
+  const auto video_mdhd = find_box(
+      buffer, find_box(buffer, video_trak + 8, get_end(buffer, video_trak),
+                       "mdia") +
+                  8,
+      get_end(buffer, video_trak), "mdhd");
+  BOOST_REQUIRE_EQUAL(90000, get_u32(buffer, video_mdhd + 20));
+
+  const auto mehd = find_box(buffer, {"moov", "mvex", "mehd"});
+  BOOST_REQUIRE_EQUAL(0x01000000, get_u32(buffer, mehd + 8));
+  BOOST_REQUIRE_EQUAL(12345, get_u64(buffer, mehd + 12));
+  const auto trex = find_box(buffer, {"moov", "mvex", "trex"});
+  BOOST_REQUIRE_EQUAL(1, get_u32(buffer, trex + 12));
+  BOOST_REQUIRE_EQUAL(3, get_u32(buffer, get_end(buffer, trex) + 12));
+
+  // 全体の長さが分からなければ mehd を書かない
+  const auto without_duration =
+      hisui::muxer::make_fragmented_mp4_init_segment(tracks);
+  BOOST_REQUIRE_THROW(find_box(without_duration, {"moov", "mvex", "mehd"}),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(fragment_with_defaults) {
+  // 全てのサンプルで duration, size, flags が同じ場合は tfhd の default で表す
+  const std::vector<hisui::muxer::FragmentedMP4Sample> samples{
+      {.duration = 960, .size = 3, .is_key = true},
+      {.duration = 960, .size = 3, .is_key = true},
+  };
+  const std::vector<std::uint8_t> data{1, 2, 3, 4, 5, 6};
+  const auto buffer = hisui::muxer::make_fragmented_mp4_fragment(
+      7, {{.track_id = 1,
+           .base_media_decode_time = 48000,
+           .samples = samples,
+           .data = data}});
+
+  const auto mfhd = find_box(buffer, {"moof", "mfhd"});
+  BOOST_REQUIRE_EQUAL(7, get_u32(buffer, mfhd + 12));
+
+  const auto tfhd = find_box(buffer, {"moof", "traf", "tfhd"});
+  BOOST_REQUIRE_EQUAL(0x00020038, get_u32(buffer, tfhd + 8));
+  BOOST_REQUIRE_EQUAL(1, get_u32(buffer, tfhd + 12));
+  BOOST_REQUIRE_EQUAL(960, get_u32(buffer, tfhd + 16));
+  BOOST_REQUIRE_EQUAL(3, get_u32(buffer, tfhd + 20));
+  BOOST_REQUIRE_EQUAL(0x02000000, get_u32(buffer, tfhd + 24));
+
+  const auto tfdt = find_box(buffer, {"moof", "traf", "tfdt"});
+  BOOST_REQUIRE_EQUAL(0x01000000, get_u32(buffer, tfdt + 8));
+  BOOST_REQUIRE_EQUAL(48000, get_u64(buffer, tfdt + 12));
+
+  // data_offset だけを書く
+  const auto trun = find_box(buffer, {"moof", "traf", "trun"});
+  BOOST_REQUIRE_EQUAL(20, get_u32(buffer, trun));
+  BOOST_REQUIRE_EQUAL(0x00000001, get_u32(buffer, trun + 8));
+  BOOST_REQUIRE_EQUAL(2, get_u32(buffer, trun + 12));
+
+  const auto mdat = find_box(buffer, 0, std::size(buffer), "mdat");
+  BOOST_REQUIRE_EQUAL(8 + 6, get_u32(buffer, mdat));
+  BOOST_REQUIRE_EQUAL(mdat + 8, get_u32(buffer, trun + 16));
+  BOOST_REQUIRE_EQUAL(std::size(buffer), mdat + 8 + 6);
+  BOOST_REQUIRE_EQUAL(1, buffer[mdat + 8]);
+}
+
+BOOST_AUTO_TEST_CASE(fragment_with_first_sample_flags) {
+  // 先頭だけがキーフレームなら, 残りのフレームのフラグを default にする
+  const std::vector<hisui::muxer::FragmentedMP4Sample> samples{
+      {.duration = 3000, .size = 4, .is_key = true},
+      {.duration = 3000, .size = 2, .is_key = false},
+      {.duration = 3000, .size = 1, .is_key = false},
+  };
+  const std::vector<std::uint8_t> data(7, 0xff);
+  const auto buffer = hisui::muxer::make_fragmented_mp4_fragment(
+      1, {{.track_id = 2,
+           .base_media_decode_time = 0,
+           .samples = samples,
+           .data = data}});
+
+  const auto tfhd = find_box(buffer, {"moof", "traf", "tfhd"});
+  BOOST_REQUIRE_EQUAL(0x00020028, get_u32(buffer, tfhd + 8));
+  BOOST_REQUIRE_EQUAL(3000, get_u32(buffer, tfhd + 16));
+  BOOST_REQUIRE_EQUAL(0x01010000, get_u32(buffer, tfhd + 20));
+
+  const auto trun = find_box(buffer, {"moof", "traf", "trun"});
+  BOOST_REQUIRE_EQUAL(0x00000205, get_u32(buffer, trun + 8));
+  BOOST_REQUIRE_EQUAL(3, get_u32(buffer, trun + 12));
+  BOOST_REQUIRE_EQUAL(0x02000000, get_u32(buffer, trun + 20));
+  BOOST_REQUIRE_EQUAL(4, get_u32(buffer, trun + 24));
+  BOOST_REQUIRE_EQUAL(2, get_u32(buffer, trun + 28));
+  BOOST_REQUIRE_EQUAL(1, get_u32(buffer, trun + 32));
+  BOOST_REQUIRE_EQUAL(36, get_u32(buffer, trun));
+}
+
+BOOST_AUTO_TEST_CASE(fragment_with_sample_flags) {
+  // 途中にもキーフレームがあれば, サンプルごとに duration と flags を書く
+  const std::vector<hisui::muxer::FragmentedMP4Sample> samples{
+      {.duration = 3000, .size = 1, .is_key = true},
+      {.duration = 3003, .size = 1, .is_key = false},
+      {.duration = 2997, .size = 1, .is_key = true},
+  };
+  const std::vector<std::uint8_t> video_data{1, 2, 3};
+  const std::vector<hisui::muxer::FragmentedMP4Sample> audio_samples{
+      {.duration = 960, .size = 2, .is_key = true},
+  };
+  const std::vector<std::uint8_t> audio_data{4, 5};
+  const auto buffer = hisui::muxer::make_fragmented_mp4_fragment(
+      1, {{.track_id = 2,
+           .base_media_decode_time = 0,
+           .samples = samples,
+           .data = video_data},
+          {.track_id = 1,
+           .base_media_decode_time = 0,
+           .samples = audio_samples,
+           .data = audio_data}});
+
+  const auto video_traf = find_box(buffer, {"moof", "traf"});
+  const auto video_tfhd = find_box(buffer, video_traf + 8,
+                                   get_end(buffer, video_traf), "tfhd");
+  BOOST_REQUIRE_EQUAL(0x00020010, get_u32(buffer, video_tfhd + 8));
+  BOOST_REQUIRE_EQUAL(1, get_u32(buffer, video_tfhd + 16));
+  const auto video_trun = find_box(buffer, video_traf + 8,
+                                   get_end(buffer, video_traf), "trun");
+  BOOST_REQUIRE_EQUAL(0x00000501, get_u32(buffer, video_trun + 8));
+  BOOST_REQUIRE_EQUAL(3000, get_u32(buffer, video_trun + 20));
+  BOOST_REQUIRE_EQUAL(0x02000000, get_u32(buffer, video_trun + 24));
+  BOOST_REQUIRE_EQUAL(3003, get_u32(buffer, video_trun + 28));
+  BOOST_REQUIRE_EQUAL(0x01010000, get_u32(buffer, video_trun + 32));
+  BOOST_REQUIRE_EQUAL(2997, get_u32(buffer, video_trun + 36));
+  BOOST_REQUIRE_EQUAL(0x02000000, get_u32(buffer, video_trun + 40));
+
+  // mdat には fragment の順にデータを並べる
+  const auto audio_traf = find_box(buffer, get_end(buffer, video_traf),
+                                   get_end(buffer, 0), "traf");
+  const auto audio_trun = find_box(buffer, audio_traf + 8,
+                                   get_end(buffer, audio_traf), "trun");
+  const auto mdat = find_box(buffer, 0, std::size(buffer), "mdat");
+  BOOST_REQUIRE_EQUAL(mdat + 8, get_u32(buffer, video_trun + 16));
+  BOOST_REQUIRE_EQUAL(mdat + 8 + 3, get_u32(buffer, audio_trun + 16));
+  BOOST_REQUIRE_EQUAL(4, buffer[mdat + 8 + 3]);
+}
+
+BOOST_AUTO_TEST_CASE(avc1_sample_entry) {
+  const auto key_frame = make_key_frame(100);
+  const auto buffer = hisui::muxer::make_avc1_sample_entry(
+      640, 480, std::data(key_frame), std::size(key_frame));
+  BOOST_REQUIRE_EQUAL("avc1", get_type(buffer, 0));
+  BOOST_REQUIRE_EQUAL(640, get_u16(buffer, 8 + 24));
+  BOOST_REQUIRE_EQUAL(480, get_u16(buffer, 8 + 26));
+
+  const auto avcC = VISUAL_SAMPLE_ENTRY_SIZE;
+  BOOST_REQUIRE_EQUAL("avcC", get_type(buffer, avcC));
+  const std::vector<std::uint8_t> expected{
+      1,    100,  0,    40,   0xff, 0xe1, 0,    6,    0x67, 100,
+      0,    40,   0xac, 0x2b, 1,    0,    4,    0x68, 0xee, 0x3c,
+      0x80, 0xfd, 0xf8, 0xf8, 0};
+  const std::vector<std::uint8_t> actual(
+      std::begin(buffer) + static_cast<std::ptrdiff_t>(avcC + 8),
+      std::end(buffer));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected), std::end(expected),
+                                  std::begin(actual), std::end(actual));
+
+  // High 以外では chroma_format などを書かない
+  const auto baseline_key_frame = make_key_frame(66);
+  const auto baseline = hisui::muxer::make_avc1_sample_entry(
+      640, 480, std::data(baseline_key_frame), std::size(baseline_key_frame));
+  BOOST_REQUIRE_EQUAL(8 + 21, get_u32(baseline, avcC));
+
+  const std::vector<std::uint8_t> without_pps{0,    0, 0, 1,    0x67, 66, 0,
+                                              40,   0, 0, 0,    1,    0x65,
+                                              0x88};
+  BOOST_REQUIRE_THROW(
+      hisui::muxer::make_avc1_sample_entry(
+          640, 480, std::data(without_pps), std::size(without_pps)),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(vpx_sample_entry) {
+  const auto vp9 = hisui::muxer::make_vpx_sample_entry(
+      hisui::Constants::VP9_FOURCC, 1280, 720);
+  BOOST_REQUIRE_EQUAL("vp09", get_type(vp9, 0));
+  const auto vpcC = VISUAL_SAMPLE_ENTRY_SIZE;
+  BOOST_REQUIRE_EQUAL("vpcC", get_type(vp9, vpcC));
+  BOOST_REQUIRE_EQUAL(20, get_u32(vp9, vpcC));
+  BOOST_REQUIRE_EQUAL(0x01000000, get_u32(vp9, vpcC + 8));
+  BOOST_REQUIRE_EQUAL(0, vp9[vpcC + 12]);
+  BOOST_REQUIRE_EQUAL(31, vp9[vpcC + 13]);
+  BOOST_REQUIRE_EQUAL(0x82, vp9[vpcC + 14]);
+  BOOST_REQUIRE_EQUAL(2, vp9[vpcC + 15]);
+  BOOST_REQUIRE_EQUAL(0, get_u16(vp9, vpcC + 18));
+
+  const auto vp8 = hisui::muxer::make_vpx_sample_entry(
+      hisui::Constants::VP8_FOURCC, 320, 240);
+  BOOST_REQUIRE_EQUAL("vp08", get_type(vp8, 0));
+  BOOST_REQUIRE_EQUAL(20, vp8[vpcC + 13]);
+
+  BOOST_REQUIRE_THROW(hisui::muxer::make_vpx_sample_entry(
+                          hisui::Constants::AV1_FOURCC, 320, 240),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(av01_sample_entry) {
+  // seq_profile = 0, seq_level_idx_0 = 8, seq_tier_0 = 1
+  const std::vector<std::uint8_t> obus{0x0a, 4, 0, 0, 0, 0x44};
+  const auto buffer = hisui::muxer::make_av01_sample_entry(1920, 1080, obus);
+  BOOST_REQUIRE_EQUAL("av01", get_type(buffer, 0));
+  const auto av1C = VISUAL_SAMPLE_ENTRY_SIZE;
+  BOOST_REQUIRE_EQUAL("av1C", get_type(buffer, av1C));
+  BOOST_REQUIRE_EQUAL(8 + 4 + std::size(obus), get_u32(buffer, av1C));
+  BOOST_REQUIRE_EQUAL(0x81, buffer[av1C + 8]);
+  BOOST_REQUIRE_EQUAL(8, buffer[av1C + 9]);
+  BOOST_REQUIRE_EQUAL(0x8c, buffer[av1C + 10]);
+  BOOST_REQUIRE_EQUAL(0, buffer[av1C + 11]);
+  BOOST_REQUIRE_EQUAL(0x0a, buffer[av1C + 12]);
+
+  // Sequence Header OBU でなければ作れない
+  const std::vector<std::uint8_t> temporal_delimiter{0x12, 0};
+  BOOST_REQUIRE_THROW(
+      hisui::muxer::make_av01_sample_entry(1920, 1080, temporal_delimiter),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(opus_sample_entry) {
+  const auto buffer = hisui::muxer::make_opus_sample_entry(312);
+  BOOST_REQUIRE_EQUAL("Opus", get_type(buffer, 0));
+  BOOST_REQUIRE_EQUAL(2, get_u16(buffer, 8 + 16));
+  BOOST_REQUIRE_EQUAL(48000U << 16, get_u32(buffer, 8 + 24));
+
+  const auto dOps = AUDIO_SAMPLE_ENTRY_SIZE;
+  BOOST_REQUIRE_EQUAL("dOps", get_type(buffer, dOps));
+  BOOST_REQUIRE_EQUAL(19, get_u32(buffer, dOps));
+  BOOST_REQUIRE_EQUAL(0, buffer[dOps + 8]);
+  BOOST_REQUIRE_EQUAL(2, buffer[dOps + 9]);
+  BOOST_REQUIRE_EQUAL(312, get_u16(buffer, dOps + 10));
+  BOOST_REQUIRE_EQUAL(48000, get_u32(buffer, dOps + 12));
+  BOOST_REQUIRE_EQUAL(0, get_u16(buffer, dOps + 16));
+  BOOST_REQUIRE_EQUAL(0, buffer[dOps + 18]);
+}
+
+BOOST_AUTO_TEST_CASE(aac_sample_entry) {
+  const auto buffer = hisui::muxer::make_aac_sample_entry(64000);
+  BOOST_REQUIRE_EQUAL("mp4a", get_type(buffer, 0));
+
+  const auto esds = AUDIO_SAMPLE_ENTRY_SIZE;
+  BOOST_REQUIRE_EQUAL("esds", get_type(buffer, esds));
+  BOOST_REQUIRE_EQUAL(std::size(buffer), get_end(buffer, esds));
+  const std::vector<std::uint8_t> expected{
+      0x03, 25,   0,    0,    0,     // ES_Descriptor
+      0x04, 17,   0x40, 0x15, 0,     // DecoderConfigDescriptor
+      0,    0,    0,    0,    0xfa,  // bufferSizeDB, maxBitrate
+      0,    0,    0,    0xfa, 0,     // avgBitrate
+      0x05, 2,    0x11, 0x90,        // AudioSpecificConfig
+      0x06, 1,    0x02};             // SLConfigDescriptor
+  const std::vector<std::uint8_t> actual(
+      std::begin(buffer) + static_cast<std::ptrdiff_t>(esds + 12),
+      std::end(buffer));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected), std::end(expected),
+                                  std::begin(actual), std::end(actual));
+}
+
+BOOST_AUTO_TEST_CASE(annexb_as_length_prefixed) {
+  const auto key_frame = make_key_frame(66);
+  std::vector<std::uint8_t> output;
+  hisui::muxer::append_annexb_as_length_prefixed(&output, std::data(key_frame),
+                                                 std::size(key_frame));
+  BOOST_REQUIRE_EQUAL(4 + 6 + 4 + 4 + 4 + 4, std::size(output));
+  BOOST_REQUIRE_EQUAL(6, get_u32(output, 0));
+  BOOST_REQUIRE_EQUAL(0x67, output[4]);
+  BOOST_REQUIRE_EQUAL(4, get_u32(output, 10));
+  BOOST_REQUIRE_EQUAL(0x68, output[14]);
+  // 末尾の 0 は NAL unit の一部として残る
+  BOOST_REQUIRE_EQUAL(4, get_u32(output, 18));
+  BOOST_REQUIRE_EQUAL(0x65, output[22]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+#include <boost/test/unit_test.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "muxer/hls_playlist.hpp"
+
+BOOST_AUTO_TEST_SUITE(hls_playlist)
+
+BOOST_AUTO_TEST_CASE(event_playlist) {
+  const std::deque<hisui::muxer::HLSSegment> segments{
+      {.uri = "out_00000.m4s", .duration = 6.0, .parts = {}},
+      {.uri = "out_00001.m4s", .duration = 5.96, .parts = {}},
+  };
+  const std::vector<hisui::muxer::HLSPart> current_parts;
+  const std::string init_segment_uri = "out_init.mp4";
+  const std::string current_segment_uri = "out_00002.m4s";
+  hisui::muxer::HLSPlaylistParameters params{
+      .init_segment_uri = init_segment_uri,
+      .target_duration = 6,
+      .part_duration = 0,
+      .is_event = true,
+      .media_sequence = 0,
+      .segments = segments,
+      .current_segment_uri = current_segment_uri,
+      .current_parts = current_parts,
+      .is_finished = false,
+  };
+  BOOST_REQUIRE_EQUAL(
+      "#EXTM3U\n"
+      "#EXT-X-VERSION:7\n"
+      "#EXT-X-TARGETDURATION:6\n"
+      "#EXT-X-PLAYLIST-TYPE:EVENT\n"
+      "#EXT-X-MEDIA-SEQUENCE:0\n"
+      "#EXT-X-INDEPENDENT-SEGMENTS\n"
+      "#EXT-X-MAP:URI=\"out_init.mp4\"\n"
+      "#EXTINF:6.00000,\n"
+      "out_00000.m4s\n"
+      "#EXTINF:5.96000,\n"
+      "out_00001.m4s\n",
+      hisui::muxer::make_hls_playlist(params));
+
+  const hisui::muxer::HLSPlaylistParameters finished{
+      .init_segment_uri = init_segment_uri,
+      .target_duration = 6,
+      .part_duration = 0,
+      .is_event = true,
+      .media_sequence = 0,
+      .segments = segments,
+      .current_segment_uri = current_segment_uri,
+      .current_parts = current_parts,
+      .is_finished = true,
+  };
+  const auto playlist = hisui::muxer::make_hls_playlist(finished);
+  BOOST_REQUIRE(playlist.ends_with("out_00001.m4s\n#EXT-X-ENDLIST\n"));
+}
+
+BOOST_AUTO_TEST_CASE(sliding_window_playlist) {
+  // --hls-playlist-size で外した segment の数を MEDIA-SEQUENCE に書く
+  const std::deque<hisui::muxer::HLSSegment> segments{
+      {.uri = "live_00003.m4s", .duration = 2.0, .parts = {}},
+  };
+  const std::vector<hisui::muxer::HLSPart> current_parts;
+  const std::string init_segment_uri = "live_init.mp4";
+  const std::string current_segment_uri = "live_00004.m4s";
+  const auto playlist = hisui::muxer::make_hls_playlist({
+      .init_segment_uri = init_segment_uri,
+      .target_duration = 2,
+      .part_duration = 0,
+      .is_event = false,
+      .media_sequence = 3,
+      .segments = segments,
+      .current_segment_uri = current_segment_uri,
+      .current_parts = current_parts,
+      .is_finished = false,
+  });
+  BOOST_REQUIRE_EQUAL(
+      "#EXTM3U\n"
+      "#EXT-X-VERSION:7\n"
+      "#EXT-X-TARGETDURATION:2\n"
+      "#EXT-X-MEDIA-SEQUENCE:3\n"
+      "#EXT-X-INDEPENDENT-SEGMENTS\n"
+      "#EXT-X-MAP:URI=\"live_init.mp4\"\n"
+      "#EXTINF:2.00000,\n"
+      "live_00003.m4s\n",
+      playlist);
+}
+
+BOOST_AUTO_TEST_CASE(low_latency_playlist) {
+  const std::deque<hisui::muxer::HLSSegment> segments{
+      {.uri = "ll_00000.m4s",
+       .duration = 2.0,
+       .parts = {{.duration = 1.0,
+                  .offset = 0,
+                  .size = 100,
+                  .is_independent = true},
+                 {.duration = 1.0,
+                  .offset = 100,
+                  .size = 50,
+                  .is_independent = false}}},
+      {.uri = "ll_00001.m4s",
+       .duration = 2.0,
+       .parts = {{.duration = 2.0,
+                  .offset = 0,
+                  .size = 120,
+                  .is_independent = true}}},
+      {.uri = "ll_00002.m4s",
+       .duration = 2.0,
+       .parts = {{.duration = 2.0,
+                  .offset = 0,
+                  .size = 130,
+                  .is_independent = true}}},
+  };
+  const std::vector<hisui::muxer::HLSPart> current_parts{
+      {.duration = 0.5, .offset = 0, .size = 40, .is_independent = true},
+  };
+  const std::string init_segment_uri = "ll_init.mp4";
+  const std::string current_segment_uri = "ll_00003.m4s";
+  hisui::muxer::HLSPlaylistParameters params{
+      .init_segment_uri = init_segment_uri,
+      .target_duration = 2,
+      .part_duration = 0.5,
+      .is_event = true,
+      .media_sequence = 0,
+      .segments = segments,
+      .current_segment_uri = current_segment_uri,
+      .current_parts = current_parts,
+      .is_finished = false,
+  };
+  // part は末尾の 2 つの segment と書き込み中の segment の分のみを載せる
+  BOOST_REQUIRE_EQUAL(
+      "#EXTM3U\n"
+      "#EXT-X-VERSION:9\n"
+      "#EXT-X-TARGETDURATION:2\n"
+      "#EXT-X-PLAYLIST-TYPE:EVENT\n"
+      "#EXT-X-MEDIA-SEQUENCE:0\n"
+      "#EXT-X-INDEPENDENT-SEGMENTS\n"
+      "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=1.500\n"
+      "#EXT-X-PART-INF:PART-TARGET=0.500\n"
+      "#EXT-X-MAP:URI=\"ll_init.mp4\"\n"
+      "#EXTINF:2.00000,\n"
+      "ll_00000.m4s\n"
+      "#EXT-X-PART:DURATION=2.00000,URI=\"ll_00001.m4s\","
+      "BYTERANGE=\"120@0\",INDEPENDENT=YES\n"
+      "#EXTINF:2.00000,\n"
+      "ll_00001.m4s\n"
+      "#EXT-X-PART:DURATION=2.00000,URI=\"ll_00002.m4s\","
+      "BYTERANGE=\"130@0\",INDEPENDENT=YES\n"
+      "#EXTINF:2.00000,\n"
+      "ll_00002.m4s\n"
+      "#EXT-X-PART:DURATION=0.50000,URI=\"ll_00003.m4s\","
+      "BYTERANGE=\"40@0\",INDEPENDENT=YES\n",
+      hisui::muxer::make_hls_playlist(params));
+}
+
+BOOST_AUTO_TEST_CASE(low_latency_parts_byterange) {
+  const std::deque<hisui::muxer::HLSSegment> segments{
+      {.uri = "ll_00000.m4s",
+       .duration = 2.0,
+       .parts = {{.duration = 1.0,
+                  .offset = 0,
+                  .size = 100,
+                  .is_independent = true},
+                 {.duration = 1.0,
+                  .offset = 100,
+                  .size = 50,
+                  .is_independent = false}}},
+  };
+  const std::vector<hisui::muxer::HLSPart> current_parts;
+  const std::string init_segment_uri = "ll_init.mp4";
+  const std::string current_segment_uri = "ll_00001.m4s";
+  const auto playlist = hisui::muxer::make_hls_playlist({
+      .init_segment_uri = init_segment_uri,
+      .target_duration = 2,
+      .part_duration = 1.0,
+      .is_event = true,
+      .media_sequence = 0,
+      .segments = segments,
+      .current_segment_uri = current_segment_uri,
+      .current_parts = current_parts,
+      .is_finished = true,
+  });
+  // キーフレームで始まらない part には INDEPENDENT を付けない
+  BOOST_REQUIRE(playlist.find("#EXT-X-PART:DURATION=1.00000,"
+                              "URI=\"ll_00000.m4s\",BYTERANGE=\"100@0\","
+                              "INDEPENDENT=YES\n"
+                              "#EXT-X-PART:DURATION=1.00000,"
+                              "URI=\"ll_00000.m4s\",BYTERANGE=\"50@100\"\n"
+                              "#EXTINF:2.00000,\n") != std::string::npos);
+  // 書き終えた後は書き込み中の segment の part を載せない
+  BOOST_REQUIRE(playlist.ends_with("ll_00000.m4s\n#EXT-X-ENDLIST\n"));
+  BOOST_REQUIRE(playlist.find("ll_00001.m4s") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,283 @@
+#include <boost/test/unit_test.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frame.hpp"
+#include "muxer/packet_ring_writer.hpp"
+
+namespace {
+
+using hisui::muxer::PacketRingWriter;
+
+// リングの大きさ. 40 バイトのパケットの record が 4 つ入る
+constexpr std::size_t RING_SIZE = 256;
+
+std::filesystem::path get_ring_path() {
+  return std::filesystem::temp_directory_path() /
+         "hisui_packet_ring_writer_test";
+}
+
+hisui::Frame make_frame(const std::uint64_t timestamp,
+                        const std::size_t size,
+                        const bool is_key = false) {
+  std::shared_ptr<std::uint8_t[]> data(new std::uint8_t[size]);
+  std::memset(data.get(), static_cast<int>(timestamp), size);
+  return {.timestamp = timestamp,
+          .data = data,
+          .data_size = size,
+          .is_key = is_key};
+}
+
+struct Record {
+  std::uint64_t position;
+  std::uint64_t timestamp;
+  std::uint32_t size;
+  std::uint32_t flags;
+  const std::uint8_t* data;
+};
+
+// packet_ring_writer.hpp に書いた手順で別のプロセスから読む側
+class PacketRingReader {
+ public:
+  explicit PacketRingReader(const std::filesystem::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      throw std::runtime_error("open failed");
+    }
+    m_size = static_cast<std::size_t>(::lseek(fd, 0, SEEK_END));
+    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("mmap failed");
+    }
+    m_data = static_cast<const std::uint8_t*>(data);
+  }
+
+  ~PacketRingReader() {
+    ::munmap(const_cast<std::uint8_t*>(m_data), m_size);
+  }
+
+  template <class T>
+  T get(const std::size_t offset) const {
+    T value;
+    std::memcpy(&value, m_data + offset, sizeof(value));
+    return value;
+  }
+
+  std::uint64_t getDataSize() const { return get<std::uint64_t>(24); }
+  std::uint64_t getReservedPosition() const { return get<std::uint64_t>(32); }
+  std::uint64_t getWrittenPosition() const { return get<std::uint64_t>(40); }
+  std::uint64_t getKeyFramePosition() const { return get<std::uint64_t>(48); }
+  std::uint64_t getState() const { return get<std::uint64_t>(56); }
+
+  // position から written_position までの record を読む. FLAG_PADDING の record は飛ばす
+  std::vector<Record> read(std::uint64_t position) const {
+    std::vector<Record> records;
+    const auto data_offset = get<std::uint64_t>(16);
+    const auto written_position = getWrittenPosition();
+    while (position < written_position) {
+      const auto offset = data_offset + position % getDataSize();
+      const Record record{.position = position,
+                          .timestamp = get<std::uint64_t>(offset),
+                          .size = get<std::uint32_t>(offset + 8),
+                          .flags = get<std::uint32_t>(offset + 12),
+                          .data = m_data + offset + 16};
+      position += (16 + record.size + 15) / 16 * 16;
+      if ((record.flags & PacketRingWriter::FLAG_PADDING) == 0) {
+        records.push_back(record);
+      }
+    }
+    return records;
+  }
+
+  // 使い終えた record が上書きされた可能性があるか
+  bool isOverwritten(const Record& record) const {
+    return getReservedPosition() > record.position + getDataSize();
+  }
+
+  bool hasData(const Record& record) const {
+    for (std::uint32_t i = 0; i < record.size; ++i) {
+      if (record.data[i] != static_cast<std::uint8_t>(record.timestamp)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  const std::uint8_t* m_data;
+  std::size_t m_size;
+};
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(packet_ring_writer)
+
+BOOST_AUTO_TEST_CASE(header) {
+  const std::vector<std::uint8_t> video_extra_data{1, 2, 3};
+  const std::vector<std::uint8_t> audio_extra_data{'O', 'p', 'u', 's'};
+  {
+    PacketRingWriter writer(get_ring_path().string(), RING_SIZE + 8,
+                            {.video_fourcc = 0x30395056,
+                             .video_width = 640,
+                             .video_height = 360,
+                             .video_extra_data = video_extra_data,
+                             .audio_fourcc = PacketRingWriter::OPUS_FOURCC,
+                             .audio_sample_rate = 48000,
+                             .audio_channels = 2,
+                             .audio_extra_data = audio_extra_data});
+    PacketRingReader reader(get_ring_path());
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::MAGIC, reader.get<std::uint64_t>(0));
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::HEADER_SIZE,
+                        reader.get<std::uint64_t>(16));
+    // RECORD_ALIGNMENT の倍数に切り下げる
+    BOOST_REQUIRE_EQUAL(RING_SIZE, reader.getDataSize());
+    BOOST_REQUIRE_EQUAL(0x30395056, reader.get<std::uint32_t>(64));
+    BOOST_REQUIRE_EQUAL(640, reader.get<std::uint32_t>(68));
+    BOOST_REQUIRE_EQUAL(360, reader.get<std::uint32_t>(72));
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::OPUS_FOURCC,
+                        reader.get<std::uint32_t>(76));
+    BOOST_REQUIRE_EQUAL(48000, reader.get<std::uint32_t>(80));
+    BOOST_REQUIRE_EQUAL(2, reader.get<std::uint32_t>(84));
+    BOOST_REQUIRE_EQUAL(3, reader.get<std::uint32_t>(88));
+    BOOST_REQUIRE_EQUAL(4, reader.get<std::uint32_t>(92));
+    BOOST_REQUIRE_EQUAL(3, reader.get<std::uint8_t>(98));
+    const auto audio_extra_data_offset =
+        96 + PacketRingWriter::MAX_EXTRA_DATA_SIZE;
+    BOOST_REQUIRE_EQUAL('s',
+                        reader.get<std::uint8_t>(audio_extra_data_offset + 3));
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::STATE_WRITING, reader.getState());
+
+    writer.finish();
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::STATE_FINISHED, reader.getState());
+  }
+  std::filesystem::remove(get_ring_path());
+}
+
+BOOST_AUTO_TEST_CASE(wrap_with_padding) {
+  PacketRingWriter writer(get_ring_path().string(), RING_SIZE, {});
+  PacketRingReader reader(get_ring_path());
+  // 40 バイトのパケットの record は 64 バイト
+  writer.addVideoFrame(make_frame(1, 40, true));
+  writer.addAudioFrame(make_frame(2, 40));
+  writer.addVideoFrame(make_frame(3, 40));
+  BOOST_REQUIRE_EQUAL(192, reader.getWrittenPosition());
+  const auto before_wrap = reader.read(0);
+  BOOST_REQUIRE_EQUAL(3, std::size(before_wrap));
+  BOOST_REQUIRE_EQUAL(PacketRingWriter::FLAG_KEY_FRAME, before_wrap[0].flags);
+  BOOST_REQUIRE_EQUAL(PacketRingWriter::FLAG_AUDIO, before_wrap[1].flags);
+  BOOST_REQUIRE_EQUAL(0, before_wrap[2].flags);
+
+  // 96 バイトの record は残りの 64 バイトに収まらないので, padding を置いて先頭に書く
+  writer.addVideoFrame(make_frame(4, 80, true));
+  BOOST_REQUIRE_EQUAL(352, reader.getWrittenPosition());
+  BOOST_REQUIRE_EQUAL(352, reader.getReservedPosition());
+  const auto padding = PacketRingWriter::HEADER_SIZE + 192;
+  BOOST_REQUIRE_EQUAL(PacketRingWriter::FLAG_PADDING,
+                      reader.get<std::uint32_t>(padding + 12));
+  BOOST_REQUIRE_EQUAL(64 - 16, reader.get<std::uint32_t>(padding + 8));
+
+  // 先頭に書いた record が, 最初の 2 つの record に重なる
+  BOOST_REQUIRE(reader.isOverwritten(before_wrap[0]));
+  BOOST_REQUIRE(reader.isOverwritten(before_wrap[1]));
+  BOOST_REQUIRE(!reader.isOverwritten(before_wrap[2]));
+  BOOST_REQUIRE(reader.hasData(before_wrap[2]));
+
+  // padding を飛ばして先頭に戻る
+  const auto records = reader.read(128);
+  BOOST_REQUIRE_EQUAL(2, std::size(records));
+  BOOST_REQUIRE_EQUAL(3, records[0].timestamp);
+  BOOST_REQUIRE_EQUAL(4, records[1].timestamp);
+  BOOST_REQUIRE_EQUAL(256, records[1].position);
+  BOOST_REQUIRE_EQUAL(80, records[1].size);
+  BOOST_REQUIRE(reader.hasData(records[1]));
+
+  // キーフレームの位置は padding ではなく, 先頭に戻った record を指す
+  BOOST_REQUIRE_EQUAL(256, reader.getKeyFramePosition());
+  const auto from_key_frame = reader.read(reader.getKeyFramePosition());
+  BOOST_REQUIRE_EQUAL(1, std::size(from_key_frame));
+  BOOST_REQUIRE_EQUAL(4, from_key_frame[0].timestamp);
+  BOOST_REQUIRE_EQUAL(PacketRingWriter::FLAG_KEY_FRAME,
+                      from_key_frame[0].flags);
+
+  // 音声と映像のキーフレームでないフレームは key_frame_position を変えない
+  writer.addAudioFrame(make_frame(5, 8));
+  writer.addVideoFrame(make_frame(6, 8));
+  BOOST_REQUIRE_EQUAL(256, reader.getKeyFramePosition());
+
+  std::filesystem::remove(get_ring_path());
+}
+
+BOOST_AUTO_TEST_CASE(overwrite_detection) {
+  PacketRingWriter writer(get_ring_path().string(), RING_SIZE, {});
+  PacketRingReader reader(get_ring_path());
+  writer.addVideoFrame(make_frame(1, 40, true));
+  writer.addVideoFrame(make_frame(2, 40));
+
+  // 読む側が record を使っている間に, 書く側がリングを一周する
+  const auto records = reader.read(0);
+  BOOST_REQUIRE_EQUAL(2, std::size(records));
+  writer.addVideoFrame(make_frame(3, 40));
+  writer.addVideoFrame(make_frame(4, 40));
+  BOOST_REQUIRE(!reader.isOverwritten(records[0]));
+  BOOST_REQUIRE(reader.hasData(records[0]));
+
+  writer.addVideoFrame(make_frame(5, 40, true));
+  BOOST_REQUIRE_EQUAL(320, reader.getReservedPosition());
+  BOOST_REQUIRE(reader.isOverwritten(records[0]));
+  BOOST_REQUIRE(!reader.isOverwritten(records[1]));
+  // 上書きされた record は別のパケットになっている
+  BOOST_REQUIRE(!reader.hasData(records[0]));
+
+  // 結果を捨て, key_frame_position から読み直す
+  BOOST_REQUIRE_EQUAL(256, reader.getKeyFramePosition());
+  const auto retried = reader.read(reader.getKeyFramePosition());
+  BOOST_REQUIRE_EQUAL(1, std::size(retried));
+  BOOST_REQUIRE_EQUAL(5, retried[0].timestamp);
+  BOOST_REQUIRE(!reader.isOverwritten(retried[0]));
+  BOOST_REQUIRE(reader.hasData(retried[0]));
+
+  std::filesystem::remove(get_ring_path());
+}
+
+BOOST_AUTO_TEST_CASE(failure) {
+  {
+    PacketRingWriter writer(get_ring_path().string(), RING_SIZE, {});
+    PacketRingReader reader(get_ring_path());
+    writer.fail();
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::STATE_FAILED, reader.getState());
+  }
+  {
+    std::unique_ptr<PacketRingReader> reader;
+    {
+      PacketRingWriter writer(get_ring_path().string(), RING_SIZE, {});
+      reader = std::make_unique<PacketRingReader>(get_ring_path());
+      // リングより大きなパケットは書けない
+      BOOST_REQUIRE_THROW(writer.addVideoFrame(make_frame(1, RING_SIZE)),
+                          std::runtime_error);
+    }
+    // finish() を呼ばずに破棄すると失敗として残る
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::STATE_FAILED, reader->getState());
+  }
+  {
+    {
+      PacketRingWriter writer(get_ring_path().string(), RING_SIZE, {});
+      writer.finish();
+    }
+    PacketRingReader reader(get_ring_path());
+    BOOST_REQUIRE_EQUAL(PacketRingWriter::STATE_FINISHED, reader.getState());
+  }
+  std::filesystem::remove(get_ring_path());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
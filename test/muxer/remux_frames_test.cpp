@@ -0,0 +1,272 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "muxer/remux_frames.hpp"
+#include "webm/input/demuxer.hpp"
+#include "webm/input/index.hpp"
+#include "webm/input/mapped_reader.hpp"
+
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+// 大きさは 8 バイトの可変長整数で書く
+Bytes element(const Bytes& id, const Bytes& data) {
+  Bytes bytes = id;
+  bytes.push_back(0x01);
+  for (int i = 6; i >= 0; --i) {
+    bytes.push_back(
+        static_cast<unsigned char>((std::size(data) >> (8 * i)) & 0xFF));
+  }
+  bytes.insert(std::end(bytes), std::begin(data), std::end(data));
+  return bytes;
+}
+
+struct Block {
+  std::int16_t timestamp_ms;
+  Bytes data;
+  bool is_key;
+};
+
+// VP8 のキーフレームの先頭 10 バイト
+Bytes make_vp8_key_frame(const std::uint32_t width,
+                         const std::uint32_t height) {
+  return {0x10,
+          0x02,
+          0x00,
+          0x9d,
+          0x01,
+          0x2a,
+          static_cast<unsigned char>(width & 0xFF),
+          static_cast<unsigned char>(width >> 8),
+          static_cast<unsigned char>(height & 0xFF),
+          static_cast<unsigned char>(height >> 8)};
+}
+
+const Bytes VP8_INTER_FRAME = {0x01, 0x00, 0x00, 0xAA};
+
+// VP9 のキーフレームの uncompressed header. color_space は BT.601
+Bytes make_vp9_key_frame(const std::uint32_t profile,
+                         const std::uint32_t width,
+                         const std::uint32_t height) {
+  Bytes bytes;
+  int bit_count = 0;
+  const auto write = [&bytes, &bit_count](const std::uint32_t value,
+                                          const int bits) {
+    for (int i = bits - 1; i >= 0; --i) {
+      if (bit_count % 8 == 0) {
+        bytes.push_back(0);
+      }
+      if ((value >> i) & 1) {
+        bytes.back() |= static_cast<unsigned char>(0x80 >> (bit_count % 8));
+      }
+      ++bit_count;
+    }
+  };
+  write(2, 2);  // frame_marker
+  write(profile & 1, 1);
+  write(profile >> 1, 1);
+  // show_existing_frame, frame_type, show_frame, error_resilient_mode
+  write(0, 4);
+  write(0x498342, 24);
+  write(1, 3);  // color_space
+  write(0, 1);  // color_range
+  if (profile == 1) {
+    write(0, 3);
+  }
+  write(width - 1, 16);
+  write(height - 1, 16);
+  write(0, 8);
+  return bytes;
+}
+
+// blocks を 1 つの Cluster に入れた WebM の Segment の中身を書き, 解析せずに
+// 開けるよう Index をキャッシュに保存しておく
+void write_webm(const std::filesystem::path& path,
+                const std::string& codec_id,
+                const std::vector<Block>& blocks) {
+  Bytes cluster = element({0xE7}, {0x00});
+  for (const auto& block : blocks) {
+    const auto tc = static_cast<std::uint16_t>(block.timestamp_ms);
+    Bytes body = {0x81, static_cast<unsigned char>(tc >> 8),
+                  static_cast<unsigned char>(tc & 0xFF),
+                  static_cast<unsigned char>(block.is_key ? 0x80 : 0x00)};
+    body.insert(std::end(body), std::begin(block.data), std::end(block.data));
+    const auto simple_block = element({0xA3}, body);
+    cluster.insert(std::end(cluster), std::begin(simple_block),
+                   std::end(simple_block));
+  }
+  const auto segment = element({0x1F, 0x43, 0xB6, 0x75}, cluster);
+  {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(std::data(segment)),
+              static_cast<std::streamsize>(std::size(segment)));
+  }
+
+  const hisui::webm::input::TrackInfo track{
+      .number = 1,
+      .type = hisui::webm::input::TrackType::Video,
+      .codec_id = codec_id,
+      .width = 320,
+      .height = 240};
+  hisui::webm::input::Index index({track}, 0, 1000000);
+  index.addClusterFrames(
+      [&segment](const std::int64_t pos, const std::size_t size) {
+        return static_cast<std::size_t>(pos) + size <= std::size(segment)
+                   ? std::data(segment) + pos
+                   : nullptr;
+      },
+      0, static_cast<std::int64_t>(std::size(segment)));
+  index.updateDurationByFrames();
+  const auto cache_directory = path.parent_path() / "cache";
+  const hisui::webm::input::MappedReader reader(path.string());
+  index.save(cache_directory.string(), path.string(), reader.getSize(),
+             reader.getVersion());
+}
+
+// 0 ms と 100 ms がキーフレームの 320x240 の VP8
+std::vector<Block> make_vp8_blocks() {
+  return {{.timestamp_ms = 0,
+           .data = make_vp8_key_frame(320, 240),
+           .is_key = true},
+          {.timestamp_ms = 33, .data = VP8_INTER_FRAME, .is_key = false},
+          {.timestamp_ms = 66, .data = VP8_INTER_FRAME, .is_key = false},
+          {.timestamp_ms = 100,
+           .data = make_vp8_key_frame(320, 240),
+           .is_key = true},
+          {.timestamp_ms = 133, .data = VP8_INTER_FRAME, .is_key = false}};
+}
+
+struct Fixture {
+  Fixture()
+      : directory(std::filesystem::temp_directory_path() /
+                  "hisui_remux_frames_test") {
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    hisui::webm::input::Demuxer::setIndexCacheDirectory(
+        (directory / "cache").string());
+  }
+
+  ~Fixture() {
+    hisui::webm::input::Demuxer::setIndexCacheDirectory("");
+    std::filesystem::remove_all(directory);
+  }
+
+  const std::filesystem::path directory;
+};
+
+}  // namespace
+
+BOOST_FIXTURE_TEST_SUITE(remux_frames, Fixture)
+
+BOOST_AUTO_TEST_CASE(find_remuxable_vp8_track) {
+  const auto path = directory / "vp8.webm";
+  write_webm(path, "V_VP8", make_vp8_blocks());
+
+  const auto track = hisui::muxer::find_remuxable_track(path.string());
+  BOOST_REQUIRE(track);
+  BOOST_REQUIRE(track->fourcc == hisui::Constants::VP8_FOURCC);
+  BOOST_REQUIRE_EQUAL(320, track->width);
+  BOOST_REQUIRE_EQUAL(240, track->height);
+  const std::vector<std::uint64_t> key_frame_timestamps = {0, 100000000};
+  BOOST_REQUIRE(track->key_frame_timestamps == key_frame_timestamps);
+}
+
+BOOST_AUTO_TEST_CASE(find_remuxable_track_rejects_resolution_change) {
+  const auto path = directory / "resized.webm";
+  auto blocks = make_vp8_blocks();
+  blocks[3].data = make_vp8_key_frame(640, 480);
+  write_webm(path, "V_VP8", blocks);
+
+  BOOST_REQUIRE(!hisui::muxer::find_remuxable_track(path.string()));
+}
+
+BOOST_AUTO_TEST_CASE(find_remuxable_vp9_track) {
+  const auto profile0 = directory / "vp9.webm";
+  write_webm(profile0, "V_VP9",
+             {{.timestamp_ms = 0,
+               .data = make_vp9_key_frame(0, 320, 240),
+               .is_key = true}});
+  const auto track = hisui::muxer::find_remuxable_track(profile0.string());
+  BOOST_REQUIRE(track);
+  BOOST_REQUIRE(track->fourcc == hisui::Constants::VP9_FOURCC);
+
+  // 出力のトラックは 8 bit 4:2:0 とするので, 4:4:4 のプロファイル 1 は使えない
+  const auto profile1 = directory / "vp9_profile1.webm";
+  write_webm(profile1, "V_VP9",
+             {{.timestamp_ms = 0,
+               .data = make_vp9_key_frame(1, 320, 240),
+               .is_key = true}});
+  BOOST_REQUIRE(!hisui::muxer::find_remuxable_track(profile1.string()));
+}
+
+BOOST_AUTO_TEST_CASE(find_remuxable_track_rejects_other_codec) {
+  const auto path = directory / "av1.webm";
+  write_webm(path, "V_AV1",
+             {{.timestamp_ms = 0, .data = {0x12, 0x00}, .is_key = true}});
+
+  BOOST_REQUIRE(!hisui::muxer::find_remuxable_track(path.string()));
+}
+
+BOOST_AUTO_TEST_CASE(copy_frames_to_timeline) {
+  const auto path = directory / "vp8.webm";
+  const auto blocks = make_vp8_blocks();
+  write_webm(path, "V_VP8", blocks);
+
+  // ファイルを 1 秒から置き, 1.1 秒で切る. 出力はミリ秒にする
+  hisui::FrameQueue buffer;
+  std::vector<std::uint64_t> progress;
+  hisui::muxer::copy_frames(
+      path.string(), 1000000000, 1000000000, 1100000000, 1000, &buffer,
+      [&progress](const std::uint64_t t) { progress.push_back(t); });
+  buffer.close();
+
+  const std::vector<std::uint64_t> timestamps = {1000, 1033, 1066};
+  for (std::size_t i = 0; i < std::size(timestamps); ++i) {
+    const auto frame = buffer.front();
+    BOOST_REQUIRE(frame);
+    BOOST_REQUIRE_EQUAL(timestamps[i], frame->timestamp);
+    BOOST_REQUIRE_EQUAL(blocks[i].is_key, frame->is_key);
+    BOOST_REQUIRE(Bytes(frame->data.get(),
+                        frame->data.get() + frame->data_size) ==
+                  blocks[i].data);
+    BOOST_REQUIRE_EQUAL(timestamps[i] * 1000000, progress[i]);
+    buffer.pop();
+  }
+  BOOST_REQUIRE(!buffer.front());
+}
+
+BOOST_AUTO_TEST_CASE(copy_frames_starts_from_key_frame) {
+  const auto path = directory / "vp8.webm";
+  write_webm(path, "V_VP8", make_vp8_blocks());
+
+  // 途中から切り出す場合, 次のキーフレームまでは復号できないので出力しない
+  hisui::FrameQueue buffer;
+  hisui::muxer::copy_frames(path.string(), 0, 20000000, 1000000000,
+                            hisui::Constants::NANO_SECOND, &buffer,
+                            [](const std::uint64_t) {});
+  buffer.close();
+
+  const std::vector<std::uint64_t> timestamps = {100000000, 133000000};
+  for (std::size_t i = 0; i < std::size(timestamps); ++i) {
+    const auto frame = buffer.front();
+    BOOST_REQUIRE(frame);
+    BOOST_REQUIRE_EQUAL(timestamps[i], frame->timestamp);
+    BOOST_REQUIRE_EQUAL(i == 0, frame->is_key);
+    buffer.pop();
+  }
+  BOOST_REQUIRE(!buffer.front());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,35 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "util/allocation_counter.hpp"
+#include "util/thread_pool.hpp"
+
+BOOST_AUTO_TEST_SUITE(allocation_counter)
+
+BOOST_AUTO_TEST_CASE(count) {
+  const auto before = hisui::util::allocation_counter::get_count();
+  auto value = std::make_unique<int>(1);
+  auto values = std::make_unique<int[]>(4);
+
+  BOOST_REQUIRE_EQUAL(before + 2,
+                      hisui::util::allocation_counter::get_count());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_does_not_allocate) {
+  hisui::util::ThreadPool pool(3);
+  std::vector<std::size_t> values(100, 0);
+  const auto task = [&values](const std::size_t i) { values[i] += i; };
+  pool.parallelFor(std::size(values), task);
+
+  const auto before = hisui::util::allocation_counter::get_count();
+  for (std::size_t n = 0; n < 10; ++n) {
+    pool.parallelFor(std::size(values), task);
+  }
+
+  BOOST_REQUIRE_EQUAL(before, hisui::util::allocation_counter::get_count());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
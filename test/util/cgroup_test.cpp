@@ -0,0 +1,38 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+#include "util/cgroup.hpp"
+
+BOOST_AUTO_TEST_SUITE(cgroup)
+
+BOOST_AUTO_TEST_CASE(parse_cgroup_v2_cpu_max) {
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_v2_cpu_max("max 100000"));
+  BOOST_REQUIRE_EQUAL(
+      1.5, hisui::util::parse_cgroup_v2_cpu_max("150000 100000").value());
+  BOOST_REQUIRE_EQUAL(2.0,
+                      hisui::util::parse_cgroup_v2_cpu_max("200000").value());
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_v2_cpu_max(""));
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_v2_cpu_max("100000 0"));
+}
+
+BOOST_AUTO_TEST_CASE(parse_cgroup_v1_cpu_quota) {
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_v1_cpu_quota("-1", "100000"));
+  BOOST_REQUIRE_EQUAL(
+      0.5, hisui::util::parse_cgroup_v1_cpu_quota("50000\n", "100000").value());
+}
+
+BOOST_AUTO_TEST_CASE(parse_cgroup_memory_limit) {
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_memory_limit("max"));
+  BOOST_REQUIRE_EQUAL(std::uint64_t{1} << 30,
+                      hisui::util::parse_cgroup_memory_limit("1073741824")
+                          .value());
+  // v1 で制限しない場合の値
+  BOOST_REQUIRE(!hisui::util::parse_cgroup_memory_limit("9223372036854771712"));
+}
+
+BOOST_AUTO_TEST_CASE(get_number_of_usable_cpus) {
+  BOOST_REQUIRE_GE(hisui::util::get_number_of_usable_cpus(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
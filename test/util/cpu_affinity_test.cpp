@@ -0,0 +1,46 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "util/cpu_affinity.hpp"
+
+BOOST_AUTO_TEST_SUITE(cpu_affinity)
+
+BOOST_AUTO_TEST_CASE(parse_cpu_list) {
+  const std::vector<std::uint32_t> expected = {0, 1, 2, 3, 8, 10, 11};
+  const auto cpus = hisui::util::parse_cpu_list("0-3,8,10-11\n");
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected), std::end(expected),
+                                  std::begin(cpus), std::end(cpus));
+  BOOST_REQUIRE(std::empty(hisui::util::parse_cpu_list("")));
+  BOOST_REQUIRE_THROW(hisui::util::parse_cpu_list("a-b"),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(split_cpus) {
+  // 先頭から順に分けるので, 同じ NUMA node の CPU が同じ組になる
+  const auto sets = hisui::util::split_cpus({0, 1, 2, 3, 4, 5, 6}, 2);
+  BOOST_REQUIRE_EQUAL(2, std::size(sets));
+  const std::vector<std::uint32_t> expected0 = {0, 1, 2};
+  const std::vector<std::uint32_t> expected1 = {3, 4, 5, 6};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected0), std::end(expected0),
+                                  std::begin(sets[0]), std::end(sets[0]));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected1), std::end(expected1),
+                                  std::begin(sets[1]), std::end(sets[1]));
+
+  // CPU が足りなければ共有する
+  const auto shared = hisui::util::split_cpus({4, 5}, 3);
+  BOOST_REQUIRE_EQUAL(3, std::size(shared));
+  BOOST_REQUIRE_EQUAL(4, shared[0][0]);
+  BOOST_REQUIRE_EQUAL(5, shared[1][0]);
+  BOOST_REQUIRE_EQUAL(4, shared[2][0]);
+
+  BOOST_REQUIRE(std::empty(hisui::util::split_cpus({}, 2)));
+}
+
+BOOST_AUTO_TEST_CASE(get_available_cpus_by_numa_node) {
+  BOOST_REQUIRE(!std::empty(hisui::util::get_available_cpus_by_numa_node()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include <boost/test/unit_test.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <sstream>
+#include <string>
+
+#include "util/file.hpp"
+
+namespace {
+
+void write_file(const std::filesystem::path& path, const std::string& data) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs << data;
+}
+
+std::string read_file(const std::filesystem::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  return oss.str();
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(file)
+
+// --result-cache-dir に残した出力を出力ファイルに戻した後に, 出力ファイルを書き換える
+BOOST_AUTO_TEST_CASE(clone_file_rewrite_after_restore) {
+  const auto directory =
+      std::filesystem::temp_directory_path() / "hisui_file_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  const auto cached = directory / "result.0123456789abcdef.webm";
+  const auto out = directory / "out.webm";
+  write_file(cached, "composed output");
+  // 前回の出力が残っていても置き換える
+  write_file(out, "previous output which is longer than the cached one");
+
+  hisui::util::clone_file(cached, out);
+  BOOST_REQUIRE_EQUAL("composed output", read_file(out));
+  BOOST_REQUIRE(!std::filesystem::equivalent(cached, out));
+
+  // その場で書き換える
+  {
+    std::fstream fs(out, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(0);
+    fs << "COMPOSED";
+  }
+  BOOST_REQUIRE_EQUAL("COMPOSED output", read_file(out));
+  BOOST_REQUIRE_EQUAL("composed output", read_file(cached));
+
+  // 合成し直して上書きする
+  write_file(out, "recomposed");
+  BOOST_REQUIRE_EQUAL("composed output", read_file(cached));
+
+  // 出力ファイルから残す場合も, 残した後に出力ファイルを書き換えても変わらない
+  const auto saved = directory / "result.fedcba9876543210.webm";
+  hisui::util::clone_file(out, saved);
+  write_file(out, "rewritten");
+  BOOST_REQUIRE_EQUAL("recomposed", read_file(saved));
+
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(clone_file_missing_source) {
+  const auto directory =
+      std::filesystem::temp_directory_path() / "hisui_file_test_missing";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  BOOST_REQUIRE_THROW(hisui::util::clone_file(directory / "missing",
+                                              directory / "out"),
+                      std::filesystem::filesystem_error);
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,48 @@
+#include <cstddef>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "util/interval.hpp"
+#include "util/interval_index.hpp"
+
+BOOST_AUTO_TEST_SUITE(interval_index)
+
+BOOST_AUTO_TEST_CASE(find) {
+  hisui::util::IntervalIndex index({
+      hisui::util::Interval(10, 20),
+      hisui::util::Interval(0, 5),
+      hisui::util::Interval(15, 30),
+      hisui::util::Interval(7, 7),
+  });
+  std::vector<std::size_t> active;
+
+  index.find(&active, 0, 1);
+  const std::vector<std::size_t> expected0 = {1};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(active), std::end(active),
+                                  std::begin(expected0), std::end(expected0));
+
+  index.find(&active, 5, 10);
+  BOOST_REQUIRE(std::empty(active));
+
+  index.find(&active, 5, 16);
+  const std::vector<std::size_t> expected1 = {0, 2};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(active), std::end(active),
+                                  std::begin(expected1), std::end(expected1));
+
+  index.find(&active, 20, 21);
+  const std::vector<std::size_t> expected2 = {2};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(active), std::end(active),
+                                  std::begin(expected2), std::end(expected2));
+
+  index.find(&active, 30, 40);
+  BOOST_REQUIRE(std::empty(active));
+
+  // 時間が戻った場合
+  index.find(&active, 4, 11);
+  const std::vector<std::size_t> expected3 = {0, 1};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(active), std::end(active),
+                                  std::begin(expected3), std::end(expected3));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,39 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/memory.hpp"
+
+BOOST_AUTO_TEST_SUITE(memory)
+
+BOOST_AUTO_TEST_CASE(allocate_image_buffer) {
+  hisui::util::enable_huge_pages(false);
+
+  // huge page より小さい領域は通常どおり確保する
+  const auto small = hisui::util::allocate_image_buffer(4096, 64);
+  BOOST_REQUIRE(small.data != nullptr);
+  BOOST_REQUIRE(!small.is_mapped);
+  BOOST_REQUIRE_EQUAL(0, reinterpret_cast<std::uintptr_t>(small.data) % 64);
+  hisui::util::free_image_buffer(small, 64);
+
+  const std::size_t size = 3840 * 2160 * 3 / 2;
+  const auto large = hisui::util::allocate_image_buffer(size, 64);
+  BOOST_REQUIRE(large.data != nullptr);
+  BOOST_REQUIRE(large.size >= size);
+  BOOST_REQUIRE_EQUAL(0, reinterpret_cast<std::uintptr_t>(large.data) % 64);
+  large.data[0] = 1;
+  large.data[size - 1] = 2;
+  hisui::util::free_image_buffer(large, 64);
+
+  std::vector<unsigned char> buffer;
+  hisui::util::resize_with_huge_pages(&buffer, size);
+  BOOST_REQUIRE_EQUAL(size, std::size(buffer));
+
+  const auto statistics = hisui::util::get_huge_page_statistics();
+  BOOST_REQUIRE(statistics.enabled);
+  BOOST_REQUIRE(!statistics.is_explicit);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
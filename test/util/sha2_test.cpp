@@ -0,0 +1,60 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include "util/sha2.hpp"
+
+BOOST_AUTO_TEST_SUITE(sha2)
+
+BOOST_AUTO_TEST_CASE(known_digests) {
+  {
+    hisui::util::SHA2 sha(hisui::util::SHA2Type::SHA256);
+    BOOST_REQUIRE_EQUAL(
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        sha.finalize());
+  }
+  {
+    hisui::util::SHA2 sha(hisui::util::SHA2Type::SHA256);
+    sha.update("abc", 3);
+    BOOST_REQUIRE_EQUAL(
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        sha.finalize());
+  }
+  {
+    hisui::util::SHA2 sha(hisui::util::SHA2Type::SHA224);
+    sha.update("abc", 3);
+    BOOST_REQUIRE_EQUAL(
+        "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7",
+        sha.finalize());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(split_updates) {
+  const std::string text =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  hisui::util::SHA2 whole(hisui::util::SHA2Type::SHA256);
+  whole.update(text.data(), std::size(text));
+  const auto expected = whole.finalize();
+  BOOST_REQUIRE_EQUAL(
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+      expected);
+
+  // ブロックの境界をまたいで少しずつ与えても同じ結果になる
+  for (std::size_t step = 1; step < std::size(text); step += 7) {
+    hisui::util::SHA2 sha(hisui::util::SHA2Type::SHA256);
+    for (std::size_t i = 0; i < std::size(text); i += step) {
+      sha.update(text.data() + i, std::min(step, std::size(text) - i));
+    }
+    BOOST_REQUIRE_EQUAL(expected, sha.finalize());
+  }
+
+  std::vector<unsigned char> million(1000000, 'a');
+  hisui::util::SHA2 sha(hisui::util::SHA2Type::SHA256);
+  sha.update(million.data(), std::size(million));
+  BOOST_REQUIRE_EQUAL(
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+      sha.finalize());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
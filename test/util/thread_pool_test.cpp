@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "util/thread_pool.hpp"
+
+BOOST_AUTO_TEST_SUITE(thread_pool)
+
+BOOST_AUTO_TEST_CASE(parallel_for) {
+  hisui::util::ThreadPool pool(3);
+  std::vector<std::size_t> values(100, 0);
+
+  for (std::size_t n = 0; n < 10; ++n) {
+    pool.parallelFor(std::size(values),
+                     [&values](const std::size_t i) { values[i] += i; });
+  }
+
+  for (std::size_t i = 0; i < std::size(values); ++i) {
+    BOOST_REQUIRE_EQUAL(i * 10, values[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_without_workers) {
+  hisui::util::ThreadPool pool(0);
+  std::size_t sum = 0;
+
+  pool.parallelFor(5, [&sum](const std::size_t i) { sum += i; });
+
+  BOOST_REQUIRE_EQUAL(10, sum);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_rethrows) {
+  hisui::util::ThreadPool pool(2);
+  std::atomic<std::size_t> count = 0;
+
+  BOOST_REQUIRE_THROW(pool.parallelFor(8,
+                                       [&count](const std::size_t i) {
+                                         ++count;
+                                         if (i == 3) {
+                                           throw std::runtime_error("error");
+                                         }
+                                       }),
+                      std::runtime_error);
+  BOOST_REQUIRE_EQUAL(8, count.load());
+
+  pool.parallelFor(4, [&count](const std::size_t) { ++count; });
+  BOOST_REQUIRE_EQUAL(12, count.load());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_parallel_for) {
+  hisui::util::ThreadPool pool(2);
+  std::vector<std::size_t> a(100, 0);
+  std::vector<std::size_t> b(100, 0);
+
+  std::thread t([&pool, &a] {
+    pool.parallelFor(std::size(a), [&a](const std::size_t i) { a[i] = i; });
+  });
+  pool.parallelFor(std::size(b), [&b](const std::size_t i) { b[i] = 2 * i; });
+  t.join();
+
+  for (std::size_t i = 0; i < std::size(a); ++i) {
+    BOOST_REQUIRE_EQUAL(i, a[i]);
+    BOOST_REQUIRE_EQUAL(2 * i, b[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(nested_parallel_for) {
+  hisui::util::ThreadPool pool(3);
+  std::vector<std::size_t> values(8 * 16, 0);
+
+  pool.parallelFor(8, [&pool, &values](const std::size_t i) {
+    pool.parallelFor(16, [&values, i](const std::size_t k) {
+      values[i * 16 + k] = i + k;
+    });
+  });
+
+  for (std::size_t i = 0; i < 8; ++i) {
+    for (std::size_t k = 0; k < 16; ++k) {
+      BOOST_REQUIRE_EQUAL(i + k, values[i * 16 + k]);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(shared_thread_pool) {
+  auto a = hisui::util::get_shared_thread_pool(2);
+  auto b = hisui::util::get_shared_thread_pool(2);
+  auto c = hisui::util::get_shared_thread_pool(3);
+
+  BOOST_REQUIRE_EQUAL(a.get(), b.get());
+  BOOST_REQUIRE_NE(a.get(), c.get());
+  BOOST_REQUIRE_EQUAL(2, a->getNumberOfWorkers());
+  BOOST_REQUIRE_EQUAL(3, c->getNumberOfWorkers());
+}
+
+BOOST_AUTO_TEST_CASE(temporary_parallel_for) {
+  std::vector<std::size_t> values(100, 0);
+
+  hisui::util::parallel_for(std::size(values),
+                            [&values](const std::size_t i) { values[i] = i; });
+
+  for (std::size_t i = 0; i < std::size(values); ++i) {
+    BOOST_REQUIRE_EQUAL(i, values[i]);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -25,4 +25,21 @@ BOOST_AUTO_TEST_CASE(mix_sample_simple) {
        .pattern = "-*-*-*-*-*-*-12-*-*-*-m-*-*-*"}));
 }
 
+BOOST_AUTO_TEST_CASE(wildcard_pattern) {
+  const hisui::util::WildcardPattern pattern("archive-*-*.json");
+  BOOST_REQUIRE(pattern.match("archive-a-b.json"));
+  BOOST_REQUIRE(pattern.match("archive---.json"));
+  BOOST_REQUIRE(pattern.match("archive-a-b-c.json"));
+  BOOST_REQUIRE(!pattern.match("archive-a.json"));
+  BOOST_REQUIRE(!pattern.match("archive-a-b.webm"));
+  BOOST_REQUIRE(!pattern.match("archive-.json"));
+
+  const hisui::util::WildcardPattern literal("report.json");
+  BOOST_REQUIRE(literal.match("report.json"));
+  BOOST_REQUIRE(!literal.match("report.json.bak"));
+
+  BOOST_REQUIRE(hisui::util::WildcardPattern("a*a").match("aa"));
+  BOOST_REQUIRE(!hisui::util::WildcardPattern("aa*aa").match("aaa"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
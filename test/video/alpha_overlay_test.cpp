@@ -0,0 +1,120 @@
+#include <boost/test/unit_test.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "video/alpha_overlay.hpp"
+
+BOOST_AUTO_TEST_SUITE(alpha_overlay)
+
+BOOST_AUTO_TEST_CASE(blend_premultiplied) {
+  // SIMD の部分と端数の部分の両方を通る長さにする
+  const std::size_t size = 37;
+  std::vector<std::uint8_t> dst(size);
+  std::vector<std::uint8_t> premultiplied(size);
+  std::vector<std::uint8_t> transparency(size);
+  std::vector<std::uint8_t> expected(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    const auto d = static_cast<std::uint32_t>((i * 37) & 0xff);
+    const auto a = static_cast<std::uint32_t>((i * 53) & 0xff);
+    const auto p = static_cast<std::uint32_t>((i * 11) % (256 - a));
+    dst[i] = static_cast<std::uint8_t>(d);
+    premultiplied[i] = static_cast<std::uint8_t>(p);
+    transparency[i] = static_cast<std::uint8_t>(a);
+    expected[i] = static_cast<std::uint8_t>(p + (d * a + 127) / 255);
+  }
+  hisui::video::blend_premultiplied(dst.data(), premultiplied.data(),
+                                    transparency.data(), size);
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected), std::end(expected),
+                                  std::begin(dst), std::end(dst));
+}
+
+BOOST_AUTO_TEST_CASE(blend_spans_only) {
+  // 4x2 の画像の左上 2x2 だけが不透明
+  const std::uint8_t y[8] = {200, 200, 9, 9, 200, 200, 9, 9};
+  const std::uint8_t u[2] = {50, 9};
+  const std::uint8_t v[2] = {60, 9};
+  const std::uint8_t alpha[8] = {255, 255, 0, 0, 255, 255, 0, 0};
+  hisui::video::AlphaOverlay overlay({y, u, v}, {4, 2, 2}, alpha, 4, 4, 2);
+  BOOST_REQUIRE_EQUAL(4 + 1 + 1, overlay.getNumberOfBlendedPixels());
+
+  // 6x4 の画像の (2, 2) に重ねる. 右端ははみ出す
+  std::vector<unsigned char> base_y(24, 1);
+  std::vector<unsigned char> base_u(6, 2);
+  std::vector<unsigned char> base_v(6, 3);
+  overlay.blend({base_y.data(), base_u.data(), base_v.data()}, 6, 4, 2, 2);
+
+  const std::vector<unsigned char> expected_y = {
+      1, 1, 1,   1,   1, 1,  //
+      1, 1, 1,   1,   1, 1,  //
+      1, 1, 200, 200, 1, 1,  //
+      1, 1, 200, 200, 1, 1,  //
+  };
+  const std::vector<unsigned char> expected_u = {2, 2, 2, 2, 50, 2};
+  const std::vector<unsigned char> expected_v = {3, 3, 3, 3, 60, 3};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_y), std::end(expected_y),
+                                  std::begin(base_y), std::end(base_y));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_u), std::end(expected_u),
+                                  std::begin(base_u), std::end(base_u));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_v), std::end(expected_v),
+                                  std::begin(base_v), std::end(base_v));
+}
+
+BOOST_AUTO_TEST_CASE(blend_nv12) {
+  // NV12 に重ねた結果は, I420 に重ねてから色差を並べたものと同じになる
+  const std::uint8_t y[16] = {};
+  const std::uint8_t u[4] = {10, 20, 30, 40};
+  const std::uint8_t v[4] = {50, 60, 70, 80};
+  std::uint8_t alpha[16];
+  for (std::size_t i = 0; i < 16; ++i) {
+    alpha[i] = static_cast<std::uint8_t>(i * 17);
+  }
+  hisui::video::AlphaOverlay overlay({y, u, v}, {4, 2, 2}, alpha, 4, 4, 4);
+
+  std::vector<unsigned char> i420(24 * 3 / 2, 100);
+  overlay.blend({i420.data(), i420.data() + 24, i420.data() + 30}, 6, 4, 2, 0);
+  std::vector<unsigned char> nv12(24 * 3 / 2, 100);
+  overlay.blendNV12(nv12.data(), nv12.data() + 24, 6, 4, 2, 0);
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(i420), std::begin(i420) + 24,
+                                  std::begin(nv12), std::begin(nv12) + 24);
+  for (std::size_t i = 0; i < 6; ++i) {
+    BOOST_REQUIRE_EQUAL(i420[24 + i], nv12[24 + 2 * i]);
+    BOOST_REQUIRE_EQUAL(i420[30 + i], nv12[24 + 2 * i + 1]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(blend_rows) {
+  // 行を分けて重ねた結果は, まとめて重ねたものと同じになる
+  const std::uint8_t y[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+  const std::uint8_t u[4] = {10, 20, 30, 40};
+  const std::uint8_t v[4] = {50, 60, 70, 80};
+  std::uint8_t alpha[16];
+  for (std::size_t i = 0; i < 16; ++i) {
+    alpha[i] = static_cast<std::uint8_t>(255 - i * 9);
+  }
+  hisui::video::AlphaOverlay overlay({y, u, v}, {4, 2, 2}, alpha, 4, 4, 4);
+
+  std::vector<unsigned char> whole(24 * 3 / 2, 100);
+  overlay.blend({whole.data(), whole.data() + 24, whole.data() + 30}, 6, 4, 1,
+                1);
+  std::vector<unsigned char> rows(24 * 3 / 2, 100);
+  overlay.blend({rows.data(), rows.data() + 24, rows.data() + 30}, 6, 4, 1, 1,
+                0, 2);
+  overlay.blend({rows.data(), rows.data() + 24, rows.data() + 30}, 6, 4, 1, 1,
+                2, 4);
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(whole), std::end(whole),
+                                  std::begin(rows), std::end(rows));
+
+  std::vector<unsigned char> nv12_whole(24 * 3 / 2, 100);
+  overlay.blendNV12(nv12_whole.data(), nv12_whole.data() + 24, 6, 4, 1, 1);
+  std::vector<unsigned char> nv12_rows(24 * 3 / 2, 100);
+  overlay.blendNV12(nv12_rows.data(), nv12_rows.data() + 24, 6, 4, 1, 1, 0, 2);
+  overlay.blendNV12(nv12_rows.data(), nv12_rows.data() + 24, 6, 4, 1, 1, 2, 4);
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(nv12_whole),
+                                  std::end(nv12_whole), std::begin(nv12_rows),
+                                  std::end(nv12_rows));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,45 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "video/context_pool.hpp"
+
+namespace {
+
+std::vector<int*> destroyed;
+
+void destroy(int* context) {
+  destroyed.push_back(context);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(context_pool)
+
+BOOST_AUTO_TEST_CASE(reuse_by_key) {
+  destroyed.clear();
+  int a = 0;
+  int b = 0;
+  int c = 0;
+  {
+    hisui::video::ContextPool<std::uint32_t, int> pool(destroy, 1);
+    BOOST_REQUIRE(pool.acquire(1) == nullptr);
+    pool.release(1, &a);
+    // 別の key の context は使わない
+    BOOST_REQUIRE(pool.acquire(2) == nullptr);
+    BOOST_REQUIRE(pool.acquire(1) == &a);
+    BOOST_REQUIRE(pool.acquire(1) == nullptr);
+
+    pool.release(1, &a);
+    // 上限を超えた分はすぐに破棄する
+    pool.release(1, &b);
+    BOOST_REQUIRE_EQUAL(1, std::size(destroyed));
+    BOOST_REQUIRE(destroyed[0] == &b);
+    pool.release(2, &c);
+  }
+  // 破棄する際に残っている context も破棄する
+  BOOST_REQUIRE_EQUAL(3, std::size(destroyed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <memory>
+
+#include "frame_buffer_pool.hpp"
+
+BOOST_AUTO_TEST_SUITE(frame_buffer_pool)
+
+BOOST_AUTO_TEST_CASE(acquire_best_fit) {
+  hisui::FrameBufferPool pool(4);
+  auto small = pool.acquire(100);
+  auto middle = pool.acquire(200);
+  auto large = pool.acquire(300);
+  const auto* small_data = small.get();
+  const auto* middle_data = middle.get();
+  const auto* large_data = large.get();
+  small.reset();
+  middle.reset();
+  large.reset();
+  BOOST_REQUIRE_EQUAL(3, pool.getNumberOfFreeBuffers());
+
+  // 足りる中で最も小さいものを使う
+  auto a = pool.acquire(150);
+  BOOST_REQUIRE(a.get() == middle_data);
+  auto b = pool.acquire(100);
+  BOOST_REQUIRE(b.get() == small_data);
+  // 足りるものがなければ新しく確保する
+  auto c = pool.acquire(1000);
+  BOOST_REQUIRE(c.get() != large_data);
+  BOOST_REQUIRE_EQUAL(1, pool.getNumberOfFreeBuffers());
+}
+
+BOOST_AUTO_TEST_CASE(release_replace_smallest) {
+  hisui::FrameBufferPool pool(2);
+  auto small = pool.acquire(100);
+  auto middle = pool.acquire(200);
+  auto large = pool.acquire(300);
+  auto tiny = pool.acquire(50);
+  const auto* middle_data = middle.get();
+  const auto* large_data = large.get();
+  small.reset();
+  middle.reset();
+  BOOST_REQUIRE_EQUAL(2, pool.getNumberOfFreeBuffers());
+
+  // 一杯の場合は最も小さいものと入れ替える
+  large.reset();
+  BOOST_REQUIRE_EQUAL(2, pool.getNumberOfFreeBuffers());
+  // 残っているものより小さければ捨てる
+  tiny.reset();
+  BOOST_REQUIRE_EQUAL(2, pool.getNumberOfFreeBuffers());
+
+  auto a = pool.acquire(10);
+  BOOST_REQUIRE(a.get() == middle_data);
+  auto b = pool.acquire(10);
+  BOOST_REQUIRE(b.get() == large_data);
+  BOOST_REQUIRE_EQUAL(0, pool.getNumberOfFreeBuffers());
+}
+
+BOOST_AUTO_TEST_CASE(release_after_pool_destroyed) {
+  std::shared_ptr<std::uint8_t[]> buffer;
+  {
+    hisui::FrameBufferPool pool;
+    buffer = pool.acquire(100);
+  }
+  // プールが先に破棄されていてもバッファは使え, 参照がなくなれば解放される
+  buffer[99] = 1;
+  BOOST_REQUIRE_EQUAL(1, buffer[99]);
+  buffer.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,144 @@
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "frame.hpp"
+#include "frame_queue.hpp"
+
+namespace {
+
+// ブロックしていることを確かめるために待つ時間
+constexpr auto BLOCKING_TIMEOUT = std::chrono::milliseconds(50);
+
+hisui::Frame make_frame(const std::uint64_t timestamp) {
+  return {.timestamp = timestamp,
+          .data = nullptr,
+          .data_size = 0,
+          .is_key = false};
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(frame_queue)
+
+BOOST_AUTO_TEST_CASE(push_and_pop) {
+  hisui::FrameQueue queue;
+  BOOST_REQUIRE(!queue.front());
+  queue.push(make_frame(1));
+  queue.push(make_frame(2));
+  queue.push(make_frame(3));
+  BOOST_REQUIRE_EQUAL(3, queue.size());
+  BOOST_REQUIRE_EQUAL(1, queue.front()->timestamp);
+  queue.pop();
+  BOOST_REQUIRE_EQUAL(2, queue.waitFront()->timestamp);
+  queue.pop();
+  queue.push(make_frame(4));
+  BOOST_REQUIRE_EQUAL(2, queue.size());
+  BOOST_REQUIRE_EQUAL(3, queue.peakSize());
+}
+
+BOOST_AUTO_TEST_CASE(wait_front_blocks_until_push) {
+  hisui::FrameQueue queue;
+  auto future = std::async(std::launch::async, [&queue] {
+    return queue.waitFront()->timestamp;
+  });
+  BOOST_REQUIRE(future.wait_for(BLOCKING_TIMEOUT) ==
+                std::future_status::timeout);
+  queue.push(make_frame(10));
+  BOOST_REQUIRE_EQUAL(10, future.get());
+}
+
+BOOST_AUTO_TEST_CASE(push_blocks_while_full) {
+  hisui::FrameQueue queue(2);
+  queue.push(make_frame(1));
+  queue.push(make_frame(2));
+  auto future =
+      std::async(std::launch::async, [&queue] { queue.push(make_frame(3)); });
+  BOOST_REQUIRE(future.wait_for(BLOCKING_TIMEOUT) ==
+                std::future_status::timeout);
+  BOOST_REQUIRE_EQUAL(2, queue.size());
+
+  queue.pop();
+  future.get();
+  BOOST_REQUIRE_EQUAL(2, queue.size());
+  BOOST_REQUIRE_EQUAL(2, queue.peakSize());
+  BOOST_REQUIRE_EQUAL(2, queue.front()->timestamp);
+}
+
+BOOST_AUTO_TEST_CASE(close) {
+  hisui::FrameQueue queue;
+  auto future = std::async(std::launch::async,
+                           [&queue] { return queue.waitFront().has_value(); });
+  BOOST_REQUIRE(future.wait_for(BLOCKING_TIMEOUT) ==
+                std::future_status::timeout);
+  queue.close();
+  // 空のまま close() されたら値を返さずに戻る
+  BOOST_REQUIRE(!future.get());
+  BOOST_REQUIRE(queue.isClosed());
+  BOOST_REQUIRE(queue.isFinished());
+  BOOST_REQUIRE_THROW(queue.push(make_frame(1)), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(drain_after_close) {
+  hisui::FrameQueue queue;
+  queue.push(make_frame(1));
+  queue.push(make_frame(2));
+  queue.close();
+  // close() の前に push() された Frame は全て読める
+  BOOST_REQUIRE(!queue.isFinished());
+  std::vector<std::uint64_t> timestamps;
+  while (const auto frame = queue.waitFront()) {
+    timestamps.push_back(frame->timestamp);
+    queue.pop();
+  }
+  BOOST_REQUIRE((timestamps == std::vector<std::uint64_t>{1, 2}));
+  BOOST_REQUIRE(queue.isFinished());
+  BOOST_REQUIRE(!queue.front());
+  BOOST_REQUIRE(!queue.waitFront());
+}
+
+BOOST_AUTO_TEST_CASE(abort_wakes_blocked_push) {
+  hisui::FrameQueue queue(1);
+  queue.push(make_frame(1));
+  auto future =
+      std::async(std::launch::async, [&queue] { queue.push(make_frame(2)); });
+  BOOST_REQUIRE(future.wait_for(BLOCKING_TIMEOUT) ==
+                std::future_status::timeout);
+  queue.abort();
+  BOOST_REQUIRE_THROW(future.get(), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(1, queue.size());
+  // abort() 後の push() もすぐに失敗する
+  BOOST_REQUIRE_THROW(queue.push(make_frame(3)), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(abort_wakes_blocked_wait_front) {
+  hisui::FrameQueue queue;
+  auto future = std::async(std::launch::async,
+                           [&queue] { return queue.waitFront().has_value(); });
+  BOOST_REQUIRE(future.wait_for(BLOCKING_TIMEOUT) ==
+                std::future_status::timeout);
+  queue.abort();
+  BOOST_REQUIRE(!future.get());
+  // close() されていないので終わってはいない
+  BOOST_REQUIRE(!queue.isClosed());
+  BOOST_REQUIRE(!queue.isFinished());
+}
+
+BOOST_AUTO_TEST_CASE(recorder) {
+  hisui::FrameQueue queue(1);
+  std::vector<std::uint64_t> recorded;
+  queue.setRecorder([&recorded](const hisui::Frame& frame) {
+    recorded.push_back(frame.timestamp);
+  });
+  queue.push(make_frame(5));
+  queue.abort();
+  // 失敗した push() の Frame も渡す
+  BOOST_REQUIRE_THROW(queue.push(make_frame(6)), std::runtime_error);
+  BOOST_REQUIRE((recorded == std::vector<std::uint64_t>{5, 6}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
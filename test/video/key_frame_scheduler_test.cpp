@@ -0,0 +1,54 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "video/key_frame_scheduler.hpp"
+
+BOOST_AUTO_TEST_SUITE(key_frame_scheduler)
+
+BOOST_AUTO_TEST_CASE(only_first_and_forced) {
+  hisui::video::KeyFrameScheduler scheduler;
+  BOOST_REQUIRE(scheduler.next(0));
+  BOOST_REQUIRE(!scheduler.next(1));
+  BOOST_REQUIRE(!scheduler.next(100));
+  scheduler.forceKeyFrame();
+  BOOST_REQUIRE(scheduler.next(101));
+  BOOST_REQUIRE(!scheduler.next(102));
+}
+
+BOOST_AUTO_TEST_CASE(interval) {
+  hisui::video::KeyFrameScheduler scheduler(3);
+  std::vector<std::int64_t> key_frames;
+  for (std::int64_t frame = 0; frame < 10; ++frame) {
+    if (scheduler.next(frame)) {
+      key_frames.push_back(frame);
+    }
+  }
+  const std::vector<std::int64_t> expected = {0, 3, 6, 9};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(key_frames), std::end(key_frames),
+                                  std::begin(expected), std::end(expected));
+}
+
+// skipImage() で省いた画像があっても, 区切りを越えた最初の画像をキーフレームにする
+BOOST_AUTO_TEST_CASE(interval_with_skipped_frames) {
+  hisui::video::KeyFrameScheduler scheduler(4);
+  BOOST_REQUIRE(scheduler.next(0));
+  BOOST_REQUIRE(!scheduler.next(1));
+  BOOST_REQUIRE(scheduler.next(5));
+  BOOST_REQUIRE(!scheduler.next(7));
+  BOOST_REQUIRE(scheduler.next(8));
+}
+
+// 強制したキーフレームの後も, 区切りはずらさない
+BOOST_AUTO_TEST_CASE(forced_key_frame_keeps_alignment) {
+  hisui::video::KeyFrameScheduler scheduler(4);
+  BOOST_REQUIRE(scheduler.next(0));
+  BOOST_REQUIRE(!scheduler.next(1));
+  scheduler.forceKeyFrame();
+  BOOST_REQUIRE(scheduler.next(2));
+  BOOST_REQUIRE(!scheduler.next(3));
+  BOOST_REQUIRE(scheduler.next(4));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
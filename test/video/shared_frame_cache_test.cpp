@@ -0,0 +1,237 @@
+#include <boost/test/unit_test.hpp>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+#include "video/shared_frame_cache.hpp"
+#include "video/yuv.hpp"
+
+namespace {
+
+// slot を SharedFrameCache::WAYS 個だけ持つ大きさ
+constexpr std::size_t CACHE_SIZE =
+    64 + hisui::video::SharedFrameCache::WAYS *
+             (64 + hisui::video::SharedFrameCache::SLOT_DATA_SIZE);
+
+std::filesystem::path get_cache_path() {
+  return std::filesystem::temp_directory_path() /
+         "hisui_shared_frame_cache_test";
+}
+
+std::unique_ptr<hisui::video::YUVImage> make_image(
+    const unsigned char value,
+    const std::uint64_t timestamp) {
+  auto image = std::make_unique<hisui::video::YUVImage>(4, 2);
+  std::memset(image->yuv[0], value, 8);
+  std::memset(image->yuv[1], value + 1, 2);
+  std::memset(image->yuv[2], value + 2, 2);
+  image->setTimestamp(timestamp);
+  return image;
+}
+
+// slot の状態の word はファイルの先頭の 64 バイトの header の後に 64 バイトごとに並ぶ.
+// 別のプロセスが find() や insert() の途中にある状態を, ファイルを書き換えて作る
+constexpr std::uint64_t STATE_WRITING = 1;
+constexpr std::uint64_t STATE_READY = 2;
+constexpr std::uint64_t REFERENCE = 4;
+
+std::streamoff get_word_offset(const std::size_t slot) {
+  return static_cast<std::streamoff>(64 + slot * 64);
+}
+
+std::uint64_t read_word(const std::size_t slot) {
+  std::ifstream ifs(get_cache_path(), std::ios::binary);
+  ifs.seekg(get_word_offset(slot));
+  std::uint64_t word = 0;
+  ifs.read(reinterpret_cast<char*>(&word), sizeof(word));
+  return word;
+}
+
+void write_word(const std::size_t slot, const std::uint64_t word) {
+  std::fstream fs(get_cache_path(),
+                  std::ios::binary | std::ios::in | std::ios::out);
+  fs.seekp(get_word_offset(slot));
+  fs.write(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+std::uint64_t make_key(const std::uint64_t timestamp) {
+  return hisui::video::SharedFrameCache::makeKey(1, timestamp, false, false);
+}
+
+// 空の cache の slot i に timestamp i のフレームを置く
+void fill(hisui::video::SharedFrameCache* cache) {
+  for (std::uint64_t t = 0; t < hisui::video::SharedFrameCache::WAYS; ++t) {
+    cache->insert(make_key(t), *make_image(static_cast<unsigned char>(t), t));
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(shared_frame_cache)
+
+BOOST_AUTO_TEST_CASE(shared_between_instances) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache writer(get_cache_path().string(),
+                                        CACHE_SIZE);
+  hisui::video::SharedFrameCache reader(get_cache_path().string(),
+                                        CACHE_SIZE);
+  BOOST_REQUIRE_EQUAL(hisui::video::SharedFrameCache::WAYS,
+                      reader.getNumberOfSlots());
+
+  const auto key =
+      hisui::video::SharedFrameCache::makeKey(1, 100, false, false);
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(!reader.find(key, &image));
+
+  writer.insert(key, *make_image(10, 100));
+  BOOST_REQUIRE(reader.find(key, &image));
+  BOOST_REQUIRE_EQUAL(4, image->getWidth(0));
+  BOOST_REQUIRE_EQUAL(2, image->getHeight(0));
+  BOOST_REQUIRE_EQUAL(100, image->getTimestamp());
+  BOOST_REQUIRE_EQUAL(10, image->yuv[0][7]);
+  BOOST_REQUIRE_EQUAL(11, image->yuv[1][1]);
+  BOOST_REQUIRE_EQUAL(12, image->yuv[2][1]);
+
+  // 同じフレームを持っていれば写し直さない
+  const auto generation = image->getGeneration();
+  BOOST_REQUIRE(reader.find(key, &image));
+  BOOST_REQUIRE_EQUAL(generation, image->getGeneration());
+
+  // 条件が異なれば別のフレームとして扱う
+  BOOST_REQUIRE(!reader.find(
+      hisui::video::SharedFrameCache::makeKey(1, 100, true, false), &image));
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(evicts_least_recently_used) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  for (std::uint64_t t = 0; t < hisui::video::SharedFrameCache::WAYS; ++t) {
+    cache.insert(hisui::video::SharedFrameCache::makeKey(1, t, false, false),
+                 *make_image(static_cast<unsigned char>(t), t));
+  }
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(cache.find(
+      hisui::video::SharedFrameCache::makeKey(1, 0, false, false), &image));
+
+  cache.insert(hisui::video::SharedFrameCache::makeKey(1, 100, false, false),
+               *make_image(100, 100));
+  BOOST_REQUIRE(cache.find(
+      hisui::video::SharedFrameCache::makeKey(1, 0, false, false), &image));
+  BOOST_REQUIRE(!cache.find(
+      hisui::video::SharedFrameCache::makeKey(1, 1, false, false), &image));
+  BOOST_REQUIRE(cache.find(
+      hisui::video::SharedFrameCache::makeKey(1, 100, false, false), &image));
+  BOOST_REQUIRE_EQUAL(100, image->yuv[0][0]);
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(find_releases_reference) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  fill(&cache);
+  BOOST_REQUIRE_EQUAL(STATE_READY, read_word(0));
+
+  // 他のプロセスが参照していても読めて, 参照カウントは読む前の値に戻る
+  write_word(0, STATE_READY + REFERENCE);
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(cache.find(make_key(0), &image));
+  BOOST_REQUIRE_EQUAL(0, image->yuv[0][0]);
+  BOOST_REQUIRE_EQUAL(STATE_READY + REFERENCE, read_word(0));
+
+  write_word(0, STATE_READY);
+  BOOST_REQUIRE(cache.find(make_key(0), &image));
+  BOOST_REQUIRE_EQUAL(STATE_READY, read_word(0));
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(find_skips_writing_slot) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  fill(&cache);
+
+  // 書き込み中の slot は key が同じでも読まず, word も変えない
+  const auto writing =
+      STATE_WRITING | static_cast<std::uint64_t>(::getpid()) << 2;
+  write_word(3, writing);
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(!cache.find(make_key(3), &image));
+  BOOST_REQUIRE_EQUAL(writing, read_word(3));
+
+  // 書き込んでいるプロセスが生きていれば追い出さず, 別の slot に置く
+  cache.insert(make_key(3), *make_image(30, 3));
+  BOOST_REQUIRE_EQUAL(writing, read_word(3));
+  BOOST_REQUIRE(cache.find(make_key(3), &image));
+  BOOST_REQUIRE_EQUAL(30, image->yuv[0][0]);
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(reclaims_slot_of_dead_writer) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  fill(&cache);
+
+  // pid_max を超える pid のプロセスは存在しない
+  write_word(5, STATE_WRITING | std::uint64_t{1} << 30 << 2);
+  cache.insert(make_key(100), *make_image(100, 100));
+  BOOST_REQUIRE_EQUAL(STATE_READY, read_word(5));
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(cache.find(make_key(100), &image));
+  BOOST_REQUIRE_EQUAL(100, image->yuv[0][0]);
+  BOOST_REQUIRE(cache.find(make_key(0), &image));
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(evicts_only_ready_slot) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  fill(&cache);
+
+  // 最も長く使われていない slot 0 は参照されているので, 次に古い slot 1 を追い出す
+  write_word(0, STATE_READY + REFERENCE);
+  cache.insert(make_key(100), *make_image(100, 100));
+  BOOST_REQUIRE_EQUAL(STATE_READY + REFERENCE, read_word(0));
+  std::shared_ptr<hisui::video::YUVImage> image;
+  BOOST_REQUIRE(cache.find(make_key(0), &image));
+  BOOST_REQUIRE(!cache.find(make_key(1), &image));
+  BOOST_REQUIRE(cache.find(make_key(100), &image));
+
+  // 全ての slot が参照されているか書き込み中ならば置かない
+  const auto writing =
+      STATE_WRITING | static_cast<std::uint64_t>(::getpid()) << 2;
+  for (std::size_t i = 0; i < hisui::video::SharedFrameCache::WAYS; ++i) {
+    write_word(i, i % 2 == 0 ? STATE_READY + REFERENCE : writing);
+  }
+  cache.insert(make_key(200), *make_image(200, 200));
+  BOOST_REQUIRE(!cache.find(make_key(200), &image));
+  for (std::size_t i = 0; i < hisui::video::SharedFrameCache::WAYS; ++i) {
+    BOOST_REQUIRE_EQUAL(i % 2 == 0 ? STATE_READY + REFERENCE : writing,
+                        read_word(i));
+  }
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(different_size) {
+  std::filesystem::remove(get_cache_path());
+  hisui::video::SharedFrameCache cache(get_cache_path().string(), CACHE_SIZE);
+  // slot の数が異なるプロセスは開けない
+  const std::size_t larger_size = CACHE_SIZE * 2 - 64;
+  BOOST_REQUIRE_THROW(
+      hisui::video::SharedFrameCache(get_cache_path().string(), larger_size),
+      std::runtime_error);
+  std::filesystem::remove(get_cache_path());
+}
+
+BOOST_AUTO_TEST_CASE(too_small) {
+  BOOST_REQUIRE_THROW(
+      hisui::video::SharedFrameCache(get_cache_path().string(), 1024),
+      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "video/vp8_header.hpp"
+
+namespace {
+
+// RFC 6386 7.3 のブール符号化器
+class BoolEncoder {
+ public:
+  void writeBool(const std::uint32_t probability, const bool value) {
+    const std::uint32_t split = 1 + (((m_range - 1) * probability) >> 8);
+    if (value) {
+      m_bottom += split;
+      m_range -= split;
+    } else {
+      m_range = split;
+    }
+    while (m_range < 128) {
+      m_range <<= 1;
+      if (m_bottom & (1U << 31)) {
+        addOneToOutput();
+      }
+      m_bottom <<= 1;
+      if (--m_bit_count == 0) {
+        m_output.push_back(static_cast<unsigned char>(m_bottom >> 24));
+        m_bottom &= (1U << 24) - 1;
+        m_bit_count = 8;
+      }
+    }
+  }
+
+  void writeLiteral(const std::uint32_t value, const int bits) {
+    for (int i = bits - 1; i >= 0; --i) {
+      writeBool(128, ((value >> i) & 1) == 1);
+    }
+  }
+
+  std::vector<unsigned char> finish() {
+    for (int i = 0; i < 32; ++i) {
+      writeBool(128, false);
+    }
+    return m_output;
+  }
+
+ private:
+  void addOneToOutput() {
+    auto it = std::end(m_output);
+    while (it != std::begin(m_output) && *--it == 255) {
+      *it = 0;
+    }
+    ++*it;
+  }
+
+  std::vector<unsigned char> m_output;
+  std::uint32_t m_range = 255;
+  std::uint32_t m_bottom = 0;
+  int m_bit_count = 24;
+};
+
+struct InterFrameHeader {
+  const bool update_mb_segmentation_map = false;
+  const bool mode_ref_lf_delta_update = false;
+  const bool refresh_golden_frame = false;
+  const std::uint32_t copy_buffer_to_alternate = 0;
+  const bool refresh_entropy_probs = false;
+  const bool refresh_last = false;
+};
+
+std::vector<unsigned char> make_inter_frame(const InterFrameHeader& header) {
+  BoolEncoder encoder;
+  encoder.writeLiteral(1, 1);  // segmentation_enabled
+  encoder.writeLiteral(header.update_mb_segmentation_map ? 1 : 0, 1);
+  encoder.writeLiteral(0, 1);   // update_segment_feature_data
+  encoder.writeLiteral(0, 1);   // filter_type
+  encoder.writeLiteral(32, 6);  // loop_filter_level
+  encoder.writeLiteral(0, 3);   // sharpness_level
+  encoder.writeLiteral(1, 1);   // loop_filter_adj_enable
+  encoder.writeLiteral(header.mode_ref_lf_delta_update ? 1 : 0, 1);
+  encoder.writeLiteral(0, 2);   // log2_nbr_of_dct_partitions
+  encoder.writeLiteral(40, 7);  // y_ac_qi
+  encoder.writeLiteral(1, 1);   // y_dc_delta_present
+  encoder.writeLiteral(3, 4);
+  encoder.writeLiteral(1, 1);
+  for (int i = 0; i < 4; ++i) {
+    encoder.writeLiteral(0, 1);
+  }
+  encoder.writeLiteral(header.refresh_golden_frame ? 1 : 0, 1);
+  encoder.writeLiteral(0, 1);  // refresh_alternate_frame
+  if (!header.refresh_golden_frame) {
+    encoder.writeLiteral(0, 2);  // copy_buffer_to_golden
+  }
+  encoder.writeLiteral(header.copy_buffer_to_alternate, 2);
+  encoder.writeLiteral(0, 1);  // sign_bias_golden
+  encoder.writeLiteral(0, 1);  // sign_bias_alternate
+  encoder.writeLiteral(header.refresh_entropy_probs ? 1 : 0, 1);
+  encoder.writeLiteral(header.refresh_last ? 1 : 0, 1);
+  const auto partition = encoder.finish();
+
+  // show_frame = 1, version = 0, インターフレーム
+  const std::uint32_t tag =
+      1 | (1 << 4) | (static_cast<std::uint32_t>(std::size(partition)) << 5);
+  std::vector<unsigned char> frame = {
+      static_cast<unsigned char>(tag & 0xff),
+      static_cast<unsigned char>((tag >> 8) & 0xff),
+      static_cast<unsigned char>((tag >> 16) & 0xff)};
+  frame.insert(std::end(frame), std::begin(partition), std::end(partition));
+  return frame;
+}
+
+bool is_droppable(const std::vector<unsigned char>& frame) {
+  return hisui::video::is_droppable_vp8_frame(std::data(frame),
+                                              std::size(frame));
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(vp8_header)
+
+BOOST_AUTO_TEST_CASE(droppable_inter_frame) {
+  BOOST_REQUIRE(is_droppable(make_inter_frame({})));
+}
+
+BOOST_AUTO_TEST_CASE(reference_inter_frame) {
+  BOOST_REQUIRE(!is_droppable(make_inter_frame({.refresh_last = true})));
+  BOOST_REQUIRE(
+      !is_droppable(make_inter_frame({.refresh_golden_frame = true})));
+  BOOST_REQUIRE(
+      !is_droppable(make_inter_frame({.copy_buffer_to_alternate = 2})));
+  BOOST_REQUIRE(
+      !is_droppable(make_inter_frame({.refresh_entropy_probs = true})));
+}
+
+BOOST_AUTO_TEST_CASE(inter_frame_updating_persistent_state) {
+  BOOST_REQUIRE(
+      !is_droppable(make_inter_frame({.update_mb_segmentation_map = true})));
+  BOOST_REQUIRE(
+      !is_droppable(make_inter_frame({.mode_ref_lf_delta_update = true})));
+}
+
+BOOST_AUTO_TEST_CASE(key_frame_and_broken_frame) {
+  auto frame = make_inter_frame({});
+  frame[0] &= 0xfe;
+  BOOST_REQUIRE(!is_droppable(frame));
+
+  BOOST_REQUIRE(!is_droppable({0x01, 0x00}));
+  frame = make_inter_frame({});
+  frame.resize(std::size(frame) - 1);
+  BOOST_REQUIRE(!is_droppable(frame));
+}
+
+BOOST_AUTO_TEST_CASE(key_frame_size) {
+  // キーフレーム, 開始コード, 幅 640 (水平スケール 1), 高さ 360
+  const std::vector<unsigned char> frame = {0x10, 0x02, 0x00, 0x9d, 0x01,
+                                            0x2a, 0x80, 0x42, 0x68, 0x01};
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  BOOST_REQUIRE(hisui::video::get_vp8_key_frame_size(
+      std::data(frame), std::size(frame), &width, &height));
+  BOOST_REQUIRE_EQUAL(640, width);
+  BOOST_REQUIRE_EQUAL(360, height);
+
+  const auto inter_frame = make_inter_frame({});
+  BOOST_REQUIRE(!hisui::video::get_vp8_key_frame_size(
+      std::data(inter_frame), std::size(inter_frame), &width, &height));
+  BOOST_REQUIRE(!hisui::video::get_vp8_key_frame_size(
+      std::data(frame), std::size(frame) - 1, &width, &height));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
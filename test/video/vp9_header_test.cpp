@@ -0,0 +1,116 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "video/vp9_header.hpp"
+
+namespace {
+
+class BitWriter {
+ public:
+  void write(const std::uint32_t value, const int bits) {
+    for (int i = bits - 1; i >= 0; --i) {
+      if (m_bit_count % 8 == 0) {
+        m_data.push_back(0);
+      }
+      if ((value >> i) & 1) {
+        m_data.back() |= static_cast<unsigned char>(0x80 >> (m_bit_count % 8));
+      }
+      ++m_bit_count;
+    }
+  }
+
+  const std::vector<unsigned char>& getData() const { return m_data; }
+
+ private:
+  std::vector<unsigned char> m_data;
+  int m_bit_count = 0;
+};
+
+std::vector<unsigned char> make_key_frame(const std::uint32_t profile,
+                                          const std::uint32_t color_space,
+                                          const std::uint32_t width,
+                                          const std::uint32_t height) {
+  BitWriter writer;
+  writer.write(2, 2);  // frame_marker
+  writer.write(profile & 1, 1);
+  writer.write(profile >> 1, 1);
+  if (profile == 3) {
+    writer.write(0, 1);
+  }
+  writer.write(0, 1);  // show_existing_frame
+  writer.write(0, 1);  // frame_type
+  writer.write(1, 1);  // show_frame
+  writer.write(0, 1);  // error_resilient_mode
+  writer.write(0x498342, 24);
+  if (profile >= 2) {
+    writer.write(0, 1);
+  }
+  writer.write(color_space, 3);
+  if (color_space != 7) {
+    writer.write(0, 1);
+    if (profile == 1 || profile == 3) {
+      writer.write(0, 3);
+    }
+  } else if (profile == 1 || profile == 3) {
+    writer.write(0, 1);
+  }
+  writer.write(width - 1, 16);
+  writer.write(height - 1, 16);
+  writer.write(0, 8);
+  return writer.getData();
+}
+
+struct Size {
+  std::uint32_t profile = 0;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+};
+
+bool get_size(const std::vector<unsigned char>& frame, Size* size) {
+  return hisui::video::get_vp9_key_frame_size(std::data(frame),
+                                              std::size(frame), &size->profile,
+                                              &size->width, &size->height);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(vp9_header)
+
+BOOST_AUTO_TEST_CASE(key_frame_size) {
+  Size size;
+  BOOST_REQUIRE(get_size(make_key_frame(0, 1, 1280, 720), &size));
+  BOOST_REQUIRE_EQUAL(0, size.profile);
+  BOOST_REQUIRE_EQUAL(1280, size.width);
+  BOOST_REQUIRE_EQUAL(720, size.height);
+
+  BOOST_REQUIRE(get_size(make_key_frame(1, 2, 641, 359), &size));
+  BOOST_REQUIRE_EQUAL(1, size.profile);
+  BOOST_REQUIRE_EQUAL(641, size.width);
+  BOOST_REQUIRE_EQUAL(359, size.height);
+
+  BOOST_REQUIRE(get_size(make_key_frame(3, 7, 320, 240), &size));
+  BOOST_REQUIRE_EQUAL(3, size.profile);
+  BOOST_REQUIRE_EQUAL(320, size.width);
+  BOOST_REQUIRE_EQUAL(240, size.height);
+}
+
+BOOST_AUTO_TEST_CASE(not_key_frame) {
+  Size size;
+  auto frame = make_key_frame(0, 1, 1280, 720);
+  // frame_type を 1 (NON_KEY_FRAME) にする
+  frame[0] |= 0x04;
+  BOOST_REQUIRE(!get_size(frame, &size));
+
+  frame = make_key_frame(0, 1, 1280, 720);
+  frame[1] = 0;
+  BOOST_REQUIRE(!get_size(frame, &size));
+
+  frame = make_key_frame(0, 1, 1280, 720);
+  frame.resize(6);
+  BOOST_REQUIRE(!get_size(frame, &size));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,10 @@
 #include <vpx/vpx_image.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 #include "video/vpx.hpp"
@@ -76,4 +81,34 @@ BOOST_AUTO_TEST_CASE(update_yuv_image_by_vpx_image_3) {
                                   buf2, buf2 + 2);
 }
 
+BOOST_AUTO_TEST_CASE(update_vpx_active_map) {
+  // 2x3 macroblock. 右端と下端の macroblock は 16x16 に満たない
+  const std::uint32_t width = 36;
+  const std::uint32_t height = 20;
+  const std::size_t luma_size = width * height;
+  const std::size_t chroma_size = 18 * 10;
+  std::vector<unsigned char> current(luma_size + 2 * chroma_size, 16);
+  std::vector<unsigned char> previous;
+  std::vector<unsigned char> active_map;
+
+  // 最初のフレームは全て変わったものとする
+  BOOST_REQUIRE_EQUAL(hisui::video::update_vpx_active_map(
+                          &active_map, &previous, current, width, height),
+                      6);
+  BOOST_REQUIRE_EQUAL(std::size(active_map), 6);
+  BOOST_REQUIRE_EQUAL(hisui::video::update_vpx_active_map(
+                          &active_map, &previous, current, width, height),
+                      0);
+
+  current[19 * width + 35] = 0;
+  current[luma_size] = 0;
+  BOOST_REQUIRE_EQUAL(hisui::video::update_vpx_active_map(
+                          &active_map, &previous, current, width, height),
+                      2);
+  const std::vector<unsigned char> expected = {1, 0, 0, 0, 0, 1};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(active_map), std::end(active_map),
+                                  std::begin(expected), std::end(expected));
+  BOOST_REQUIRE(previous == current);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "video/yuv.hpp"
+#include "video/yuv_image_pool.hpp"
 
 BOOST_AUTO_TEST_SUITE(yuv)
 
@@ -76,6 +77,58 @@ BOOST_AUTO_TEST_CASE(merge_yuv_planes_from_top_left_2x2b) {
   delete[] merged;
 }
 
+BOOST_AUTO_TEST_CASE(merge_yuv_plane_rows_from_top_left_2x2) {
+  unsigned char p1[6] = {1, 1, 1, 1, 1, 1};
+  unsigned char p2[6] = {2, 2, 2, 2, 2, 2};
+  unsigned char p3[6] = {3, 3, 3, 3, 3, 3};
+  std::vector<const unsigned char*> yuvs{p1, p2, p3};
+
+  unsigned char merged[24] = {};
+  hisui::video::merge_yuv_plane_rows_from_top_left(merged, 2, yuvs, 3, 3, 2,
+                                                   128, 1, 3);
+  unsigned char expected[24] = {0, 0, 0, 0,   0,   0,   1, 1, 1, 2,   2,   2,
+                                3, 3, 3, 128, 128, 128, 0, 0, 0, 0,   0,   0};
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(expected, expected + 24, merged, merged + 24);
+
+  hisui::video::merge_yuv_plane_rows_from_top_left(merged, 2, yuvs, 3, 3, 2,
+                                                   128, 0, 1);
+  hisui::video::merge_yuv_plane_rows_from_top_left(merged, 2, yuvs, 3, 3, 2,
+                                                   128, 3, 4);
+  unsigned char* full = new unsigned char[24];
+  hisui::video::merge_yuv_planes_from_top_left(full, 24, 2, yuvs, 3, 3, 2, 128);
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(full, full + 24, merged, merged + 24);
+  delete[] full;
+}
+
+BOOST_AUTO_TEST_CASE(copy_yuv_plane_to_grid_2x2) {
+  unsigned char p1[6] = {1, 1, 1, 1, 1, 1};
+  unsigned char p2[6] = {2, 2, 2, 2, 2, 2};
+  unsigned char p3[6] = {3, 3, 3, 3, 3, 3};
+  std::vector<const unsigned char*> yuvs{p1, p2, p3};
+
+  // 書き込む順番によらず merge_yuv_planes_from_top_left() と同じになる
+  unsigned char merged[24] = {};
+  hisui::video::fill_yuv_plane_outside_grid(merged, 24, 2, 3, 3, 2, 128);
+  for (std::size_t i = 3; i > 0; --i) {
+    hisui::video::copy_yuv_plane_to_grid(merged, 2, yuvs[i - 1], i - 1, 3, 2);
+  }
+  unsigned char full[24];
+  hisui::video::merge_yuv_planes_from_top_left(full, 24, 2, yuvs, 3, 3, 2, 128);
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(full, full + 24, merged, merged + 24);
+}
+
+BOOST_AUTO_TEST_CASE(get_yuv_plane_grid_cell_2x2) {
+  unsigned char merged[24] = {};
+  const std::size_t offsets[4] = {0, 3, 12, 15};
+  for (std::size_t i = 0; i < 4; ++i) {
+    BOOST_REQUIRE(hisui::video::get_yuv_plane_grid_cell(merged, 2, i, 3, 2) ==
+                  merged + offsets[i]);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(merge_yuv_planes_from_top_left_2x2c) {
   unsigned char p1[6] = {1, 1, 1, 1, 1, 1};
   unsigned char p2[6] = {2, 2, 2, 2, 2, 2};
@@ -141,6 +194,33 @@ BOOST_AUTO_TEST_CASE(create_black_yuv_image_2) {
                                   yuv->yuv[2] + 2);
 }
 
+BOOST_AUTO_TEST_CASE(get_shared_black_yuv_image_1) {
+  auto yuv1 = hisui::video::get_shared_black_yuv_image(4, 2);
+  auto yuv2 = hisui::video::get_shared_black_yuv_image(4, 2);
+  auto yuv3 = hisui::video::get_shared_black_yuv_image(2, 4);
+
+  BOOST_REQUIRE_EQUAL(yuv1, yuv2);
+  BOOST_REQUIRE_NE(yuv1, yuv3);
+  BOOST_REQUIRE(yuv3->checkWidthAndHeight(2, 4));
+  BOOST_REQUIRE_EQUAL(0, yuv1->yuv[0][0]);
+  BOOST_REQUIRE_EQUAL(128, yuv1->yuv[1][0]);
+}
+
+BOOST_AUTO_TEST_CASE(YUVImage_getGeneration_1) {
+  auto yuv1 = hisui::video::create_black_yuv_image(4, 2);
+  auto yuv2 = hisui::video::create_black_yuv_image(4, 2);
+  BOOST_REQUIRE_NE(yuv1->getGeneration(), yuv2->getGeneration());
+
+  const auto generation = yuv1->getGeneration();
+  yuv1->setTimestamp(0);
+  BOOST_REQUIRE_NE(generation, yuv1->getGeneration());
+
+  const auto updated = yuv1->getGeneration();
+  BOOST_REQUIRE_EQUAL(updated, yuv1->getGeneration());
+  yuv1->updateGeneration();
+  BOOST_REQUIRE_NE(updated, yuv1->getGeneration());
+}
+
 BOOST_AUTO_TEST_CASE(YUVIMage_setWidthAndHeight_1) {
   auto yuv = hisui::video::create_black_yuv_image(3, 2);
 
@@ -163,4 +243,222 @@ BOOST_AUTO_TEST_CASE(YUVIMage_setWidthAndHeight_1) {
   BOOST_REQUIRE_EQUAL(2, yuv->getHeight(2));
 }
 
+BOOST_AUTO_TEST_CASE(fill_yuv_plane_outside_rectangles_1) {
+  unsigned char plane[24];
+  std::fill_n(plane, 24, 9);
+  // 幅 4, 高さ 3, stride 6 の plane で (1, 1) から 2x2 と (3, 0) から 1x1 を残す
+  hisui::video::fill_yuv_plane_outside_rectangles(
+      plane, 6, 4, 3,
+      {{.x = 1, .y = 1, .width = 2, .height = 2},
+       {.x = 3, .y = 0, .width = 1, .height = 1}},
+      0);
+  unsigned char expected[24] = {0, 0, 0, 9, 9, 9, 0, 9, 9, 0, 9, 9,
+                                0, 9, 9, 0, 9, 9, 9, 9, 9, 9, 9, 9};
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(expected, expected + 24, plane, plane + 24);
+}
+
+BOOST_AUTO_TEST_CASE(overlay_yuv_plane_outside_rectangles_1) {
+  unsigned char overlayed[16];
+  std::fill_n(overlayed, 16, 0);
+  unsigned char src[6] = {1, 2, 3, 4, 5, 6};
+  // 幅 4 の plane の (1, 1) に 3x2 の src を重ねるが, src の (1, 0) から 2x1 は残す
+  hisui::video::overlay_yuv_plane_outside_rectangles(
+      overlayed, src, 4, 1, 1, 3, 2,
+      {{.x = 1, .y = 0, .width = 2, .height = 1}});
+  unsigned char expected[16] = {0, 0, 0, 0, 0, 1, 0, 0,
+                                0, 4, 5, 6, 0, 0, 0, 0};
+
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(expected, expected + 16, overlayed,
+                                  overlayed + 16);
+}
+
+BOOST_AUTO_TEST_CASE(is_covered_by_rectangles_1) {
+  BOOST_REQUIRE(hisui::video::is_covered_by_rectangles(
+      4, 2,
+      {{.x = 0, .y = 0, .width = 3, .height = 2},
+       {.x = 2, .y = 0, .width = 4, .height = 4}}));
+  BOOST_REQUIRE(!hisui::video::is_covered_by_rectangles(
+      4, 2,
+      {{.x = 0, .y = 0, .width = 2, .height = 2},
+       {.x = 2, .y = 0, .width = 2, .height = 1}}));
+  BOOST_REQUIRE(!hisui::video::is_covered_by_rectangles(4, 2, {}));
+}
+
+BOOST_AUTO_TEST_CASE(clip_rectangles_1) {
+  const auto clipped = hisui::video::clip_rectangles(
+      {{.x = 0, .y = 0, .width = 4, .height = 4},
+       {.x = 10, .y = 0, .width = 2, .height = 2}},
+      {.x = 2, .y = 1, .width = 4, .height = 4});
+
+  BOOST_REQUIRE_EQUAL(1, std::size(clipped));
+  BOOST_REQUIRE_EQUAL(0, clipped[0].x);
+  BOOST_REQUIRE_EQUAL(0, clipped[0].y);
+  BOOST_REQUIRE_EQUAL(2, clipped[0].width);
+  BOOST_REQUIRE_EQUAL(3, clipped[0].height);
+}
+
+BOOST_AUTO_TEST_CASE(get_rectangles_outside_1) {
+  // 4x3 の中央の 2x1 を除くと, 上下の帯と中段の左右に分かれる
+  const auto outside = hisui::video::get_rectangles_outside(
+      4, 3, {{.x = 1, .y = 1, .width = 2, .height = 1}});
+
+  BOOST_REQUIRE_EQUAL(4, std::size(outside));
+  std::uint32_t area = 0;
+  for (const auto& r : outside) {
+    area += r.width * r.height;
+  }
+  BOOST_REQUIRE_EQUAL(10, area);
+  BOOST_REQUIRE_EQUAL(0, outside[1].x);
+  BOOST_REQUIRE_EQUAL(1, outside[1].y);
+  BOOST_REQUIRE_EQUAL(1, outside[1].width);
+  BOOST_REQUIRE_EQUAL(3, outside[2].x);
+
+  const auto whole = hisui::video::get_rectangles_outside(4, 3, {});
+  BOOST_REQUIRE_EQUAL(1, std::size(whole));
+  BOOST_REQUIRE_EQUAL(4, whole[0].width);
+  BOOST_REQUIRE_EQUAL(3, whole[0].height);
+  BOOST_REQUIRE(std::empty(hisui::video::get_rectangles_outside(
+      4, 3, {{.x = 0, .y = 0, .width = 4, .height = 3}})));
+}
+
+BOOST_AUTO_TEST_CASE(YUVImage_stride) {
+  hisui::video::YUVImage yuv(6, 4, 64);
+
+  BOOST_REQUIRE_EQUAL(64, yuv.getStride(0));
+  BOOST_REQUIRE_EQUAL(64, yuv.getStride(1));
+  BOOST_REQUIRE_EQUAL(64, yuv.getStride(2));
+  for (std::size_t p = 0; p < 3; ++p) {
+    BOOST_REQUIRE_EQUAL(0, reinterpret_cast<std::uintptr_t>(yuv.yuv[p]) %
+                               hisui::video::YUV_IMAGE_ALIGNMENT);
+  }
+
+  yuv.setBlack();
+  BOOST_REQUIRE_EQUAL(0, yuv.yuv[0][64 * 3 + 5]);
+  BOOST_REQUIRE_EQUAL(128, yuv.yuv[2][64 + 2]);
+}
+
+BOOST_AUTO_TEST_CASE(YUVImage_setWidthAndHeight_keeps_capacity) {
+  hisui::video::YUVImage yuv(8, 8);
+  const auto capacity = yuv.getCapacity();
+  const auto buffer = yuv.yuv[0];
+
+  yuv.setWidthAndHeight(4, 4);
+  BOOST_REQUIRE_EQUAL(capacity, yuv.getCapacity());
+  BOOST_REQUIRE(buffer == yuv.yuv[0]);
+  BOOST_REQUIRE_EQUAL(4, yuv.getStride(0));
+  BOOST_REQUIRE_EQUAL(2, yuv.getStride(1));
+}
+
+BOOST_AUTO_TEST_CASE(YUVImage_wrap) {
+  hisui::video::YUVImage yuv(4, 2);
+  std::uint8_t y[16] = {};
+  std::uint8_t u[8] = {};
+  std::uint8_t v[8] = {};
+
+  yuv.wrap({y, u, v}, {8, 4, 4}, 4, 2);
+  BOOST_REQUIRE(yuv.isWrapped());
+  BOOST_REQUIRE(!yuv.isPacked());
+  BOOST_REQUIRE(yuv.yuv[0] == y);
+  BOOST_REQUIRE_EQUAL(8, yuv.getStride(0));
+  BOOST_REQUIRE_EQUAL(4, yuv.getStride(1));
+
+  yuv.setWidthAndHeight(4, 2);
+  BOOST_REQUIRE(!yuv.isWrapped());
+  BOOST_REQUIRE(yuv.isPacked());
+  BOOST_REQUIRE(yuv.yuv[0] != y);
+
+  BOOST_REQUIRE_THROW(yuv.wrap({y, u, v}, {2, 4, 4}, 4, 2),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(YUVImage_getView) {
+  hisui::video::YUVImage yuv(4, 2);
+  std::uint8_t y[16] = {};
+  std::uint8_t u[8] = {};
+  std::uint8_t v[8] = {};
+
+  yuv.wrap({y, u, v}, {8, 4, 4}, 4, 2);
+  const auto view = yuv.getView();
+  BOOST_REQUIRE(view.planes[0] == y);
+  BOOST_REQUIRE(view.planes[2] == v);
+  BOOST_REQUIRE_EQUAL(8, view.strides[0]);
+  BOOST_REQUIRE_EQUAL(4, view.strides[1]);
+  BOOST_REQUIRE_EQUAL(4, view.width);
+  BOOST_REQUIRE_EQUAL(2, view.height);
+  BOOST_REQUIRE_EQUAL(yuv.getGeneration(), view.generation);
+
+  yuv.updateGeneration();
+  BOOST_REQUIRE_NE(yuv.getGeneration(), view.generation);
+}
+
+BOOST_AUTO_TEST_CASE(YUVImagePool_recycle) {
+  hisui::video::YUVImagePool pool(1);
+
+  auto image = pool.acquire(8, 8);
+  const auto buffer = image->yuv[0];
+  image.reset();
+  BOOST_REQUIRE_EQUAL(1, pool.getNumberOfFreeImages());
+
+  image = pool.acquire(4, 4);
+  BOOST_REQUIRE_EQUAL(0, pool.getNumberOfFreeImages());
+  BOOST_REQUIRE(buffer == image->yuv[0]);
+  BOOST_REQUIRE(image->checkWidthAndHeight(4, 4));
+
+  auto other = pool.acquire(4, 4);
+  image.reset();
+  other.reset();
+  BOOST_REQUIRE_EQUAL(1, pool.getNumberOfFreeImages());
+}
+
+BOOST_AUTO_TEST_CASE(i420_plane) {
+  using Y = hisui::video::I420Plane<0>;
+  using U = hisui::video::I420Plane<1>;
+  static_assert(Y::floor(5) == 5 && Y::ceil(5) == 5);
+  static_assert(U::floor(5) == 2 && U::ceil(5) == 3);
+  static_assert(Y::default_value == 0 && U::default_value == 128);
+
+  std::size_t indices = 0;
+  hisui::video::for_each_i420_plane([&indices](const auto plane) {
+    indices = indices * 10 + decltype(plane)::index + 1;
+  });
+  BOOST_REQUIRE_EQUAL(123, indices);
+}
+
+BOOST_AUTO_TEST_CASE(nv12_planes) {
+  // 4x4 の NV12 の (2, 2) に 2x2 の I420 を重ね, 残りを黒く塗る
+  std::vector<unsigned char> y_plane(16, 9);
+  std::vector<unsigned char> uv_plane(8, 9);
+  hisui::video::fill_nv12_planes_outside_rectangles(
+      y_plane.data(), uv_plane.data(), 4, 4,
+      {{.x = 2, .y = 2, .width = 2, .height = 2}});
+  const unsigned char y[4] = {1, 2, 3, 4};
+  const unsigned char u[1] = {5};
+  const unsigned char v[1] = {6};
+  hisui::video::overlay_yuv_planes(y_plane.data(), y, 4, 2, 2, 2, 2);
+  hisui::video::overlay_uv_planes(uv_plane.data(), u, v, 4, 1, 1, 1, 1);
+
+  const std::vector<unsigned char> expected_y = {0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 0, 1, 2, 0, 0, 3, 4};
+  const std::vector<unsigned char> expected_uv = {128, 128, 128, 128,
+                                                  128, 128, 5,   6};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_y), std::end(expected_y),
+                                  std::begin(y_plane), std::end(y_plane));
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_uv),
+                                  std::end(expected_uv), std::begin(uv_plane),
+                                  std::end(uv_plane));
+
+  // 覆われる部分は書き込まない
+  const unsigned char u2[2] = {7, 7};
+  const unsigned char v2[2] = {8, 8};
+  hisui::video::overlay_uv_plane_outside_rectangles(
+      uv_plane.data(), u2, v2, 4, 0, 0, 2, 1,
+      {{.x = 1, .y = 0, .width = 1, .height = 1}});
+  const std::vector<unsigned char> expected_uv2 = {7,   8,   128, 128,
+                                                   128, 128, 5,   6};
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(std::begin(expected_uv2),
+                                  std::end(expected_uv2), std::begin(uv_plane),
+                                  std::end(uv_plane));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,231 @@
+#include <boost/test/unit_test.hpp>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "webm/input/http_reader.hpp"
+
+namespace {
+
+// 127.0.0.1 で 1 回だけ接続を受け, リクエストのヘッダーを読んでから response を返す
+class OneShotServer {
+ public:
+  explicit OneShotServer(const std::string& t_response)
+      : m_response(t_response) {
+    m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::socklen_t length = sizeof(address);
+    if (m_fd == -1 ||
+        ::bind(m_fd, reinterpret_cast<::sockaddr*>(&address), length) != 0 ||
+        ::listen(m_fd, 1) != 0 ||
+        ::getsockname(m_fd, reinterpret_cast<::sockaddr*>(&address),
+                      &length) != 0) {
+      throw std::runtime_error("starting server failed");
+    }
+    m_port = ntohs(address.sin_port);
+    m_thread = std::thread([this] { serve(); });
+  }
+
+  ~OneShotServer() {
+    m_thread.join();
+    ::close(m_fd);
+  }
+
+  std::string getURL() const {
+    return "http://127.0.0.1:" + std::to_string(m_port) + "/archive.webm";
+  }
+
+  std::string getRequest() const { return m_request; }
+
+ private:
+  int m_fd;
+  std::uint16_t m_port;
+  std::string m_response;
+  std::string m_request;
+  std::thread m_thread;
+
+  void serve() {
+    const int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd == -1) {
+      return;
+    }
+    char buffer[4096];
+    while (m_request.find("\r\n\r\n") == std::string::npos) {
+      const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        break;
+      }
+      m_request.append(buffer, static_cast<std::size_t>(n));
+    }
+    ::send(fd, std::data(m_response), std::size(m_response), MSG_NOSIGNAL);
+    ::close(fd);
+  }
+};
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(http_reader)
+
+BOOST_AUTO_TEST_CASE(parse_url) {
+  const auto url = hisui::webm::input::parse_url(
+      "http://[::1]:8080/bucket/a.webm?X-Amz-Signature=abc#fragment");
+  BOOST_REQUIRE_EQUAL("::1", url.host);
+  BOOST_REQUIRE_EQUAL("8080", url.port);
+  BOOST_REQUIRE_EQUAL("/bucket/a.webm?X-Amz-Signature=abc", url.target);
+
+  BOOST_REQUIRE_THROW(hisui::webm::input::parse_url("https://example.com/"),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(make_range_request) {
+  // Range の終わりは最後のバイトの位置
+  BOOST_REQUIRE_EQUAL(
+      "GET /a.webm HTTP/1.1\r\nHost: example.com\r\n"
+      "Range: bytes=262144-524287\r\nUser-Agent: hisui\r\n\r\n",
+      hisui::webm::input::make_range_request(
+          {.host = "example.com", .port = "80", .target = "/a.webm"}, 262144,
+          524288));
+  BOOST_REQUIRE_EQUAL(
+      "GET / HTTP/1.1\r\nHost: [::1]:9000\r\n"
+      "Range: bytes=0-0\r\nUser-Agent: hisui\r\n\r\n",
+      hisui::webm::input::make_range_request(
+          {.host = "::1", .port = "9000", .target = "/"}, 0, 1));
+}
+
+BOOST_AUTO_TEST_CASE(parse_content_range) {
+  const auto range =
+      hisui::webm::input::parse_content_range("bytes 0-0/1234567");
+  BOOST_REQUIRE(range.is_satisfied);
+  BOOST_REQUIRE_EQUAL(0, range.first);
+  BOOST_REQUIRE_EQUAL(0, range.last);
+  BOOST_REQUIRE_EQUAL(1234567, range.complete_length);
+
+  const auto unsatisfied = hisui::webm::input::parse_content_range("bytes */0");
+  BOOST_REQUIRE(!unsatisfied.is_satisfied);
+  BOOST_REQUIRE_EQUAL(0, unsatisfied.complete_length);
+
+  for (const auto value : {"", "bytes 0-0/*", "bytes 0-9", "items 0-9/10",
+                           "bytes 9-0/10", "bytes 0-10/10", "bytes -1/10",
+                           "bytes 0-1/x"}) {
+    BOOST_TEST_CONTEXT(value) {
+      BOOST_REQUIRE_THROW(hisui::webm::input::parse_content_range(value),
+                          std::runtime_error);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parse_range_response) {
+  const auto response = hisui::webm::input::parse_range_response(
+      "HTTP/1.1 206 Partial Content\r\n"
+      "Content-Length: 1\r\n"
+      "content-range: bytes 0-0/1000\r\n"
+      "ETag:  \"abc\"\r\n"
+      "Last-Modified: Wed, 14 Oct 2026 00:00:00 GMT\r\n"
+      "Connection: Close",
+      0, 1);
+  BOOST_REQUIRE_EQUAL(1000, response.file_size);
+  BOOST_REQUIRE_EQUAL("\"abc\"", response.version);
+  BOOST_REQUIRE_EQUAL(1, response.body_size);
+  BOOST_REQUIRE(response.is_connection_close);
+
+  // ETag が無ければ Last-Modified を版とする
+  const auto without_etag = hisui::webm::input::parse_range_response(
+      "HTTP/1.1 206 Partial Content\r\n"
+      "Content-Length: 100\r\n"
+      "Content-Range: bytes 100-199/1000\r\n"
+      "Last-Modified: Wed, 14 Oct 2026 00:00:00 GMT",
+      100, 200);
+  BOOST_REQUIRE_EQUAL("Wed, 14 Oct 2026 00:00:00 GMT", without_etag.version);
+  BOOST_REQUIRE_EQUAL(100, without_etag.body_size);
+  BOOST_REQUIRE(!without_etag.is_connection_close);
+
+  // 要求と異なる範囲
+  BOOST_REQUIRE_THROW(hisui::webm::input::parse_range_response(
+                          "HTTP/1.1 206 Partial Content\r\n"
+                          "Content-Length: 100\r\n"
+                          "Content-Range: bytes 0-99/1000",
+                          100, 200),
+                      std::runtime_error);
+  BOOST_REQUIRE_THROW(hisui::webm::input::parse_range_response(
+                          "HTTP/1.1 206 Partial Content\r\n"
+                          "Content-Length: 50\r\n"
+                          "Content-Range: bytes 100-199/1000",
+                          100, 200),
+                      std::runtime_error);
+  // Range を無視して全体を返す
+  BOOST_REQUIRE_THROW(
+      hisui::webm::input::parse_range_response(
+          "HTTP/1.1 200 OK\r\nContent-Length: 1000", 0, 1),
+      std::runtime_error);
+  // 範囲外
+  BOOST_REQUIRE_THROW(hisui::webm::input::parse_range_response(
+                          "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                          "Content-Range: bytes */100",
+                          100, 200),
+                      std::runtime_error);
+  BOOST_REQUIRE_THROW(
+      hisui::webm::input::parse_range_response(
+          "HTTP/1.1 404 Not Found\r\nContent-Length: 0", 0, 1),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parse_range_response_empty_file) {
+  // 大きさが 0 のファイルには bytes=0-0 が範囲外になる
+  const auto unsatisfiable = hisui::webm::input::parse_range_response(
+      "HTTP/1.1 416 Range Not Satisfiable\r\n"
+      "Content-Range: bytes */0\r\n"
+      "Content-Length: 0\r\n"
+      "ETag: \"empty\"",
+      0, 1);
+  BOOST_REQUIRE_EQUAL(0, unsatisfiable.file_size);
+  BOOST_REQUIRE_EQUAL(0, unsatisfiable.body_size);
+  BOOST_REQUIRE_EQUAL("\"empty\"", unsatisfiable.version);
+
+  const auto ignored = hisui::webm::input::parse_range_response(
+      "HTTP/1.1 200 OK\r\nContent-Length: 0", 0, 1);
+  BOOST_REQUIRE_EQUAL(0, ignored.file_size);
+  BOOST_REQUIRE_EQUAL(0, ignored.body_size);
+}
+
+BOOST_AUTO_TEST_CASE(empty_remote_file) {
+  OneShotServer server(
+      "HTTP/1.1 416 Range Not Satisfiable\r\n"
+      "Content-Range: bytes */0\r\n"
+      "Content-Length: 0\r\n\r\n");
+  try {
+    hisui::webm::input::HttpReader reader(server.getURL());
+    BOOST_FAIL("HttpReader should throw for an empty file");
+  } catch (const std::runtime_error& e) {
+    BOOST_REQUIRE(std::string(e.what()).starts_with("remote file is empty"));
+  }
+  BOOST_REQUIRE(server.getRequest().starts_with("GET /archive.webm HTTP/1.1"));
+  BOOST_REQUIRE(server.getRequest().find("Range: bytes=0-0\r\n") !=
+                std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(read_remote_file) {
+  OneShotServer server(
+      "HTTP/1.1 206 Partial Content\r\n"
+      "Content-Range: bytes 0-0/1\r\n"
+      "Content-Length: 1\r\n"
+      "ETag: \"one\"\r\n"
+      "Connection: close\r\n\r\n"
+      "x");
+  hisui::webm::input::HttpReader reader(server.getURL());
+  BOOST_REQUIRE_EQUAL(1, reader.getSize());
+  BOOST_REQUIRE_EQUAL("\"one\"", reader.getVersion());
+  long long total = 0;
+  BOOST_REQUIRE_EQUAL(0, reader.Length(&total, nullptr));
+  BOOST_REQUIRE_EQUAL(1, total);
+  BOOST_REQUIRE(reader.getData(1, 1) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
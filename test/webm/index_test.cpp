@@ -0,0 +1,398 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <ios>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "webm/input/demuxer.hpp"
+#include "webm/input/index.hpp"
+#include "webm/input/mapped_reader.hpp"
+#include "webm/input/video_context.hpp"
+
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+constexpr std::int64_t MS = 1000000;
+
+Bytes concat(std::initializer_list<Bytes> parts) {
+  Bytes bytes;
+  for (const auto& part : parts) {
+    bytes.insert(std::end(bytes), std::begin(part), std::end(part));
+  }
+  return bytes;
+}
+
+// 大きさは 8 バイトの可変長整数で書く
+Bytes element(const Bytes& id, const Bytes& data) {
+  Bytes bytes = id;
+  bytes.push_back(0x01);
+  for (int i = 6; i >= 0; --i) {
+    bytes.push_back(
+        static_cast<unsigned char>((std::size(data) >> (8 * i)) & 0xFF));
+  }
+  bytes.insert(std::end(bytes), std::begin(data), std::end(data));
+  return bytes;
+}
+
+const Bytes CLUSTER_ID = {0x1F, 0x43, 0xB6, 0x75};
+const Bytes TIMECODE_ID = {0xE7};
+const Bytes SIMPLE_BLOCK_ID = {0xA3};
+const Bytes BLOCK_GROUP_ID = {0xA0};
+const Bytes BLOCK_ID = {0xA1};
+const Bytes REFERENCE_BLOCK_ID = {0xFB};
+const Bytes VOID_ID = {0xEC};
+
+Bytes timecode(const std::uint8_t value) {
+  return element(TIMECODE_ID, {value});
+}
+
+// track_number は 1 バイトで書ける値にする
+Bytes block_body(const std::uint8_t track_number,
+                 const std::int16_t relative_timecode,
+                 const std::uint8_t flags,
+                 const Bytes& data) {
+  const auto tc = static_cast<std::uint16_t>(relative_timecode);
+  return concat({{static_cast<unsigned char>(0x80 | track_number),
+                  static_cast<unsigned char>(tc >> 8),
+                  static_cast<unsigned char>(tc & 0xFF), flags},
+                 data});
+}
+
+Bytes simple_block(const std::uint8_t track_number,
+                   const std::int16_t relative_timecode,
+                   const bool is_key,
+                   const Bytes& data) {
+  return element(SIMPLE_BLOCK_ID,
+                 block_body(track_number, relative_timecode,
+                            is_key ? 0x80 : 0x00, data));
+}
+
+Bytes block_group(const std::uint8_t track_number,
+                  const std::int16_t relative_timecode,
+                  const bool has_reference_block,
+                  const Bytes& data) {
+  auto group = element(BLOCK_ID, block_body(track_number, relative_timecode,
+                                            0x00, data));
+  if (has_reference_block) {
+    group = concat({group, element(REFERENCE_BLOCK_ID, {0xDF})});
+  }
+  return element(BLOCK_GROUP_ID, group);
+}
+
+const std::vector<hisui::webm::input::TrackInfo> TRACKS = {
+    {.number = 1,
+     .type = hisui::webm::input::TrackType::Video,
+     .codec_id = "V_VP8",
+     .width = 320,
+     .height = 240},
+    {.number = 2,
+     .type = hisui::webm::input::TrackType::Audio,
+     .codec_id = "A_OPUS",
+     .channels = 2,
+     .sampling_rate = 48000.0},
+};
+
+// 映像は 0ms と 100ms がキーフレーム. 音声は 2 番目の Cluster で Xiph lacing を使う
+Bytes make_segment() {
+  return concat({
+      element(VOID_ID, {0x00, 0x00}),
+      element(CLUSTER_ID,
+              concat({timecode(0), simple_block(1, 0, true, {'A', 'A', 'A'}),
+                      simple_block(2, 0, true, {'a'}),
+                      simple_block(1, 33, false, {'B', 'B'})})),
+      element(CLUSTER_ID,
+              concat({timecode(100), block_group(1, 0, false, {'C', 'C'}),
+                      element(SIMPLE_BLOCK_ID,
+                              block_body(2, 0, 0x82,
+                                         {0x02, 0x01, 0x02, 'b', 'c', 'c',
+                                          'd'})),
+                      block_group(1, 33, true, {'D'})})),
+  });
+}
+
+hisui::webm::input::DataGetter make_data_getter(const Bytes& bytes) {
+  return [&bytes](const std::int64_t pos,
+                  const std::size_t size) -> const unsigned char* {
+    if (pos < 0 || static_cast<std::size_t>(pos) + size > std::size(bytes)) {
+      return nullptr;
+    }
+    return std::data(bytes) + pos;
+  };
+}
+
+hisui::webm::input::Index make_index(const Bytes& segment) {
+  hisui::webm::input::Index index(TRACKS, 200 * MS, MS);
+  const auto end = static_cast<std::int64_t>(std::size(segment));
+  std::optional<std::int64_t> pos = 0;
+  while (pos) {
+    pos = index.addClusterFrames(make_data_getter(segment), *pos, end);
+  }
+  return index;
+}
+
+std::string frame_data(const Bytes& bytes,
+                       const hisui::webm::input::IndexedFrame& frame) {
+  return std::string(
+      reinterpret_cast<const char*>(std::data(bytes)) + frame.pos, frame.size);
+}
+
+std::filesystem::path make_directory(const std::string& name) {
+  const auto directory = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  return directory;
+}
+
+void write_file(const std::filesystem::path& path, const Bytes& bytes) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char*>(std::data(bytes)),
+            static_cast<std::streamsize>(std::size(bytes)));
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(webm_index)
+
+BOOST_AUTO_TEST_CASE(add_cluster_frames) {
+  const auto segment = make_segment();
+  hisui::webm::input::Index index(TRACKS, 200 * MS, MS);
+  const auto get_data = make_data_getter(segment);
+  const auto end = static_cast<std::int64_t>(std::size(segment));
+
+  // Void は読み飛ばし, Cluster を 1 つずつ読む
+  const auto second = index.addClusterFrames(get_data, 0, end);
+  BOOST_REQUIRE(second);
+  BOOST_REQUIRE_EQUAL(std::size(*index.getFrames(1)), 2);
+  const auto last = index.addClusterFrames(get_data, *second, end);
+  BOOST_REQUIRE(last);
+  BOOST_REQUIRE_EQUAL(*last, end);
+  BOOST_REQUIRE(!index.addClusterFrames(get_data, *last, end));
+
+  const auto& video = *index.getFrames(1);
+  BOOST_REQUIRE_EQUAL(std::size(video), 4);
+  const std::vector<std::string> video_data = {"AAA", "BB", "CC", "D"};
+  const std::vector<std::int64_t> video_timestamps = {0, 33 * MS, 100 * MS,
+                                                      133 * MS};
+  const std::vector<bool> video_keys = {true, false, true, false};
+  for (std::size_t i = 0; i < std::size(video); ++i) {
+    BOOST_REQUIRE_EQUAL(frame_data(segment, video[i]), video_data[i]);
+    BOOST_REQUIRE_EQUAL(video[i].timestamp_ns, video_timestamps[i]);
+    BOOST_REQUIRE_EQUAL(video[i].is_key, video_keys[i]);
+    BOOST_REQUIRE(video[i].is_first_in_block);
+  }
+
+  BOOST_REQUIRE(index.findTrack(hisui::webm::input::TrackType::Audio));
+  BOOST_REQUIRE_EQUAL(
+      index.findTrack(hisui::webm::input::TrackType::Audio)->info.number, 2);
+  BOOST_REQUIRE(index.getFrames(3) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(add_cluster_frames_lacing) {
+  // Xiph, 固定長, EBML の順に 3 フレームずつ lacing した Block
+  const auto segment = element(
+      CLUSTER_ID,
+      concat({timecode(10),
+              element(SIMPLE_BLOCK_ID,
+                      block_body(1, 0, 0x82,
+                                 {0x02, 0x01, 0x02, 'a', 'b', 'b', 'c'})),
+              element(SIMPLE_BLOCK_ID,
+                      block_body(1, 1, 0x84,
+                                 {0x02, 'd', 'd', 'e', 'e', 'f', 'f'})),
+              element(SIMPLE_BLOCK_ID,
+                      block_body(1, 2, 0x86,
+                                 {0x02, 0x82, 0xC2, 'g', 'g', 'h', 'h', 'h',
+                                  'h', 'h', 'i'}))}));
+  hisui::webm::input::Index index(TRACKS, 0, MS);
+  const auto end = static_cast<std::int64_t>(std::size(segment));
+  BOOST_REQUIRE_EQUAL(
+      *index.addClusterFrames(make_data_getter(segment), 0, end), end);
+
+  const auto& frames = *index.getFrames(1);
+  BOOST_REQUIRE_EQUAL(std::size(frames), 9);
+  const std::vector<std::string> data = {"a",  "bb", "c",     "dd", "ee",
+                                         "ff", "gg", "hhhhh", "i"};
+  for (std::size_t i = 0; i < std::size(frames); ++i) {
+    BOOST_REQUIRE_EQUAL(frame_data(segment, frames[i]), data[i]);
+    BOOST_REQUIRE_EQUAL(frames[i].timestamp_ns,
+                        static_cast<std::int64_t>(10 + i / 3) * MS);
+    BOOST_REQUIRE(frames[i].is_key);
+    // 途中のフレームからはデコードを始められない
+    BOOST_REQUIRE_EQUAL(frames[i].is_first_in_block, i % 3 == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(add_cluster_frames_unknown_size) {
+  // 大きさが分からない Cluster は次の Cluster の手前で止まる
+  const auto first = concat({CLUSTER_ID, {0xFF}, timecode(0),
+                             simple_block(1, 0, true, {'A'})});
+  const auto segment = concat(
+      {first, CLUSTER_ID, {0xFF}, timecode(50),
+       simple_block(1, 0, false, {'B'})});
+  hisui::webm::input::Index index(TRACKS, 0, MS);
+  const auto get_data = make_data_getter(segment);
+  const auto end = static_cast<std::int64_t>(std::size(segment));
+
+  const auto second = index.addClusterFrames(get_data, 0, end);
+  BOOST_REQUIRE(second);
+  BOOST_REQUIRE_EQUAL(*second, static_cast<std::int64_t>(std::size(first)));
+  BOOST_REQUIRE_EQUAL(std::size(*index.getFrames(1)), 1);
+  BOOST_REQUIRE_EQUAL(*index.addClusterFrames(get_data, *second, end), end);
+
+  const auto& frames = *index.getFrames(1);
+  BOOST_REQUIRE_EQUAL(std::size(frames), 2);
+  BOOST_REQUIRE_EQUAL(frame_data(segment, frames[1]), "B");
+  BOOST_REQUIRE_EQUAL(frames[1].timestamp_ns, 50 * MS);
+
+  // 書き込み中のファイルのように長さが書かれていなければ最後のフレームから決める
+  BOOST_REQUIRE_EQUAL(index.getDuration(), 0);
+  index.updateDurationByFrames();
+  BOOST_REQUIRE_EQUAL(index.getDuration(), 50 * MS);
+}
+
+BOOST_AUTO_TEST_CASE(add_cluster_frames_truncated_block) {
+  // Block の中身が Cluster の範囲を超えている
+  auto segment = element(CLUSTER_ID,
+                         concat({timecode(0), SIMPLE_BLOCK_ID, {0x88, 0x81}}));
+  hisui::webm::input::Index index(TRACKS, 0, MS);
+  BOOST_REQUIRE_THROW(
+      index.addClusterFrames(make_data_getter(segment), 0,
+                             static_cast<std::int64_t>(std::size(segment))),
+      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(cache_round_trip) {
+  const auto directory = make_directory("hisui_index_test_cache");
+  const auto segment = make_segment();
+  const auto saved = make_index(segment);
+  const std::string file_path = "/path/to/input.webm";
+  saved.save(directory.string(), file_path, 1234, "1700000000.000000001");
+  // 書きかけのファイルは残らない
+  BOOST_REQUIRE_EQUAL(
+      std::distance(std::filesystem::directory_iterator(directory),
+                    std::filesystem::directory_iterator()),
+      1);
+
+  const auto loaded = hisui::webm::input::Index::load(
+      directory.string(), file_path, 1234, "1700000000.000000001");
+  BOOST_REQUIRE(loaded);
+  BOOST_REQUIRE_EQUAL(loaded->getDuration(), 200 * MS);
+  const auto video = loaded->findTrack(hisui::webm::input::TrackType::Video);
+  BOOST_REQUIRE(video);
+  BOOST_REQUIRE_EQUAL(video->info.codec_id, "V_VP8");
+  BOOST_REQUIRE_EQUAL(video->info.width, 320);
+  BOOST_REQUIRE_EQUAL(video->info.height, 240);
+  const auto audio = loaded->findTrack(hisui::webm::input::TrackType::Audio);
+  BOOST_REQUIRE(audio);
+  BOOST_REQUIRE_EQUAL(audio->info.channels, 2);
+  BOOST_REQUIRE_EQUAL(audio->info.sampling_rate, 48000.0);
+
+  for (const std::uint64_t track_number : {1U, 2U}) {
+    const auto& expected = *saved.getFrames(track_number);
+    const auto& actual = *loaded->getFrames(track_number);
+    BOOST_REQUIRE_EQUAL(std::size(actual), std::size(expected));
+    for (std::size_t i = 0; i < std::size(expected); ++i) {
+      BOOST_REQUIRE_EQUAL(actual[i].pos, expected[i].pos);
+      BOOST_REQUIRE_EQUAL(actual[i].size, expected[i].size);
+      BOOST_REQUIRE_EQUAL(actual[i].timestamp_ns, expected[i].timestamp_ns);
+      BOOST_REQUIRE_EQUAL(actual[i].is_key, expected[i].is_key);
+      BOOST_REQUIRE_EQUAL(actual[i].is_first_in_block,
+                          expected[i].is_first_in_block);
+    }
+  }
+  // 別のディレクトリの同じ名前のファイルとは区別する
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(
+      directory.string(), "/other/input.webm", 1234, "1700000000.000000001"));
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(cache_invalidation) {
+  const auto directory = make_directory("hisui_index_test_invalidation");
+  const std::string file_path = "/path/to/input.webm";
+  const std::string version = "1700000000.000000001";
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(directory.string(),
+                                                 file_path, 1234, version));
+
+  make_index(make_segment())
+      .save(directory.string(), file_path, 1234, version);
+  BOOST_REQUIRE(hisui::webm::input::Index::load(directory.string(), file_path,
+                                                1234, version));
+  // 保存した後にファイルが書き換えられた
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(directory.string(),
+                                                 file_path, 1235, version));
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(
+      directory.string(), file_path, 1234, "1700000000.000000002"));
+
+  // 途中で切れたキャッシュは使わない
+  const auto cache_path =
+      std::filesystem::directory_iterator(directory)->path();
+  std::filesystem::resize_file(cache_path,
+                               std::filesystem::file_size(cache_path) - 1);
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(directory.string(),
+                                                 file_path, 1234, version));
+  // 書式の版が違う
+  make_index(make_segment())
+      .save(directory.string(), file_path, 1234, version);
+  {
+    std::fstream fs(cache_path, std::ios::binary | std::ios::in |
+                                    std::ios::out);
+    fs.seekp(8);
+    fs.put(static_cast<char>(0x7F));
+  }
+  BOOST_REQUIRE(!hisui::webm::input::Index::load(directory.string(),
+                                                 file_path, 1234, version));
+  std::filesystem::remove_all(directory);
+}
+
+// 保存した Index を使い, Segment を解析せずにキーフレームへ読み飛ばす
+BOOST_AUTO_TEST_CASE(seek_to_key_frame_by_cached_index) {
+  const auto directory = make_directory("hisui_index_test_seek");
+  const auto segment = make_segment();
+  const auto file_path = (directory / "input.webm").string();
+  write_file(file_path, segment);
+  {
+    const hisui::webm::input::MappedReader reader(file_path);
+    make_index(segment).save((directory / "cache").string(), file_path,
+                             reader.getSize(), reader.getVersion());
+  }
+  hisui::webm::input::Demuxer::setIndexCacheDirectory(
+      (directory / "cache").string());
+
+  {
+    hisui::webm::input::VideoContext context(file_path);
+    BOOST_REQUIRE(context.init());
+    BOOST_REQUIRE_EQUAL(context.getWidth(), 320);
+    BOOST_REQUIRE_EQUAL(context.getDuration(), 200 * MS);
+
+    // 120ms までの最後のキーフレームは 100ms
+    BOOST_REQUIRE(context.seekToKeyFrame(120 * MS));
+    BOOST_REQUIRE_EQUAL(*context.peekNextTimestamp(), 100 * MS);
+    BOOST_REQUIRE(context.readFrame());
+    BOOST_REQUIRE(context.isKeyFrame());
+    BOOST_REQUIRE_EQUAL(
+        std::string(reinterpret_cast<const char*>(context.getBuffer()),
+                    context.getBufferSize()),
+        "CC");
+
+    // 次のフレームから 150ms までにキーフレームは無いので読み進めない
+    BOOST_REQUIRE(!context.seekToKeyFrame(150 * MS));
+    BOOST_REQUIRE(context.readFrame());
+    BOOST_REQUIRE_EQUAL(context.getTimestamp(), 133 * MS);
+    BOOST_REQUIRE(!context.isKeyFrame());
+    BOOST_REQUIRE(!context.readFrame());
+  }
+
+  hisui::webm::input::Demuxer::setIndexCacheDirectory("");
+  std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()